@@ -0,0 +1,335 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//////////////////////////////////////////////////////////////////////////
+// Deterministic synthetic SAM generator for the benchmarks.
+//
+// Writes a random reference to <outBase>.fa and coordinate sorted reads
+// sampled from it to <outBase>.sam.  The same options and seed always
+// give the same files.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <queue>
+#include <math.h>
+
+namespace
+{
+    // xorshift64*, so the output does not depend on the standard
+    // library's distributions.
+    class Random
+    {
+    public:
+        Random(uint64_t seed) : myState(seed ? seed : 0x9E3779B97F4A7C15ULL) {}
+        uint64_t next()
+        {
+            myState ^= myState >> 12;
+            myState ^= myState << 25;
+            myState ^= myState >> 27;
+            return(myState * 0x2545F4914F6CDD1DULL);
+        }
+        // Uniform in [0, 1).
+        double nextDouble()
+        {
+            return((next() >> 11) * (1.0 / 9007199254740992.0));
+        }
+        uint32_t nextInt(uint32_t limit)
+        {
+            return(next() % limit);
+        }
+    private:
+        uint64_t myState;
+    };
+
+    struct Settings
+    {
+        std::string outBase;
+        int numRefs;
+        uint32_t refLength;
+        double depth;
+        int readLength;
+        int insertSize;
+        double pairRate;
+        double dupRate;
+        double discordantRate;
+        double errorRate;
+        int numReadGroups;
+        uint64_t seed;
+    };
+
+    // A read waiting for the output to reach its position.
+    struct PendingRead
+    {
+        int refID;
+        uint32_t pos;
+        uint64_t order;
+        std::string line;
+        bool operator>(const PendingRead& other) const
+        {
+            if(refID != other.refID) return(refID > other.refID);
+            if(pos != other.pos) return(pos > other.pos);
+            return(order > other.order);
+        }
+    };
+
+    typedef std::priority_queue<PendingRead, std::vector<PendingRead>, 
+                                std::greater<PendingRead> > PendingQueue;
+
+    const char BASES[] = "ACGT";
+
+    void printUsage(FILE* fp)
+    {
+        fprintf(fp, "Usage: synthSam --out <outBase> [--refs <n>] [--refLength <bases>]\n"
+                "       [--depth <x>] [--readLength <bases>] [--insertSize <bases>]\n"
+                "       [--pairRate <fraction>] [--dupRate <fraction>]\n"
+                "       [--discordantRate <fraction>] [--errorRate <fraction>]\n"
+                "       [--readGroups <n>] [--seed <n>]\n"
+                "Writes <outBase>.fa and the coordinate sorted <outBase>.sam.\n"
+                "Prints the number of records written to stdout.\n");
+    }
+
+    bool parseArgs(int argc, char** argv, Settings& settings)
+    {
+        for(int i = 1; i < argc; i++)
+        {
+            if(i + 1 >= argc)
+            {
+                return(false);
+            }
+            const char* name = argv[i];
+            const char* value = argv[++i];
+            if(strcmp(name, "--out") == 0) settings.outBase = value;
+            else if(strcmp(name, "--refs") == 0) settings.numRefs = atoi(value);
+            else if(strcmp(name, "--refLength") == 0) settings.refLength = strtoul(value, NULL, 10);
+            else if(strcmp(name, "--depth") == 0) settings.depth = atof(value);
+            else if(strcmp(name, "--readLength") == 0) settings.readLength = atoi(value);
+            else if(strcmp(name, "--insertSize") == 0) settings.insertSize = atoi(value);
+            else if(strcmp(name, "--pairRate") == 0) settings.pairRate = atof(value);
+            else if(strcmp(name, "--dupRate") == 0) settings.dupRate = atof(value);
+            else if(strcmp(name, "--discordantRate") == 0) settings.discordantRate = atof(value);
+            else if(strcmp(name, "--errorRate") == 0) settings.errorRate = atof(value);
+            else if(strcmp(name, "--readGroups") == 0) settings.numReadGroups = atoi(value);
+            else if(strcmp(name, "--seed") == 0) settings.seed = strtoull(value, NULL, 10);
+            else return(false);
+        }
+        return(!settings.outBase.empty() && (settings.numRefs > 0) &&
+               (settings.readLength > 0) && 
+               (settings.refLength > (uint32_t)settings.insertSize) &&
+               (settings.insertSize >= settings.readLength) &&
+               (settings.numReadGroups >= 0));
+    }
+
+    // Read sequence copied from the reference with substitution errors,
+    // and its qualities.
+    void sampleRead(const std::string& ref, uint32_t pos, const Settings& settings,
+                    Random& random, std::string& seq, std::string& qual)
+    {
+        seq.assign(ref, pos, settings.readLength);
+        qual.resize(settings.readLength);
+        for(int i = 0; i < settings.readLength; i++)
+        {
+            qual[i] = '!' + 20 + random.nextInt(21);
+            if(random.nextDouble() < settings.errorRate)
+            {
+                seq[i] = BASES[(strchr(BASES, seq[i]) - BASES + 1 + random.nextInt(3)) % 4];
+            }
+        }
+    }
+
+    void addRead(PendingQueue& pending, uint64_t& order, const Settings& settings,
+                 const std::vector<std::string>& refs, const std::string& name,
+                 int flag, int refID, uint32_t pos, int mateRefID, 
+                 uint32_t matePos, int tlen, int readGroup, Random& random)
+    {
+        std::string seq;
+        std::string qual;
+        sampleRead(refs[refID], pos, settings, random, seq, qual);
+        char fields[256];
+        snprintf(fields, sizeof(fields), "\t%d\tref%d\t%u\t60\t%dM\t", 
+                 flag, refID + 1, pos + 1, settings.readLength);
+        PendingRead read;
+        read.refID = refID;
+        read.pos = pos;
+        read.order = order++;
+        read.line = name;
+        read.line += fields;
+        if(mateRefID < 0)
+        {
+            read.line += "*\t0\t0\t";
+        }
+        else
+        {
+            snprintf(fields, sizeof(fields), "%s\t%u\t%d\t",
+                     (mateRefID == refID) ? "=" : ("ref" + std::to_string(mateRefID + 1)).c_str(),
+                     matePos + 1, tlen);
+            read.line += fields;
+        }
+        read.line += seq;
+        read.line += '\t';
+        read.line += qual;
+        if(settings.numReadGroups > 0)
+        {
+            read.line += "\tRG:Z:rg" + std::to_string(readGroup + 1);
+        }
+        pending.push(read);
+    }
+
+    // Write the reads that cannot be preceded by reads not yet generated.
+    void flushPending(FILE* fp, PendingQueue& pending, int refID, uint32_t pos,
+                      uint64_t& numRecords)
+    {
+        while(!pending.empty() && 
+              ((pending.top().refID < refID) ||
+               ((pending.top().refID == refID) && (pending.top().pos <= pos))))
+        {
+            fputs(pending.top().line.c_str(), fp);
+            fputc('\n', fp);
+            pending.pop();
+            ++numRecords;
+        }
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    settings.numRefs = 2;
+    settings.refLength = 1000000;
+    settings.depth = 10;
+    settings.readLength = 100;
+    settings.insertSize = 300;
+    settings.pairRate = 0.9;
+    settings.dupRate = 0.05;
+    settings.discordantRate = 0.01;
+    settings.errorRate = 0.01;
+    settings.numReadGroups = 1;
+    settings.seed = 1;
+
+    if(!parseArgs(argc, argv, settings))
+    {
+        printUsage(stderr);
+        return(-1);
+    }
+
+    Random random(settings.seed);
+    std::vector<std::string> refs(settings.numRefs);
+    std::string faName = settings.outBase + ".fa";
+    FILE* fa = fopen(faName.c_str(), "w");
+    if(fa == NULL)
+    {
+        fprintf(stderr, "Failed to open %s\n", faName.c_str());
+        return(-1);
+    }
+    for(int r = 0; r < settings.numRefs; r++)
+    {
+        refs[r].resize(settings.refLength);
+        fprintf(fa, ">ref%d\n", r + 1);
+        for(uint32_t i = 0; i < settings.refLength; i++)
+        {
+            refs[r][i] = BASES[random.nextInt(4)];
+        }
+        for(uint32_t i = 0; i < settings.refLength; i += 60)
+        {
+            fprintf(fa, "%s\n", refs[r].substr(i, 60).c_str());
+        }
+    }
+    fclose(fa);
+
+    std::string samName = settings.outBase + ".sam";
+    FILE* sam = fopen(samName.c_str(), "w");
+    if(sam == NULL)
+    {
+        fprintf(stderr, "Failed to open %s\n", samName.c_str());
+        return(-1);
+    }
+    fprintf(sam, "@HD\tVN:1.4\tSO:coordinate\n");
+    for(int r = 0; r < settings.numRefs; r++)
+    {
+        fprintf(sam, "@SQ\tSN:ref%d\tLN:%u\n", r + 1, settings.refLength);
+    }
+    for(int g = 0; g < settings.numReadGroups; g++)
+    {
+        fprintf(sam, "@RG\tID:rg%d\tSM:sample\tLB:lib%d\n", g + 1, g + 1);
+    }
+
+    // Fragment starts are spaced so the reads give the requested depth.
+    double readsPerFragment = 1 + settings.pairRate;
+    double meanGap = settings.readLength * readsPerFragment / settings.depth;
+    PendingQueue pending;
+    uint64_t order = 0;
+    uint64_t numRecords = 0;
+    uint64_t numFragments = 0;
+    uint32_t lastStart = settings.refLength - settings.insertSize;
+    for(int r = 0; r < settings.numRefs; r++)
+    {
+        double pos = 0;
+        while(true)
+        {
+            pos += -meanGap * log(1 - random.nextDouble());
+            if(pos > lastStart)
+            {
+                break;
+            }
+            uint32_t start = pos;
+            flushPending(sam, pending, r, start, numRecords);
+
+            int readGroup = (settings.numReadGroups > 0) ? 
+                random.nextInt(settings.numReadGroups) : 0;
+            bool paired = random.nextDouble() < settings.pairRate;
+            bool discordant = paired && (r + 1 < settings.numRefs) &&
+                (random.nextDouble() < settings.discordantRate);
+            int copies = (random.nextDouble() < settings.dupRate) ? 2 : 1;
+            uint32_t mateStart = start + settings.insertSize - settings.readLength;
+            for(int c = 0; c < copies; c++)
+            {
+                std::string name = "read" + std::to_string(++numFragments);
+                if(!paired)
+                {
+                    addRead(pending, order, settings, refs, name, 
+                            random.nextInt(2) ? 16 : 0,
+                            r, start, -1, 0, 0, readGroup, random);
+                }
+                else if(discordant)
+                {
+                    addRead(pending, order, settings, refs, name, 0x61,
+                            r, start, r + 1, start, 0, readGroup, random);
+                    addRead(pending, order, settings, refs, name, 0x91,
+                            r + 1, start, r, start, 0, readGroup, random);
+                }
+                else
+                {
+                    addRead(pending, order, settings, refs, name, 0x63,
+                            r, start, r, mateStart, settings.insertSize,
+                            readGroup, random);
+                    addRead(pending, order, settings, refs, name, 0x93,
+                            r, mateStart, r, start, -settings.insertSize,
+                            readGroup, random);
+                }
+            }
+        }
+    }
+    flushPending(sam, pending, settings.numRefs, 0, numRecords);
+    fclose(sam);
+
+    printf("%llu\n", (unsigned long long)numRecords);
+    return(0);
+}
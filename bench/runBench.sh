@@ -0,0 +1,68 @@
+#!/bin/bash
+#
+# End to end benchmarks on deterministic synthetic data.
+# Each tool is run with --profile, which gives the time of its main
+# stages; this script adds the records per second and the peak memory.
+#
+# Settings can be overridden in the environment, for example:
+#   DEPTH=30 REF_LENGTH=10000000 THREADS=4 ./runBench.sh
+
+BAM=${BAM:-../bin/bam}
+OUT=${OUT:-results}
+REFS=${REFS:-2}
+REF_LENGTH=${REF_LENGTH:-2000000}
+DEPTH=${DEPTH:-20}
+READ_LENGTH=${READ_LENGTH:-100}
+PAIR_RATE=${PAIR_RATE:-0.9}
+DUP_RATE=${DUP_RATE:-0.05}
+DISCORDANT_RATE=${DISCORDANT_RATE:-0.01}
+READ_GROUPS=${READ_GROUPS:-4}
+SEED=${SEED:-1}
+THREADS=${THREADS:-1}
+
+mkdir -p $OUT
+
+SYNTH_ARGS="--refs $REFS --refLength $REF_LENGTH --depth $DEPTH --readLength $READ_LENGTH --pairRate $PAIR_RATE --dupRate $DUP_RATE --discordantRate $DISCORDANT_RATE --seed $SEED"
+
+NUM_RECORDS=$(./synthSam --out $OUT/synth $SYNTH_ARGS --readGroups $READ_GROUPS) || exit 1
+./synthSam --out $OUT/merge1 $SYNTH_ARGS --readGroups 0 > /dev/null || exit 1
+./synthSam --out $OUT/merge2 $SYNTH_ARGS --readGroups 0 --seed $((SEED + 1)) > /dev/null || exit 1
+for name in synth merge1 merge2
+do
+    $BAM convert --in $OUT/$name.sam --out $OUT/$name.bam --noph 2> /dev/null || exit 1
+done
+printf "BAM\tID\tSM\tLB\n$OUT/merge1.bam\tRG1\tsample\tlib1\n$OUT/merge2.bam\tRG2\tsample\tlib2\n" > $OUT/merge.list
+
+echo "Synthetic input: $NUM_RECORDS records, $SYNTH_ARGS --readGroups $READ_GROUPS"
+printf "%-12s %12s %12s %12s\n" "tool" "seconds" "records/sec" "peakRssKB"
+
+STATUS=0
+# Run a tool, reporting its throughput from the time of the whole command
+# and its peak RSS from the --profile report.
+runBench()
+{
+    local name=$1
+    shift
+    local start=$(date +%s.%N)
+    "$@" --noph --threads $THREADS --profile=$OUT/$name.json > $OUT/$name.out 2> $OUT/$name.log
+    local status=$?
+    local end=$(date +%s.%N)
+    if [ $status -ne 0 ]
+    then
+        echo "$name failed, see $OUT/$name.log"
+        STATUS=1
+        return
+    fi
+    local rss=$(sed -n 's/.*"peakRssKB": \([0-9]*\).*/\1/p' $OUT/$name.json)
+    awk -v name=$name -v start=$start -v end=$end -v recs=$NUM_RECORDS -v rss=$rss \
+        'BEGIN { secs = end - start; printf "%-12s %12.3f %12.0f %12d\n", name, secs, (secs > 0) ? recs / secs : 0, rss }'
+}
+
+runBench dedup $BAM dedup --in $OUT/synth.bam --out $OUT/dedup.bam
+runBench recab $BAM recab --in $OUT/synth.bam --out $OUT/recab.bam --refFile $OUT/synth.fa
+runBench mergeBam $BAM mergeBam --list $OUT/merge.list --out $OUT/mergeBam.bam
+runBench clipOverlap $BAM clipOverlap --in $OUT/synth.bam --out $OUT/clipOverlap.bam
+runBench bam2FastQ $BAM bam2FastQ --in $OUT/synth.bam --outBase $OUT/bam2FastQ
+runBench stats $BAM stats --in $OUT/synth.bam --basic
+
+exit $STATUS
@@ -0,0 +1,245 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <iostream>
+
+#include "BalancedShards.h"
+#include "ParallelBgzf.h"
+
+// BAI pseudo-bin holding the offsets & counts of a reference's records.
+static const uint32_t BAI_META_BIN = 37450;
+
+// Compression ratio assumed to estimate the compressed position of a
+// record from its offset in its BGZF block, so records in the same
+// block (all of a small file) can be told apart.
+static const uint64_t ASSUMED_COMPRESSION_RATIO = 4;
+
+template<class T>
+static T readValue(const char* ptr)
+{
+    T value;
+    memcpy(&value, ptr, sizeof(T));
+    return(value);
+}
+
+
+bool BalancedShards::plan(const char* bamFile, const char* indexFile,
+                          int32_t numRefs, int numShards,
+                          std::vector<Shard>& shards)
+{
+    shards.clear();
+    std::vector<RefWindows> refs;
+    if(!readIndex(indexFile, refs))
+    {
+        return(false);
+    }
+    if((int32_t)refs.size() != numRefs)
+    {
+        std::cerr << "ERROR: The index " << indexFile << " has "
+                  << refs.size() << " references, but " << bamFile
+                  << " has " << numRefs << ".\n";
+        return(false);
+    }
+    struct stat fileStat;
+    if(stat(bamFile, &fileStat) != 0)
+    {
+        std::cerr << "ERROR: Failed to read the size of " << bamFile << ".\n";
+        return(false);
+    }
+    uint64_t fileEnd = fileStat.st_size;
+    if(fileEnd >= ParallelBgzf::EOF_MARKER_SIZE)
+    {
+        fileEnd -= ParallelBgzf::EOF_MARKER_SIZE;
+    }
+
+    // References without an end in the index end where the next
+    // reference with records starts, windows without records where the
+    // next window with records starts.
+    uint64_t nextStart = fileEnd;
+    uint64_t mappedEnd = 0;
+    for(int32_t ref = numRefs - 1; ref >= 0; ref--)
+    {
+        RefWindows& windows = refs[ref];
+        if(windows.end == 0)
+        {
+            windows.end = nextStart;
+        }
+        uint64_t next = windows.end;
+        for(size_t w = windows.offsets.size(); w > 0; w--)
+        {
+            if(windows.offsets[w - 1] == 0)
+            {
+                windows.offsets[w - 1] = next;
+            }
+            next = windows.offsets[w - 1];
+        }
+        if(!windows.offsets.empty())
+        {
+            nextStart = windows.offsets[0];
+        }
+        mappedEnd = std::max(mappedEnd, windows.end);
+    }
+    uint64_t unmappedBytes = (fileEnd > mappedEnd) ? fileEnd - mappedEnd : 0;
+
+    uint64_t total = unmappedBytes;
+    for(int32_t ref = 0; ref < numRefs; ref++)
+    {
+        for(size_t w = 0; w < refs[ref].offsets.size(); w++)
+        {
+            total += getWindowBytes(refs[ref], w);
+        }
+    }
+
+    // Cut after the window that reaches each multiple of total/numShards.
+    int nextCut = 1;
+    uint64_t done = 0;
+    shards.push_back(Shard());
+    shards.back().bytes = 0;
+    for(int32_t ref = 0; ref < numRefs; ref++)
+    {
+        const RefWindows& windows = refs[ref];
+        Region region;
+        region.refID = ref;
+        region.start = 0;
+        for(size_t w = 0; w < windows.offsets.size(); w++)
+        {
+            uint64_t bytes = getWindowBytes(windows, w);
+            done += bytes;
+            shards.back().bytes += bytes;
+            if((nextCut >= numShards) || (bytes == 0) ||
+               ((double)done < (double)total * nextCut / numShards))
+            {
+                continue;
+            }
+            region.end = (w + 1) * WINDOW_SIZE;
+            shards.back().regions.push_back(region);
+            region.start = region.end;
+            shards.push_back(Shard());
+            shards.back().bytes = 0;
+            while((nextCut < numShards) &&
+                  ((double)done >= (double)total * nextCut / numShards))
+            {
+                ++nextCut;
+            }
+        }
+        // The rest of the reference, which covers records past the end
+        // of the linear index.
+        region.end = -1;
+        shards.back().regions.push_back(region);
+    }
+    Region unmapped;
+    unmapped.refID = -1;
+    unmapped.start = 0;
+    unmapped.end = -1;
+    shards.back().regions.push_back(unmapped);
+    shards.back().bytes += unmappedBytes;
+    return(true);
+}
+
+
+uint64_t BalancedShards::getCompressedPosition(uint64_t virtualOffset)
+{
+    return((virtualOffset >> 16) +
+           ((virtualOffset & 0xFFFF) / ASSUMED_COMPRESSION_RATIO));
+}
+
+
+uint64_t BalancedShards::getWindowBytes(const RefWindows& windows, size_t w)
+{
+    uint64_t next = (w + 1 < windows.offsets.size()) ?
+        windows.offsets[w + 1] : windows.end;
+    return((next > windows.offsets[w]) ? next - windows.offsets[w] : 0);
+}
+
+
+bool BalancedShards::readIndex(const char* indexFile,
+                               std::vector<RefWindows>& refs)
+{
+    std::vector<char> index;
+    FILE* file = fopen(indexFile, "rb");
+    if(file != NULL)
+    {
+        char buffer[65536];
+        size_t numRead = 0;
+        while((numRead = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        {
+            index.insert(index.end(), buffer, buffer + numRead);
+        }
+        fclose(file);
+    }
+
+    // Check each field fits before reading it.
+    const char* ptr = index.data();
+    const char* end = ptr + index.size();
+    bool valid = ((index.size() >= 8) && (memcmp(ptr, "BAI\1", 4) == 0));
+    int32_t numRefs = valid ? readValue<int32_t>(ptr + 4) : 0;
+    ptr += 8;
+    // Each reference takes at least 8 bytes.
+    valid = valid && (numRefs >= 0) && ((end - ptr) / 8 >= numRefs);
+    refs.assign(valid ? numRefs : 0, RefWindows());
+    for(int32_t ref = 0; valid && (ref < numRefs); ref++)
+    {
+        RefWindows& windows = refs[ref];
+        windows.end = 0;
+        valid = (end - ptr >= 4);
+        int32_t numBins = valid ? readValue<int32_t>(ptr) : 0;
+        ptr += 4;
+        for(int32_t bin = 0; valid && (bin < numBins); bin++)
+        {
+            valid = (end - ptr >= 8);
+            if(!valid)
+            {
+                break;
+            }
+            uint32_t binNum = readValue<uint32_t>(ptr);
+            int32_t numChunks = readValue<int32_t>(ptr + 4);
+            ptr += 8;
+            valid = ((numChunks >= 0) && (end - ptr >= (int64_t)numChunks * 16));
+            if(!valid)
+            {
+                break;
+            }
+            if((binNum == BAI_META_BIN) && (numChunks > 0))
+            {
+                // The first chunk spans the reference's records.
+                windows.end = getCompressedPosition(readValue<uint64_t>(ptr + 8));
+            }
+            ptr += numChunks * 16;
+        }
+        valid = valid && (end - ptr >= 4);
+        int32_t numIntervals = valid ? readValue<int32_t>(ptr) : 0;
+        ptr += 4;
+        valid = valid && (numIntervals >= 0) &&
+            (end - ptr >= (int64_t)numIntervals * 8);
+        for(int32_t i = 0; valid && (i < numIntervals); i++)
+        {
+            windows.offsets.push_back(
+                getCompressedPosition(readValue<uint64_t>(ptr + i * 8)));
+        }
+        ptr += numIntervals * 8;
+    }
+    if(!valid)
+    {
+        std::cerr << "ERROR: Invalid or missing BAI index " << indexFile
+                  << std::endl;
+    }
+    return(valid);
+}
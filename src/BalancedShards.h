@@ -0,0 +1,88 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BALANCED_SHARDS_H__
+#define __BALANCED_SHARDS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/// Cuts the genome of a coordinate sorted BAM file into shards of about
+/// the same amount of data, estimated from the compressed offsets of the
+/// 16kb windows of its BAI linear index, so jobs run on the shards take
+/// about the same time.  Shards are cut on window boundaries and may
+/// span several (small) references.  A record belongs to the shard
+/// holding its start position, so reading each region of a shard with
+/// SetReadSection and skipping the records that start before the region
+/// reads each record exactly once.
+class BalancedShards
+{
+public:
+    /// 0-based start and exclusive end on the reference, end -1 for the
+    /// end of the reference.  refID -1 is the unmapped reads at the end
+    /// of the file.
+    struct Region
+    {
+        int32_t refID;
+        int32_t start;
+        int32_t end;
+    };
+
+    struct Shard
+    {
+        std::vector<Region> regions;
+        // Estimated compressed bytes of the shard's records.
+        uint64_t bytes;
+    };
+
+    /// Size of the BAI linear index windows the shards are cut on.
+    static const int32_t WINDOW_SIZE = 16384;
+
+    /// Plan up to numShards shards covering all numRefs references and
+    /// the unmapped reads, using the BAI index of bamFile.  There are
+    /// fewer shards if there are fewer windows with data.
+    /// Returns false after printing the reason to stderr on failure.
+    static bool plan(const char* bamFile, const char* indexFile,
+                     int32_t numRefs, int numShards,
+                     std::vector<Shard>& shards);
+
+private:
+    // Compressed position (see getCompressedPosition) of the first record
+    // overlapping each window (or of the next window with a record), and
+    // of the end of the reference's records.
+    struct RefWindows
+    {
+        std::vector<uint64_t> offsets;
+        uint64_t end;
+    };
+
+    // Read the linear index and the end of each reference's records from
+    // the BAI index.
+    static bool readIndex(const char* indexFile,
+                          std::vector<RefWindows>& refs);
+
+    // Estimated position in the compressed file of a virtual offset,
+    // 0 for 0 (no record).
+    static uint64_t getCompressedPosition(uint64_t virtualOffset);
+
+    // Compressed bytes from the start of the window to the next one.
+    static uint64_t getWindowBytes(const RefWindows& windows, size_t w);
+};
+
+#endif
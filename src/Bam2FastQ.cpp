@@ -15,15 +15,26 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdio.h>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <string>
+
 #include "Bam2FastQ.h"
 #include "BgzfFileType.h"
 #include "BaseUtilities.h"
 #include "SamFlag.h"
 #include "SamFile.h"
 #include "SamHelper.h"
+#include "StringArray.h"
+#include "ThreadedSamFile.h"
+#include "RecordCollator.h"
+#include "RemoteBamCache.h"
 
 const char* Bam2FastQ::DEFAULT_FIRST_EXT = "/1";
 const char* Bam2FastQ::DEFAULT_SECOND_EXT = "/2";
+const int Bam2FastQ::NUM_SPILL_FILES = 16;
 
 
 
@@ -44,6 +55,13 @@ Bam2FastQ::Bam2FastQ()
       myNumQualTagErrors(0),
       myReverseComp(true),
       myRNPlus(false),
+      myMaxMateMap(0),
+      mySpillPrefix(""),
+      mySpillFiles(),
+      mySpilledMatePos(),
+      myNumSpilled(0),
+      myRefPtr(NULL),
+      myPrevRNRec(NULL),
       myOutBase(""),
       myFirstRNExt(DEFAULT_FIRST_EXT),
       mySecondRNExt(DEFAULT_SECOND_EXT),
@@ -77,12 +95,15 @@ void Bam2FastQ::printDescription(std::ostream& os)
 void Bam2FastQ::printUsage(std::ostream& os)
 {
     BamExecutable::printUsage(os);
-    os << "\t./bam bam2FastQ --in <inputFile> [--readName] [--splitRG] [--qualField <tag>] [--refFile <referenceFile>] [--outBase <outputFileBase>] [--firstOut <1stReadInPairOutFile>] [--merge|--secondOut <2ndReadInPairOutFile>] [--unpairedOut <unpairedOutFile>] [--firstRNExt <firstInPairReadNameExt>] [--secondRNExt <secondInPairReadNameExt>] [--rnPlus] [--noReverseComp] [--region <chr>[:<pos>[:<base>]]] [--gzip] [--noeof] [--params]" << std::endl;
+    os << "\t./bam bam2FastQ --in <inputFile> [--readName] [--collate] [--splitRG] [--qualField <tag>] [--refFile <referenceFile>] [--outBase <outputFileBase>] [--firstOut <1stReadInPairOutFile>] [--merge|--secondOut <2ndReadInPairOutFile>] [--unpairedOut <unpairedOutFile>] [--firstRNExt <firstInPairReadNameExt>] [--secondRNExt <secondInPairReadNameExt>] [--rnPlus] [--noReverseComp] [--region <chr>[:<pos>[:<base>]][,...]|--byIndex] [--gzip] [--noeof] [--maxMateMap <numRecords>] [--spillPrefix <prefix>] [--params]" << std::endl;
     os << "\tRequired Parameters:" << std::endl;
     os << "\t\t--in       : the SAM/BAM file to convert to FastQ" << std::endl;
     os << "\tOptional Parameters:" << std::endl;
     os << "\t\t--readname      : Process the BAM as readName sorted instead\n"
               << "\t\t                  of coordinate if the header does not indicate a sort order." << std::endl;
+    os << "\t\t--collate       : Group the mates by read name through temporary files rather\n"
+              << "\t\t                  than relying on the sort order, for unsorted or coordinate\n"
+              << "\t\t                  sorted files whose mates are far apart." << std::endl;
     os << "\t\t--splitRG       : Split into RG specific fastqs." << std::endl;
     os << "\t\t--qualField     : Use the base quality from the specified tag\n";
     os << "\t\t                  rather than from the Quality field (default)" << std::endl;
@@ -98,9 +119,21 @@ void Bam2FastQ::printUsage(std::ostream& os)
     os << "\t\t--noReverseComp : Do not reverse complement reads marked as reverse\n";
     os << "\t\t--region        : Only convert reads containing the specified region/nucleotide.\n"
               << "\t\t                  Position formatted as: chr:pos:base\n"
-              << "\t\t                  pos (0-based) & base are optional.\n";
+              << "\t\t                  pos (0-based) & base are optional.\n"
+              << "\t\t                  If --in is an http://, s3://, or file:// URL of a BAM file,\n"
+              << "\t\t                  only the blocks needed for the region are fetched.\n"
+              << "\t\t                  Separate several regions with ',' to read them in\n"
+              << "\t\t                  parallel using the index (see --byIndex).\n";
+    os << "\t\t--byIndex       : For indexed coordinate sorted BAM files, read each reference\n"
+              << "\t\t                  and the unmapped reads in parallel (up to --threads) using\n"
+              << "\t\t                  the index.  The output is the same as reading the file.\n";
     os << "\t\t--gzip          : Compress the output FASTQ files using gzip\n";
     os << "\t\t--noeof         : Do not expect an EOF block on a bam file." << std::endl;
+    os << "\t\t--maxMateMap    : For coordinate sorted files, the maximum number of reads to\n"
+              << "\t\t                  keep in memory waiting for their mates, default 0 (no limit).\n"
+              << "\t\t                  Beyond that, the reads with the furthest mates are spilled to\n"
+              << "\t\t                  disk and paired at the end." << std::endl;
+    os << "\t\t--spillPrefix   : Prefix for the --maxMateMap & --collate temporary files, default is outBase" << std::endl;
     os << "\t\t--params        : Print the parameter settings to stderr" << std::endl;
     os << "\tOptional OutputFile Names:" << std::endl;
     os << "\t\t--outBase       : Base output name for generated output files" << std::endl;
@@ -119,6 +152,7 @@ int Bam2FastQ::execute(int argc, char **argv)
     // Extract command line arguments.
     String inFile = "";
     bool readName = false;
+    bool collate = false;
     String refFile = "";
     String firstOut = "";
     String secondOut = "";
@@ -129,6 +163,7 @@ int Bam2FastQ::execute(int argc, char **argv)
     bool gzip = false;
     bool params = false;
     String region = "";
+    bool byIndex = false;
     char nucleotide = ' ';
 
     myOutBase = "";
@@ -140,6 +175,9 @@ int Bam2FastQ::execute(int argc, char **argv)
     myNumQualTagErrors = 0;
     myReverseComp = true;
     myRNPlus = false;
+    myMaxMateMap = 0;
+    mySpillPrefix = "";
+    myNumSpilled = 0;
     myFirstRNExt = DEFAULT_FIRST_EXT;
     mySecondRNExt = DEFAULT_SECOND_EXT;
     myCompression = InputFile::DEFAULT;
@@ -151,6 +189,7 @@ int Bam2FastQ::execute(int argc, char **argv)
         LONG_STRINGPARAMETER("in", &inFile)
         LONG_PARAMETER_GROUP("Optional Parameters")
         LONG_PARAMETER("readName", &readName)
+        LONG_PARAMETER("collate", &collate)
         LONG_PARAMETER("splitRG", &mySplitRG)
         LONG_STRINGPARAMETER("qualField", &myQField)
         LONG_PARAMETER("merge", &interleave)
@@ -160,8 +199,11 @@ int Bam2FastQ::execute(int argc, char **argv)
         LONG_PARAMETER("rnPlus", &myRNPlus)
         LONG_PARAMETER("noReverseComp", &myReverseComp)
         LONG_STRINGPARAMETER("region", &region)
+        LONG_PARAMETER("byIndex", &byIndex)
         LONG_PARAMETER("gzip", &gzip)
         LONG_PARAMETER("noeof", &noeof)
+        LONG_INTPARAMETER("maxMateMap", &myMaxMateMap)
+        LONG_STRINGPARAMETER("spillPrefix", &mySpillPrefix)
         LONG_PARAMETER("params", &params)
         LONG_PARAMETER_GROUP("Optional OutputFile Names")
         LONG_STRINGPARAMETER("outBase", &myOutBase)
@@ -187,44 +229,43 @@ int Bam2FastQ::execute(int argc, char **argv)
 
     String chr = "";
     int position = -1;
+    std::vector<Region> regions;
     if(region != "")
     {
-        // Parse region.
-        int chrStrEnd = region.FastFindChar(':',1);
-        if(chrStrEnd < 1)
-        {
-            // This region is just a chromosome.
-            chr = region;
-        }
-        else
+        StringArray regionStrs;
+        regionStrs.ReplaceColumns(region, ',');
+        for(int i = 0; i < regionStrs.Length(); i++)
         {
-            chr = region.Left(chrStrEnd);
-            int posStrEnd = region.FastFindChar(':',chrStrEnd+1);
-            String posStr;
-            if(posStrEnd < chrStrEnd)
+            regions.push_back(Region());
+            if(!parseRegion(regionStrs[i], regions.back()))
             {
-                // No base specified
-                posStr = region.SubStr(chrStrEnd+1);
-            }
-            else
-            {
-                posStr = region.Mid(chrStrEnd+1, posStrEnd-1);
-                nucleotide = toupper(region[posStrEnd + 1]);
-                if(posStrEnd + 1 != region.Length()-1)
-                {
-                    std::cerr << "ERROR: Invalid region string, '" << region
-                              << "', the nucleotide specified can only be a single base.\n";
-                    return(-1);
-                }
-            }
-            if(!posStr.AsInteger(position) || position < 0)
-            {
-                std::cerr << "ERROR: Invalid region string, '" << region
-                          << "', the position, '" << posStr << "' is not an integer.\n";
                 return(-1);
-            }                
+            }
         }
     }
+    if(byIndex && !regions.empty())
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        std::cerr << "ERROR: Cannot specify --byIndex & --region.\n";
+        return(-1);
+    }
+    // Several regions or the whole file by index are read in parallel.
+    bool bySection = byIndex || (regions.size() > 1);
+    if(regions.size() == 1)
+    {
+        chr = regions[0].chr;
+        position = regions[0].position;
+        nucleotide = regions[0].nucleotide;
+    }
+    if(bySection && collate)
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        std::cerr << "ERROR: Cannot specify --collate with --byIndex "
+                  << "or several regions.\n";
+        return(-1);
+    }
 
     // Check to see if the in file was specified, if not, report an error.
     if(inFile == "")
@@ -291,6 +332,18 @@ int Bam2FastQ::execute(int argc, char **argv)
         }
     }
 
+    if(myMaxMateMap < 0)
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        std::cerr << "ERROR: --maxMateMap cannot be negative.\n";
+        return(-1);
+    }
+    if(mySpillPrefix.IsEmpty())
+    {
+        mySpillPrefix = (myOutBase[0] != '-') ? myOutBase : String("bam2FastQ");
+    }
+
     if(mySplitRG)
     {
         std::string fqList = myOutBase.c_str();
@@ -328,10 +381,37 @@ int Bam2FastQ::execute(int argc, char **argv)
         inputParameters.Status();
     }
 
+    // Only fetch the parts of a remote file needed for the regions, its
+    // index is the local file name + ".bai".
+    std::string indexFile;
+    if(RemoteFile::isRemote(inFile.c_str()))
+    {
+        std::vector<RemoteBamCache::Region> remoteRegions;
+        for(unsigned int i = 0; i < regions.size(); i++)
+        {
+            int regionPos = regions[i].position;
+            remoteRegions.push_back(RemoteBamCache::Region(regions[i].chr.c_str(),
+                                                           std::max(regionPos, 0),
+                                                           (regionPos != -1) ? regionPos + 1 : -1));
+        }
+        std::string localIn = inFile.c_str();
+        if(!RemoteBamCache::localize(localIn, indexFile, remoteRegions))
+        {
+            return(-1);
+        }
+        inFile = localIn.c_str();
+    }
+
     // Open the files for reading/writing.
     // Open prior to opening the output files,
     // so if there is an error, the outputs don't get created.
-    SamFile samIn;
+    ThreadedSamFile samIn;
+    if(bySection || (chr != ""))
+    {
+        // Reading a region requires the index, which is not threaded.
+        // By section, only the header is read from samIn.
+        samIn.setThreadedRead(false);
+    }
     samIn.OpenForRead(inFile, &mySamHeader);
     // Skip non-primary reads (supplementary and secondary).
     samIn.SetReadFlags(0, 0x0900);
@@ -348,15 +428,92 @@ int Bam2FastQ::execute(int argc, char **argv)
         }
     }
 
+    // Read each reference/region, and the unmapped reads, on its own
+    // thread with its own SamFile.  The records are returned in file
+    // order, so mates in different sections are paired just as when
+    // reading the file serially.
+    IndexedSectionReader sectionReader;
+    if(bySection)
+    {
+        if(readName || (strcmp(mySamHeader.getSortOrder(), "queryname") == 0))
+        {
+            std::cerr << "ERROR: --byIndex & several regions require a "
+                      << "coordinate sorted file.\n";
+            return(-1);
+        }
+        std::vector<IndexedSectionReader::Section> sections;
+        if(byIndex)
+        {
+            int32_t numRefs = mySamHeader.getReferenceInfo().getNumEntries();
+            for(int32_t refID = 0; refID < numRefs; refID++)
+            {
+                sections.push_back(IndexedSectionReader::Section(refID));
+            }
+            sections.push_back(IndexedSectionReader::Section(-1));
+        }
+        for(unsigned int i = 0; i < regions.size(); i++)
+        {
+            Region& reg = regions[i];
+            reg.refID = (reg.chr == "*") ? -1 :
+                mySamHeader.getReferenceID(reg.chr);
+            if((reg.chr != "*") && (reg.refID < 0))
+            {
+                std::cerr << "ERROR: Invalid region, '" << reg.chr
+                          << "' is not a reference in " << inFile << ".\n";
+                return(-1);
+            }
+            if((reg.refID < 0) || (reg.position == -1))
+            {
+                sections.push_back(IndexedSectionReader::Section(reg.refID));
+            }
+            else
+            {
+                sections.push_back(IndexedSectionReader::Section(reg.refID,
+                                                                 reg.position,
+                                                                 reg.position + 1));
+            }
+        }
+        // Put the sections in file order, the unmapped reads last, and
+        // merge the overlapping ones so no record is read twice.
+        std::sort(sections.begin(), sections.end(),
+                  [](const IndexedSectionReader::Section& a,
+                     const IndexedSectionReader::Section& b)
+                  {
+                      if(a.refID != b.refID)
+                      {
+                          return((uint32_t)a.refID < (uint32_t)b.refID);
+                      }
+                      return(a.start < b.start);
+                  });
+        std::vector<IndexedSectionReader::Section> merged;
+        for(unsigned int i = 0; i < sections.size(); i++)
+        {
+            IndexedSectionReader::Section& section = sections[i];
+            if(merged.empty() || (merged.back().refID != section.refID) ||
+               ((merged.back().end != -1) &&
+                (merged.back().end < section.start)))
+            {
+                merged.push_back(section);
+            }
+            else if((merged.back().end != -1) &&
+                    ((section.end == -1) || (section.end > merged.back().end)))
+            {
+                merged.back().end = section.end;
+            }
+        }
+        sectionReader.start(inFile.c_str(), indexFile, merged,
+                            getNumThreads(), 0, 0x0900);
+    }
+
     // Open the output files if not splitting RG
     if(!mySplitRG)
     {
-        myUnpairedFile = ifopen(unpairedOut, "w", myCompression);
+        myUnpairedFile = openFastQ(unpairedOut);
 
         // Only open the first file if it is different than an already opened file.
         if(firstOut != unpairedOut)
         {
-            myFirstFile = ifopen(firstOut, "w", myCompression);
+            myFirstFile = openFastQ(firstOut);
         }
         else
         {
@@ -374,7 +531,7 @@ int Bam2FastQ::execute(int argc, char **argv)
         }
         else
         {
-            mySecondFile = ifopen(secondOut, "w", myCompression);
+            mySecondFile = openFastQ(secondOut);
         }
     
         if(myUnpairedFile == NULL)
@@ -397,7 +554,8 @@ int Bam2FastQ::execute(int argc, char **argv)
         }
     }
 
-    if((readName) || (strcmp(mySamHeader.getSortOrder(), "queryname") == 0))
+    if((readName) || collate ||
+       (strcmp(mySamHeader.getSortOrder(), "queryname") == 0))
     {
         readName = true;
     }
@@ -407,12 +565,21 @@ int Bam2FastQ::execute(int argc, char **argv)
         samIn.setSortedValidation(SamFile::COORDINATE);
     }
 
+    // Group the mates before converting, so the records can be
+    // processed as if they were sorted by read name.
+    RecordCollator collator;
+    if(collate)
+    {
+        collator.init(mySpillPrefix.c_str());
+        collator.partition(samIn, mySamHeader);
+    }
+
     // Setup the '=' translation if the reference was specified.
     if(!refFile.IsEmpty())
     {
-        GenomeSequence* refPtr = new GenomeSequence(refFile);
+        myRefPtr = new GenomeSequence(refFile);
         samIn.SetReadSequenceTranslation(SamRecord::BASES);
-        samIn.SetReference(refPtr);
+        samIn.SetReference(myRefPtr);
     }
 
     SamRecord* recordPtr;
@@ -427,7 +594,38 @@ int Bam2FastQ::execute(int argc, char **argv)
             // Failed to allocate a new record.
             throw(std::runtime_error("Failed to allocate a new SAM/BAM record"));
         }
-        if(!samIn.ReadRecord(mySamHeader, *recordPtr))
+        if(collate)
+        {
+            if(!collator.ReadRecord(mySamHeader, *recordPtr))
+            {
+                returnStatus = SamStatus::NO_MORE_RECS;
+                continue;
+            }
+            if(myRefPtr != NULL)
+            {
+                recordPtr->setReference(myRefPtr);
+                recordPtr->setSequenceTranslation(SamRecord::BASES);
+            }
+        }
+        else if(bySection)
+        {
+            if(!sectionReader.ReadRecord(mySamHeader, *recordPtr))
+            {
+                returnStatus = SamStatus::NO_MORE_RECS;
+                continue;
+            }
+            if(myRefPtr != NULL)
+            {
+                recordPtr->setReference(myRefPtr);
+                recordPtr->setSequenceTranslation(SamRecord::BASES);
+            }
+            if(!regions.empty() && !inRegions(*recordPtr, regions))
+            {
+                myPool.releaseRecord(recordPtr);
+                continue;
+            }
+        }
+        else if(!samIn.ReadRecord(mySamHeader, *recordPtr))
         {
             // Failed to read a record.
             returnStatus = samIn.GetStatus();
@@ -466,7 +664,18 @@ int Bam2FastQ::execute(int argc, char **argv)
     }
 
     // Flush All
+    if(myPrevRNRec != NULL)
+    {
+        // The last paired read did not have its mate.
+        std::cerr << "Paired Read, " << myPrevRNRec->getReadName()
+                  << " but couldn't find mate, so writing as "
+                  << "unpaired (single-ended)\n";
+        ++myNumMateFailures;
+        writeFastQ(*myPrevRNRec, myUnpairedFile, myUnpairedFileNameExt);
+        myPrevRNRec = NULL;
+    }
     cleanUpMateMap(0, true);
+    joinSpilledMates();
 
     if(returnStatus == SamStatus::NO_MORE_RECS)
     {
@@ -490,15 +699,92 @@ int Bam2FastQ::execute(int argc, char **argv)
         std::cerr << myNumQualTagErrors << " records did not have tag "
                   << myQField.c_str() << " or it was invalid, so the quality field was used for those records.\n";
     }
+    if(myNumSpilled != 0)
+    {
+        std::cerr << "Spilled " << myNumSpilled << " reads to disk to keep at most "
+                  << myMaxMateMap << " reads waiting for their mates.\n";
+    }
 
     return(returnStatus);
 }
 
 
+bool Bam2FastQ::parseRegion(const String& regionStr, Region& region)
+{
+    region.chr = "";
+    region.refID = -1;
+    region.position = -1;
+    region.nucleotide = ' ';
+    int chrStrEnd = regionStr.FastFindChar(':',1);
+    if(chrStrEnd < 1)
+    {
+        // This region is just a chromosome.
+        region.chr = regionStr;
+        return(true);
+    }
+    region.chr = regionStr.Left(chrStrEnd);
+    int posStrEnd = regionStr.FastFindChar(':',chrStrEnd+1);
+    String posStr;
+    if(posStrEnd < chrStrEnd)
+    {
+        // No base specified
+        posStr = regionStr.SubStr(chrStrEnd+1);
+    }
+    else
+    {
+        posStr = regionStr.Mid(chrStrEnd+1, posStrEnd-1);
+        region.nucleotide = toupper(regionStr[posStrEnd + 1]);
+        if(posStrEnd + 1 != regionStr.Length()-1)
+        {
+            std::cerr << "ERROR: Invalid region string, '" << regionStr
+                      << "', the nucleotide specified can only be a single base.\n";
+            return(false);
+        }
+    }
+    if(!posStr.AsInteger(region.position) || region.position < 0)
+    {
+        std::cerr << "ERROR: Invalid region string, '" << regionStr
+                  << "', the position, '" << posStr << "' is not an integer.\n";
+        return(false);
+    }
+    return(true);
+}
+
+
+bool Bam2FastQ::inRegions(SamRecord& samRec,
+                          const std::vector<Region>& regions)
+{
+    int32_t start = samRec.get0BasedPosition();
+    // Unmapped reads placed with their mates cover their position.
+    int32_t end = std::max(samRec.get0BasedAlignmentEnd(), start);
+    for(unsigned int i = 0; i < regions.size(); i++)
+    {
+        const Region& region = regions[i];
+        if(region.refID != samRec.getReferenceID())
+        {
+            continue;
+        }
+        if(region.position == -1)
+        {
+            return(true);
+        }
+        if((region.position < start) || (region.position > end))
+        {
+            continue;
+        }
+        if((region.nucleotide == ' ') ||
+           (toupper(samRec.getSequence(samRec.getCigarInfo()->getQueryIndex(region.position, start))) == region.nucleotide))
+        {
+            return(true);
+        }
+    }
+    return(false);
+}
+
+
 void Bam2FastQ::handlePairedRN(SamRecord& samRec)
 {
-    static SamRecord* prevRec = NULL;
-    static std::string prevRN = "";
+    SamRecord*& prevRec = myPrevRNRec;
 
     if(prevRec == NULL)
     {
@@ -566,6 +852,12 @@ void Bam2FastQ::handlePairedCoord(SamRecord& samRec)
                                          samRec.get0BasedPosition());
     matePos = SamHelper::combineChromPos(samRec.getMateReferenceID(), 
                                          samRec.get0BasedMatePosition());
+
+    // Forget the spilled mate positions that have already been passed.
+    while(!mySpilledMatePos.empty() && (*mySpilledMatePos.begin() < readPos))
+    {
+        mySpilledMatePos.erase(mySpilledMatePos.begin());
+    }
  
     // Check to see if the mate is prior to this record.
     if(matePos <= readPos)
@@ -574,14 +866,21 @@ void Bam2FastQ::handlePairedCoord(SamRecord& samRec)
         mateRec = myMateMap.getMate(samRec);
         if(mateRec == NULL)
         {
+            if(mySpilledMatePos.count(readPos) != 0)
+            {
+                // A record whose mate is at this position was spilled,
+                // so spill this record to be paired at the end.
+                spillRecord(samRec);
+            }
             // If they are the same position, add it to the map.
-            if(matePos == readPos)
+            else if(matePos == readPos)
             {
                 myMateMap.add(samRec);
 
                 // Check to see if the mate map can be cleaned up prior
                 // to this position.
                 cleanUpMateMap(readPos);
+                limitMateMap();
             }
             else
             {
@@ -597,29 +896,7 @@ void Bam2FastQ::handlePairedCoord(SamRecord& samRec)
         {
             // Found the mate.
             ++myNumPairs;
-            // Check which is the first in the pair.
-            if(SamFlag::isFirstFragment(samRec.getFlag()))
-            {
-                if(SamFlag::isFirstFragment(mateRec->getFlag()))
-                {
-                    std::cerr << "Both reads of " << samRec.getReadName()
-                              << " are first fragment, so "
-                              << "splitting one to be in the 2nd fastq.\n";
-                }
-                writeFastQ(samRec, myFirstFile, myFirstFileNameExt, myFirstRNExt.c_str());
-                writeFastQ(*mateRec, mySecondFile, mySecondFileNameExt, mySecondRNExt.c_str());
-            }
-            else
-            {
-                if(!SamFlag::isFirstFragment(mateRec->getFlag()))
-                {
-                    std::cerr << "Neither read of " << samRec.getReadName()
-                              << " are first fragment, so "
-                              << "splitting one to be in the 2nd fastq.\n";
-                }
-                writeFastQ(*mateRec, myFirstFile, myFirstFileNameExt, myFirstRNExt.c_str());
-                writeFastQ(samRec, mySecondFile, mySecondFileNameExt, mySecondRNExt.c_str());
-            }
+            writePair(samRec, *mateRec);
         }
     }
     else
@@ -629,11 +906,40 @@ void Bam2FastQ::handlePairedCoord(SamRecord& samRec)
 
         // Check to see if the mate map can be cleaned up.
         cleanUpMateMap(readPos);
+        limitMateMap();
     }
 }
 
 
-void Bam2FastQ::writeFastQ(SamRecord& samRec, IFILE filePtr,
+void Bam2FastQ::writePair(SamRecord& samRec, SamRecord& mateRec)
+{
+    // Check which is the first in the pair.
+    if(SamFlag::isFirstFragment(samRec.getFlag()))
+    {
+        if(SamFlag::isFirstFragment(mateRec.getFlag()))
+        {
+            std::cerr << "Both reads of " << samRec.getReadName()
+                      << " are first fragment, so "
+                      << "splitting one to be in the 2nd fastq.\n";
+        }
+        writeFastQ(samRec, myFirstFile, myFirstFileNameExt, myFirstRNExt.c_str());
+        writeFastQ(mateRec, mySecondFile, mySecondFileNameExt, mySecondRNExt.c_str());
+    }
+    else
+    {
+        if(!SamFlag::isFirstFragment(mateRec.getFlag()))
+        {
+            std::cerr << "Neither read of " << samRec.getReadName()
+                      << " are first fragment, so "
+                      << "splitting one to be in the 2nd fastq.\n";
+        }
+        writeFastQ(mateRec, myFirstFile, myFirstFileNameExt, myFirstRNExt.c_str());
+        writeFastQ(samRec, mySecondFile, mySecondFileNameExt, mySecondRNExt.c_str());
+    }
+}
+
+
+void Bam2FastQ::writeFastQ(SamRecord& samRec, FastQWriter* filePtr,
                            const std::string& fileNameExt, const char* readNameExt)
 {
     static int16_t flag;
@@ -664,7 +970,7 @@ void Bam2FastQ::writeFastQ(SamRecord& samRec, IFILE filePtr,
                 rg = ".";
             }
             fileName += rgFastqExt;
-            filePtr = ifopen(fileName.c_str(), "w", myCompression);
+            filePtr = openFastQ(fileName.c_str());
             myOutFastqs[rgFastqExt] = filePtr;
 
             if(fileNameExt != mySecondFileNameExt || myFirstFileNameExt == mySecondFileNameExt)
@@ -737,34 +1043,8 @@ void Bam2FastQ::writeFastQ(SamRecord& samRec, IFILE filePtr,
         }
     }
     
-    if(SamFlag::isReverse(flag) && myReverseComp)
-    {
-        // It is reverse, so reverse compliment the sequence
-        BaseUtilities::reverseComplement(sequence);
-        // Reverse the quality.
-        quality.Reverse();
-    }
-    else
-    {
-        // Ensure it is all capitalized.
-        int seqLen = sequence.size();
-        for (int i = 0; i < seqLen; i++)
-        {
-            sequence[i] = (char)toupper(sequence[i]);
-        }
-    }
-    
-    if(myRNPlus)
-    {
-
-        ifprintf(filePtr, "@%s%s\n%s\n+%s%s\n%s\n", readName, readNameExt,
-                 sequence.c_str(), readName, readNameExt, quality.c_str());
-    }
-    else
-    {
-        ifprintf(filePtr, "@%s%s\n%s\n+\n%s\n", readName, readNameExt,
-                 sequence.c_str(), quality.c_str());
-    }
+    filePtr->write(readName, readNameExt, sequence, quality.c_str(),
+                   SamFlag::isReverse(flag) && myReverseComp);
     // Release the record.
     myPool.releaseRecord(&samRec);
 }
@@ -804,6 +1084,144 @@ void Bam2FastQ::cleanUpMateMap(uint64_t readPos, bool flushAll)
 }
 
 
+void Bam2FastQ::limitMateMap()
+{
+    while((myMaxMateMap > 0) && (myMateMap.size() > (unsigned int)myMaxMateMap))
+    {
+        // The last record has the furthest mate, so it would be held the
+        // longest.  Remember where its mate is so the mate is also spilled.
+        SamRecord* lastRec = myMateMap.last();
+        myMateMap.popLast();
+        mySpilledMatePos.insert(SamHelper::combineChromPos(lastRec->getMateReferenceID(),
+                                                           lastRec->get0BasedMatePosition()));
+        spillRecord(*lastRec);
+    }
+}
+
+
+void Bam2FastQ::spillRecord(SamRecord& samRec)
+{
+    // Partition by read name so mates are in the same file, and each file
+    // can be paired on its own.
+    if(mySpillFiles.empty())
+    {
+        mySpillFiles.resize(NUM_SPILL_FILES, NULL);
+    }
+    int spillIndex = 
+        std::hash<std::string>()(samRec.getReadName()) % NUM_SPILL_FILES;
+    SamFile*& spillFile = mySpillFiles[spillIndex];
+    if(spillFile == NULL)
+    {
+        std::string fileName;
+        getSpillFileName(fileName, spillIndex);
+        spillFile = new SamFile;
+        spillFile->OpenForWrite(fileName.c_str());
+        if(myRefPtr != NULL)
+        {
+            // Write the bases rather than '=' so they do not need to be
+            // translated when read back.
+            spillFile->SetWriteSequenceTranslation(SamRecord::BASES);
+            spillFile->SetReference(myRefPtr);
+        }
+        spillFile->WriteHeader(mySamHeader);
+    }
+    spillFile->WriteRecord(mySamHeader, samRec);
+    ++myNumSpilled;
+    myPool.releaseRecord(&samRec);
+}
+
+
+void Bam2FastQ::joinSpilledMates()
+{
+    for(unsigned int i = 0; i < mySpillFiles.size(); i++)
+    {
+        if(mySpillFiles[i] == NULL)
+        {
+            continue;
+        }
+        mySpillFiles[i]->Close();
+        delete mySpillFiles[i];
+        mySpillFiles[i] = NULL;
+
+        std::string fileName;
+        getSpillFileName(fileName, i);
+        SamFile spillIn;
+        SamFileHeader spillHeader;
+        spillIn.OpenForRead(fileName.c_str(), &spillHeader);
+
+        // Pair the records by read name.
+        std::map<std::string, SamRecord*> unpaired;
+        SamRecord* recordPtr = myPool.getRecord();
+        while((recordPtr != NULL) && spillIn.ReadRecord(spillHeader, *recordPtr))
+        {
+            std::map<std::string, SamRecord*>::iterator mateIter = 
+                unpaired.find(recordPtr->getReadName());
+            if(mateIter == unpaired.end())
+            {
+                unpaired[recordPtr->getReadName()] = recordPtr;
+            }
+            else
+            {
+                SamRecord* mateRec = mateIter->second;
+                unpaired.erase(mateIter);
+                ++myNumPairs;
+                writePair(*recordPtr, *mateRec);
+            }
+            recordPtr = myPool.getRecord();
+        }
+        if(recordPtr == NULL)
+        {
+            // Failed to allocate a new record.
+            throw(std::runtime_error("Failed to allocate a new SAM/BAM record"));
+        }
+        myPool.releaseRecord(recordPtr);
+
+        for(std::map<std::string, SamRecord*>::iterator iter = unpaired.begin();
+            iter != unpaired.end(); iter++)
+        {
+            std::cerr << "Paired Read, " << iter->second->getReadName()
+                      << " but couldn't find mate, so writing as "
+                      << "unpaired (single-ended)\n";
+            ++myNumMateFailures;
+            writeFastQ(*(iter->second), myUnpairedFile, myUnpairedFileNameExt);
+        }
+        spillIn.Close();
+        remove(fileName.c_str());
+    }
+    mySpillFiles.clear();
+    mySpilledMatePos.clear();
+}
+
+
+void Bam2FastQ::getSpillFileName(std::string& fileName, int spillIndex)
+{
+    fileName = mySpillPrefix.c_str();
+    fileName += ".mateSpill" + std::to_string(spillIndex) + ".ubam";
+}
+
+
+FastQWriter* Bam2FastQ::openFastQ(const char* fileName)
+{
+    FastQWriter* filePtr = new FastQWriter();
+    if(!filePtr->open(fileName, myCompression, myRNPlus))
+    {
+        delete filePtr;
+        filePtr = NULL;
+    }
+    return(filePtr);
+}
+
+
+void Bam2FastQ::closeFastQ(FastQWriter* filePtr)
+{
+    if(!filePtr->close())
+    {
+        std::cerr << "Bam2FastQ: failed writing a FASTQ file.\n";
+    }
+    delete filePtr;
+}
+
+
 void Bam2FastQ::closeFiles()
 {
     // NULL out any duplicate file pointers
@@ -823,17 +1241,17 @@ void Bam2FastQ::closeFiles()
 
     if(myUnpairedFile != NULL)
     {
-        ifclose(myUnpairedFile);
+        closeFastQ(myUnpairedFile);
         myUnpairedFile = NULL;
     }
     if(myFirstFile != NULL)
     {
-        ifclose(myFirstFile);
+        closeFastQ(myFirstFile);
         myFirstFile = NULL;
     }
     if(mySecondFile != NULL)
     {
-        ifclose(mySecondFile);
+        closeFastQ(mySecondFile);
         mySecondFile = NULL;
     }
 
@@ -847,8 +1265,11 @@ void Bam2FastQ::closeFiles()
     for (OutFastqMap::iterator it=myOutFastqs.begin(); 
          it!=myOutFastqs.end(); ++it)
     {
-        ifclose(it->second);
-        it->second = NULL;
+        if(it->second != NULL)
+        {
+            closeFastQ(it->second);
+            it->second = NULL;
+        }
     }
     myOutFastqs.clear();
 }
@@ -28,10 +28,15 @@
 #include <map>
 #endif
 
+#include <set>
+#include <vector>
+
 #include "BamExecutable.h"
 #include "SamRecord.h"
 #include "MateMapByCoord.h"
 #include "SamCoordOutput.h"
+#include "FastQWriter.h"
+#include "IndexedSectionReader.h"
 
 class Bam2FastQ : public BamExecutable
 {
@@ -48,15 +53,51 @@ public:
 private:
     static const char* DEFAULT_FIRST_EXT;
     static const char* DEFAULT_SECOND_EXT;
+    // Number of files records are spilled to, partitioned by read name.
+    static const int NUM_SPILL_FILES;
+
+    // A --region: a reference, optionally a 0-based position on it, and
+    // optionally the base reads must have at that position.
+    struct Region
+    {
+        String chr;
+        int32_t refID;
+        int position;
+        char nucleotide;
+    };
+
+    // Parse a chr[:pos[:base]] region, returning false after reporting
+    // the reason to stderr if it is invalid.
+    static bool parseRegion(const String& regionStr, Region& region);
+    // Whether the record contains any of the regions (and its base).
+    static bool inRegions(SamRecord& samRec,
+                          const std::vector<Region>& regions);
 
     void handlePairedRN(SamRecord& samRec);
     void handlePairedCoord(SamRecord& samRec);
     // Handles a record, writing the fastq to the specified file.
     // Releases the record.
-    void writeFastQ(SamRecord& samRec, IFILE filePtr,
+    void writeFastQ(SamRecord& samRec, FastQWriter* filePtr,
                     const std::string& fileNameExt,
                     const char* readNameExt = "");
+    // Write the pair of records, samRec is the later record in the file.
+    // Releases the records.
+    void writePair(SamRecord& samRec, SamRecord& mateRec);
     void cleanUpMateMap(uint64_t readPos, bool flushAll = false);
+    // Open a fastq file for writing, returning NULL on failure.
+    FastQWriter* openFastQ(const char* fileName);
+    // Close the fastq file, failing if any of its writes failed.
+    void closeFastQ(FastQWriter* filePtr);
+
+    // Spill the records with the furthest mates until the mate map is
+    // within the limit.
+    void limitMateMap();
+    // Write the record to the spill file for its read name.
+    // Releases the record.
+    void spillRecord(SamRecord& samRec);
+    // Pair up the spilled records and remove the spill files.
+    void joinSpilledMates();
+    void getSpillFileName(std::string& fileName, int spillIndex);
 
     void closeFiles();
     void getFileName(String& fn, const std::string& ext);
@@ -67,9 +108,9 @@ private:
 
     InputFile::ifileCompression myCompression;
 
-    IFILE myUnpairedFile;
-    IFILE myFirstFile;
-    IFILE mySecondFile;
+    FastQWriter* myUnpairedFile;
+    FastQWriter* myFirstFile;
+    FastQWriter* mySecondFile;
 
     int myNumMateFailures;
     int myNumPairs;
@@ -81,6 +122,17 @@ private:
     bool myReverseComp;
     bool myRNPlus;
 
+    // Maximum number of records to keep in the mate map, 0 for no limit.
+    int myMaxMateMap;
+    String mySpillPrefix;
+    std::vector<SamFile*> mySpillFiles;
+    // Mate positions of spilled records that have not yet been reached.
+    std::multiset<uint64_t> mySpilledMatePos;
+    int myNumSpilled;
+    GenomeSequence* myRefPtr;
+    // Paired read waiting for its mate when processing by read name.
+    SamRecord* myPrevRNRec;
+
     String myOutBase;
 
     String myFirstRNExt;
@@ -91,9 +143,9 @@ private:
     std::string myUnpairedFileNameExt;
 
     #ifdef __GXX_EXPERIMENTAL_CXX0X__
-    typedef std::unordered_map<std::string, IFILE> OutFastqMap;
+    typedef std::unordered_map<std::string, FastQWriter*> OutFastqMap;
     #else
-    typedef std::map<std::string, IFILE> OutFastqMap;
+    typedef std::map<std::string, FastQWriter*> OutFastqMap;
     #endif
     OutFastqMap myOutFastqs;
     IFILE myFqList;
@@ -23,7 +23,13 @@
 #include <iostream>
 #include <string.h>
 #include <stdlib.h>
+#include <vector>
 #include "BamExecutable.h"
+#include "Profile.h"
+#include "MemoryBudget.h"
+
+int BamExecutable::ourNumThreads = 1;
+std::unique_ptr<ThreadPool> BamExecutable::ourThreadPool;
 
 BamExecutable::BamExecutable()
 {
@@ -60,3 +66,121 @@ void BamExecutable::printUsage(std::ostream& os)
     os << std::endl;
     printDescription(os);
 }
+
+
+int BamExecutable::processCommonParameters(int argc, char** argv)
+{
+    // Tool name is argv[1], so start checking after it.
+    int newArgc = 2;
+    for(int i = 2; i < argc; i++)
+    {
+        const char* threadsValue = NULL;
+        if(strcmp(argv[i], "--profile") == 0)
+        {
+            Profile::enable("");
+            continue;
+        }
+        else if(strncmp(argv[i], "--profile=", 10) == 0)
+        {
+            Profile::enable(argv[i] + 10);
+            continue;
+        }
+        else if(strcmp(argv[i], "--threads") == 0)
+        {
+            if(i + 1 >= argc)
+            {
+                std::cerr << "Error: --threads requires the number of threads.\n";
+                return(-1);
+            }
+            threadsValue = argv[++i];
+        }
+        else if(strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            threadsValue = argv[i] + 10;
+        }
+        else if((strcmp(argv[i], "--maxMem") == 0) ||
+                (strncmp(argv[i], "--maxMem=", 9) == 0))
+        {
+            const char* sizeValue = argv[i] + 8;
+            if(*sizeValue == '=')
+            {
+                ++sizeValue;
+            }
+            else if(i + 1 < argc)
+            {
+                sizeValue = argv[++i];
+            }
+            uint64_t maxMem = 0;
+            if(!MemoryBudget::parseSize(sizeValue, maxMem) || (maxMem == 0))
+            {
+                std::cerr << "Error: invalid --maxMem value, " << sizeValue
+                          << ", it must be a number of megabytes or a size such as 4G or 512K.\n";
+                return(-1);
+            }
+            MemoryBudget::setLimit(maxMem);
+            continue;
+        }
+        else
+        {
+            argv[newArgc++] = argv[i];
+            continue;
+        }
+
+        char* endPtr = NULL;
+        long numThreads = strtol(threadsValue, &endPtr, 10);
+        if((*threadsValue == '\0') || (*endPtr != '\0') || (numThreads < 1))
+        {
+            std::cerr << "Error: invalid --threads value, " << threadsValue
+                      << ", it must be at least 1.\n";
+            return(-1);
+        }
+        ourNumThreads = numThreads;
+    }
+    argv[newArgc] = NULL;
+    return(newArgc);
+}
+
+
+void BamExecutable::printCommonUsage(std::ostream& os)
+{
+    os << "Options common to all tools:" << std::endl;
+    os << "\t--threads <n> : number of threads to use for BAM (BGZF) compression/decompression\n"
+       << "\t                and for building recalibration tables\n"
+       << "\t                (default 1, not used when reading stdin)\n"
+       << "\t--maxMem <MB> : memory budget in megabytes (or with a K/M/G suffix) shared by\n"
+       << "\t                the record pools, mate maps, and recalibration tables; when it\n"
+       << "\t                is reached, tools that can spill, flush, or limit their pools\n"
+       << "\t                do so.  sort and dedup_LowMem size their sort buffers by it.\n"
+       << "\t                (default no budget)\n"
+       << "\t--profile[=<file>] : write the time spent in the main stages, the CPU time,\n"
+       << "\t                and the peak memory as JSON to the file (default stderr) at exit" << std::endl;
+}
+
+
+ThreadPool& BamExecutable::getThreadPool()
+{
+    if(!ourThreadPool)
+    {
+        ourThreadPool.reset(new ThreadPool(ourNumThreads));
+    }
+    return(*ourThreadPool);
+}
+
+
+void BamExecutable::runWorkers(const std::function<void()>& work, 
+                               int numWorkers)
+{
+    std::vector< std::future<void> > workers;
+    for(int i = 0; i < numWorkers; i++)
+    {
+        workers.push_back(getThreadPool().submit(work));
+    }
+    for(unsigned int i = 0; i < workers.size(); i++)
+    {
+        workers[i].wait();
+    }
+    for(unsigned int i = 0; i < workers.size(); i++)
+    {
+        workers[i].get();
+    }
+}
@@ -20,6 +20,9 @@
 
 #include "StringBasics.h"
 #include "Parameters.h"
+#include <functional>
+
+#include "ThreadPool.h"
 
 /// Base Class BAM Executable.
 class BamExecutable
@@ -37,10 +40,28 @@ public:
     
     virtual const char* getProgramName() {return("bam");}
 
+    /// Process the options shared by all tools (--threads <n>,
+    /// --maxMem <MB>, --profile), removing them from argv.  Returns the
+    /// updated argc, or -1 if an option is invalid.
+    static int processCommonParameters(int argc, char** argv);
+    static void printCommonUsage(std::ostream& os);
+
+    /// Number of threads to use for BGZF compression/decompression and
+    /// for building recalibration tables.
+    static int getNumThreads() {return(ourNumThreads);}
+
+    /// Pool with getNumThreads() threads, started on first use.
+    static ThreadPool& getThreadPool();
+
+    /// Run numWorkers copies of work on the thread pool, waiting for all
+    /// of them to finish before rethrowing the first failure.
+    static void runWorkers(const std::function<void()>& work, int numWorkers);
 
 protected:
 
 private:
+    static int ourNumThreads;
+    static std::unique_ptr<ThreadPool> ourThreadPool;
 };
 
 #endif
@@ -0,0 +1,795 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "BamIndexBuilder.h"
+#include "BamExecutable.h"
+
+namespace
+{
+    template<class T>
+    void append(std::vector<char>& buffer, T value)
+    {
+        const char* ptr = (const char*)&value;
+        buffer.insert(buffer.end(), ptr, ptr + sizeof(T));
+    }
+
+    // First bin of the specified level.
+    uint32_t binFirst(int level)
+    {
+        return(((1 << (level * 3)) - 1) / 7);
+    }
+
+    // Level of the bin, 0 for the bin covering the whole reference.
+    int binLevel(uint32_t bin)
+    {
+        int level = 0;
+        for(; bin != 0; bin = (bin - 1) >> 3)
+        {
+            ++level;
+        }
+        return(level);
+    }
+}
+
+
+BamIndexBuilder::BamIndexBuilder()
+    : myIsCsi(false),
+      myMinShift(BAI_MIN_SHIFT),
+      myDepth(BAI_DEPTH),
+      myLinearShift(BAI_MIN_SHIFT),
+      myMaxPos(1LL << 29),
+      myRefNames(),
+      myRefLengths(),
+      myRefs(),
+      myNumNoCoord(0),
+      myNumRecords(0),
+      myLastKey(0),
+      myWritten(),
+      myWrittenEnd(0),
+      myBlocks(),
+      myBlocksEnd(0),
+      mySawEofBlock(false),
+      myFailed(false)
+{
+}
+
+
+BamIndexBuilder::~BamIndexBuilder()
+{
+}
+
+
+bool BamIndexBuilder::build(const char* bamFile, const char* indexFile,
+                            bool csi, int minShift)
+{
+    reset();
+    ParallelBgzfReader reader;
+    if(!reader.open(bamFile, BamExecutable::getThreadPool(),
+                    BamExecutable::getNumThreads() * BLOCKS_PER_THREAD))
+    {
+        std::cerr << "ERROR: Failed to open " << bamFile 
+                  << " as a BAM file.\n";
+        return(false);
+    }
+
+    try
+    {
+        if(!readHeader(reader))
+        {
+            std::cerr << "ERROR: Failed to read the BAM header of " 
+                      << bamFile << ".\n";
+            return(false);
+        }
+
+        if(!setup(csi, minShift))
+        {
+            return(false);
+        }
+
+        // Index the batches on the thread pool while the next one is read.
+        int numThreads = BamExecutable::getNumThreads();
+        Batch batches[2];
+        int current = 0;
+        readBatch(reader, batches[current]);
+        while(!batches[current].starts.empty())
+        {
+            const Batch& batch = batches[current];
+            size_t numRecords = batch.starts.size();
+            size_t numTasks = std::max((size_t)1,
+                std::min((size_t)numThreads, numRecords / MIN_TASK_RECORDS));
+            std::vector<PartialIndex> partials(numTasks);
+            std::vector< std::future<void> > tasks;
+            for(size_t i = 0; i < numTasks; i++)
+            {
+                size_t first = numRecords * i / numTasks;
+                size_t last = numRecords * (i + 1) / numTasks;
+                PartialIndex* partial = &(partials[i]);
+                tasks.push_back(BamExecutable::getThreadPool().submit(
+                    [this, &batch, first, last, partial]()
+                    { indexRecords(batch, first, last, *partial); }));
+            }
+
+            current = 1 - current;
+            readBatch(reader, batches[current]);
+
+            bool success = true;
+            for(size_t i = 0; i < numTasks; i++)
+            {
+                tasks[i].get();
+                success = success && merge(partials[i]);
+            }
+            if(!success)
+            {
+                return(false);
+            }
+            myNumRecords += numRecords;
+        }
+    }
+    catch(std::runtime_error& e)
+    {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return(false);
+    }
+    reader.close();
+
+    for(size_t i = 0; i < myRefs.size(); i++)
+    {
+        finishRef(myRefs[i]);
+    }
+    return(write(indexFile, csi));
+}
+
+
+bool BamIndexBuilder::start(const SamFileHeader& header, bool csi,
+                            int minShift)
+{
+    reset();
+    const SamReferenceInfo& refInfo = header.getReferenceInfo();
+    for(int i = 0; i < refInfo.getNumEntries(); i++)
+    {
+        myRefNames.push_back(refInfo.getReferenceName(i));
+        myRefLengths.push_back(refInfo.getReferenceLength(i));
+    }
+    myRefs.resize(myRefNames.size());
+    return(setup(csi, minShift));
+}
+
+
+void BamIndexBuilder::addRecord(const char* buffer, uint32_t size,
+                                uint64_t dataOffset)
+{
+    myWritten.starts.push_back(myWritten.data.size());
+    myWritten.offsets.push_back(dataOffset);
+    myWritten.data.insert(myWritten.data.end(), buffer, buffer + size);
+    myWrittenEnd = dataOffset + size;
+}
+
+
+void BamIndexBuilder::addBlock(uint64_t fileOffset, uint32_t dataSize)
+{
+    Block block = {myBlocksEnd, myBlocksEnd + dataSize, fileOffset};
+    myBlocks.push_back(block);
+    myBlocksEnd += dataSize;
+    if(dataSize == 0)
+    {
+        mySawEofBlock = true;
+    }
+    if(myWritten.data.size() >= WRITE_BATCH_SIZE)
+    {
+        indexWritten();
+    }
+}
+
+
+bool BamIndexBuilder::finish(const char* indexFile)
+{
+    indexWritten();
+    if(myFailed)
+    {
+        return(false);
+    }
+    if(!myWritten.starts.empty())
+    {
+        std::cerr << "ERROR: Not all of the BAM file was written, so it "
+                  << "was not indexed.\n";
+        return(false);
+    }
+    for(size_t i = 0; i < myRefs.size(); i++)
+    {
+        finishRef(myRefs[i]);
+    }
+    return(write(indexFile, myIsCsi));
+}
+
+
+bool BamIndexBuilder::needsCsi(const SamFileHeader& header)
+{
+    const SamReferenceInfo& refInfo = header.getReferenceInfo();
+    for(int i = 0; i < refInfo.getNumEntries(); i++)
+    {
+        if(refInfo.getReferenceLength(i) > 
+           (1LL << (BAI_MIN_SHIFT + BAI_DEPTH * 3)))
+        {
+            return(true);
+        }
+    }
+    return(false);
+}
+
+
+std::string BamIndexBuilder::getDefaultName(const char* bamFile, bool csi)
+{
+    std::string name = bamFile;
+    name += csi ? ".csi" : ".bai";
+    return(name);
+}
+
+
+uint32_t BamIndexBuilder::reg2bin(int64_t beg, int64_t end,
+                                  int minShift, int depth)
+{
+    --end;
+    int shift = minShift;
+    for(int level = depth; level > 0; --level, shift += 3)
+    {
+        if((beg >> shift) == (end >> shift))
+        {
+            return(binFirst(level) + (beg >> shift));
+        }
+    }
+    return(0);
+}
+
+
+void BamIndexBuilder::reset()
+{
+    myRefNames.clear();
+    myRefLengths.clear();
+    myRefs.clear();
+    myNumNoCoord = 0;
+    myNumRecords = 0;
+    myLastKey = 0;
+    myWritten.data.clear();
+    myWritten.starts.clear();
+    myWritten.offsets.clear();
+    myWrittenEnd = 0;
+    myBlocks.clear();
+    myBlocksEnd = 0;
+    mySawEofBlock = false;
+    myFailed = false;
+}
+
+
+bool BamIndexBuilder::setup(bool csi, int minShift)
+{
+    int64_t maxLength = 0;
+    size_t longest = 0;
+    for(size_t i = 0; i < myRefLengths.size(); i++)
+    {
+        if(myRefLengths[i] > maxLength)
+        {
+            maxLength = myRefLengths[i];
+            longest = i;
+        }
+    }
+    myIsCsi = csi;
+    if(csi)
+    {
+        // Add levels until the bins cover the longest reference.
+        myMinShift = minShift;
+        myDepth = 0;
+        for(int64_t size = 1LL << minShift; maxLength + 256 > size;
+            size <<= 3)
+        {
+            ++myDepth;
+        }
+    }
+    else
+    {
+        myMinShift = BAI_MIN_SHIFT;
+        myDepth = BAI_DEPTH;
+    }
+    myLinearShift = myMinShift;
+    myMaxPos = 1LL << (myMinShift + myDepth * 3);
+    if(maxLength > myMaxPos)
+    {
+        std::cerr << "ERROR: Reference " << myRefNames[longest]
+                  << " is longer than the " << (myMaxPos >> 20)
+                  << "Mb a BAI index supports, use --csi.\n";
+        return(false);
+    }
+    return(true);
+}
+
+
+bool BamIndexBuilder::readHeader(ParallelBgzfReader& reader)
+{
+    char magic[4];
+    int32_t textLen = 0;
+    int32_t numRefs = 0;
+    if((reader.read(magic, sizeof(magic)) != sizeof(magic)) ||
+       (memcmp(magic, "BAM\1", sizeof(magic)) != 0) ||
+       (reader.read(&textLen, sizeof(textLen)) != sizeof(textLen)) ||
+       (textLen < 0) ||
+       (reader.skip(textLen) != (uint32_t)textLen) ||
+       (reader.read(&numRefs, sizeof(numRefs)) != sizeof(numRefs)) ||
+       (numRefs < 0))
+    {
+        return(false);
+    }
+    std::vector<char> name;
+    for(int32_t i = 0; i < numRefs; i++)
+    {
+        int32_t nameLen = 0;
+        int32_t refLen = 0;
+        if((reader.read(&nameLen, sizeof(nameLen)) != sizeof(nameLen)) ||
+           (nameLen <= 0))
+        {
+            return(false);
+        }
+        name.resize(nameLen);
+        if((reader.read(&(name[0]), nameLen) != (uint32_t)nameLen) ||
+           (reader.read(&refLen, sizeof(refLen)) != sizeof(refLen)) ||
+           (refLen < 0))
+        {
+            return(false);
+        }
+        myRefNames.push_back(std::string(&(name[0]), nameLen - 1));
+        myRefLengths.push_back(refLen);
+    }
+    myRefs.resize(numRefs);
+    return(true);
+}
+
+
+void BamIndexBuilder::readBatch(ParallelBgzfReader& reader, Batch& batch)
+{
+    batch.data.clear();
+    batch.starts.clear();
+    batch.offsets.clear();
+    uint64_t offset = reader.tell();
+    while(batch.data.size() < BATCH_SIZE)
+    {
+        int32_t blockSize = 0;
+        uint32_t numRead = reader.read(&blockSize, sizeof(blockSize));
+        if(numRead == 0)
+        {
+            // End of the records.
+            break;
+        }
+        // The fixed length fields take 32 bytes.
+        if((numRead != sizeof(blockSize)) || (blockSize < 32))
+        {
+            throw std::runtime_error("Invalid BAM record");
+        }
+        uint64_t start = batch.data.size();
+        batch.data.resize(start + sizeof(blockSize) + blockSize);
+        memcpy(&(batch.data[start]), &blockSize, sizeof(blockSize));
+        if(reader.read(&(batch.data[start + sizeof(blockSize)]), blockSize) !=
+           (uint32_t)blockSize)
+        {
+            throw std::runtime_error("Truncated BAM record");
+        }
+        batch.starts.push_back(start);
+        batch.offsets.push_back(offset);
+        offset = reader.tell();
+    }
+    batch.offsets.push_back(offset);
+}
+
+
+void BamIndexBuilder::indexWritten()
+{
+    // Find the records whose end is in a written block.
+    size_t numRecords = myWritten.starts.size();
+    while((numRecords > 0) &&
+          !isWritten((numRecords == myWritten.starts.size()) ? myWrittenEnd :
+                     myWritten.offsets[numRecords]))
+    {
+        --numRecords;
+    }
+    if(numRecords == 0)
+    {
+        return;
+    }
+
+    Batch batch;
+    uint64_t dataLen = (numRecords == myWritten.starts.size()) ?
+        myWritten.data.size() : myWritten.starts[numRecords];
+    batch.data.assign(myWritten.data.begin(), myWritten.data.begin() + dataLen);
+    batch.starts.assign(myWritten.starts.begin(),
+                        myWritten.starts.begin() + numRecords);
+    size_t blockIndex = 0;
+    for(size_t i = 0; i < numRecords; i++)
+    {
+        batch.offsets.push_back(getWrittenOffset(myWritten.offsets[i],
+                                                 blockIndex));
+    }
+    uint64_t end = (numRecords == myWritten.starts.size()) ? myWrittenEnd :
+        myWritten.offsets[numRecords];
+    batch.offsets.push_back(getWrittenOffset(end, blockIndex));
+
+    myWritten.data.erase(myWritten.data.begin(),
+                         myWritten.data.begin() + dataLen);
+    myWritten.starts.erase(myWritten.starts.begin(),
+                           myWritten.starts.begin() + numRecords);
+    for(size_t i = 0; i < myWritten.starts.size(); i++)
+    {
+        myWritten.starts[i] -= dataLen;
+    }
+    myWritten.offsets.erase(myWritten.offsets.begin(),
+                            myWritten.offsets.begin() + numRecords);
+
+    // Drop the blocks before the data that is left.
+    while(!myBlocks.empty() && (myBlocks.front().dataEnd <= end))
+    {
+        myBlocks.pop_front();
+    }
+
+    if(!myFailed)
+    {
+        PartialIndex partial;
+        indexRecords(batch, 0, numRecords, partial);
+        myFailed = !merge(partial);
+        myNumRecords += numRecords;
+    }
+}
+
+
+bool BamIndexBuilder::isWritten(uint64_t dataOffset)
+{
+    // Data at the end of a block starts the next block, which is known
+    // once it is written.
+    return((dataOffset < myBlocksEnd) ||
+           (mySawEofBlock && (dataOffset == myBlocksEnd)));
+}
+
+
+uint64_t BamIndexBuilder::getWrittenOffset(uint64_t dataOffset,
+                                           size_t& blockIndex)
+{
+    while((myBlocks[blockIndex].dataEnd < dataOffset) ||
+          ((myBlocks[blockIndex].dataEnd == dataOffset) &&
+           (myBlocks[blockIndex].dataEnd != myBlocks[blockIndex].dataStart)))
+    {
+        ++blockIndex;
+    }
+    return((myBlocks[blockIndex].fileOffset << 16) |
+           (dataOffset - myBlocks[blockIndex].dataStart));
+}
+
+
+void BamIndexBuilder::indexRecords(const Batch& batch, size_t first,
+                                   size_t last, PartialIndex& partial) const
+{
+    int32_t prevRefID = -2;
+    RefIndex* ref = NULL;
+    uint32_t prevBin = 0;
+    std::vector<Chunk>* chunks = NULL;
+    for(size_t i = first; i < last; i++)
+    {
+        const char* record = &(batch.data[batch.starts[i]]);
+        int32_t blockSize = *(const int32_t*)record;
+        int32_t refID = *(const int32_t*)(record + 4);
+        int32_t pos = *(const int32_t*)(record + 8);
+        uint8_t nameLen = *(const uint8_t*)(record + 12);
+        uint16_t numCigar = *(const uint16_t*)(record + 16);
+        uint16_t flag = *(const uint16_t*)(record + 18);
+        uint64_t begOffset = batch.offsets[i];
+        uint64_t endOffset = batch.offsets[i + 1];
+
+        if((refID < -1) || (refID >= (int32_t)myRefs.size()) ||
+           (32 + nameLen + numCigar * 4 > blockSize))
+        {
+            partial.error = "Invalid BAM record";
+            return;
+        }
+        if(pos < 0)
+        {
+            pos = (refID < 0) ? -1 : 0;
+        }
+
+        // Unmapped reads without a coordinate sort to the end.
+        uint64_t key = ((uint64_t)(uint32_t)refID << 32) | (uint32_t)pos;
+        if(i == first)
+        {
+            partial.firstKey = key;
+        }
+        else if(key < partial.lastKey)
+        {
+            partial.error = "The file is not sorted by coordinate";
+            return;
+        }
+        partial.lastKey = key;
+
+        if(refID < 0)
+        {
+            ++partial.numNoCoord;
+            continue;
+        }
+
+        // Compute the end from the reference length of the cigar.
+        int64_t end = pos;
+        if((flag & 0x4) == 0)
+        {
+            const uint32_t* cigar =
+                (const uint32_t*)(record + 36 + nameLen);
+            for(uint16_t op = 0; op < numCigar; op++)
+            {
+                // M, D, N, =, X consume the reference.
+                uint32_t type = cigar[op] & 0xF;
+                if((type == 0) || (type == 2) || (type == 3) ||
+                   (type == 7) || (type == 8))
+                {
+                    end += cigar[op] >> 4;
+                }
+            }
+        }
+        if(end <= pos)
+        {
+            end = pos + 1;
+        }
+        if(end > myMaxPos)
+        {
+            partial.error = "Record beyond the positions the index supports, use --csi";
+            return;
+        }
+
+        if(refID != prevRefID)
+        {
+            ref = &(partial.refs[refID]);
+            ref->begOffset = begOffset;
+            prevRefID = refID;
+            chunks = NULL;
+        }
+        ref->endOffset = endOffset;
+        if((flag & 0x4) == 0)
+        {
+            ++ref->numMapped;
+        }
+        else
+        {
+            ++ref->numUnmapped;
+        }
+
+        uint32_t bin = reg2bin(pos, end, myMinShift, myDepth);
+        if((chunks == NULL) || (bin != prevBin))
+        {
+            chunks = &(ref->bins[bin]);
+            prevBin = bin;
+        }
+        if(!chunks->empty() && (chunks->back().end == begOffset))
+        {
+            chunks->back().end = endOffset;
+        }
+        else
+        {
+            Chunk chunk = {begOffset, endOffset};
+            chunks->push_back(chunk);
+        }
+
+        uint64_t lastWindow = (end - 1) >> myLinearShift;
+        if(ref->linear.size() <= lastWindow)
+        {
+            ref->linear.resize(lastWindow + 1, 0);
+        }
+        for(uint64_t window = pos >> myLinearShift; window <= lastWindow;
+            window++)
+        {
+            if(ref->linear[window] == 0)
+            {
+                ref->linear[window] = begOffset;
+            }
+        }
+    }
+}
+
+
+bool BamIndexBuilder::merge(PartialIndex& partial)
+{
+    if(!partial.error.empty())
+    {
+        std::cerr << "ERROR: " << partial.error << ".\n";
+        return(false);
+    }
+    if(partial.firstKey < myLastKey)
+    {
+        std::cerr << "ERROR: The file is not sorted by coordinate.\n";
+        return(false);
+    }
+    myLastKey = partial.lastKey;
+    myNumNoCoord += partial.numNoCoord;
+
+    for(std::map<int32_t, RefIndex>::iterator refIter = partial.refs.begin();
+        refIter != partial.refs.end(); refIter++)
+    {
+        RefIndex& ref = myRefs[refIter->first];
+        RefIndex& part = refIter->second;
+        if((ref.numMapped + ref.numUnmapped) == 0)
+        {
+            ref.begOffset = part.begOffset;
+        }
+        ref.endOffset = part.endOffset;
+        ref.numMapped += part.numMapped;
+        ref.numUnmapped += part.numUnmapped;
+
+        for(BinMap::iterator binIter = part.bins.begin();
+            binIter != part.bins.end(); binIter++)
+        {
+            std::vector<Chunk>& chunks = ref.bins[binIter->first];
+            std::vector<Chunk>& partChunks = binIter->second;
+            size_t i = 0;
+            if(!chunks.empty() && (chunks.back().end == partChunks[0].beg))
+            {
+                chunks.back().end = partChunks[0].end;
+                i = 1;
+            }
+            chunks.insert(chunks.end(), partChunks.begin() + i,
+                          partChunks.end());
+        }
+
+        if(ref.linear.size() < part.linear.size())
+        {
+            ref.linear.resize(part.linear.size(), 0);
+        }
+        for(size_t window = 0; window < part.linear.size(); window++)
+        {
+            if(ref.linear[window] == 0)
+            {
+                ref.linear[window] = part.linear[window];
+            }
+        }
+    }
+    return(true);
+}
+
+
+void BamIndexBuilder::finishRef(RefIndex& ref)
+{
+    for(BinMap::iterator binIter = ref.bins.begin();
+        binIter != ref.bins.end(); binIter++)
+    {
+        // Chunks that start in the block another ends in are read
+        // together anyway.
+        std::vector<Chunk>& chunks = binIter->second;
+        size_t numMerged = 0;
+        for(size_t i = 1; i < chunks.size(); i++)
+        {
+            if((chunks[i].beg >> 16) <= (chunks[numMerged].end >> 16))
+            {
+                chunks[numMerged].end =
+                    std::max(chunks[numMerged].end, chunks[i].end);
+            }
+            else
+            {
+                chunks[++numMerged] = chunks[i];
+            }
+        }
+        chunks.resize(numMerged + 1);
+    }
+    // A window without records can start at the offset of the previous.
+    for(size_t window = 1; window < ref.linear.size(); window++)
+    {
+        if(ref.linear[window] == 0)
+        {
+            ref.linear[window] = ref.linear[window - 1];
+        }
+    }
+}
+
+
+bool BamIndexBuilder::write(const char* indexFile, bool csi)
+{
+    std::vector<char> buffer;
+    uint32_t pseudoBin = binFirst(myDepth + 1) + 1;
+    if(csi)
+    {
+        buffer.insert(buffer.end(), "CSI\1", "CSI\1" + 4);
+        append<int32_t>(buffer, myMinShift);
+        append<int32_t>(buffer, myDepth);
+        // No auxiliary data.
+        append<int32_t>(buffer, 0);
+    }
+    else
+    {
+        buffer.insert(buffer.end(), "BAI\1", "BAI\1" + 4);
+    }
+    append<int32_t>(buffer, myRefs.size());
+    for(size_t i = 0; i < myRefs.size(); i++)
+    {
+        RefIndex& ref = myRefs[i];
+        bool hasRecords = ((ref.numMapped + ref.numUnmapped) != 0);
+        append<int32_t>(buffer, ref.bins.size() + (hasRecords ? 1 : 0));
+        for(BinMap::iterator binIter = ref.bins.begin();
+            binIter != ref.bins.end(); binIter++)
+        {
+            append<uint32_t>(buffer, binIter->first);
+            if(csi)
+            {
+                // Offset of the first record overlapping the start of
+                // the bin.
+                int level = binLevel(binIter->first);
+                uint64_t bot = (uint64_t)(binIter->first - binFirst(level))
+                    << ((myDepth - level) * 3);
+                append<uint64_t>(buffer, (bot < ref.linear.size()) ?
+                                 ref.linear[bot] : binIter->second[0].beg);
+            }
+            append<int32_t>(buffer, binIter->second.size());
+            for(size_t j = 0; j < binIter->second.size(); j++)
+            {
+                append<uint64_t>(buffer, binIter->second[j].beg);
+                append<uint64_t>(buffer, binIter->second[j].end);
+            }
+        }
+        if(hasRecords)
+        {
+            // The pseudo bin with the offsets & counts of the records.
+            append<uint32_t>(buffer, pseudoBin);
+            if(csi)
+            {
+                append<uint64_t>(buffer, 0);
+            }
+            append<int32_t>(buffer, 2);
+            append<uint64_t>(buffer, ref.begOffset);
+            append<uint64_t>(buffer, ref.endOffset);
+            append<uint64_t>(buffer, ref.numMapped);
+            append<uint64_t>(buffer, ref.numUnmapped);
+        }
+        if(!csi)
+        {
+            append<int32_t>(buffer, ref.linear.size());
+            buffer.insert(buffer.end(), (const char*)ref.linear.data(),
+                          (const char*)(ref.linear.data() + ref.linear.size()));
+        }
+    }
+    append<uint64_t>(buffer, myNumNoCoord);
+
+    bool success;
+    if(csi)
+    {
+        // CSI indexes are BGZF compressed.
+        ParallelBgzfWriter writer;
+        success = writer.open(indexFile) &&
+            writer.write(buffer.data(), buffer.size());
+        success &= writer.close();
+    }
+    else
+    {
+        FILE* out = fopen(indexFile, "wb");
+        success = (out != NULL) &&
+            (fwrite(buffer.data(), 1, buffer.size(), out) == buffer.size());
+        if(out != NULL)
+        {
+            success &= (fclose(out) == 0);
+        }
+    }
+    if(!success)
+    {
+        std::cerr << "ERROR: Failed to write " << indexFile << ".\n";
+        unlink(indexFile);
+        return(false);
+    }
+    return(true);
+}
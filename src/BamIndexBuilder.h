@@ -0,0 +1,220 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BAM_INDEX_BUILDER_H__
+#define __BAM_INDEX_BUILDER_H__
+
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ParallelBgzf.h"
+#include "SamFileHeader.h"
+
+/// Builds a BAI or CSI index of a coordinate sorted BAM file.
+/// The BGZF blocks are inflated on the thread pool while batches of
+/// records are read, and each batch is split between the threads, which
+/// each build a partial index (bins, linear index and counts) of their
+/// records.  The partial indexes are merged into the index in file order
+/// while the next batch is read.
+/// A file can also be indexed as it is written: the records and the BGZF
+/// blocks are added as they are written and the records are indexed once
+/// the blocks holding them are known.
+/// BAI indexes cannot represent positions beyond 2^29 (512Mb), CSI
+/// indexes add bin levels as needed for the longest reference.
+class BamIndexBuilder
+{
+public:
+    /// The shift of the smallest bins & the number of bin levels of a BAI.
+    static const int BAI_MIN_SHIFT = 14;
+    static const int BAI_DEPTH = 5;
+
+    BamIndexBuilder();
+    ~BamIndexBuilder();
+
+    /// Index the BAM file, writing a CSI index with the specified minimum
+    /// shift (size of the smallest bins) if csi is set, otherwise a BAI.
+    /// Returns false after reporting the reason to stderr on failure.
+    bool build(const char* bamFile, const char* indexFile,
+               bool csi, int minShift = BAI_MIN_SHIFT);
+
+    /// Start indexing a BAM file as it is written, using the references
+    /// of its header.  Returns false after reporting the reason to stderr
+    /// if the references are too long for the index.
+    bool start(const SamFileHeader& header, bool csi,
+               int minShift = BAI_MIN_SHIFT);
+
+    /// Add the record (the BAM buffer starting with the block size) that
+    /// was written starting at the specified offset in the uncompressed
+    /// data.  Records must be added in order, with nothing between them.
+    void addRecord(const char* buffer, uint32_t size, uint64_t dataOffset);
+
+    /// Add the BGZF block written at the file offset with dataSize bytes
+    /// of uncompressed data.  Blocks must be added in file order, ending
+    /// with the empty EOF marker block.
+    void addBlock(uint64_t fileOffset, uint32_t dataSize);
+
+    /// Write the index of the records that were added.
+    /// Returns false after reporting the reason to stderr on failure.
+    bool finish(const char* indexFile);
+
+    /// Return true if a reference of the header is too long for a BAI.
+    static bool needsCsi(const SamFileHeader& header);
+
+    /// Return true if the index being built is a CSI index.
+    bool isCsi() { return(myIsCsi); }
+
+    /// Number of records in the last file that was indexed.
+    uint64_t getNumRecords() { return(myNumRecords); }
+
+    /// Return the default index file name, the bam file + ".bai"/".csi".
+    static std::string getDefaultName(const char* bamFile, bool csi);
+
+    /// Return the bin of 0-based region [beg, end) for the shift & depth.
+    static uint32_t reg2bin(int64_t beg, int64_t end, int minShift, int depth);
+
+private:
+    struct Chunk
+    {
+        uint64_t beg;
+        uint64_t end;
+    };
+    typedef std::map<uint32_t, std::vector<Chunk> > BinMap;
+
+    // Index of the records of a single reference.
+    struct RefIndex
+    {
+        BinMap bins;
+        // Smallest offset of the records overlapping each window, 0 if none.
+        std::vector<uint64_t> linear;
+        uint64_t begOffset;
+        uint64_t endOffset;
+        uint64_t numMapped;
+        uint64_t numUnmapped;
+        RefIndex()
+            : bins(), linear(), begOffset(0), endOffset(0),
+              numMapped(0), numUnmapped(0) {}
+    };
+
+    // Index of a range of records built by one task.
+    struct PartialIndex
+    {
+        std::map<int32_t, RefIndex> refs;
+        uint64_t numNoCoord;
+        // Sort keys of the first & last records for checking the order.
+        uint64_t firstKey;
+        uint64_t lastKey;
+        // Empty if the records were indexed, otherwise why not.
+        std::string error;
+        PartialIndex()
+            : refs(), numNoCoord(0), firstKey(0), lastKey(0), error() {}
+    };
+
+    // Records read from the BAM file.
+    struct Batch
+    {
+        std::vector<char> data;
+        // Start of each record in data.
+        std::vector<uint64_t> starts;
+        // Virtual file offset of each record and then the end of the last.
+        std::vector<uint64_t> offsets;
+    };
+
+    // A written BGZF block.
+    struct Block
+    {
+        uint64_t dataStart;
+        uint64_t dataEnd;
+        uint64_t fileOffset;
+    };
+
+    static const uint32_t BATCH_SIZE = 32 << 20;
+    // Bytes of written records to collect before indexing them.
+    static const uint32_t WRITE_BATCH_SIZE = 8 << 20;
+    static const uint32_t MIN_TASK_RECORDS = 10000;
+    static const int BLOCKS_PER_THREAD = 4;
+
+    BamIndexBuilder(const BamIndexBuilder&);
+    BamIndexBuilder& operator=(const BamIndexBuilder&);
+
+    // Clear the index for a new file.
+    void reset();
+
+    // Set the shift & depth for the references, returning false after
+    // reporting the reason if they are too long for the index.
+    bool setup(bool csi, int minShift);
+
+    // Read the header, setting the reference names & lengths.
+    bool readHeader(ParallelBgzfReader& reader);
+
+    // Index the written records whose blocks are known, all of them if
+    // the EOF marker was added.
+    void indexWritten();
+
+    // Return true if the virtual file offset of the data offset is known.
+    bool isWritten(uint64_t dataOffset);
+
+    // Return the virtual file offset of the written data offset, moving
+    // blockIndex forward to the block containing it.
+    uint64_t getWrittenOffset(uint64_t dataOffset, size_t& blockIndex);
+
+    // Read the next batch of records, leaving it empty at the end of the
+    // file.  Throws std::runtime_error if the file is invalid.
+    void readBatch(ParallelBgzfReader& reader, Batch& batch);
+
+    // Index the records [first, last) of the batch.
+    void indexRecords(const Batch& batch, size_t first, size_t last,
+                      PartialIndex& partial) const;
+
+    // Add the partial index of the next records, returning false after
+    // reporting the reason if they could not be indexed.
+    bool merge(PartialIndex& partial);
+
+    // Merge chunks in the same BGZF block & fill the linear index holes.
+    static void finishRef(RefIndex& ref);
+
+    // Write the finished index to the file.
+    bool write(const char* indexFile, bool csi);
+
+    bool myIsCsi;
+    int myMinShift;
+    int myDepth;
+    // Shift of the linear index windows.
+    int myLinearShift;
+    int64_t myMaxPos;
+
+    std::vector<std::string> myRefNames;
+    std::vector<int64_t> myRefLengths;
+    std::vector<RefIndex> myRefs;
+    uint64_t myNumNoCoord;
+    uint64_t myNumRecords;
+    uint64_t myLastKey;
+
+    // Records added while writing that have not been indexed, the batch
+    // offsets are data offsets of the records.
+    Batch myWritten;
+    uint64_t myWrittenEnd;
+    // Blocks that may contain data of records that are not indexed.
+    std::deque<Block> myBlocks;
+    uint64_t myBlocksEnd;
+    bool mySawEofBlock;
+    bool myFailed;
+};
+
+#endif
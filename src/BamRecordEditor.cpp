@@ -0,0 +1,433 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include "BamRecordEditor.h"
+
+// Offsets in the BAM record buffer, which starts with the block size.
+static const uint32_t READ_NAME_LEN_OFFSET = 12;
+static const uint32_t CIGAR_LEN_OFFSET = 16;
+static const uint32_t READ_LEN_OFFSET = 20;
+static const uint32_t DATA_OFFSET = 36;
+// Quality value of the first base when a record does not have qualities.
+static const unsigned char MISSING_QUAL = 0xFF;
+static const int QUAL_CONVERT = 33;
+
+// Returns the size of the specified tag/array value type, 0 if it is
+// not a fixed size type.
+static uint32_t getValueSize(char type)
+{
+    switch(type)
+    {
+        case 'A':
+        case 'c':
+        case 'C':
+            return(1);
+        case 's':
+        case 'S':
+            return(2);
+        case 'i':
+        case 'I':
+        case 'f':
+            return(4);
+        default:
+            return(0);
+    }
+}
+
+
+// Returns true if the BAM tag type matches the requested type,
+// where 'i' matches any integer type.
+static bool typeMatches(char bamType, char type)
+{
+    if(type == 'i')
+    {
+        return((bamType == 'c') || (bamType == 'C') ||
+               (bamType == 's') || (bamType == 'S') ||
+               (bamType == 'i') || (bamType == 'I'));
+    }
+    return(bamType == type);
+}
+
+
+BamRecordEditor::BamRecordEditor()
+    : myBuffer(),
+      myStatus()
+{
+}
+
+
+bool BamRecordEditor::load(SamRecord& record)
+{
+    const char* buffer = (const char*)record.getRecordBuffer(SamRecord::NONE);
+    if(buffer == NULL)
+    {
+        myStatus.setStatus(SamStatus::FAIL_MEM,
+                           "Failed to get the BAM record buffer.");
+        myBuffer.clear();
+        return(false);
+    }
+    int32_t blockSize = 0;
+    memcpy(&blockSize, buffer, sizeof(blockSize));
+    myBuffer.assign(buffer, buffer + blockSize + sizeof(blockSize));
+    if((myBuffer.size() < DATA_OFFSET) || (getTagsOffset() > myBuffer.size()))
+    {
+        myStatus.setStatus(SamStatus::INVALID,
+                           "Invalid BAM record buffer.");
+        myBuffer.clear();
+        return(false);
+    }
+    return(true);
+}
+
+
+bool BamRecordEditor::store(SamRecord& record, SamFileHeader& header)
+{
+    if(myBuffer.empty())
+    {
+        myStatus.setStatus(SamStatus::FAIL_ORDER,
+                           "Cannot store a record that was not loaded.");
+        return(false);
+    }
+    SamStatus::Status status = record.setBuffer(&(myBuffer[0]),
+                                                myBuffer.size(), header);
+    if(status != SamStatus::SUCCESS)
+    {
+        myStatus.setStatus(status, "Failed to store the edited BAM record.");
+        return(false);
+    }
+    return(true);
+}
+
+
+void BamRecordEditor::mapQualities(const int* qualMap, int maxQualChar)
+{
+    uint32_t readLength = getReadLength();
+    unsigned char* qual = (unsigned char*)&(myBuffer[getQualityOffset()]);
+    if((readLength == 0) || (qual[0] == MISSING_QUAL))
+    {
+        // Only map set qualities.
+        return;
+    }
+    for(uint32_t i = 0; i < readLength; i++)
+    {
+        int qualChar = qual[i] + QUAL_CONVERT;
+        if(qualChar <= maxQualChar)
+        {
+            qual[i] = qualMap[qualChar] - QUAL_CONVERT;
+        }
+    }
+}
+
+
+bool BamRecordEditor::setQualities(const char* quality)
+{
+    uint32_t readLength = getReadLength();
+    unsigned char* qual = (unsigned char*)&(myBuffer[getQualityOffset()]);
+    if(strcmp(quality, "*") == 0)
+    {
+        memset(qual, MISSING_QUAL, readLength);
+        return(true);
+    }
+    if(strlen(quality) != readLength)
+    {
+        myStatus.setStatus(SamStatus::INVALID,
+                           "Quality length does not match the sequence length.");
+        return(false);
+    }
+    for(uint32_t i = 0; i < readLength; i++)
+    {
+        qual[i] = quality[i] - QUAL_CONVERT;
+    }
+    return(true);
+}
+
+
+bool BamRecordEditor::setMatchesToEquals(EqualsEncoder& encoder,
+                                         SamFileHeader& header)
+{
+    if(myBuffer.empty() || 
+       !encoder.encode(&(myBuffer[0]), myBuffer.size(), header))
+    {
+        myStatus.setStatus(SamStatus::INVALID,
+                           "Invalid BAM record buffer.");
+        return(false);
+    }
+    return(true);
+}
+
+
+bool BamRecordEditor::getStringTag(const char* tag, std::string& value)
+{
+    uint32_t offset = findTag(tag);
+    if((offset == 0) || (myBuffer[offset + 2] != 'Z'))
+    {
+        return(false);
+    }
+    // getTagSize verified that the value is null terminated.
+    value = &(myBuffer[offset + 3]);
+    return(true);
+}
+
+
+bool BamRecordEditor::getIntegerTag(const char* tag, int& value)
+{
+    uint32_t offset = findTag(tag);
+    if(offset == 0)
+    {
+        return(false);
+    }
+    const char* valuePtr = &(myBuffer[offset + 3]);
+    switch(myBuffer[offset + 2])
+    {
+        case 'c':
+        {
+            int8_t val;
+            memcpy(&val, valuePtr, sizeof(val));
+            value = val;
+            return(true);
+        }
+        case 'C':
+        {
+            uint8_t val;
+            memcpy(&val, valuePtr, sizeof(val));
+            value = val;
+            return(true);
+        }
+        case 's':
+        {
+            int16_t val;
+            memcpy(&val, valuePtr, sizeof(val));
+            value = val;
+            return(true);
+        }
+        case 'S':
+        {
+            uint16_t val;
+            memcpy(&val, valuePtr, sizeof(val));
+            value = val;
+            return(true);
+        }
+        case 'i':
+        {
+            int32_t val;
+            memcpy(&val, valuePtr, sizeof(val));
+            value = val;
+            return(true);
+        }
+        case 'I':
+        {
+            uint32_t val;
+            memcpy(&val, valuePtr, sizeof(val));
+            value = val;
+            return(true);
+        }
+        default:
+            return(false);
+    }
+}
+
+
+void BamRecordEditor::removeTag(const char* tag, char type)
+{
+    uint32_t offset = findTag(tag);
+    if((offset != 0) && typeMatches(myBuffer[offset + 2], type))
+    {
+        replace(offset, getTagSize(offset), NULL, 0);
+    }
+}
+
+
+bool BamRecordEditor::removeTags(const char* tags)
+{
+    const char* currentTagPtr = tags;
+    while(*currentTagPtr != '\0')
+    {
+        // Tags are formatted as: XY:Z
+        if((currentTagPtr[0] == '\0') || (currentTagPtr[1] == '\0') ||
+           (currentTagPtr[2] != ':') || (currentTagPtr[3] == '\0'))
+        {
+            myStatus.setStatus(SamStatus::INVALID,
+                               "removeTags called with improperly formatted tags.");
+            return(false);
+        }
+        removeTag(currentTagPtr, currentTagPtr[3]);
+
+        // Move to the next tag.
+        if((currentTagPtr[4] == ',') || (currentTagPtr[4] == ';'))
+        {
+            currentTagPtr += 5;
+        }
+        else if(currentTagPtr[4] == '\0')
+        {
+            currentTagPtr += 4;
+        }
+        else
+        {
+            myStatus.setStatus(SamStatus::INVALID,
+                               "removeTags called with improperly formatted tags.");
+            return(false);
+        }
+    }
+    return(true);
+}
+
+
+void BamRecordEditor::setStringTag(const char* tag, const char* value)
+{
+    std::string newTag(tag, 2);
+    newTag += 'Z';
+    newTag += value;
+    newTag += '\0';
+
+    uint32_t offset = findTag(tag);
+    if(offset != 0)
+    {
+        replace(offset, getTagSize(offset), newTag.data(), newTag.size());
+        return;
+    }
+
+    // Add it before the first tag that sorts after it, the same order
+    // SamRecord writes its tags in.
+    offset = getTagsOffset();
+    while(offset < myBuffer.size())
+    {
+        uint32_t tagSize = getTagSize(offset);
+        if((tagSize == 0) || (strncmp(&(myBuffer[offset]), tag, 2) > 0))
+        {
+            break;
+        }
+        offset += tagSize;
+    }
+    replace(offset, 0, newTag.data(), newTag.size());
+}
+
+
+uint32_t BamRecordEditor::getReadLength()
+{
+    int32_t readLength = 0;
+    memcpy(&readLength, &(myBuffer[READ_LEN_OFFSET]), sizeof(readLength));
+    return((readLength < 0) ? 0 : readLength);
+}
+
+
+uint32_t BamRecordEditor::getQualityOffset()
+{
+    uint16_t cigarLength = 0;
+    memcpy(&cigarLength, &(myBuffer[CIGAR_LEN_OFFSET]), sizeof(cigarLength));
+    return(DATA_OFFSET + (uint8_t)(myBuffer[READ_NAME_LEN_OFFSET]) +
+           (cigarLength * sizeof(uint32_t)) + ((getReadLength() + 1) / 2));
+}
+
+
+uint32_t BamRecordEditor::getTagsOffset()
+{
+    return(getQualityOffset() + getReadLength());
+}
+
+
+uint32_t BamRecordEditor::findTag(const char* tag)
+{
+    uint32_t offset = getTagsOffset();
+    while(offset < myBuffer.size())
+    {
+        uint32_t tagSize = getTagSize(offset);
+        if(tagSize == 0)
+        {
+            // Invalid tags.
+            return(0);
+        }
+        if((myBuffer[offset] == tag[0]) && (myBuffer[offset + 1] == tag[1]))
+        {
+            return(offset);
+        }
+        offset += tagSize;
+    }
+    return(0);
+}
+
+
+uint32_t BamRecordEditor::getTagSize(uint32_t offset)
+{
+    // Tag name & type.
+    uint32_t headerSize = 3;
+    if((offset + headerSize) > myBuffer.size())
+    {
+        return(0);
+    }
+    char type = myBuffer[offset + 2];
+    uint32_t size = 0;
+    if((type == 'Z') || (type == 'H'))
+    {
+        const char* start = &(myBuffer[offset + headerSize]);
+        const void* end = memchr(start, '\0', myBuffer.size() - offset - headerSize);
+        if(end == NULL)
+        {
+            return(0);
+        }
+        size = headerSize + ((const char*)end - start) + 1;
+    }
+    else if(type == 'B')
+    {
+        // Array type & count followed by the values.
+        uint32_t count = 0;
+        if((offset + headerSize + 1 + sizeof(count)) > myBuffer.size())
+        {
+            return(0);
+        }
+        memcpy(&count, &(myBuffer[offset + headerSize + 1]), sizeof(count));
+        uint32_t valueSize = getValueSize(myBuffer[offset + headerSize]);
+        if(valueSize == 0)
+        {
+            return(0);
+        }
+        size = headerSize + 1 + sizeof(count) + ((uint64_t)count * valueSize);
+    }
+    else
+    {
+        size = getValueSize(type);
+        if(size == 0)
+        {
+            return(0);
+        }
+        size += headerSize;
+    }
+    if((offset + size) > myBuffer.size())
+    {
+        return(0);
+    }
+    return(size);
+}
+
+
+void BamRecordEditor::replace(uint32_t offset, uint32_t len, 
+                              const char* newBytes, uint32_t newLen)
+{
+    if(newLen == len)
+    {
+        memcpy(&(myBuffer[offset]), newBytes, newLen);
+        return;
+    }
+    myBuffer.erase(myBuffer.begin() + offset, myBuffer.begin() + offset + len);
+    if(newLen != 0)
+    {
+        myBuffer.insert(myBuffer.begin() + offset, newBytes, newBytes + newLen);
+    }
+    int32_t blockSize = myBuffer.size() - sizeof(blockSize);
+    memcpy(&(myBuffer[0]), &blockSize, sizeof(blockSize));
+}
@@ -0,0 +1,101 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BAM_RECORD_EDITOR_H__
+#define __BAM_RECORD_EDITOR_H__
+
+#include <string>
+#include <vector>
+
+#include "SamRecord.h"
+#include "EqualsEncoder.h"
+
+/// Edits a copy of a record's BAM buffer in place and then stores it back
+/// into the record.  This avoids SamRecord decoding every field into
+/// strings and re-encoding the whole record when only the qualities or
+/// tags are changed.
+/// Edits are made to the loaded copy, so the record must not be
+/// changed between load and store.
+class BamRecordEditor
+{
+public:
+    BamRecordEditor();
+
+    /// Copy the BAM buffer of the record for editing.
+    /// Returns false if the record does not have a valid buffer.
+    bool load(SamRecord& record);
+
+    /// Replace the contents of the record with the edited buffer.
+    bool store(SamRecord& record, SamFileHeader& header);
+
+    /// Replace each quality character q with qualMap[q], where qualMap
+    /// has an entry for every character up to maxQualChar.  Records without
+    /// qualities are not changed.
+    void mapQualities(const int* qualMap, int maxQualChar);
+
+    /// Replace the qualities with the specified quality string ("*" for
+    /// none).  Returns false if the length does not match the sequence.
+    bool setQualities(const char* quality);
+
+    /// Replace the bases that match the encoder's reference with '=',
+    /// the same as writing with SamRecord::EQUAL.
+    bool setMatchesToEquals(EqualsEncoder& encoder, SamFileHeader& header);
+
+    /// Get the value of the specified string (Z) tag, returns false
+    /// if the record does not have it.
+    bool getStringTag(const char* tag, std::string& value);
+
+    /// Get the value of the specified integer tag, returns false
+    /// if the record does not have it.
+    bool getIntegerTag(const char* tag, int& value);
+
+    /// Remove the tag if it is in the record with the specified type,
+    /// where 'i' matches any of the integer types.
+    void removeTag(const char* tag, char type);
+
+    /// Remove the tags formatted as Tag:Type,Tag:Type,Tag:Type...
+    /// Returns false if they are not formatted correctly.
+    bool removeTags(const char* tags);
+
+    /// Set the value of the specified string (Z) tag, replacing it if the
+    /// record already has it, otherwise adding it in tag name order.
+    void setStringTag(const char* tag, const char* value);
+
+    /// Get the status of the last failure.
+    SamStatus& getStatus() { return(myStatus); }
+
+private:
+    // Fields of the BAM record buffer, which starts with the block size.
+    uint32_t getReadLength();
+    uint32_t getQualityOffset();
+    uint32_t getTagsOffset();
+
+    // Offset of the specified tag, or 0 if the record does not have it.
+    uint32_t findTag(const char* tag);
+    // Size of the tag, including its name & type, at the specified offset.
+    // Returns 0 if it extends past the end of the buffer.
+    uint32_t getTagSize(uint32_t offset);
+    // Replace len bytes at the offset with the new ones, updating
+    // the block size.
+    void replace(uint32_t offset, uint32_t len, 
+                 const char* newBytes, uint32_t newLen);
+
+    std::vector<char> myBuffer;
+    SamStatus myStatus;
+};
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "BamRecordView.h"
+
+const Cigar::Operation BamRecordView::ourOperations[16] = 
+    {Cigar::match, Cigar::insert, Cigar::del, Cigar::skip,
+     Cigar::softClip, Cigar::hardClip, Cigar::pad, Cigar::match,
+     Cigar::mismatch, Cigar::none, Cigar::none, Cigar::none,
+     Cigar::none, Cigar::none, Cigar::none, Cigar::none};
+
+
+BamRecordView::BamRecordView()
+    : myBuffer(NULL),
+      myCigar(NULL),
+      mySize(0)
+{
+}
+
+
+bool BamRecordView::set(const char* buffer, uint32_t size)
+{
+    if(size < NAME_OFFSET)
+    {
+        return(false);
+    }
+    myBuffer = buffer;
+    mySize = size;
+    myCigar = myBuffer + NAME_OFFSET + (unsigned char)myBuffer[NAME_LEN_OFFSET];
+    if((myCigar + getNumCigarOps() * sizeof(uint32_t)) > (buffer + size))
+    {
+        myBuffer = NULL;
+        myCigar = NULL;
+        mySize = 0;
+        return(false);
+    }
+    return(true);
+}
+
+
+int32_t BamRecordView::get0BasedAlignmentEnd()
+{
+    int32_t alignmentLength = 0;
+    uint16_t numCigarOps = getNumCigarOps();
+    for(uint16_t i = 0; i < numCigarOps; i++)
+    {
+        if(Cigar::foundInReference(getCigarOperation(i)))
+        {
+            alignmentLength += getCigarLength(i);
+        }
+    }
+    if(alignmentLength == 0)
+    {
+        return(get0BasedPosition());
+    }
+    return(get0BasedPosition() + alignmentLength - 1);
+}
+
+
+const char* BamRecordView::getQualities()
+{
+    int32_t readLength = getReadLength();
+    if(readLength < 0)
+    {
+        return(NULL);
+    }
+    // The qualities follow the 4 bit encoded sequence.
+    const char* qualities = 
+        myCigar + getNumCigarOps() * sizeof(uint32_t) + (readLength + 1) / 2;
+    if((qualities + readLength) > (myBuffer + mySize))
+    {
+        return(NULL);
+    }
+    return(qualities);
+}
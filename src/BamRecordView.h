@@ -0,0 +1,106 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BAM_RECORD_VIEW_H__
+#define __BAM_RECORD_VIEW_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include "Cigar.h"
+
+/// Read only view of a BAM record buffer (starting with the block size)
+/// that only decodes the fixed fields, the raw CIGAR operations, and
+/// the raw qualities, for tools that do not need the sequence or tags.
+/// The buffer must stay valid while the view is used.
+class BamRecordView
+{
+public:
+    BamRecordView();
+
+    /// View the specified buffer, returning false if it is too short
+    /// for its read name and CIGAR.
+    bool set(const char* buffer, uint32_t size);
+
+    int32_t getReferenceID() { return(getInt32(REF_ID_OFFSET)); }
+    int32_t get0BasedPosition() { return(getInt32(POS_OFFSET)); }
+    uint8_t getMapQuality() { return((uint8_t)myBuffer[MAP_QUAL_OFFSET]); }
+    uint16_t getFlag() { return(getUInt16(FLAG_OFFSET)); }
+    int32_t getMateReferenceID() { return(getInt32(MATE_REF_ID_OFFSET)); }
+    int32_t get0BasedMatePosition() { return(getInt32(MATE_POS_OFFSET)); }
+    int32_t getInsertSize() { return(getInt32(INSERT_SIZE_OFFSET)); }
+    const char* getReadName() { return(myBuffer + NAME_OFFSET); }
+    int32_t getReadLength() { return(getInt32(READ_LEN_OFFSET)); }
+
+    uint16_t getNumCigarOps() { return(getUInt16(NUM_CIGAR_OFFSET)); }
+    /// Get the operation of the specified CIGAR entry.
+    Cigar::Operation getCigarOperation(uint16_t index)
+    { return(ourOperations[getCigarEntry(index) & 0xF]); }
+    /// Get the length of the specified CIGAR entry.
+    uint32_t getCigarLength(uint16_t index)
+    { return(getCigarEntry(index) >> 4); }
+
+    /// Returns the 0 based position of the last reference base the read is
+    /// aligned to, or the position if it does not align to any.
+    int32_t get0BasedAlignmentEnd();
+
+    /// Get the getReadLength() phred qualities (not offset by 33), 
+    /// the first is 0xFF if the record does not have qualities.
+    /// Returns NULL if the buffer is too short for them.
+    const char* getQualities();
+
+private:
+    static const uint32_t REF_ID_OFFSET = 4;
+    static const uint32_t POS_OFFSET = 8;
+    static const uint32_t NAME_LEN_OFFSET = 12;
+    static const uint32_t MAP_QUAL_OFFSET = 13;
+    static const uint32_t NUM_CIGAR_OFFSET = 16;
+    static const uint32_t FLAG_OFFSET = 18;
+    static const uint32_t READ_LEN_OFFSET = 20;
+    static const uint32_t MATE_REF_ID_OFFSET = 24;
+    static const uint32_t MATE_POS_OFFSET = 28;
+    static const uint32_t INSERT_SIZE_OFFSET = 32;
+    static const uint32_t NAME_OFFSET = 36;
+
+    // Operation for each BAM CIGAR op code, "MIDNSHP=X".
+    static const Cigar::Operation ourOperations[16];
+
+    int32_t getInt32(uint32_t offset)
+    {
+        int32_t value;
+        memcpy(&value, myBuffer + offset, sizeof(value));
+        return(value);
+    }
+    uint16_t getUInt16(uint32_t offset)
+    {
+        uint16_t value;
+        memcpy(&value, myBuffer + offset, sizeof(value));
+        return(value);
+    }
+    uint32_t getCigarEntry(uint16_t index)
+    {
+        uint32_t value;
+        memcpy(&value, myCigar + index * sizeof(value), sizeof(value));
+        return(value);
+    }
+
+    const char* myBuffer;
+    const char* myCigar;
+    uint32_t mySize;
+};
+
+#endif
@@ -0,0 +1,155 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//////////////////////////////////////////////////////////////////////////
+// This file contains the processing for the executable option "baseQC"
+// which converts a binary baseQC file written by "stats --bBaseQC" to text.
+
+#include "BaseQC.h"
+#include "BaseQCFile.h"
+#include "InputFile.h"
+#include "Parameters.h"
+#include "SamStatus.h"
+
+void BaseQC::printBaseQCDescription(std::ostream& os)
+{
+    os << " baseQC - Print a region of a binary stats --bBaseQC file as pBaseQC/cBaseQC text" << std::endl;
+}
+
+
+void BaseQC::printDescription(std::ostream& os)
+{
+    printBaseQCDescription(os);
+}
+
+
+void BaseQC::printUsage(std::ostream& os)
+{
+    BamExecutable::printUsage(os);
+    os << "\t./bam baseQC --in <bBaseQCFile> [--out <outputFile>] [--percent] [--refName <name>] [--start <pos>] [--end <pos>] [--params]" << std::endl;
+    os << "\tRequired Parameters:" << std::endl;
+    os << "\t\t--in      : the binary baseQC file written by 'bam stats --bBaseQC'" << std::endl;
+    os << "\tOptional Parameters:" << std::endl;
+    os << "\t\t--out     : the text file to write, formatted like stats --cBaseQC" << std::endl;
+    os << "\t\t            Defaults to stdout." << std::endl;
+    os << "\t\t--percent : format the output like stats --pBaseQC" << std::endl;
+    os << "\t\t--refName : only print the positions of this reference." << std::endl;
+    os << "\t\t            Defaults to all references." << std::endl;
+    os << "\t\t--start   : inclusive 0-based start position." << std::endl;
+    os << "\t\t            Defaults to the start of the reference." << std::endl;
+    os << "\t\t            Only applicable if refName is set." << std::endl;
+    os << "\t\t--end     : exclusive 0-based end position." << std::endl;
+    os << "\t\t            Defaults to -1: meaning til the end of the reference." << std::endl;
+    os << "\t\t            Only applicable if refName is set." << std::endl;
+    os << "\t\t--params  : print the parameter settings" << std::endl;
+    os << std::endl;
+}
+
+
+int BaseQC::execute(int argc, char **argv)
+{
+    // Extract command line arguments.
+    String inFile = "";
+    String outFile = "-";
+    bool percent = false;
+    String refName = "";
+    int start = 0;
+    int end = -1;
+    bool params = false;
+
+    ParameterList inputParameters;
+    BEGIN_LONG_PARAMETERS(longParameterList)
+        LONG_STRINGPARAMETER("in", &inFile)
+        LONG_STRINGPARAMETER("out", &outFile)
+        LONG_PARAMETER("percent", &percent)
+        LONG_STRINGPARAMETER("refName", &refName)
+        LONG_INTPARAMETER("start", &start)
+        LONG_INTPARAMETER("end", &end)
+        LONG_PARAMETER("params", &params)
+        LONG_PHONEHOME(VERSION)
+        END_LONG_PARAMETERS();
+   
+    inputParameters.Add(new LongParameters ("Input Parameters", 
+                                            longParameterList));
+
+    // parameters start at index 2 rather than 1.
+    inputParameters.Read(argc, argv, 2);
+
+    // Check to see if the in file was specified, if not, report an error.
+    if(inFile == "")
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        // mandatory argument was not specified.
+        std::cerr << "Missing mandatory argument: --in" << std::endl;
+        return(-1);
+    }
+
+    if(params)
+    {
+        inputParameters.Status();
+    }
+
+    BaseQCFile baseQCFile;
+    if(!baseQCFile.openForRead(inFile.c_str()))
+    {
+        return(SamStatus::FAIL_IO);
+    }
+
+    if(!refName.IsEmpty())
+    {
+        int32_t refID = baseQCFile.getReferenceID(refName.c_str());
+        if(refID < 0)
+        {
+            std::cerr << "ERROR: " << refName << " is not a reference in "
+                      << inFile << std::endl;
+            return(-1);
+        }
+        baseQCFile.setReadRegion(refID, start < 0 ? 0 : start, end);
+    }
+
+    IFILE outPtr = ifopen(outFile, "w");
+    if(outPtr == NULL)
+    {
+        std::cerr << "ERROR: Failed to open " << outFile << std::endl;
+        return(SamStatus::FAIL_IO);
+    }
+    PileupElementBaseQCStats::setPercentStats(percent);
+    PileupElementBaseQCStats::setOutputFile(outPtr);
+    PileupElementBaseQCStats::printHeader();
+
+    // Format the rows a block at a time.
+    BaseQCFile::Row row;
+    String rows;
+    int numRows = 0;
+    while(baseQCFile.readRow(row))
+    {
+        PileupElementBaseQCStats::formatRow(
+            baseQCFile.getReferenceName(row.refID).c_str(), row.refPosition,
+            row.counts, rows);
+        if(++numRows == (int)BaseQCFile::ROWS_PER_BLOCK)
+        {
+            PileupElementBaseQCStats::writeRows(rows);
+            rows.Clear();
+            numRows = 0;
+        }
+    }
+    PileupElementBaseQCStats::writeRows(rows);
+    PileupElementBaseQCStats::setOutputFile(NULL);
+    ifclose(outPtr);
+    return(SamStatus::SUCCESS);
+}
@@ -0,0 +1,463 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iostream>
+#include <stdexcept>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "BaseQCFile.h"
+
+const char BaseQCFile::MAGIC[4] = {'B', 'Q', 'C', 1};
+
+// The int counters in the order their columns are stored, after the
+// position column.
+static int PileupElementBaseQCStats::Counts::* const COUNT_COLUMNS[] =
+{
+    &PileupElementBaseQCStats::Counts::numEntries,
+    &PileupElementBaseQCStats::Counts::numQ20,
+    &PileupElementBaseQCStats::Counts::depth,
+    &PileupElementBaseQCStats::Counts::numDups,
+    &PileupElementBaseQCStats::Counts::numMapped,
+    &PileupElementBaseQCStats::Counts::numMapQPass,
+    &PileupElementBaseQCStats::Counts::numZeroMapQ,
+    &PileupElementBaseQCStats::Counts::numLT10MapQ,
+    &PileupElementBaseQCStats::Counts::numPaired,
+    &PileupElementBaseQCStats::Counts::numProperPaired,
+    &PileupElementBaseQCStats::Counts::numQCFail,
+    &PileupElementBaseQCStats::Counts::numMapQ255,
+    &PileupElementBaseQCStats::Counts::averageMapQCount
+};
+
+
+BaseQCFile::BaseQCFile()
+    : myFile(NULL),
+      myFileName(),
+      myWriting(false),
+      myOffset(0),
+      myRefNames(),
+      myIndex(),
+      myRows(),
+      myBuffer(),
+      myDeflated(),
+      myReadRefID(-1),
+      myReadStart(0),
+      myReadEnd(-1),
+      myNextBlock(0),
+      myNextRow(0)
+{
+}
+
+
+BaseQCFile::~BaseQCFile()
+{
+    close();
+}
+
+
+bool BaseQCFile::openForWrite(const char* fileName, SamFileHeader& header)
+{
+    close();
+    myFileName = fileName;
+    myFile = (myFileName == "-") ? stdout : fopen(fileName, "wb");
+    if(myFile == NULL)
+    {
+        std::cerr << "ERROR: Failed to open " << fileName
+                  << " for writing.\n";
+        return(false);
+    }
+    myWriting = true;
+    myOffset = 0;
+
+    const SamReferenceInfo& refInfo = header.getReferenceInfo();
+    for(int refID = 0; refID < refInfo.getNumEntries(); refID++)
+    {
+        myRefNames.push_back(refInfo.getReferenceName(refID).c_str());
+    }
+    if(!write(MAGIC, sizeof(MAGIC)))
+    {
+        std::cerr << "ERROR: Failed to write " << myFileName << ".\n";
+        return(false);
+    }
+    return(true);
+}
+
+
+void BaseQCFile::addRow(int32_t refID, int32_t refPosition,
+                        const Counts& counts)
+{
+    if(!myRows.empty() &&
+       ((myRows[0].refID != refID) || (myRows.size() >= ROWS_PER_BLOCK)) &&
+       !writeBlock())
+    {
+        throw std::runtime_error("Failed to write " + myFileName);
+    }
+    Row row;
+    row.refID = refID;
+    row.refPosition = refPosition;
+    row.counts = counts;
+    myRows.push_back(row);
+}
+
+
+void BaseQCFile::packRow(int32_t refID, int32_t refPosition,
+                         const Counts& counts, std::string& rows)
+{
+    Row row;
+    row.refID = refID;
+    row.refPosition = refPosition;
+    row.counts = counts;
+    rows.append((const char*)&row, sizeof(row));
+}
+
+
+void BaseQCFile::addPackedRows(const std::string& rows)
+{
+    Row row;
+    for(size_t pos = 0; pos + sizeof(row) <= rows.size(); pos += sizeof(row))
+    {
+        memcpy(&row, rows.data() + pos, sizeof(row));
+        addRow(row.refID, row.refPosition, row.counts);
+    }
+}
+
+
+bool BaseQCFile::openForRead(const char* fileName)
+{
+    close();
+    myFileName = fileName;
+    myFile = fopen(fileName, "rb");
+    if(myFile == NULL)
+    {
+        std::cerr << "ERROR: Failed to open " << fileName << ".\n";
+        return(false);
+    }
+
+    char magic[sizeof(MAGIC)];
+    char endMagic[sizeof(MAGIC)];
+    uint64_t indexOffset = 0;
+    uint32_t numRefs = 0;
+    uint32_t numBlocks = 0;
+    bool valid = 
+        (fread(magic, sizeof(magic), 1, myFile) == 1) &&
+        (memcmp(magic, MAGIC, sizeof(MAGIC)) == 0) &&
+        (fseeko(myFile, -(off_t)(sizeof(indexOffset) + sizeof(MAGIC)),
+                SEEK_END) == 0) &&
+        (fread(&indexOffset, sizeof(indexOffset), 1, myFile) == 1) &&
+        (fread(endMagic, sizeof(endMagic), 1, myFile) == 1) &&
+        (memcmp(endMagic, MAGIC, sizeof(MAGIC)) == 0) &&
+        (fseeko(myFile, indexOffset, SEEK_SET) == 0) &&
+        (fread(&numRefs, sizeof(numRefs), 1, myFile) == 1);
+
+    for(uint32_t i = 0; valid && (i < numRefs); i++)
+    {
+        uint32_t len = 0;
+        valid = (fread(&len, sizeof(len), 1, myFile) == 1);
+        std::string name(len, '\0');
+        valid = valid && 
+            ((len == 0) || (fread(&(name[0]), len, 1, myFile) == 1));
+        myRefNames.push_back(name);
+    }
+    valid = valid && (fread(&numBlocks, sizeof(numBlocks), 1, myFile) == 1);
+    for(uint32_t i = 0; valid && (i < numBlocks); i++)
+    {
+        BlockInfo block;
+        valid = 
+            (fread(&block.refID, sizeof(block.refID), 1, myFile) == 1) &&
+            (fread(&block.firstPos, sizeof(block.firstPos), 1, myFile) == 1) &&
+            (fread(&block.lastPos, sizeof(block.lastPos), 1, myFile) == 1) &&
+            (fread(&block.numRows, sizeof(block.numRows), 1, myFile) == 1) &&
+            (fread(&block.offset, sizeof(block.offset), 1, myFile) == 1) &&
+            (fread(&block.size, sizeof(block.size), 1, myFile) == 1) &&
+            (block.refID >= 0) && ((uint32_t)block.refID < numRefs) &&
+            (block.numRows <= ROWS_PER_BLOCK) && 
+            (block.offset + block.size <= indexOffset);
+        myIndex.push_back(block);
+    }
+    if(!valid)
+    {
+        std::cerr << "ERROR: " << fileName
+                  << " is not a valid binary baseQC file.\n";
+        close();
+        return(false);
+    }
+    setReadRegion(-1);
+    return(true);
+}
+
+
+int32_t BaseQCFile::getReferenceID(const std::string& refName) const
+{
+    for(unsigned int i = 0; i < myRefNames.size(); i++)
+    {
+        if(myRefNames[i] == refName)
+        {
+            return(i);
+        }
+    }
+    return(-1);
+}
+
+
+void BaseQCFile::setReadRegion(int32_t refID, int32_t start, int32_t end)
+{
+    myReadRefID = refID;
+    myReadStart = start;
+    myReadEnd = end;
+    myNextBlock = 0;
+    myNextRow = 0;
+    myRows.clear();
+}
+
+
+bool BaseQCFile::readRow(Row& row)
+{
+    while(true)
+    {
+        while(myNextRow < myRows.size())
+        {
+            const Row& next = myRows[myNextRow++];
+            if((myReadRefID < 0) ||
+               ((next.refPosition >= myReadStart) &&
+                ((myReadEnd < 0) || (next.refPosition < myReadEnd))))
+            {
+                row = next;
+                return(true);
+            }
+        }
+
+        // Find the next block that overlaps the region.
+        for(; myNextBlock < myIndex.size(); ++myNextBlock)
+        {
+            const BlockInfo& block = myIndex[myNextBlock];
+            if((myReadRefID < 0) ||
+               ((block.refID == myReadRefID) &&
+                (block.lastPos >= myReadStart) &&
+                ((myReadEnd < 0) || (block.firstPos < myReadEnd))))
+            {
+                break;
+            }
+        }
+        if(myNextBlock >= myIndex.size())
+        {
+            return(false);
+        }
+        if(!readBlock(myIndex[myNextBlock++]))
+        {
+            throw std::runtime_error("Failed to read a block of " + 
+                                     myFileName);
+        }
+        myNextRow = 0;
+    }
+}
+
+
+bool BaseQCFile::close()
+{
+    bool success = true;
+    if(myWriting)
+    {
+        success = writeBlock();
+        uint64_t indexOffset = myOffset;
+        uint32_t numRefs = myRefNames.size();
+        uint32_t numBlocks = myIndex.size();
+        success = success && write(&numRefs, sizeof(numRefs));
+        for(uint32_t i = 0; success && (i < numRefs); i++)
+        {
+            uint32_t len = myRefNames[i].size();
+            success = write(&len, sizeof(len)) &&
+                write(myRefNames[i].c_str(), len);
+        }
+        success = success && write(&numBlocks, sizeof(numBlocks));
+        for(uint32_t i = 0; success && (i < numBlocks); i++)
+        {
+            const BlockInfo& block = myIndex[i];
+            success =
+                write(&block.refID, sizeof(block.refID)) &&
+                write(&block.firstPos, sizeof(block.firstPos)) &&
+                write(&block.lastPos, sizeof(block.lastPos)) &&
+                write(&block.numRows, sizeof(block.numRows)) &&
+                write(&block.offset, sizeof(block.offset)) &&
+                write(&block.size, sizeof(block.size));
+        }
+        success = success && write(&indexOffset, sizeof(indexOffset)) &&
+            write(MAGIC, sizeof(MAGIC));
+    }
+    if(myFile != NULL)
+    {
+        if(myFile == stdout)
+        {
+            success &= (fflush(myFile) == 0);
+        }
+        else
+        {
+            success &= (fclose(myFile) == 0);
+        }
+    }
+    if(myWriting && !success)
+    {
+        std::cerr << "ERROR: Failed to write " << myFileName << ".\n";
+        if(myFile != stdout)
+        {
+            unlink(myFileName.c_str());
+        }
+    }
+    myFile = NULL;
+    myWriting = false;
+    myRefNames.clear();
+    myIndex.clear();
+    myRows.clear();
+    return(success);
+}
+
+
+bool BaseQCFile::writeBlock()
+{
+    if(myRows.empty())
+    {
+        return(true);
+    }
+    uint32_t numRows = myRows.size();
+    myBuffer.resize(numRows * ROW_SIZE);
+    char* out = &(myBuffer[0]);
+
+    // Store the differences from the previous position, which are mostly
+    // small or zero, so the block deflates well.
+    uint32_t prev = 0;
+    BlockInfo block;
+    block.refID = myRows[0].refID;
+    block.firstPos = myRows[0].refPosition;
+    block.lastPos = myRows[0].refPosition;
+    block.numRows = numRows;
+    block.offset = myOffset;
+    for(uint32_t i = 0; i < numRows; i++)
+    {
+        int32_t pos = myRows[i].refPosition;
+        if(pos < block.firstPos)
+        {
+            block.firstPos = pos;
+        }
+        if(pos > block.lastPos)
+        {
+            block.lastPos = pos;
+        }
+        uint32_t diff = (uint32_t)pos - prev;
+        memcpy(out, &diff, sizeof(diff));
+        out += sizeof(diff);
+        prev = pos;
+    }
+    for(unsigned int c = 0; c < NUM_INT_COLUMNS - 1; c++)
+    {
+        prev = 0;
+        for(uint32_t i = 0; i < numRows; i++)
+        {
+            uint32_t value = myRows[i].counts.*COUNT_COLUMNS[c];
+            uint32_t diff = value - prev;
+            memcpy(out, &diff, sizeof(diff));
+            out += sizeof(diff);
+            prev = value;
+        }
+    }
+    uint64_t prevSum = 0;
+    for(uint32_t i = 0; i < numRows; i++)
+    {
+        uint64_t diff = myRows[i].counts.sumMapQ - prevSum;
+        memcpy(out, &diff, sizeof(diff));
+        out += sizeof(diff);
+        prevSum = myRows[i].counts.sumMapQ;
+    }
+    myRows.clear();
+
+    uLongf size = compressBound(myBuffer.size());
+    myDeflated.resize(size);
+    // Favor speed, since a genome's positions are millions of blocks.
+    if((compress2((Bytef*)&(myDeflated[0]), &size,
+                  (const Bytef*)&(myBuffer[0]), myBuffer.size(),
+                  Z_BEST_SPEED) != Z_OK) ||
+       !write(&(myDeflated[0]), size))
+    {
+        return(false);
+    }
+    block.size = size;
+    myIndex.push_back(block);
+    return(true);
+}
+
+
+bool BaseQCFile::write(const void* data, size_t size)
+{
+    if((size != 0) && (fwrite(data, size, 1, myFile) != 1))
+    {
+        return(false);
+    }
+    myOffset += size;
+    return(true);
+}
+
+
+bool BaseQCFile::readBlock(const BlockInfo& block)
+{
+    myDeflated.resize(block.size);
+    myBuffer.resize(block.numRows * ROW_SIZE);
+    uLongf size = myBuffer.size();
+    if((fseeko(myFile, block.offset, SEEK_SET) != 0) ||
+       ((block.size != 0) &&
+        (fread(&(myDeflated[0]), block.size, 1, myFile) != 1)) ||
+       (uncompress((Bytef*)&(myBuffer[0]), &size,
+                   (const Bytef*)&(myDeflated[0]), block.size) != Z_OK) ||
+       (size != myBuffer.size()))
+    {
+        return(false);
+    }
+
+    myRows.resize(block.numRows);
+    const char* in = &(myBuffer[0]);
+    uint32_t prev = 0;
+    for(uint32_t i = 0; i < block.numRows; i++)
+    {
+        uint32_t diff;
+        memcpy(&diff, in, sizeof(diff));
+        in += sizeof(diff);
+        prev += diff;
+        myRows[i].refID = block.refID;
+        myRows[i].refPosition = prev;
+    }
+    for(unsigned int c = 0; c < NUM_INT_COLUMNS - 1; c++)
+    {
+        prev = 0;
+        for(uint32_t i = 0; i < block.numRows; i++)
+        {
+            uint32_t diff;
+            memcpy(&diff, in, sizeof(diff));
+            in += sizeof(diff);
+            prev += diff;
+            myRows[i].counts.*COUNT_COLUMNS[c] = prev;
+        }
+    }
+    uint64_t prevSum = 0;
+    for(uint32_t i = 0; i < block.numRows; i++)
+    {
+        uint64_t diff;
+        memcpy(&diff, in, sizeof(diff));
+        in += sizeof(diff);
+        prevSum += diff;
+        myRows[i].counts.sumMapQ = prevSum;
+    }
+    return(true);
+}
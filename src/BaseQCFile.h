@@ -0,0 +1,153 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __BASE_QC_FILE_H__
+#define __BASE_QC_FILE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "SamFileHeader.h"
+#include "PileupElementBaseQCStats.h"
+
+/// Binary per base QC file written by "bam stats --bBaseQC" in place of
+/// the pBaseQC/cBaseQC text, and converted back to that text by
+/// "bam baseQC".  The covered positions are stored as fixed width
+/// counters in blocks of up to ROWS_PER_BLOCK positions of one reference.
+/// Each block stores the positions and then each counter as a column,
+/// every value as the difference from the previous position's, and is
+/// deflated on its own, so a region is read by inflating only the blocks
+/// the index lists for it.
+///
+/// The file is:
+///   magic,
+///   the deflated blocks,
+///   the index: number of references, per reference: name length, name,
+///              number of blocks, per block: refID, first position,
+///              last position, number of positions, file offset,
+///              deflated size,
+///   the file offset of the index, magic.
+/// Values are stored in the byte order of the machine writing them.
+class BaseQCFile
+{
+public:
+    typedef PileupElementBaseQCStats::Counts Counts;
+
+    /// A covered position and its counts.
+    struct Row
+    {
+        int32_t refID;
+        int32_t refPosition;
+        Counts counts;
+    };
+
+    /// Most positions stored in a block.
+    static const uint32_t ROWS_PER_BLOCK = 16384;
+
+    BaseQCFile();
+    ~BaseQCFile();
+
+    /// Open the file for writing rows on the header's references.
+    /// Returns false and prints the error on failure.
+    bool openForWrite(const char* fileName, SamFileHeader& header);
+
+    /// Add the counts of a position.  Positions of a reference are
+    /// expected in increasing order.  Throws std::runtime_error if the
+    /// file cannot be written.
+    void addRow(int32_t refID, int32_t refPosition, const Counts& counts);
+
+    /// Append a row to a buffer for addPackedRows, so rows can be
+    /// collected on other threads and added in order.
+    static void packRow(int32_t refID, int32_t refPosition,
+                        const Counts& counts, std::string& rows);
+
+    /// Add the rows appended by packRow.
+    void addPackedRows(const std::string& rows);
+
+    /// Open the file for reading, reading its index.
+    /// Returns false and prints the error on failure.
+    bool openForRead(const char* fileName);
+
+    int32_t getNumReferences() const { return(myRefNames.size()); }
+    const std::string& getReferenceName(int32_t refID) const
+    { return(myRefNames[refID]); }
+    /// Returns the ID of the reference, or -1 if it is not in the file.
+    int32_t getReferenceID(const std::string& refName) const;
+
+    /// Read only the positions of refID from start (0-based) to end
+    /// (exclusive, -1 for the end of the reference) with readRow.
+    /// Defaults to reading all positions.
+    void setReadRegion(int32_t refID, int32_t start = 0, int32_t end = -1);
+
+    /// Read the next row in the region, returning false when there are
+    /// no more.  Throws std::runtime_error if a block cannot be read.
+    bool readRow(Row& row);
+
+    /// Finish writing the file or stop reading it.
+    /// Returns false and prints the error if the file could not be written.
+    bool close();
+
+private:
+    BaseQCFile(const BaseQCFile&);
+    BaseQCFile& operator=(const BaseQCFile&);
+
+    struct BlockInfo
+    {
+        int32_t refID;
+        int32_t firstPos;
+        int32_t lastPos;
+        uint32_t numRows;
+        uint64_t offset;
+        uint32_t size;
+    };
+
+    // Number of 32 bit columns: the position & the int counts.
+    static const unsigned int NUM_INT_COLUMNS = 14;
+    // Bytes per row in an inflated block: the 32 bit columns & sumMapQ.
+    static const uint32_t ROW_SIZE = NUM_INT_COLUMNS * 4 + 8;
+    static const char MAGIC[4];
+
+    // Write the rows as a block, returning false if it cannot be written.
+    bool writeBlock();
+    bool write(const void* data, size_t size);
+    bool readBlock(const BlockInfo& block);
+
+    FILE* myFile;
+    std::string myFileName;
+    bool myWriting;
+    uint64_t myOffset;
+
+    std::vector<std::string> myRefNames;
+    std::vector<BlockInfo> myIndex;
+
+    // Rows of the block being written or read.
+    std::vector<Row> myRows;
+    std::vector<char> myBuffer;
+    std::vector<char> myDeflated;
+
+    // Region being read, the next block to check, and the next row.
+    int32_t myReadRefID;
+    int32_t myReadStart;
+    int32_t myReadEnd;
+    uint32_t myNextBlock;
+    uint32_t myNextRow;
+};
+
+#endif
@@ -0,0 +1,312 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+
+#include "BaseQCPileup.h"
+#include "SamFlag.h"
+
+// Add the change in the counts that apply to an entire record.
+static void addChange(PileupElementBaseQCStats::Counts& total,
+                      const PileupElementBaseQCStats::Counts& change,
+                      bool subtract)
+{
+    int sign = subtract ? -1 : 1;
+    total.numEntries += sign * change.numEntries;
+    total.numDups += sign * change.numDups;
+    total.numMapped += sign * change.numMapped;
+    total.numMapQPass += sign * change.numMapQPass;
+    total.numZeroMapQ += sign * change.numZeroMapQ;
+    total.numLT10MapQ += sign * change.numLT10MapQ;
+    total.numPaired += sign * change.numPaired;
+    total.numProperPaired += sign * change.numProperPaired;
+    total.numQCFail += sign * change.numQCFail;
+    total.numMapQ255 += sign * change.numMapQ255;
+    total.averageMapQCount += sign * change.averageMapQCount;
+    if(subtract)
+    {
+        total.sumMapQ -= change.sumMapQ;
+    }
+    else
+    {
+        total.sumMapQ += change.sumMapQ;
+    }
+}
+
+
+BaseQCPileup::BaseQCPileup(int windowSize)
+    : myRunning(),
+      myRefID(-1),
+      myChromosome(),
+      myStartPos(0),
+      myEndPos(-1),
+      myExcludeList(NULL),
+      myRows()
+{
+    int32_t size = 1;
+    while(size < windowSize)
+    {
+        size <<= 1;
+    }
+    myDiffs.resize(size, Counts());
+    myMask = size - 1;
+}
+
+
+void BaseQCPileup::processAlignmentRegion(SamRecord& record,
+                                          int startPos, int endPos,
+                                          const KnownSites* excludeList)
+{
+    int32_t refID = record.getReferenceID();
+    int32_t refPosition = record.get0BasedPosition();
+    if(refPosition < startPos)
+    {
+        refPosition = startPos;
+    }
+
+    if(refID != myRefID)
+    {
+        // New reference, so flush the previous one.
+        flushPileup();
+        myRefID = refID;
+        myChromosome = record.getReferenceName();
+    }
+    myExcludeList = excludeList;
+    flushPileup(refPosition);
+
+    int32_t endRefPosition = record.get0BasedAlignmentEnd();
+    if((endPos != -1) && (endRefPosition >= endPos))
+    {
+        endRefPosition = endPos - 1;
+    }
+    if(refPosition < myStartPos)
+    {
+        // Earlier positions were already output.
+        refPosition = myStartPos;
+    }
+    if(endRefPosition < refPosition)
+    {
+        // Nothing to pileup.
+        return;
+    }
+
+    // Determine what this record adds to each position, checking
+    // in the same order as PileupElementBaseQCStats::addEntry.
+    Counts change = Counts();
+    bool countBases = false;
+    uint16_t flag = record.getFlag();
+    int mapQ = record.getMapQuality();
+
+    change.numEntries = 1;
+    if(SamFlag::isDuplicate(flag))
+    {
+        change.numDups = 1;
+    }
+    if(SamFlag::isQCFailure(flag))
+    {
+        change.numQCFail = 1;
+    }
+
+    if((PileupElementBaseQCStats::getFilterDups() && SamFlag::isDuplicate(flag)) ||
+       (PileupElementBaseQCStats::getFilterQCFail() && SamFlag::isQCFailure(flag)))
+    {
+        // Filtered for duplicate/QC
+    }
+    else if(SamFlag::isMapped(flag))
+    {
+        change.numMapped = 1;
+        if(SamFlag::isPaired(flag))
+        {
+            change.numPaired = 1;
+            if(SamFlag::isProperPair(flag))
+            {
+                change.numProperPaired = 1;
+            }
+        }
+        if(mapQ < 10)
+        {
+            change.numLT10MapQ = 1;
+            if(mapQ == 0)
+            {
+                change.numZeroMapQ = 1;
+            }
+        }
+        if(mapQ >= PileupElementBaseQCStats::getMinMapQuality())
+        {
+            change.numMapQPass = 1;
+        }
+        if(mapQ == 255)
+        {
+            // Do not include mapping quality greater than 255.
+            change.numMapQ255 = 1;
+        }
+        else
+        {
+            change.sumMapQ = mapQ;
+            change.averageMapQCount = 1;
+            countBases = 
+                (mapQ >= PileupElementBaseQCStats::getMinMapQuality());
+        }
+    }
+
+    reserve(endRefPosition + 1);
+    addChange(myDiffs[slot(refPosition)], change, false);
+    addChange(myDiffs[slot(endRefPosition + 1)], change, true);
+
+    if(!countBases)
+    {
+        return;
+    }
+
+    // Walk the cigar for the positions that have a base.
+    Cigar* cigar = record.getCigarInfo();
+    if(cigar == NULL)
+    {
+        throw std::runtime_error("Failed to retrieve cigar info from the record.");
+    }
+
+    int32_t position = record.get0BasedPosition();
+    int32_t readIndex = 0;
+    for(int i = 0; (i < cigar->size()) && (position <= endRefPosition); i++)
+    {
+        const Cigar::CigarOperator& op = (*cigar)[i];
+        switch(op.operation)
+        {
+            case Cigar::match:
+            case Cigar::mismatch:
+                for(uint32_t j = 0; j < op.count; j++)
+                {
+                    if((position >= refPosition) &&
+                       (position <= endRefPosition))
+                    {
+                        Counts& counts = myDiffs[slot(position)];
+                        ++counts.depth;
+                        if(record.getQuality(readIndex) >=
+                           PileupElementBaseQCStats::Q20_CHAR_VAL)
+                        {
+                            ++counts.numQ20;
+                        }
+                    }
+                    ++position;
+                    ++readIndex;
+                }
+                break;
+            case Cigar::del:
+            case Cigar::skip:
+                // No base quality for deletions.
+                position += op.count;
+                break;
+            case Cigar::insert:
+            case Cigar::softClip:
+                readIndex += op.count;
+                break;
+            default:
+                // Hard clips & pads are in neither.
+                break;
+        }
+    }
+}
+
+
+void BaseQCPileup::flushPileup()
+{
+    flushPileup(myEndPos + 1);
+    myStartPos = 0;
+    myEndPos = -1;
+}
+
+
+void BaseQCPileup::flushPileup(int32_t position)
+{
+    bool hasOutput = PileupElementBaseQCStats::hasOutput();
+    bool hasBinaryOutput = PileupElementBaseQCStats::hasBinaryOutput();
+    int32_t lastPos = position - 1;
+    if(lastPos > myEndPos)
+    {
+        lastPos = myEndPos;
+    }
+    for(int32_t pos = myStartPos; pos <= lastPos; ++pos)
+    {
+        Counts& change = myDiffs[slot(pos)];
+        addChange(myRunning, change, false);
+
+        Counts counts = myRunning;
+        counts.depth = change.depth;
+        counts.numQ20 = change.numQ20;
+        change = Counts();
+
+        // Only output if the position is covered.
+        if((counts.numEntries == 0) ||
+           ((myExcludeList != NULL) &&
+            myExcludeList->hasPosition(myRefID, pos)))
+        {
+            continue;
+        }
+        if(hasBinaryOutput)
+        {
+            PileupElementBaseQCStats::writeBinaryRow(myRefID, pos, counts);
+        }
+        else if(hasOutput)
+        {
+            PileupElementBaseQCStats::formatRow(myChromosome.c_str(), pos,
+                                                counts, myRows);
+        }
+        PileupElementBaseQCStats::addToSummary(counts);
+    }
+
+    if(position > myStartPos)
+    {
+        myStartPos = position;
+    }
+    if(myEndPos < myStartPos)
+    {
+        myEndPos = myStartPos - 1;
+    }
+
+    if(myRows.Length() != 0)
+    {
+        PileupElementBaseQCStats::writeRows(myRows);
+        myRows.Clear();
+    }
+}
+
+
+void BaseQCPileup::reserve(int32_t position)
+{
+    int32_t needed = position - myStartPos + 1;
+    int32_t size = myDiffs.size();
+    if(needed > size)
+    {
+        int32_t newSize = size;
+        while(newSize < needed)
+        {
+            newSize <<= 1;
+        }
+        std::vector<Counts> newDiffs(newSize, Counts());
+        int32_t newMask = newSize - 1;
+        for(int32_t pos = myStartPos; pos <= myEndPos; ++pos)
+        {
+            newDiffs[pos & newMask] = myDiffs[slot(pos)];
+        }
+        myDiffs.swap(newDiffs);
+        myMask = newMask;
+    }
+    if(position > myEndPos)
+    {
+        myEndPos = position;
+    }
+}
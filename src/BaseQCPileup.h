@@ -0,0 +1,74 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BASE_QC_PILEUP_H__
+#define __BASE_QC_PILEUP_H__
+
+#include <string>
+#include <vector>
+
+#include "SamRecord.h"
+#include "KnownSites.h"
+#include "PileupElementBaseQCStats.h"
+
+/// Piles up records for the baseQC statistics without creating a
+/// PileupElement per position.  The counts that are the same for every
+/// position a record covers are added to a difference array at the start
+/// and end of the record, so each record is added in constant time plus a
+/// walk of its cigar for the depth/Q20 counts.  Produces the same output as
+/// Pileup<PileupElementBaseQCStats>, using its static settings.
+class BaseQCPileup
+{
+public:
+    BaseQCPileup(int windowSize);
+
+    /// Add the record to the pileup for the positions between startPos
+    /// and endPos (endPos of -1 means to the end of the reference),
+    /// skipping positions in excludeList.  Records must be sorted.
+    void processAlignmentRegion(SamRecord& record, int startPos, int endPos,
+                                const KnownSites* excludeList = NULL);
+
+    /// Output all positions that are still in the pileup.
+    void flushPileup();
+
+private:
+    typedef PileupElementBaseQCStats::Counts Counts;
+
+    // Output all positions prior to the specified position.
+    void flushPileup(int32_t position);
+    // Make room for positions up to and including the specified position.
+    void reserve(int32_t position);
+    int32_t slot(int32_t position) { return(position & myMask); }
+
+    // Per position changes to the counts that apply to an entire record,
+    // depth & numQ20 are the actual values rather than changes.
+    std::vector<Counts> myDiffs;
+    int32_t myMask;
+    // Counts for the last position that was output.
+    Counts myRunning;
+
+    int32_t myRefID;
+    std::string myChromosome;
+    // First position still in the pileup & last position with any changes.
+    int32_t myStartPos;
+    int32_t myEndPos;
+    const KnownSites* myExcludeList;
+
+    String myRows;
+};
+
+#endif
@@ -0,0 +1,239 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <functional>
+#include <zlib.h>
+
+#include "BatchedBamWriter.h"
+#include "BamExecutable.h"
+#include "ThreadedSamFile.h"
+
+const uint32_t BatchedBamWriter::DEFAULT_BATCH_BLOCKS = 8;
+const uint32_t BatchedBamWriter::DEFAULT_MAX_OPEN = 64;
+
+
+BatchedBamWriter::BatchedBamWriter(uint32_t maxOpen, uint32_t batchBlocks)
+    : myMaxOpen(maxOpen < 1 ? 1 : maxOpen),
+      myBatchSize((batchBlocks < 1 ? 1 : batchBlocks) *
+                  ParallelBgzf::MAX_BLOCK_DATA_SIZE),
+      myMaxInFlight(2 * BamExecutable::getNumThreads()),
+      myFailed(false),
+      myFiles(),
+      myPending(),
+      myOpenFiles()
+{
+}
+
+
+BatchedBamWriter::~BatchedBamWriter()
+{
+    // Only reached without close on an error, so just release everything.
+    for(unsigned int i = 0; i < myPending.size(); i++)
+    {
+        myPending[i].blocks.wait();
+    }
+    while(!myOpenFiles.empty())
+    {
+        fclose(myFiles[myOpenFiles.front()].filePtr);
+        myFiles[myOpenFiles.front()].filePtr = NULL;
+        myOpenFiles.pop_front();
+    }
+}
+
+
+bool BatchedBamWriter::addFile(const char* filename, SamFileHeader& header,
+                               uint32_t& index)
+{
+    index = myFiles.size();
+    myFiles.push_back(OutFile());
+    OutFile& outFile = myFiles.back();
+    outFile.fileName = filename;
+    outFile.buffer = std::make_shared<ParallelBgzf::Buffer>();
+    outFile.numRecords = 0;
+    outFile.filePtr = NULL;
+
+    // Create the file now so failures are reported up front.
+    if(getFile(index, "wb") == NULL)
+    {
+        return(false);
+    }
+    if(!ThreadedSamFile::getBamHeader(header, *(outFile.buffer)))
+    {
+        return(false);
+    }
+    return(true);
+}
+
+
+bool BatchedBamWriter::writeRecord(uint32_t index, SamRecord& record)
+{
+    // The record buffer starts with the block size.
+    const char* recordBuffer = (const char*)record.getRecordBuffer(SamRecord::NONE);
+    if(recordBuffer == NULL)
+    {
+        return(false);
+    }
+    int32_t blockSize = 0;
+    memcpy(&blockSize, recordBuffer, sizeof(blockSize));
+
+    OutFile& outFile = myFiles[index];
+    outFile.buffer->insert(outFile.buffer->end(), recordBuffer,
+                           recordBuffer + blockSize + sizeof(blockSize));
+    ++outFile.numRecords;
+    if(outFile.buffer->size() >= myBatchSize)
+    {
+        queueBatch(index);
+    }
+    return(!myFailed);
+}
+
+
+bool BatchedBamWriter::close()
+{
+    for(uint32_t i = 0; i < myFiles.size(); i++)
+    {
+        if(!myFiles[i].buffer->empty())
+        {
+            queueBatch(i);
+        }
+    }
+    while(!myPending.empty())
+    {
+        writeFirstPending();
+    }
+    for(uint32_t i = 0; i < myFiles.size(); i++)
+    {
+        writeData(i, (const char*)ParallelBgzf::EOF_MARKER,
+                  ParallelBgzf::EOF_MARKER_SIZE);
+        closeFile(i);
+    }
+    return(!myFailed);
+}
+
+
+void BatchedBamWriter::queueBatch(uint32_t index)
+{
+    // Only compress full batches until the end, so the block boundaries
+    // only depend on the data written to the file.
+    OutFile& outFile = myFiles[index];
+    ParallelBgzf::BufferPtr batch = outFile.buffer;
+    outFile.buffer = std::make_shared<ParallelBgzf::Buffer>();
+    if(batch->size() > myBatchSize)
+    {
+        outFile.buffer->assign(batch->begin() + myBatchSize, batch->end());
+        batch->resize(myBatchSize);
+    }
+
+    if(BamExecutable::getNumThreads() <= 1)
+    {
+        ParallelBgzf::BufferPtr blocks = deflateBatch(batch);
+        writeData(index, &((*blocks)[0]), blocks->size());
+        return;
+    }
+    if(myPending.size() >= myMaxInFlight)
+    {
+        writeFirstPending();
+    }
+    myPending.push_back(PendingBatch());
+    myPending.back().index = index;
+    myPending.back().blocks =
+        BamExecutable::getThreadPool().submit(std::bind(&BatchedBamWriter::deflateBatch,
+                                                        batch));
+}
+
+
+void BatchedBamWriter::writeFirstPending()
+{
+    // Batches are written in the order they were queued, which keeps
+    // each file's batches in order.
+    uint32_t index = myPending.front().index;
+    ParallelBgzf::BufferPtr blocks = myPending.front().blocks.get();
+    myPending.pop_front();
+    writeData(index, &((*blocks)[0]), blocks->size());
+}
+
+
+void BatchedBamWriter::writeData(uint32_t index, const char* data, size_t len)
+{
+    FILE* filePtr = getFile(index, "ab");
+    if((filePtr == NULL) || (fwrite(data, 1, len, filePtr) != len))
+    {
+        myFailed = true;
+    }
+}
+
+
+FILE* BatchedBamWriter::getFile(uint32_t index, const char* mode)
+{
+    OutFile& outFile = myFiles[index];
+    if(outFile.filePtr != NULL)
+    {
+        // Move it to the front of the most recently used list.
+        myOpenFiles.splice(myOpenFiles.begin(), myOpenFiles, outFile.openPos);
+        return(outFile.filePtr);
+    }
+    if(myOpenFiles.size() >= myMaxOpen)
+    {
+        closeFile(myOpenFiles.back());
+    }
+    outFile.filePtr = fopen(outFile.fileName.c_str(), mode);
+    if(outFile.filePtr != NULL)
+    {
+        myOpenFiles.push_front(index);
+        outFile.openPos = myOpenFiles.begin();
+    }
+    return(outFile.filePtr);
+}
+
+
+void BatchedBamWriter::closeFile(uint32_t index)
+{
+    OutFile& outFile = myFiles[index];
+    if(outFile.filePtr == NULL)
+    {
+        return;
+    }
+    if(fclose(outFile.filePtr) != 0)
+    {
+        myFailed = true;
+    }
+    outFile.filePtr = NULL;
+    myOpenFiles.erase(outFile.openPos);
+}
+
+
+ParallelBgzf::BufferPtr BatchedBamWriter::deflateBatch(ParallelBgzf::BufferPtr batch)
+{
+    ParallelBgzf::BufferPtr blocks = std::make_shared<ParallelBgzf::Buffer>();
+    for(size_t start = 0; start < batch->size();
+        start += ParallelBgzf::MAX_BLOCK_DATA_SIZE)
+    {
+        size_t end = start + ParallelBgzf::MAX_BLOCK_DATA_SIZE;
+        if(end > batch->size())
+        {
+            end = batch->size();
+        }
+        ParallelBgzf::BufferPtr block =
+            std::make_shared<ParallelBgzf::Buffer>(batch->begin() + start,
+                                                   batch->begin() + end);
+        ParallelBgzf::BufferPtr compressed =
+            ParallelBgzf::deflateBlock(block, Z_DEFAULT_COMPRESSION);
+        blocks->insert(blocks->end(), compressed->begin(), compressed->end());
+    }
+    return(blocks);
+}
@@ -0,0 +1,112 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BATCHED_BAM_WRITER_H__
+#define __BATCHED_BAM_WRITER_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <deque>
+#include <list>
+#include <string>
+#include <vector>
+#include <future>
+
+#include "SamFile.h"
+#include "ParallelBgzf.h"
+
+/// Writes many BAM files at once, such as one per read group.  The records
+/// for each file are buffered in memory and compressed a batch at a time
+/// (on the thread pool when there is more than one thread), so each file
+/// gets a few large writes rather than many small ones.  At most maxOpen
+/// of the files are open at a time, the least recently written is closed
+/// (and later reopened for appending) when another file needs to be open.
+class BatchedBamWriter
+{
+public:
+    /// Default number of uncompressed BGZF blocks buffered per file.
+    static const uint32_t DEFAULT_BATCH_BLOCKS;
+    /// Default maximum number of files kept open.
+    static const uint32_t DEFAULT_MAX_OPEN;
+
+    BatchedBamWriter(uint32_t maxOpen = DEFAULT_MAX_OPEN,
+                     uint32_t batchBlocks = DEFAULT_BATCH_BLOCKS);
+    ~BatchedBamWriter();
+
+    /// Create the file and buffer its header, returning false if the file
+    /// could not be created.  index is set to the file's index.
+    bool addFile(const char* filename, SamFileHeader& header, uint32_t& index);
+
+    /// Buffer the record for the file with the specified index.
+    bool writeRecord(uint32_t index, SamRecord& record);
+
+    /// Return the number of records written to the specified file.
+    uint32_t getRecordCount(uint32_t index) { return(myFiles[index].numRecords); }
+
+    const std::string& getFileName(uint32_t index) { return(myFiles[index].fileName); }
+
+    /// Write all buffered records and the EOF markers and close all of
+    /// the files.  Returns false if any of the writes failed.
+    bool close();
+
+private:
+    BatchedBamWriter(const BatchedBamWriter&);
+    BatchedBamWriter& operator=(const BatchedBamWriter&);
+
+    struct OutFile
+    {
+        std::string fileName;
+        ParallelBgzf::BufferPtr buffer;
+        uint32_t numRecords;
+        FILE* filePtr;
+        // Position in myOpenFiles when open.
+        std::list<uint32_t>::iterator openPos;
+    };
+
+    // Compressed blocks for a file, in the order they were queued.
+    struct PendingBatch
+    {
+        uint32_t index;
+        std::future<ParallelBgzf::BufferPtr> blocks;
+    };
+
+    // Compress the buffered data of the specified file.
+    void queueBatch(uint32_t index);
+    // Write the oldest compressed batch to its file.
+    void writeFirstPending();
+    // Write data to the specified file, opening it if necessary.
+    void writeData(uint32_t index, const char* data, size_t len);
+    // Return the open file, closing the least recently used file if
+    // there are already maxOpen files open.
+    FILE* getFile(uint32_t index, const char* mode);
+    void closeFile(uint32_t index);
+
+    // Compress each block of the batch on its own so the blocks match
+    // those written by ParallelBgzfWriter.
+    static ParallelBgzf::BufferPtr deflateBatch(ParallelBgzf::BufferPtr batch);
+
+    uint32_t myMaxOpen;
+    uint32_t myBatchSize;
+    unsigned int myMaxInFlight;
+    bool myFailed;
+    std::vector<OutFile> myFiles;
+    std::deque<PendingBatch> myPending;
+    // Open files, most recently used first.
+    std::list<uint32_t> myOpenFiles;
+};
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//////////////////////////////////////////////////////////////////////////
+// This file contains the processing for the executable option "cacheFields"
+// which builds a field cache of a BAM file.
+
+#include "CacheFields.h"
+#include "FieldCache.h"
+#include "Parameters.h"
+
+void CacheFields::printCacheFieldsDescription(std::ostream& os)
+{
+    os << " cacheFields - Build a cache of the alignment fields of a BAM file for repeated stats --basic, gapInfo, & findCigars runs" << std::endl;
+}
+
+
+void CacheFields::printDescription(std::ostream& os)
+{
+    printCacheFieldsDescription(os);
+}
+
+
+void CacheFields::printUsage(std::ostream& os)
+{
+    BamExecutable::printUsage(os);
+    os << "\t./bam cacheFields --in <inputFile> [--out <cacheFile>] [--params]" << std::endl;
+    os << "\tRequired Parameters:" << std::endl;
+    os << "\t\t--in     : the BAM file to cache the fields of" << std::endl;
+    os << "\tOptional Parameters:" << std::endl;
+    os << "\t\t--out    : the field cache to write" << std::endl;
+    os << "\t\t           (if not specified, uses the --in value + \".bfc\"," << std::endl;
+    os << "\t\t           which the tools read instead of the BAM while it is up to date)" << std::endl;
+    os << "\t\t--params : print the parameter settings" << std::endl;
+    os << std::endl;
+}
+
+
+int CacheFields::execute(int argc, char **argv)
+{
+    // Extract command line arguments.
+    String inFile = "";
+    String outFile = "";
+    bool params = false;
+
+    ParameterList inputParameters;
+    BEGIN_LONG_PARAMETERS(longParameterList)
+        LONG_STRINGPARAMETER("in", &inFile)
+        LONG_STRINGPARAMETER("out", &outFile)
+        LONG_PARAMETER("params", &params)
+        LONG_PHONEHOME(VERSION)
+        END_LONG_PARAMETERS();
+   
+    inputParameters.Add(new LongParameters ("Input Parameters", 
+                                            longParameterList));
+
+    // parameters start at index 2 rather than 1.
+    inputParameters.Read(argc, argv, 2);
+
+    // Check to see if the in file was specified, if not, report an error.
+    if(inFile == "")
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        // mandatory argument was not specified.
+        std::cerr << "Missing mandatory argument: --in" << std::endl;
+        return(-1);
+    }
+
+    if(outFile == "")
+    {
+        outFile = FieldCache::getDefaultName(inFile.c_str()).c_str();
+    }
+
+    if(params)
+    {
+        inputParameters.Status();
+    }
+
+    uint64_t numRecords = 0;
+    if(!FieldCache::build(inFile.c_str(), outFile.c_str(), numRecords))
+    {
+        return(SamStatus::FAIL_IO);
+    }
+
+    std::cerr << "Wrote " << outFile << " caching " << numRecords
+              << " records.\n";
+    return(SamStatus::SUCCESS);
+}
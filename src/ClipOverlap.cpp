@@ -19,6 +19,8 @@
 //////////////////////////////////////////////////////////////////////////
 // This file contains the processing for the executable option "clipOverlap"
 // which clips overlapping read pairs.
+#include <stdio.h>
+
 #include "ClipOverlap.h"
 #include "SamFile.h"
 #include "BgzfFileType.h"
@@ -38,7 +40,16 @@ ClipOverlap::ClipOverlap()
       myNumPoolFailNoHandle(0),
       myNumPoolFailHandled(0),
       myNumOutOfOrder(0),
-      myPoolSkipOverlap(false)
+      myPoolSkipOverlap(false),
+      myPoolSpill(false),
+      myTmpPrefix(""),
+      mySpillFirstFile(NULL),
+      mySpillMateFile(NULL),
+      mySpillEnabled(false),
+      mySpillPass(0),
+      mySpilledNames(),
+      myNumPassSpilled(0),
+      myNumSpilled(0)
 {
 }
 
@@ -58,13 +69,15 @@ void ClipOverlap::printDescription(std::ostream& os)
 void ClipOverlap::printUsage(std::ostream& os)
 {
     BamExecutable::printUsage(os);
-    os << "\t./bam clipOverlap --in <inputFile> --out <outputFile> [--storeOrig <tag>] [--readName] [--noRNValidate] [--stats] [--overlapsOnly] [--excludeFlags <flag>] [--poolSize <numRecords allowed to allocate>] [--poolSkipOverlap] [--noeof] [--params]" << std::endl;
+    os << "\t./bam clipOverlap --in <inputFile> --out <outputFile> [--storeOrig <tag>] [--readName] [--collate] [--noRNValidate] [--stats] [--overlapsOnly] [--excludeFlags <flag>] [--poolSize <numRecords allowed to allocate>] [--poolSkipOverlap] [--poolSpill] [--tmpPrefix <prefix>] [--noeof] [--params]" << std::endl;
     os << "\tRequired Parameters:" << std::endl;
     os << "\t\t--in           : the SAM/BAM file to clip overlaping read pairs for" << std::endl;
     os << "\t\t--out          : the SAM/BAM file to be written" << std::endl;
     os << "\tOptional Parameters:" << std::endl;
     os << "\t\t--storeOrig    : Store the original cigar in the specified tag." << std::endl;
     os << "\t\t--readName     : Original file is sorted by Read Name instead of coordinate." << std::endl;
+    os << "\t\t--collate      : Group the mates by read name through temporary files rather" << std::endl;
+    os << "\t\t                 than relying on the sort order of the original file." << std::endl;
     os << "\t\t--noRNValidate   : Turn off alpha-numeric read name sorting validation." << std::endl;
     os << "\t\t--stats        : Print some statistics on the overlaps." << std::endl;
     os << "\t\t--overlapsOnly : Only output overlapping read pairs" << std::endl;
@@ -75,9 +88,14 @@ void ClipOverlap::printUsage(std::ostream& os)
     os << "\tClipping By Coordinate Optional Parameters:" << std::endl;
     os << "\t\t--poolSize     : Maximum number of records the program is allowed to allocate" << std::endl;
     os << "\t\t                 for clipping on Coordinate sorted files. (Default: " << DEFAULT_POOL_SIZE << ")" << std::endl;
+    os << "\t\t                 The pool is also limited by --maxMem when it is set." << std::endl;
     os << "\t\t--poolSkipClip : Skip clipping reads to free of usable records when the" << std::endl;
     os << "\t\t                 poolSize is hit. The default action is to just clip the" << std::endl;
     os << "\t\t                 first read in a pair to free up the record." << std::endl;
+    os << "\t\t--poolSpill    : When the poolSize is hit, write the first read in a pair to a" << std::endl;
+    os << "\t\t                 temporary file along with its mate and clip them in a later" << std::endl;
+    os << "\t\t                 pass rather than clipping without the mate." << std::endl;
+    os << "\t\t--tmpPrefix    : Prefix for the --poolSpill & --collate temporary files (Default: --out)" << std::endl;
     os << std::endl;
 }
 
@@ -89,6 +107,7 @@ int ClipOverlap::execute(int argc, char **argv)
     String outFile = "";
     String storeOrig = "";
     bool readName = false;
+    bool collate = false;
     bool noRNValidate = false;
     bool stats = false;
     int poolSize = DEFAULT_POOL_SIZE;
@@ -106,6 +125,7 @@ int ClipOverlap::execute(int argc, char **argv)
         LONG_PARAMETER_GROUP("Optional Parameters")
         LONG_STRINGPARAMETER("storeOrig", &storeOrig)
         LONG_PARAMETER("readName", &readName)
+        LONG_PARAMETER("collate", &collate)
         LONG_PARAMETER ("noRNValidate", &noRNValidate)
         LONG_PARAMETER ("stats", &stats)
         LONG_PARAMETER ("overlapsOnly", &myOverlapsOnly)
@@ -116,6 +136,8 @@ int ClipOverlap::execute(int argc, char **argv)
         LONG_PARAMETER_GROUP("Coordinate Processing Optional Parameters")
         LONG_INTPARAMETER("poolSize", &poolSize)
         LONG_PARAMETER("poolSkipOverlap", &myPoolSkipOverlap)
+        LONG_PARAMETER("poolSpill", &myPoolSpill)
+        LONG_STRINGPARAMETER("tmpPrefix", &myTmpPrefix)
         LONG_PHONEHOME(VERSION)
         BEGIN_LEGACY_PARAMETERS()
         LONG_PARAMETER ("clipsOnly", &myOverlapsOnly)
@@ -166,6 +188,31 @@ int ClipOverlap::execute(int argc, char **argv)
         return(-1);
     }
 
+    if(myPoolSpill && !readName)
+    {
+        if(outFile == "-")
+        {
+            printUsage(std::cerr);
+            inputParameters.Status();
+            std::cerr << "--poolSpill requires an --out file, not stdout.\n";
+            return(-1);
+        }
+        if(myTmpPrefix.IsEmpty())
+        {
+            myTmpPrefix = outFile;
+        }
+    }
+
+    if(collate)
+    {
+        // Collated records are processed like a read name sorted file.
+        readName = true;
+        if(myTmpPrefix.IsEmpty())
+        {
+            myTmpPrefix = (outFile != "-") ? outFile : String("clipOverlap");
+        }
+    }
+
     myOverlapHandler = new OverlapClipLowerBaseQual();
     if(myOverlapHandler == NULL)
     {
@@ -197,6 +244,7 @@ int ClipOverlap::execute(int argc, char **argv)
     // For each step process the file.
     // Open the files & read/write the sam header.
     SamStatus::Status runStatus = SamStatus::SUCCESS;
+    RecordCollator collator;
     for(int i = 1; i <= myOverlapHandler->numSteps(); i++)
     {
         // Open the file for reading.
@@ -209,7 +257,22 @@ int ClipOverlap::execute(int argc, char **argv)
             samOutPtr = new SamFile(outFile, SamFile::WRITE, &mySamHeader);
         }
 
-        if(readName)
+        if(collate)
+        {
+            // Partition the file on the first step, later steps
+            // reread the collated records.
+            if(i == 1)
+            {
+                collator.init(myTmpPrefix.c_str());
+                collator.partition(samIn, mySamHeader);
+            }
+            else
+            {
+                collator.rewind();
+            }
+            runStatus = handleSortedByReadName(samIn, samOutPtr, &collator);
+        }
+        else if(readName)
         {
             if(!noRNValidate)
             {
@@ -222,6 +285,7 @@ int ClipOverlap::execute(int argc, char **argv)
             // Coordinate sorted, so work with the pools.
             samIn.setSortedValidation(SamFile::COORDINATE);
             myPool.setMaxAllocatedRecs(poolSize);
+            myPool.setLimitByBudget(true);
 
             // Reset the number of failures
             myNumMateFailures = 0;
@@ -229,6 +293,10 @@ int ClipOverlap::execute(int argc, char **argv)
             myNumPoolFailNoHandle = 0;
             myNumPoolFailHandled = 0;
             myNumOutOfOrder = 0;
+            myNumSpilled = 0;
+            myNumPassSpilled = 0;
+            mySpillPass = 0;
+            mySpilledNames.clear();
 
             // Run by coordinate
             if(samOutPtr != NULL)
@@ -236,7 +304,9 @@ int ClipOverlap::execute(int argc, char **argv)
                 // Setup the output buffer for writing.
                 SamCoordOutput outputBuffer(myPool);
                 outputBuffer.setOutputFile(samOutPtr, &mySamHeader);
+                mySpillEnabled = myPoolSpill;
                 runStatus = handleSortedByCoord(samIn, &outputBuffer);
+                closeSpillFiles();
 
                 // Cleanup the output buffer.
                 if(!outputBuffer.flushAll())
@@ -264,6 +334,16 @@ int ClipOverlap::execute(int argc, char **argv)
             delete samOutPtr;
             samOutPtr = NULL;
         }
+
+        // Clip any records that were spilled now that the output is closed.
+        if(myNumPassSpilled != 0)
+        {
+            runStatus = clipSpilled(outFile);
+            if(runStatus != SamStatus::SUCCESS)
+            {
+                break;
+            }
+        }
     }
 
     // Done processing.
@@ -298,6 +378,12 @@ int ClipOverlap::execute(int argc, char **argv)
         }
     }
 
+    if(myNumSpilled != 0)
+    {
+        std::cerr << "Spilled " << myNumSpilled 
+                  << " records to temporary files to wait for their mates.\n";
+    }
+
     if(runStatus == SamStatus::SUCCESS)
     {
         if(myNumPoolFail == 0)
@@ -319,7 +405,8 @@ int ClipOverlap::execute(int argc, char **argv)
 
 
 SamStatus::Status ClipOverlap::handleSortedByReadName(SamFile& samIn, 
-                                                      SamFile* samOutPtr)
+                                                      SamFile* samOutPtr,
+                                                      RecordCollator* collator)
 {
     // Set returnStatus to success.  It will be changed
     // to the failure reason if any of the writes fail.
@@ -336,7 +423,9 @@ SamStatus::Status ClipOverlap::handleSortedByReadName(SamFile& samIn,
     }
 
     // Keep reading records until ReadRecord returns false.
-    while(samIn.ReadRecord(mySamHeader, *samRecord))
+    while((collator != NULL) ?
+          collator->ReadRecord(mySamHeader, *samRecord) :
+          samIn.ReadRecord(mySamHeader, *samRecord))
     {
         int16_t flag = samRecord->getFlag();
         if((flag & myIntExcludeFlags) != 0)
@@ -495,7 +584,7 @@ SamStatus::Status ClipOverlap::handleSortedByReadName(SamFile& samIn,
         delete tmpRecord;
     }
 
-    if(samIn.GetStatus() != SamStatus::NO_MORE_RECS)
+    if((collator == NULL) && (samIn.GetStatus() != SamStatus::NO_MORE_RECS))
     {
         return(samIn.GetStatus());
     }
@@ -506,7 +595,7 @@ SamStatus::Status ClipOverlap::handleSortedByReadName(SamFile& samIn,
 SamStatus::Status ClipOverlap::handleSortedByCoord(SamFile& samIn, 
                                                    SamCoordOutput* outputBufferPtr)
 {
-    MateMapByCoord mateMap;
+    MateRingBuffer mateMap;
 
     // Get record & track success/fail
     SamStatus::Status returnStatus = SamStatus::SUCCESS;
@@ -548,6 +637,15 @@ SamStatus::Status ClipOverlap::handleSortedByCoord(SamFile& samIn,
 
         // Check the read for overlaps.
         overlapInfo = myOverlapHandler->getOverlapInfo(*recordPtr, myIntExcludeFlags);
+
+        // If the first read in this pair was spilled, spill this one too
+        // so the pair is clipped in the next pass.
+        if(spillMate(*recordPtr, overlapInfo))
+        {
+            myPool.releaseRecord(recordPtr);
+            recordPtr = NULL;
+            continue;
+        }
         // Handle the types of overlaps.
         switch(overlapInfo)
         {
@@ -671,7 +769,7 @@ SamStatus::Status ClipOverlap::handleSortedByCoord(SamFile& samIn,
 
 SamStatus::Status ClipOverlap::readCoordRecord(SamFile& samIn,
                                                SamRecord** recordPtr, 
-                                               MateMapByCoord& mateMap,
+                                               MateRingBuffer& mateMap,
                                                SamCoordOutput* outputBufferPtr)
 {
     // Null pointer, so get a new pointer.
@@ -714,7 +812,7 @@ SamStatus::Status ClipOverlap::readCoordRecord(SamFile& samIn,
 ///////////////////////////////////////////////////////////////////
 // Methods to handle flushing records from the mate map and/or
 // the output buffer.
-bool ClipOverlap::forceRecordFlush(MateMapByCoord& mateMap,
+bool ClipOverlap::forceRecordFlush(MateRingBuffer& mateMap,
                                    SamCoordOutput* outputBufferPtr)
 {
     // The previous standard flush did not free up any records, so pop
@@ -725,6 +823,18 @@ bool ClipOverlap::forceRecordFlush(MateMapByCoord& mateMap,
     int32_t flushPos = -1;
     bool updated = false;
 
+    if((firstRec != NULL) && mySpillEnabled && (outputBufferPtr != NULL))
+    {
+        // Rather than processing it without its mate, spill it and
+        // flush up to & including its position.
+        mateMap.popFirst();
+        spillFirst(*firstRec);
+        flushChrom = firstRec->getReferenceID();
+        flushPos = firstRec->get0BasedPosition();
+        myPool.releaseRecord(firstRec);
+        return(outputBufferPtr->flush(flushChrom, flushPos));
+    }
+
     // Increment number of pool failures.
     ++myNumPoolFail;
 
@@ -778,7 +888,7 @@ bool ClipOverlap::forceRecordFlush(MateMapByCoord& mateMap,
 }
 
 
-bool ClipOverlap::flushOutputBuffer(MateMapByCoord& mateMap,
+bool ClipOverlap::flushOutputBuffer(MateRingBuffer& mateMap,
                                     SamCoordOutput& outputBuffer,
                                     int32_t prevChrom,
                                     int32_t prevPos)
@@ -797,7 +907,7 @@ bool ClipOverlap::flushOutputBuffer(MateMapByCoord& mateMap,
     return(outputBuffer.flush(prevChrom, prevPos));
 }
 
-void ClipOverlap::cleanupMateMap(MateMapByCoord& mateMap,
+void ClipOverlap::cleanupMateMap(MateRingBuffer& mateMap,
                                  SamCoordOutput* outputBufferPtr,
                                  int32_t chrom, int32_t position)
 {
@@ -848,3 +958,223 @@ void ClipOverlap::cleanupMateMap(MateMapByCoord& mateMap,
         }
     }
 }
+
+
+///////////////////////////////////////////////////////////////////
+// Methods to spill records to temporary files when the pool is hit.
+void ClipOverlap::spillFirst(SamRecord& record)
+{
+    if(mySpillFirstFile == NULL)
+    {
+        // Open both spill files so the next pass can read both.
+        std::string fileName;
+        getSpillFileName(fileName, "First", mySpillPass);
+        mySpillFirstFile = new SamFile(fileName.c_str(), SamFile::WRITE,
+                                       &mySamHeader);
+        getSpillFileName(fileName, "Mate", mySpillPass);
+        mySpillMateFile = new SamFile(fileName.c_str(), SamFile::WRITE,
+                                      &mySamHeader);
+    }
+    mySpillFirstFile->WriteRecord(mySamHeader, record);
+    mySpilledNames.insert(record.getReadName());
+    ++myNumPassSpilled;
+    ++myNumSpilled;
+}
+
+
+bool ClipOverlap::spillMate(SamRecord& record, 
+                            OverlapHandler::OverlapInfo overlapInfo)
+{
+    if(mySpilledNames.empty())
+    {
+        return(false);
+    }
+    // Only records that would look for their mate in the mate map.
+    if((overlapInfo != OverlapHandler::SAME_START) &&
+       (overlapInfo != OverlapHandler::UNKNOWN_OVERLAP) &&
+       (overlapInfo != OverlapHandler::UNKNOWN_OVERLAP_WRONG_ORIENT))
+    {
+        return(false);
+    }
+    if(mySpilledNames.erase(record.getReadName()) == 0)
+    {
+        // The mate was not spilled.
+        return(false);
+    }
+    mySpillMateFile->WriteRecord(mySamHeader, record);
+    ++myNumPassSpilled;
+    ++myNumSpilled;
+    return(true);
+}
+
+
+void ClipOverlap::closeSpillFiles()
+{
+    if(mySpillFirstFile != NULL)
+    {
+        mySpillFirstFile->Close();
+        delete mySpillFirstFile;
+        mySpillFirstFile = NULL;
+    }
+    if(mySpillMateFile != NULL)
+    {
+        mySpillMateFile->Close();
+        delete mySpillMateFile;
+        mySpillMateFile = NULL;
+    }
+}
+
+
+SamStatus::Status ClipOverlap::clipSpilled(const String& outFile)
+{
+    // Move the output aside, it will be merged with the clipped
+    // spilled records.
+    std::vector<std::string> outputs;
+    outputs.push_back(std::string(myTmpPrefix.c_str()) + ".clipMain");
+    if(rename(outFile.c_str(), outputs[0].c_str()) != 0)
+    {
+        std::cerr << "ERROR: Failed to rename " << outFile 
+                  << " to " << outputs[0] << std::endl;
+        return(SamStatus::FAIL_IO);
+    }
+
+    SamStatus::Status runStatus = SamStatus::SUCCESS;
+    uint32_t numInput = 0xFFFFFFFF;
+    while((runStatus == SamStatus::SUCCESS) && (myNumPassSpilled != 0))
+    {
+        // Sort the records spilled in the previous pass by merging the
+        // first reads with their mates.
+        std::vector<std::string> spilled(2);
+        getSpillFileName(spilled[0], "First", mySpillPass);
+        getSpillFileName(spilled[1], "Mate", mySpillPass);
+        ++mySpillPass;
+        std::string sortedFile;
+        std::string clippedFile;
+        getSpillFileName(sortedFile, "Sorted", mySpillPass);
+        getSpillFileName(clippedFile, "Clipped", mySpillPass);
+        if(!mergeSortedFiles(spilled, sortedFile.c_str()))
+        {
+            runStatus = SamStatus::FAIL_IO;
+            break;
+        }
+        remove(spilled[0].c_str());
+        remove(spilled[1].c_str());
+
+        // Only spill again if the previous pass left fewer records to
+        // clip, so the passes end.
+        mySpillEnabled = (myNumPassSpilled < numInput);
+        numInput = myNumPassSpilled;
+        myNumPassSpilled = 0;
+        mySpilledNames.clear();
+
+        mySamHeader.resetHeader();
+        SamFile samIn(sortedFile.c_str(), SamFile::READ, &mySamHeader);
+        samIn.setSortedValidation(SamFile::COORDINATE);
+        SamFile samOut(clippedFile.c_str(), SamFile::WRITE, &mySamHeader);
+        outputs.push_back(clippedFile);
+        SamCoordOutput outputBuffer(myPool);
+        outputBuffer.setOutputFile(&samOut, &mySamHeader);
+        runStatus = handleSortedByCoord(samIn, &outputBuffer);
+        if(!outputBuffer.flushAll())
+        {
+            std::cerr << "ERROR: Failed to flush the output buffer\n";
+            runStatus = SamStatus::FAIL_IO;
+        }
+        closeSpillFiles();
+        samIn.Close();
+        samOut.Close();
+        remove(sortedFile.c_str());
+    }
+
+    if((runStatus == SamStatus::SUCCESS) &&
+       !mergeSortedFiles(outputs, outFile.c_str()))
+    {
+        runStatus = SamStatus::FAIL_IO;
+    }
+    for(unsigned int i = 0; i < outputs.size(); i++)
+    {
+        remove(outputs[i].c_str());
+    }
+    return(runStatus);
+}
+
+
+bool ClipOverlap::mergeSortedFiles(const std::vector<std::string>& inputs,
+                                   const char* outFile)
+{
+    SamFile samOut(outFile, SamFile::WRITE, &mySamHeader);
+
+    std::vector<SamFile*> inFiles(inputs.size(), NULL);
+    std::vector<SamFileHeader> headers(inputs.size());
+    std::vector<SamRecord*> records(inputs.size(), NULL);
+    for(unsigned int i = 0; i < inputs.size(); i++)
+    {
+        inFiles[i] = new SamFile(inputs[i].c_str(), SamFile::READ, &headers[i]);
+        records[i] = new SamRecord();
+        if(!inFiles[i]->ReadRecord(headers[i], *records[i]))
+        {
+            delete records[i];
+            records[i] = NULL;
+        }
+    }
+
+    bool status = true;
+    while(status)
+    {
+        // Write the earliest record, the earlier file on ties.
+        int minIndex = -1;
+        uint64_t minChromPos = 0;
+        for(unsigned int i = 0; i < records.size(); i++)
+        {
+            if(records[i] == NULL)
+            {
+                continue;
+            }
+            uint64_t chromPos = 
+                SamHelper::combineChromPos(records[i]->getReferenceID(),
+                                           records[i]->get0BasedPosition());
+            if((minIndex == -1) || (chromPos < minChromPos))
+            {
+                minIndex = i;
+                minChromPos = chromPos;
+            }
+        }
+        if(minIndex == -1)
+        {
+            break;
+        }
+        if(!samOut.WriteRecord(mySamHeader, *records[minIndex]))
+        {
+            std::cerr << "ERROR: Failed writing to " << outFile << std::endl;
+            status = false;
+        }
+        if(!inFiles[minIndex]->ReadRecord(headers[minIndex],
+                                          *records[minIndex]))
+        {
+            delete records[minIndex];
+            records[minIndex] = NULL;
+        }
+    }
+
+    for(unsigned int i = 0; i < inputs.size(); i++)
+    {
+        inFiles[i]->Close();
+        delete inFiles[i];
+        if(records[i] != NULL)
+        {
+            delete records[i];
+        }
+    }
+    samOut.Close();
+    return(status);
+}
+
+
+void ClipOverlap::getSpillFileName(std::string& fileName, const char* type,
+                                   int pass)
+{
+    fileName = myTmpPrefix.c_str();
+    fileName += ".clip";
+    fileName += type;
+    fileName += std::to_string(pass) + ".ubam";
+}
@@ -22,11 +22,16 @@
 #ifndef __CLIP_OVERLAP_H__
 #define __CLIP_OVERLAP_H__
 
+#include <string>
+#include <unordered_set>
+#include <vector>
+
 #include "BamExecutable.h"
 #include "SamFile.h"
-#include "MateMapByCoord.h"
+#include "MateRingBuffer.h"
 #include "SamCoordOutput.h"
 #include "OverlapHandler.h"
+#include "RecordCollator.h"
 
 class ClipOverlap : public BamExecutable
 {
@@ -42,8 +47,10 @@ public:
 private:
     static const int DEFAULT_POOL_SIZE = 1000000;
 
+    // Reads from the collator rather than samIn if it is specified.
     SamStatus::Status handleSortedByReadName(SamFile& samIn,
-                                             SamFile* outFile);
+                                             SamFile* outFile,
+                                             RecordCollator* collator = NULL);
 
     SamStatus::Status handleSortedByCoord(SamFile& samIn,
                                           SamCoordOutput* outputBufferPtr);
@@ -55,27 +62,51 @@ private:
     // returns success or the failure reason.
     SamStatus::Status readCoordRecord(SamFile& samIn,
                                       SamRecord** recordPtr,
-                                      MateMapByCoord& mateMap, 
+                                      MateRingBuffer& mateMap, 
                                       SamCoordOutput* outputBufferPtr);
 
     // Flush the first record from the mate map if there is one and flush the output buffer
     // up to and including that position (if there was nothing in the mateMap, flush everything).
-    bool forceRecordFlush(MateMapByCoord& mateMap, 
+    bool forceRecordFlush(MateRingBuffer& mateMap, 
                           SamCoordOutput* outputBufferPtr);
 
     // Flush up to the first record in the mate map, or if it is empty,
     // flush up to and including the specified position.
-    bool flushOutputBuffer(MateMapByCoord& mateMap,
+    bool flushOutputBuffer(MateRingBuffer& mateMap,
                            SamCoordOutput& outputBuffer,
                            int32_t prevChrom,
                            int32_t prevPos);
 
     // Cleanup the mate map up to the specified record. 
     // If chrom is -1, empty the entire mateMap.
-    void cleanupMateMap(MateMapByCoord& mateMap,
+    void cleanupMateMap(MateRingBuffer& mateMap,
                         SamCoordOutput* outputBufferPtr,
                         int32_t chrom = -1, int32_t position = -1);
 
+    ///////////////////////////////////////////////////////////////////
+    // Methods to spill records to temporary files when the pool is hit.
+
+    // Write the first read of a pair to the spill file, so it and its mate
+    // are clipped in a later pass.
+    void spillFirst(SamRecord& record);
+
+    // If the record's mate was spilled, write it to the mate spill file
+    // and return true.
+    bool spillMate(SamRecord& record, OverlapHandler::OverlapInfo overlapInfo);
+
+    // Close the spill files for the current pass.
+    void closeSpillFiles();
+
+    // Clip the spilled records in passes until none are spilled, then
+    // merge them into the already written output file.
+    SamStatus::Status clipSpilled(const String& outFile);
+
+    // Merge the coordinate sorted input files into the output file.
+    bool mergeSortedFiles(const std::vector<std::string>& inputs,
+                          const char* outFile);
+
+    void getSpillFileName(std::string& fileName, const char* type, int pass);
+
     ///////////////////////////////////////////////////////////////////
     // Private Member Data
 
@@ -91,6 +122,20 @@ private:
     uint32_t myNumPoolFailHandled;
     uint32_t myNumOutOfOrder;
     bool myPoolSkipOverlap;
+
+    // Spill records rather than clipping without the mate when the pool
+    // is hit.
+    bool myPoolSpill;
+    String myTmpPrefix;
+    // Spilled first reads and mates of the current pass; NULL if not
+    // spilling in this pass.
+    SamFile* mySpillFirstFile;
+    SamFile* mySpillMateFile;
+    bool mySpillEnabled;
+    int mySpillPass;
+    std::unordered_set<std::string> mySpilledNames;
+    uint32_t myNumPassSpilled;
+    uint32_t myNumSpilled;
 };
 
 #endif
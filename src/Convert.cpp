@@ -20,11 +20,15 @@
 // which reads an SAM/BAM file and writes a SAM/BAM file (it can convert 
 // between SAM and BAM formats).
 
+#include <atomic>
+
 #include "Convert.h"
-#include "SamFile.h"
+#include "ThreadedSamFile.h"
 #include "Parameters.h"
 #include "BgzfFileType.h"
 #include "SamValidation.h"
+#include "ParallelRecordMap.h"
+#include "BamRecordEditor.h"
 
 void Convert::printConvertDescription(std::ostream& os)
 {
@@ -163,7 +167,9 @@ int Convert::execute(int argc, char **argv)
     }
     else if((useEquals) && (refPtr != NULL))
     {
-        translation = SamRecord::EQUAL;
+        // Matching bases are replaced with '=' in the BAM records before
+        // they are written rather than by the write translation.
+        translation = SamRecord::NONE;
     }
     else
     {
@@ -177,12 +183,12 @@ int Convert::execute(int argc, char **argv)
     }
 
     // Open the input file for reading.
-    SamFile samIn;
+    ThreadedSamFile samIn;
     if(recover) samIn.setAttemptRecovery(true);
     samIn.OpenForRead(inFile);
 
     // Open the output file for writing.
-    SamFile samOut;
+    ThreadedSamFile samOut;
     samOut.OpenForWrite(outFile);
     samOut.SetWriteSequenceTranslation(translation);
     samOut.SetReference(refPtr);
@@ -200,15 +206,76 @@ int Convert::execute(int argc, char **argv)
     // to the failure reason if any of the writes fail.
     SamStatus::Status returnStatus = SamStatus::SUCCESS;
 
+    // Each worker edits with its own encoder.
+    bool encodeEquals = useEquals && (refPtr != NULL);
+    std::vector<std::unique_ptr<BamRecordEditor> > editors;
+    std::vector<std::unique_ptr<EqualsEncoder> > encoders;
+    if(encodeEquals)
+    {
+        for(unsigned int i = 0; i < ParallelRecordMap::getNumWorkers(); i++)
+        {
+            editors.emplace_back(new BamRecordEditor);
+            encoders.emplace_back(new EqualsEncoder);
+            encoders.back()->setReference(refPtr);
+        }
+    }
+    // Shift and encode the record, returning false if encoding failed.
+    auto convert = [&](SamRecord& record, unsigned int worker)
+    {
+        if(lshift)
+        {
+            record.shiftIndelsLeft();
+        }
+        if(!encodeEquals)
+        {
+            return(true);
+        }
+        BamRecordEditor& editor = *(editors[worker]);
+        if(!editor.load(record) ||
+           !editor.setMatchesToEquals(*(encoders[worker]), samHeader) ||
+           !editor.store(record, samHeader))
+        {
+            fprintf(stderr, "%s\n", editor.getStatus().getStatusMessage());
+            return(false);
+        }
+        return(true);
+    };
+
     while(1) {
         try {
+            if((lshift || encodeEquals) && !recover)
+            {
+                // Shift & encode the records on the thread pool when using
+                // multiple threads, writing them in their original order.
+                // Recovery resyncs the input mid stream, so it always
+                // reads and writes one record at a time.
+                // Records that fail to encode are written unencoded.
+                std::atomic<bool> convertFailed(false);
+                ParallelRecordMap recordMap;
+                returnStatus = 
+                    recordMap.run(samIn, samOut, samHeader,
+                                  [&](SamRecord& record, unsigned int worker)
+                    {
+                        if(!convert(record, worker))
+                        {
+                            convertFailed = true;
+                        }
+                        return(true);
+                    });
+                if(convertFailed && (returnStatus == SamStatus::SUCCESS))
+                {
+                    returnStatus = SamStatus::INVALID;
+                }
+                break;
+            }
+
             // Keep reading records until ReadRecord returns false.
             while(samIn.ReadRecord(samHeader, samRecord))
             {
-                // left shift if necessary.
-                if(lshift)
+                // left shift & encode if necessary.
+                if(!convert(samRecord, 0))
                 {
-                    samRecord.shiftIndelsLeft();
+                    returnStatus = SamStatus::INVALID;
                 }
 
                 // Successfully read a record from the file, so write it.
@@ -0,0 +1,138 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <limits>
+
+#include "CoordReorderBuffer.h"
+#include "ParallelRecordMap.h"
+
+CoordReorderBuffer::CoordReorderBuffer()
+    : mySamOut(NULL),
+      myHeader(NULL),
+      myHeld(),
+      myFreeBuffers(),
+      myNumAdded(0),
+      myLastKey(0),
+      myNumHeld(0),
+      myNumOutOfOrder(0),
+      myMaxHeld(0)
+{
+}
+
+
+CoordReorderBuffer::~CoordReorderBuffer()
+{
+}
+
+
+void CoordReorderBuffer::init(ThreadedSamFile* samOut, SamFileHeader* header)
+{
+    mySamOut = samOut;
+    myHeader = header;
+    myHeld.clear();
+    myNumAdded = 0;
+    myLastKey = 0;
+    myNumHeld = 0;
+    myNumOutOfOrder = 0;
+    myMaxHeld = 0;
+}
+
+
+SamStatus::Status CoordReorderBuffer::add(SamRecord& record, uint64_t inputKey)
+{
+    // Later input records are at or after inputKey and only move forward.
+    SamStatus::Status status = flush(inputKey);
+    ++myNumAdded;
+
+    uint64_t key = ParallelRecordMap::getCoordKey(record);
+    if(key <= inputKey)
+    {
+        // Sorts before everything still held, so write it now.
+        if(key < myLastKey)
+        {
+            ++myNumOutOfOrder;
+        }
+        else
+        {
+            myLastKey = key;
+        }
+        if(!mySamOut->WriteRecord(*myHeader, record))
+        {
+            status = writeFailed();
+        }
+        return(status);
+    }
+
+    const char* buffer = 
+        (const char*)record.getRecordBuffer(SamRecord::NONE);
+    if(buffer == NULL)
+    {
+        fprintf(stderr, "ERROR: Failed to get the BAM record buffer\n");
+        return(SamStatus::FAIL_MEM);
+    }
+    int32_t blockSize = 0;
+    memcpy(&blockSize, buffer, sizeof(blockSize));
+
+    std::vector<char>& held = myHeld[std::make_pair(key, myNumAdded)];
+    if(!myFreeBuffers.empty())
+    {
+        held.swap(myFreeBuffers.back());
+        myFreeBuffers.pop_back();
+    }
+    held.assign(buffer, buffer + blockSize + sizeof(blockSize));
+    ++myNumHeld;
+    if(myHeld.size() > myMaxHeld)
+    {
+        myMaxHeld = myHeld.size();
+    }
+    return(status);
+}
+
+
+SamStatus::Status CoordReorderBuffer::flushAll()
+{
+    return(flush(std::numeric_limits<uint64_t>::max()));
+}
+
+
+SamStatus::Status CoordReorderBuffer::flush(uint64_t maxKey)
+{
+    SamStatus::Status status = SamStatus::SUCCESS;
+    while(!myHeld.empty() && (myHeld.begin()->first.first <= maxKey))
+    {
+        HeldMap::iterator first = myHeld.begin();
+        myLastKey = first->first.first;
+        std::vector<char>& buffer = first->second;
+        if(!mySamOut->WriteRawRecord(*myHeader, &(buffer[0]), buffer.size()))
+        {
+            status = writeFailed();
+        }
+        myFreeBuffers.push_back(std::vector<char>());
+        myFreeBuffers.back().swap(buffer);
+        myHeld.erase(first);
+    }
+    return(status);
+}
+
+
+SamStatus::Status CoordReorderBuffer::writeFailed()
+{
+    fprintf(stderr, "%s\n", mySamOut->GetStatusMessage());
+    return(mySamOut->GetStatus());
+}
@@ -0,0 +1,88 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __COORD_REORDER_BUFFER_H__
+#define __COORD_REORDER_BUFFER_H__
+
+#include <stdint.h>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "ThreadedSamFile.h"
+
+/// Writes the records of a coordinate sorted input in coordinate order
+/// after their positions may have moved forward, for example by soft
+/// clipping the start of the read.
+/// Since positions only move forward, no later input record can sort
+/// before a record whose new position is not after the input position of
+/// the record being added, so only records that moved past the input are
+/// held (as copies of their BAM buffers).  Records with the same position
+/// are written in input order.
+class CoordReorderBuffer
+{
+public:
+    CoordReorderBuffer();
+    ~CoordReorderBuffer();
+
+    /// Setup writing to the already opened output file.
+    void init(ThreadedSamFile* samOut, SamFileHeader* header);
+
+    /// Add the record whose coordinate key (ParallelRecordMap::getCoordKey)
+    /// was inputKey in the input, writing it and any held records that
+    /// can no longer be passed.  Records must be added in input order.
+    /// Returns SUCCESS or the status of the last failed write.
+    SamStatus::Status add(SamRecord& record, uint64_t inputKey);
+
+    /// Write all held records.
+    /// Returns SUCCESS or the status of the last failed write.
+    SamStatus::Status flushAll();
+
+    /// Number of records that moved past later input records, so were
+    /// held before being written.
+    uint64_t getNumHeld() { return(myNumHeld); }
+    /// Number of records whose position moved backward, so may be out of
+    /// order in the output.
+    uint64_t getNumOutOfOrder() { return(myNumOutOfOrder); }
+    /// Most records held at once.
+    uint32_t getMaxHeld() { return(myMaxHeld); }
+
+private:
+    CoordReorderBuffer(const CoordReorderBuffer&);
+    CoordReorderBuffer& operator=(const CoordReorderBuffer&);
+
+    // Held records by coordinate key then input order.
+    typedef std::map< std::pair<uint64_t, uint64_t>, std::vector<char> > HeldMap;
+
+    // Write the held records with keys up to maxKey.
+    SamStatus::Status flush(uint64_t maxKey);
+    // Report the failed write, returning its status.
+    SamStatus::Status writeFailed();
+
+    ThreadedSamFile* mySamOut;
+    SamFileHeader* myHeader;
+    HeldMap myHeld;
+    // Buffers of written records, reused for new held records.
+    std::vector< std::vector<char> > myFreeBuffers;
+    uint64_t myNumAdded;
+    uint64_t myLastKey;
+    uint64_t myNumHeld;
+    uint64_t myNumOutOfOrder;
+    uint32_t myMaxHeld;
+};
+
+#endif
@@ -24,9 +24,7 @@
 #include <vector>
 #include <stdexcept>
 #include "BaseAsciiMap.h"
-
-// TODO - move logic for looping through a read and extracting each covariate 
-// to here.
+#include "BaseUtilities.h"
 
 struct BaseData
 {
@@ -68,77 +66,13 @@ public:
     {
         read = (key >> 63);
         qual = (key >> 56) & 0x7F;
-        cycle = (key >> 40) & 0xFF;
+        cycle = (key >> 40) & 0xFFFF;
         preBase = BaseAsciiMap::int2base[(key >> 36) & 0xF];
         curBase = BaseAsciiMap::int2base[(key >> 32) & 0xF];
         rgid = key & 0xFFFFFFFF;
            
     }
 
-    inline static uint32_t getFastKeySize()
-    {
-        return(0x0FFFFFFF);
-    }
-
-
-    inline static int32_t getFastMaxRG()
-    {
-        return(0xFF);
-    }
-
-
-    inline static uint32_t getFastMaxQual()
-    {
-        return(0x3F);
-    }
-
-
-    inline static int32_t getFastMaxCycles()
-    {
-        return(0x7F);
-    }
-
-
-    inline uint32_t getFastKey() const
-    {
-        if(rgid > getFastMaxRG())
-        {
-            String errorMsg = "RECAB: Cannot use --fast option with more than ";
-            errorMsg += (getFastMaxRG() + 1);
-            errorMsg += " read groups";
-            throw(std::runtime_error(errorMsg.c_str()));
-        }
-        if(qual > getFastMaxQual())
-        {
-            String errorMsg = "RECAB: Cannot use --fast option with qualities > ";
-            errorMsg += getFastMaxQual();
-            throw(std::runtime_error(errorMsg.c_str()));
-        }
-        if(cycle > getFastMaxCycles())
-        {
-            String errorMsg = "RECAB: Cannot use --fast option with cycles > ";
-            errorMsg += getFastMaxCycles();
-            throw(std::runtime_error(errorMsg.c_str()));
-        }
-        return( ((uint32_t)(read & 0x1) << 27) |
-                ((uint32_t)(cycle & 0x7F) << 20) | 
-                ((uint32_t)(qual & 0x3F) << 14) | 
-                ((uint32_t)(BaseAsciiMap::base2int[(int)preBase] & 0x7) << 11) | 
-                ((uint32_t)(BaseAsciiMap::base2int[(int)curBase] & 0x7) << 8) | 
-                rgid );
-    }
-
-    inline void parseFastKey(uint32_t key)
-    {
-        read = (key >> 27);
-        cycle = (key >> 20) & 0x7F;
-        qual = (key >> 14) & 0x3F;
-        preBase = BaseAsciiMap::int2base[(key >> 11) & 0x7];
-        curBase = BaseAsciiMap::int2base[(key >> 8) & 0x7];
-        rgid = key & 0xFF;
-           
-    }
-
     inline bool operator <(const BaseData& other) const
     {
         if(rgid == other.rgid)
@@ -177,6 +111,70 @@ public:
 private:
 };
 
+// Covariates of every base of a read, extracted in one pass in cycle
+// order.  Cycles of reverse strand reads start at the end of the
+// sequence and their bases are complemented.  The caller sets counted
+// for the bases to add to a table (see HashErrorModel::addRead), so
+// the keys are checked against the table once per read.
+struct ReadCovariates
+{
+public:
+    enum Outcome { SKIP = 0, MATCH = 1, MISMATCH = 2 };
+
+    // BaseData key, base, and quality of each cycle.
+    std::vector<uint64_t> keys;
+    std::string bases;
+    std::vector<uint8_t> quals;
+    // Outcome of each cycle, all SKIP after extract.
+    std::vector<uint8_t> counted;
+
+    ReadCovariates() : keys(), bases(), quals(), counted(), myReverse(false) {}
+
+    inline void extract(const char* sequence, const char* quality,
+                        int32_t seqLen, bool reverse, bool secondRead,
+                        int32_t rgid)
+    {
+        myReverse = reverse;
+        keys.resize(seqLen);
+        bases.resize(seqLen);
+        quals.resize(seqLen);
+        counted.assign(seqLen, SKIP);
+
+        uint64_t readKey = ((uint64_t)(secondRead & 0x1) << 63) | (uint32_t)rgid;
+        // The previous base of cycle 0 is unset ('K').
+        uint64_t preCode = BaseAsciiMap::base2int[(int)'K'];
+        int32_t seqPos = reverse ? seqLen - 1 : 0;
+        int32_t seqIncr = reverse ? -1 : 1;
+        for(int32_t cycle = 0; cycle < seqLen; cycle++, seqPos += seqIncr)
+        {
+            char base = sequence[seqPos];
+            if(reverse)
+            {
+                base = BaseAsciiMap::base2complement[(unsigned int)base];
+            }
+            uint64_t curCode = BaseAsciiMap::base2int[(int)base];
+            uint8_t qual = BaseUtilities::getPhredBaseQuality(quality[seqPos]);
+            bases[cycle] = base;
+            quals[cycle] = qual;
+            keys[cycle] = readKey | ((uint64_t)(qual & 0x7F) << 56) |
+                ((uint64_t)(cycle & 0xFFFF) << 40) | (preCode << 36) |
+                (curCode << 32);
+            preCode = curCode;
+        }
+    }
+
+    inline int32_t getNumCycles() const { return(keys.size()); }
+
+    // Position in the sequence of the base at cycle.
+    inline int32_t getSeqPos(int32_t cycle) const
+    {
+        return(myReverse ? (int32_t)keys.size() - 1 - cycle : cycle);
+    }
+
+private:
+    bool myReverse;
+};
+
 struct Covariates
 {
 public:
@@ -21,43 +21,47 @@
 #include <string>
 #include <unistd.h>
 #include <getopt.h>
-#include "SamFile.h"
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <future>
+#include "ThreadedSamFile.h"
+#include "BamIndexBuilder.h"
+#include "FileBatch.h"
+#include "MergedSamInput.h"
+#include "Profile.h"
 #include "Dedup.h"
 #include "Logger.h"
 #include "SamHelper.h"
 #include "SamStatus.h"
 #include "BgzfFileType.h"
+#include "QualitySum.h"
 
 const int Dedup::DEFAULT_MIN_QUAL = 15;
+const int Dedup::DEFAULT_REORDER_WINDOW = 1000000;
 const uint32_t Dedup::CLIP_OFFSET = 1000;
 
 Dedup::~Dedup()
 {
     // clean up the maps.
     // First free any fragment records.
-    for(FragmentMap::iterator iter = myFragmentMap.begin(); 
-        iter != myFragmentMap.end(); iter++)
-    {
-        mySamPool.releaseRecord(iter->second.recordPtr);
-    }
+    myFragmentMap.forEach([this](const DupKey&, ReadData& data)
+                          { mySamPool.releaseRecord(data.recordPtr); });
     myFragmentMap.clear();
 
     // Free any paired records.
-    for(PairedMap::iterator iterator = myPairedMap.begin(); 
-        iterator != myPairedMap.end(); iterator++)
-    {
-        // These are not duplicates, but we are done with them, so release them.
-        mySamPool.releaseRecord(iterator->second.record1Ptr);
-        mySamPool.releaseRecord(iterator->second.record2Ptr);
-    }
+    myPairedMap.forEach([this](const PairedKey&, PairedData& data)
+                        {
+                            // These are not duplicates, but we are done
+                            // with them, so release them.
+                            mySamPool.releaseRecord(data.record1Ptr);
+                            mySamPool.releaseRecord(data.record2Ptr);
+                        });
     myPairedMap.clear();
 
     // Free any entries in the mate map.
-    for(MateMap::iterator iter = myMateMap.begin(); 
-        iter != myMateMap.end(); iter++)
-    {
-        mySamPool.releaseRecord(iter->second.recordPtr);
-    }
+    myMateMap.forEach([this](uint64_t, ReadData& data)
+                      { mySamPool.releaseRecord(data.recordPtr); });
     myMateMap.clear();
 }
 
@@ -75,11 +79,14 @@ void Dedup::printDescription(std::ostream& os)
 
 void Dedup::printUsage(std::ostream& os)
 {
-    os << "Usage: ./bam dedup --in <InputBamFile> --out <OutputBamFile> [--minQual <minPhred>] [--log <logFile>] [--oneChrom] [--rmDups] [--force] [--excludeFlags <flag>] [--verbose] [--noeof] [--params] [--recab] ";
+    os << "Usage: ./bam dedup --in <InputBamFile>|--list <InputListFile> --out <OutputBamFile> [--minQual <minPhred>] [--log <logFile>] [--oneChrom] [--rmDups] [--force] [--excludeFlags <flag>] [--verbose] [--noeof] [--params] [--onePass [--reorderWindow <records>] [--tmpPrefix <prefix>]] [--byChrom] [--index] [--recab] ";
     myRecab.printRecabSpecificUsageLine(os);
     os << std::endl << std::endl;
     os << "Required parameters :" << std::endl;
     os << "\t--in <infile>   : Input BAM file name (must be sorted)" << std::endl;
+    os << "\t--list <file>   : Instead of --in, file listing coordinate sorted input files, one per line, such as" << std::endl;
+    os << "\t                  the lanes of a sample, which are merged as they are read into one deduplicated output." << std::endl;
+    os << "\t                  The inputs must have the same references, their read groups and programs are combined." << std::endl;
     os << "\t--out <outfile> : Output BAM file name (same order with original file)" << std::endl;
     os << "Optional parameters : " << std::endl;
     os << "\t--minQual <int> : Only add scores over this phred quality when determining a read's quality (default: "
@@ -95,7 +102,17 @@ void Dedup::printUsage(std::ostream& os)
     os << "\t--verbose       : Turn on verbose mode" << std::endl;
     os << "\t--noeof         : Do not expect an EOF block on a bam file." << std::endl;
     os << "\t--params        : Print the parameter settings" << std::endl;
+    os << "\t--onePass       : Mark duplicates in a single pass through the input, allowing stdin input." << std::endl;
+    os << "\t                  Records are buffered until their duplicate status is known (cannot be used with --recab)" << std::endl;
+    os << "\t--reorderWindow <records> : with --onePass, number of records to buffer in memory before spilling them" << std::endl;
+    os << "\t                            to temporary files (default: " << DEFAULT_REORDER_WINDOW << ")" << std::endl;
+    os << "\t--tmpPrefix <prefix>      : with --onePass or --byChrom, prefix for the temporary files (default: $TMPDIR/bamDedup.<pid>)" << std::endl;
+    os << "\t--byChrom       : With --threads, use the BAM index (<infile>.bai) to process each reference on its own thread." << std::endl;
+    os << "\t                  The output must be a BAM file (cannot be used with --onePass or --recab)" << std::endl;
+    os << "\t--index         : Index the BAM output as it is written (<outfile>.bai, or .csi if a reference is longer" << std::endl;
+    os << "\t                  than 512Mb).  With --byChrom, the index is built from the output after it is written" << std::endl;
     os << "\t--recab         : Recalibrate in addition to deduping" << std::endl;
+    os << "\t                  With --threads, the table is built on the other threads while deduping" << std::endl;
     myRecab.printRecabSpecificUsage(os);
     os<< "\n" << std::endl;
 }
@@ -105,7 +122,7 @@ int Dedup::execute(int argc, char** argv)
     /* --------------------------------
      * process the arguments
      * -------------------------------*/
-    String inFile, outFile, logFile;
+    String inFile, outFile, logFile, listFile;
     myDoRecab = false;
     bool removeFlag = false;
     bool verboseFlag = false;
@@ -116,12 +133,18 @@ int Dedup::execute(int argc, char** argv)
     uint16_t intExcludeFlags = 0;
     bool noeof = false;
     bool params = false;
+    myOnePass = false;
+    int reorderWindow = DEFAULT_REORDER_WINDOW;
+    String tmpPrefix = "";
+    bool byChrom = false;
+    bool index = false;
 
     LongParamContainer parameters;
     parameters.addGroup("Required Parameters");
     parameters.addString("in", &inFile);
     parameters.addString("out", &outFile);
     parameters.addGroup("Optional Parameters");
+    parameters.addString("list", &listFile);
     parameters.addInt("minQual", & myMinQual);
     parameters.addString("log", &logFile);
     parameters.addBool("oneChrom", &myOneChrom);
@@ -132,6 +155,11 @@ int Dedup::execute(int argc, char** argv)
     parameters.addBool("verbose", &verboseFlag);
     parameters.addBool("noeof", &noeof);
     parameters.addBool("params", &params);
+    parameters.addBool("onePass", &myOnePass);
+    parameters.addInt("reorderWindow", &reorderWindow);
+    parameters.addString("tmpPrefix", &tmpPrefix);
+    parameters.addBool("byChrom", &byChrom);
+    parameters.addBool("index", &index);
     parameters.addPhoneHome(VERSION);
     myRecab.addRecabSpecificParameters(parameters);
 
@@ -150,23 +178,43 @@ int Dedup::execute(int argc, char** argv)
         BgzfFileType::setRequireEofBlock(false);
     }
 
-    if(inFile.IsEmpty())
+    if(inFile.IsEmpty() == listFile.IsEmpty())
     {
         printUsage(std::cerr);
         inputParameters.Status();
-        std::cerr << "Specify an input file" << std::endl;
+        std::cerr << "Specify either an input file or an input list file" << std::endl;
         return EXIT_FAILURE;
     }
-    // inFile is not empty, so there is at least one character.  Check if
-    // it is specifing stdin since that is not supported for Dedup.
-    if(inFile[0] == '-')
+
+    std::vector<std::string> inFiles;
+    if(listFile.IsEmpty())
     {
-        // ERROR: stdin specified, but since Dedup requires 2 passes through
-        // the input file, stdin is not supported.
-        printUsage(std::cerr);
-        inputParameters.Status();
-        std::cerr << "ERROR: stdin ('" << inFile << "') is not a supported input file because Dedup requires two passes through the input file." << std::endl;
-        return EXIT_FAILURE;
+        inFiles.push_back(inFile.c_str());
+    }
+    else
+    {
+        FileBatch batch;
+        if(!batch.readList(listFile.c_str()))
+        {
+            return EXIT_FAILURE;
+        }
+        inFiles = batch.getFiles();
+        inFile = inFiles[0].c_str();
+    }
+
+    // The input names are not empty, so there is at least one character.
+    // Check if one is specifing stdin since that is not supported for Dedup.
+    for(unsigned int i = 0; i < inFiles.size(); i++)
+    {
+        if((inFiles[i][0] == '-') && !myOnePass)
+        {
+            // ERROR: stdin specified, but since Dedup requires 2 passes through
+            // the input file, stdin is not supported.
+            printUsage(std::cerr);
+            inputParameters.Status();
+            std::cerr << "ERROR: stdin ('" << inFiles[i] << "') is not a supported input file because Dedup requires two passes through the input file." << std::endl;
+            return EXIT_FAILURE;
+        }
     }
 
     if(outFile.IsEmpty())
@@ -204,9 +252,56 @@ int Dedup::execute(int argc, char** argv)
         return EXIT_FAILURE;
     }
 
+    if(myOnePass && myDoRecab)
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        std::cerr << "ERROR: --onePass cannot be used with --recab since recalibration requires a second pass.\n";
+        return EXIT_FAILURE;
+    }
+
+    if(byChrom && (myOnePass || myDoRecab))
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        std::cerr << "ERROR: --byChrom cannot be used with --onePass or --recab.\n";
+        return EXIT_FAILURE;
+    }
+
+    if(byChrom && (inFiles.size() > 1))
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        std::cerr << "ERROR: --byChrom cannot be used with more than one input file.\n";
+        return EXIT_FAILURE;
+    }
+
+    if(myOnePass && (reorderWindow < 1))
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        std::cerr << "ERROR: --reorderWindow must be at least 1.\n";
+        return EXIT_FAILURE;
+    }
+
+    if(tmpPrefix.IsEmpty())
+    {
+        const char* tmpDir = getenv("TMPDIR");
+        tmpPrefix = (tmpDir == NULL) ? "/tmp" : tmpDir;
+        tmpPrefix += "/bamDedup.";
+        tmpPrefix += (int)getpid();
+    }
+
     if(logFile.IsEmpty())
     {
-        logFile = outFile + ".log";
+        if(ThreadedSamFile::isPipeName(outFile.c_str()))
+        {
+            logFile = "-";
+        }
+        else
+        {
+            logFile = outFile + ".log";
+        }
     }
 
     if(myDoRecab)
@@ -231,30 +326,73 @@ int Dedup::execute(int argc, char** argv)
      * instantiate dedup, and construct the read group library map
      * ------------------------------------------------------------------*/
 
-    SamFile samIn;
-
-    samIn.OpenForRead(inFile.c_str());
-    // If the file isn't sorted it will throw an exception.
-    samIn.setSortedValidation(SamFile::COORDINATE);
-
+    // Multiple inputs are merged as they are read.  If a file isn't
+    // sorted it will throw an exception.
+    MergedSamInput samIn;
     SamFileHeader header;
-    samIn.ReadHeader(header);
+    if(!samIn.open(inFiles, header))
+    {
+        std::string names = inFiles[0];
+        for(unsigned int i = 1; i < inFiles.size(); i++)
+        {
+            names += ", " + inFiles[i];
+        }
+        Logger::gLogger->error("Failed to merge the input files: %s",
+                               names.c_str());
+    }
+    if(inFiles.size() > 1)
+    {
+        Logger::gLogger->writeLog("Merging %u input files",
+                                  (unsigned int)inFiles.size());
+    }
 
     buildReadGroupLibraryMap(header);
+    if(header.getReferenceInfo().getNumEntries() > MAX_KEY_REFERENCES)
+    {
+        Logger::gLogger->error("More than %d references, Dedup only allows up to %d references", 
+                               MAX_KEY_REFERENCES, MAX_KEY_REFERENCES);
+    }
+
+    if(byChrom)
+    {
+        // Processing by reference requires threads and writing the
+        // output with the thread pool.
+        const char* extension = strrchr(outFile.c_str(), '.');
+        if(BamExecutable::getNumThreads() <= 1)
+        {
+            Logger::gLogger->warning("--byChrom requires --threads greater than 1, processing the file sequentially");
+        }
+        else if((extension == NULL) || (strcmp(extension, ".bam") != 0))
+        {
+            Logger::gLogger->warning("--byChrom requires a BAM output file, processing the file sequentially");
+        }
+        else
+        {
+            samIn.Close();
+            return(executeByChrom(inFile, outFile, header, removeFlag,
+                                  intExcludeFlags, tmpPrefix, index));
+        }
+    }
+
+    ThreadedSamFile samOut;
+    samOut.setWriteIndex(index);
+    if(myOnePass)
+    {
+        // Single pass, so write records as soon as they and all the
+        // records before them have been checked for duplicates.
+        samOut.OpenForWrite(outFile.c_str());
+        samOut.WriteHeader(header);
+        myReorderBuffer.init(&samOut, &header, reorderWindow, 
+                             tmpPrefix.c_str(), removeFlag, myForceFlag);
+        Logger::gLogger->writeLog("\nWriting %s in a single pass", outFile.c_str());
+    }
 
     lastReference = -1;
     lastCoordinate = -1;
 
     // for keeping some basic statistics
-    uint32_t recordCount = 0;
-    uint32_t pairedCount = 0;
-    uint32_t properPairCount = 0;
-    uint32_t unmappedCount = 0;
-    uint32_t reverseCount = 0;
-    uint32_t qualCheckFailCount = 0;
-    uint32_t secondaryCount = 0;
-    uint32_t supplementaryCount = 0;
-    uint32_t excludedCount = 0;
+    uint64_t recordCount = 0;
+    ReadCounts counts;
 
     // Now we start reading records
     SamRecord* recordPtr;
@@ -267,6 +405,7 @@ int Dedup::execute(int argc, char** argv)
             std::cerr << "Failed to allocate enough records\n";
             return(-1);
         }
+        Profile::setMaxValue("Dedup::recordsInUse", mySamPool.getNumInUse());
         if(!samIn.ReadRecord(header, *recordPtr))
         {
             returnStatus = samIn.GetStatus();
@@ -274,18 +413,18 @@ int Dedup::execute(int argc, char** argv)
         }
         // Take note of properties of this record
         int flag = recordPtr->getFlag();
-        if(SamFlag::isPaired(flag))     ++pairedCount;
-        if(SamFlag::isProperPair(flag)) ++properPairCount;
-        if(SamFlag::isReverse(flag))    ++reverseCount;
-        if(SamFlag::isQCFailure(flag))  ++qualCheckFailCount;
-        if(SamFlag::isSecondary(flag))  ++secondaryCount;
-        if(flag & SamFlag::SUPPLEMENTARY_ALIGNMENT)  ++supplementaryCount;
-        if(!SamFlag::isMapped(flag))    ++unmappedCount;
+        counts.addRecord(flag);
 
         // put the record in the appropriate maps:
         //   single reads go in myFragmentMap
         //   paired reads go in myPairedMap
-        recordCount = samIn.GetCurrentRecordCount();
+        // Count the records here since the file's count is only 32 bits.
+        ++recordCount;
+
+        if(myOnePass)
+        {
+            myReorderBuffer.add(recordCount, recordPtr);
+        }
 
         // if we have moved to a new position, look back at previous reads for duplicates
         if (hasPositionChanged(*recordPtr))
@@ -296,7 +435,7 @@ int Dedup::execute(int argc, char** argv)
         // Determine if this read should be checked for duplicates.
         if((!SamFlag::isMapped(flag)) || ((flag & intExcludeFlags) != 0))
         {
-            ++excludedCount;
+            ++counts.excluded;
 
             // No deduping done on this record, but still build the recab table.
             if(myDoRecab)
@@ -305,7 +444,14 @@ int Dedup::execute(int argc, char** argv)
             }
             // Nothing more to do with this record, so
             // release the pointer.
-            mySamPool.releaseRecord(recordPtr);
+            if(myOnePass)
+            {
+                myReorderBuffer.setDuplicate(recordCount, recordPtr, false);
+            }
+            else
+            {
+                mySamPool.releaseRecord(recordPtr);
+            }
         }
         else
         {
@@ -318,13 +464,19 @@ int Dedup::execute(int argc, char** argv)
 
             checkDups(*recordPtr, recordCount);
         }
+        if(myOnePass)
+        {
+            // Write any records that are done.
+            myReorderBuffer.flush();
+        }
         // let the user know we're not napping
         if (verboseFlag && (recordCount % 100000 == 0))
         {
-            Logger::gLogger->writeLog("recordCount=%u singleKeyMap=%u pairedKeyMap=%u, dictSize=%u", 
-                                      recordCount, myFragmentMap.size(), 
-                                      myPairedMap.size(), 
-                                      myMateMap.size());
+            Logger::gLogger->writeLog("recordCount=%llu singleKeyMap=%llu pairedKeyMap=%llu, dictSize=%llu", 
+                                      (unsigned long long)recordCount,
+                                      (unsigned long long)myFragmentMap.size(), 
+                                      (unsigned long long)myPairedMap.size(), 
+                                      (unsigned long long)myMateMap.size());
         }
     }
 
@@ -332,74 +484,62 @@ int Dedup::execute(int argc, char** argv)
     //  close the input file
     cleanupPriorReads(NULL);
     samIn.Close();
+    if(myOnePass)
+    {
+        myReorderBuffer.finish();
+        samOut.Close();
+        if(samOut.writeIndexFailed())
+        {
+            Logger::gLogger->error("Failed to index %s", outFile.c_str());
+        }
+    }
 
     // print some statistics
-    Logger::gLogger->writeLog("--------------------------------------------------------------------------");
-    Logger::gLogger->writeLog("SUMMARY STATISTICS OF THE READS");
-    Logger::gLogger->writeLog("Total number of reads: %u",recordCount);
-    Logger::gLogger->writeLog("Total number of paired-end reads: %u",
-                              pairedCount);
-    Logger::gLogger->writeLog("Total number of properly paired reads: %u",
-                              properPairCount);
-    Logger::gLogger->writeLog("Total number of unmapped reads: %u",
-                              unmappedCount);
-    Logger::gLogger->writeLog("Total number of reverse strand mapped reads: %u",
-                              reverseCount);
-    Logger::gLogger->writeLog("Total number of QC-failed reads: %u",
-                              qualCheckFailCount);
-    Logger::gLogger->writeLog("Total number of secondary reads: %u",
-                              secondaryCount);
-    Logger::gLogger->writeLog("Total number of supplementary reads: %u",
-                              supplementaryCount);
-    Logger::gLogger->writeLog("Size of singleKeyMap (must be zero): %u",
-                              myFragmentMap.size());
-    Logger::gLogger->writeLog("Size of pairedKeyMap (must be zero): %u",
-                              myPairedMap.size());
-    Logger::gLogger->writeLog("Total number of missing mates: %u",
-                              myNumMissingMate);
-    Logger::gLogger->writeLog("Total number of reads excluded from duplicate checking: %u",
-                              excludedCount);
-    Logger::gLogger->writeLog("--------------------------------------------------------------------------");
-    Logger::gLogger->writeLog("Sorting the indices of %d duplicated records",
-                              myDupList.size());
+    logReadCounts(counts);
 
-    // sort the indices of duplicate records
-    std::sort(myDupList.begin(), myDupList.end(),
-              std::less<uint32_t> ());
+    if(myOnePass)
+    {
+        Logger::gLogger->writeLog("Number of records spilled to temporary files: %llu",
+                                  (unsigned long long)myReorderBuffer.getNumSpilled());
+        Logger::gLogger->writeLog("Successfully %s %llu unpaired and %llu paired duplicate reads", 
+                                  removeFlag ? "removed" : "marked" ,
+                                  (unsigned long long)myReorderBuffer.getNumSingleDuplicates(),
+                                  (unsigned long long)myReorderBuffer.getNumPairedDuplicates()/2);
+        Logger::gLogger->writeLog("\nDedup complete!");
+        return 0;
+    }
 
     // get ready to write the output file by making a second pass
     // through the input file
-    samIn.OpenForRead(inFile.c_str());
-    samIn.ReadHeader(header);
+    samIn.open(inFiles, header);
 
-    SamFile samOut;
     samOut.OpenForWrite(outFile.c_str());
     samOut.WriteHeader(header);
 
     // If we are recalibrating, output the model information.
     if(myDoRecab)
     {
-        myRecab.modelFitPrediction(outFile);
+        // Name the tables after the log rather than a pipe output.
+        myRecab.modelFitPrediction(ThreadedSamFile::isPipeName(outFile.c_str()) ?
+                                   logFile.c_str() : outFile.c_str());
     }
 
-    // an iterator to run through the duplicate indices
-    int currentDupIndex = 0;
-    bool moreDups = !myDupList.empty();
+    // Index of the current record in the file.
+    uint64_t currentIndex = 0;
 
     // let the user know what we're doing
     Logger::gLogger->writeLog("\nWriting %s", outFile.c_str());
 
     // count the duplicate records as a check
-    uint32_t singleDuplicates(0), pairedDuplicates(0);
+    uint64_t singleDuplicates(0), pairedDuplicates(0);
 
     // start reading records and writing them out
     SamRecord record;
     while(samIn.ReadRecord(header, record))
     {
-        uint32_t currentIndex = samIn.GetCurrentRecordCount();
+        ++currentIndex;
 
-        bool foundDup = moreDups &&
-            (currentIndex == myDupList[currentDupIndex]);
+        bool foundDup = myDupList.test(currentIndex);
 
         // modify the duplicate flag and write out the record,
         // if it's appropriate
@@ -408,7 +548,6 @@ int Dedup::execute(int argc, char** argv)
         {   
             // this record is a duplicate, so mark it.
             record.setFlag( flag | 0x400 );
-            currentDupIndex++;
             // increment duplicate counters to verify we found them all
             if ( ( ( flag & 0x0001 ) == 0 ) || ( flag & 0x0008 ) )
             { // unpaired or mate unmapped
@@ -445,104 +584,510 @@ int Dedup::execute(int argc, char** argv)
 	
         // Let the user know we're still here
         if (verboseFlag && (currentIndex % 100000 == 0)) {
-            Logger::gLogger->writeLog("recordCount=%u", currentIndex);
+            Logger::gLogger->writeLog("recordCount=%llu",
+                                      (unsigned long long)currentIndex);
         }
     }
 
     // We're done.  Close the files and print triumphant messages.
     samIn.Close();
     samOut.Close();
+    if(samOut.writeIndexFailed())
+    {
+        Logger::gLogger->error("Failed to index %s", outFile.c_str());
+    }
 
-    Logger::gLogger->writeLog("Successfully %s %u unpaired and %u paired duplicate reads", 
+    Logger::gLogger->writeLog("Successfully %s %llu unpaired and %llu paired duplicate reads", 
                               removeFlag ? "removed" : "marked" ,
-                              singleDuplicates,
-                              pairedDuplicates/2);
+                              (unsigned long long)singleDuplicates,
+                              (unsigned long long)pairedDuplicates/2);
     Logger::gLogger->writeLog("\nDedup complete!");
     return 0;
 }
 
-// Now that we've reached coordinate on chromosome reference, look back and
-// clean up any previous positions from being tracked.
-void Dedup::cleanupPriorReads(SamRecord* record)
+void Dedup::logReadCounts(const ReadCounts& counts)
 {
-    static DupKey emptyKey;
-    static DupKey tempKey2;
+    Logger::gLogger->writeLog("--------------------------------------------------------------------------");
+    Logger::gLogger->writeLog("SUMMARY STATISTICS OF THE READS");
+    Logger::gLogger->writeLog("Total number of reads: %llu",
+                              (unsigned long long)counts.records);
+    Logger::gLogger->writeLog("Total number of paired-end reads: %llu",
+                              (unsigned long long)counts.paired);
+    Logger::gLogger->writeLog("Total number of properly paired reads: %llu",
+                              (unsigned long long)counts.properPair);
+    Logger::gLogger->writeLog("Total number of unmapped reads: %llu",
+                              (unsigned long long)counts.unmapped);
+    Logger::gLogger->writeLog("Total number of reverse strand mapped reads: %llu",
+                              (unsigned long long)counts.reverse);
+    Logger::gLogger->writeLog("Total number of QC-failed reads: %llu",
+                              (unsigned long long)counts.qualCheckFail);
+    Logger::gLogger->writeLog("Total number of secondary reads: %llu",
+                              (unsigned long long)counts.secondary);
+    Logger::gLogger->writeLog("Total number of supplementary reads: %llu",
+                              (unsigned long long)counts.supplementary);
+    Logger::gLogger->writeLog("Size of singleKeyMap (must be zero): %llu",
+                              (unsigned long long)myFragmentMap.size());
+    Logger::gLogger->writeLog("Size of pairedKeyMap (must be zero): %llu",
+                              (unsigned long long)myPairedMap.size());
+    Logger::gLogger->writeLog("Total number of missing mates: %llu",
+                              (unsigned long long)myNumMissingMate);
+    Logger::gLogger->writeLog("Total number of reads excluded from duplicate checking: %llu",
+                              (unsigned long long)counts.excluded);
+    Logger::gLogger->writeLog("--------------------------------------------------------------------------");
+}
 
-    // Set where to stop cleaning out the structures.
-    // Initialize to the end of the structures.
-    FragmentMap::iterator fragmentFinish = myFragmentMap.end();
-    PairedMap::iterator pairedFinish = myPairedMap.end();
-    uint64_t mateStopPos = 0;
 
-    // If a record was specified, stop before this record.
-    if(record != NULL)
+int Dedup::executeByChrom(const String& inFile, const String& outFile,
+                          SamFileHeader& header, bool removeFlag,
+                          uint16_t excludeFlags, const String& tmpPrefix,
+                          bool index)
+{
+    // Make sure the index can be read before starting the threads.
+    SamFile indexCheck(ErrorHandler::RETURN);
+    if(!indexCheck.OpenForRead(inFile.c_str()) || !indexCheck.ReadBamIndex())
+    {
+        std::cerr << "ERROR: --byChrom requires an indexed BAM file, failed to read the index for "
+                  << inFile << std::endl;
+        return(EXIT_FAILURE);
+    }
+    indexCheck.Close();
+
+    // One section per reference followed by the unmapped reads, so the
+    // sections are in file order.
+    int numRefs = header.getReferenceInfo().getNumEntries();
+    std::vector<SectionResult*> results;
+    for(int i = 0; i <= numRefs; i++)
+    {
+        SectionResult* result = new SectionResult;
+        result->referenceID = (i < numRefs) ? i : -1;
+        result->partName = tmpPrefix.c_str();
+        result->partName += ".part" + std::to_string(i) + ".bgzf";
+        results.push_back(result);
+    }
+    int numWorkers = BamExecutable::getNumThreads();
+    if(numWorkers > (int)results.size())
     {
-        int32_t reference = record->getReferenceID();
-        int32_t coordinate = record->get0BasedPosition();
-        tempKey2.cleanupKey(reference, coordinate);
-        fragmentFinish = myFragmentMap.lower_bound(tempKey2);
-        // Now do the same thing with the paired reads
-        PairedKey pairedKey(emptyKey, tempKey2);
-        pairedFinish = myPairedMap.lower_bound(pairedKey);
-        mateStopPos =
-            SamHelper::combineChromPos(reference, 
-                                       coordinate);
+        numWorkers = results.size();
     }
+    Logger::gLogger->writeLog("Processing %d references on %d threads",
+                              numRefs, numWorkers);
 
-    // For each key k < fragmentFinish, release the record since we are
-    // done with that position and it is not a duplicate.
-    for(FragmentMap::iterator iter = myFragmentMap.begin(); 
-        iter != fragmentFinish; iter++)
+    std::atomic<unsigned int> nextSection(0);
+    try
     {
-        // If it is not paired, we are done with this record.
-        if(!iter->second.paired)
+        // Determine the duplicates within each reference.
+        runWorkers([&]()
+            {
+                Dedup worker;
+                worker.copySettings(*this);
+                SamFile samIn;
+                SamFileHeader sectionHeader;
+                samIn.OpenForRead(inFile.c_str(), &sectionHeader);
+                samIn.ReadBamIndex();
+                unsigned int section;
+                while((section = nextSection++) < results.size())
+                {
+                    worker.mySection = section;
+                    samIn.SetReadSection(results[section]->referenceID);
+                    worker.dedupSection(samIn, sectionHeader, excludeFlags,
+                                        *(results[section]));
+                }
+            }, numWorkers);
+
+        // Check the pairs whose mates are on different references.
+        checkCrossChromDups(results);
+
+        // Write each reference with the duplicates marked.
+        nextSection = 0;
+        runWorkers([&]()
+            {
+                SamFile samIn;
+                SamFileHeader sectionHeader;
+                samIn.OpenForRead(inFile.c_str(), &sectionHeader);
+                samIn.ReadBamIndex();
+                unsigned int section;
+                while((section = nextSection++) < results.size())
+                {
+                    samIn.SetReadSection(results[section]->referenceID);
+                    writeSection(samIn, sectionHeader, removeFlag,
+                                 *(results[section]));
+                }
+            }, numWorkers);
+    }
+    catch(std::exception& e)
+    {
+        for(unsigned int i = 0; i < results.size(); i++)
         {
-            // Unpaired, non-duplicate, so perform any additional handling.
-            handleNonDuplicate(iter->second.recordPtr);
+            remove(results[i]->partName.c_str());
+            delete results[i];
         }
+        throw;
     }
-    // Erase the entries from the map.
-    if(fragmentFinish != myFragmentMap.begin())
+
+    // Combine the results.
+    ReadCounts counts;
+    uint64_t singleDuplicates = 0;
+    uint64_t pairedDuplicates = 0;
+    for(unsigned int i = 0; i < results.size(); i++)
     {
-        myFragmentMap.erase(myFragmentMap.begin(), fragmentFinish);
+        counts += results[i]->counts;
+        myNumMissingMate += results[i]->numMissingMate;
+        singleDuplicates += results[i]->singleDuplicates;
+        pairedDuplicates += results[i]->pairedDuplicates;
     }
+    logReadCounts(counts);
 
-    // Now do the same thing with the paired reads
-    for(PairedMap::iterator iter = myPairedMap.begin(); 
-        iter != pairedFinish; iter++)
+    // Concatenate the sections in order.
+    Logger::gLogger->writeLog("\nWriting %s", outFile.c_str());
+    ThreadedSamFile samOut;
+    samOut.OpenForWrite(outFile.c_str());
+    samOut.WriteHeader(header);
+    bool appended = true;
+    for(unsigned int i = 0; i < results.size(); i++)
     {
-        PairedData* pairedData = &(iter->second);
-        // These are not duplicates, but we are done with them, 
-        // so perform any additional handling.
-        handleNonDuplicate(pairedData->record1Ptr);
-        handleNonDuplicate(pairedData->record2Ptr);
+        appended = appended && samOut.appendBamRecords(results[i]->partName.c_str());
+        remove(results[i]->partName.c_str());
+        delete results[i];
     }
-    // Erase the entries.
-    if (pairedFinish != myPairedMap.begin())
+    results.clear();
+    samOut.Close();
+    if(!appended)
     {
-        myPairedMap.erase(myPairedMap.begin(), pairedFinish);
+        Logger::gLogger->error("Failed to write %s", outFile.c_str());
+    }
+    if(index && (outFile != "-.bam"))
+    {
+        // The appended sections are not seen by the writer, so index the
+        // output by reading it back on the thread pool.
+        BamIndexBuilder builder;
+        bool csi = BamIndexBuilder::needsCsi(header);
+        std::string indexFile = BamIndexBuilder::getDefaultName(outFile.c_str(), csi);
+        if(!builder.build(outFile.c_str(), indexFile.c_str(), csi))
+        {
+            Logger::gLogger->error("Failed to index %s", outFile.c_str());
+        }
     }
 
-    // Clean up the Mate map from any reads whose mates were not found.
-    // Loop through the mate map and release records prior to this position.
-    MateMap::iterator mateIter;
-    for(mateIter = myMateMap.begin(); mateIter != myMateMap.end(); mateIter++)
+    Logger::gLogger->writeLog("Successfully %s %llu unpaired and %llu paired duplicate reads", 
+                              removeFlag ? "removed" : "marked" ,
+                              (unsigned long long)singleDuplicates,
+                              (unsigned long long)pairedDuplicates/2);
+    Logger::gLogger->writeLog("\nDedup complete!");
+    return 0;
+}
+
+
+void Dedup::copySettings(const Dedup& dedup)
+{
+    rgidLibMap = dedup.rgidLibMap;
+    myReadGroups = dedup.myReadGroups;
+    myRgLibraries = dedup.myRgLibraries;
+    numLibraries = dedup.numLibraries;
+    myOneChrom = dedup.myOneChrom;
+    myForceFlag = dedup.myForceFlag;
+    myMinQual = dedup.myMinQual;
+}
+
+
+void Dedup::dedupSection(SamFile& samIn, SamFileHeader& header,
+                         uint16_t excludeFlags, SectionResult& result)
+{
+    lastReference = -1;
+    lastCoordinate = -1;
+    myNumMissingMate = 0;
+    myDupList.clear();
+    myCrossChromReads = &(result.crossChromReads);
+
+    uint64_t recordCount = 0;
+    SamRecord* recordPtr;
+    while(true)
     {
-        // stop if a record was specified and we have gone past the mate
-        // stop position.  If no record was specified, we want to clean
-        // it all out.
-        if((record != NULL) && (mateIter->first >= mateStopPos))
+        recordPtr = mySamPool.getRecord();
+        if(recordPtr == NULL)
         {
+            throw(std::runtime_error("Failed to allocate enough records"));
+        }
+        Profile::setMaxValue("Dedup::recordsInUse", mySamPool.getNumInUse());
+        if(!samIn.ReadRecord(header, *recordPtr))
+        {
+            mySamPool.releaseRecord(recordPtr);
             break;
         }
-        // Passed the mate, but it was not found.
-        handleMissingMate(mateIter->second.recordPtr);
+        int flag = recordPtr->getFlag();
+        result.counts.addRecord(flag);
+        ++recordCount;
+
+        // if we have moved to a new position, look back at previous reads for duplicates
+        if (hasPositionChanged(*recordPtr))
+        {
+            cleanupPriorReads(recordPtr);
+        }
+
+        // Determine if this read should be checked for duplicates.
+        if((!SamFlag::isMapped(flag)) || ((flag & excludeFlags) != 0))
+        {
+            ++result.counts.excluded;
+            mySamPool.releaseRecord(recordPtr);
+        }
+        else
+        {
+            if(SamFlag::isDuplicate(flag) && !myForceFlag)
+            {
+                // Error: Marked duplicates, and duplicates aren't excluded.
+                Logger::gLogger->error("There are records already duplicate marked.");
+                Logger::gLogger->error("Use -f to clear the duplicate flag and start the deduping procedure over");
+            }
+
+            checkDups(*recordPtr, recordCount);
+        }
+    }
+    cleanupPriorReads(NULL);
+
+    myCrossChromReads = NULL;
+    result.numMissingMate = myNumMissingMate;
+    result.dups.swap(myDupList);
+}
+
+
+void Dedup::writeSection(SamFile& samIn, SamFileHeader& header,
+                         bool removeFlag, SectionResult& result)
+{
+    ParallelBgzfWriter samOut;
+    if(!samOut.open(result.partName.c_str()))
+    {
+        throw(std::runtime_error("Failed to open " + result.partName +
+                                 " for writing"));
+    }
+
+    uint64_t currentIndex = 0;
+    bool written = true;
+    SamRecord record;
+    while(samIn.ReadRecord(header, record))
+    {
+        ++currentIndex;
+        int flag = record.getFlag();
+        if(result.dups.test(currentIndex))
+        {
+            // this record is a duplicate, so mark it.
+            record.setFlag( flag | 0x400 );
+            if ( ( ( flag & 0x0001 ) == 0 ) || ( flag & 0x0008 ) )
+            { // unpaired or mate unmapped
+                result.singleDuplicates++;
+            }
+            else
+            {
+                result.pairedDuplicates++;
+            }
+            if(removeFlag)
+            {
+                continue;
+            }
+        }
+        else if(myForceFlag)
+        { 
+            // this is not a duplicate we've identified but we want to
+            // remove any duplicate marking
+            record.setFlag( flag & 0xfffffbff ); // unmark duplicate
+        }
+        // Write the record buffer, which starts with the block size.
+        const char* buffer = (const char*)record.getRecordBuffer(SamRecord::NONE);
+        if(buffer == NULL)
+        {
+            throw(std::runtime_error("Failed to get the BAM record buffer"));
+        }
+        int32_t blockSize = 0;
+        memcpy(&blockSize, buffer, sizeof(blockSize));
+        written = written && samOut.write(buffer, blockSize + sizeof(blockSize));
     }
-    // Erase the entries.
-    if(mateIter != myMateMap.begin())
+    if(!samOut.close() || !written)
+    {
+        throw(std::runtime_error("Failed to write " + result.partName));
+    }
+}
+
+
+void Dedup::checkCrossChromDups(std::vector<SectionResult*>& results)
+{
+    // Process the reads in file order as if they were read from the file.
+    std::vector<CrossChromRead> reads;
+    for(unsigned int i = 0; i < results.size(); i++)
     {
-        myMateMap.erase(myMateMap.begin(), mateIter);
+        reads.insert(reads.end(), results[i]->crossChromReads.begin(),
+                     results[i]->crossChromReads.end());
+        std::vector<CrossChromRead>().swap(results[i]->crossChromReads);
     }
+    std::sort(reads.begin(), reads.end(), 
+              [](const CrossChromRead& lhs, const CrossChromRead& rhs)
+              { return(lhs.fileOrder < rhs.fileOrder); });
+
+    // Reads waiting for their mates, by mate position.
+    std::multimap<uint64_t, size_t> mateMap;
+    typedef std::map<PairedKey, CrossChromPair, PairedKeyComparator> CrossChromPairMap;
+    CrossChromPairMap pairedMap;
+    DupKey emptyKey;
+    DupKey cleanupKey;
+    for(size_t i = 0; i < reads.size(); i++)
+    {
+        CrossChromRead& read = reads[i];
+
+        // Cleanup as would have been done when reaching this position.
+        cleanupKey.cleanupKey(read.referenceID, read.position);
+        pairedMap.erase(pairedMap.begin(), 
+                        pairedMap.lower_bound(PairedKey(emptyKey, cleanupKey)));
+        std::multimap<uint64_t, size_t>::iterator mateStop = 
+            mateMap.lower_bound(SamHelper::combineChromPos(read.referenceID,
+                                                           read.position));
+        for(std::multimap<uint64_t, size_t>::iterator iter = mateMap.begin();
+            iter != mateStop; iter++)
+        {
+            // Passed the mate, but it was not found.
+            warnMissingMate(true);
+            ++myNumMissingMate;
+        }
+        mateMap.erase(mateMap.begin(), mateStop);
+
+        // Look for the mate the same way checkDups does.
+        int sumBaseQual = read.sumBaseQual;
+        bool foundMate = false;
+        size_t mateRead = 0;
+        if(read.matePos <= read.readPos)
+        {
+            std::pair<std::multimap<uint64_t, size_t>::iterator,
+                std::multimap<uint64_t, size_t>::iterator> matches =
+                mateMap.equal_range(read.readPos);
+            for(std::multimap<uint64_t, size_t>::iterator iter = matches.first; 
+                iter != matches.second; iter++)
+            {
+                if(reads[iter->second].readName == read.readName)
+                {
+                    foundMate = true;
+                    mateRead = iter->second;
+                    sumBaseQual += reads[mateRead].sumBaseQual;
+                    mateMap.erase(iter);
+                    break;
+                }
+            }
+        }
+        if(!foundMate)
+        {
+            if(read.matePos >= read.readPos)
+            {
+                // Haven't gotten to the mate yet, so store this read.
+                mateMap.insert(std::make_pair(read.matePos, i));
+            }
+            else
+            {
+                // Passed the mate, but it was not found.
+                warnMissingMate(true);
+                ++myNumMissingMate;
+            }
+            continue;
+        }
+
+        CrossChromRead& mate = reads[mateRead];
+        uint64_t record1Order = getFirstIndex(read.key, read.fileOrder,
+                                              mate.key, mate.fileOrder);
+        std::pair<CrossChromPairMap::iterator, bool> pairedReturn =
+            pairedMap.insert(std::make_pair(PairedKey(read.key, mate.key),
+                                            CrossChromPair()));
+        CrossChromPair& storedPair = pairedReturn.first->second;
+        if(pairedReturn.second == false)
+        {
+            // Duplicate found, keep the higher quality pair, or the one
+            // with the earlier record1 if they are the same.
+            bool keepStored = true;
+            if((storedPair.sumBaseQual < sumBaseQual) ||
+               ((storedPair.sumBaseQual == sumBaseQual) &&
+                (record1Order < storedPair.record1Order)))
+            {
+                keepStored = false;
+            }
+            if(keepStored)
+            {
+                results[mate.section]->dups.set(mate.index);
+                results[read.section]->dups.set(read.index);
+                continue;
+            }
+            CrossChromRead& stored1 = reads[storedPair.read1];
+            CrossChromRead& stored2 = reads[storedPair.read2];
+            results[stored1.section]->dups.set(stored1.index);
+            results[stored2.section]->dups.set(stored2.index);
+        }
+        storedPair.sumBaseQual = sumBaseQual;
+        storedPair.record1Order = record1Order;
+        storedPair.read1 = mateRead;
+        storedPair.read2 = i;
+    }
+    // Any reads left did not find their mates.
+    for(size_t i = 0; i < mateMap.size(); i++)
+    {
+        warnMissingMate(true);
+        ++myNumMissingMate;
+    }
+}
+
+
+// Now that we've reached coordinate on chromosome reference, look back and
+// clean up any previous positions from being tracked.
+void Dedup::cleanupPriorReads(SamRecord* record)
+{
+    static Profile::Stage& stage = Profile::getStage("Dedup::cleanupPriorReads");
+    Profile::Timer timer(stage);
+    DupKey emptyKey;
+    DupKey tempKey2;
+
+    // For each fragment key that is cleaned up, release the record since
+    // we are done with that position and it is not a duplicate.
+    auto fragmentDone = [this](const DupKey&, ReadData& readData)
+        {
+            // If it is not paired, we are done with this record.
+            if(!readData.paired)
+            {
+                // Unpaired, non-duplicate, so perform any additional handling.
+                handleNonDuplicate(readData.recordIndex, readData.recordPtr);
+            }
+        };
+    // Now do the same thing with the paired reads
+    auto pairedDone = [this](const PairedKey&, PairedData& pairedData)
+        {
+            // These are not duplicates, but we are done with them, 
+            // so perform any additional handling.
+            handleNonDuplicate(pairedData.record1Index, pairedData.record1Ptr);
+            handleNonDuplicate(pairedData.record2Index, pairedData.record2Ptr);
+        };
+    // Clean up the Mate map from any reads whose mates were not found.
+    auto mateDone = [this](uint64_t, ReadData& mateData)
+        {
+            // Passed the mate, but it was not found.
+            handleMissingMate(mateData.recordIndex, mateData.recordPtr);
+        };
+
+    // If a record was specified, stop before this record, otherwise
+    // clean it all out.
+    if(record == NULL)
+    {
+        myFragmentMap.removeAll(fragmentDone);
+        myPairedMap.removeAll(pairedDone);
+        myMateMap.removeAll(mateDone);
+        return;
+    }
+
+    // Drop every window before the cleanup key and the entries in its
+    // window that are less than it.
+    int32_t reference = record->getReferenceID();
+    int32_t coordinate = record->get0BasedPosition();
+    tempKey2.cleanupKey(reference, coordinate);
+    myFragmentMap.removeBefore(tempKey2.getWindowId(), tempKey2, fragmentDone);
+
+    // The paired map is windowed by key2.
+    PairedKey pairedKey(emptyKey, tempKey2);
+    myPairedMap.removeBefore(pairedKey.key2.getWindowId(), pairedKey,
+                             pairedDone);
+
+    // Release mates prior to this position.
+    uint64_t mateStopPos =
+        SamHelper::combineChromPos(reference, coordinate);
+    myMateMap.removeBefore(mateStopPos, mateDone);
     return;
 }
 
@@ -566,13 +1111,15 @@ bool Dedup::hasPositionChanged(SamRecord& record)
 
 // When a record is read, check if it is a duplicate or
 // store for future checking.
-void Dedup::checkDups(SamRecord& record, uint32_t recordCount)
+void Dedup::checkDups(SamRecord& record, uint64_t recordCount)
 {
+    static Profile::Stage& stage = Profile::getStage("Dedup::checkDups");
+    Profile::Timer timer(stage);
     // Only inside this method if the record is mapped.
 
     // Get the key for this record.
-    static DupKey key;
-    static DupKey mateKey;
+    DupKey key;
+    DupKey mateKey;
     key.updateKey(record, getLibraryID(record));
 
     int flag = record.getFlag(); 
@@ -591,9 +1138,9 @@ void Dedup::checkDups(SamRecord& record, uint32_t recordCount)
     
     // Look in the map to see if an entry for this key exists.
     FragmentMapInsertReturn ireturn = 
-        myFragmentMap.insert(std::make_pair(key, ReadData()));
+        myFragmentMap.insert(key.getWindowId(), key);
 
-    ReadData* readData = &(ireturn.first->second);
+    ReadData* readData = ireturn.first;
 
     // Mark this record's data in the fragment record if this is the first
     // entry or if it is a duplicate and the old record is not paired and 
@@ -647,8 +1194,28 @@ void Dedup::checkDups(SamRecord& record, uint32_t recordCount)
     uint64_t matePos =
         SamHelper::combineChromPos(mateChromID, 
                                    record.get0BasedMatePosition());
+
+    if((myCrossChromReads != NULL) && (chromID != mateChromID))
+    {
+        // Processing one reference at a time, so save the information
+        // needed to check this pair once all references are done.
+        myCrossChromReads->push_back(CrossChromRead());
+        CrossChromRead& crossChromRead = myCrossChromReads->back();
+        crossChromRead.section = mySection;
+        crossChromRead.index = recordCount;
+        crossChromRead.fileOrder = ((uint64_t)mySection << 40) | recordCount;
+        crossChromRead.referenceID = chromID;
+        crossChromRead.position = record.get0BasedPosition();
+        crossChromRead.readPos = readPos;
+        crossChromRead.matePos = matePos;
+        crossChromRead.sumBaseQual = sumBaseQual;
+        crossChromRead.key = key;
+        crossChromRead.readName = record.getReadName();
+        mySamPool.releaseRecord(&record);
+        return;
+    }
     SamRecord* mateRecord = NULL;
-    int mateIndex = 0;
+    uint64_t mateIndex = 0;
     
     // Check to see if the mate is prior to this record.
     if(matePos <= readPos)
@@ -656,35 +1223,30 @@ void Dedup::checkDups(SamRecord& record, uint32_t recordCount)
         // The mate map is stored by the mate position, so look for this 
         // record's position.
         // The mate should be in the mate map, so find it.
-        std::pair<MateMap::iterator,MateMap::iterator> matches =
-            myMateMap.equal_range(readPos);
-        // Loop through the elements that matched the pos looking for the mate.
-        for(MateMap::iterator iter = matches.first; 
-            iter != matches.second; iter++)
-        {
-            if(strcmp((*iter).second.recordPtr->getReadName(), 
-                      record.getReadName()) == 0)
+        // Find the first entry at this position with a matching read name.
+        const char* readName = record.getReadName();
+        auto isMate = [readName](const ReadData& mateData)
             {
-                // Found the match.
-                ReadData* mateData = &((*iter).second);
-                // Update the quality and track the mate record and index.
-                sumBaseQual += mateData->sumBaseQual;
-                mateIndex = mateData->recordIndex;
-                mateRecord = mateData->recordPtr;
-                // Remove the entry from the map.
-                myMateMap.erase(iter);
-                break;
-            }
+                return(strcmp(mateData.recordPtr->getReadName(), 
+                              readName) == 0);
+            };
+        ReadData mateData;
+        if(myMateMap.extract(readPos, isMate, mateData))
+        {
+            // Found the match.
+            // Update the quality and track the mate record and index.
+            sumBaseQual += mateData.sumBaseQual;
+            mateIndex = mateData.recordIndex;
+            mateRecord = mateData.recordPtr;
         }
     }
     if((mateRecord == NULL) && (matePos >= readPos))
     {
         // Haven't gotten to the mate yet, so store this record.
-        MateMap::iterator mateIter = 
-            myMateMap.insert(std::make_pair(matePos, ReadData()));
-        mateIter->second.sumBaseQual = sumBaseQual;
-        mateIter->second.recordPtr = &record;
-        mateIter->second.recordIndex = recordCount;
+        ReadData* mateData = myMateMap.insert(matePos);
+        mateData->sumBaseQual = sumBaseQual;
+        mateData->recordPtr = &record;
+        mateData->recordIndex = recordCount;
         // No more processing for this record is necessary.
         return;
     }
@@ -692,7 +1254,7 @@ void Dedup::checkDups(SamRecord& record, uint32_t recordCount)
     if(mateRecord == NULL)
     {
         // Passed the mate, but it was not found.
-        handleMissingMate(&record);
+        handleMissingMate(recordCount, &record);
         return;
     }
 
@@ -702,11 +1264,11 @@ void Dedup::checkDups(SamRecord& record, uint32_t recordCount)
 
     // Check to see if this pair is a duplicate.
     PairedMapInsertReturn pairedReturn = 
-        myPairedMap.insert(std::make_pair(pkey,PairedData()));
-    PairedData* storedPair = &(pairedReturn.first->second);
+        myPairedMap.insert(pkey.key2.getWindowId(), pkey);
+    PairedData* storedPair = pairedReturn.first;
 
     // Get the index for "record 1" - the one with the earlier coordinate.
-    int record1Index = getFirstIndex(key, recordCount,
+    uint64_t record1Index = getFirstIndex(key, recordCount,
                                           mateKey, mateIndex);
 
     // Check if we have already found a duplicate pair.
@@ -715,12 +1277,12 @@ void Dedup::checkDups(SamRecord& record, uint32_t recordCount)
     {
         // Duplicate found.
         bool keepStored = true;
-        if(pairedReturn.first->second.sumBaseQual < sumBaseQual)
+        if(storedPair->sumBaseQual < sumBaseQual)
         {
             // The new pair has higher quality, so keep that.
             keepStored = false;
         }
-        else if(pairedReturn.first->second.sumBaseQual == sumBaseQual)
+        else if(storedPair->sumBaseQual == sumBaseQual)
         {
             // Same quality, so keep the one with the earlier record1Index.
             if(record1Index < storedPair->record1Index)
@@ -796,18 +1358,7 @@ void Dedup::checkDups(SamRecord& record, uint32_t recordCount)
 
 // Finds the total base quality of a read 
 int Dedup::getBaseQuality(SamRecord & record) {
-    const char* baseQualities = record.getQuality();
-    int readLength = record.getReadLength();
-    int quality = 0.;
-    if(strcmp(baseQualities, "*") == 0)
-    {
-        return(0);
-    }
-    for(int i=0; i < readLength; ++i) {
-        int q = static_cast<int>(baseQualities[i])-33;
-        if ( q >= myMinQual ) quality += q;
-    }
-    return quality;
+    return(sumRecordQualities(record, myMinQual));
 }
 
 
@@ -853,6 +1404,13 @@ void Dedup::buildReadGroupLibraryMap(SamFileHeader& header) {
     if (numLibraries > 0xff) {
         Logger::gLogger->error("More than 255 library names are identified. Dedup currently only allows up to 255 library names");
     }
+
+    // Library of each read group in the dictionary used to look them up.
+    myReadGroups.init(header);
+    myRgLibraries.assign(myReadGroups.size(), 0);
+    for(uint32_t i = 0; i < myReadGroups.size(); i++) {
+        myRgLibraries[i] = rgidLibMap[myReadGroups.getName(i)];
+    }
 }    
 
 // get the libraryID of a record
@@ -860,6 +1418,15 @@ uint32_t Dedup::getLibraryID(SamRecord& record, bool checkTags) {
     if ( ( checkTags == false ) && ( numLibraries <= 1 ) ) {
         return 0; 
     } else {
+        // Look up the read group without copying it.  Anything unexpected
+        // is reported by checking all of the tags below.
+        const String* rgPtr = record.getStringTag("RG");
+        if ( rgPtr != NULL ) {
+            int32_t index = myReadGroups.find(rgPtr->c_str(), rgPtr->Length());
+            if ( index >= 0 ) {
+                return myRgLibraries[index];
+            }
+        }
         char tag[3];
         char vtype;
         void* value;
@@ -897,7 +1464,7 @@ uint32_t Dedup::getLibraryID(SamRecord& record, bool checkTags) {
 }
 
 
-void Dedup::handleNonDuplicate(SamRecord* recordPtr)
+void Dedup::handleNonDuplicate(uint64_t index, SamRecord* recordPtr)
 {
     if(recordPtr == NULL)
     {
@@ -920,48 +1487,60 @@ void Dedup::handleNonDuplicate(SamRecord* recordPtr)
         myRecab.processReadBuildTable(*recordPtr);
     }
 
+    if(myOnePass)
+    {
+        // The reorder buffer releases the record once it is written.
+        myReorderBuffer.setDuplicate(index, recordPtr, false);
+        return;
+    }
     // Release the record.
     mySamPool.releaseRecord(recordPtr);
 }
 
 
-void Dedup::handleMissingMate(SamRecord* recordPtr)
+void Dedup::handleMissingMate(uint64_t index, SamRecord* recordPtr)
 {
-    static bool firstDifferChrom = true;
-    static bool firstSameChrom = true;
-
     if(recordPtr == NULL)
     {
         return;
     }
 
     // Passed the mate, but it was not found.
-    if(recordPtr->getMateReferenceID() != recordPtr->getReferenceID())
+    warnMissingMate(recordPtr->getMateReferenceID() !=
+                    recordPtr->getReferenceID());
+
+    // Don't consider this record to be a duplicate.
+    // Release this record since there is nothing more to do with it.
+    ++myNumMissingMate;
+    handleNonDuplicate(index, recordPtr);
+}
+
+
+void Dedup::warnMissingMate(bool differentChrom)
+{
+    // Shared by all threads when processing by reference.
+    static std::atomic<bool> firstDifferChrom(true);
+    static std::atomic<bool> firstSameChrom(true);
+
+    if(differentChrom)
     {
-        if(firstDifferChrom)
+        if(firstDifferChrom.exchange(false))
         {
             std::cerr << "Mate on different chromosome was not found.\n"
                       << "If you are running single chromosome, consider "
                       << "using --oneChrom to treat reads with mates on "
                       << "different chromosomes as single-ended.\n";
-            firstDifferChrom = false;
         }
     }
-    else if(firstSameChrom)
+    else if(firstSameChrom.exchange(false))
     {
         std::cerr << "WARNING: Records with missing mate can't be checked for "
                   << "duplicates.\n";
-        firstSameChrom = false;
     }
-
-    // Don't consider this record to be a duplicate.
-    // Release this record since there is nothing more to do with it.
-    ++myNumMissingMate;
-    handleNonDuplicate(recordPtr);
 }
 
 
-void Dedup::handleDuplicate(uint32_t index, SamRecord* recordPtr)
+void Dedup::handleDuplicate(uint64_t index, SamRecord* recordPtr)
 {
     if(recordPtr == NULL)
     {
@@ -978,8 +1557,15 @@ void Dedup::handleDuplicate(uint32_t index, SamRecord* recordPtr)
         myRecab.processReadBuildTable(*recordPtr);
     }
 
+    if(myOnePass)
+    {
+        // The reorder buffer releases the record once it is written.
+        myReorderBuffer.setDuplicate(index, recordPtr, true);
+        return;
+    }
+
     // Add the index to the duplicate list.
-    myDupList.push_back(index);
+    myDupList.set(index);
     // Release the record.
     mySamPool.releaseRecord(recordPtr);
 }
@@ -22,9 +22,13 @@
 #include <vector>
 #include <set>
 #include <map>
-#include "SamRecordPool.h"
+#include "SamRecordArena.h"
 #include "Recab.h"
 #include "SamFlag.h"
+#include "DedupReorderBuffer.h"
+#include "FlatWindowMap.h"
+#include "DupBitmap.h"
+#include "ReadGroupDict.h"
 
 /*---------------------------------------------------------------/
   /
@@ -41,14 +45,19 @@ public:
     virtual const char* getProgramName() {return("bam:dedup");}
 
     Dedup():
+        myMateMap(WINDOW_SHIFT),
         myRecab(),
         myDoRecab(false),
         myOneChrom(false),
         mySamPool(),
+        myOnePass(false),
+        myReorderBuffer(mySamPool),
         lastCoordinate(-1), lastReference(-1), numLibraries(0), 
         myNumMissingMate(0),
         myForceFlag(false),
-        myMinQual(15)
+        myMinQual(15),
+        myCrossChromReads(NULL),
+        mySection(0)
     {}
 
     ~Dedup();
@@ -58,7 +67,7 @@ private:
     {
         int sumBaseQual;
         SamRecord* recordPtr;
-        int recordIndex;
+        uint64_t recordIndex;
         bool paired;
         ReadData()
             : sumBaseQual(0), recordPtr(NULL), recordIndex(0), paired(false) {}
@@ -68,82 +77,91 @@ private:
         int sumBaseQual;
         SamRecord* record1Ptr;
         SamRecord* record2Ptr;
-        int record1Index;
-        int record2Index;
+        uint64_t record1Index;
+        uint64_t record2Index;
         PairedData()
             : sumBaseQual(0), record1Ptr(NULL), record2Ptr(NULL),
               record1Index(0), record2Index(0) {}
     };
 
 
+    // The key fields are packed into one integer that orders the same as
+    // comparing them in turn: reference (23 bits), coordinate + 2^31 
+    // (32 bits), orientation (1 bit), and library id (8 bits).
     struct DupKey
     {
-        int32_t reference;
-        int32_t coordinate;
-        bool orientation;
-        uint32_t libraryID;
+        uint64_t packed;
         DupKey()
-            : reference(0), coordinate(0), orientation(false), libraryID(0) {}
+            : packed(pack(0, 0, false, 0)) {}
         DupKey(int32_t ref, int32_t coord, bool orient, uint32_t lib)
-            : reference(ref), coordinate(coord), orientation(orient), libraryID(lib) {}
+            : packed(pack(ref, coord, orient, lib)) {}
+        static inline uint64_t pack(int32_t ref, int32_t coord, 
+                                    bool orient, uint32_t lib)
+        {
+            return(((uint64_t)(uint32_t)ref << COORD_END_BIT) |
+                   ((uint64_t)((uint32_t)coord ^ 0x80000000) << ORIENT_BIT) |
+                   ((uint64_t)orient << ORIENT_SHIFT) | (lib & 0xFF));
+        }
         inline void updateKey(SamRecord& record, uint32_t libID)
         {
-            reference = record.getReferenceID();
-            coordinate = record.get0BasedUnclippedStart();
-            orientation = SamFlag::isReverse(record.getFlag());
-            if(orientation)
-            {
+            bool orientation = SamFlag::isReverse(record.getFlag());
+            int32_t coordinate = orientation ?
                 // Reverse, so get the unclipped end.
-                coordinate = record.get0BasedUnclippedEnd();
-            }
-            libraryID = libID;
+                record.get0BasedUnclippedEnd() : 
+                record.get0BasedUnclippedStart();
+            packed = pack(record.getReferenceID(), coordinate, 
+                          orientation, libID);
         }
         inline void cleanupKey(int32_t referenceID, int32_t coord)
         {
-            reference = referenceID;
-            coordinate = coord - CLIP_OFFSET;
-            orientation = false;
-            libraryID = 0;
+            packed = pack(referenceID, coord - CLIP_OFFSET, false, 0);
+        }
+        inline int32_t getReference() const
+        {
+            return((int32_t)(packed >> COORD_END_BIT));
+        }
+        inline int32_t getCoordinate() const
+        {
+            return((int32_t)((uint32_t)(packed >> ORIENT_BIT) ^ 0x80000000));
         }
         inline bool operator <(const DupKey& key) const
         {
-            if(reference == key.reference)
-            {
-                // same reference, so check the coordinate.
-                if(coordinate == key.coordinate)
-                {
-                    // Same coordinate, so check orientation.
-                    if(orientation == key.orientation)
-                    {
-                        // Same orientation, so check library id.
-                        return(libraryID < key.libraryID);
-                    }
-                    // Different orientations, so this is less than the
-                    // other if this orientation is false.
-                    return(!orientation);
-                }
-                // Same Ref, & different coordinates, so just check that.
-                return(coordinate < key.coordinate);
-            }
-            // Different references, so less than is determined by 
-            // checking the reference only.
-            return(reference < key.reference);
+            return(packed < key.packed);
         }
-        inline DupKey&  operator = (const DupKey& key)
+        inline bool operator ==(const DupKey& key) const
         {
-            reference = key.reference;
-            coordinate = key.coordinate;
-            orientation = key.orientation;
-            libraryID = key.libraryID;
-            return(*this);
+            return(packed == key.packed);
         }
+        inline uint64_t getWindowId() const
+        {
+            // Same as ::getWindowId(reference, coordinate, WINDOW_SHIFT).
+            return((packed >> ORIENT_BIT) >> WINDOW_SHIFT);
+        }
+        // Bit positions of the fields.
+        static const int ORIENT_SHIFT = 8;
+        static const int ORIENT_BIT = 9;
+        static const int COORD_END_BIT = 41;
     };
-    
+
+    struct DupKeyHash {
+        inline size_t operator() (const DupKey& key) const {
+            uint64_t hash = key.packed * 0x9E3779B97F4A7C15ULL;
+            return((size_t)(hash ^ (hash >> 32)));
+        }
+    };
+    struct DupKeyEqual {
+        inline bool operator() (const DupKey& lhs, const DupKey& rhs) const {
+            return(lhs == rhs);
+        }
+    };
+
     // Each read is assigned a key based on its referenceID, coordinate, orientation, and libraryID
     // This structure stores the two keys in a paired end read.
     struct PairedKey {
         DupKey key1;
         DupKey key2;
+        PairedKey()
+            : key1(), key2() {}
         PairedKey(DupKey k1, DupKey k2)
         {
             if(k2 < k1)
@@ -160,38 +178,149 @@ private:
     };
 
 
-    // Paired key comparison operator used for sorting paired end reads.
+    // Paired key comparison operator used for sorting paired end reads,
+    // compares the keys as a 128 bit value of key2 then key1.
     struct PairedKeyComparator {
         inline bool operator() (const PairedKey& lhs, const PairedKey& rhs) const {
-            if (lhs.key2 < rhs.key2) return true;
-            if (rhs.key2 < lhs.key2) return false;
-            return lhs.key1 < rhs.key1;
+            return((lhs.key2.packed < rhs.key2.packed) ||
+                   ((lhs.key2.packed == rhs.key2.packed) &&
+                    (lhs.key1.packed < rhs.key1.packed)));
+        }
+    };
+    struct PairedKeyHash {
+        inline size_t operator() (const PairedKey& key) const {
+            uint64_t hash = (key.key1.packed ^ (key.key2.packed * 31)) * 
+                0x9E3779B97F4A7C15ULL;
+            return((size_t)(hash ^ (hash >> 32)));
+        }
+    };
+    struct PairedKeyEqual {
+        inline bool operator() (const PairedKey& lhs, const PairedKey& rhs) const {
+            return((lhs.key1.packed == rhs.key1.packed) && 
+                   (lhs.key2.packed == rhs.key2.packed));
+        }
+    };
+
+    // Counts of the types of records that were read.
+    struct ReadCounts
+    {
+        uint64_t records;
+        uint64_t paired;
+        uint64_t properPair;
+        uint64_t unmapped;
+        uint64_t reverse;
+        uint64_t qualCheckFail;
+        uint64_t secondary;
+        uint64_t supplementary;
+        uint64_t excluded;
+        ReadCounts()
+            : records(0), paired(0), properPair(0), unmapped(0), reverse(0),
+              qualCheckFail(0), secondary(0), supplementary(0), excluded(0) {}
+        inline void addRecord(int flag)
+        {
+            ++records;
+            if(SamFlag::isPaired(flag))     ++paired;
+            if(SamFlag::isProperPair(flag)) ++properPair;
+            if(SamFlag::isReverse(flag))    ++reverse;
+            if(SamFlag::isQCFailure(flag))  ++qualCheckFail;
+            if(SamFlag::isSecondary(flag))  ++secondary;
+            if(flag & SamFlag::SUPPLEMENTARY_ALIGNMENT)  ++supplementary;
+            if(!SamFlag::isMapped(flag))    ++unmapped;
         }
+        inline ReadCounts& operator +=(const ReadCounts& counts)
+        {
+            records += counts.records;
+            paired += counts.paired;
+            properPair += counts.properPair;
+            unmapped += counts.unmapped;
+            reverse += counts.reverse;
+            qualCheckFail += counts.qualCheckFail;
+            secondary += counts.secondary;
+            supplementary += counts.supplementary;
+            excluded += counts.excluded;
+            return(*this);
+        }
+    };
+
+    // When processing by reference, records whose mate is on a different
+    // reference are saved so they can be paired after all references have
+    // been processed.
+    struct CrossChromRead
+    {
+        // Index of the section (reference) and of the record in the section.
+        uint32_t section;
+        uint64_t index;
+        // Section and index combined, ordered the same as the file.
+        uint64_t fileOrder;
+        int32_t referenceID;
+        int32_t position;
+        uint64_t readPos;
+        uint64_t matePos;
+        int sumBaseQual;
+        DupKey key;
+        std::string readName;
+    };
+
+    // A pair of CrossChromReads (by index in the list of reads).
+    struct CrossChromPair
+    {
+        int sumBaseQual;
+        uint64_t record1Order;
+        size_t read1;
+        size_t read2;
+        CrossChromPair()
+            : sumBaseQual(0), record1Order(0), read1(0), read2(0) {}
+    };
+
+    // The results of processing one reference (or the unmapped reads)
+    // from an indexed file.
+    struct SectionResult
+    {
+        int32_t referenceID;
+        DupBitmap dups;
+        std::vector<CrossChromRead> crossChromReads;
+        ReadCounts counts;
+        uint64_t numMissingMate;
+        uint64_t singleDuplicates;
+        uint64_t pairedDuplicates;
+        std::string partName;
+        SectionResult()
+            : referenceID(-1), dups(), crossChromReads(), counts(),
+              numMissingMate(0), singleDuplicates(0), pairedDuplicates(0),
+              partName() {}
     };
 
     // A map from read group IDs to its libraryID
     typedef std::map< std::string, uint32_t, std::less<std::string> > StringToInt32Map;
     StringToInt32Map rgidLibMap;
+    // Read group IDs (from the header) & the libraryID of each.
+    ReadGroupDict myReadGroups;
+    std::vector<uint32_t> myRgLibraries;
+
+    // The maps are split into windows of 2^WINDOW_SHIFT positions so
+    // cleanup can drop whole windows at a time.
+    static const int WINDOW_SHIFT = 6;
 
-    // A map from the key of a single read to its read data
-    typedef std::map< DupKey, ReadData > FragmentMap;
-    typedef std::pair<FragmentMap::iterator,bool> FragmentMapInsertReturn;
+    // A map from the key of a single read to its read data,
+    // windowed by the key.
+    typedef FlatWindowMap<DupKey, ReadData, DupKeyHash, DupKeyEqual,
+                          std::less<DupKey> > FragmentMap;
+    typedef FragmentMap::InsertReturn FragmentMapInsertReturn;
     FragmentMap myFragmentMap;
 
     // Map for storing reads until the mate is found.
-    typedef std::multimap<uint64_t, ReadData> MateMap;
-    typedef std::pair<MateMap::iterator,bool> MateMapInsertReturn;
+    typedef FlatWindowMultiMap<ReadData> MateMap;
     MateMap myMateMap;
 
-    // A map from the key of a paired read to its read data
-    typedef std::map<PairedKey, PairedData, PairedKeyComparator> PairedMap;
-    typedef std::pair<PairedMap::iterator,bool> PairedMapInsertReturn;
+    // A map from the key of a paired read to its read data,
+    // windowed by key2 (the later key).
+    typedef FlatWindowMap<PairedKey, PairedData, PairedKeyHash,
+                          PairedKeyEqual, PairedKeyComparator> PairedMap;
+    typedef PairedMap::InsertReturn PairedMapInsertReturn;
     PairedMap myPairedMap;
 
     // Stores the record counts of duplicates reads
-    typedef std::vector< uint32_t > Int32Vector;
-    typedef std::vector< uint32_t >::iterator Int32VectorIterator;
-    Int32Vector myDupList;
+    DupBitmap myDupList;
 
     // Recalibrator logic.
     Recab myRecab;
@@ -199,17 +328,56 @@ private:
     bool myOneChrom;
     
     // Pool of sam records.
-    SamRecordPool mySamPool;
+    SamRecordArena mySamPool;
+
+    // Single pass mode, records are held in the reorder buffer until
+    // their duplicate status is known rather than making a second pass.
+    bool myOnePass;
+    DedupReorderBuffer myReorderBuffer;
     
     int lastCoordinate;
     int lastReference;
     uint32_t numLibraries;
-    int myNumMissingMate;
+    uint64_t myNumMissingMate;
     bool myForceFlag;
     int myMinQual;
 
+    // Set when processing by reference, to save the records whose mates
+    // are on other references rather than looking for the mates.
+    std::vector<CrossChromRead>* myCrossChromReads;
+    uint32_t mySection;
+
     static const int DEFAULT_MIN_QUAL;
+    static const int DEFAULT_REORDER_WINDOW;
     static const uint32_t CLIP_OFFSET;
+    // Most references that fit in a DupKey.
+    static const int32_t MAX_KEY_REFERENCES = 1 << 23;
+
+    // Write the summary statistics of the records read.
+    void logReadCounts(const ReadCounts& counts);
+
+    // Process each reference of the indexed input file on the thread pool,
+    // indexing the output once it is written if index is set.
+    int executeByChrom(const String& inFile, const String& outFile,
+                       SamFileHeader& header, bool removeFlag,
+                       uint16_t excludeFlags, const String& tmpPrefix,
+                       bool index);
+
+    // Copy the settings used for determining duplicates.
+    void copySettings(const Dedup& dedup);
+
+    // Determine the duplicates in the currently set read section.
+    void dedupSection(SamFile& samIn, SamFileHeader& header,
+                      uint16_t excludeFlags, SectionResult& result);
+
+    // Write the records from the currently set read section, marking the
+    // duplicates, to the section's part file (BGZF compressed BAM records
+    // without a header).
+    void writeSection(SamFile& samIn, SamFileHeader& header, bool removeFlag,
+                      SectionResult& result);
+
+    // Check the pairs with mates on different references for duplicates.
+    void checkCrossChromDups(std::vector<SectionResult*>& results);
 
     // Once record is read, look back at previous reads and determine 
     // if any no longer need to be kept for duplicate checking.
@@ -221,7 +389,7 @@ private:
     
     // When a record is read, check if it is a duplicate or
     // store for future checking.
-    void checkDups(SamRecord & record, uint32_t recordCount);
+    void checkDups(SamRecord & record, uint64_t recordCount);
 
     // Add the base qualities in a read
     int getBaseQuality(SamRecord& record);
@@ -234,36 +402,39 @@ private:
 
     // Handle records that are not to be marked duplicates.
     // Performs any additional processing the first time through the file.
-    void handleNonDuplicate(SamRecord* recordPtr);
+    void handleNonDuplicate(uint64_t index, SamRecord* recordPtr);
 
     // Handle records whose mate was not found.  This will handle all processing
     // including calling handleNonDuplicate. 
-    void handleMissingMate(SamRecord* recordPtr);
+    void handleMissingMate(uint64_t index, SamRecord* recordPtr);
+
+    void handleDuplicate(uint64_t index, SamRecord* recordPtr);
 
-    void handleDuplicate(uint32_t index, SamRecord* recordPtr);
+    // Warn (once per type) that mates could not be found.
+    void warnMissingMate(bool differentChrom);
 
-    inline int getFirstIndex(const DupKey& key1, 
-                             int key1Index,
-                             const DupKey& key2,
-                             int key2Index)
+    inline uint64_t getFirstIndex(const DupKey& key1, 
+                                  uint64_t key1Index,
+                                  const DupKey& key2,
+                                  uint64_t key2Index)
     {
-        if(key1.reference < key2.reference)
+        if(key1.getReference() < key2.getReference())
         {
             // key1 has a smaller chromosome
             return(key1Index);
         }
-        if(key1.reference > key2.reference)
+        if(key1.getReference() > key2.getReference())
         {
             // key2 has a smaller chromosome
             return(key2Index);
         }
         // Same chromosome, so check the coordinate.
-        if(key1.coordinate < key2.coordinate)
+        if(key1.getCoordinate() < key2.getCoordinate())
         {
             // key1 has a smaller coordinate
             return(key1Index);
         }
-        if(key1.coordinate < key2.coordinate)
+        if(key1.getCoordinate() < key2.getCoordinate())
         {
             // key2 has a smaller coordinate
             return(key2Index);
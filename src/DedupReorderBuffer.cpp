@@ -0,0 +1,241 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <sstream>
+
+#include "DedupReorderBuffer.h"
+#include "SamFlag.h"
+#include "Logger.h"
+#include "MemoryBudget.h"
+
+DedupReorderBuffer::DedupReorderBuffer(SamRecordArena& pool)
+    : myPool(pool),
+      mySamOut(NULL),
+      myHeader(NULL),
+      myWindowSize(0),
+      mySpillPrefix(),
+      myRemoveDups(false),
+      myClearDups(false),
+      myPending(),
+      myFirstIndex(0),
+      myNumInMemory(0),
+      mySpillFiles(),
+      myNumSpillFiles(0),
+      mySpillIn(),
+      mySpillHeader(),
+      mySpillRecord(),
+      mySpillRecordsLeft(0),
+      mySingleDuplicates(0),
+      myPairedDuplicates(0),
+      myNumSpilled(0)
+{
+}
+
+
+DedupReorderBuffer::~DedupReorderBuffer()
+{
+    mySpillIn.Close();
+    // Remove any spill files that were not completely read.
+    for(unsigned int i = 0; i < mySpillFiles.size(); i++)
+    {
+        remove(mySpillFiles[i].fileName.c_str());
+    }
+    for(unsigned int i = 0; i < myPending.size(); i++)
+    {
+        if(myPending[i].state != UNDECIDED)
+        {
+            // Undecided records are owned by the duplicate maps.
+            myPool.releaseRecord(myPending[i].recordPtr);
+        }
+    }
+}
+
+
+void DedupReorderBuffer::init(ThreadedSamFile* samOut, SamFileHeader* header,
+                              uint32_t windowSize,
+                              const std::string& spillPrefix,
+                              bool removeDups, bool clearDups)
+{
+    mySamOut = samOut;
+    myHeader = header;
+    myWindowSize = windowSize;
+    mySpillPrefix = spillPrefix;
+    myRemoveDups = removeDups;
+    myClearDups = clearDups;
+}
+
+
+void DedupReorderBuffer::add(uint64_t index, SamRecord* recordPtr)
+{
+    if(myPending.empty())
+    {
+        myFirstIndex = index;
+    }
+    else if(index != (myFirstIndex + myPending.size()))
+    {
+        Logger::gLogger->error("Dedup single pass records added out of order, record %u", index);
+    }
+    myPending.push_back(PendingRecord(recordPtr));
+    ++myNumInMemory;
+    if((myNumInMemory > myWindowSize) ||
+       ((myNumInMemory >= (uint32_t)SamRecordArena::BLOCK_SIZE) &&
+        MemoryBudget::isOverLimit() && myPool.isExhausted()))
+    {
+        spill();
+    }
+}
+
+
+void DedupReorderBuffer::setDuplicate(uint64_t index, SamRecord* recordPtr,
+                                      bool duplicate)
+{
+    PendingRecord& pending = myPending[index - myFirstIndex];
+    pending.state = duplicate ? DUPLICATE : NOT_DUPLICATE;
+    if(pending.recordPtr == NULL)
+    {
+        // Already in a spill file, so the record is no longer needed.
+        myPool.releaseRecord(recordPtr);
+    }
+}
+
+
+void DedupReorderBuffer::flush()
+{
+    while(!myPending.empty() && (myPending.front().state != UNDECIDED))
+    {
+        writeFirst();
+    }
+}
+
+
+void DedupReorderBuffer::finish()
+{
+    flush();
+    if(!myPending.empty())
+    {
+        Logger::gLogger->error("Dedup single pass ended with %u records that were not checked for duplicates",
+                               myPending.size());
+    }
+}
+
+
+void DedupReorderBuffer::spill()
+{
+    std::ostringstream fileName;
+    fileName << mySpillPrefix << "." << myNumSpillFiles++ << ".bam";
+
+    ThreadedSamFile spillOut;
+    if(!spillOut.OpenForWrite(fileName.str().c_str(), myHeader))
+    {
+        Logger::gLogger->error("Failed to open the temporary dedup file %s",
+                               fileName.str().c_str());
+    }
+    // The records held in memory are at the end of the pending list.
+    for(unsigned int i = myPending.size() - myNumInMemory;
+        i < myPending.size(); i++)
+    {
+        PendingRecord& pending = myPending[i];
+        spillOut.WriteRecord(*myHeader, *(pending.recordPtr));
+        if(pending.state != UNDECIDED)
+        {
+            myPool.releaseRecord(pending.recordPtr);
+        }
+        pending.recordPtr = NULL;
+    }
+    spillOut.Close();
+
+    mySpillFiles.push_back(SpillFile(fileName.str(), myNumInMemory));
+    myNumSpilled += myNumInMemory;
+    myNumInMemory = 0;
+}
+
+
+void DedupReorderBuffer::writeFirst()
+{
+    PendingRecord& pending = myPending.front();
+    SamRecord* recordPtr = pending.recordPtr;
+    if(recordPtr == NULL)
+    {
+        recordPtr = readSpilled();
+    }
+    else
+    {
+        --myNumInMemory;
+    }
+
+    uint16_t flag = recordPtr->getFlag();
+    if(pending.state == DUPLICATE)
+    {
+        SamFlag::setDuplicate(flag);
+        recordPtr->setFlag(flag);
+        // count the duplicates the same way as the two pass method.
+        if(!SamFlag::isPaired(flag) || !SamFlag::isMateMapped(flag))
+        {
+            mySingleDuplicates++;
+        }
+        else
+        {
+            myPairedDuplicates++;
+        }
+        if(!myRemoveDups)
+        {
+            mySamOut->WriteRecord(*myHeader, *recordPtr);
+        }
+    }
+    else
+    {
+        if(myClearDups)
+        {
+            SamFlag::setNotDuplicate(flag);
+            recordPtr->setFlag(flag);
+        }
+        mySamOut->WriteRecord(*myHeader, *recordPtr);
+    }
+
+    if(pending.recordPtr != NULL)
+    {
+        myPool.releaseRecord(pending.recordPtr);
+    }
+    myPending.pop_front();
+    ++myFirstIndex;
+}
+
+
+SamRecord* DedupReorderBuffer::readSpilled()
+{
+    if(mySpillRecordsLeft == 0)
+    {
+        // Open the next spill file.
+        mySpillIn.OpenForRead(mySpillFiles.front().fileName.c_str());
+        mySpillIn.ReadHeader(mySpillHeader);
+        mySpillRecordsLeft = mySpillFiles.front().numRecords;
+    }
+    if(!mySpillIn.ReadRecord(mySpillHeader, mySpillRecord))
+    {
+        Logger::gLogger->error("Failed to read the temporary dedup file %s",
+                               mySpillFiles.front().fileName.c_str());
+    }
+    if(--mySpillRecordsLeft == 0)
+    {
+        // Done with this spill file.
+        mySpillIn.Close();
+        remove(mySpillFiles.front().fileName.c_str());
+        mySpillFiles.pop_front();
+    }
+    return(&mySpillRecord);
+}
@@ -0,0 +1,119 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DEDUP_REORDER_BUFFER_H__
+#define __DEDUP_REORDER_BUFFER_H__
+
+#include <deque>
+#include <string>
+
+#include "ThreadedSamFile.h"
+#include "SamRecordArena.h"
+
+/// Buffers records until their duplicate status is known so they can be
+/// marked and written in their original order in a single pass.
+/// When more than the window size of records would be held in memory,
+/// the buffered records are spilled to a temporary BAM file and read back
+/// when they are written.  They are also spilled when the MemoryBudget
+/// is exceeded and the pool would have to allocate more records.
+/// Records must be added in record count order.
+class DedupReorderBuffer
+{
+public:
+    DedupReorderBuffer(SamRecordArena& pool);
+    ~DedupReorderBuffer();
+
+    /// Setup writing to the already opened output file.
+    /// removeDups - do not write duplicates.
+    /// clearDups - clear the duplicate flag on non-duplicates.
+    void init(ThreadedSamFile* samOut, SamFileHeader* header,
+              uint32_t windowSize, const std::string& spillPrefix,
+              bool removeDups, bool clearDups);
+
+    /// Add the record with the specified index (records must be added
+    /// in order).  The buffer owns the record until it is released.
+    void add(uint64_t index, SamRecord* recordPtr);
+
+    /// Set the duplicate status of the specified record, releasing it
+    /// if it is no longer needed.
+    void setDuplicate(uint64_t index, SamRecord* recordPtr, bool duplicate);
+
+    /// Write all records at the front of the buffer whose status is known.
+    void flush();
+
+    /// Write all remaining records, all records must have a status.
+    void finish();
+
+    uint64_t getNumSingleDuplicates() { return(mySingleDuplicates); }
+    uint64_t getNumPairedDuplicates() { return(myPairedDuplicates); }
+    uint64_t getNumSpilled() { return(myNumSpilled); }
+
+private:
+    enum DupState { UNDECIDED, NOT_DUPLICATE, DUPLICATE };
+
+    struct PendingRecord
+    {
+        // NULL if the record was spilled to a temporary file.
+        SamRecord* recordPtr;
+        DupState state;
+        PendingRecord(SamRecord* ptr)
+            : recordPtr(ptr), state(UNDECIDED) {}
+    };
+
+    // Temporary file containing a contiguous range of buffered records.
+    struct SpillFile
+    {
+        std::string fileName;
+        uint32_t numRecords;
+        SpillFile(const std::string& name, uint32_t num)
+            : fileName(name), numRecords(num) {}
+    };
+
+    // Write all records held in memory to a new spill file.
+    void spill();
+    // Write the first pending record.
+    void writeFirst();
+    // Get the next record from the current spill file.
+    SamRecord* readSpilled();
+
+    SamRecordArena& myPool;
+    ThreadedSamFile* mySamOut;
+    SamFileHeader* myHeader;
+    uint32_t myWindowSize;
+    std::string mySpillPrefix;
+    bool myRemoveDups;
+    bool myClearDups;
+
+    std::deque<PendingRecord> myPending;
+    // Index of the first record in myPending.
+    uint64_t myFirstIndex;
+    // Number of records at the end of myPending that are held in memory.
+    uint32_t myNumInMemory;
+
+    std::deque<SpillFile> mySpillFiles;
+    uint32_t myNumSpillFiles;
+    ThreadedSamFile mySpillIn;
+    SamFileHeader mySpillHeader;
+    SamRecord mySpillRecord;
+    uint32_t mySpillRecordsLeft;
+
+    uint64_t mySingleDuplicates;
+    uint64_t myPairedDuplicates;
+    uint64_t myNumSpilled;
+};
+
+#endif
@@ -21,12 +21,14 @@
 #include <string>
 #include <unistd.h>
 #include <getopt.h>
-#include "SamFile.h"
+#include "ThreadedSamFile.h"
 #include "Dedup_LowMem.h"
 #include "Logger.h"
 #include "SamHelper.h"
 #include "SamStatus.h"
 #include "BgzfFileType.h"
+#include "QualitySum.h"
+#include "MemoryBudget.h"
 
 const int Dedup_LowMem::DEFAULT_MIN_QUAL = 15;
 const uint32_t Dedup_LowMem::CLIP_OFFSET = 1000;
@@ -58,7 +60,7 @@ void Dedup_LowMem::printDescription(std::ostream& os)
 
 void Dedup_LowMem::printUsage(std::ostream& os)
 {
-    os << "Usage: ./bam dedup_LowMem --in <InputBamFile> --out <OutputBamFile> [--minQual <minPhred>] [--log <logFile>] [--oneChrom] [--rmDups] [--force] [--excludeFlags <flag>] [--verbose] [--noeof] [--params] [--recab] ";
+    os << "Usage: ./bam dedup_LowMem --in <InputBamFile> --out <OutputBamFile> [--minQual <minPhred>] [--log <logFile>] [--oneChrom] [--rmDups] [--force] [--excludeFlags <flag>] [--verbose] [--noeof] [--params] [--maxMem <MB> [--tmpPrefix <prefix>]] [--recab] ";
     myRecab.printRecabSpecificUsageLine(os);
     os << std::endl << std::endl;
     os << "Required parameters :" << std::endl;
@@ -78,6 +80,9 @@ void Dedup_LowMem::printUsage(std::ostream& os)
     os << "\t--verbose       : Turn on verbose mode" << std::endl;
     os << "\t--noeof         : Do not expect an EOF block on a bam file." << std::endl;
     os << "\t--params        : Print the parameter settings" << std::endl;
+    os << "\t--maxMem <MB>   : Find duplicates by sorting the read keys in temporary files, using about this" << std::endl;
+    os << "\t                  many megabytes (or K/M/G) of memory, rather than keeping them in memory (default: off)." << std::endl;
+    os << "\t--tmpPrefix <prefix> : with --maxMem, prefix for the temporary files (default: $TMPDIR/bamDedup_LowMem.<pid>)" << std::endl;
     os << "\t--recab         : Recalibrate in addition to dedup_LowMem" << std::endl;
     myRecab.printRecabSpecificUsage(os);
     os << "\n" << std::endl;
@@ -99,6 +104,7 @@ int Dedup_LowMem::execute(int argc, char** argv)
     uint16_t intExcludeFlags = 0;
     bool noeof = false;
     bool params = false;
+    String tmpPrefix = "";
 
     LongParamContainer parameters;
     parameters.addGroup("Required Parameters");
@@ -115,6 +121,7 @@ int Dedup_LowMem::execute(int argc, char** argv)
     parameters.addBool("verbose", &verboseFlag);
     parameters.addBool("noeof", &noeof);
     parameters.addBool("params", &params);
+    parameters.addString("tmpPrefix", &tmpPrefix);
     parameters.addPhoneHome(VERSION);
     myRecab.addRecabSpecificParameters(parameters);
 
@@ -176,9 +183,40 @@ int Dedup_LowMem::execute(int argc, char** argv)
         return EXIT_FAILURE;
     }
 
+    // The common --maxMem budget bounds the sort buffers.
+    mySortDups = MemoryBudget::hasLimit();
+    myExcludeFlags = intExcludeFlags;
+
+    if(tmpPrefix.IsEmpty())
+    {
+        const char* tmpDir = getenv("TMPDIR");
+        tmpPrefix = (tmpDir == NULL) ? "/tmp" : tmpDir;
+        tmpPrefix += "/bamDedup_LowMem.";
+        tmpPrefix += (int)getpid();
+    }
+
+    if(mySortDups)
+    {
+        // At most 4 of the sorters hold records in memory at once.
+        uint64_t sortBytes = MemoryBudget::getLimit() / 4;
+        std::string prefix = tmpPrefix.c_str();
+        myFragSorter.init(prefix + ".frag", sortBytes / sizeof(SortFrag));
+        myMateSorter.init(prefix + ".mate", sortBytes / sizeof(SortMate));
+        myPairSorter.init(prefix + ".pair", sortBytes / sizeof(SortPair));
+        myDupSorter.init(prefix + ".dup", sortBytes / sizeof(uint64_t));
+        myRecabSorter.init(prefix + ".recab", sortBytes / sizeof(uint64_t));
+    }
+
     if(logFile.IsEmpty())
     {
-        logFile = outFile + ".log";
+        if(ThreadedSamFile::isPipeName(outFile.c_str()))
+        {
+            logFile = "-";
+        }
+        else
+        {
+            logFile = outFile + ".log";
+        }
     }
     
     if(myDoRecab)
@@ -203,7 +241,7 @@ int Dedup_LowMem::execute(int argc, char** argv)
      * instantiate dedup_LowMem, and construct the read group library map
      * ------------------------------------------------------------------*/
 
-    SamFile samIn;
+    ThreadedSamFile samIn;
 
     samIn.OpenForRead(inFile.c_str());
     // If the file isn't sorted it will throw an exception.
@@ -213,20 +251,25 @@ int Dedup_LowMem::execute(int argc, char** argv)
     samIn.ReadHeader(header);
 
     buildReadGroupLibraryMap(header);
+    if(header.getReferenceInfo().getNumEntries() > MAX_KEY_REFERENCES)
+    {
+        Logger::gLogger->error("More than %d references, Dedup_LowMem only allows up to %d references", 
+                               MAX_KEY_REFERENCES, MAX_KEY_REFERENCES);
+    }
 
     lastReference = -1;
     lastCoordinate = -1;
 
     // for keeping some basic statistics
-    uint32_t recordCount = 0;
-    uint32_t pairedCount = 0;
-    uint32_t properPairCount = 0;
-    uint32_t unmappedCount = 0;
-    uint32_t reverseCount = 0;
-    uint32_t qualCheckFailCount = 0;
-    uint32_t secondaryCount = 0;
-    uint32_t supplementaryCount = 0;
-    uint32_t excludedCount = 0;
+    uint64_t recordCount = 0;
+    uint64_t pairedCount = 0;
+    uint64_t properPairCount = 0;
+    uint64_t unmappedCount = 0;
+    uint64_t reverseCount = 0;
+    uint64_t qualCheckFailCount = 0;
+    uint64_t secondaryCount = 0;
+    uint64_t supplementaryCount = 0;
+    uint64_t excludedCount = 0;
 
     // Now we start reading records
     SamRecord* recordPtr;
@@ -257,7 +300,8 @@ int Dedup_LowMem::execute(int argc, char** argv)
         // put the record in the appropriate maps:
         //   single reads go in myFragmentMap
         //   paired reads go in myPairedMap
-        recordCount = samIn.GetCurrentRecordCount();
+        // Count the records here since the file's count is only 32 bits.
+        ++recordCount;
 
         // if we have moved to a new position, look back at previous reads for duplicates
         if (hasPositionChanged(*recordPtr))
@@ -271,7 +315,8 @@ int Dedup_LowMem::execute(int argc, char** argv)
             ++excludedCount;
 
             // No deduping done on this record, but still build the recab table.
-            if(myDoRecab)
+            // With --maxMem, it is built in a separate pass.
+            if(myDoRecab && !mySortDups)
             {
                 myRecab.processReadBuildTable(*recordPtr);
             }
@@ -288,16 +333,24 @@ int Dedup_LowMem::execute(int argc, char** argv)
                 Logger::gLogger->error("Use -f to clear the duplicate flag and start the dedup_LowMem procedure over");
             }
 
-            checkDups(*recordPtr, recordCount);
+            if(mySortDups)
+            {
+                addSortRecords(*recordPtr, recordCount);
+            }
+            else
+            {
+                checkDups(*recordPtr, recordCount);
+            }
             mySamPool.releaseRecord(recordPtr);
         }
         // let the user know we're not napping
         if (verboseFlag && (recordCount % 100000 == 0))
         {
-            Logger::gLogger->writeLog("recordCount=%u singleKeyMap=%u pairedKeyMap=%u, dictSize=%u", 
-                                      recordCount, myFragmentMap.size(), 
-                                      myPairedMap.size(), 
-                                      myMateMap.size());
+            Logger::gLogger->writeLog("recordCount=%llu singleKeyMap=%llu pairedKeyMap=%llu, dictSize=%llu", 
+                                      (unsigned long long)recordCount,
+                                      (unsigned long long)myFragmentMap.size(), 
+                                      (unsigned long long)myPairedMap.size(), 
+                                      (unsigned long long)myMateMap.size());
         }
     }
 
@@ -305,74 +358,78 @@ int Dedup_LowMem::execute(int argc, char** argv)
     //  close the input file
     cleanupPriorReads(NULL);
     samIn.Close();
+    if(mySortDups)
+    {
+        findSortedDups();
+    }
 
     // print some statistics
     Logger::gLogger->writeLog("--------------------------------------------------------------------------");
     Logger::gLogger->writeLog("SUMMARY STATISTICS OF THE READS");
-    Logger::gLogger->writeLog("Total number of reads: %u",recordCount);
-    Logger::gLogger->writeLog("Total number of paired-end reads: %u",
-                              pairedCount);
-    Logger::gLogger->writeLog("Total number of properly paired reads: %u",
-                              properPairCount);
-    Logger::gLogger->writeLog("Total number of unmapped reads: %u",
-                              unmappedCount);
-    Logger::gLogger->writeLog("Total number of reverse strand mapped reads: %u",
-                              reverseCount);
-    Logger::gLogger->writeLog("Total number of QC-failed reads: %u",
-                              qualCheckFailCount);
-    Logger::gLogger->writeLog("Total number of secondary reads: %u",
-                              secondaryCount);
-    Logger::gLogger->writeLog("Total number of supplementary reads: %u",
-                              supplementaryCount);
-    Logger::gLogger->writeLog("Size of singleKeyMap (must be zero): %u",
-                              myFragmentMap.size());
-    Logger::gLogger->writeLog("Size of pairedKeyMap (must be zero): %u",
-                              myPairedMap.size());
-    Logger::gLogger->writeLog("Total number of missing mates: %u",
-                              myNumMissingMate);
-    Logger::gLogger->writeLog("Total number of reads excluded from duplicate checking: %u",
-                              excludedCount);
+    Logger::gLogger->writeLog("Total number of reads: %llu",
+                              (unsigned long long)recordCount);
+    Logger::gLogger->writeLog("Total number of paired-end reads: %llu",
+                              (unsigned long long)pairedCount);
+    Logger::gLogger->writeLog("Total number of properly paired reads: %llu",
+                              (unsigned long long)properPairCount);
+    Logger::gLogger->writeLog("Total number of unmapped reads: %llu",
+                              (unsigned long long)unmappedCount);
+    Logger::gLogger->writeLog("Total number of reverse strand mapped reads: %llu",
+                              (unsigned long long)reverseCount);
+    Logger::gLogger->writeLog("Total number of QC-failed reads: %llu",
+                              (unsigned long long)qualCheckFailCount);
+    Logger::gLogger->writeLog("Total number of secondary reads: %llu",
+                              (unsigned long long)secondaryCount);
+    Logger::gLogger->writeLog("Total number of supplementary reads: %llu",
+                              (unsigned long long)supplementaryCount);
+    Logger::gLogger->writeLog("Size of singleKeyMap (must be zero): %llu",
+                              (unsigned long long)myFragmentMap.size());
+    Logger::gLogger->writeLog("Size of pairedKeyMap (must be zero): %llu",
+                              (unsigned long long)myPairedMap.size());
+    Logger::gLogger->writeLog("Total number of missing mates: %llu",
+                              (unsigned long long)myNumMissingMate);
+    Logger::gLogger->writeLog("Total number of reads excluded from duplicate checking: %llu",
+                              (unsigned long long)excludedCount);
     Logger::gLogger->writeLog("--------------------------------------------------------------------------");
-    Logger::gLogger->writeLog("Sorting the indices of %d duplicated records",
-                              myDupList.size());
 
-    // sort the indices of duplicate records
-    std::sort(myDupList.begin(), myDupList.end(),
-              std::less<uint32_t> ());
+    if(mySortDups && myDoRecab)
+    {
+        buildSortedRecab(inFile);
+    }
 
     // get ready to write the output file by making a second pass
     // through the input file
     samIn.OpenForRead(inFile.c_str());
     samIn.ReadHeader(header);
 
-    SamFile samOut;
+    ThreadedSamFile samOut;
     samOut.OpenForWrite(outFile.c_str());
     samOut.WriteHeader(header);
 
     // If we are recalibrating, output the model information.
     if(myDoRecab)
     {
-        myRecab.modelFitPrediction(outFile);
+        // Name the tables after the log rather than a pipe output.
+        myRecab.modelFitPrediction(ThreadedSamFile::isPipeName(outFile.c_str()) ?
+                                   logFile.c_str() : outFile.c_str());
     }
 
-    // an iterator to run through the duplicate indices
-    int currentDupIndex = 0;
-    bool moreDups = !myDupList.empty();
+    // Index of the current record in the file.
+    uint64_t currentIndex = 0;
 
     // let the user know what we're doing
     Logger::gLogger->writeLog("\nWriting %s", outFile.c_str());
 
     // count the duplicate records as a check
-    uint32_t singleDuplicates(0), pairedDuplicates(0);
+    uint64_t singleDuplicates(0), pairedDuplicates(0);
 
     // start reading records and writing them out
     SamRecord record;
     while(samIn.ReadRecord(header, record))
     {
-        uint32_t currentIndex = samIn.GetCurrentRecordCount();
+        ++currentIndex;
 
-        bool foundDup = moreDups &&
-            (currentIndex == myDupList[currentDupIndex]);
+        bool foundDup = isDuplicate(currentIndex);
 
         // modify the duplicate flag and write out the record,
         // if it's appropriate
@@ -381,7 +438,6 @@ int Dedup_LowMem::execute(int argc, char** argv)
         {   
             // this record is a duplicate, so mark it.
             record.setFlag( flag | 0x400 );
-            currentDupIndex++;
             // increment duplicate counters to verify we found them all
             if ( ( ( flag & 0x0001 ) == 0 ) || ( flag & 0x0008 ) )
             { // unpaired or mate unmapped
@@ -418,7 +474,8 @@ int Dedup_LowMem::execute(int argc, char** argv)
 	
         // Let the user know we're still here
         if (verboseFlag && (currentIndex % 100000 == 0)) {
-            Logger::gLogger->writeLog("recordCount=%u", currentIndex);
+            Logger::gLogger->writeLog("recordCount=%llu",
+                                      (unsigned long long)currentIndex);
         }
     }
 
@@ -426,10 +483,10 @@ int Dedup_LowMem::execute(int argc, char** argv)
     samIn.Close();
     samOut.Close();
 
-    Logger::gLogger->writeLog("Successfully %s %u unpaired and %u paired duplicate reads", 
+    Logger::gLogger->writeLog("Successfully %s %llu unpaired and %llu paired duplicate reads", 
                               removeFlag ? "removed" : "marked" ,
-                              singleDuplicates,
-                              pairedDuplicates/2);
+                              (unsigned long long)singleDuplicates,
+                              (unsigned long long)pairedDuplicates/2);
     Logger::gLogger->writeLog("\nDedup_LowMem complete!");
     return 0;
 }
@@ -508,7 +565,7 @@ void Dedup_LowMem::cleanupPriorReads(SamRecord* record)
             break;
         }
         // Passed the mate, but it was not found.
-        handleMissingMate(mateIter->second.key.reference, 
+        handleMissingMate(mateIter->second.key.getReference(), 
                           mateIter->first >> 32);
     }
     // Erase the entries.
@@ -539,7 +596,7 @@ bool Dedup_LowMem::hasPositionChanged(SamRecord& record)
 
 // When a record is read, check if it is a duplicate or
 // store for future checking.
-void Dedup_LowMem::checkDups(SamRecord& record, uint32_t recordCount)
+void Dedup_LowMem::checkDups(SamRecord& record, uint64_t recordCount)
 {
     // Only inside this method if the record is mapped.
 
@@ -626,7 +683,7 @@ void Dedup_LowMem::checkDups(SamRecord& record, uint32_t recordCount)
     uint64_t matePos =
         SamHelper::combineChromPos(mateChromID, 
                                    record.get0BasedMatePosition());
-    int mateIndex = -1;
+    uint64_t mateIndex = 0;
     MateData* mateData = NULL;
 
     // Check to see if the mate is prior to this record.
@@ -684,8 +741,8 @@ void Dedup_LowMem::checkDups(SamRecord& record, uint32_t recordCount)
     PairedData* storedPair = &(pairedReturn.first->second);
 
     // Get the index for "record 1" - the one with the earlier coordinate.
-    int record1Index = getFirstIndex(key, recordCount,
-                                     mateData->key, mateIndex);
+    uint64_t record1Index = getFirstIndex(key, recordCount,
+                                          mateData->key, mateIndex);
 
     // Check if we have already found a duplicate pair.
     // If there is no duplicate found, there is nothing more to do.
@@ -766,18 +823,7 @@ void Dedup_LowMem::checkDups(SamRecord& record, uint32_t recordCount)
 
 // Finds the total base quality of a read 
 int Dedup_LowMem::getBaseQuality(SamRecord & record) {
-    const char* baseQualities = record.getQuality();
-    int readLength = record.getReadLength();
-    int quality = 0.;
-    if(strcmp(baseQualities, "*") == 0)
-    {
-        return(0);
-    }
-    for(int i=0; i < readLength; ++i) {
-        int q = static_cast<int>(baseQualities[i])-33;
-        if ( q >= myMinQual ) quality += q;
-    }
-    return quality;
+    return(sumRecordQualities(record, myMinQual));
 }
 
 
@@ -823,6 +869,13 @@ void Dedup_LowMem::buildReadGroupLibraryMap(SamFileHeader& header) {
     if (numLibraries > 0xff) {
         Logger::gLogger->error("More than 255 library names are identified. Dedup_LowMem currently only allows up to 255 library names");
     }
+
+    // Library of each read group in the dictionary used to look them up.
+    myReadGroups.init(header);
+    myRgLibraries.assign(myReadGroups.size(), 0);
+    for(uint32_t i = 0; i < myReadGroups.size(); i++) {
+        myRgLibraries[i] = rgidLibMap[myReadGroups.getName(i)];
+    }
 }    
 
 // get the libraryID of a record
@@ -830,6 +883,15 @@ uint32_t Dedup_LowMem::getLibraryID(SamRecord& record, bool checkTags) {
     if ( ( checkTags == false ) && ( numLibraries <= 1 ) ) {
         return 0; 
     } else {
+        // Look up the read group without copying it.  Anything unexpected
+        // is reported by checking all of the tags below.
+        const String* rgPtr = record.getStringTag("RG");
+        if ( rgPtr != NULL ) {
+            int32_t index = myReadGroups.find(rgPtr->c_str(), rgPtr->Length());
+            if ( index >= 0 ) {
+                return myRgLibraries[index];
+            }
+        }
         char tag[3];
         char vtype;
         void* value;
@@ -898,8 +960,224 @@ void Dedup_LowMem::handleMissingMate(int32_t refID, int32_t mateRefID)
 }
 
 
-void Dedup_LowMem::handleDuplicate(uint32_t index)
+void Dedup_LowMem::handleDuplicate(uint64_t index)
 {
     // Add the index to the duplicate list.
-    myDupList.push_back(index);
+    if(mySortDups)
+    {
+        myDupSorter.add(index);
+    }
+    else
+    {
+        myDupList.set(index);
+    }
+}
+
+
+bool Dedup_LowMem::isDuplicate(uint64_t index)
+{
+    if(!mySortDups)
+    {
+        return(myDupList.test(index));
+    }
+    while(myHaveNextDup && (myNextDup < index))
+    {
+        myHaveNextDup = myDupSorter.next(myNextDup);
+    }
+    return(myHaveNextDup && (myNextDup == index));
+}
+
+
+// FNV-1a hash of a read name, used to group mates when sorting.
+static uint64_t hashReadName(const char* readName)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for(const char* c = readName; *c != '\0'; ++c)
+    {
+        hash ^= (unsigned char)*c;
+        hash *= 1099511628211ULL;
+    }
+    return(hash);
+}
+
+
+void Dedup_LowMem::addSortRecords(SamRecord& record, uint64_t recordCount)
+{
+    // Only inside this method if the record is mapped.
+    SortFrag frag;
+    frag.key.initKey(record, getLibraryID(record));
+
+    int flag = record.getFlag(); 
+    bool recordPaired = SamFlag::isPaired(flag) && SamFlag::isMateMapped(flag);
+    int32_t chromID = record.getReferenceID();
+    int32_t mateChromID = record.getMateReferenceID();
+
+    // If we are one-chrom and the mate is not on the same chromosome, 
+    // mark it as not paired.
+    if(myOneChrom && (chromID != mateChromID))
+    {
+        recordPaired = false;
+    }
+
+    frag.sumBaseQual = getBaseQuality(record);
+    frag.paired = recordPaired;
+    frag.recordIndex = recordCount;
+    myFragSorter.add(frag);
+
+    if(!recordPaired)
+    {
+        return;
+    }
+
+    uint64_t readPos = 
+        SamHelper::combineChromPos(chromID,
+                                   record.get0BasedPosition());
+    uint64_t matePos =
+        SamHelper::combineChromPos(mateChromID, 
+                                   record.get0BasedMatePosition());
+    SortMate mate;
+    mate.meetPos = std::max(readPos, matePos);
+    mate.nameHash = hashReadName(record.getReadName());
+    mate.recordIndex = recordCount;
+    mate.key = frag.key;
+    mate.sumBaseQual = frag.sumBaseQual;
+    mate.mateRefID = mateChromID;
+    myMateSorter.add(mate);
+}
+
+
+void Dedup_LowMem::findSortedDups()
+{
+    // Fragments with the same key are sorted so the one that is not a
+    // duplicate is first.  Paired records are checked as pairs below.
+    myFragSorter.finish();
+    SortFrag frag;
+    SortFrag first;
+    bool haveFirst = false;
+    // Index of the first record with the key, for recalibration.
+    uint64_t minIndex = 0;
+    while(myFragSorter.next(frag))
+    {
+        if(!haveFirst || (first.key < frag.key))
+        {
+            if(haveFirst && myDoRecab)
+            {
+                myRecabSorter.add(minIndex);
+            }
+            first = frag;
+            minIndex = frag.recordIndex;
+            haveFirst = true;
+            continue;
+        }
+        minIndex = std::min(minIndex, frag.recordIndex);
+        if(!frag.paired)
+        {
+            handleDuplicate(frag.recordIndex);
+        }
+    }
+    if(haveFirst && myDoRecab)
+    {
+        myRecabSorter.add(minIndex);
+    }
+    myFragSorter.clear();
+
+    // Mates are next to each other, make a pair for each.
+    myMateSorter.finish();
+    SortMate mate;
+    SortMate prev;
+    bool havePrev = false;
+    while(myMateSorter.next(mate))
+    {
+        if(havePrev && (prev.meetPos == mate.meetPos) && 
+           (prev.nameHash == mate.nameHash))
+        {
+            SortPair pair;
+            pair.key = PairedKey(mate.key, prev.key);
+            pair.sumBaseQual = mate.sumBaseQual + prev.sumBaseQual;
+            // Get the index for "record 1" - the one with the earlier
+            // coordinate.
+            pair.record1Index = getFirstIndex(mate.key, mate.recordIndex,
+                                              prev.key, prev.recordIndex);
+            pair.record2Index = (pair.record1Index == prev.recordIndex) ?
+                mate.recordIndex : prev.recordIndex;
+            myPairSorter.add(pair);
+            havePrev = false;
+            continue;
+        }
+        if(havePrev)
+        {
+            handleMissingMate(prev.key.getReference(), prev.mateRefID);
+        }
+        prev = mate;
+        havePrev = true;
+    }
+    if(havePrev)
+    {
+        handleMissingMate(prev.key.getReference(), prev.mateRefID);
+    }
+    myMateSorter.clear();
+
+    // Pairs with the same key are sorted so the one that is kept is first.
+    myPairSorter.finish();
+    PairedKeyComparator keyLess;
+    SortPair pair;
+    SortPair firstPair;
+    bool haveFirstPair = false;
+    while(myPairSorter.next(pair))
+    {
+        if(haveFirstPair && !keyLess(firstPair.key, pair.key))
+        {
+            handleDuplicate(pair.record1Index);
+            handleDuplicate(pair.record2Index);
+        }
+        else
+        {
+            firstPair = pair;
+            haveFirstPair = true;
+        }
+    }
+    myPairSorter.clear();
+
+    myDupSorter.finish();
+    myHaveNextDup = myDupSorter.next(myNextDup);
+    if(myDoRecab)
+    {
+        myRecabSorter.finish();
+        myHaveNextRecab = myRecabSorter.next(myNextRecab);
+    }
+}
+
+
+void Dedup_LowMem::buildSortedRecab(const String& inFile)
+{
+    ThreadedSamFile samIn;
+    samIn.OpenForRead(inFile.c_str());
+    SamFileHeader header;
+    samIn.ReadHeader(header);
+
+    // Build the table from the same records as without --maxMem:
+    // the excluded records & the first record with each key.
+    SamRecord record;
+    uint64_t index = 0;
+    while(samIn.ReadRecord(header, record))
+    {
+        ++index;
+        int flag = record.getFlag();
+        bool build = (!SamFlag::isMapped(flag)) || 
+            ((flag & myExcludeFlags) != 0);
+        if(!build)
+        {
+            while(myHaveNextRecab && (myNextRecab < index))
+            {
+                myHaveNextRecab = myRecabSorter.next(myNextRecab);
+            }
+            build = myHaveNextRecab && (myNextRecab == index);
+        }
+        if(build)
+        {
+            myRecab.processReadBuildTable(record);
+        }
+    }
+    samIn.Close();
+    myRecabSorter.clear();
 }
@@ -22,9 +22,12 @@
 #include <vector>
 #include <set>
 #include <map>
-#include "SamRecordPool.h"
+#include "SamRecordArena.h"
 #include "Recab.h"
 #include "SamFlag.h"
+#include "DupBitmap.h"
+#include "ReadGroupDict.h"
+#include "ExternalSorter.h"
 
 /*---------------------------------------------------------------/
   /
@@ -48,7 +51,13 @@ public:
         lastCoordinate(-1), lastReference(-1), numLibraries(0), 
         myNumMissingMate(0),
         myForceFlag(false),
-        myMinQual(15)
+        myMinQual(15),
+        mySortDups(false),
+        myExcludeFlags(0),
+        myHaveNextDup(false),
+        myNextDup(0),
+        myHaveNextRecab(false),
+        myNextRecab(0)
     {}
 
     ~Dedup_LowMem();
@@ -57,7 +66,7 @@ private:
     struct FragData
     {
         int sumBaseQual;
-        int recordIndex;
+        uint64_t recordIndex;
         bool paired;
         FragData()
             : sumBaseQual(0), recordIndex(0), paired(false) {}
@@ -66,82 +75,58 @@ private:
     struct PairedData
     {
         int sumBaseQual;
-        int record1Index;
-        int record2Index;
+        uint64_t record1Index;
+        uint64_t record2Index;
         PairedData()
             : sumBaseQual(0), record1Index(0), record2Index(0) {}
     };
 
+    // The key fields are packed into one integer that orders the same as
+    // comparing them in turn: reference (23 bits), coordinate + 2^31 
+    // (32 bits), orientation (1 bit), and library id (8 bits).
     struct DupKey
     {
-        int32_t reference;
-        int32_t coordinate;
-        bool orientation;
-        uint32_t libraryID;
+        uint64_t packed;
         DupKey()
-            : reference(0), coordinate(0), orientation(false), libraryID(0) {}
-        DupKey(const DupKey& key)
-            : reference(key.reference), coordinate(key.coordinate),
-              orientation(key.orientation), libraryID(key.libraryID) {}
+            : packed(pack(0, 0, false, 0)) {}
         DupKey(int32_t ref, int32_t coord, bool orient, uint32_t lib)
-            : reference(ref), coordinate(coord), orientation(orient), libraryID(lib) {}
+            : packed(pack(ref, coord, orient, lib)) {}
+        static inline uint64_t pack(int32_t ref, int32_t coord, 
+                                    bool orient, uint32_t lib)
+        {
+            return(((uint64_t)(uint32_t)ref << 41) |
+                   ((uint64_t)((uint32_t)coord ^ 0x80000000) << 9) |
+                   ((uint64_t)orient << 8) | (lib & 0xFF));
+        }
         inline void initKey(SamRecord& record, uint32_t libID)
         {
-            reference = record.getReferenceID();
-            coordinate = record.get0BasedUnclippedStart();
-            orientation = SamFlag::isReverse(record.getFlag());
-            if(orientation)
-            {
+            bool orientation = SamFlag::isReverse(record.getFlag());
+            int32_t coordinate = orientation ?
                 // Reverse, so get the unclipped end.
-                coordinate = record.get0BasedUnclippedEnd();
-            }
-            libraryID = libID;
+                record.get0BasedUnclippedEnd() : 
+                record.get0BasedUnclippedStart();
+            packed = pack(record.getReferenceID(), coordinate, 
+                          orientation, libID);
         }
         inline void copy(const DupKey& key)
         {
-            reference = key.reference;
-            coordinate = key.coordinate;
-            orientation = key.orientation;
-            libraryID = key.libraryID;
+            packed = key.packed;
         }
         inline void cleanupKey(int32_t referenceID, int32_t coord)
         {
-            reference = referenceID;
-            coordinate = coord - CLIP_OFFSET;
-            orientation = false;
-            libraryID = 0;
+            packed = pack(referenceID, coord - CLIP_OFFSET, false, 0);
         }
-        inline bool operator <(const DupKey& key) const
+        inline int32_t getReference() const
         {
-            if(reference == key.reference)
-            {
-                // same reference, so check the coordinate.
-                if(coordinate == key.coordinate)
-                {
-                    // Same coordinate, so check orientation.
-                    if(orientation == key.orientation)
-                    {
-                        // Same orientation, so check library id.
-                        return(libraryID < key.libraryID);
-                    }
-                    // Different orientations, so this is less than the
-                    // other if this orientation is false.
-                    return(!orientation);
-                }
-                // Same Ref, & different coordinates, so just check that.
-                return(coordinate < key.coordinate);
-            }
-            // Different references, so less than is determined by 
-            // checking the reference only.
-            return(reference < key.reference);
+            return((int32_t)(packed >> 41));
+        }
+        inline int32_t getCoordinate() const
+        {
+            return((int32_t)((uint32_t)(packed >> 9) ^ 0x80000000));
         }
-        inline DupKey&  operator = (const DupKey& key)
+        inline bool operator <(const DupKey& key) const
         {
-            reference = key.reference;
-            coordinate = key.coordinate;
-            orientation = key.orientation;
-            libraryID = key.libraryID;
-            return(*this);
+            return(packed < key.packed);
         }
     };
     
@@ -150,6 +135,7 @@ private:
     struct PairedKey {
         DupKey key1;
         DupKey key2;
+        PairedKey() {}
         PairedKey(DupKey k1, DupKey k2)
         {
             if(k2 < k1)
@@ -166,28 +152,112 @@ private:
     };
 
 
-    // Paired key comparison operator used for sorting paired end reads.
+    // Paired key comparison operator used for sorting paired end reads,
+    // compares the keys as a 128 bit value of key2 then key1.
     struct PairedKeyComparator {
         inline bool operator() (const PairedKey& lhs, const PairedKey& rhs) const {
-            if (lhs.key2 < rhs.key2) return true;
-            if (rhs.key2 < lhs.key2) return false;
-            return lhs.key1 < rhs.key1;
+            return((lhs.key2.packed < rhs.key2.packed) ||
+                   ((lhs.key2.packed == rhs.key2.packed) &&
+                    (lhs.key1.packed < rhs.key1.packed)));
         }
     };
 
     struct MateData
     {
         int sumBaseQual;
-        int recordIndex;
+        uint64_t recordIndex;
         DupKey key;
         std::string readName;
         MateData()
             : sumBaseQual(0), recordIndex(0), readName() {}
     };
 
+    // With --maxMem, instead of keeping the maps, one of these is written
+    // for each record that is checked for duplicates and they are sorted
+    // on disk to find the duplicates.
+    struct SortFrag
+    {
+        DupKey key;
+        int32_t sumBaseQual;
+        bool paired;
+        uint64_t recordIndex;
+    };
+
+    // Order by key, then the record that is kept first: paired, then
+    // highest quality, then earliest.
+    struct SortFragLess
+    {
+        inline bool operator()(const SortFrag& lhs, const SortFrag& rhs) const
+        {
+            if(lhs.key < rhs.key) return true;
+            if(rhs.key < lhs.key) return false;
+            if(lhs.paired != rhs.paired) return lhs.paired;
+            if(lhs.sumBaseQual != rhs.sumBaseQual) 
+                return(lhs.sumBaseQual > rhs.sumBaseQual);
+            return(lhs.recordIndex < rhs.recordIndex);
+        }
+    };
+
+    // A paired record, sorted to find its mate.  Mates are both at
+    // meetPos, the later of the record's and its mate's positions, and
+    // have the same read name hash.
+    struct SortMate
+    {
+        uint64_t meetPos;
+        uint64_t nameHash;
+        uint64_t recordIndex;
+        DupKey key;
+        int32_t sumBaseQual;
+        int32_t mateRefID;
+    };
+
+    struct SortMateLess
+    {
+        inline bool operator()(const SortMate& lhs, const SortMate& rhs) const
+        {
+            if(lhs.meetPos != rhs.meetPos) return(lhs.meetPos < rhs.meetPos);
+            if(lhs.nameHash != rhs.nameHash) return(lhs.nameHash < rhs.nameHash);
+            return(lhs.recordIndex < rhs.recordIndex);
+        }
+    };
+
+    struct SortPair
+    {
+        PairedKey key;
+        int32_t sumBaseQual;
+        uint64_t record1Index;
+        uint64_t record2Index;
+    };
+
+    // Order by key, then the pair that is kept first: highest quality,
+    // then earliest record1.
+    struct SortPairLess
+    {
+        inline bool operator()(const SortPair& lhs, const SortPair& rhs) const
+        {
+            PairedKeyComparator keyLess;
+            if(keyLess(lhs.key, rhs.key)) return true;
+            if(keyLess(rhs.key, lhs.key)) return false;
+            if(lhs.sumBaseQual != rhs.sumBaseQual) 
+                return(lhs.sumBaseQual > rhs.sumBaseQual);
+            return(lhs.record1Index < rhs.record1Index);
+        }
+    };
+
+    struct IndexLess
+    {
+        inline bool operator()(uint64_t lhs, uint64_t rhs) const
+        {
+            return(lhs < rhs);
+        }
+    };
+
     // A map from read group IDs to its libraryID
     typedef std::map< std::string, uint32_t, std::less<std::string> > StringToInt32Map;
     StringToInt32Map rgidLibMap;
+    // Read group IDs (from the header) & the libraryID of each.
+    ReadGroupDict myReadGroups;
+    std::vector<uint32_t> myRgLibraries;
 
     // A map from the key of a single read to its read data
     typedef std::map< DupKey, FragData > FragmentMap;
@@ -205,9 +275,7 @@ private:
     PairedMap myPairedMap;
 
     // Stores the record counts of duplicates reads
-    typedef std::vector< uint32_t > Int32Vector;
-    typedef std::vector< uint32_t >::iterator Int32VectorIterator;
-    Int32Vector myDupList;
+    DupBitmap myDupList;
 
     // Recalibrator logic.
     Recab myRecab;
@@ -215,17 +283,34 @@ private:
     bool myOneChrom;
     
     // Pool of sam records.
-    SamRecordPool mySamPool;
+    SamRecordArena mySamPool;
     
     int lastCoordinate;
     int lastReference;
     uint32_t numLibraries;
-    int myNumMissingMate;
+    uint64_t myNumMissingMate;
     bool myForceFlag;
     int myMinQual;
 
+    // Sorted run (--maxMem) duplicate finding.
+    bool mySortDups;
+    uint16_t myExcludeFlags;
+    ExternalSorter<SortFrag, SortFragLess> myFragSorter;
+    ExternalSorter<SortMate, SortMateLess> myMateSorter;
+    ExternalSorter<SortPair, SortPairLess> myPairSorter;
+    // Indices of the duplicates.
+    ExternalSorter<uint64_t, IndexLess> myDupSorter;
+    // Indices of the records that build the recalibration table.
+    ExternalSorter<uint64_t, IndexLess> myRecabSorter;
+    bool myHaveNextDup;
+    uint64_t myNextDup;
+    bool myHaveNextRecab;
+    uint64_t myNextRecab;
+
     static const int DEFAULT_MIN_QUAL;
     static const uint32_t CLIP_OFFSET;
+    // Most references that fit in a DupKey.
+    static const int32_t MAX_KEY_REFERENCES = 1 << 23;
 
     // Once record is read, look back at previous reads and determine 
     // if any no longer need to be kept for duplicate checking.
@@ -237,7 +322,23 @@ private:
     
     // When a record is read, check if it is a duplicate or
     // store for future checking.
-    void checkDups(SamRecord & record, uint32_t recordCount);
+    void checkDups(SamRecord & record, uint64_t recordCount);
+
+    // With --maxMem, add the sort records for a record that is checked
+    // for duplicates.
+    void addSortRecords(SamRecord & record, uint64_t recordCount);
+
+    // With --maxMem, sort the records added by addSortRecords to find
+    // the duplicates and the records used for recalibration.
+    void findSortedDups();
+
+    // With --maxMem, make a pass through the input building the
+    // recalibration table from the records found by findSortedDups.
+    void buildSortedRecab(const String& inFile);
+
+    // Return whether or not the record at index is a duplicate, indices
+    // must be checked in increasing order.
+    bool isDuplicate(uint64_t index);
 
     // Add the base qualities in a read
     int getBaseQuality(SamRecord& record);
@@ -257,30 +358,30 @@ private:
     // including calling handleNonDuplicate. 
     void handleMissingMate(int32_t refID, int32_t mateRefID);
 
-    void handleDuplicate(uint32_t index);
+    void handleDuplicate(uint64_t index);
 
-    inline int getFirstIndex(const DupKey& key1, 
-                             int key1Index,
-                             const DupKey& key2,
-                             int key2Index)
+    inline uint64_t getFirstIndex(const DupKey& key1, 
+                                  uint64_t key1Index,
+                                  const DupKey& key2,
+                                  uint64_t key2Index)
     {
-        if(key1.reference < key2.reference)
+        if(key1.getReference() < key2.getReference())
         {
             // key1 has a smaller chromosome
             return(key1Index);
         }
-        if(key1.reference > key2.reference)
+        if(key1.getReference() > key2.getReference())
         {
             // key2 has a smaller chromosome
             return(key2Index);
         }
         // Same chromosome, so check the coordinate.
-        if(key1.coordinate < key2.coordinate)
+        if(key1.getCoordinate() < key2.getCoordinate())
         {
             // key1 has a smaller coordinate
             return(key1Index);
         }
-        if(key1.coordinate < key2.coordinate)
+        if(key1.getCoordinate() < key2.getCoordinate())
         {
             // key2 has a smaller coordinate
             return(key2Index);
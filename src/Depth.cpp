@@ -0,0 +1,435 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//////////////////////////////////////////////////////////////////////////
+// This file contains the processing for the executable option "depth"
+// which writes the depth of coverage of a sorted SAM/BAM file.
+
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <stdio.h>
+
+#include "Depth.h"
+#include "ThreadedSamFile.h"
+#include "BgzfFileType.h"
+#include "Pileup.h"
+#include "SamFlag.h"
+#include "Parameters.h"
+
+void Depth::printDepthDescription(std::ostream& os)
+{
+    os << " depth - Write the depth of coverage of a sorted SAM/BAM file as runs of positions with the same depth" << std::endl;
+}
+
+
+void Depth::printDescription(std::ostream& os)
+{
+    printDepthDescription(os);
+}
+
+
+void Depth::printUsage(std::ostream& os)
+{
+    BamExecutable::printUsage(os);
+    os << "\t./bam depth --in <inputFile> [--out <outputFile>] [--bamIndex <bamIndexFile>] [--minMapQual <minMapQ>] [--requiredFlags <integerRequiredFlags>] [--excludeFlags <integerExcludeFlags>] [--noeof] [--params]" << std::endl;
+    os << "\tRequired Parameters:" << std::endl;
+    os << "\t\t--in            : the coordinate sorted SAM/BAM file to calculate the depth of" << std::endl;
+    os << "\tOptional Parameters:" << std::endl;
+    os << "\t\t--out           : the file to write \"chrom<tab>start<tab>end<tab>depth\" lines to," << std::endl;
+    os << "\t\t                  one per run of positions with the same non-zero depth." << std::endl;
+    os << "\t\t                  Positions are 0 based and the end is not included in the run." << std::endl;
+    os << "\t\t                  Defaults to stdout." << std::endl;
+    os << "\t\t--bamIndex      : the path/name of the bam index file used to process the" << std::endl;
+    os << "\t\t                  file in shards on multiple --threads" << std::endl;
+    os << "\t\t                  (if not specified, uses the --in value + \".bai\")" << std::endl;
+    os << "\t\t--minMapQual    : The minimum mapping quality of the reads counted in the depth." << std::endl;
+    os << "\t\t--excludeFlags  : Skip any records with any of the specified flags set\n";
+    os << "\t\t                  (specify an integer representation of the flags)\n";
+    os << "\t\t--requiredFlags : Only process records with all of the specified flags set\n";
+    os << "\t\t                  (specify an integer representation of the flags)\n";
+    os << "\t\t--noeof         : Do not expect an EOF block on a bam file." << std::endl;
+    os << "\t\t--params        : Print the parameter settings." << std::endl;
+    os << "\tThe depth is the Depth of stats --cBaseQC: the number of bases aligned to a" << std::endl;
+    os << "\tposition, excluding duplicates, QC failures, and mapping qualities of 255." << std::endl;
+    os << std::endl;
+}
+
+
+int Depth::execute(int argc, char **argv)
+{
+    // Extract command line arguments.
+    String inFile = "";
+    String outFile = "-";
+    String indexFile = "";
+    int minMapQual = 0;
+    int excludeFlags = 0;
+    int requiredFlags = 0;
+    bool noeof = false;
+    bool params = false;
+
+    ParameterList inputParameters;
+    BEGIN_LONG_PARAMETERS(longParameterList)
+        LONG_PARAMETER_GROUP("Required Parameters")
+        LONG_STRINGPARAMETER("in", &inFile)
+        LONG_PARAMETER_GROUP("Optional Parameters")
+        LONG_STRINGPARAMETER("out", &outFile)
+        LONG_STRINGPARAMETER("bamIndex", &indexFile)
+        LONG_INTPARAMETER("minMapQual", &minMapQual)
+        LONG_INTPARAMETER("excludeFlags", &excludeFlags)
+        LONG_INTPARAMETER("requiredFlags", &requiredFlags)
+        LONG_PARAMETER("noeof", &noeof)
+        LONG_PARAMETER("params", &params)
+        LONG_PHONEHOME(VERSION)
+        END_LONG_PARAMETERS();
+   
+    inputParameters.Add(new LongParameters ("Input Parameters", 
+                                            longParameterList));
+
+    // parameters start at index 2 rather than 1.
+    inputParameters.Read(argc, argv, 2);
+
+    // If no eof block is required for a bgzf file, set the bgzf file type to 
+    // not look for it.
+    if(noeof)
+    {
+        // Set that the eof block is not required.
+        BgzfFileType::setRequireEofBlock(false);
+    }
+
+    // Check to see if the in file was specified, if not, report an error.
+    if(inFile == "")
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        // In file was not specified but it is mandatory.
+        std::cerr << "--in is a mandatory argument for depth, "
+                  << "but was not specified" << std::endl;
+        return(-1);
+    }
+
+    if(params)
+    {
+        inputParameters.Status();
+    }
+
+    myMinMapQual = minMapQual;
+    myRequiredFlags = requiredFlags;
+    myExcludeFlags = excludeFlags;
+
+    IFILE output = ifopen(outFile, "w");
+    if(output == NULL)
+    {
+        std::cerr << "ERROR: Failed to open " << outFile << std::endl;
+        return(SamStatus::FAIL_IO);
+    }
+
+    // Process an indexed BAM on multiple threads.
+    int status = SamStatus::SUCCESS;
+    bool byShard = false;
+    SamFileHeader header;
+    if(BamExecutable::getNumThreads() > 1)
+    {
+        SamFile indexCheck(ErrorHandler::RETURN);
+        byShard = indexCheck.OpenForRead(inFile, &header) &&
+            (indexFile.IsEmpty() ? indexCheck.ReadBamIndex() :
+             indexCheck.ReadBamIndex(indexFile));
+        if(!byShard)
+        {
+            std::cerr << "Input is not an indexed BAM file, so calculating the depth on one thread.\n";
+        }
+    }
+    if(byShard)
+    {
+        depthByShard(inFile, indexFile, header, output);
+    }
+    else
+    {
+        status = depthByFile(inFile, output);
+    }
+    ifclose(output);
+    return(status);
+}
+
+
+bool Depth::isCounted(SamRecord& record)
+{
+    uint16_t flag = record.getFlag();
+    if(SamFlag::isDuplicate(flag) || SamFlag::isQCFailure(flag) ||
+       !SamFlag::isMapped(flag))
+    {
+        return(false);
+    }
+    int mapQ = record.getMapQuality();
+    return((mapQ != 255) && (mapQ >= myMinMapQual));
+}
+
+
+void Depth::formatRuns(const DepthPileup::Run* runs, size_t numRuns,
+                       std::string& output)
+{
+    char line[64];
+    for(size_t i = 0; i < numRuns; i++)
+    {
+        const DepthPileup::Run& run = runs[i];
+        output += myRefNames[run.refID];
+        int len = snprintf(line, sizeof(line), "\t%d\t%d\t%d\n",
+                           run.start, run.end, run.depth);
+        output.append(line, len);
+    }
+}
+
+
+int Depth::depthByFile(const String& inFile, IFILE output)
+{
+    ThreadedSamFile samIn;
+    if(!samIn.OpenForRead(inFile))
+    {
+        fprintf(stderr, "%s\n", samIn.GetStatusMessage());
+        return(samIn.GetStatus());
+    }
+    // If the file isn't sorted it will throw an exception.
+    samIn.setSortedValidation(SamFile::COORDINATE);
+    samIn.SetReadFlags(myRequiredFlags, myExcludeFlags);
+
+    SamFileHeader header;
+    if(!samIn.ReadHeader(header))
+    {
+        fprintf(stderr, "%s\n", samIn.GetStatusMessage());
+        return(samIn.GetStatus());
+    }
+    const SamReferenceInfo& refInfo = header.getReferenceInfo();
+    myRefNames.clear();
+    for(int refID = 0; refID < refInfo.getNumEntries(); refID++)
+    {
+        myRefNames.push_back(refInfo.getReferenceName(refID).c_str());
+    }
+
+    DepthPileup pileup(PileupHelper::DEFAULT_WINDOW_SIZE);
+    std::vector<DepthPileup::Run>& runs = pileup.getRuns();
+    std::string text;
+    SamRecord samRecord;
+    while(samIn.ReadRecord(header, samRecord))
+    {
+        if(isCounted(samRecord))
+        {
+            pileup.addRecord(samRecord, 0, -1);
+        }
+        if(runs.size() >= RUN_BATCH_SIZE)
+        {
+            formatRuns(&(runs[0]), runs.size(), text);
+            ifwrite(output, text.c_str(), text.size());
+            text.clear();
+            runs.clear();
+        }
+    }
+    pileup.flush();
+    if(!runs.empty())
+    {
+        formatRuns(&(runs[0]), runs.size(), text);
+        ifwrite(output, text.c_str(), text.size());
+    }
+
+    if(samIn.GetStatus() != SamStatus::NO_MORE_RECS)
+    {
+        fprintf(stderr, "%s\n", samIn.GetStatusMessage());
+        return(samIn.GetStatus());
+    }
+    return(SamStatus::SUCCESS);
+}
+
+
+void Depth::depthByShard(const String& inFile, const String& indexFile,
+                         SamFileHeader& header, IFILE output)
+{
+    // Split each reference into shards.  Unmapped reads have no depth.
+    std::vector<Shard> shards;
+    const SamReferenceInfo& refInfo = header.getReferenceInfo();
+    myRefNames.clear();
+    for(int refID = 0; refID < refInfo.getNumEntries(); refID++)
+    {
+        myRefNames.push_back(refInfo.getReferenceName(refID).c_str());
+        int32_t refLen = refInfo.getReferenceLength(refID);
+        int32_t start = 0;
+        for(; (start + SHARD_SIZE) < refLen; start += SHARD_SIZE)
+        {
+            shards.push_back(Shard(refID, start, start + SHARD_SIZE));
+        }
+        // The last shard goes to the end of the reference.
+        shards.push_back(Shard(refID, start, -1));
+    }
+
+    // Workers process the next shard that has not been started, but
+    // do not get more than maxAhead shards ahead of the results that have
+    // been written, so the output held in memory is bounded.
+    int numWorkers = BamExecutable::getNumThreads();
+    unsigned int maxAhead = 2 * numWorkers;
+    std::mutex shardLock;
+    std::condition_variable shardCond;
+    unsigned int nextShard = 0;
+    unsigned int numWritten = 0;
+    std::vector<bool> done(shards.size(), false);
+    bool failed = false;
+
+    std::vector< std::future<void> > workers;
+    for(int w = 0; w < numWorkers; w++)
+    {
+        workers.push_back(BamExecutable::getThreadPool().submit([&]()
+            {
+                try
+                {
+                    SamFile samIn;
+                    SamFileHeader shardHeader;
+                    samIn.OpenForRead(inFile, &shardHeader);
+                    if(indexFile.IsEmpty())
+                    {
+                        samIn.ReadBamIndex();
+                    }
+                    else
+                    {
+                        samIn.ReadBamIndex(indexFile);
+                    }
+                    samIn.SetReadFlags(myRequiredFlags, myExcludeFlags);
+                    while(true)
+                    {
+                        unsigned int shard;
+                        {
+                            std::unique_lock<std::mutex> guard(shardLock);
+                            shardCond.wait(guard, [&]()
+                                           { return(failed || 
+                                                    (nextShard < numWritten + maxAhead)); });
+                            if(failed || (nextShard >= shards.size()))
+                            {
+                                return;
+                            }
+                            shard = nextShard++;
+                        }
+                        processShard(samIn, shardHeader, shards[shard]);
+                        std::lock_guard<std::mutex> guard(shardLock);
+                        done[shard] = true;
+                        shardCond.notify_all();
+                    }
+                }
+                catch(...)
+                {
+                    std::lock_guard<std::mutex> guard(shardLock);
+                    failed = true;
+                    shardCond.notify_all();
+                    throw;
+                }
+            }));
+    }
+
+    // Write the runs of each shard in order, joining the runs that
+    // continue across the shard boundaries.
+    DepthPileup::Run pending = {-1, 0, 0, 0};
+    std::string text;
+    for(unsigned int i = 0; i < shards.size(); i++)
+    {
+        {
+            std::unique_lock<std::mutex> guard(shardLock);
+            shardCond.wait(guard, [&]() { return(failed || done[i]); });
+            if(failed)
+            {
+                break;
+            }
+        }
+        Shard& shard = shards[i];
+        if(!shard.edges.empty())
+        {
+            const DepthPileup::Run& first = shard.edges[0];
+            if((pending.refID == first.refID) && 
+               (pending.end == first.start) && (pending.depth == first.depth))
+            {
+                pending.end = first.end;
+            }
+            else
+            {
+                if(pending.refID != -1)
+                {
+                    formatRuns(&pending, 1, text);
+                }
+                pending = first;
+            }
+            if(shard.edges.size() > 1)
+            {
+                formatRuns(&pending, 1, text);
+                text += shard.text;
+                pending = shard.edges[1];
+            }
+            ifwrite(output, text.c_str(), text.size());
+            text.clear();
+        }
+        std::string().swap(shard.text);
+
+        std::lock_guard<std::mutex> guard(shardLock);
+        ++numWritten;
+        shardCond.notify_all();
+    }
+    if(pending.refID != -1)
+    {
+        formatRuns(&pending, 1, text);
+        ifwrite(output, text.c_str(), text.size());
+    }
+
+    // Wait for the workers, rethrowing any failure.
+    for(unsigned int i = 0; i < workers.size(); i++)
+    {
+        workers[i].wait();
+    }
+    for(unsigned int i = 0; i < workers.size(); i++)
+    {
+        workers[i].get();
+    }
+}
+
+
+void Depth::processShard(SamFile& samIn, SamFileHeader& header, Shard& shard)
+{
+    samIn.SetReadSection(shard.refID, shard.start, shard.end);
+
+    DepthPileup pileup(PileupHelper::DEFAULT_WINDOW_SIZE);
+    SamRecord samRecord;
+    while(samIn.ReadRecord(header, samRecord))
+    {
+        // Only the part of the reads in this shard is piled up.
+        if(isCounted(samRecord))
+        {
+            pileup.addRecord(samRecord, shard.start, shard.end);
+        }
+    }
+    pileup.flush();
+
+    if(samIn.GetStatus() != SamStatus::NO_MORE_RECS)
+    {
+        throw(std::runtime_error(samIn.GetStatusMessage()));
+    }
+
+    // Keep the first and last runs to join with the adjacent shards.
+    std::vector<DepthPileup::Run>& runs = pileup.getRuns();
+    if(!runs.empty())
+    {
+        shard.edges.push_back(runs[0]);
+    }
+    if(runs.size() > 1)
+    {
+        formatRuns(&(runs[1]), runs.size() - 2, shard.text);
+        shard.edges.push_back(runs.back());
+    }
+}
@@ -0,0 +1,87 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//////////////////////////////////////////////////////////////////////////
+// This file contains the processing for the executable option "depth"
+// which writes the depth of coverage of a sorted SAM/BAM file.
+
+#ifndef __DEPTH_H__
+#define __DEPTH_H__
+
+#include <string>
+#include <vector>
+
+#include "BamExecutable.h"
+#include "DepthPileup.h"
+#include "SamFile.h"
+
+class Depth : public BamExecutable
+{
+public:
+    static void printDepthDescription(std::ostream& os);
+    void printDescription(std::ostream& os);
+    void printUsage(std::ostream& os);
+    int execute(int argc, char **argv);
+    virtual const char* getProgramName() {return("bam:depth");}
+
+private:
+    // Size of the regions processed on separate threads.
+    static const int32_t SHARD_SIZE = 1000000;
+    // Number of runs collected before they are written.
+    static const unsigned int RUN_BATCH_SIZE = 65536;
+
+    // Region of the file processed on one thread and its results: the
+    // first & last runs, which may continue into the adjacent shards,
+    // and the text of the runs between them.
+    struct Shard
+    {
+        int32_t refID;
+        int32_t start;
+        int32_t end;
+        std::vector<DepthPileup::Run> edges;
+        std::string text;
+        Shard(int32_t ref, int32_t startPos, int32_t endPos)
+            : refID(ref), start(startPos), end(endPos) {}
+    };
+
+    // Returns whether the bases of the record are counted in the depth,
+    // the same as the Depth of the stats baseQC.
+    bool isCounted(SamRecord& record);
+
+    // Append the runs to the output as "chrom start end depth" lines.
+    void formatRuns(const DepthPileup::Run* runs, size_t numRuns,
+                    std::string& output);
+
+    // Read the file on this thread, writing the runs to the output.
+    // Returns the status of reading the file.
+    int depthByFile(const String& inFile, IFILE output);
+
+    // Read the indexed file on the thread pool a shard at a time,
+    // writing the runs to the output in order.
+    void depthByShard(const String& inFile, const String& indexFile,
+                      SamFileHeader& header, IFILE output);
+
+    void processShard(SamFile& samIn, SamFileHeader& header, Shard& shard);
+
+    int myMinMapQual;
+    int myRequiredFlags;
+    int myExcludeFlags;
+    std::vector<std::string> myRefNames;
+};
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdexcept>
+
+#include "DepthPileup.h"
+
+DepthPileup::DepthPileup(int windowSize)
+    : myDiffs(),
+      myMask(0),
+      myRefID(-1),
+      myStartPos(0),
+      myEndPos(-1),
+      myDepth(0),
+      myRunStart(0),
+      myRuns()
+{
+    int32_t size = 1;
+    while(size < windowSize)
+    {
+        size <<= 1;
+    }
+    myDiffs.resize(size, 0);
+    myMask = size - 1;
+}
+
+
+void DepthPileup::addRecord(SamRecord& record,
+                            int32_t startPos, int32_t endPos)
+{
+    int32_t refID = record.getReferenceID();
+    if(refID != myRefID)
+    {
+        // New reference, so flush the previous one.
+        flush();
+        myRefID = refID;
+    }
+
+    int32_t position = record.get0BasedPosition();
+    flush((position < startPos) ? startPos : position);
+    if(startPos < myStartPos)
+    {
+        // Earlier positions were already passed.
+        startPos = myStartPos;
+    }
+
+    Cigar* cigar = record.getCigarInfo();
+    if(cigar == NULL)
+    {
+        throw std::runtime_error("Failed to retrieve cigar info from the record.");
+    }
+    for(int i = 0; i < cigar->size(); i++)
+    {
+        const Cigar::CigarOperator& op = (*cigar)[i];
+        switch(op.operation)
+        {
+            case Cigar::match:
+            case Cigar::mismatch:
+            {
+                int32_t start = (position < startPos) ? startPos : position;
+                int32_t end = position + op.count;
+                if((endPos != -1) && (end > endPos))
+                {
+                    end = endPos;
+                }
+                if(start < end)
+                {
+                    reserve(end);
+                    ++myDiffs[slot(start)];
+                    --myDiffs[slot(end)];
+                }
+                position += op.count;
+                break;
+            }
+            case Cigar::del:
+            case Cigar::skip:
+                // Deletions are not counted in the depth.
+                position += op.count;
+                break;
+            default:
+                // Insertions, clips, & pads are not on the reference.
+                break;
+        }
+    }
+}
+
+
+void DepthPileup::flush()
+{
+    flush(myEndPos + 1);
+    myStartPos = 0;
+    myEndPos = -1;
+}
+
+
+void DepthPileup::flush(int32_t position)
+{
+    int32_t lastPos = position - 1;
+    if(lastPos > myEndPos)
+    {
+        lastPos = myEndPos;
+    }
+    for(int32_t pos = myStartPos; pos <= lastPos; ++pos)
+    {
+        int32_t& change = myDiffs[slot(pos)];
+        if(change == 0)
+        {
+            continue;
+        }
+        // The depth changes, so end the run.
+        if(myDepth != 0)
+        {
+            Run run = {myRefID, myRunStart, pos, myDepth};
+            myRuns.push_back(run);
+        }
+        myDepth += change;
+        myRunStart = pos;
+        change = 0;
+    }
+
+    if(position > myStartPos)
+    {
+        myStartPos = position;
+    }
+    if(myEndPos < myStartPos)
+    {
+        myEndPos = myStartPos - 1;
+    }
+}
+
+
+void DepthPileup::reserve(int32_t position)
+{
+    int32_t needed = position - myStartPos + 1;
+    int32_t size = myDiffs.size();
+    if(needed > size)
+    {
+        int32_t newSize = size;
+        while(newSize < needed)
+        {
+            newSize <<= 1;
+        }
+        std::vector<int32_t> newDiffs(newSize, 0);
+        int32_t newMask = newSize - 1;
+        for(int32_t pos = myStartPos; pos <= myEndPos; ++pos)
+        {
+            newDiffs[pos & newMask] = myDiffs[slot(pos)];
+        }
+        myDiffs.swap(newDiffs);
+        myMask = newMask;
+    }
+    if(position > myEndPos)
+    {
+        myEndPos = position;
+    }
+}
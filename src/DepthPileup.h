@@ -0,0 +1,80 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __DEPTH_PILEUP_H__
+#define __DEPTH_PILEUP_H__
+
+#include <stdint.h>
+#include <vector>
+
+#include "SamRecord.h"
+
+/// Piles up the depth of the aligned bases of records as runs of positions
+/// with the same depth.  Each match/mismatch block of a record's cigar
+/// adds to a difference array at its start and subtracts at its end, so
+/// there is no per position element, and the depth only needs to be
+/// compared as the positions are passed.
+class DepthPileup
+{
+public:
+    /// Positions [start, end) of a reference with the same non-zero depth.
+    struct Run
+    {
+        int32_t refID;
+        int32_t start;
+        int32_t end;
+        int32_t depth;
+    };
+
+    DepthPileup(int windowSize);
+
+    /// Add the aligned bases of the record between startPos and endPos
+    /// (endPos of -1 means to the end of the reference).
+    /// Records must be sorted.
+    void addRecord(SamRecord& record, int32_t startPos, int32_t endPos);
+
+    /// End the runs of the positions that are still in the pileup.
+    void flush();
+
+    /// The runs that have ended, in order.  Adjacent runs have different
+    /// depths.  The caller removes the runs it has output.
+    std::vector<Run>& getRuns() { return(myRuns); }
+
+private:
+    // Pass the positions prior to the specified position.
+    void flush(int32_t position);
+    // Make room for changes up to and including the specified position.
+    void reserve(int32_t position);
+    int32_t slot(int32_t position) { return(position & myMask); }
+
+    // Per position changes to the depth.
+    std::vector<int32_t> myDiffs;
+    int32_t myMask;
+
+    int32_t myRefID;
+    // First position still in the pileup & last position with any changes.
+    int32_t myStartPos;
+    int32_t myEndPos;
+    // Depth of the positions passed since myRunStart.
+    int32_t myDepth;
+    int32_t myRunStart;
+
+    std::vector<Run> myRuns;
+};
+
+#endif
@@ -27,6 +27,17 @@
 #include "SamTags.h"
 #include "SamFlag.h"
 #include "SamRecordHelper.h"
+#include "ParallelBgzf.h"
+#include "ReadNameMap.h"
+#include "MemoryBudget.h"
+#include <atomic>
+#include <deque>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
 
 const char* Diff::FLAG_DIFF_TAG = "ZF";
 const char* Diff::POS_DIFF_TAG = "ZP";
@@ -39,7 +50,7 @@ const char* Diff::QUAL_DIFF_TAG = "ZQ";
 const char* Diff::TAGS_DIFF_TAG = "ZT";
 
 Diff::Diff()
-    : myFreeSamRecords(),
+    : myRecordArena(),
       myFile1Unmatched(),
       myFile2Unmatched(),
       myCompAll(false),
@@ -55,7 +66,6 @@ Diff::Diff()
       myOnlyDiffs(false),
       myBamOut(false),
       myMaxAllowedRecs(1000000),
-      myAllocatedRecs(0),
       myThreshold(100000),
       myNumPoolOverflows(0),
       myFile1(),
@@ -100,7 +110,7 @@ void Diff::printDescription(std::ostream& os)
 void Diff::printUsage(std::ostream& os)
 {
     BamExecutable::printUsage(os);
-    os << "\t./bam diff --in1 <inputFile> --in2 <inputFile> [--out <outputFile>] [--all] [--flag] [--mapQual] [--mate] [--isize] [--seq] [--baseQual] [--tags <Tag:Type[,Tag:Type]*>] [--everyTag] [--noCigar] [--noPos] [--onlyDiffs] [--recPoolSize <int>] [--posDiff <int>] [--noeof] [--params]" << std::endl;
+    os << "\t./bam diff --in1 <inputFile> --in2 <inputFile> [--out <outputFile>] [--all] [--flag] [--mapQual] [--mate] [--isize] [--seq] [--baseQual] [--tags <Tag:Type[,Tag:Type]*>] [--everyTag] [--noCigar] [--noPos] [--onlyDiffs] [--recPoolSize <int>] [--posDiff <int>] [--byName [--buckets <int>] [--tmpPrefix <prefix>]] [--noeof] [--params]" << std::endl;
     os << "\tRequired Parameters:" << std::endl;
     os << "\t\t--in1         : first coordinate sorted SAM/BAM file to be diffed" << std::endl;
     os << "\t\t--in2         : second coordinate sorted SAM/BAM file to be diffed" << std::endl;
@@ -124,7 +134,14 @@ void Diff::printUsage(std::ostream& os)
     os << "\t\t--onlyDiffs   : only print the fields that are different, otherwise for any diff all the fields that are compared are printed." << std::endl;
     os << "\t\t--recPoolSize : number of records to allow to be stored at a time, default value: " << myMaxAllowedRecs << std::endl;
     os << "\t\t                Set to -1 for unlimited number of records" << std::endl;
+    os << "\t\t                The records are also limited by --maxMem when it is set." << std::endl;
     os << "\t\t--posDiff     : max base pair difference between possibly matching records, default value: " << myThreshold << std::endl;
+    os << "\t\t--byName      : match records by read name regardless of how the files are sorted." << std::endl;
+    os << "\t\t                The records are split by read name into temporary bucket files and the" << std::endl;
+    os << "\t\t                buckets are diffed in parallel, so --recPoolSize and --posDiff are not used." << std::endl;
+    os << "\t\t                The diffs are written grouped by bucket rather than in file order." << std::endl;
+    os << "\t\t--buckets     : with --byName, number of temporary buckets per input file, default value: " << DEFAULT_NUM_BUCKETS << std::endl;
+    os << "\t\t--tmpPrefix   : with --byName, prefix for the temporary files (default: $TMPDIR/bamDiff.<pid>)" << std::endl;
     os << "\t\t--noeof       : do not expect an EOF block on a bam file." << std::endl;
     os << "\t\t--params      : print the parameter settings" << std::endl;
     os << std::endl;
@@ -140,6 +157,9 @@ int Diff::execute(int argc, char **argv)
     bool noPos = false;
     bool noeof = false;
     bool params = false;
+    bool byName = false;
+    int numBuckets = DEFAULT_NUM_BUCKETS;
+    String tmpPrefix = "";
     myNumPoolOverflows = 0;
 
     ParameterList inputParameters;
@@ -161,6 +181,9 @@ int Diff::execute(int argc, char **argv)
         LONG_PARAMETER("onlyDiffs", &myOnlyDiffs)
         LONG_INTPARAMETER("recPoolSize", &myMaxAllowedRecs)
         LONG_INTPARAMETER("posDiff", &myThreshold)
+        LONG_PARAMETER("byName", &byName)
+        LONG_INTPARAMETER("buckets", &numBuckets)
+        LONG_STRINGPARAMETER("tmpPrefix", &tmpPrefix)
         LONG_PARAMETER("noeof", &noeof)
         LONG_PARAMETER("params", &params)
         LONG_PHONEHOME(VERSION)
@@ -174,6 +197,8 @@ int Diff::execute(int argc, char **argv)
     
     myCompCigar = !noCigar;
     myCompPos = !noPos;
+    myRecordArena.setMaxAllocatedRecs(myMaxAllowedRecs);
+    myRecordArena.setLimitByBudget(true);
 
     // If all is specified, turn all comparisons on.
     if(myCompAll)
@@ -260,6 +285,22 @@ int Diff::execute(int argc, char **argv)
     }
 
 
+    if(byName && (numBuckets < 1))
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        std::cerr << "--buckets must be at least 1" << std::endl;
+        return(-1);
+    }
+
+    if(tmpPrefix.IsEmpty())
+    {
+        const char* tmpDir = getenv("TMPDIR");
+        tmpPrefix = (tmpDir == NULL) ? "/tmp" : tmpDir;
+        tmpPrefix += "/bamDiff.";
+        tmpPrefix += (int)getpid();
+    }
+
     if(params)
     {
         inputParameters.Status();
@@ -273,6 +314,11 @@ int Diff::execute(int argc, char **argv)
     myFile1.file.ReadHeader(myFile1.header);
     myFile2.file.ReadHeader(myFile2.header);
 
+    if(byName)
+    {
+        return(diffByName(tmpPrefix, numBuckets));
+    }
+
     SamRecord* tempRecord = NULL;
 
     bool need1 = true;
@@ -444,6 +490,10 @@ int Diff::execute(int argc, char **argv)
         std::cerr << ".\nTry increasing --recPoolSize from "
                   << myMaxAllowedRecs << " or setting it "
                   << "to -1 (unlimited).\n";
+        if(MemoryBudget::hasLimit())
+        {
+            std::cerr << "The records are also limited by --maxMem.\n";
+        }
     }
 
 
@@ -462,6 +512,341 @@ int Diff::execute(int argc, char **argv)
 }
 
 
+// Read the next record from a bucket file into record, returning false
+// at the end of the file.  Throws std::runtime_error on a failure.
+static bool readBucketRecord(ParallelBgzfReader& bucketIn,
+                             std::vector<char>& buffer,
+                             SamFileHeader& header, SamRecord& record)
+{
+    uint32_t blockSize = 0;
+    uint32_t numRead = bucketIn.read(&blockSize, sizeof(blockSize));
+    if(numRead == 0)
+    {
+        return(false);
+    }
+    buffer.resize(sizeof(blockSize) + blockSize);
+    memcpy(&(buffer[0]), &blockSize, sizeof(blockSize));
+    if((numRead != sizeof(blockSize)) ||
+       (bucketIn.read(&(buffer[sizeof(blockSize)]), blockSize) != blockSize))
+    {
+        throw(std::runtime_error("Truncated record in a diff bucket file"));
+    }
+    if(record.setBuffer(&(buffer[0]), buffer.size(), header) != 
+       SamStatus::SUCCESS)
+    {
+        throw(std::runtime_error("Failed to parse a record in a diff bucket file"));
+    }
+    return(true);
+}
+
+
+int Diff::diffByName(const String& tmpPrefix, int numBuckets)
+{
+    FileInfo* inputs[2] = {&myFile1, &myFile2};
+    std::vector<std::string> bucketNames[2];
+    std::vector<std::string> diffNames;
+    std::vector<std::string> only1Names;
+    std::vector<std::string> only2Names;
+    for(int i = 0; i < numBuckets; i++)
+    {
+        std::string bucketPrefix = 
+            std::string(tmpPrefix.c_str()) + "." + std::to_string(i);
+        bucketNames[0].push_back(bucketPrefix + ".in1.bgzf");
+        bucketNames[1].push_back(bucketPrefix + ".in2.bgzf");
+        if(myBamOut)
+        {
+            diffNames.push_back(bucketPrefix + ".diff.ubam");
+            only1Names.push_back(bucketPrefix + ".only1.ubam");
+            only2Names.push_back(bucketPrefix + ".only2.ubam");
+        }
+        else
+        {
+            diffNames.push_back(bucketPrefix + ".diff.txt");
+        }
+    }
+    std::vector<std::string>* tempNames[5] = 
+        {&bucketNames[0], &bucketNames[1], &diffNames, &only1Names, &only2Names};
+
+    // Split the records of each input by the hash of their read name,
+    // so matching records end up in the same numbered bucket.
+    int status = 0;
+    for(int input = 0; (input < 2) && (status == 0); input++)
+    {
+        std::unique_ptr<ParallelBgzfWriter[]> bucketOut(new ParallelBgzfWriter[numBuckets]);
+        bool written = true;
+        for(int i = 0; i < numBuckets; i++)
+        {
+            if(!bucketOut[i].open(bucketNames[input][i].c_str(),
+                                  getThreadPool(), 2))
+            {
+                std::cerr << "ERROR: Failed to open " << bucketNames[input][i]
+                          << " for writing" << std::endl;
+                written = false;
+                break;
+            }
+            bucketOut[i].setCompressionLevel(1);
+        }
+
+        FileInfo& inFile = *(inputs[input]);
+        SamRecord record;
+        while(written && inFile.file.ReadRecord(inFile.header, record))
+        {
+            // The record buffer starts with the block size.
+            const char* buffer = (const char*)
+                record.getRecordBuffer(SamRecord::NONE);
+            if(buffer == NULL)
+            {
+                std::cerr << "ERROR: Failed to get the BAM record buffer"
+                          << std::endl;
+                written = false;
+                break;
+            }
+            int32_t blockSize = 0;
+            memcpy(&blockSize, buffer, sizeof(blockSize));
+            uint64_t hash1 = 0;
+            uint64_t hash2 = 0;
+            ReadNameMap::hashName(record.getReadName(), hash1, hash2);
+            if(!bucketOut[hash1 % numBuckets].write(buffer, blockSize + 
+                                                    sizeof(blockSize)))
+            {
+                std::cerr << "ERROR: Failed to write " 
+                          << bucketNames[input][hash1 % numBuckets] 
+                          << std::endl;
+                written = false;
+            }
+        }
+        for(int i = 0; i < numBuckets; i++)
+        {
+            if(bucketOut[i].isOpen() && !bucketOut[i].close() && written)
+            {
+                std::cerr << "ERROR: Failed to write " << bucketNames[input][i]
+                          << std::endl;
+                written = false;
+            }
+        }
+        if(!written)
+        {
+            status = -1;
+        }
+        else if(inFile.file.GetStatus() != SamStatus::NO_MORE_RECS)
+        {
+            // Error.
+            status = inFile.file.GetStatus();
+        }
+    }
+
+    // Diff each pair of buckets on the thread pool, each into its own
+    // output files.
+    if(status == 0)
+    {
+        int numWorkers = getNumThreads();
+        if(numWorkers > numBuckets)
+        {
+            numWorkers = numBuckets;
+        }
+        std::atomic<unsigned int> nextBucket(0);
+        try
+        {
+            runWorkers([&]()
+                {
+                    unsigned int bucket;
+                    while((bucket = nextBucket++) < (unsigned int)numBuckets)
+                    {
+                        Diff bucketDiff;
+                        bucketDiff.copySettings(*this);
+                        if(myBamOut)
+                        {
+                            bucketDiff.myBamDiffName = diffNames[bucket].c_str();
+                            bucketDiff.myBamOnly1Name = only1Names[bucket].c_str();
+                            bucketDiff.myBamOnly2Name = only2Names[bucket].c_str();
+                        }
+                        else
+                        {
+                            bucketDiff.myDiffFileName = diffNames[bucket].c_str();
+                        }
+                        bucketDiff.diffBucket(bucketNames[0][bucket],
+                                              bucketNames[1][bucket]);
+                    }
+                }, numWorkers);
+        }
+        catch(std::exception& e)
+        {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            status = -1;
+        }
+    }
+
+    // Concatenate the bucket outputs in bucket order.
+    for(int i = 0; (i < numBuckets) && (status == 0); i++)
+    {
+        if(myBamOut)
+        {
+            if(!appendBucket(diffNames[i], myBamDiff, myBamDiffName, 
+                             myFile1.header) ||
+               !appendBucket(only1Names[i], myBamOnly1, myBamOnly1Name,
+                             myFile1.header) ||
+               !appendBucket(only2Names[i], myBamOnly2, myBamOnly2Name,
+                             myFile2.header))
+            {
+                status = -1;
+            }
+            continue;
+        }
+        FILE* bucketIn = fopen(diffNames[i].c_str(), "rb");
+        if(bucketIn == NULL)
+        {
+            // No diffs in this bucket.
+            continue;
+        }
+        char buffer[65536];
+        size_t numRead;
+        while((status == 0) && 
+              ((numRead = fread(buffer, 1, sizeof(buffer), bucketIn)) > 0))
+        {
+            if(!checkDiffFile() || 
+               (ifwrite(myDiffFile, buffer, numRead) != numRead))
+            {
+                std::cerr << "ERROR: Failed to write " << myDiffFileName
+                          << std::endl;
+                status = -1;
+            }
+        }
+        fclose(bucketIn);
+    }
+
+    for(int i = 0; i < 5; i++)
+    {
+        for(unsigned int j = 0; j < tempNames[i]->size(); j++)
+        {
+            remove((*(tempNames[i]))[j].c_str());
+        }
+    }
+    return(status);
+}
+
+
+void Diff::diffBucket(const std::string& bucket1Name,
+                      const std::string& bucket2Name)
+{
+    // Records that can still match, keyed by read name and fragment type,
+    // holding indices into file1Recs in file order.
+    std::unordered_map<std::string, std::deque<uint32_t> > unmatched1;
+    std::vector<SamRecord*> file1Recs;
+    std::vector<char> buffer;
+    std::string key;
+
+    ParallelBgzfReader bucketIn;
+    if(!bucketIn.open(bucket1Name.c_str()))
+    {
+        throw(std::runtime_error("Failed to open " + bucket1Name));
+    }
+    SamRecord* record = myRecordArena.getRecord();
+    while(readBucketRecord(bucketIn, buffer, myFile1.header, *record))
+    {
+        key = record->getReadName();
+        key += (char)SamFlag::getFragmentType(record->getFlag());
+        unmatched1[key].push_back(file1Recs.size());
+        file1Recs.push_back(record);
+        record = myRecordArena.getRecord();
+    }
+    bucketIn.close();
+
+    // Stream the second file's records, matching each against the first
+    // unmatched record with the same read name and fragment.
+    if(!bucketIn.open(bucket2Name.c_str()))
+    {
+        throw(std::runtime_error("Failed to open " + bucket2Name));
+    }
+    while(readBucketRecord(bucketIn, buffer, myFile2.header, *record))
+    {
+        key = record->getReadName();
+        key += (char)SamFlag::getFragmentType(record->getFlag());
+        std::unordered_map<std::string, std::deque<uint32_t> >::iterator iter =
+            unmatched1.find(key);
+        if(iter == unmatched1.end())
+        {
+            writeDiffs(NULL, record);
+            continue;
+        }
+        uint32_t index = iter->second.front();
+        iter->second.pop_front();
+        if(iter->second.empty())
+        {
+            unmatched1.erase(iter);
+        }
+        writeDiffs(file1Recs[index], record);
+        myRecordArena.releaseRecord(file1Recs[index]);
+        file1Recs[index] = NULL;
+    }
+    bucketIn.close();
+
+    // Write the first file's records that were not matched.
+    for(unsigned int i = 0; i < file1Recs.size(); i++)
+    {
+        if(file1Recs[i] != NULL)
+        {
+            writeDiffs(file1Recs[i], NULL);
+        }
+    }
+    myRecordArena.releaseAll();
+}
+
+
+void Diff::copySettings(Diff& other)
+{
+    myCompAll = other.myCompAll;
+    myCompCigar = other.myCompCigar;
+    myCompPos = other.myCompPos;
+    myCompBaseQual = other.myCompBaseQual;
+    myCompSeq = other.myCompSeq;
+    myCompFlag = other.myCompFlag;
+    myCompMapQ = other.myCompMapQ;
+    myCompMate = other.myCompMate;
+    myCompISize = other.myCompISize;
+    myTags = other.myTags;
+    myEveryTag = other.myEveryTag;
+    myOnlyDiffs = other.myOnlyDiffs;
+    myBamOut = other.myBamOut;
+    myFile1.header = other.myFile1.header;
+    myFile2.header = other.myFile2.header;
+}
+
+
+bool Diff::appendBucket(const std::string& bucketName, SamFile& out,
+                        const String& outName, SamFileHeader& header)
+{
+    if(access(bucketName.c_str(), F_OK) != 0)
+    {
+        // Nothing was written to this bucket file.
+        return(true);
+    }
+    // The buckets are uncompressed BAM, which is read from a mapping.
+    ThreadedSamFile bucketIn(ErrorHandler::RETURN);
+    SamFileHeader bucketHeader;
+    if(!bucketIn.OpenForRead(bucketName.c_str(), &bucketHeader))
+    {
+        std::cerr << "ERROR: " << bucketIn.GetStatusMessage() << std::endl;
+        return(false);
+    }
+    SamRecord record;
+    while(bucketIn.ReadRecord(bucketHeader, record))
+    {
+        if(!out.IsOpen())
+        {
+            // not yet open.
+            out.OpenForWrite(outName.c_str(), &header);
+        }
+        out.WriteRecord(header, record);
+    }
+    if(bucketIn.GetStatus() != SamStatus::NO_MORE_RECS)
+    {
+        std::cerr << "ERROR: " << bucketIn.GetStatusMessage() << std::endl;
+        return(false);
+    }
+    return(true);
+}
+
+
 bool Diff::matchingRecs(SamRecord* rec1, SamRecord* rec2)
 {
     if((rec1 == NULL) || (rec2 == NULL))
@@ -528,8 +913,6 @@ bool Diff::lessThan(SamRecord* rec1, SamRecord* rec2, int threshold)
 
 void Diff::writeBamDiffs(SamRecord* rec1, SamRecord* rec2)
 {
-    static String tempString;
-
     if((rec1 == NULL) && (rec2 != NULL))
     {
         // If myBamOnly2 file has not open yet, initialize it.
@@ -567,10 +950,10 @@ void Diff::writeBamDiffs(SamRecord* rec1, SamRecord* rec2)
         //  Add the fields from rec2.
         if(myCompPos && (!myOnlyDiffs || myDiffStruct.posDiff))
         {
-            tempString = rec2->getReferenceName();
-            tempString += ':';
-            tempString += rec2->get1BasedPosition();
-            rec1->addTag(POS_DIFF_TAG, POS_DIFF_TYPE, tempString.c_str());
+            myTempBuffer = rec2->getReferenceName();
+            myTempBuffer += ':';
+            myTempBuffer += rec2->get1BasedPosition();
+            rec1->addTag(POS_DIFF_TAG, POS_DIFF_TYPE, myTempBuffer.c_str());
         }
         if(myCompCigar && (!myOnlyDiffs || myDiffStruct.cigarDiff))
         {
@@ -586,10 +969,10 @@ void Diff::writeBamDiffs(SamRecord* rec1, SamRecord* rec2)
         }
         if(myCompMate && (!myOnlyDiffs || myDiffStruct.mateDiff))
         {
-            tempString = rec2->getMateReferenceName();
-            tempString += ':';
-            tempString += rec2->get1BasedMatePosition();
-            rec1->addTag(MATE_DIFF_TAG, MATE_DIFF_TYPE, tempString.c_str());
+            myTempBuffer = rec2->getMateReferenceName();
+            myTempBuffer += ':';
+            myTempBuffer += rec2->get1BasedMatePosition();
+            rec1->addTag(MATE_DIFF_TAG, MATE_DIFF_TYPE, myTempBuffer.c_str());
         }
         if(myCompISize && (!myOnlyDiffs || myDiffStruct.isizeDiff))
         {
@@ -755,6 +1138,11 @@ void Diff::writeDiffDiffs(SamRecord* rec1, SamRecord* rec2)
 
 void Diff::writeDiffs(SamRecord* rec1, SamRecord* rec2)
 {
+    if((rec1 != NULL) && (rec2 != NULL) && sameComparedBytes(*rec1, *rec2))
+    {
+        // Nothing compared differs, so there are no diffs to write.
+        return;
+    }
     if(myBamOut)
     {
         writeBamDiffs(rec1, rec2);
@@ -766,6 +1154,99 @@ void Diff::writeDiffs(SamRecord* rec1, SamRecord* rec2)
 }
 
 
+bool Diff::sameComparedBytes(SamRecord& rec1, SamRecord& rec2)
+{
+    // The record buffers start with the block size.
+    const unsigned char* buf1 = 
+        (const unsigned char*)rec1.getRecordBuffer(SamRecord::NONE);
+    const unsigned char* buf2 = 
+        (const unsigned char*)rec2.getRecordBuffer(SamRecord::NONE);
+    if((buf1 == NULL) || (buf2 == NULL))
+    {
+        return(false);
+    }
+
+    // Offsets of the fixed fields in the BAM record buffer.
+    static const int REF_ID_POS_OFFSET = 4;   // refID, pos
+    static const int NAME_LEN_OFFSET = 12;    // l_read_name
+    static const int MAPQ_OFFSET = 13;
+    static const int NUM_CIGAR_OFFSET = 16;   // n_cigar_op
+    static const int FLAG_OFFSET = 18;
+    static const int SEQ_LEN_OFFSET = 20;     // l_seq
+    static const int MATE_OFFSET = 24;        // next_refID, next_pos
+    static const int ISIZE_OFFSET = 32;       // tlen
+    static const int NAME_OFFSET = 36;
+
+    if((myCompPos && 
+        (memcmp(buf1 + REF_ID_POS_OFFSET, buf2 + REF_ID_POS_OFFSET, 8) != 0)) ||
+       (myCompMapQ && (buf1[MAPQ_OFFSET] != buf2[MAPQ_OFFSET])) ||
+       (myCompFlag && 
+        (memcmp(buf1 + FLAG_OFFSET, buf2 + FLAG_OFFSET, 2) != 0)) ||
+       (myCompMate && 
+        (memcmp(buf1 + MATE_OFFSET, buf2 + MATE_OFFSET, 8) != 0)) ||
+       (myCompISize && 
+        (memcmp(buf1 + ISIZE_OFFSET, buf2 + ISIZE_OFFSET, 4) != 0)))
+    {
+        return(false);
+    }
+
+    uint16_t numCigar1 = 0;
+    uint16_t numCigar2 = 0;
+    int32_t seqLen1 = 0;
+    int32_t seqLen2 = 0;
+    int32_t blockSize1 = 0;
+    int32_t blockSize2 = 0;
+    memcpy(&numCigar1, buf1 + NUM_CIGAR_OFFSET, sizeof(numCigar1));
+    memcpy(&numCigar2, buf2 + NUM_CIGAR_OFFSET, sizeof(numCigar2));
+    memcpy(&seqLen1, buf1 + SEQ_LEN_OFFSET, sizeof(seqLen1));
+    memcpy(&seqLen2, buf2 + SEQ_LEN_OFFSET, sizeof(seqLen2));
+    memcpy(&blockSize1, buf1, sizeof(blockSize1));
+    memcpy(&blockSize2, buf2, sizeof(blockSize2));
+
+    // Walk the variable length fields of both records: read name, cigar,
+    // packed sequence, qualities, and tags.
+    const unsigned char* var1 = buf1 + NAME_OFFSET + buf1[NAME_LEN_OFFSET];
+    const unsigned char* var2 = buf2 + NAME_OFFSET + buf2[NAME_LEN_OFFSET];
+    if(myCompCigar && 
+       ((numCigar1 != numCigar2) ||
+        (memcmp(var1, var2, numCigar1 * sizeof(uint32_t)) != 0)))
+    {
+        return(false);
+    }
+    var1 += numCigar1 * sizeof(uint32_t);
+    var2 += numCigar2 * sizeof(uint32_t);
+    if((myCompSeq || myCompBaseQual) && (seqLen1 != seqLen2))
+    {
+        return(false);
+    }
+    if(myCompSeq && (memcmp(var1, var2, (seqLen1 + 1) / 2) != 0))
+    {
+        return(false);
+    }
+    var1 += (seqLen1 + 1) / 2;
+    var2 += (seqLen2 + 1) / 2;
+    if(myCompBaseQual && (memcmp(var1, var2, seqLen1) != 0))
+    {
+        return(false);
+    }
+    var1 += seqLen1;
+    var2 += seqLen2;
+    if(myEveryTag || !myTags.IsEmpty())
+    {
+        // Any difference in the tags, including their order, is left to
+        // getDiffs.
+        const unsigned char* end1 = buf1 + sizeof(blockSize1) + blockSize1;
+        const unsigned char* end2 = buf2 + sizeof(blockSize2) + blockSize2;
+        if(((end1 - var1) != (end2 - var2)) || (end1 < var1) ||
+           (memcmp(var1, var2, end1 - var1) != 0))
+        {
+            return(false);
+        }
+    }
+    return(true);
+}
+
+
 bool Diff::getDiffs(SamRecord* rec1, SamRecord* rec2)
 {
     if((rec1 == NULL) && (rec2 == NULL))
@@ -918,26 +1399,9 @@ bool Diff::writeReadName(SamRecord& record)
 SamRecord* Diff::getSamRecord()
 {
     // Get new samRecord.
-    SamRecord* returnSam = NULL;
-    if(!myFreeSamRecords.empty())
-    {
-        // have free already allocated records, so get one of those.
-        returnSam = myFreeSamRecords.top();
-        myFreeSamRecords.pop();
-    }
-    else if((myMaxAllowedRecs == -1) || (myAllocatedRecs < myMaxAllowedRecs))
-    {
-        // There were no free records, but either there is no max or
-        // there is still room to allocate more.
-        returnSam = new SamRecord();
-        ++myAllocatedRecs;
-        if(returnSam == NULL)
-        {
-            // Failed allocation.
-            throw(std::runtime_error("Failed to allocate SamRecord"));
-        }
-    }
-    else
+    // Returns NULL if the max number of records are already in use.
+    SamRecord* returnSam = myRecordArena.getRecord();
+    if(returnSam == NULL)
     {
         // There are no more free ones and we have already hit the
         // max number allowed to be allocated, so flush the first record from
@@ -972,7 +1436,7 @@ void Diff::releaseSamRecord(SamRecord* record)
     }
 
     // Release the samRecord to be reused.
-    myFreeSamRecords.push(record);
+    myRecordArena.releaseRecord(record);
 }
 
 
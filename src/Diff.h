@@ -22,11 +22,13 @@
 #ifndef __DIFF_H__
 #define __DIFF_H__
 
-#include <stack>
 #include <list>
 #include <map>
+#include <string>
 #include "BamExecutable.h"
 #include "SamFile.h"
+#include "SamRecordArena.h"
+#include "ThreadedSamFile.h"
 
 class Diff : public BamExecutable
 {
@@ -56,7 +58,7 @@ private:
     class FileInfo
     {
     public:
-        SamFile file;
+        ThreadedSamFile file;
         SamFileHeader header;
     };
     
@@ -113,6 +115,10 @@ private:
     void writeBamDiffs(SamRecord* rec1, SamRecord* rec2);
     void writeDiffDiffs(SamRecord* rec1, SamRecord* rec2);
     void writeDiffs(SamRecord* rec1, SamRecord* rec2);
+    // Returns true if the raw BAM records are byte for byte the same in
+    // all of the compared fields, so they have no diffs.  A false return
+    // does not mean they differ, only that getDiffs needs to check.
+    bool sameComparedBytes(SamRecord& rec1, SamRecord& rec2);
     bool getDiffs(SamRecord* rec1, SamRecord* rec2);
     bool writeReadName(SamRecord& record);
     SamRecord* getSamRecord();
@@ -120,6 +126,22 @@ private:
     void releaseSamRecord(SamRecord* record);
 
     bool checkDiffFile();
+
+    // Diff the input files by partitioning the records by read name into
+    // numBuckets temporary files per input and matching each pair of
+    // buckets in memory on the thread pool.
+    int diffByName(const String& tmpPrefix, int numBuckets);
+    // Diff one pair of bucket files, writing the diffs to this object's
+    // output files.
+    void diffBucket(const std::string& bucket1Name,
+                    const std::string& bucket2Name);
+    // Copy the comparison settings and the headers from another Diff.
+    void copySettings(Diff& other);
+    // Copy the records of the bucket SAM/BAM file onto the end of the
+    // output, opening the output with the header if it is not yet open.
+    // Missing bucket files are skipped.
+    static bool appendBucket(const std::string& bucketName, SamFile& out,
+                             const String& outName, SamFileHeader& header);
     
     static const char* FLAG_DIFF_TAG;
     static const char* POS_DIFF_TAG;
@@ -137,7 +159,9 @@ private:
     static const char QUAL_DIFF_TYPE = 'Z';
     static const char TAGS_DIFF_TYPE = 'Z';
 
-    std::stack<SamRecord*> myFreeSamRecords;
+    static const int DEFAULT_NUM_BUCKETS = 64;
+
+    SamRecordArena myRecordArena;
 
     UnmatchedRecords myFile1Unmatched;
     UnmatchedRecords myFile2Unmatched;
@@ -157,7 +181,6 @@ private:
     bool myBamOut;
 
     int myMaxAllowedRecs;
-    int myAllocatedRecs;
     int myThreshold;
     int myNumPoolOverflows;
 
@@ -0,0 +1,114 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "DupBitmap.h"
+#include <algorithm>
+
+DupBitmap::DupBitmap()
+    : myChunks(),
+      mySize(0)
+{
+}
+
+
+DupBitmap::~DupBitmap()
+{
+    clear();
+}
+
+
+void DupBitmap::set(uint64_t index)
+{
+    uint64_t chunkIndex = index >> CHUNK_BITS;
+    uint16_t low = (uint16_t)(index & 0xFFFF);
+    if(chunkIndex >= myChunks.size())
+    {
+        myChunks.resize(chunkIndex + 1, NULL);
+    }
+    Chunk* chunk = myChunks[chunkIndex];
+    if(chunk == NULL)
+    {
+        chunk = new Chunk;
+        myChunks[chunkIndex] = chunk;
+    }
+
+    if(!chunk->bits.empty())
+    {
+        uint64_t mask = 1ULL << (low & 63);
+        uint64_t& word = chunk->bits[low >> 6];
+        if((word & mask) == 0)
+        {
+            word |= mask;
+            ++mySize;
+        }
+        return;
+    }
+
+    // Indices are mostly added in increasing order, so check the end first.
+    std::vector<uint16_t>& array = chunk->array;
+    std::vector<uint16_t>::iterator pos = array.end();
+    if(!array.empty() && (array.back() >= low))
+    {
+        pos = std::lower_bound(array.begin(), array.end(), low);
+        if(*pos == low)
+        {
+            // Already set.
+            return;
+        }
+    }
+    array.insert(pos, low);
+    ++mySize;
+
+    if(array.size() > MAX_ARRAY_SIZE)
+    {
+        // Convert to a bit array.
+        chunk->bits.assign(CHUNK_WORDS, 0);
+        for(unsigned int i = 0; i < array.size(); i++)
+        {
+            chunk->bits[array[i] >> 6] |= 1ULL << (array[i] & 63);
+        }
+        std::vector<uint16_t>().swap(array);
+    }
+}
+
+
+bool DupBitmap::test(uint64_t index) const
+{
+    uint64_t chunkIndex = index >> CHUNK_BITS;
+    if((chunkIndex >= myChunks.size()) || (myChunks[chunkIndex] == NULL))
+    {
+        return(false);
+    }
+    const Chunk* chunk = myChunks[chunkIndex];
+    uint16_t low = (uint16_t)(index & 0xFFFF);
+    if(!chunk->bits.empty())
+    {
+        return((chunk->bits[low >> 6] & (1ULL << (low & 63))) != 0);
+    }
+    return(std::binary_search(chunk->array.begin(), chunk->array.end(), low));
+}
+
+
+void DupBitmap::clear()
+{
+    for(unsigned int i = 0; i < myChunks.size(); i++)
+    {
+        delete myChunks[i];
+    }
+    myChunks.clear();
+    mySize = 0;
+}
@@ -0,0 +1,80 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DUP_BITMAP_H__
+#define __DUP_BITMAP_H__
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+/// Compressed set of 64-bit record indices (roaring style).  Indices are
+/// split into chunks of 2^16: a chunk with few entries is stored as a
+/// sorted array of the low 16 bits of its indices, and is converted to a
+/// 8KB bit array once it has more than MAX_ARRAY_SIZE entries.
+/// Lookups are constant time for bit array chunks and a short binary
+/// search for array chunks.
+class DupBitmap
+{
+public:
+    DupBitmap();
+    ~DupBitmap();
+
+    /// Add the index to the set.
+    void set(uint64_t index);
+
+    /// Return whether or not the index is in the set.
+    bool test(uint64_t index) const;
+
+    /// Return the number of indices in the set.
+    uint64_t size() const { return(mySize); }
+
+    bool empty() const { return(mySize == 0); }
+
+    /// Remove all indices from the set.
+    void clear();
+
+    /// Exchange the contents of this set with another.
+    void swap(DupBitmap& other)
+    {
+        myChunks.swap(other.myChunks);
+        std::swap(mySize, other.mySize);
+    }
+
+private:
+    static const unsigned int CHUNK_BITS = 16;
+    static const unsigned int CHUNK_WORDS = (1 << CHUNK_BITS) / 64;
+    // An array of more than 4096 uint16_t takes more space than the
+    // bit array.
+    static const unsigned int MAX_ARRAY_SIZE = 4096;
+
+    struct Chunk
+    {
+        // Sorted low bits, only used if bits is empty.
+        std::vector<uint16_t> array;
+        std::vector<uint64_t> bits;
+    };
+
+    DupBitmap(const DupBitmap&);
+    DupBitmap& operator=(const DupBitmap&);
+
+    // Indexed by index >> CHUNK_BITS, NULL if the chunk has no entries.
+    std::vector<Chunk*> myChunks;
+    uint64_t mySize;
+};
+
+#endif
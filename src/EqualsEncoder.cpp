@@ -0,0 +1,213 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ctype.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "EqualsEncoder.h"
+#include "BamRecordView.h"
+
+// Code of 'N', which is never replaced.
+static const uint8_t N_CODE = 15;
+
+EqualsEncoder::EqualsEncoder()
+    : myReference(NULL),
+      myChromosomes(),
+      myHeader(NULL),
+      myAligned()
+{
+    memset(myRefCodes, NO_MATCH, sizeof(myRefCodes));
+    // '=' (code 0) is skipped since the reference never has it.
+    const char* bases = "=ACMGRSVTWYHKDBN";
+    for(uint8_t code = 1; code < 16; code++)
+    {
+        myRefCodes[(unsigned char)bases[code]] = code;
+        myRefCodes[tolower(bases[code])] = code;
+    }
+}
+
+
+void EqualsEncoder::setReference(GenomeSequence* reference)
+{
+    myReference = reference;
+    myChromosomes.clear();
+    myHeader = NULL;
+}
+
+
+bool EqualsEncoder::encode(char* buffer, uint32_t size, SamFileHeader& header)
+{
+    BamRecordView view;
+    if(!view.set(buffer, size))
+    {
+        return(false);
+    }
+    const char* qualities = view.getQualities();
+    if(qualities == NULL)
+    {
+        return(false);
+    }
+    uint32_t readLength = view.getReadLength();
+    int32_t position = view.get0BasedPosition();
+    if((myReference == NULL) || (readLength == 0) || (position < 0))
+    {
+        return(true);
+    }
+    genomeIndex_t chromSize = 0;
+    genomeIndex_t chromStart = 
+        getChromosomeStart(view.getReferenceID(), header, chromSize);
+    if((chromStart == INVALID_GENOME_INDEX) || 
+       ((genomeIndex_t)position >= chromSize))
+    {
+        // No reference, or the header is longer than the reference's
+        // chromosome, so leave the read as it is.
+        return(true);
+    }
+
+    // Fetch the reference for each aligned base in one pass per
+    // operation, in read order.
+    myAligned.assign(readLength, NO_MATCH);
+    uint32_t readPos = 0;
+    genomeIndex_t refPos = position;
+    uint16_t numCigarOps = view.getNumCigarOps();
+    for(uint16_t i = 0; i < numCigarOps; i++)
+    {
+        Cigar::Operation op = view.getCigarOperation(i);
+        uint32_t len = view.getCigarLength(i);
+        bool inQuery = Cigar::foundInQuery(op);
+        if(inQuery && Cigar::foundInReference(op))
+        {
+            // Only the bases within the read & chromosome are compared.
+            uint32_t count = std::min(len, readLength - readPos);
+            genomeIndex_t refLeft = (refPos >= chromSize) ? 0 : chromSize - refPos;
+            if(count > refLeft)
+            {
+                count = refLeft;
+            }
+            genomeIndex_t refIndex = chromStart + refPos;
+            for(uint32_t j = 0; j < count; j++)
+            {
+                myAligned[readPos + j] = 
+                    myRefCodes[(unsigned char)(*myReference)[refIndex + j]];
+            }
+            refPos += len;
+            readPos += len;
+        }
+        else if(inQuery)
+        {
+            readPos += len;
+        }
+        else if(Cigar::foundInReference(op))
+        {
+            refPos += len;
+        }
+        if((readPos >= readLength) || (refPos >= chromSize))
+        {
+            break;
+        }
+    }
+
+    // The sequence directly precedes the qualities.
+    unsigned char* seq = 
+        (unsigned char*)buffer + (qualities - buffer) - ((readLength + 1) / 2);
+    replaceMatches(seq, &(myAligned[0]), readLength);
+    return(true);
+}
+
+
+genomeIndex_t EqualsEncoder::getChromosomeStart(int32_t refID,
+                                                SamFileHeader& header,
+                                                genomeIndex_t& size)
+{
+    if(refID < 0)
+    {
+        return(INVALID_GENOME_INDEX);
+    }
+    if(&header != myHeader)
+    {
+        myChromosomes.clear();
+        myHeader = &header;
+    }
+    if((uint32_t)refID >= myChromosomes.size())
+    {
+        myChromosomes.resize(refID + 1, -2);
+    }
+    if(myChromosomes[refID] == -2)
+    {
+        myChromosomes[refID] = 
+            myReference->getChromosome(header.getReferenceLabel(refID).c_str());
+        if(myChromosomes[refID] < 0)
+        {
+            myChromosomes[refID] = -1;
+        }
+    }
+    int chromIndex = myChromosomes[refID];
+    if(chromIndex < 0)
+    {
+        return(INVALID_GENOME_INDEX);
+    }
+    size = myReference->getChromosomeSize(chromIndex);
+    return(myReference->getChromosomeStart(chromIndex));
+}
+
+
+void EqualsEncoder::replaceMatches(unsigned char* seq, const uint8_t* refCodes,
+                                   uint32_t readLength)
+{
+    uint32_t i = 0;
+#ifdef __SSE2__
+    __m128i lowNibble = _mm_set1_epi8(0xF);
+    __m128i lowByte = _mm_set1_epi16(0xFF);
+    __m128i nCode = _mm_set1_epi8(N_CODE);
+    for(; i + 16 <= readLength; i += 16)
+    {
+        // Unpack 16 bases, the first of each byte in the high nibble.
+        __m128i packed = _mm_loadl_epi64((const __m128i*)(seq + (i >> 1)));
+        __m128i first = _mm_and_si128(_mm_srli_epi16(packed, 4), lowNibble);
+        __m128i second = _mm_and_si128(packed, lowNibble);
+        __m128i bases = _mm_unpacklo_epi8(first, second);
+
+        // Clear the bases that match the reference & are not N.
+        __m128i refs = _mm_loadu_si128((const __m128i*)(refCodes + i));
+        __m128i matches = _mm_andnot_si128(_mm_cmpeq_epi8(bases, nCode),
+                                           _mm_cmpeq_epi8(bases, refs));
+        bases = _mm_andnot_si128(matches, bases);
+
+        // Repack them, each pair into the low byte of a 16 bit value.
+        __m128i pairs = 
+            _mm_or_si128(_mm_slli_epi16(_mm_and_si128(bases, lowByte), 4),
+                         _mm_srli_epi16(bases, 8));
+        _mm_storel_epi64((__m128i*)(seq + (i >> 1)), 
+                         _mm_packus_epi16(pairs, pairs));
+    }
+#endif
+    for(; i < readLength; i++)
+    {
+        unsigned char& packed = seq[i >> 1];
+        int shift = (i & 1) ? 0 : 4;
+        uint8_t base = (packed >> shift) & 0xF;
+        if((base == refCodes[i]) && (base != N_CODE))
+        {
+            packed &= ~(0xF << shift);
+        }
+    }
+}
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __EQUALS_ENCODER_H__
+#define __EQUALS_ENCODER_H__
+
+#include <stdint.h>
+#include <vector>
+
+#include "GenomeSequence.h"
+#include "SamFileHeader.h"
+
+/// Replaces the bases of BAM records that match the reference with '='
+/// directly in their 4-bit packed sequences, giving the same sequence as
+/// writing with SamRecord::EQUAL but without decoding the sequence into a
+/// string and looking up the reference once per base through the CIGAR.
+/// The reference of each matched CIGAR operation is fetched in one pass,
+/// then the read is compared with it 16 bases at a time (with SSE2).
+/// Each thread needs its own encoder, but they may share the reference.
+class EqualsEncoder
+{
+public:
+    EqualsEncoder();
+
+    /// Set the reference to compare against, NULL for none.
+    void setReference(GenomeSequence* reference);
+
+    /// Replace the bases that match the reference in the BAM record
+    /// buffer (starting with the block size), whose reference IDs are
+    /// from header.  Bases that are not aligned, are past the end of the
+    /// reference, or are 'N' are not changed, nor are records with
+    /// references that are not in the reference file.
+    /// Returns false if the buffer is invalid.
+    bool encode(char* buffer, uint32_t size, SamFileHeader& header);
+
+private:
+    EqualsEncoder(const EqualsEncoder&);
+    EqualsEncoder& operator=(const EqualsEncoder&);
+
+    // Reference code that never matches a read base.
+    static const uint8_t NO_MATCH = 0xFF;
+
+    // Returns the start of the chromosome in the reference for the
+    // reference ID, setting its size, or INVALID_GENOME_INDEX.
+    genomeIndex_t getChromosomeStart(int32_t refID, SamFileHeader& header,
+                                     genomeIndex_t& size);
+
+    // Set each 4-bit base of seq that equals its reference code to 0 ('=').
+    static void replaceMatches(unsigned char* seq, const uint8_t* refCodes,
+                               uint32_t readLength);
+
+    GenomeSequence* myReference;
+    // 4-bit BAM code of each reference character, NO_MATCH for the
+    // characters that no read base matches.
+    uint8_t myRefCodes[256];
+    // Chromosome index for each reference ID of the header, -1 if not
+    // in the reference and -2 if it has not been looked up.
+    std::vector<int> myChromosomes;
+    SamFileHeader* myHeader;
+    // Reference code for each base of the read being encoded, NO_MATCH
+    // for those that are not aligned.
+    std::vector<uint8_t> myAligned;
+};
+
+#endif
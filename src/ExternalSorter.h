@@ -0,0 +1,280 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//////////////////////////////////////////////////////////////////////////
+// Sort of fixed size records that may not fit in memory: records are
+// sorted in memory in batches that are written to temporary run files,
+// which are then merged.
+
+#ifndef __EXTERNAL_SORTER_H__
+#define __EXTERNAL_SORTER_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <queue>
+#include <algorithm>
+
+#include "Logger.h"
+
+/// Sort records of type T (plain data that can be written with fwrite)
+/// by LESS using at most maxRecords records of memory, plus a read buffer
+/// per run file while merging.
+/// Records are added with add(), then after finish() they are returned
+/// in sorted order by next().
+template<class T, class LESS>
+class ExternalSorter
+{
+public:
+    ExternalSorter()
+        : myPrefix(), myMaxRecords(1), myRecords(), myNextRecord(0),
+          myRuns(), myRunCount(0), myMerge(), myNumRecords(0)
+    {}
+
+    ~ExternalSorter()
+    {
+        closeRuns();
+    }
+
+    /// Set the temporary run file prefix & the number of records to
+    /// sort in memory at a time.
+    void init(const std::string& prefix, uint64_t maxRecords)
+    {
+        myPrefix = prefix;
+        myMaxRecords = std::max(maxRecords, (uint64_t)1);
+    }
+
+    void add(const T& record)
+    {
+        myRecords.push_back(record);
+        ++myNumRecords;
+        if(myRecords.size() >= myMaxRecords)
+        {
+            writeRun();
+        }
+    }
+
+    /// Done adding records, prepare to return them in sorted order.
+    void finish()
+    {
+        if(myRuns.empty())
+        {
+            // Everything fit in memory.
+            std::sort(myRecords.begin(), myRecords.end(), myLess);
+            myNextRecord = 0;
+            return;
+        }
+        writeRun();
+        std::vector<T>().swap(myRecords);
+
+        // Merge runs until they can all be open at once.
+        while(myRuns.size() > MAX_MERGE_RUNS)
+        {
+            std::vector<Run> group(myRuns.begin(), 
+                                   myRuns.begin() + MAX_MERGE_RUNS);
+            myRuns.erase(myRuns.begin(), myRuns.begin() + MAX_MERGE_RUNS);
+            Run merged = newRun();
+            startMerge(group);
+            T record;
+            while(nextMerged(group, record))
+            {
+                writeRecord(merged, record);
+            }
+            closeRuns(group);
+            closeRun(merged);
+            myRuns.push_back(merged);
+        }
+        startMerge(myRuns);
+    }
+
+    /// Get the next record in sorted order, returns false when there
+    /// are no more.
+    bool next(T& record)
+    {
+        if(myRuns.empty())
+        {
+            if(myNextRecord >= myRecords.size())
+            {
+                return(false);
+            }
+            record = myRecords[myNextRecord++];
+            return(true);
+        }
+        return(nextMerged(myRuns, record));
+    }
+
+    /// Remove all records and run files.
+    void clear()
+    {
+        closeRuns();
+        std::vector<T>().swap(myRecords);
+        myNextRecord = 0;
+        myNumRecords = 0;
+    }
+
+    /// Total number of records added.
+    uint64_t size() const { return(myNumRecords); }
+
+    /// Number of run files written.
+    uint32_t getNumRuns() const { return(myRunCount); }
+
+private:
+    // Limit on the number of run files open at once.
+    static const unsigned int MAX_MERGE_RUNS = 128;
+
+    struct Run
+    {
+        FILE* file;
+        std::string fileName;
+        T record;
+    };
+
+    // Orders the merge heap so the smallest record is on top.
+    struct HeapGreater
+    {
+        std::vector<Run>* runs;
+        LESS less;
+        HeapGreater(std::vector<Run>* r = NULL) : runs(r), less() {}
+        bool operator()(unsigned int a, unsigned int b) const
+        {
+            return(less((*runs)[b].record, (*runs)[a].record));
+        }
+    };
+    typedef std::priority_queue<unsigned int, std::vector<unsigned int>,
+                                HeapGreater> MergeHeap;
+
+    Run newRun()
+    {
+        Run run;
+        run.fileName = myPrefix + ".sortRun" + std::to_string(myRunCount++);
+        run.file = fopen(run.fileName.c_str(), "wb");
+        if(run.file == NULL)
+        {
+            Logger::gLogger->error("Failed to open temporary sort file %s",
+                                   run.fileName.c_str());
+        }
+        return(run);
+    }
+
+    void writeRecord(Run& run, const T& record)
+    {
+        if(fwrite(&record, sizeof(T), 1, run.file) != 1)
+        {
+            Logger::gLogger->error("Failed to write temporary sort file %s",
+                                   run.fileName.c_str());
+        }
+    }
+
+    // Sort the records in memory and write them to a new run.
+    void writeRun()
+    {
+        if(myRecords.empty())
+        {
+            return;
+        }
+        std::sort(myRecords.begin(), myRecords.end(), myLess);
+        Run run = newRun();
+        for(size_t i = 0; i < myRecords.size(); i++)
+        {
+            writeRecord(run, myRecords[i]);
+        }
+        // Only the runs being merged are kept open.
+        closeRun(run);
+        myRuns.push_back(run);
+        myRecords.clear();
+    }
+
+    void startMerge(std::vector<Run>& runs)
+    {
+        myMerge = MergeHeap(HeapGreater(&runs));
+        for(unsigned int i = 0; i < runs.size(); i++)
+        {
+            runs[i].file = fopen(runs[i].fileName.c_str(), "rb");
+            if(runs[i].file == NULL)
+            {
+                Logger::gLogger->error("Failed to open temporary sort file %s",
+                                       runs[i].fileName.c_str());
+            }
+            if(fread(&(runs[i].record), sizeof(T), 1, runs[i].file) == 1)
+            {
+                myMerge.push(i);
+            }
+        }
+    }
+
+    bool nextMerged(std::vector<Run>& runs, T& record)
+    {
+        if(myMerge.empty())
+        {
+            return(false);
+        }
+        unsigned int i = myMerge.top();
+        myMerge.pop();
+        record = runs[i].record;
+        if(fread(&(runs[i].record), sizeof(T), 1, runs[i].file) == 1)
+        {
+            myMerge.push(i);
+        }
+        return(true);
+    }
+
+    void closeRun(Run& run)
+    {
+        if((run.file != NULL) && (fclose(run.file) != 0))
+        {
+            run.file = NULL;
+            Logger::gLogger->error("Failed to write temporary sort file %s",
+                                   run.fileName.c_str());
+        }
+        run.file = NULL;
+    }
+
+    void closeRuns(std::vector<Run>& runs)
+    {
+        for(unsigned int i = 0; i < runs.size(); i++)
+        {
+            if(runs[i].file != NULL)
+            {
+                fclose(runs[i].file);
+            }
+            remove(runs[i].fileName.c_str());
+        }
+        runs.clear();
+    }
+
+    void closeRuns()
+    {
+        myMerge = MergeHeap(HeapGreater(&myRuns));
+        closeRuns(myRuns);
+    }
+
+    ExternalSorter(const ExternalSorter&);
+    ExternalSorter& operator=(const ExternalSorter&);
+
+    std::string myPrefix;
+    uint64_t myMaxRecords;
+    LESS myLess;
+    std::vector<T> myRecords;
+    size_t myNextRecord;
+    std::vector<Run> myRuns;
+    uint32_t myRunCount;
+    MergeHeap myMerge;
+    uint64_t myNumRecords;
+};
+
+#endif
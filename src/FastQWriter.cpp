@@ -0,0 +1,216 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ctype.h>
+#include <algorithm>
+#include <functional>
+
+#include "FastQWriter.h"
+#include "BamExecutable.h"
+#include "BaseUtilities.h"
+
+const unsigned int FastQWriter::BATCH_SIZE = 1000;
+
+
+FastQWriter::FastQWriter()
+    : myFile(NULL),
+      myBgzfFile(),
+      myThreaded(false),
+      myRnPlus(false),
+      myFailed(false),
+      myMaxInFlight(1),
+      myBatch(),
+      myPending(),
+      myRead(),
+      myBuffer()
+{
+}
+
+
+FastQWriter::~FastQWriter()
+{
+    close();
+}
+
+
+bool FastQWriter::open(const char* filename,
+                       InputFile::ifileCompression compression, bool rnPlus)
+{
+    close();
+    myRnPlus = rnPlus;
+    myFailed = false;
+    myThreaded = (BamExecutable::getNumThreads() > 1);
+    myMaxInFlight = 2 * BamExecutable::getNumThreads();
+
+    if(myThreaded)
+    {
+        myBatch = std::make_shared<Batch>();
+        myBatch->reserve(BATCH_SIZE);
+        if(compression == InputFile::GZIP)
+        {
+            return(myBgzfFile.open(filename, BamExecutable::getThreadPool(),
+                                   myMaxInFlight));
+        }
+    }
+    myFile = ifopen(filename, "w", compression);
+    return(myFile != NULL);
+}
+
+
+void FastQWriter::write(const char* readName, const char* readNameExt,
+                        const std::string& sequence, const char* quality,
+                        bool reverse)
+{
+    Read* read = &myRead;
+    if(myThreaded)
+    {
+        myBatch->push_back(Read());
+        read = &(myBatch->back());
+    }
+    read->name = readName;
+    read->name += readNameExt;
+    read->sequence = sequence;
+    read->quality = quality;
+    read->reverse = reverse;
+
+    if(!myThreaded)
+    {
+        myBuffer.clear();
+        formatRead(myRead, myRnPlus, myBuffer);
+        writeBuffer(myBuffer);
+    }
+    else if(myBatch->size() >= BATCH_SIZE)
+    {
+        queueBatch();
+    }
+}
+
+
+bool FastQWriter::close()
+{
+    if(myThreaded)
+    {
+        if(myBatch && !myBatch->empty())
+        {
+            queueBatch();
+        }
+        while(!myPending.empty())
+        {
+            writeFirstPending();
+        }
+        if(myBgzfFile.isOpen() && !myBgzfFile.close())
+        {
+            myFailed = true;
+        }
+        myBatch.reset();
+    }
+    if(myFile != NULL)
+    {
+        ifclose(myFile);
+        myFile = NULL;
+    }
+    myThreaded = false;
+    return(!myFailed);
+}
+
+
+void FastQWriter::formatRead(Read& read, bool rnPlus, ParallelBgzf::Buffer& out)
+{
+    if(read.reverse)
+    {
+        // It is reverse, so reverse compliment the sequence
+        BaseUtilities::reverseComplement(read.sequence);
+        // Reverse the quality.
+        std::reverse(read.quality.begin(), read.quality.end());
+    }
+    else
+    {
+        // Ensure it is all capitalized.
+        int seqLen = read.sequence.size();
+        for (int i = 0; i < seqLen; i++)
+        {
+            read.sequence[i] = (char)toupper(read.sequence[i]);
+        }
+    }
+
+    out.push_back('@');
+    out.insert(out.end(), read.name.begin(), read.name.end());
+    out.push_back('\n');
+    out.insert(out.end(), read.sequence.begin(), read.sequence.end());
+    out.push_back('\n');
+    out.push_back('+');
+    if(rnPlus)
+    {
+        out.insert(out.end(), read.name.begin(), read.name.end());
+    }
+    out.push_back('\n');
+    out.insert(out.end(), read.quality.begin(), read.quality.end());
+    out.push_back('\n');
+}
+
+
+ParallelBgzf::BufferPtr FastQWriter::formatBatch(std::shared_ptr<Batch> batch,
+                                                 bool rnPlus)
+{
+    ParallelBgzf::BufferPtr out = std::make_shared<ParallelBgzf::Buffer>();
+    for(unsigned int i = 0; i < batch->size(); i++)
+    {
+        formatRead((*batch)[i], rnPlus, *out);
+    }
+    return(out);
+}
+
+
+void FastQWriter::queueBatch()
+{
+    if(myPending.size() >= myMaxInFlight)
+    {
+        writeFirstPending();
+    }
+    myPending.push_back(BamExecutable::getThreadPool().submit(std::bind(&FastQWriter::formatBatch,
+                                                                        myBatch, myRnPlus)));
+    myBatch = std::make_shared<Batch>();
+    myBatch->reserve(BATCH_SIZE);
+}
+
+
+void FastQWriter::writeFirstPending()
+{
+    ParallelBgzf::BufferPtr formatted = myPending.front().get();
+    myPending.pop_front();
+    writeBuffer(*formatted);
+}
+
+
+void FastQWriter::writeBuffer(const ParallelBgzf::Buffer& buffer)
+{
+    if(buffer.empty())
+    {
+        return;
+    }
+    if(myBgzfFile.isOpen())
+    {
+        if(!myBgzfFile.write(&(buffer[0]), buffer.size()))
+        {
+            myFailed = true;
+        }
+    }
+    else if(ifwrite(myFile, &(buffer[0]), buffer.size()) != buffer.size())
+    {
+        myFailed = true;
+    }
+}
@@ -0,0 +1,96 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FASTQ_WRITER_H__
+#define __FASTQ_WRITER_H__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <future>
+#include <memory>
+
+#include "InputFile.h"
+#include "ParallelBgzf.h"
+
+/// Writes reads to a FASTQ file.  With more than one thread, batches of
+/// reads are formatted on the thread pool and gzip output is written as
+/// BGZF (which gzip can read) compressed on the thread pool, keeping the
+/// reads in the order they were written.  Otherwise reads are formatted
+/// and written directly.
+class FastQWriter
+{
+public:
+    /// Number of reads formatted together on the thread pool.
+    static const unsigned int BATCH_SIZE;
+
+    FastQWriter();
+    ~FastQWriter();
+
+    /// Open the file ("-" for stdout), returning false on failure.
+    /// rnPlus - repeat the read name on the '+' line.
+    bool open(const char* filename, InputFile::ifileCompression compression,
+              bool rnPlus);
+
+    /// Write a read.  If reverse is set, the sequence is reverse
+    /// complemented and the quality is reversed, otherwise the sequence
+    /// is upper cased.
+    void write(const char* readName, const char* readNameExt,
+               const std::string& sequence, const char* quality,
+               bool reverse);
+
+    /// Write the remaining reads and close the file.
+    /// Returns false if any of the writes failed.
+    bool close();
+
+private:
+    FastQWriter(const FastQWriter&);
+    FastQWriter& operator=(const FastQWriter&);
+
+    struct Read
+    {
+        std::string name;
+        std::string sequence;
+        std::string quality;
+        bool reverse;
+    };
+    typedef std::vector<Read> Batch;
+
+    static void formatRead(Read& read, bool rnPlus, ParallelBgzf::Buffer& out);
+    static ParallelBgzf::BufferPtr formatBatch(std::shared_ptr<Batch> batch,
+                                               bool rnPlus);
+
+    // Format the current batch on the thread pool.
+    void queueBatch();
+    // Write the first formatted batch to the file.
+    void writeFirstPending();
+    void writeBuffer(const ParallelBgzf::Buffer& buffer);
+
+    IFILE myFile;
+    ParallelBgzfWriter myBgzfFile;
+    bool myThreaded;
+    bool myRnPlus;
+    bool myFailed;
+    unsigned int myMaxInFlight;
+    std::shared_ptr<Batch> myBatch;
+    std::deque< std::future<ParallelBgzf::BufferPtr> > myPending;
+    // Buffer for formatting a read when not threaded.
+    Read myRead;
+    ParallelBgzf::Buffer myBuffer;
+};
+
+#endif
@@ -0,0 +1,479 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "FieldCache.h"
+#include "BamExecutable.h"
+#include "BamRecordView.h"
+#include "ReadNameIndex.h"
+
+const char FieldCache::MAGIC[4] = {'B', 'F', 'C', 1};
+
+// Size of the fixed fields of a BAM record after the block size.
+static const uint32_t FIXED_SIZE = 32;
+// Offset of the read name length in a BAM record buffer.
+static const uint32_t NAME_LEN_OFFSET = 12;
+
+template<class T>
+static void putValue(char* ptr, T value)
+{
+    memcpy(ptr, &value, sizeof(T));
+}
+
+
+FieldCache::FieldCache()
+    : myReader(),
+      myBamFile(),
+      myBamReader(),
+      myDone(true),
+      myBlock(),
+      myIndex(0),
+      myCigarIndex(0),
+      myRecord(),
+      myBamRecord()
+{
+}
+
+
+FieldCache::~FieldCache()
+{
+    close();
+}
+
+
+bool FieldCache::build(const char* bamFile, const char* cacheFile,
+                       uint64_t& numRecords)
+{
+    numRecords = 0;
+    int64_t bamInfo[2] = {0, 0};
+    ParallelBgzfReader reader;
+    int maxInFlight = BamExecutable::getNumThreads() * BLOCKS_PER_THREAD;
+    if(!getFileInfo(bamFile, bamInfo[0], bamInfo[1]) ||
+       !reader.open(bamFile, BamExecutable::getThreadPool(), maxInFlight))
+    {
+        std::cerr << "ERROR: Failed to open " << bamFile 
+                  << " as a BAM file.\n";
+        return(false);
+    }
+
+    ParallelBgzfWriter writer;
+    bool success = true;
+    try
+    {
+        if(!ReadNameIndex::skipHeader(reader))
+        {
+            std::cerr << "ERROR: Failed to read the BAM header of " 
+                      << bamFile << ".\n";
+            return(false);
+        }
+        if(!writer.open(cacheFile, BamExecutable::getThreadPool(),
+                        maxInFlight))
+        {
+            std::cerr << "ERROR: Failed to open " << cacheFile
+                      << " for writing.\n";
+            return(false);
+        }
+        success = writer.write(MAGIC, sizeof(MAGIC)) &&
+            writer.write(bamInfo, sizeof(bamInfo));
+
+        Block block;
+        BamRecordView view;
+        std::vector<char> record;
+        while(success)
+        {
+            uint64_t offset = reader.tell();
+            int32_t blockSize = 0;
+            uint32_t numRead = reader.read(&blockSize, sizeof(blockSize));
+            if(numRead == 0)
+            {
+                // End of the records.
+                break;
+            }
+            if((numRead != sizeof(blockSize)) || (blockSize < (int32_t)FIXED_SIZE))
+            {
+                std::cerr << "ERROR: Invalid BAM record in " << bamFile
+                          << ".\n";
+                success = false;
+                break;
+            }
+            // The record buffer starts with the block size.
+            record.resize(sizeof(blockSize) + blockSize);
+            memcpy(&(record[0]), &blockSize, sizeof(blockSize));
+            if((reader.read(&(record[sizeof(blockSize)]), blockSize) !=
+                (uint32_t)blockSize) ||
+               !view.set(&(record[0]), record.size()))
+            {
+                std::cerr << "ERROR: Truncated BAM record in " << bamFile
+                          << ".\n";
+                success = false;
+                break;
+            }
+            block.offsets.push_back(offset);
+            block.flags.push_back(view.getFlag());
+            block.refIDs.push_back(view.getReferenceID());
+            block.positions.push_back(view.get0BasedPosition());
+            block.mapQualities.push_back(view.getMapQuality());
+            block.mateRefIDs.push_back(view.getMateReferenceID());
+            block.matePositions.push_back(view.get0BasedMatePosition());
+            block.insertSizes.push_back(view.getInsertSize());
+            block.readLengths.push_back(view.getReadLength());
+            uint16_t numOps = view.getNumCigarOps();
+            block.numCigarOps.push_back(numOps);
+            // The CIGAR follows the read name.
+            const char* cigar = &(record[sizeof(blockSize) + FIXED_SIZE]) +
+                (uint8_t)record[NAME_LEN_OFFSET];
+            size_t numCigars = block.cigars.size();
+            block.cigars.resize(numCigars + numOps);
+            if(numOps != 0)
+            {
+                memcpy(&(block.cigars[numCigars]), cigar,
+                       numOps * sizeof(uint32_t));
+            }
+            ++numRecords;
+            if(block.flags.size() == BLOCK_RECORDS)
+            {
+                success = writeBlock(writer, block);
+                block.clear();
+            }
+        }
+        if(success && !block.flags.empty())
+        {
+            success = writeBlock(writer, block);
+        }
+        // An empty block marks the end of the records.
+        block.clear();
+        success = success && writeBlock(writer, block);
+    }
+    catch(std::runtime_error& e)
+    {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        success = false;
+    }
+    reader.close();
+    if(!writer.close() && success)
+    {
+        std::cerr << "ERROR: Failed to write " << cacheFile << ".\n";
+        success = false;
+    }
+    if(!success)
+    {
+        unlink(cacheFile);
+    }
+    return(success);
+}
+
+
+bool FieldCache::open(const char* cacheFile, const char* bamFile)
+{
+    close();
+    int64_t cacheSize = 0;
+    int64_t cacheTime = 0;
+    int64_t bamInfo[2] = {0, 0};
+    if(!getFileInfo(cacheFile, cacheSize, cacheTime) ||
+       !getFileInfo(bamFile, bamInfo[0], bamInfo[1]))
+    {
+        // No cache to use.
+        return(false);
+    }
+
+    char magic[sizeof(MAGIC)];
+    int64_t cacheInfo[2] = {0, 0};
+    bool valid = false;
+    try
+    {
+        valid = myReader.open(cacheFile, BamExecutable::getThreadPool(),
+                              BamExecutable::getNumThreads() * BLOCKS_PER_THREAD) &&
+            (myReader.read(magic, sizeof(magic)) == sizeof(magic)) &&
+            (memcmp(magic, MAGIC, sizeof(MAGIC)) == 0) &&
+            (myReader.read(cacheInfo, sizeof(cacheInfo)) == sizeof(cacheInfo));
+    }
+    catch(std::runtime_error&)
+    {
+        valid = false;
+    }
+    if(!valid)
+    {
+        std::cerr << "WARNING: " << cacheFile << " is not a valid field "
+                  << "cache, so reading " << bamFile << ".\n";
+        close();
+        return(false);
+    }
+    if((cacheInfo[0] != bamInfo[0]) || (cacheInfo[1] != bamInfo[1]))
+    {
+        std::cerr << "WARNING: The field cache " << cacheFile
+                  << " is out of date, so reading " << bamFile 
+                  << ", rebuild it with cacheFields.\n";
+        close();
+        return(false);
+    }
+    myBamFile = bamFile;
+    myDone = false;
+    return(true);
+}
+
+
+void FieldCache::close()
+{
+    myReader.close();
+    myBamReader.close();
+    myBamFile.clear();
+    myDone = true;
+    myBlock.clear();
+    myIndex = 0;
+    myCigarIndex = 0;
+}
+
+
+bool FieldCache::next(const char*& record, uint32_t& size)
+{
+    while(myIndex >= myBlock.flags.size())
+    {
+        if(!readBlock())
+        {
+            return(false);
+        }
+    }
+
+    uint16_t numOps = myBlock.numCigarOps[myIndex];
+    if(myCigarIndex + numOps > myBlock.cigars.size())
+    {
+        throw std::runtime_error("Invalid field cache, it has too few CIGAR operations");
+    }
+    // Empty read name, so just its terminator before the CIGAR.
+    int32_t blockSize = FIXED_SIZE + 1 + numOps * sizeof(uint32_t);
+    myRecord.resize(sizeof(blockSize) + blockSize);
+    char* ptr = &(myRecord[0]);
+    putValue<int32_t>(ptr, blockSize);
+    putValue<int32_t>(ptr + 4, myBlock.refIDs[myIndex]);
+    putValue<int32_t>(ptr + 8, myBlock.positions[myIndex]);
+    putValue<uint8_t>(ptr + NAME_LEN_OFFSET, 1);
+    putValue<uint8_t>(ptr + 13, myBlock.mapQualities[myIndex]);
+    putValue<uint16_t>(ptr + 14, 0);
+    putValue<uint16_t>(ptr + 16, numOps);
+    putValue<uint16_t>(ptr + 18, myBlock.flags[myIndex]);
+    putValue<int32_t>(ptr + 20, myBlock.readLengths[myIndex]);
+    putValue<int32_t>(ptr + 24, myBlock.mateRefIDs[myIndex]);
+    putValue<int32_t>(ptr + 28, myBlock.matePositions[myIndex]);
+    putValue<int32_t>(ptr + 32, myBlock.insertSizes[myIndex]);
+    ptr[36] = 0;
+    if(numOps != 0)
+    {
+        memcpy(ptr + 37, &(myBlock.cigars[myCigarIndex]),
+               numOps * sizeof(uint32_t));
+    }
+    myCigarIndex += numOps;
+    ++myIndex;
+
+    record = &(myRecord[0]);
+    size = myRecord.size();
+    return(true);
+}
+
+
+bool FieldCache::readBamRecord(const char*& record, uint32_t& size)
+{
+    uint64_t offset = getOffset();
+    try
+    {
+        // Only a few blocks are read after each seek.
+        if(!myBamReader.isOpen() &&
+           !myBamReader.open(myBamFile.c_str(), 
+                             BamExecutable::getThreadPool(), 1))
+        {
+            std::cerr << "ERROR: Failed to open " << myBamFile
+                      << " as a BAM file.\n";
+            return(false);
+        }
+        uint32_t blockSize = 0;
+        if(!myBamReader.seek(offset) ||
+           (myBamReader.read(&blockSize, sizeof(blockSize)) != sizeof(blockSize)))
+        {
+            std::cerr << "ERROR: Failed to read the record at offset " 
+                      << offset << " from the field cache.\n";
+            return(false);
+        }
+        myBamRecord.resize(sizeof(blockSize) + blockSize);
+        memcpy(&(myBamRecord[0]), &blockSize, sizeof(blockSize));
+        if(myBamReader.read(&(myBamRecord[sizeof(blockSize)]), blockSize) != 
+           blockSize)
+        {
+            std::cerr << "ERROR: Truncated BAM record at offset "
+                      << offset << ".\n";
+            return(false);
+        }
+    }
+    catch(std::runtime_error& e)
+    {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return(false);
+    }
+    record = &(myBamRecord[0]);
+    size = myBamRecord.size();
+    return(true);
+}
+
+
+std::string FieldCache::getDefaultName(const char* bamFile)
+{
+    std::string name = bamFile;
+    name += ".bfc";
+    return(name);
+}
+
+
+void FieldCache::Block::clear()
+{
+    offsets.clear();
+    flags.clear();
+    refIDs.clear();
+    positions.clear();
+    mapQualities.clear();
+    mateRefIDs.clear();
+    matePositions.clear();
+    insertSizes.clear();
+    readLengths.clear();
+    numCigarOps.clear();
+    cigars.clear();
+}
+
+
+bool FieldCache::writeBlock(ParallelBgzfWriter& writer, const Block& block)
+{
+    uint32_t counts[2] = {(uint32_t)block.flags.size(),
+                          (uint32_t)block.cigars.size()};
+    // The offsets and the positions of sorted files are close to the
+    // previous ones, so their differences compress better.
+    std::vector<uint64_t> offsets(block.offsets);
+    std::vector<int32_t> positions(block.positions);
+    for(size_t i = offsets.size(); i > 1; i--)
+    {
+        offsets[i - 1] -= offsets[i - 2];
+        positions[i - 1] =
+            (uint32_t)positions[i - 1] - (uint32_t)positions[i - 2];
+    }
+    return(writer.write(counts, sizeof(counts)) &&
+           writeColumn(writer, offsets) &&
+           writeColumn(writer, block.flags) &&
+           writeColumn(writer, block.refIDs) &&
+           writeColumn(writer, positions) &&
+           writeColumn(writer, block.mapQualities) &&
+           writeColumn(writer, block.mateRefIDs) &&
+           writeColumn(writer, block.matePositions) &&
+           writeColumn(writer, block.insertSizes) &&
+           writeColumn(writer, block.readLengths) &&
+           writeColumn(writer, block.numCigarOps) &&
+           writeColumn(writer, block.cigars));
+}
+
+
+template<class T>
+bool FieldCache::writeColumn(ParallelBgzfWriter& writer,
+                             const std::vector<T>& column)
+{
+    // Write in pieces so the length fits the writer's.
+    static const size_t MAX_PIECE = 1 << 30;
+    const char* data = (const char*)column.data();
+    size_t len = column.size() * sizeof(T);
+    for(size_t done = 0; done < len; done += MAX_PIECE)
+    {
+        if(!writer.write(data + done, std::min(len - done, MAX_PIECE)))
+        {
+            return(false);
+        }
+    }
+    return(true);
+}
+
+
+bool FieldCache::readBlock()
+{
+    if(myDone)
+    {
+        return(false);
+    }
+    uint32_t counts[2] = {0, 0};
+    if(myReader.read(counts, sizeof(counts)) != sizeof(counts))
+    {
+        throw std::runtime_error("The field cache is truncated");
+    }
+    if(counts[0] == 0)
+    {
+        // The empty block after the last records.
+        myDone = true;
+        myBlock.clear();
+        return(false);
+    }
+    readColumn(myBlock.offsets, counts[0]);
+    readColumn(myBlock.flags, counts[0]);
+    readColumn(myBlock.refIDs, counts[0]);
+    readColumn(myBlock.positions, counts[0]);
+    readColumn(myBlock.mapQualities, counts[0]);
+    readColumn(myBlock.mateRefIDs, counts[0]);
+    readColumn(myBlock.matePositions, counts[0]);
+    readColumn(myBlock.insertSizes, counts[0]);
+    readColumn(myBlock.readLengths, counts[0]);
+    readColumn(myBlock.numCigarOps, counts[0]);
+    readColumn(myBlock.cigars, counts[1]);
+    for(size_t i = 1; i < myBlock.offsets.size(); i++)
+    {
+        myBlock.offsets[i] += myBlock.offsets[i - 1];
+        myBlock.positions[i] =
+            (uint32_t)myBlock.positions[i] + (uint32_t)myBlock.positions[i - 1];
+    }
+    myIndex = 0;
+    myCigarIndex = 0;
+    return(true);
+}
+
+
+template<class T>
+void FieldCache::readColumn(std::vector<T>& column, uint32_t numValues)
+{
+    // Read in pieces so the length fits the reader's.
+    static const size_t MAX_PIECE = 1 << 30;
+    column.resize(numValues);
+    char* data = (char*)column.data();
+    size_t len = column.size() * sizeof(T);
+    for(size_t done = 0; done < len; done += MAX_PIECE)
+    {
+        uint32_t pieceLen = std::min(len - done, MAX_PIECE);
+        if(myReader.read(data + done, pieceLen) != pieceLen)
+        {
+            throw std::runtime_error("The field cache is truncated");
+        }
+    }
+}
+
+
+bool FieldCache::getFileInfo(const char* filename, int64_t& size,
+                             int64_t& modTime)
+{
+    struct stat fileStat;
+    if(stat(filename, &fileStat) != 0)
+    {
+        return(false);
+    }
+    size = fileStat.st_size;
+    modTime = fileStat.st_mtime;
+    return(true);
+}
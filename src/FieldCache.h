@@ -0,0 +1,133 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FIELD_CACHE_H__
+#define __FIELD_CACHE_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "ParallelBgzf.h"
+
+/// Columnar sidecar of the fields of a BAM file's records that the QC
+/// tools need (flag, reference, position, mapping quality, CIGAR, mate,
+/// insert size, read length, and the record's virtual offset), so
+/// repeated runs read a fraction of the data the BAM file takes.
+/// The cache is a BGZF file with a magic number, the size and
+/// modification time of the BAM file it was built from, and then blocks
+/// of up to BLOCK_RECORDS records, each with its number of records and
+/// CIGAR operations followed by the values of one field for all of its
+/// records at a time (the offsets and positions as the differences from
+/// the previous record's), ending with an empty block.
+class FieldCache
+{
+public:
+    FieldCache();
+    ~FieldCache();
+
+    /// Records per block of the cache.
+    static const uint32_t BLOCK_RECORDS = 65536;
+
+    /// Build the cache of the specified BAM file, writing it to cacheFile.
+    /// Returns false and prints the error on failure.
+    static bool build(const char* bamFile, const char* cacheFile,
+                      uint64_t& numRecords);
+
+    /// Open the cache of the BAM file if it exists.  Returns false,
+    /// after printing a warning unless the cache does not exist, if it
+    /// cannot be used: it is invalid or the BAM file has changed since it
+    /// was built.  The BAM file should then be read instead.
+    bool open(const char* cacheFile, const char* bamFile);
+    void close();
+
+    /// Read the cached fields of the next record as a BAM record buffer
+    /// (starting with the block size) for BamRecordView, with an empty
+    /// read name, 0 for the bin, and no sequence, qualities, or tags.
+    /// Returns false at the end of the records.
+    /// Throws std::runtime_error if the cache is corrupt or truncated.
+    bool next(const char*& record, uint32_t& size);
+
+    /// BGZF virtual offset in the BAM file of the last record from next.
+    uint64_t getOffset() const { return(myBlock.offsets[myIndex - 1]); }
+
+    /// Read the full BAM record of the last record from next from the
+    /// BAM file, returning false and printing the error on failure.
+    /// The record is valid until the next call.
+    bool readBamRecord(const char*& record, uint32_t& size);
+
+    /// The default name of the cache for the BAM file.
+    static std::string getDefaultName(const char* bamFile);
+
+private:
+    FieldCache(const FieldCache&);
+    FieldCache& operator=(const FieldCache&);
+
+    // Read the next block of records, returning false after the last.
+    bool readBlock();
+
+    // Read a column of numValues values.
+    template<class T>
+    void readColumn(std::vector<T>& column, uint32_t numValues);
+
+    // Size and modification time of the file, false if it does not exist.
+    static bool getFileInfo(const char* filename, int64_t& size,
+                            int64_t& modTime);
+
+    static const char MAGIC[4];
+    static const int BLOCKS_PER_THREAD = 4;
+
+    ParallelBgzfReader myReader;
+    std::string myBamFile;
+    ParallelBgzfReader myBamReader;
+    bool myDone;
+
+    // The columns of a block.
+    struct Block
+    {
+        std::vector<uint64_t> offsets;
+        std::vector<uint16_t> flags;
+        std::vector<int32_t> refIDs;
+        std::vector<int32_t> positions;
+        std::vector<uint8_t> mapQualities;
+        std::vector<int32_t> mateRefIDs;
+        std::vector<int32_t> matePositions;
+        std::vector<int32_t> insertSizes;
+        std::vector<int32_t> readLengths;
+        std::vector<uint16_t> numCigarOps;
+        // The raw BAM CIGAR entries of all of the records.
+        std::vector<uint32_t> cigars;
+        void clear();
+    };
+
+    // Write the block to the cache, returning false if a write failed.
+    static bool writeBlock(ParallelBgzfWriter& writer, const Block& block);
+    template<class T>
+    static bool writeColumn(ParallelBgzfWriter& writer,
+                            const std::vector<T>& column);
+
+    Block myBlock;
+    // Index of the next record in the block and of its first CIGAR op.
+    uint32_t myIndex;
+    uint32_t myCigarIndex;
+
+    // The record returned by next and by readBamRecord.
+    std::vector<char> myRecord;
+    std::vector<char> myBamRecord;
+};
+
+#endif
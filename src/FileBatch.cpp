@@ -0,0 +1,123 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+
+#include "FileBatch.h"
+#include "BamExecutable.h"
+
+FileBatch::FileBatch()
+    : myFiles()
+{
+}
+
+
+bool FileBatch::readList(const char* listFile)
+{
+    myFiles.clear();
+    std::ifstream in(listFile);
+    if(!in)
+    {
+        std::cerr << "Failed to open the file list " << listFile << std::endl;
+        return(false);
+    }
+    std::string line;
+    while(std::getline(in, line))
+    {
+        // Ignore trailing whitespace, including DOS line endings.
+        size_t end = line.find_last_not_of(" \t\r");
+        if((end == std::string::npos) || (line[0] == '#'))
+        {
+            continue;
+        }
+        myFiles.push_back(line.substr(0, end + 1));
+    }
+    if(myFiles.empty())
+    {
+        std::cerr << "The file list " << listFile 
+                  << " does not list any files" << std::endl;
+        return(false);
+    }
+    return(true);
+}
+
+
+unsigned int FileBatch::run(const Process& process, std::ostream& os,
+                            bool concurrent)
+{
+    unsigned int numFailed = 0;
+    if(!concurrent || (BamExecutable::getNumThreads() <= 1))
+    {
+        for(unsigned int i = 0; i < myFiles.size(); i++)
+        {
+            os << "File: " << myFiles[i] << std::endl;
+            if(process(i, myFiles[i], os) != 0)
+            {
+                ++numFailed;
+            }
+            os << std::endl;
+        }
+        return(numFailed);
+    }
+
+    // Each file is a task, its report is buffered until it is written.
+    struct Result
+    {
+        int status;
+        std::string report;
+    };
+    std::vector< std::future<Result> > results;
+    for(unsigned int i = 0; i < myFiles.size(); i++)
+    {
+        const std::string& file = myFiles[i];
+        results.push_back(BamExecutable::getThreadPool().submit([&process, i, &file]()
+            {
+                std::ostringstream out;
+                Result result;
+                result.status = process(i, file, out);
+                result.report = out.str();
+                return(result);
+            }));
+    }
+    for(unsigned int i = 0; i < results.size(); i++)
+    {
+        Result result;
+        try
+        {
+            result = results[i].get();
+        }
+        catch(...)
+        {
+            // The remaining tasks use process, so let them finish
+            // before rethrowing.
+            for(unsigned int j = i + 1; j < results.size(); j++)
+            {
+                results[j].wait();
+            }
+            throw;
+        }
+        os << "File: " << myFiles[i] << std::endl << result.report << std::endl;
+        if(result.status != 0)
+        {
+            ++numFailed;
+        }
+    }
+    return(numFailed);
+}
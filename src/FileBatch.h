@@ -0,0 +1,59 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FILE_BATCH_H__
+#define __FILE_BATCH_H__
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// Processes a list of input files in one run, several at a time on the
+/// thread pool, so many small files do not each pay for starting the
+/// tool.  The report of each file is written in list order.
+class FileBatch
+{
+public:
+    /// Process the file with the specified index in the list, writing its
+    /// report to out.  Returns 0 on success, otherwise its failure status.
+    /// Runs on the thread pool when run concurrently, in which case it
+    /// must not use the pool itself.
+    typedef std::function<int(unsigned int index, const std::string& file,
+                              std::ostream& out)> Process;
+
+    FileBatch();
+
+    /// Read the file names from listFile, one per line, skipping blank
+    /// lines and lines starting with '#'.  Returns false after reporting
+    /// the failure if it cannot be read or lists no files.
+    bool readList(const char* listFile);
+
+    const std::vector<std::string>& getFiles() const { return(myFiles); }
+
+    /// Process each file, writing its name and then its report to os.
+    /// If concurrent is false, or there is only 1 thread, the files are
+    /// processed one at a time on this thread, so process may use the
+    /// thread pool.  Returns the number of files that failed.
+    unsigned int run(const Process& process, std::ostream& os,
+                     bool concurrent = true);
+
+private:
+    std::vector<std::string> myFiles;
+};
+
+#endif
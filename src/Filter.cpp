@@ -16,13 +16,110 @@
  */
 
 //////////////////////////////////////////////////////////////////////////
+#include <ctype.h>
+#include <string.h>
+#include <vector>
+
 #include "Filter.h"
 
 #include "Parameters.h"
 #include "BgzfFileType.h"
 #include "GenomeSequence.h"
-#include "SamFile.h"
+#include "ThreadedSamFile.h"
 #include "SamFilter.h"
+#include "ParallelRecordMap.h"
+
+// Cigar operations in the BAM record.
+static const uint32_t BAM_CIGAR_MATCH = 0;
+static const uint32_t BAM_CIGAR_INS = 1;
+static const uint32_t BAM_CIGAR_DEL = 2;
+static const uint32_t BAM_CIGAR_SKIP = 3;
+static const uint32_t BAM_CIGAR_SOFT_CLIP = 4;
+static const uint32_t BAM_CIGAR_EQUAL = 7;
+static const uint32_t BAM_CIGAR_DIFF = 8;
+
+// Returns true if the read has aligned bases and all of them match the
+// reference (in the same way SamFilter compares them), in which case
+// neither SamFilter check changes the read.  refStart is the genome index
+// of the start of the read's chromosome.
+// This walks the cigar and the packed sequence once, stopping at the
+// first mismatch, so the SamFilter checks only walk reads that have one.
+static bool allBasesMatch(SamRecord& record, GenomeSequence& reference,
+                          genomeIndex_t refStart)
+{
+    static const char SEQ_BASES[] = "=ACMGRSVTWYHKDBN";
+
+    const unsigned char* buffer = 
+        (const unsigned char*)record.getRecordBuffer(SamRecord::NONE);
+    if((buffer == NULL) || (refStart == INVALID_GENOME_INDEX))
+    {
+        return(false);
+    }
+    int32_t position = 0;
+    uint8_t readNameLength = buffer[12];
+    uint16_t cigarLength = 0;
+    int32_t readLength = 0;
+    memcpy(&position, buffer + 8, sizeof(position));
+    memcpy(&cigarLength, buffer + 16, sizeof(cigarLength));
+    memcpy(&readLength, buffer + 20, sizeof(readLength));
+    if(position < 0)
+    {
+        return(false);
+    }
+    const unsigned char* cigar = buffer + 36 + readNameLength;
+    const unsigned char* seq = cigar + (cigarLength * sizeof(uint32_t));
+
+    uint64_t refPos = (uint64_t)refStart + position;
+    uint64_t genomeLength = reference.sequenceLength();
+    int32_t readIndex = 0;
+    int32_t numAligned = 0;
+    for(int i = 0; i < cigarLength; i++)
+    {
+        uint32_t cigarOp = 0;
+        memcpy(&cigarOp, cigar + (i * sizeof(uint32_t)), sizeof(cigarOp));
+        uint32_t opLength = cigarOp >> 4;
+        switch(cigarOp & 0xF)
+        {
+            case BAM_CIGAR_MATCH:
+            case BAM_CIGAR_EQUAL:
+            case BAM_CIGAR_DIFF:
+                if((readIndex + (int64_t)opLength > readLength) ||
+                   (refPos + opLength > genomeLength))
+                {
+                    return(false);
+                }
+                for(uint32_t j = 0; j < opLength; j++)
+                {
+                    char readBase = 
+                        SEQ_BASES[(seq[readIndex >> 1] >> 
+                                   ((~readIndex & 1) << 2)) & 0xF];
+                    char refBase = reference[refPos];
+                    if((readBase != '=') && (refBase != '=') &&
+                       (toupper(readBase) != toupper(refBase)))
+                    {
+                        return(false);
+                    }
+                    ++readIndex;
+                    ++refPos;
+                }
+                numAligned += opLength;
+                break;
+            case BAM_CIGAR_INS:
+            case BAM_CIGAR_SOFT_CLIP:
+                readIndex += opLength;
+                break;
+            case BAM_CIGAR_DEL:
+            case BAM_CIGAR_SKIP:
+                refPos += opLength;
+                break;
+            default:
+                // Hard clips and pads do not consume either.
+                break;
+        }
+    }
+    return(numAligned > 0);
+}
+
 
 void Filter::printFilterDescription(std::ostream& os)
 {
@@ -126,12 +223,12 @@ int Filter::execute(int argc, char **argv)
     GenomeSequence reference(refFile);
 
     // Open the bam file.
-    SamFile samIn;
+    ThreadedSamFile samIn;
     // Open the file for reading.   
     samIn.OpenForRead(inFile);
 
     // Open the output file.
-    SamFile samOut;
+    ThreadedSamFile samOut;
     samOut.OpenForWrite(outFile);
 
     // Read the sam header.
@@ -141,21 +238,45 @@ int Filter::execute(int argc, char **argv)
     // Write the header to the output file.
     samOut.WriteHeader(samHeader);
 
-    // Read the sam records.
-    SamRecord samRecord;
-
-    SamStatus::Status returnStatus = SamStatus::SUCCESS;
-    
-    int clippedCount = 0;
-    int mismatchThresholdFilterCount = 0;
-    int qualityThresholdFilterCount = 0;
+    // Counts and the current chromosome kept by each worker.
+    struct WorkerState
+    {
+        int clippedCount;
+        int mismatchThresholdFilterCount;
+        int qualityThresholdFilterCount;
+        // Genome index of the start of the current record's chromosome.
+        int32_t refID;
+        genomeIndex_t refStart;
+        WorkerState()
+            : clippedCount(0),
+              mismatchThresholdFilterCount(0),
+              qualityThresholdFilterCount(0),
+              refID(-1),
+              refStart(INVALID_GENOME_INDEX) {}
+    };
+    std::vector<WorkerState> workers(ParallelRecordMap::getNumWorkers());
 
-    // Keep reading records until they aren't anymore.
-    while(samIn.ReadRecord(samHeader, samRecord))
+    // Records are filtered on the thread pool when using multiple threads
+    // and written in their original order.
+    ParallelRecordMap recordMap;
+    SamStatus::Status returnStatus = 
+        recordMap.run(samIn, samOut, samHeader,
+                      [&](SamRecord& samRecord, unsigned int worker)
     {
-        // Store the original cigar and position for later reference.
-        //        std::string origCigarString = samRecord.getCigar();
-        //        int32_t origPosition = samRecord.get0BasedPosition();
+        WorkerState& state = workers[worker];
+        if(samRecord.getReferenceID() != state.refID)
+        {
+            state.refID = samRecord.getReferenceID();
+            state.refStart = 
+                reference.getGenomePosition(samRecord.getReferenceName());
+        }
+
+        // Reads with no mismatches are neither clipped nor filtered.
+        if((mismatchThreshold >= 0) &&
+           allBasesMatch(samRecord, reference, state.refStart))
+        {
+            return(true);
+        }
 
         SamFilter::FilterStatus filterStatus = 
             SamFilter::clipOnMismatchThreshold(samRecord, reference,
@@ -165,7 +286,7 @@ int Filter::execute(int argc, char **argv)
         if(filterStatus == SamFilter::FILTERED)
         {
             // The read was filtered, update the counter.
-            ++ mismatchThresholdFilterCount;
+            ++state.mismatchThresholdFilterCount;
         }
         else
         {
@@ -174,7 +295,7 @@ int Filter::execute(int argc, char **argv)
             {
                 // The read was clipped, nothing to do other than
                 // update the counter.
-                ++clippedCount;
+                ++state.clippedCount;
             }
 
             // Now filter on mismatch quality.
@@ -185,40 +306,21 @@ int Filter::execute(int argc, char **argv)
             if(filterStatus == SamFilter::FILTERED)
             {
                 // Filtered.
-                ++qualityThresholdFilterCount;
+                ++state.qualityThresholdFilterCount;
             }
         }
+        return(true);
+    });
 
-        // Write the record.
-        samOut.WriteRecord(samHeader, samRecord);
-
-//         // If the read was clipped or filtered,
-//         // write the read and the associated reference to a file.
-//         if(filterStatus != SamFilter::NONE)
-//         {
-//             uint32_t chrStart = 
-//                 reference.getGenomePosition(samRecord.getReferenceName());
-//             std::string referenceString;
-//             reference.getString(referenceString, 
-//                                 chrStart + samRecord.get0BasedUnclippedStart(),
-//                                 samRecord.getReadLength());
-//             std:: cerr << samRecord.get0BasedPosition()
-//                        << "\t"
-//                        << samRecord.getCigar()
-//                        << "\t"
-//                        << samRecord.getSequence()
-//                        << "\t"
-//                        << samRecord.getQuality()
-//                        << "\n"
-//                        << origPosition
-//                        << "\t"
-//                        << origCigarString
-//                        << "\t"
-//                        << referenceString
-//                        << "\t"
-//                        << samRecord.getQuality()
-//                        << "\n\n";
-//         }
+    int clippedCount = 0;
+    int mismatchThresholdFilterCount = 0;
+    int qualityThresholdFilterCount = 0;
+    for(unsigned int i = 0; i < workers.size(); i++)
+    {
+        clippedCount += workers[i].clippedCount;
+        mismatchThresholdFilterCount += 
+            workers[i].mismatchThresholdFilterCount;
+        qualityThresholdFilterCount += workers[i].qualityThresholdFilterCount;
     }
     
     std::cerr << "Number of Reads Clipped by Filtering: "
@@ -22,9 +22,11 @@
 
 #include <bitset>
 #include "FindCigars.h"
-#include "SamFile.h"
+#include "ThreadedSamFile.h"
 #include "Parameters.h"
 #include "BgzfFileType.h"
+#include "BamRecordView.h"
+#include "FieldCache.h"
 
 FindCigars::FindCigars()
 {
@@ -48,6 +50,8 @@ void FindCigars::printUsage(std::ostream& os)
     os << "\t./bam findCigars --in <inputFile> --out <outputFile.sam/bam/ubam (ubam is uncompressed bam)> [--cinsert] [--cdel] [--cpad] [--cskip] [--chardClip] [--csoftClip] [--nonM] [--noeof] [--params]" << std::endl;
     os << "\tRequired Parameters:" << std::endl;
     os << "\t\t--in         : the SAM/BAM file to be read" << std::endl;
+    os << "\t\t               (the reads are selected from the --in value + \".bfc\" field" << std::endl;
+    os << "\t\t               cache built by cacheFields if it is up to date)" << std::endl;
     os << "\t\t--out        : the SAM/BAM file to be written" << std::endl;
     os << "\tOptional Parameters:" << std::endl;
     os << "\t\t--cinsert     : output reads that contain insertions ('I')." << std::endl;
@@ -179,12 +183,24 @@ int FindCigars::execute(int argc, char **argv)
         return(-1);
     }
 
+    // The records can be selected from the field cache if there is an
+    // up to date one, only reading the selected records from the file.
+    FieldCache fieldCache;
+    bool useCache = 
+        fieldCache.open(FieldCache::getDefaultName(inFile.c_str()).c_str(),
+                        inFile.c_str());
+
     // Open the input file for reading.
-    SamFile samIn;
+    ThreadedSamFile samIn;
+    if(useCache)
+    {
+        // Only the header is read through samIn.
+        samIn.setThreadedRead(false);
+    }
     samIn.OpenForRead(inFile);
 
     // Open the output file for writing.
-    SamFile samOut;
+    ThreadedSamFile samOut;
     samOut.OpenForWrite(outFile);
 
     // Read the sam header.
@@ -195,29 +211,43 @@ int FindCigars::execute(int argc, char **argv)
     samOut.WriteHeader(samHeader);
 
     SamRecord samRecord;
+    BamRecordView recordView;
+    const char* recordBuffer = NULL;
+    uint32_t recordSize = 0;
+    uint64_t numRecords = 0;
 
     // Set returnStatus to success.  It will be changed to the
     // failure reason if any of the writes or updates fail.
     SamStatus::Status returnStatus = SamStatus::SUCCESS;
 
-    // Keep reading records until ReadRecord returns false.
-    while(samIn.ReadRecord(samHeader, samRecord))
+    // Only the cigar is needed to select the records, so they are checked
+    // and written without being decoded into SamRecords.
+    // Keep reading records until there are no more.
+    while(useCache ? fieldCache.next(recordBuffer, recordSize) :
+          samIn.ReadRawRecord(samHeader, samRecord, recordBuffer, recordSize))
     {
+        ++numRecords;
         // Check the cigar.
-        Cigar* cigarPtr = samRecord.getCigarInfo();
-        if(cigarPtr == NULL)
+        if(!recordView.set(recordBuffer, recordSize))
         {
             std::cerr << "Failed to get a cigar.";
             return(-1);
         }
-        for(int i = 0; i < cigarPtr->size(); i++)
+        for(uint16_t i = 0; i < recordView.getNumCigarOps(); i++)
         {
-            Cigar::Operation op = cigarPtr->getOperator(i).operation;
+            Cigar::Operation op = recordView.getCigarOperation(i);
 
             if(desiredOps[op])
             {
+                // The cached record only has the fields, so read the
+                // whole record to write it.
+                if(useCache &&
+                   !fieldCache.readBamRecord(recordBuffer, recordSize))
+                {
+                    return(SamStatus::FAIL_IO);
+                }
                 // This cigar has a desired operation, so write the record.
-                if(!samOut.WriteRecord(samHeader, samRecord))
+                if(!samOut.WriteRawRecord(samHeader, recordBuffer, recordSize))
                 {
                     // Failed to write a record.
                     fprintf(stderr, "%s\n", samOut.GetStatusMessage());
@@ -229,7 +259,7 @@ int FindCigars::execute(int argc, char **argv)
         }
     }
     std::cerr << std::endl << "Number of records read = " << 
-        samIn.GetCurrentRecordCount() << std::endl;
+        numRecords << std::endl;
     std::cerr << "Number of records written = " << 
         samOut.GetCurrentRecordCount() << std::endl;
 
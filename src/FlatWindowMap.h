@@ -0,0 +1,512 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//////////////////////////////////////////////////////////////////////////
+// Hash maps whose entries are grouped into windows (by reference and
+// coordinate) so the maps can be cleaned up one window at a time as a
+// coordinate sorted file is processed.
+
+#ifndef __FLAT_WINDOW_MAP_H__
+#define __FLAT_WINDOW_MAP_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+/// Return the window id for the 0-based reference id/coordinate, such that
+/// window ids increase with (reference, coordinate).  Coordinates may be
+/// negative (unclipped starts).
+inline uint64_t getWindowId(int32_t referenceID, int32_t coordinate,
+                            int windowShift)
+{
+    uint32_t shiftedCoord = (uint32_t)((int64_t)coordinate + 0x80000000LL);
+    return(((uint64_t)(uint32_t)referenceID << 32 | shiftedCoord) >> windowShift);
+}
+
+
+/// Open addressing hash map split into windows.  Each key must always be
+/// accessed with the same window id and windows must be ordered the same
+/// as the keys (if windowA < windowB, then all keys in windowA are less
+/// than the keys in windowB).
+/// Pointers returned by insert are only valid until the next insert.
+template<class KEY, class VALUE, class HASH, class EQUAL, class LESS>
+class FlatWindowMap
+{
+public:
+    typedef std::pair<VALUE*, bool> InsertReturn;
+
+    FlatWindowMap()
+        : myWindows(), myFreeWindows(), mySize(0)
+    {}
+
+    ~FlatWindowMap()
+    {
+        clear();
+        for(unsigned int i = 0; i < myFreeWindows.size(); i++)
+        {
+            delete myFreeWindows[i];
+        }
+    }
+
+    /// Find the key, inserting it with a default value if it is not found.
+    /// second is true if the key was inserted.
+    InsertReturn insert(uint64_t windowId, const KEY& key)
+    {
+        typename WindowMap::iterator iter = myWindows.find(windowId);
+        if(iter == myWindows.end())
+        {
+            iter = myWindows.insert(std::make_pair(windowId, newWindow())).first;
+        }
+        Window& window = *(iter->second);
+        if((window.numUsed + 1) * 4 > window.slots.size() * 3)
+        {
+            grow(window);
+        }
+        size_t mask = window.slots.size() - 1;
+        for(size_t pos = myHash(key) & mask; ; pos = (pos + 1) & mask)
+        {
+            Slot& slot = window.slots[pos];
+            if(!slot.used)
+            {
+                slot.used = true;
+                slot.key = key;
+                slot.value = VALUE();
+                ++window.numUsed;
+                ++mySize;
+                return(InsertReturn(&(slot.value), true));
+            }
+            if(myEqual(slot.key, key))
+            {
+                return(InsertReturn(&(slot.value), false));
+            }
+        }
+    }
+
+    size_t size() const { return(mySize); }
+
+    /// Remove all entries in windows prior to windowId and the entries in
+    /// windowId whose key is less than cutKey.  func(key, value) is called
+    /// for each removed entry in key order before it is removed.
+    template<class FUNC>
+    void removeBefore(uint64_t windowId, const KEY& cutKey, FUNC func)
+    {
+        std::vector<Slot> removed;
+        typename WindowMap::iterator iter = myWindows.begin();
+        while((iter != myWindows.end()) && (iter->first < windowId))
+        {
+            Window* window = iter->second;
+            size_t windowStart = removed.size();
+            for(size_t i = 0; i < window->slots.size(); i++)
+            {
+                if(window->slots[i].used)
+                {
+                    removed.push_back(window->slots[i]);
+                }
+            }
+            // Windows are in key order, so each window's entries
+            // only need to be sorted among themselves.
+            std::sort(removed.begin() + windowStart, removed.end(), 
+                      SlotLess(myLess));
+            mySize -= window->numUsed;
+            releaseWindow(window);
+            myWindows.erase(iter++);
+        }
+        if((iter != myWindows.end()) && (iter->first == windowId))
+        {
+            // Boundary window, so only remove the keys before cutKey,
+            // reinserting the rest.
+            Window* window = iter->second;
+            bool anyRemoved = false;
+            for(size_t i = 0; i < window->slots.size(); i++)
+            {
+                if(window->slots[i].used && myLess(window->slots[i].key, cutKey))
+                {
+                    anyRemoved = true;
+                    break;
+                }
+            }
+            if(anyRemoved)
+            {
+                size_t windowStart = removed.size();
+                std::vector<Slot> kept;
+                for(size_t i = 0; i < window->slots.size(); i++)
+                {
+                    Slot& slot = window->slots[i];
+                    if(!slot.used)
+                    {
+                        continue;
+                    }
+                    if(myLess(slot.key, cutKey))
+                    {
+                        removed.push_back(slot);
+                    }
+                    else
+                    {
+                        kept.push_back(slot);
+                    }
+                    slot.used = false;
+                }
+                mySize -= window->numUsed;
+                window->numUsed = 0;
+                for(size_t i = 0; i < kept.size(); i++)
+                {
+                    *(insert(windowId, kept[i].key).first) = kept[i].value;
+                }
+                std::sort(removed.begin() + windowStart, removed.end(), 
+                          SlotLess(myLess));
+            }
+        }
+
+        for(size_t i = 0; i < removed.size(); i++)
+        {
+            func(removed[i].key, removed[i].value);
+        }
+    }
+
+    /// Remove all entries, calling func(key, value) for each in key order.
+    template<class FUNC>
+    void removeAll(FUNC func)
+    {
+        std::vector<Slot> removed;
+        removed.reserve(mySize);
+        for(typename WindowMap::iterator iter = myWindows.begin(); 
+            iter != myWindows.end(); iter++)
+        {
+            Window* window = iter->second;
+            size_t windowStart = removed.size();
+            for(size_t i = 0; i < window->slots.size(); i++)
+            {
+                if(window->slots[i].used)
+                {
+                    removed.push_back(window->slots[i]);
+                }
+            }
+            std::sort(removed.begin() + windowStart, removed.end(), 
+                      SlotLess(myLess));
+        }
+        clear();
+        for(size_t i = 0; i < removed.size(); i++)
+        {
+            func(removed[i].key, removed[i].value);
+        }
+    }
+
+    /// Call func for every value in the map (in no particular order).
+    template<class FUNC>
+    void forEach(FUNC func)
+    {
+        for(typename WindowMap::iterator iter = myWindows.begin(); 
+            iter != myWindows.end(); iter++)
+        {
+            Window* window = iter->second;
+            for(size_t i = 0; i < window->slots.size(); i++)
+            {
+                if(window->slots[i].used)
+                {
+                    func(window->slots[i].key, window->slots[i].value);
+                }
+            }
+        }
+    }
+
+    void clear()
+    {
+        for(typename WindowMap::iterator iter = myWindows.begin(); 
+            iter != myWindows.end(); iter++)
+        {
+            releaseWindow(iter->second);
+        }
+        myWindows.clear();
+        mySize = 0;
+    }
+
+private:
+    struct Slot
+    {
+        KEY key;
+        VALUE value;
+        bool used;
+        Slot() : key(), value(), used(false) {}
+    };
+
+    struct SlotLess
+    {
+        SlotLess(LESS& less) : myLessRef(less) {}
+        bool operator()(const Slot& lhs, const Slot& rhs) const
+        { return(myLessRef(lhs.key, rhs.key)); }
+        LESS& myLessRef;
+    };
+
+    struct Window
+    {
+        std::vector<Slot> slots;
+        size_t numUsed;
+    };
+
+    typedef std::map<uint64_t, Window*> WindowMap;
+
+    // Initial number of slots per window, must be a power of 2.
+    static const size_t INITIAL_SLOTS = 16;
+
+    Window* newWindow()
+    {
+        if(!myFreeWindows.empty())
+        {
+            Window* window = myFreeWindows.back();
+            myFreeWindows.pop_back();
+            return(window);
+        }
+        Window* window = new Window;
+        window->slots.resize(INITIAL_SLOTS);
+        window->numUsed = 0;
+        return(window);
+    }
+
+    void releaseWindow(Window* window)
+    {
+        for(size_t i = 0; i < window->slots.size(); i++)
+        {
+            window->slots[i].used = false;
+        }
+        window->numUsed = 0;
+        myFreeWindows.push_back(window);
+    }
+
+    void grow(Window& window)
+    {
+        std::vector<Slot> oldSlots(window.slots.size() * 2);
+        oldSlots.swap(window.slots);
+        size_t mask = window.slots.size() - 1;
+        for(size_t i = 0; i < oldSlots.size(); i++)
+        {
+            if(!oldSlots[i].used)
+            {
+                continue;
+            }
+            size_t pos = myHash(oldSlots[i].key) & mask;
+            while(window.slots[pos].used)
+            {
+                pos = (pos + 1) & mask;
+            }
+            window.slots[pos] = oldSlots[i];
+        }
+    }
+
+    WindowMap myWindows;
+    std::vector<Window*> myFreeWindows;
+    size_t mySize;
+    HASH myHash;
+    EQUAL myEqual;
+    LESS myLess;
+};
+
+
+/// Multimap from a uint64_t key to values, split into windows of
+/// 2^windowShift keys.  Values with the same key are kept in insertion
+/// order.
+template<class VALUE>
+class FlatWindowMultiMap
+{
+public:
+    FlatWindowMultiMap(int windowShift)
+        : myWindowShift(windowShift), myWindows(), myFreeWindows(), mySize(0)
+    {}
+
+    ~FlatWindowMultiMap()
+    {
+        clear();
+        for(unsigned int i = 0; i < myFreeWindows.size(); i++)
+        {
+            delete myFreeWindows[i];
+        }
+    }
+
+    /// Add a default value for the key, returning a pointer to it that is
+    /// valid until the next insert/extract.
+    VALUE* insert(uint64_t key)
+    {
+        uint64_t windowId = key >> myWindowShift;
+        typename WindowMap::iterator iter = myWindows.find(windowId);
+        if(iter == myWindows.end())
+        {
+            std::vector<Entry>* window = NULL;
+            if(!myFreeWindows.empty())
+            {
+                window = myFreeWindows.back();
+                myFreeWindows.pop_back();
+            }
+            else
+            {
+                window = new std::vector<Entry>;
+            }
+            iter = myWindows.insert(std::make_pair(windowId, window)).first;
+        }
+        iter->second->push_back(Entry(key));
+        ++mySize;
+        return(&(iter->second->back().value));
+    }
+
+    /// Find the first value for this key for which match(value) is true,
+    /// removing it from the map and storing it in value.
+    /// Returns false if no match was found.
+    template<class PRED>
+    bool extract(uint64_t key, PRED& match, VALUE& value)
+    {
+        typename WindowMap::iterator iter = myWindows.find(key >> myWindowShift);
+        if(iter == myWindows.end())
+        {
+            return(false);
+        }
+        std::vector<Entry>& window = *(iter->second);
+        for(typename std::vector<Entry>::iterator entry = window.begin();
+            entry != window.end(); entry++)
+        {
+            if((entry->key == key) && match(entry->value))
+            {
+                value = entry->value;
+                window.erase(entry);
+                --mySize;
+                if(window.empty())
+                {
+                    myFreeWindows.push_back(iter->second);
+                    myWindows.erase(iter);
+                }
+                return(true);
+            }
+        }
+        return(false);
+    }
+
+    size_t size() const { return(mySize); }
+
+    /// Remove all values with a key less than stopKey, calling
+    /// func(key, value) for each in key order (insertion order for equal
+    /// keys) before it is removed.
+    template<class FUNC>
+    void removeBefore(uint64_t stopKey, FUNC func)
+    {
+        uint64_t stopWindow = stopKey >> myWindowShift;
+        std::vector<Entry> removed;
+        typename WindowMap::iterator iter = myWindows.begin();
+        while((iter != myWindows.end()) && (iter->first <= stopWindow))
+        {
+            std::vector<Entry>& window = *(iter->second);
+            size_t startRemoved = removed.size();
+            if(iter->first < stopWindow)
+            {
+                removed.insert(removed.end(), window.begin(), window.end());
+                window.clear();
+            }
+            else
+            {
+                // Boundary window, only remove the keys before stopKey.
+                size_t numKept = 0;
+                for(size_t i = 0; i < window.size(); i++)
+                {
+                    if(window[i].key < stopKey)
+                    {
+                        removed.push_back(window[i]);
+                    }
+                    else
+                    {
+                        window[numKept++] = window[i];
+                    }
+                }
+                window.resize(numKept);
+            }
+            // Entries in a window are in insertion order, so a stable
+            // sort gives key then insertion order.
+            std::stable_sort(removed.begin() + startRemoved, removed.end(),
+                             EntryLess());
+            if(window.empty())
+            {
+                myFreeWindows.push_back(iter->second);
+                myWindows.erase(iter++);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+        mySize -= removed.size();
+        for(size_t i = 0; i < removed.size(); i++)
+        {
+            func(removed[i].key, removed[i].value);
+        }
+    }
+
+    /// Remove all values calling func(key, value) for each in key order.
+    /// The maximum uint64_t is not a valid key.
+    template<class FUNC>
+    void removeAll(FUNC func)
+    {
+        removeBefore(~((uint64_t)0), func);
+    }
+
+    /// Call func for every value in the map (in no particular order).
+    template<class FUNC>
+    void forEach(FUNC func)
+    {
+        for(typename WindowMap::iterator iter = myWindows.begin(); 
+            iter != myWindows.end(); iter++)
+        {
+            std::vector<Entry>& window = *(iter->second);
+            for(size_t i = 0; i < window.size(); i++)
+            {
+                func(window[i].key, window[i].value);
+            }
+        }
+    }
+
+    void clear()
+    {
+        for(typename WindowMap::iterator iter = myWindows.begin(); 
+            iter != myWindows.end(); iter++)
+        {
+            iter->second->clear();
+            myFreeWindows.push_back(iter->second);
+        }
+        myWindows.clear();
+        mySize = 0;
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t key;
+        VALUE value;
+        Entry() : key(0), value() {}
+        Entry(uint64_t k) : key(k), value() {}
+    };
+
+    struct EntryLess
+    {
+        bool operator()(const Entry& lhs, const Entry& rhs) const
+        { return(lhs.key < rhs.key); }
+    };
+
+    typedef std::map<uint64_t, std::vector<Entry>*> WindowMap;
+
+    int myWindowShift;
+    WindowMap myWindows;
+    std::vector<std::vector<Entry>*> myFreeWindows;
+    size_t mySize;
+};
+
+#endif
@@ -17,9 +17,13 @@
 
 //////////////////////////////////////////////////////////////////////////
 #include "GapInfo.h"
-#include "SamFile.h"
+#include "ThreadedSamFile.h"
 #include "BgzfFileType.h"
 #include "SamFlag.h"
+#include "BamRecordView.h"
+#include "FieldCache.h"
+#include <map>
+#include <vector>
 
 GapInfo::GapInfo()
     : BamExecutable()
@@ -45,6 +49,8 @@ void GapInfo::printUsage(std::ostream& os)
     os << "\t./bam gapInfo --in <inputFile> --out <outputFile> [--noeof] [--params]" << std::endl;
     os << "\tRequired Parameters:" << std::endl;
     os << "\t\t--in          : the SAM/BAM file to print read pair gap info for" << std::endl;
+    os << "\t\t                (reads the --in value + \".bfc\" field cache built by" << std::endl;
+    os << "\t\t                cacheFields instead if it is up to date)" << std::endl;
     os << "\t\t--out         : the output file to be written" << std::endl;
     os << "\tOptional Parameters:" << std::endl;
     os << "\t\t--refFile     : reference file, used to skip gaps that include reference base 'N' (for runs without --detailed)";
@@ -136,8 +142,20 @@ int GapInfo::processFile(const char* inputFileName, const char* outputFileName,
                          const char* refFile, bool detailed,
                          bool checkFirst, bool checkStrand)
 {
+    // Only the fixed fields and the cigar are needed, so read them from
+    // the field cache if there is an up to date one.
+    FieldCache fieldCache;
+    bool useCache = 
+        fieldCache.open(FieldCache::getDefaultName(inputFileName).c_str(),
+                        inputFileName);
+
     // Open the file for reading.
-    SamFile samIn;
+    ThreadedSamFile samIn;
+    if(useCache)
+    {
+        // Only the header is read from the file.
+        samIn.setThreadedRead(false);
+    }
     samIn.OpenForRead(inputFileName);
 
     // Read the sam header.
@@ -145,6 +163,9 @@ int GapInfo::processFile(const char* inputFileName, const char* outputFileName,
     samIn.ReadHeader(samHeader);
 
     SamRecord samRecord;
+    BamRecordView recordView;
+    const char* recordBuffer = NULL;
+    uint32_t recordSize = 0;
 
     GenomeSequence* refPtr = NULL;
     if(strcmp(refFile, "") != 0)
@@ -154,14 +175,26 @@ int GapInfo::processFile(const char* inputFileName, const char* outputFileName,
 
     IFILE outFile = ifopen(outputFileName, "w");
 
-    // Map for summary.
-    std::map<int, int> gapInfoMap;
-
-
-    // Keep reading records until ReadRecord returns false.
-    while(samIn.ReadRecord(samHeader, samRecord))
+    // Summary counts by gap size, gapCounts[gapSize] for non-negative
+    // gaps and overlapCounts[-gapSize - 1] for negative ones, with the
+    // rare gaps larger than MAX_DENSE_GAP in a map.
+    std::vector<int> gapCounts;
+    std::vector<int> overlapCounts;
+    std::map<int, int> sparseGapInfoMap;
+
+    // Only the fixed fields and the cigar are needed, so the records are
+    // not decoded into SamRecords.
+    // Keep reading records until there are no more.
+    while(useCache ? fieldCache.next(recordBuffer, recordSize) :
+          samIn.ReadRawRecord(samHeader, samRecord, recordBuffer, recordSize))
     {
-        uint16_t samFlags = samRecord.getFlag();
+        if(!recordView.set(recordBuffer, recordSize))
+        {
+            std::cerr << "ERROR: Invalid BAM record at record "
+                      << samIn.GetCurrentRecordCount() << std::endl;
+            return(SamStatus::FAIL_PARSE);
+        }
+        uint16_t samFlags = recordView.getFlag();
 
         if((!SamFlag::isMapped(samFlags)) || 
            (!SamFlag::isMateMapped(samFlags)) ||
@@ -179,14 +212,14 @@ int GapInfo::processFile(const char* inputFileName, const char* outputFileName,
 
         // No gap info if the chromosome names are different or
         // are unknown.
-        int32_t refID = samRecord.getReferenceID();
-        if((refID != samRecord.getMateReferenceID()) || (refID == -1))
+        int32_t refID = recordView.getReferenceID();
+        if((refID != recordView.getMateReferenceID()) || (refID == -1))
         {
             continue;
         }
 
-        int32_t readStart = samRecord.get0BasedPosition();
-        int32_t mateStart = samRecord.get0BasedMatePosition();
+        int32_t readStart = recordView.get0BasedPosition();
+        int32_t mateStart = recordView.get0BasedMatePosition();
 
         // If the mate starts first, then the pair was processed by
         // the mate.
@@ -202,7 +235,7 @@ int GapInfo::processFile(const char* inputFileName, const char* outputFileName,
         }
 
         // Process this read pair.
-        int32_t readEnd = samRecord.get0BasedAlignmentEnd();
+        int32_t readEnd = recordView.get0BasedAlignmentEnd();
         
         int32_t gapSize = mateStart - readEnd - 1;
 
@@ -210,7 +243,8 @@ int GapInfo::processFile(const char* inputFileName, const char* outputFileName,
         {
             // Output the gap info.
             ifprintf(outFile, "%s\t%d\t%d", 
-                     samRecord.getReferenceName(), readEnd+1, gapSize);
+                     samHeader.getReferenceLabel(refID).c_str(),
+                     readEnd+1, gapSize);
             
             // Check if it is not the first or if it is not the forward strand.
             if(checkFirst && !SamFlag::isFirstFragment(samFlags))
@@ -238,7 +272,7 @@ int GapInfo::processFile(const char* inputFileName, const char* outputFileName,
             if(refPtr != NULL)
             {
                 genomeIndex_t chromStartIndex = 
-                    refPtr->getGenomePosition(samRecord.getReferenceName());
+                    refPtr->getGenomePosition(samHeader.getReferenceLabel(refID).c_str());
                 if(chromStartIndex == INVALID_GENOME_INDEX)
                 {
                     // Invalid position, so continue to the next one.
@@ -261,7 +295,19 @@ int GapInfo::processFile(const char* inputFileName, const char* outputFileName,
             }
             
             // Update the gapInfo.
-            gapInfoMap[gapSize]++;
+            std::vector<int>& counts = 
+                (gapSize < 0) ? overlapCounts : gapCounts;
+            unsigned int index = (gapSize < 0) ? (-gapSize - 1) : gapSize;
+            if(index >= MAX_DENSE_GAP)
+            {
+                sparseGapInfoMap[gapSize]++;
+                continue;
+            }
+            if(index >= counts.size())
+            {
+                counts.resize(index + 1, 0);
+            }
+            counts[index]++;
         }
     }
 
@@ -269,8 +315,26 @@ int GapInfo::processFile(const char* inputFileName, const char* outputFileName,
     {
         // Output the summary.
         ifprintf(outFile, "GapSize\tNumPairs\n");
-        for(std::map<int,int>::iterator iter = gapInfoMap.begin(); 
-            iter != gapInfoMap.end(); iter++)
+        std::map<int,int>::iterator iter = sparseGapInfoMap.begin();
+        for(; (iter != sparseGapInfoMap.end()) && ((*iter).first < 0); iter++)
+        {
+            ifprintf(outFile, "%d\t%d\n", (*iter).first, (*iter).second);
+        }
+        for(int i = overlapCounts.size() - 1; i >= 0; i--)
+        {
+            if(overlapCounts[i] != 0)
+            {
+                ifprintf(outFile, "%d\t%d\n", -i - 1, overlapCounts[i]);
+            }
+        }
+        for(unsigned int i = 0; i < gapCounts.size(); i++)
+        {
+            if(gapCounts[i] != 0)
+            {
+                ifprintf(outFile, "%d\t%d\n", (int)i, gapCounts[i]);
+            }
+        }
+        for(; iter != sparseGapInfoMap.end(); iter++)
         {
             ifprintf(outFile, "%d\t%d\n", (*iter).first, (*iter).second);
         }
@@ -39,6 +39,9 @@ private:
     int processFile(const char* inputFileName, const char* outputFileName,
                     const char* refFile, bool detailed,
                     bool checkFirst, bool checkStrand);
+
+    // Gaps up to this size are counted in an array rather than a map.
+    static const unsigned int MAX_DENSE_GAP = 1 << 20;
 };
 
 #endif
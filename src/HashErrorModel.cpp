@@ -20,97 +20,289 @@
 #include <iostream>
 #include <stdio.h>
 #include <stdexcept>
+#include <algorithm>
 #include "HashErrorModel.h"
 #include "BaseUtilities.h"
 #include <math.h>
 
 bool HashErrorModel::ourUseLogReg = true;
-bool HashErrorModel::ourUseFast = false;
+const char HashErrorModel::TABLE_MAGIC[8] = {'R','E','C','A','B','T','B','1'};
 
 HashErrorModel::HashErrorModel()
+    : myNumDensePagesAllocated(0),
+      myNumRG(0),
+      myNumCycles(0),
+      myNumQuals(0),
+      myNumDenseCells(0),
+      myUseHash(false)
 {
 	lastElement = 0;
 }
 
 HashErrorModel::~HashErrorModel() 
 {
+    MemoryBudget::add(MemoryBudget::RECAB_TABLES,
+                      -(int64_t)myNumDensePagesAllocated * DENSE_PAGE_BYTES);
 }
 
 
 void HashErrorModel::setCell(const BaseData& data, char refBase)
 {
-    if(ourUseFast)
+    if(BaseUtilities::areEqual(refBase, data.curBase))
+    {
+        addCell(data.getKey(), 1, 0);
+    }
+    else
     {
-        if(mismatchTableFast.empty())
+        addCell(data.getKey(), 0, 1);
+    }
+}
+
+
+void HashErrorModel::addRead(const ReadCovariates& read)
+{
+    int32_t numCycles = read.getNumCycles();
+    if(numCycles == 0)
+    {
+        return;
+    }
+    const uint64_t* keys = &(read.keys[0]);
+    const uint8_t* counted = &(read.counted[0]);
+    if(!myUseHash)
+    {
+        // The read group and read are the same for all of the cycles, so
+        // the table fits the read if it fits the last counted cycle with
+        // the largest counted quality and bases.
+        uint64_t maxQual = 0;
+        uint64_t maxPreBase = 0;
+        uint64_t maxCurBase = 0;
+        int32_t lastCycle = -1;
+        for(int32_t cycle = 0; cycle < numCycles; cycle++)
+        {
+            if(counted[cycle] != ReadCovariates::SKIP)
+            {
+                maxQual = std::max(maxQual, keys[cycle] & KEY_QUAL_MASK);
+                maxPreBase = std::max(maxPreBase, keys[cycle] & KEY_PRE_BASE_MASK);
+                maxCurBase = std::max(maxCurBase, keys[cycle] & KEY_CUR_BASE_MASK);
+                lastCycle = cycle;
+            }
+        }
+        if(lastCycle < 0)
         {
-            mismatchTableFast.resize(BaseData::getFastKeySize());
+            return;
         }
-        SMatchesFast& matchInfo = mismatchTableFast[data.getFastKey()];
-        if(BaseUtilities::areEqual(refBase, data.curBase))
+        uint64_t maxKey = (keys[lastCycle] & 
+                           ~(KEY_QUAL_MASK | KEY_PRE_BASE_MASK | KEY_CUR_BASE_MASK)) |
+            maxQual | maxPreBase | maxCurBase;
+        if(!inDenseTable(maxKey) && !growDenseTable(maxKey))
         {
-            ++(matchInfo.m);
+            // Too many read groups, cycles, or qualities for a dense table.
+            switchToHash();
         }
-        else
+    }
+
+    for(int32_t cycle = 0; cycle < numCycles; cycle++)
+    {
+        uint8_t outcome = counted[cycle];
+        if(outcome == ReadCovariates::SKIP)
         {
-            ++(matchInfo.mm);
+            continue;
         }
+        SMatches& matchInfo = myUseHash ? mismatchTable[keys[cycle]] :
+            getDenseCell(getDenseIndex(keys[cycle]));
+        matchInfo.m += (outcome == ReadCovariates::MATCH);
+        matchInfo.mm += (outcome == ReadCovariates::MISMATCH);
         matchInfo.qempSimple = 255;
-        return;
     }
-    SMatches& matchInfo = mismatchTable[data.getKey()];
+}
 
-    if(BaseUtilities::areEqual(refBase, data.curBase))
+
+static bool lessKey(const std::pair<uint64_t, HashErrorModel::SMatches>& a,
+                    const std::pair<uint64_t, HashErrorModel::SMatches>& b)
+{
+    return(a.first < b.first);
+}
+
+
+void HashErrorModel::addCounts(const std::vector<HashErrorModel*>& tables)
+{
+    std::vector<std::pair<uint64_t, SMatches> > counts;
+    for(unsigned int i = 0; i < tables.size(); i++)
+    {
+        tables[i]->forEachCell([&counts](uint64_t key, SMatches& matchInfo)
+            {
+                counts.push_back(std::make_pair(key, matchInfo));
+            });
+    }
+    std::sort(counts.begin(), counts.end(), lessKey);
+
+    for(unsigned int i = 0; i < counts.size(); i++)
+    {
+        addCell(counts[i].first, counts[i].second.m, counts[i].second.mm);
+    }
+}
+
+
+void HashErrorModel::addCell(uint64_t key, 
+                             uint32_t matches, uint32_t mismatches)
+{
+    if(!myUseHash && !inDenseTable(key) && !growDenseTable(key))
+    {
+        // Too many read groups, cycles, or qualities for a dense table.
+        switchToHash();
+    }
+
+    SMatches* matchInfo;
+    if(myUseHash)
     {
-        ++(matchInfo.m);
+        matchInfo = &(mismatchTable[key]);
     }
     else
     {
-        ++(matchInfo.mm);
+        matchInfo = &(getDenseCell(getDenseIndex(key)));
     }
-    matchInfo.qempSimple = 255;
+    matchInfo->m += matches;
+    matchInfo->mm += mismatches;
+    matchInfo->qempSimple = 255;
 }
 
-uint8_t HashErrorModel::getQemp(BaseData& data)
+
+bool HashErrorModel::growDenseTable(uint64_t key)
 {
-    if(ourUseFast)
+    if((((key >> 36) & 0xF) >= DENSE_NUM_BASES) ||
+       (((key >> 32) & 0xF) >= DENSE_NUM_BASES))
     {
-        SMatchesFast& matchInfo = mismatchTableFast[data.getFastKey()];
+        return(false);
+    }
 
-        // If no matches or mismatches, return the original quality.
-        if((matchInfo.m == 0) && (matchInfo.mm == 0))
-        {
-            return(data.qual);
-        }
+    uint64_t numRG = std::max((uint64_t)myNumRG, (key & 0xFFFFFFFF) + 1);
+    uint64_t numCycles = myNumCycles;
+    uint64_t cycle = (key >> 40) & 0xFFFF;
+    if(cycle >= numCycles)
+    {
+        // Grow by at least half so a read longer than the previous ones
+        // does not relayout the table every few cycles.
+        numCycles = std::max(cycle + 1, numCycles + numCycles / 2);
+        numCycles = 
+            (numCycles + DENSE_CYCLE_INCR - 1) / DENSE_CYCLE_INCR * DENSE_CYCLE_INCR;
+    }
+    uint64_t numQuals = myNumQuals;
+    uint64_t qual = (key >> 56) & 0x7F;
+    if(qual >= numQuals)
+    {
+        numQuals = 
+            (qual + DENSE_QUAL_INCR) / DENSE_QUAL_INCR * DENSE_QUAL_INCR;
+    }
 
-        if(matchInfo.qempSimple == 255)
-        {
-            matchInfo.qempSimple = 
-                getQempSimple(matchInfo.m, matchInfo.mm);
-        }
-        return(matchInfo.qempSimple);
+    uint64_t numCells = numRG * numCycles * 2 * numQuals * 
+        DENSE_NUM_BASES * DENSE_NUM_BASES;
+    if(numCells > MAX_DENSE_CELLS)
+    {
+        return(false);
     }
-    
-    // If it is not in the table, return the original quality.
-    HashMatch::iterator iter = mismatchTable.find(data.getKey());
-    if(iter == mismatchTable.end())
+
+    if((numCycles == (uint64_t)myNumCycles) && 
+       (numQuals == (uint64_t)myNumQuals))
     {
-        // Not in the table, so just return the original quality.
-        return(data.qual);
+        // Only new read groups, which are added to the end.
+        myNumRG = numRG;
+        myNumDenseCells = numCells;
+        myDensePages.resize((numCells + DENSE_PAGE_SIZE - 1) >> DENSE_PAGE_BITS);
+        return(true);
     }
 
-    // in the table, so get the qemp
+    // The layout changes, so move the entries to their new positions.
+    std::vector<std::pair<uint64_t, SMatches> > counts;
+    forEachCell([&counts](uint64_t cellKey, SMatches& matchInfo)
+        {
+            counts.push_back(std::make_pair(cellKey, matchInfo));
+        });
+    myNumRG = numRG;
+    myNumCycles = numCycles;
+    myNumQuals = numQuals;
+    resetDenseTable(numCells);
+    for(unsigned int i = 0; i < counts.size(); i++)
+    {
+        getDenseCell(getDenseIndex(counts[i].first)) = counts[i].second;
+    }
+    return(true);
+}
+
+
+void HashErrorModel::resetDenseTable(uint64_t numCells)
+{
+    std::vector<std::vector<SMatches> >
+        ((numCells + DENSE_PAGE_SIZE - 1) >> DENSE_PAGE_BITS).swap(myDensePages);
+    myNumDenseCells = numCells;
+    MemoryBudget::add(MemoryBudget::RECAB_TABLES,
+                      -(int64_t)myNumDensePagesAllocated * DENSE_PAGE_BYTES);
+    myNumDensePagesAllocated = 0;
+}
+
+
+void HashErrorModel::switchToHash()
+{
+    HashMatch& table = mismatchTable;
+    forEachCell([&table](uint64_t key, SMatches& matchInfo)
+        {
+            table[key] = matchInfo;
+        });
+    resetDenseTable(0);
+    myNumRG = 0;
+    myNumCycles = 0;
+    myNumQuals = 0;
+    myUseHash = true;
+}
+
+
+uint8_t HashErrorModel::getQemp(BaseData& data)
+{
     if(ourUseLogReg)
     {
-        return(iter->second.qempLogReg);
+        return(getQemp<true>(data));
+    }
+    return(getQemp<false>(data));
+}
+
+
+template<bool USE_LOG_REG>
+uint8_t HashErrorModel::getQemp(BaseData& data)
+{
+    SMatches* matchInfo;
+    uint64_t key = data.getKey();
+    if(myUseHash)
+    {
+        HashMatch::iterator iter = mismatchTable.find(key);
+        if(iter == mismatchTable.end())
+        {
+            // Not in the table, so just return the original quality.
+            return(data.qual);
+        }
+        matchInfo = &(iter->second);
     }
-    if(iter->second.qempSimple == 255)
+    else
     {
-        iter->second.qempSimple = 
-            getQempSimple(iter->second.m, iter->second.mm);
+        if(!inDenseTable(key))
+        {
+            // Not in the table, so just return the original quality.
+            return(data.qual);
+        }
+        matchInfo = findDenseCell(getDenseIndex(key));
+        if((matchInfo == NULL) || 
+           ((matchInfo->m == 0) && (matchInfo->mm == 0)))
+        {
+            // No matches or mismatches, so return the original quality.
+            return(data.qual);
+        }
     }
-    return(iter->second.qempSimple);
+
+    // in the table, so get the qemp
+    return(getCellQemp<USE_LOG_REG>(*matchInfo));
 }
 
+template uint8_t HashErrorModel::getQemp<true>(BaseData& data);
+template uint8_t HashErrorModel::getQemp<false>(BaseData& data);
+
 
 uint8_t HashErrorModel::getQempSimple(uint32_t matches, uint32_t mismatches)
 {
@@ -139,49 +331,13 @@ int HashErrorModel::writeTableQemp(std::string& filename,
 
     BaseData data;
 
-    if(ourUseFast)
-    {
-        for(unsigned int i = 0; i < mismatchTableFast.size(); i++)
+    forEachCell([&](uint64_t key, SMatches& matchInfo)
         {
-            SMatchesFast& matchInfo = mismatchTableFast[i];
-            if((matchInfo.m == 0) && (matchInfo.mm == 0))
-            {
-                // No data, so continue to the next entry.
-                continue;
-            }
-            data.parseFastKey(i);
-            
-            if(data.rgid <= maxId)
+            data.parseKey(key);
+            if(data.rgid > maxId)
             {
-                int16_t cycle = data.cycle + 1;
-                if(data.read)
-                {
-                    // 2nd.
-                    cycle = -cycle;
-                }
-                
-                if(matchInfo.qempSimple == 255)
-                {
-                    matchInfo.qempSimple = 
-                        getQempSimple(matchInfo.m, matchInfo.mm);
-                }
-                fprintf(pFile,"%s,%d,%d,%c%c,%d,%d,%d\n",
-                        id2rg[data.rgid].c_str(), data.qual, cycle, 
-                        data.preBase, data.curBase,
-                        matchInfo.m + matchInfo.mm, matchInfo.mm, 
-                        matchInfo.qempSimple);
+                return;
             }
-        }
-        fclose(pFile);
-        return(1);
-    }
-    for(HashMatch::iterator it = mismatchTable.begin();
-        it != mismatchTable.end();
-        ++it)
-    {
-        data.parseKey(it->first);
-        if(data.rgid <= maxId)
-        {
             int16_t cycle = data.cycle + 1;
             if(data.read)
             {
@@ -189,113 +345,239 @@ int HashErrorModel::writeTableQemp(std::string& filename,
                 cycle = -cycle;
             }
 
-            if(it->second.qempSimple == 255)
+            if(matchInfo.qempSimple == 255)
             {
-                it->second.qempSimple = 
-                    getQempSimple(it->second.m, it->second.mm);
+                matchInfo.qempSimple = 
+                    getQempSimple(matchInfo.m, matchInfo.mm);
             }
-            uint8_t qemp = it->second.qempSimple;
+            uint8_t qemp = matchInfo.qempSimple;
             if(logReg)
             {
-                qemp = it->second.qempLogReg;
+                qemp = matchInfo.qempLogReg;
             }
             
             fprintf(pFile,"%s,%d,%d,%c%c,%d,%d,%d\n",
                     id2rg[data.rgid].c_str(), data.qual, cycle, 
                     data.preBase, data.curBase,
-                    it->second.m + it->second.mm, it->second.mm, qemp);
-        }
-    }
+                    matchInfo.m + matchInfo.mm, matchInfo.mm, qemp);
+        });
     fclose(pFile);
     return 1;
 }
 
 
-void HashErrorModel::addPrediction(Model model,int blendedWeight)
+int HashErrorModel::writeTable(const std::string& filename, 
+                               const std::vector<std::string>& id2rg)
 {
-    BaseData data;
-    if(ourUseFast)
+    // Format (native byte order):
+    //   TABLE_MAGIC
+    //   uint32_t number of read groups, then for each: 
+    //       uint32_t name length, name
+    //   uint64_t number of entries, then for each:
+    //       uint64_t BaseData key, uint32_t matches, uint32_t mismatches
+    FILE* pFile = fopen(filename.c_str(), "wb");
+    if(!pFile) return 0;
+
+    bool ok = (fwrite(TABLE_MAGIC, sizeof(TABLE_MAGIC), 1, pFile) == 1);
+    uint32_t numRG = id2rg.size();
+    ok &= (fwrite(&numRG, sizeof(numRG), 1, pFile) == 1);
+    for(uint32_t i = 0; i < numRG; i++)
     {
-        return;
+        uint32_t len = id2rg[i].length();
+        ok &= (fwrite(&len, sizeof(len), 1, pFile) == 1);
+        ok &= (fwrite(id2rg[i].c_str(), 1, len, pFile) == len);
     }
 
-    for(HashMatch::iterator it = mismatchTable.begin();
-        it != mismatchTable.end();
-        ++it)
+    uint64_t numEntries = 0;
+    forEachCell([&numEntries](uint64_t, SMatches&) { ++numEntries; });
+    ok &= (fwrite(&numEntries, sizeof(numEntries), 1, pFile) == 1);
+    forEachCell([&ok, pFile](uint64_t key, SMatches& matchInfo)
+        {
+            ok &= (fwrite(&key, sizeof(key), 1, pFile) == 1);
+            ok &= (fwrite(&matchInfo.m, sizeof(matchInfo.m), 1, pFile) == 1);
+            ok &= (fwrite(&matchInfo.mm, sizeof(matchInfo.mm), 1, pFile) == 1);
+        });
+    ok &= (fclose(pFile) == 0);
+    return(ok ? 1 : 0);
+}
+
+
+int HashErrorModel::readTable(const std::string& filename,
+                              std::map<std::string, uint16_t>& rg2id,
+                              std::vector<std::string>& id2rg)
+{
+    FILE* pFile = fopen(filename.c_str(), "rb");
+    if(!pFile) return 0;
+
+    char magic[sizeof(TABLE_MAGIC)];
+    uint32_t numRG = 0;
+    if((fread(magic, sizeof(magic), 1, pFile) != 1) ||
+       !std::equal(magic, magic + sizeof(magic), TABLE_MAGIC) ||
+       (fread(&numRG, sizeof(numRG), 1, pFile) != 1))
     {
-        Covariates cov;
-        data.parseKey(it->first);
-        cov.setCovariates(data);
-        int j = 1;
-        double qemp = model[0]; //slope
-        for(std::vector<uint16_t>::const_iterator itv = cov.covariates.begin();
-            itv != cov.covariates.end(); ++itv)
+        fclose(pFile);
+        return(0);
+    }
+
+    // Map the file's read group ids to the ids in rg2id.
+    std::vector<uint16_t> fileId2Id(numRG);
+    std::string readGroup;
+    for(uint32_t i = 0; i < numRG; i++)
+    {
+        uint32_t len = 0;
+        if(fread(&len, sizeof(len), 1, pFile) != 1)
         {
-            qemp += model[j]*(double)(*itv);
-            j++;
+            fclose(pFile);
+            return(0);
         }
-        //phred-score transformation
-        //conservative (otherwise +0.5)
-        //blended Model?
-        int phred = 0;
-        if(blendedWeight==9999)
+        readGroup.resize(len);
+        if((len != 0) && (fread(&(readGroup[0]), 1, len, pFile) != len))
         {
-            uint32_t m = it->second.m;
-            uint32_t mm = it->second.mm;
-            qemp = (mm-blendedWeight)/(m+mm-blendedWeight);
+            fclose(pFile);
+            return(0);
         }
-        else
+        std::pair<std::map<std::string, uint16_t>::iterator, bool> insertRet =
+            rg2id.insert(std::make_pair(readGroup, (uint16_t)id2rg.size()));
+        if(insertRet.second)
         {
-            if(blendedWeight>0)
-            {
-                uint32_t m = it->second.m;
-                uint32_t mm = it->second.mm;
-                //qemp = (mm+qemp*blendedWeight)/(m+mm+blendedWeight);
-                qemp = (mm+qemp*mm)/(2.0*(m+mm));
-            }
+            id2rg.push_back(readGroup);
         }
+        fileId2Id[i] = insertRet.first->second;
+    }
 
-        phred = trunc((-10.0*log10(1.0-(1.0/(1.0+exp(-qemp)))))+0.5);
-        it->second.qempLogReg = phred;
+    uint64_t numEntries = 0;
+    if(fread(&numEntries, sizeof(numEntries), 1, pFile) != 1)
+    {
+        fclose(pFile);
+        return(0);
     }
+    for(uint64_t i = 0; i < numEntries; i++)
+    {
+        uint64_t key;
+        uint32_t matches;
+        uint32_t mismatches;
+        if((fread(&key, sizeof(key), 1, pFile) != 1) ||
+           (fread(&matches, sizeof(matches), 1, pFile) != 1) ||
+           (fread(&mismatches, sizeof(mismatches), 1, pFile) != 1) ||
+           ((key & 0xFFFFFFFF) >= numRG))
+        {
+            fclose(pFile);
+            return(0);
+        }
+        key = (key & ~(uint64_t)0xFFFFFFFF) | fileId2Id[key & 0xFFFFFFFF];
+        addCell(key, matches, mismatches);
+    }
+    fclose(pFile);
+    return(1);
+}
+
+
+void HashErrorModel::addPrediction(Model globalModel,int blendedWeight,
+                                   const std::vector<Model>& rgModels)
+{
+    BaseData data;
+
+    forEachCell([&](uint64_t key, SMatches& matchInfo)
+        {
+            Covariates cov;
+            data.parseKey(key);
+            cov.setCovariates(data);
+            const Model& model = 
+                (((uint32_t)data.rgid < rgModels.size()) &&
+                 !rgModels[data.rgid].empty()) ? rgModels[data.rgid] : 
+                globalModel;
+            int j = 1;
+            double qemp = model[0]; //slope
+            for(std::vector<uint16_t>::const_iterator itv = cov.covariates.begin();
+                itv != cov.covariates.end(); ++itv)
+            {
+                qemp += model[j]*(double)(*itv);
+                j++;
+            }
+            //phred-score transformation
+            //conservative (otherwise +0.5)
+            //blended Model?
+            int phred = 0;
+            if(blendedWeight==9999)
+            {
+                uint32_t m = matchInfo.m;
+                uint32_t mm = matchInfo.mm;
+                qemp = (mm-blendedWeight)/(m+mm-blendedWeight);
+            }
+            else
+            {
+                if(blendedWeight>0)
+                {
+                    uint32_t m = matchInfo.m;
+                    uint32_t mm = matchInfo.mm;
+                    //qemp = (mm+qemp*blendedWeight)/(m+mm+blendedWeight);
+                    qemp = (mm+qemp*mm)/(2.0*(m+mm));
+                }
+            }
+
+            phred = trunc((-10.0*log10(1.0-(1.0/(1.0+exp(-qemp)))))+0.5);
+            matchInfo.qempLogReg = phred;
+        });
 };
 
 
-void HashErrorModel::setDataforPrediction(Matrix & X, Vector & succ, Vector & total,bool binarizeFlag)
+void HashErrorModel::setDataforPrediction(Matrix & X, Vector & succ, Vector & total,bool binarizeFlag,
+                                          int32_t rgid)
 {
-    int i = 0;
     BaseData data;
 
-    if(ourUseFast)
+    // The read group is not a co-variate, so cells that differ only by
+    // read group share a design matrix row.  Their counts are summed,
+    // which gives the same fit as one row per cell.
+    typedef std::map<std::vector<uint16_t>, uint32_t> RowMap;
+    RowMap rowIndex;
+    std::vector<const std::vector<uint16_t>*> rowCovariates;
+    std::vector<double> rowSucc;
+    std::vector<double> rowTotal;
+
+    forEachCell([&](uint64_t key, SMatches& matchInfo)
+        {
+            data.parseKey(key);
+            if((rgid >= 0) && (data.rgid != rgid))
+            {
+                return;
+            }
+            Covariates cov;
+            cov.setCovariates(data);
+            std::pair<RowMap::iterator, bool> inserted = 
+                rowIndex.insert(std::make_pair(cov.covariates, 
+                                               (uint32_t)rowSucc.size()));
+            uint32_t row = inserted.first->second;
+            if(inserted.second)
+            {
+                rowCovariates.push_back(&(inserted.first->first));
+                rowSucc.push_back(0);
+                rowTotal.push_back(0);
+            }
+            rowTotal[row] += matchInfo.mm + matchInfo.m;
+            rowSucc[row] += matchInfo.m;
+        });
+
+    uint32_t rows = rowSucc.size();
+    if(rows == 0)
     {
         return;
     }
+    succ.Dimension(rows);
+    total.Dimension(rows);
+    X.Dimension(rows, rowCovariates[0]->size() + 1);
+    X.Zero();
 
-    for(HashMatch::const_iterator it = mismatchTable.begin();
-        it != mismatchTable.end();
-        ++it)
+    for(uint32_t i = 0; i < rows; i++)
     {
-        data.parseKey(it->first);
-        Covariates cov;
-        cov.setCovariates(data);
-        if(i == 0)
-        {
-            uint32_t rows = mismatchTable.size();
-
-            succ.Dimension(rows);
-            total.Dimension(rows);
-            X.Dimension(rows, cov.covariates.size() + 1);
-            X.Zero();
-        }
-
         // The first column of the design matrix is constant one, for the slope
         X[i][0] = 1.0;
 
         int j = 0;
                 
         //binarize a couple of co-variates
-        for(std::vector<uint16_t>::const_iterator itv = cov.covariates.begin();
-            itv != cov.covariates.end();
+        for(std::vector<uint16_t>::const_iterator itv = rowCovariates[i]->begin();
+            itv != rowCovariates[i]->end();
             ++itv)
         {
             if(binarizeFlag)
@@ -322,9 +604,7 @@ void HashErrorModel::setDataforPrediction(Matrix & X, Vector & succ, Vector & to
                 j++;
             }
         }
-        total[i] = it->second.mm + it->second.m;
-        succ[i] = it->second.m;
-        i++;
+        total[i] = rowTotal[i];
+        succ[i] = rowSucc[i];
     }
 }
-
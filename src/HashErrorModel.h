@@ -21,6 +21,8 @@
 
 #include <stdint.h>
 #include <vector>
+#include <map>
+#include <string>
 
 #ifdef __GXX_EXPERIMENTAL_CXX0X__
 #include <unordered_map>
@@ -32,6 +34,7 @@
 #include "Covariates.h"
 #include "MathMatrix.h"
 #include "MathVector.h"
+#include "MemoryBudget.h"
 
 #define MINSIZE 1048576
 
@@ -41,7 +44,7 @@ class HashErrorModel {
 public:
 
     static void setUseLogReg(bool useLogReg) { ourUseLogReg = useLogReg; }
-    static void setUseFast(bool useFast) { ourUseFast = useFast; }
+    static bool getUseLogReg() { return(ourUseLogReg); }
     
     
     typedef std::vector<double> Model;
@@ -52,12 +55,6 @@ public:
         uint8_t qempSimple;
         uint8_t qempLogReg;
     };
-    struct SMatchesFast{
-        SMatchesFast() : m(0), mm(0), qempSimple(0) {}
-        uint32_t m;
-        uint32_t mm;
-        uint8_t qempSimple;
-    };
     
 
     #ifdef __GXX_EXPERIMENTAL_CXX0X__
@@ -66,26 +63,305 @@ public:
     typedef std::map<uint64_t, HashErrorModel::SMatches> HashMatch;
     #endif
 
+    // Only used once the dense table is abandoned, see useHash().
     HashMatch mismatchTable;
-    std::vector<SMatchesFast> mismatchTableFast;
     uint16_t lastElement;
     
     HashErrorModel();
     ~HashErrorModel();
     
     void setCell(const BaseData& data, char refBase);
+
+    /// Count the cycles of a read whose outcome was set to MATCH or
+    /// MISMATCH.  The table is checked against the read's largest counted
+    /// fields once, rather than for every base.
+    void addRead(const ReadCovariates& read);
+
+    /// Add the match/mismatch counts of the specified tables, built on
+    /// other threads, to this table.  Entries are added in key order so
+    /// the resulting table does not depend on which thread counted which
+    /// read.
+    void addCounts(const std::vector<HashErrorModel*>& tables);
+
+    uint8_t getQemp(BaseData& data);
+    /// getQemp for the specified setUseLogReg setting, so callers can
+    /// pick the version once rather than checking the setting every base.
+    template<bool USE_LOG_REG>
     uint8_t getQemp(BaseData& data);
     uint8_t getQempSimple(uint32_t matches, uint32_t mismatches);
     int writeTableQemp(std::string& filename, 
                        const std::vector<std::string>& id2rg,
                        bool logReg);
 
-    void setDataforPrediction(Matrix & X, Vector & succ, Vector& total,bool binarizeFlag);
-    void addPrediction(Model model, int blendedWeight);
+
+    /// Write the match/mismatch counts to a binary file for readTable.
+    /// Returns 1 on success, 0 on failure.
+    int writeTable(const std::string& filename, 
+                   const std::vector<std::string>& id2rg);
+
+    /// Add the counts from a writeTable file to this table, so tables
+    /// from several runs can be summed.  Read groups are matched by name,
+    /// new ones are added to rg2id/id2rg.
+    /// Returns 1 on success, 0 on failure.
+    int readTable(const std::string& filename,
+                  std::map<std::string, uint16_t>& rg2id,
+                  std::vector<std::string>& id2rg);
+
+    /// Only the cells of read group rgid are used, or all cells if rgid
+    /// is negative.
+    void setDataforPrediction(Matrix & X, Vector & succ, Vector& total,bool binarizeFlag,
+                              int32_t rgid = -1);
+    /// Cells use the model of their read group in rgModels if there is a
+    /// non-empty one, otherwise the global model.
+    void addPrediction(Model model, int blendedWeight,
+                       const std::vector<Model>& rgModels = std::vector<Model>());
+
+    /// True if the counts are kept in the hashed mismatchTable because
+    /// the dense table would have been too large.
+    bool useHash() const { return(myUseHash); }
+
+    /// Byte per entry of the dense table, used to look up new qualities
+    /// without computing keys.  The entry for cycle c, quality q,
+    /// and previous/current base codes p/b of a read group & read is at
+    /// getOffset(rgid, read) + c * cycleStep + q * qualStep + p * baseStep + b.
+    struct QualLookup
+    {
+        QualLookup() : numRG(0), numCycles(0), numQuals(0),
+                       cycleStep(0), qualStep(0), baseStep(0) {}
+
+        inline uint64_t getOffset(int32_t rgid, bool read) const
+        {
+            return(((uint64_t)rgid * numCycles * 2 + (read & 0x1)) * 
+                   numQuals * qualStep);
+        }
+
+        std::vector<uint8_t> table;
+        int32_t numRG;
+        int32_t numCycles;
+        int32_t numQuals;
+        uint32_t cycleStep;
+        uint32_t qualStep;
+        uint32_t baseStep;
+    };
+
+    /// Fill lookup with qualFunc(qual, qemp) for every entry of the
+    /// dense table, where qemp is what getQemp returns for that entry.
+    /// Returns false, leaving lookup empty, if the table is hashed.
+    template<class FUNC>
+    bool buildQualLookup(QualLookup& lookup, FUNC qualFunc);
     
 private:
+    // The dense table holds the same entries as mismatchTable, indexed by
+    // the fields of the BaseData key: read group, cycle, read, quality,
+    // previous base and current base.  Read groups, cycles & qualities
+    // are sized by the largest values seen so far.
+    // It is split into pages that are only allocated when a cell in them
+    // is first counted, so the memory used and the cells visited follow
+    // the covariates actually seen rather than the table size.  The
+    // allocated pages are added to the MemoryBudget.
+    static const uint64_t DENSE_NUM_BASES = 6;
+    static const uint64_t DENSE_PAGE_BITS = 12;
+    static const uint64_t DENSE_PAGE_SIZE = 1 << DENSE_PAGE_BITS;
+    static const int64_t DENSE_PAGE_BYTES = DENSE_PAGE_SIZE * sizeof(SMatches);
+    static const int32_t DENSE_CYCLE_INCR = 64;
+    static const int32_t DENSE_QUAL_INCR = 64;
+    static const uint64_t MAX_DENSE_CELLS = 1 << 26;
+
+    // Fields of a BaseData key that vary within a read.
+    static const uint64_t KEY_QUAL_MASK = 0x7FULL << 56;
+    static const uint64_t KEY_PRE_BASE_MASK = 0xFULL << 36;
+    static const uint64_t KEY_CUR_BASE_MASK = 0xFULL << 32;
+
+    // Start of a writeTable file.
+    static const char TABLE_MAGIC[8];
+
+    inline bool inDenseTable(uint64_t key) const
+    {
+        return(((key & 0xFFFFFFFF) < (uint64_t)myNumRG) &&
+               (((key >> 40) & 0xFFFF) < (uint64_t)myNumCycles) &&
+               (((key >> 56) & 0x7F) < (uint64_t)myNumQuals) &&
+               (((key >> 36) & 0xF) < DENSE_NUM_BASES) &&
+               (((key >> 32) & 0xF) < DENSE_NUM_BASES));
+    }
+
+    inline uint64_t getDenseIndex(uint64_t key) const
+    {
+        return(((((((key & 0xFFFFFFFF) * myNumCycles + ((key >> 40) & 0xFFFF)) 
+                   * 2 + (key >> 63)) * myNumQuals + ((key >> 56) & 0x7F))
+                 * DENSE_NUM_BASES + ((key >> 36) & 0xF))
+                * DENSE_NUM_BASES) + ((key >> 32) & 0xF));
+    }
+
+    // Get the cell at the specified dense index, NULL if its page has
+    // not been allocated.
+    inline SMatches* findDenseCell(uint64_t index)
+    {
+        std::vector<SMatches>& page = myDensePages[index >> DENSE_PAGE_BITS];
+        if(page.empty())
+        {
+            return(NULL);
+        }
+        return(&(page[index & (DENSE_PAGE_SIZE - 1)]));
+    }
+
+    // Get the cell at the specified dense index, allocating its page.
+    inline SMatches& getDenseCell(uint64_t index)
+    {
+        std::vector<SMatches>& page = myDensePages[index >> DENSE_PAGE_BITS];
+        if(page.empty())
+        {
+            page.resize(DENSE_PAGE_SIZE);
+            ++myNumDensePagesAllocated;
+            MemoryBudget::add(MemoryBudget::RECAB_TABLES, DENSE_PAGE_BYTES);
+        }
+        return(page[index & (DENSE_PAGE_SIZE - 1)]);
+    }
+
+    // The empirical quality of a cell with counts.
+    template<bool USE_LOG_REG>
+    inline uint8_t getCellQemp(SMatches& matchInfo)
+    {
+        if(USE_LOG_REG)
+        {
+            return(matchInfo.qempLogReg);
+        }
+        if(matchInfo.qempSimple == 255)
+        {
+            matchInfo.qempSimple = 
+                getQempSimple(matchInfo.m, matchInfo.mm);
+        }
+        return(matchInfo.qempSimple);
+    }
+
+    // Fill the lookup table set up by buildQualLookup.
+    template<bool USE_LOG_REG, class FUNC>
+    void fillQualLookup(QualLookup& lookup, FUNC& qualFunc);
+
+    // Set the dense table to numCells cells with no pages allocated.
+    void resetDenseTable(uint64_t numCells);
+
+    // Get the key of the cell at the specified dense index.
+    inline uint64_t getDenseKey(uint64_t index) const
+    {
+        uint64_t cur = index % DENSE_NUM_BASES;
+        index /= DENSE_NUM_BASES;
+        uint64_t pre = index % DENSE_NUM_BASES;
+        index /= DENSE_NUM_BASES;
+        uint64_t qual = index % myNumQuals;
+        index /= myNumQuals;
+        uint64_t read = index & 0x1;
+        index >>= 1;
+        uint64_t cycle = index % myNumCycles;
+        uint64_t rgid = index / myNumCycles;
+        return((read << 63) | (qual << 56) | (cycle << 40) |
+               (pre << 36) | (cur << 32) | rgid);
+    }
+
+    // Add counts for the specified key, growing the dense table or
+    // switching to hashing if it does not fit.
+    void addCell(uint64_t key, uint32_t matches, uint32_t mismatches);
+
+    // Resize the dense table to fit key, returns false if it would have
+    // more than MAX_DENSE_CELLS entries.
+    bool growDenseTable(uint64_t key);
+
+    // Move the dense table's counts into mismatchTable.
+    void switchToHash();
+
+    // Call func(uint64_t key, SMatches&) for each entry with counts,
+    // in key field order for the dense table.
+    template<class FUNC>
+    void forEachCell(FUNC func);
+
+    std::vector<std::vector<SMatches> > myDensePages;
+    uint64_t myNumDensePagesAllocated;
+    int32_t myNumRG;
+    int32_t myNumCycles;
+    int32_t myNumQuals;
+    uint64_t myNumDenseCells;
+    bool myUseHash;
+
     static bool ourUseLogReg;
-    static bool ourUseFast;
 };
 
+
+template<class FUNC>
+void HashErrorModel::forEachCell(FUNC func)
+{
+    if(myUseHash)
+    {
+        for(HashMatch::iterator it = mismatchTable.begin();
+            it != mismatchTable.end();
+            ++it)
+        {
+            func(it->first, it->second);
+        }
+        return;
+    }
+    // Visit the allocated pages in index order, which is key field order.
+    for(uint64_t pageNum = 0; pageNum < myDensePages.size(); pageNum++)
+    {
+        std::vector<SMatches>& page = myDensePages[pageNum];
+        uint64_t index = pageNum << DENSE_PAGE_BITS;
+        for(uint64_t i = 0; i < page.size(); i++)
+        {
+            SMatches& matchInfo = page[i];
+            if(((matchInfo.m == 0) && (matchInfo.mm == 0)) ||
+               (index + i >= myNumDenseCells))
+            {
+                continue;
+            }
+            func(getDenseKey(index + i), matchInfo);
+        }
+    }
+}
+
+
+template<class FUNC>
+bool HashErrorModel::buildQualLookup(QualLookup& lookup, FUNC qualFunc)
+{
+    lookup = QualLookup();
+    if(myUseHash)
+    {
+        return(false);
+    }
+    lookup.numRG = myNumRG;
+    lookup.numCycles = myNumCycles;
+    lookup.numQuals = myNumQuals;
+    lookup.baseStep = DENSE_NUM_BASES;
+    lookup.qualStep = DENSE_NUM_BASES * DENSE_NUM_BASES;
+    lookup.cycleStep = 2 * myNumQuals * lookup.qualStep;
+    lookup.table.resize(myNumDenseCells);
+
+    if(ourUseLogReg)
+    {
+        fillQualLookup<true>(lookup, qualFunc);
+    }
+    else
+    {
+        fillQualLookup<false>(lookup, qualFunc);
+    }
+    return(true);
+}
+
+
+template<bool USE_LOG_REG, class FUNC>
+void HashErrorModel::fillQualLookup(QualLookup& lookup, FUNC& qualFunc)
+{
+    // Same order as the dense table, so the quality is the only field
+    // needed from the index.
+    for(uint64_t i = 0; i < myNumDenseCells; i++)
+    {
+        uint8_t qual = (i / lookup.qualStep) % myNumQuals;
+        SMatches* matchInfoPtr = findDenseCell(i);
+        uint8_t qemp = qual;
+        if((matchInfoPtr != NULL) && 
+           ((matchInfoPtr->m != 0) || (matchInfoPtr->mm != 0)))
+        {
+            qemp = getCellQemp<USE_LOG_REG>(*matchInfoPtr);
+        }
+        lookup.table[i] = qualFunc(qual, qemp);
+    }
+}
+
 #endif
@@ -0,0 +1,126 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//////////////////////////////////////////////////////////////////////////
+// This file contains the processing for the executable option "index"
+// which builds a BAI or CSI index of a coordinate sorted BAM file.
+
+#include "IndexBam.h"
+#include "BamIndexBuilder.h"
+#include "Parameters.h"
+#include "SamStatus.h"
+
+void IndexBam::printIndexBamDescription(std::ostream& os)
+{
+    os << " index - Build a BAI (or CSI) index of a coordinate sorted BAM file" << std::endl;
+}
+
+
+void IndexBam::printDescription(std::ostream& os)
+{
+    printIndexBamDescription(os);
+}
+
+
+void IndexBam::printUsage(std::ostream& os)
+{
+    BamExecutable::printUsage(os);
+    os << "\t./bam index --in <inputFile> [--out <indexFile>] [--csi] [--minShift <shift>] [--params]" << std::endl;
+    os << "\tRequired Parameters:" << std::endl;
+    os << "\t\t--in       : the coordinate sorted BAM file to index" << std::endl;
+    os << "\tOptional Parameters:" << std::endl;
+    os << "\t\t--out      : the index to write" << std::endl;
+    os << "\t\t             (if not specified, uses the --in value + \".bai\" or \".csi\")" << std::endl;
+    os << "\t\t--csi      : write a CSI index, needed for references longer than 512Mb" << std::endl;
+    os << "\t\t--minShift : size of the smallest CSI bins as a power of 2, default "
+       << BamIndexBuilder::BAI_MIN_SHIFT << std::endl;
+    os << "\t\t--params   : print the parameter settings" << std::endl;
+    os << std::endl;
+}
+
+
+int IndexBam::execute(int argc, char **argv)
+{
+    // Extract command line arguments.
+    String inFile = "";
+    String outFile = "";
+    bool csi = false;
+    int minShift = BamIndexBuilder::BAI_MIN_SHIFT;
+    bool params = false;
+
+    ParameterList inputParameters;
+    BEGIN_LONG_PARAMETERS(longParameterList)
+        LONG_STRINGPARAMETER("in", &inFile)
+        LONG_STRINGPARAMETER("out", &outFile)
+        LONG_PARAMETER("csi", &csi)
+        LONG_INTPARAMETER("minShift", &minShift)
+        LONG_PARAMETER("params", &params)
+        LONG_PHONEHOME(VERSION)
+        END_LONG_PARAMETERS();
+   
+    inputParameters.Add(new LongParameters ("Input Parameters", 
+                                            longParameterList));
+
+    // parameters start at index 2 rather than 1.
+    inputParameters.Read(argc, argv, 2);
+
+    // Check to see if the in file was specified, if not, report an error.
+    if(inFile == "")
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        // mandatory argument was not specified.
+        std::cerr << "Missing mandatory argument: --in" << std::endl;
+        return(-1);
+    }
+
+    if((minShift < 1) || (minShift > 30))
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        std::cerr << "--minShift must be between 1 and 30." << std::endl;
+        return(-1);
+    }
+    if(!csi && (minShift != BamIndexBuilder::BAI_MIN_SHIFT))
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        std::cerr << "--minShift requires --csi, BAI indexes always use "
+                  << BamIndexBuilder::BAI_MIN_SHIFT << "." << std::endl;
+        return(-1);
+    }
+
+    if(outFile == "")
+    {
+        outFile = BamIndexBuilder::getDefaultName(inFile.c_str(), csi).c_str();
+    }
+
+    if(params)
+    {
+        inputParameters.Status();
+    }
+
+    BamIndexBuilder builder;
+    if(!builder.build(inFile.c_str(), outFile.c_str(), csi, minShift))
+    {
+        return(SamStatus::FAIL_IO);
+    }
+
+    std::cerr << "Wrote " << outFile << " indexing " 
+              << builder.getNumRecords() << " records.\n";
+    return(SamStatus::SUCCESS);
+}
@@ -0,0 +1,285 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include "IndexedSectionReader.h"
+
+IndexedSectionReader::IndexedSectionReader()
+    : myBamFile(),
+      myIndexFile(),
+      mySections(),
+      myRequiredFlags(0),
+      myExcludedFlags(0),
+      myThreads(),
+      myMutex(),
+      myCondition(),
+      myStates(),
+      myNextSection(0),
+      myCurrentSection(0),
+      myBufferedBytes(0),
+      myStopping(false),
+      myException(),
+      myCurrent(),
+      myCurrentIndex(0)
+{
+}
+
+
+IndexedSectionReader::~IndexedSectionReader()
+{
+    stop();
+}
+
+
+void IndexedSectionReader::start(const std::string& bamFile,
+                                 const std::string& indexFile,
+                                 const std::vector<Section>& sections,
+                                 int numThreads, uint16_t requiredFlags,
+                                 uint16_t excludedFlags)
+{
+    stop();
+
+    myBamFile = bamFile;
+    myIndexFile = indexFile;
+    mySections = sections;
+    myRequiredFlags = requiredFlags;
+    myExcludedFlags = excludedFlags;
+    myStates.clear();
+    myStates.resize(sections.size());
+    myNextSection = 0;
+    myCurrentSection = 0;
+    myBufferedBytes = 0;
+    myStopping = false;
+    myException = nullptr;
+    myCurrent.reset();
+    myCurrentIndex = 0;
+
+    int maxThreads = std::max(numThreads, 1);
+    for(int i = 0; (i < maxThreads) && (i < (int)sections.size()); i++)
+    {
+        myThreads.push_back(std::thread(&IndexedSectionReader::readSections,
+                                        this));
+    }
+}
+
+
+bool IndexedSectionReader::ReadRecord(SamFileHeader& header,
+                                      SamRecord& record)
+{
+    while(!myCurrent || (myCurrentIndex == myCurrent->offsets.size()))
+    {
+        std::unique_lock<std::mutex> lock(myMutex);
+        if(myCurrent)
+        {
+            myBufferedBytes -= myCurrent->data.size();
+            myCurrent.reset();
+            myCondition.notify_all();
+        }
+        if(myCurrentSection >= myStates.size())
+        {
+            return(false);
+        }
+        SectionState& state = myStates[myCurrentSection];
+        myCondition.wait(lock, [this, &state]()
+                         { return(myException || !state.batches.empty() ||
+                                  state.done); });
+        if(myException)
+        {
+            std::exception_ptr exception = myException;
+            myException = nullptr;
+            myStopping = true;
+            myCurrentSection = myStates.size();
+            myCondition.notify_all();
+            std::rethrow_exception(exception);
+        }
+        if(!state.batches.empty())
+        {
+            myCurrent = std::move(state.batches.front());
+            state.batches.pop_front();
+            myCurrentIndex = 0;
+        }
+        else
+        {
+            // Let the thread waiting to add the next section's records in.
+            ++myCurrentSection;
+            myCondition.notify_all();
+        }
+    }
+
+    uint32_t offset = myCurrent->offsets[myCurrentIndex];
+    ++myCurrentIndex;
+    uint32_t end = myCurrent->data.size();
+    if(myCurrentIndex < myCurrent->offsets.size())
+    {
+        end = myCurrent->offsets[myCurrentIndex];
+    }
+    if(record.setBuffer(&(myCurrent->data[offset]), end - offset, header) !=
+       SamStatus::SUCCESS)
+    {
+        throw std::runtime_error("Failed to read an indexed record from " +
+                                 myBamFile);
+    }
+    return(true);
+}
+
+
+void IndexedSectionReader::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(myMutex);
+        myStopping = true;
+    }
+    myCondition.notify_all();
+    for(unsigned int i = 0; i < myThreads.size(); i++)
+    {
+        myThreads[i].join();
+    }
+    myThreads.clear();
+    myStates.clear();
+    myCurrent.reset();
+    myCurrentSection = 0;
+}
+
+
+void IndexedSectionReader::readSections()
+{
+    try
+    {
+        SamFile samIn;
+        SamFileHeader header;
+        bool opened = samIn.OpenForRead(myBamFile.c_str(), &header);
+        if(opened)
+        {
+            opened = myIndexFile.empty() ? samIn.ReadBamIndex() :
+                samIn.ReadBamIndex(myIndexFile.c_str());
+        }
+        if(!opened)
+        {
+            throw std::runtime_error("Failed to open " + myBamFile +
+                                     " and its index");
+        }
+        samIn.SetReadFlags(myRequiredFlags, myExcludedFlags);
+
+        SamRecord record;
+        while(true)
+        {
+            unsigned int section = 0;
+            {
+                std::lock_guard<std::mutex> lock(myMutex);
+                if(myStopping || (myNextSection >= mySections.size()))
+                {
+                    return;
+                }
+                section = myNextSection++;
+            }
+
+            const Section& current = mySections[section];
+            // Records overlapping the previous section were returned for it.
+            int32_t skipBefore = -1;
+            if((section > 0) && (current.refID >= 0) &&
+               (mySections[section - 1].refID == current.refID))
+            {
+                skipBefore = mySections[section - 1].end;
+            }
+            bool sectionSet = ((current.start <= 0) && (current.end < 0)) ?
+                samIn.SetReadSection(current.refID) :
+                samIn.SetReadSection(current.refID, current.start,
+                                     current.end);
+            if(!sectionSet)
+            {
+                throw std::runtime_error("Failed to read a section of " +
+                                         myBamFile);
+            }
+
+            BatchPtr batch(new RecordBatch());
+            while(samIn.ReadRecord(header, record))
+            {
+                if(record.get0BasedPosition() < skipBefore)
+                {
+                    continue;
+                }
+                // The record buffer starts with the block size.
+                const char* buffer =
+                    (const char*)record.getRecordBuffer(SamRecord::NONE);
+                int32_t blockSize = 0;
+                memcpy(&blockSize, buffer, sizeof(blockSize));
+                batch->offsets.push_back(batch->data.size());
+                batch->data.insert(batch->data.end(), buffer,
+                                   buffer + sizeof(blockSize) + blockSize);
+                if(batch->data.size() >= BATCH_SIZE)
+                {
+                    if(!addBatch(section, batch))
+                    {
+                        return;
+                    }
+                    batch.reset(new RecordBatch());
+                }
+            }
+            if(samIn.GetStatus() != SamStatus::NO_MORE_RECS)
+            {
+                throw std::runtime_error("Failed to read a section of " +
+                                         myBamFile + ": " +
+                                         samIn.GetStatusMessage());
+            }
+            if(!batch->offsets.empty() && !addBatch(section, batch))
+            {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(myMutex);
+                myStates[section].done = true;
+            }
+            myCondition.notify_all();
+        }
+    }
+    catch(...)
+    {
+        {
+            std::lock_guard<std::mutex> lock(myMutex);
+            if(!myException)
+            {
+                myException = std::current_exception();
+            }
+        }
+        myCondition.notify_all();
+    }
+}
+
+
+bool IndexedSectionReader::addBatch(unsigned int section, BatchPtr& batch)
+{
+    uint64_t bytes = batch->data.size();
+    std::unique_lock<std::mutex> lock(myMutex);
+    // The section being returned is never held back, so the caller
+    // always frees room for the others.
+    myCondition.wait(lock, [this, section, bytes]()
+                     { return(myStopping || (section <= myCurrentSection) ||
+                              (myBufferedBytes == 0) ||
+                              (myBufferedBytes + bytes <= MAX_BUFFERED_BYTES)); });
+    if(myStopping)
+    {
+        return(false);
+    }
+    myBufferedBytes += bytes;
+    myStates[section].batches.push_back(std::move(batch));
+    lock.unlock();
+    myCondition.notify_all();
+    return(true);
+}
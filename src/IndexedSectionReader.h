@@ -0,0 +1,130 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __INDEXED_SECTION_READER_H__
+#define __INDEXED_SECTION_READER_H__
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SamFile.h"
+
+/// Reads sections of an indexed BAM file (references or regions of them,
+/// and the unmapped reads at the end) on background threads, each with
+/// its own SamFile, returning the records in section order exactly as if
+/// the sections were read one after another with SetReadSection.  The
+/// records of upcoming sections are read ahead, up to MAX_BUFFERED_BYTES,
+/// but the section being returned is never held back, so the caller
+/// always makes progress.  Dedicated threads are used rather than the
+/// thread pool, since they wait on the caller, which may be waiting on
+/// tasks on the pool.
+class IndexedSectionReader
+{
+public:
+    /// 0-based start and exclusive end, -1 for the end of the reference.
+    /// refID -1 is the unmapped reads at the end of the file.
+    struct Section
+    {
+        int32_t refID;
+        int32_t start;
+        int32_t end;
+        Section(int32_t id, int32_t sectionStart = 0, int32_t sectionEnd = -1)
+            : refID(id), start(sectionStart), end(sectionEnd) {}
+    };
+
+    /// Records are passed to the caller in batches of about this many bytes.
+    static const uint32_t BATCH_SIZE = 1024 * 1024;
+    /// Most bytes of records read ahead for the upcoming sections.
+    static const uint64_t MAX_BUFFERED_BYTES = 64 * 1024 * 1024;
+
+    IndexedSectionReader();
+    ~IndexedSectionReader();
+
+    /// Start reading the sections of bamFile using indexFile (empty for
+    /// the default) on up to numThreads threads.  The sections must be in
+    /// file order; records that start before the end of the previous
+    /// section on the same reference were already returned for it and are
+    /// skipped.  Records without all of the required flags or with any of
+    /// the excluded flags are skipped.
+    void start(const std::string& bamFile, const std::string& indexFile,
+               const std::vector<Section>& sections, int numThreads,
+               uint16_t requiredFlags, uint16_t excludedFlags);
+
+    /// Read the next record, returning false when there are no more.
+    /// Throws std::runtime_error (or rethrows the exception of a reading
+    /// thread) if a section cannot be read.
+    bool ReadRecord(SamFileHeader& header, SamRecord& record);
+
+    /// Stop reading and wait for the threads to exit.
+    void stop();
+
+private:
+    IndexedSectionReader(const IndexedSectionReader&);
+    IndexedSectionReader& operator=(const IndexedSectionReader&);
+
+    struct RecordBatch
+    {
+        std::vector<char> data;
+        // Offset of each record in data.
+        std::vector<uint32_t> offsets;
+    };
+    typedef std::unique_ptr<RecordBatch> BatchPtr;
+
+    struct SectionState
+    {
+        std::deque<BatchPtr> batches;
+        bool done;
+        SectionState() : batches(), done(false) {}
+    };
+
+    // Thread loop, reading the next section that has not been started.
+    void readSections();
+    // Add the batch to the section once it is the current section or
+    // there is room, returning false if stopping.
+    bool addBatch(unsigned int section, BatchPtr& batch);
+
+    std::string myBamFile;
+    std::string myIndexFile;
+    std::vector<Section> mySections;
+    uint16_t myRequiredFlags;
+    uint16_t myExcludedFlags;
+
+    std::vector<std::thread> myThreads;
+    std::mutex myMutex;
+    std::condition_variable myCondition;
+    // A deque, since the batches of a section cannot be copied.
+    std::deque<SectionState> myStates;
+    unsigned int myNextSection;
+    // Section whose records are being returned.
+    unsigned int myCurrentSection;
+    uint64_t myBufferedBytes;
+    bool myStopping;
+    std::exception_ptr myException;
+
+    // Batch being returned to the caller, NULL if none.
+    BatchPtr myCurrent;
+    uint32_t myCurrentIndex;
+};
+
+#endif
@@ -0,0 +1,388 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "KnownSites.h"
+#include "InputFile.h"
+#include "StringArray.h"
+
+const char KnownSites::MAGIC[8] = {'K', 'S', 'I', 'T', 'E', 'S', 0, 1};
+
+KnownSites::KnownSites()
+    : myMap(NULL),
+      myMapLen(0),
+      myImage(),
+      myData(NULL),
+      myNumWords(0),
+      myChroms(),
+      myNames(),
+      myRefChroms()
+{
+}
+
+
+KnownSites::~KnownSites()
+{
+    close();
+}
+
+
+bool KnownSites::isKnownSitesFile(const char* fileName)
+{
+    char magic[sizeof(MAGIC)];
+    FILE* file = fopen(fileName, "rb");
+    if(file == NULL)
+    {
+        return(false);
+    }
+    bool isBitmap = (fread(magic, sizeof(magic), 1, file) == 1) &&
+        (memcmp(magic, MAGIC, sizeof(MAGIC)) == 0);
+    fclose(file);
+    return(isBitmap);
+}
+
+
+bool KnownSites::load(const char* fileName)
+{
+    if(isKnownSitesFile(fileName))
+    {
+        return(open(fileName));
+    }
+    return(loadText(fileName));
+}
+
+
+bool KnownSites::loadText(const char* fileName)
+{
+    close();
+    IFILE in = ifopen(fileName, "r");
+    if(in == NULL)
+    {
+        std::cerr << "ERROR: Failed to open the known sites file "
+                  << fileName << ".\n";
+        return(false);
+    }
+
+    // The words of each block with a site, per chromosome.
+    typedef std::vector<std::vector<uint64_t> > Blocks;
+    std::vector<Blocks> chroms;
+    std::vector<std::string> names;
+    StringArray tokens;
+    String buffer;
+    int position = 0;
+    while(!ifeof(in))
+    {
+        buffer.ReadLine(in);
+        if(buffer.IsEmpty() || (buffer[0] == '#'))
+        {
+            continue;
+        }
+        tokens.Clear();
+        tokens.AddTokens(buffer);
+        if(tokens.Length() < 2)
+        {
+            continue;
+        }
+        if(!tokens[1].AsInteger(position))
+        {
+            std::cerr << "Improperly formatted known sites line, position "
+                      << "(2nd column) is not an integer: " << tokens[1]
+                      << "; Skipping to the next line.\n";
+            continue;
+        }
+        if(position < 0)
+        {
+            continue;
+        }
+
+        std::string name = tokens[0].c_str();
+        std::map<std::string, int32_t>::iterator iter = myNames.find(name);
+        if(iter == myNames.end())
+        {
+            iter = myNames.insert(std::make_pair(name,
+                                                 (int32_t)names.size())).first;
+            names.push_back(name);
+            chroms.push_back(Blocks());
+        }
+        Blocks& blocks = chroms[iter->second];
+        uint32_t block = (uint32_t)position >> BLOCK_SHIFT;
+        if(block >= blocks.size())
+        {
+            blocks.resize(block + 1);
+        }
+        if(blocks[block].empty())
+        {
+            blocks[block].assign(BLOCK_WORDS, 0);
+        }
+        blocks[block][(position >> 6) & (BLOCK_WORDS - 1)] |=
+            (uint64_t)1 << (position & 63);
+    }
+    ifclose(in);
+
+    // Lay the sites out as they are written to a file.
+    uint64_t nameWords = 0;
+    uint64_t tableWords = 0;
+    for(size_t i = 0; i < chroms.size(); i++)
+    {
+        nameWords += (names[i].size() + 7) / 8;
+        tableWords += chroms[i].size();
+    }
+    uint64_t nameStart = HEADER_WORDS + chroms.size() * ENTRY_WORDS;
+    uint64_t tableStart = nameStart + nameWords;
+    uint64_t blockStart = tableStart + tableWords;
+    myImage.assign(blockStart, 0);
+    memcpy(&(myImage[0]), MAGIC, sizeof(MAGIC));
+    myImage[1] = chroms.size();
+    for(size_t i = 0; i < chroms.size(); i++)
+    {
+        uint64_t* entry = &(myImage[HEADER_WORDS + i * ENTRY_WORDS]);
+        entry[0] = nameStart;
+        entry[1] = names[i].size();
+        entry[2] = tableStart;
+        entry[3] = chroms[i].size();
+        memcpy(&(myImage[nameStart]), names[i].data(), names[i].size());
+        nameStart += (names[i].size() + 7) / 8;
+        for(size_t block = 0; block < chroms[i].size(); block++)
+        {
+            if(chroms[i][block].empty())
+            {
+                continue;
+            }
+            myImage[tableStart + block] = myImage.size();
+            myImage.insert(myImage.end(), chroms[i][block].begin(),
+                           chroms[i][block].end());
+            // Free the block as it is copied.
+            std::vector<uint64_t>().swap(chroms[i][block]);
+        }
+        tableStart += chroms[i].size();
+    }
+    myImage[2] = myImage.size();
+    myData = &(myImage[0]);
+    myNumWords = myImage.size();
+    if(!index())
+    {
+        std::cerr << "ERROR: Failed to index the known sites in "
+                  << fileName << ".\n";
+        close();
+        return(false);
+    }
+    return(true);
+}
+
+
+bool KnownSites::open(const char* fileName)
+{
+    close();
+    int fd = ::open(fileName, O_RDONLY);
+    if(fd < 0)
+    {
+        std::cerr << "ERROR: Failed to open the known sites file "
+                  << fileName << ".\n";
+        return(false);
+    }
+    struct stat fileStat;
+    if((fstat(fd, &fileStat) == 0) &&
+       (fileStat.st_size >= (off_t)(HEADER_WORDS * sizeof(uint64_t))))
+    {
+        myMapLen = fileStat.st_size;
+        myMap = mmap(NULL, myMapLen, PROT_READ, MAP_SHARED, fd, 0);
+        if(myMap == MAP_FAILED)
+        {
+            myMap = NULL;
+        }
+    }
+    // The mapping keeps the file open.
+    ::close(fd);
+
+    myData = (const uint64_t*)myMap;
+    myNumWords = myMapLen / sizeof(uint64_t);
+    if((myData == NULL) || (myMapLen % sizeof(uint64_t) != 0) ||
+       (myData[2] != myNumWords) || !index())
+    {
+        std::cerr << "ERROR: " << fileName
+                  << " is not a valid known sites file.\n";
+        close();
+        return(false);
+    }
+    return(true);
+}
+
+
+bool KnownSites::write(const char* fileName) const
+{
+    FILE* out = fopen(fileName, "wb");
+    if(out == NULL)
+    {
+        std::cerr << "ERROR: Failed to open " << fileName
+                  << " for writing.\n";
+        return(false);
+    }
+    bool success = (myData != NULL) &&
+        (fwrite(myData, sizeof(uint64_t), myNumWords, out) == myNumWords);
+    success &= (fclose(out) == 0);
+    if(!success)
+    {
+        std::cerr << "ERROR: Failed to write " << fileName << ".\n";
+        unlink(fileName);
+        return(false);
+    }
+    return(true);
+}
+
+
+void KnownSites::close()
+{
+    if(myMap != NULL)
+    {
+        munmap(myMap, myMapLen);
+    }
+    myMap = NULL;
+    myMapLen = 0;
+    std::vector<uint64_t>().swap(myImage);
+    myData = NULL;
+    myNumWords = 0;
+    myChroms.clear();
+    myNames.clear();
+    myRefChroms.clear();
+}
+
+
+void KnownSites::setReference(SamFileHeader& header)
+{
+    const SamReferenceInfo& refInfo = header.getReferenceInfo();
+    myRefChroms.resize(refInfo.getNumEntries());
+    for(int i = 0; i < refInfo.getNumEntries(); i++)
+    {
+        myRefChroms[i] = getChromosome(refInfo.getReferenceName(i));
+    }
+}
+
+
+void KnownSites::setReference(const GenomeSequence& reference)
+{
+    myRefChroms.resize(reference.getChromosomeCount());
+    for(int i = 0; i < reference.getChromosomeCount(); i++)
+    {
+        myRefChroms[i] = getChromosome(reference.getChromosomeName(i));
+    }
+}
+
+
+bool KnownSites::hasGenomePosition(const GenomeSequence& reference,
+                                   genomeIndex_t pos) const
+{
+    int chromIndex = reference.getChromosome(pos);
+    if(chromIndex < 0)
+    {
+        return(false);
+    }
+    // Known site positions are 1-based.
+    return(hasPosition(chromIndex,
+                       (int64_t)pos -
+                       reference.getChromosomeStart(chromIndex) + 1));
+}
+
+
+int32_t KnownSites::getChromosome(const char* chromosomeName) const
+{
+    std::map<std::string, int32_t>::const_iterator iter =
+        myNames.find(chromosomeName);
+    if(iter == myNames.end())
+    {
+        return(-1);
+    }
+    return(iter->second);
+}
+
+
+uint64_t KnownSites::getNumSites() const
+{
+    uint64_t numSites = 0;
+    for(size_t i = 0; i < myChroms.size(); i++)
+    {
+        for(uint64_t block = 0; block < myChroms[i].numBlocks; block++)
+        {
+            uint64_t offset = myChroms[i].blocks[block];
+            for(uint32_t word = 0; (offset != 0) && (word < BLOCK_WORDS);
+                word++)
+            {
+                numSites += __builtin_popcountll(myData[offset + word]);
+            }
+        }
+    }
+    return(numSites);
+}
+
+
+std::string KnownSites::getDefaultName(const char* textFile)
+{
+    return(std::string(textFile) + ".ksb");
+}
+
+
+bool KnownSites::index()
+{
+    myChroms.clear();
+    myNames.clear();
+    if((myNumWords < HEADER_WORDS) ||
+       (memcmp(myData, MAGIC, sizeof(MAGIC)) != 0))
+    {
+        return(false);
+    }
+    uint64_t numChroms = myData[1];
+    if(numChroms > (myNumWords - HEADER_WORDS) / ENTRY_WORDS)
+    {
+        return(false);
+    }
+    myChroms.resize(numChroms);
+    for(uint64_t i = 0; i < numChroms; i++)
+    {
+        const uint64_t* entry = myData + HEADER_WORDS + i * ENTRY_WORDS;
+        uint64_t nameOffset = entry[0];
+        uint64_t nameLength = entry[1];
+        uint64_t tableOffset = entry[2];
+        uint64_t numBlocks = entry[3];
+        if((nameOffset > myNumWords) ||
+           (nameLength > (myNumWords - nameOffset) * sizeof(uint64_t)) ||
+           (tableOffset > myNumWords) ||
+           (numBlocks > myNumWords - tableOffset))
+        {
+            return(false);
+        }
+        myChroms[i].blocks = myData + tableOffset;
+        myChroms[i].numBlocks = numBlocks;
+        for(uint64_t block = 0; block < numBlocks; block++)
+        {
+            uint64_t offset = myChroms[i].blocks[block];
+            if((offset != 0) && ((offset > myNumWords) ||
+                                 (BLOCK_WORDS > myNumWords - offset)))
+            {
+                return(false);
+            }
+        }
+        std::string name((const char*)(myData + nameOffset), nameLength);
+        myNames[name] = i;
+    }
+    return(true);
+}
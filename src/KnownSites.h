@@ -0,0 +1,163 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __KNOWN_SITES_H__
+#define __KNOWN_SITES_H__
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "GenomeSequence.h"
+#include "SamFileHeader.h"
+
+/// Known variant sites (dbSNP) stored as a bitmap per chromosome.
+/// The sites are read from a text file of "chromosome position" lines, or
+/// from a bitmap file written by write() (see "bam indexSites"), which is
+/// memory mapped read-only so opening it does not depend on the number of
+/// sites and concurrent jobs share it through the page cache.
+/// Each chromosome is split into blocks of 4096 positions and only blocks
+/// containing a site are stored, so sparse site lists stay small.
+/// Positions are stored as they appear in the text file, which loadDBSNP
+/// treats as 1-based.
+///
+/// The file is a sequence of 64-bit words:
+///   magic, number of chromosomes, total number of words,
+///   per chromosome: name offset, name length, block table offset,
+///                   number of blocks,
+///   the names (padded to a word), the block tables (the offset of each
+///   block's bitmap or 0 if it has no sites), and the block bitmaps.
+/// Offsets are in words from the start of the file.
+class KnownSites
+{
+public:
+    KnownSites();
+    ~KnownSites();
+
+    /// Returns whether the file is a known sites bitmap rather than text.
+    static bool isKnownSitesFile(const char* fileName);
+
+    /// Load the sites, memory mapping the file if it is a known sites
+    /// bitmap, otherwise reading it as text.
+    /// Returns false and prints the error on failure.
+    bool load(const char* fileName);
+
+    /// Read a text file of "chromosome position" lines, skipping lines
+    /// starting with '#' and lines with fewer than 2 columns.
+    /// Returns false and prints the error on failure.
+    bool loadText(const char* fileName);
+
+    /// Memory map a known sites bitmap.
+    /// Returns false and prints the error on failure.
+    bool open(const char* fileName);
+
+    /// Write the sites as a known sites bitmap.
+    /// Returns false and prints the error on failure.
+    bool write(const char* fileName) const;
+
+    void close();
+
+    bool isOpen() const { return(myData != NULL); }
+
+    /// Map the reference ids of the header to the chromosomes of the
+    /// sites for hasPosition.
+    void setReference(SamFileHeader& header);
+    /// Map the chromosome indices of the reference to the chromosomes of
+    /// the sites for hasPosition and hasGenomePosition.
+    void setReference(const GenomeSequence& reference);
+
+    /// Returns whether the position on the reference id/chromosome index
+    /// from setReference is a known site.
+    inline bool hasPosition(int32_t refID, int64_t pos) const
+    {
+        if((refID < 0) || (refID >= (int32_t)myRefChroms.size()))
+        {
+            return(false);
+        }
+        return(hasSite(myRefChroms[refID], pos));
+    }
+
+    /// Returns whether the genome index of the reference passed to
+    /// setReference is a known site.
+    bool hasGenomePosition(const GenomeSequence& reference,
+                           genomeIndex_t pos) const;
+
+    /// Returns whether the position on the chromosome index of the sites
+    /// is a known site.
+    inline bool hasSite(int32_t chrom, int64_t pos) const
+    {
+        if((chrom < 0) || (pos < 0))
+        {
+            return(false);
+        }
+        const Chromosome& chromosome = myChroms[chrom];
+        uint64_t block = (uint64_t)pos >> BLOCK_SHIFT;
+        if(block >= chromosome.numBlocks)
+        {
+            return(false);
+        }
+        uint64_t offset = chromosome.blocks[block];
+        if(offset == 0)
+        {
+            return(false);
+        }
+        uint64_t word = myData[offset + ((pos >> 6) & (BLOCK_WORDS - 1))];
+        return(((word >> (pos & 63)) & 1) != 0);
+    }
+
+    /// Returns the index of the named chromosome, or -1 if it has no sites.
+    int32_t getChromosome(const char* chromosomeName) const;
+    uint32_t getNumChromosomes() const { return(myChroms.size()); }
+    uint64_t getNumSites() const;
+
+    /// The default name of the bitmap for the text file.
+    static std::string getDefaultName(const char* textFile);
+
+private:
+    KnownSites(const KnownSites&);
+    KnownSites& operator=(const KnownSites&);
+
+    struct Chromosome
+    {
+        const uint64_t* blocks;
+        uint64_t numBlocks;
+    };
+
+    // Point myChroms & myNames into myData, returning false if the
+    // words are not a valid known sites bitmap.
+    bool index();
+
+    static const char MAGIC[8];
+    static const uint32_t HEADER_WORDS = 3;
+    static const uint32_t ENTRY_WORDS = 4;
+    static const uint32_t BLOCK_SHIFT = 12;
+    static const uint32_t BLOCK_WORDS = (1 << BLOCK_SHIFT) / 64;
+
+    // The memory mapped file, or the sites read from a text file.
+    void* myMap;
+    size_t myMapLen;
+    std::vector<uint64_t> myImage;
+    const uint64_t* myData;
+    uint64_t myNumWords;
+
+    std::vector<Chromosome> myChroms;
+    std::map<std::string, int32_t> myNames;
+    std::vector<int32_t> myRefChroms;
+};
+
+#endif
@@ -48,6 +48,7 @@ Logger::Logger(const char* filename, bool verbose)
 
 // Write a log to output file
 void Logger::writeLog(const char* format, ... ) {
+  std::lock_guard<std::mutex> lock(m_mutex);
   va_list args;
   va_start (args, format);
   vfprintf(fp_log, format, args);
@@ -65,6 +66,7 @@ void Logger::writeLog(const char* format, ... ) {
 
 // Write error messages and throw an exception.
 void Logger::error(const char* format, ... ) {
+  std::lock_guard<std::mutex> lock(m_mutex);
   va_list args;
   va_start (args, format);
   fprintf(fp_log, "ERROR: ");
@@ -91,6 +93,7 @@ void Logger::error(const char* format, ... ) {
 
 // Write warning messages
 void Logger::warning(const char* format, ... ) {
+  std::lock_guard<std::mutex> lock(m_mutex);
   va_list args;
   va_start (args, format);
   fprintf(fp_log, "WARNING: ");
@@ -21,6 +21,7 @@
 
 
 #include <iostream>
+#include <mutex>
 
 // Logger class for logging/error/warning
 class Logger {
@@ -28,6 +29,8 @@ class Logger {
   FILE* fp_log;
   FILE* fp_err;
   bool b_verbose;
+  // Serializes messages from worker threads (e.g. dedup --byChrom).
+  std::mutex m_mutex;
 
   Logger() {} // default constructor prohibited
  public:
@@ -66,15 +66,13 @@ void LogisticRegression::reset(Matrix& X){
     W.Zero();
 
     residuals.Dimension(X.rows);
+    gradient.Dimension(X.cols);
 
     deltaB.Dimension(X.cols);
 
     D.Dimension(X.cols, X.cols);
 
     Dinv.Dimension(X.cols, X.cols);
-    Dtwo.Dimension(X.cols, X.rows);
-    XtV.Dimension(X.cols, X.rows);
-
 }
 
 bool LogisticRegression::FitLogisticModel(Matrix & X, Vector & succ, Vector& total, int nrrounds)
@@ -86,33 +84,41 @@ bool LogisticRegression::FitLogisticModel(Matrix & X, Vector & succ, Vector& tot
     while (rounds < nrrounds)
     {
         // beta = beta + solve( t(X)%*%diag(p*(1-p)) %*%X) %*% t(X) %*% (Y-p);
+        // X'WX and X'(Y-p) are accumulated in a single pass over the rows
+        // of X, so only cols x cols values are updated for each row.
+        D.Zero();
+        gradient.Zero();
         for (int i = 0; i < X.rows; i++)
         {
+            const Vector& x = X[i];
             double d = 0;
             for (int k = 0; k < X.cols; k ++)
             {
-                d += B[k] * X[i][k]; // \eta,
+                d += B[k] * x[k]; // \eta,
             } // for parameter beta-k
 
             p[i] = 1.0 / (1.0 + exp(-d)); // \mu = E(prob)
             V[i] = p[i] * (1 - p[i]); 
             W[i] = total[i] * V[i]; // weight
-        } // for observation i
-
-        // The first part: solve / inverse
-        D.Zero();
+            residuals[i] = succ[i] - total[i] * p[i];
 
-        for (int k = 0; k < X.cols; k++)
-        {
-            for (int l = k; l < X.cols; l++)
+            for (int k = 0; k < X.cols; k++)
             {
-                double Dentry = 0.0;
-                for (int i = 0; i < X.rows; i++)
-                    Dentry += X[i][k] * W[i] * X[i][l];
-                D[k][l] = D[l][k] = Dentry;
+                if (x[k] == 0.0)
+                    continue;
+                double wx = W[i] * x[k];
+                gradient[k] += x[k] * residuals[i];
+                Vector& Dk = D[k];
+                for (int l = k; l < X.cols; l++)
+                    Dk[l] += wx * x[l];
             }
-        }
+        } // for observation i
+
+        for (int k = 0; k < X.cols; k++)
+            for (int l = k + 1; l < X.cols; l++)
+                D[l][k] = D[k][l];
 
+        // The first part: solve / inverse
         Dinv.Zero();
         Dinv = D;
         // SVD svd;
@@ -123,23 +129,11 @@ bool LogisticRegression::FitLogisticModel(Matrix & X, Vector & succ, Vector& tot
         chol.Invert();
         Dinv = chol.inv; // (X' W X)^{-1}
 
-        // Accumulate up to the second part: multiply by t(X)
-        Dtwo.Zero();
-
-        for (int k = 0; k < X.cols; k++)
-            for (int i = 0; i < X.rows; i++)
-                for (int l = 0; l < X.cols; l++)
-                    Dtwo[k][i] += Dinv[k][l] * X[i][l];
-
-        // The last part, residuals
-        residuals.Zero();
-        for (int i = 0; i < X.rows; i++)
-            residuals[i] = succ[i] - total[i] * p[i];
-
+        // The last part, (X' W X)^{-1} X' (Y-p)
         deltaB.Zero();
         for (int k = 0; k < X.cols; k++)
-            for (int i = 0; i < X.rows; i++)
-                deltaB[k] += Dtwo[k][i] * residuals[i];
+            for (int l = 0; l < X.cols; l++)
+                deltaB[k] += Dinv[k][l] * gradient[l];
 
         // update beta's and check for convergence
         double delta = 0.0;
@@ -165,20 +159,8 @@ bool LogisticRegression::FitLogisticModel(Matrix & X, Vector & succ, Vector& tot
     // add 10 more rounds before givin up
 
     // obtain covariance matrix to perform Wald test
-    // covB = solve(t(X)%*%V%*%X)
-
-    // Transpose X and multiply by diagonal V
-    //XtV.Zero();
-    for (int i = 0; i < X.rows; i++)
-        for (int k = 0; k < X.cols; k++)
-            XtV[k][i] = X[i][k] * W[i];
-
-    covB.Product(XtV, X);
-
-    if (!chol.TryDecompose(covB))
-        return false;
-    chol.Decompose(covB);
-    chol.Invert();
-    covB = chol.inv;
+    // covB = solve(t(X)%*%V%*%X), which was inverted in the last round
+    // since W has not changed since then.
+    covB = Dinv;
     return true;
 }
@@ -32,12 +32,11 @@ public:
 private:
 	Vector p, V, W;
     Vector residuals;
+    Vector gradient;
     Vector deltaB;
     Matrix D;
     Matrix Dinv;
     Cholesky chol;
-    Matrix Dtwo;
-	Matrix XtV;
 };
 
 #endif
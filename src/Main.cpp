@@ -21,6 +21,7 @@
 #include <stdlib.h>
 
 #include "Validate.h"
+#include "Profile.h"
 #include "Convert.h"
 #include "DumpHeader.h"
 #include "SplitChromosome.h"
@@ -36,6 +37,8 @@
 #include "Squeeze.h"
 #include "FindCigars.h"
 #include "Stats.h"
+#include "BaseQC.h"
+#include "Depth.h"
 #include "ClipOverlap.h"
 #include "SplitBam.h"
 #include "TrimBam.h"
@@ -46,6 +49,12 @@
 #include "Dedup_LowMem.h"
 #include "Recab.h"
 #include "Bam2FastQ.h"
+#include "Pipe.h"
+#include "IndexBam.h"
+#include "IndexNames.h"
+#include "CacheFields.h"
+#include "IndexSites.h"
+#include "SortBam.h"
 #include "PhoneHome.h"
 
 // May add option to print to console in red for errors.
@@ -71,6 +80,8 @@ void WriteUsage(std::ostream& os)
     os << "bam <tool> [<tool arguments>]" << std::endl;
     os << "bam (usage|help) - Will print usage and exit." << std::endl;
     os << "bam (usage|help) <tool> - Will print usage for specific tool and exit." << std::endl;
+    os << std::endl;
+    BamExecutable::printCommonUsage(os);
 
     os << std::endl;
     os << "Tools to Rewrite SAM/BAM Files: " << std::endl;
@@ -79,6 +90,7 @@ void WriteUsage(std::ostream& os)
     SplitChromosome::printSplitChromosomeDescription(os);
     SplitBam::printSplitBamDescription(os);
     FindCigars::printFindCigarsDescription(os);
+    SortBam::printSortBamDescription(os);
 
     os << "\nTools to Modify & write SAM/BAM Files: " << std::endl;
     ClipOverlap::printClipOverlapDescription(os);
@@ -96,17 +108,24 @@ void WriteUsage(std::ostream& os)
     Validate::printValidateDescription(os);
     Diff::printDiffDescription(os);
     Stats::printStatsDescription(os);
+    Depth::printDepthDescription(os);
     GapInfo::printGapInfoDescription(os);
 
     os << "\nTools to Print Information In Readable Format\n";
     DumpHeader::printDumpHeaderDescription(os);
     DumpRefInfo::printDumpRefInfoDescription(os);
     DumpIndex::printDumpIndexDescription(os);
+    BaseQC::printBaseQCDescription(os);
     ReadReference::printReadReferenceDescription(os);
     ExplainFlags::printExplainFlagsDescription(os);
 
     os << "\nAdditional Tools\n";
     Bam2FastQ::printBam2FastQDescription(os);
+    Pipe::printPipeDescription(os);
+    IndexBam::printIndexBamDescription(os);
+    IndexNames::printIndexNamesDescription(os);
+    CacheFields::printCacheFieldsDescription(os);
+    IndexSites::printIndexSitesDescription(os);
 
     os << "\nDummy/Example Tools\n";
     ReadIndexedBam::printReadIndexedBamDescription(os);
@@ -176,6 +195,14 @@ BamExecutable* CreateBamExe(const std::string& name)
     {
         ret = new Stats();
     }
+    else if(name == ToLowerCase("baseQC"))
+    {
+        ret = new BaseQC();
+    }
+    else if(name == "depth")
+    {
+        ret = new Depth();
+    }
     else if(name == ToLowerCase("clipOverlap"))
     {
         ret = new ClipOverlap();
@@ -221,6 +248,30 @@ BamExecutable* CreateBamExe(const std::string& name)
     {
         ret = new Convert();
     }
+    else if(name == "pipe")
+    {
+        ret = new Pipe();
+    }
+    else if(name == "index")
+    {
+        ret = new IndexBam();
+    }
+    else if(name == ToLowerCase("indexNames"))
+    {
+        ret = new IndexNames();
+    }
+    else if(name == ToLowerCase("cacheFields"))
+    {
+        ret = new CacheFields();
+    }
+    else if(name == ToLowerCase("indexSites"))
+    {
+        ret = new IndexSites();
+    }
+    else if(name == "sort")
+    {
+        ret = new SortBam();
+    }
 
     return ret;
 }
@@ -257,6 +308,8 @@ int main(int argc, char ** argv)
                 if (bamExe != NULL)
                 {
                     bamExe->printUsage(std::cout);
+                    std::cout << std::endl;
+                    BamExecutable::printCommonUsage(std::cout);
                 }
                 else
                 {
@@ -272,6 +325,14 @@ int main(int argc, char ** argv)
 
             if(bamExe != NULL)
             {
+                argc = BamExecutable::processCommonParameters(argc, argv);
+                if(argc < 0)
+                {
+                    std::cerr << std::endl;
+                    BamExecutable::printCommonUsage(std::cerr);
+                    return(-1);
+                }
+
                 String compStatus;
                 try
                 {
@@ -279,6 +340,8 @@ int main(int argc, char ** argv)
                 }
                 catch (std::runtime_error e)
                 {
+                    Profile::writeReport(cmd.c_str(),
+                                         BamExecutable::getNumThreads());
                     compStatus = "Exception";
                     PhoneHome::completionStatus(compStatus.c_str());
                     std::string errorMsg = "Exiting due to ERROR:\n\t";
@@ -286,6 +349,8 @@ int main(int argc, char ** argv)
                     std::cerr << errorMsg << std::endl;
                     return(-1);
                 }
+                Profile::writeReport(cmd.c_str(), 
+                                     BamExecutable::getNumThreads());
                 compStatus = ret;
                 PhoneHome::completionStatus(compStatus.c_str());
                 delete bamExe;
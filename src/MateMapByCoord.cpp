@@ -17,6 +17,7 @@
 
 #include "MateMapByCoord.h"
 #include "SamHelper.h"
+#include "MemoryBudget.h"
 
 MateMapByCoord::MateMapByCoord(bool mateCoord)
     : myMateBuffer(),
@@ -27,6 +28,8 @@ MateMapByCoord::MateMapByCoord(bool mateCoord)
 
 MateMapByCoord::~MateMapByCoord()
 {
+    MemoryBudget::add(MemoryBudget::MATE_MAPS,
+                      -(int64_t)myMateBuffer.size() * ENTRY_BYTES);
     myMateBuffer.clear();
 }
 
@@ -68,6 +71,7 @@ SamRecord* MateMapByCoord::getMate(SamRecord& record)
             mate = (*iter).second;
             // Remove the entry from the map.
             myMateBuffer.erase(iter);
+            MemoryBudget::add(MemoryBudget::MATE_MAPS, -ENTRY_BYTES);
             break;
         }
     }
@@ -91,6 +95,7 @@ void MateMapByCoord::add(SamRecord& record)
     }
 
     myMateBuffer.insert(MATE_MAP_PAIR(chromPos, &record));
+    MemoryBudget::add(MemoryBudget::MATE_MAPS, ENTRY_BYTES);
 }
 
 
@@ -114,6 +119,31 @@ void MateMapByCoord::popFirst()
     {
         // There is a first element, so remove it.
         myMateBuffer.erase(first);
+        MemoryBudget::add(MemoryBudget::MATE_MAPS, -ENTRY_BYTES);
+    }
+    return;
+}
+
+
+SamRecord* MateMapByCoord::last()
+{
+    if(myMateBuffer.empty())
+    {
+        return(NULL);
+    }
+
+    // Return the record from the last element.
+    return(myMateBuffer.rbegin()->second);
+}
+
+
+void MateMapByCoord::popLast()
+{
+    if(!myMateBuffer.empty())
+    {
+        // There is a last element, so remove it.
+        myMateBuffer.erase(--myMateBuffer.end());
+        MemoryBudget::add(MemoryBudget::MATE_MAPS, -ENTRY_BYTES);
     }
     return;
 }
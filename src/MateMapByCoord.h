@@ -27,6 +27,8 @@
 /// Assumes the records are added in a coordinate sorted order.
 /// Assumes the mate chromosome/position information on reads are accurate
 /// otherwise the mates will not be found.
+/// The map entries are added to the MemoryBudget (the records are
+/// accounted for by their pool).
 class MateMapByCoord
 {
 public:
@@ -56,6 +58,18 @@ public:
     /// Remove the first record from the map.
     void popFirst();
 
+    /// Return the last record (position-wise).
+    /// If there are no records, NULL is returned.
+    /// The record is NOT removed from the map, call popLast to remove the 
+    /// record.
+    SamRecord* last();
+
+    /// Remove the last record from the map.
+    void popLast();
+
+    /// Return the number of records in the map.
+    unsigned int size() { return(myMateBuffer.size()); }
+
 protected:
 
 private:
@@ -65,6 +79,9 @@ private:
     // the first() and popFirst() methods expect it to be ordered
     typedef std::multimap<uint64_t, SamRecord*> MATE_MAP;
 
+    // Estimated memory per map entry: the value and the tree node.
+    static const int ENTRY_BYTES = sizeof(MATE_MAP::value_type) + 4 * sizeof(void*);
+
     MATE_MAP myMateBuffer;
     bool myMateCoord;
 };
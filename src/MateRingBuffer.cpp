@@ -0,0 +1,163 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "MateRingBuffer.h"
+#include "SamHelper.h"
+#include "MemoryBudget.h"
+
+MateRingBuffer::MateRingBuffer()
+    : myRing(INITIAL_RING_SIZE, NULL),
+      myHead(0),
+      myTail(0),
+      myNumRecords(0),
+      myMateIndex()
+{
+    MemoryBudget::add(MemoryBudget::MATE_MAPS,
+                      myRing.size() * sizeof(SamRecord*));
+}
+
+
+MateRingBuffer::~MateRingBuffer()
+{
+    MemoryBudget::add(MemoryBudget::MATE_MAPS,
+                      -(int64_t)(myRing.size() * sizeof(SamRecord*) +
+                                 myMateIndex.size() * INDEX_ENTRY_BYTES));
+    myMateIndex.clear();
+    myRing.clear();
+}
+
+
+SamRecord* MateRingBuffer::getMate(SamRecord& record)
+{
+    const char* readName = record.getReadName();
+
+    // The records are indexed by their mate's coordinate, so search
+    // using the passed in record's coordinate.
+    uint64_t mateKey = 
+        SamHelper::combineChromPos(record.getReferenceID(), 
+                                   record.get0BasedPosition());
+
+    std::pair<MATE_INDEX::iterator,MATE_INDEX::iterator> matches =
+        myMateIndex.equal_range(mateKey);
+
+    // Loop through the records that matched the key looking for the mate.
+    uint64_t mask = myRing.size() - 1;
+    for(MATE_INDEX::iterator iter = matches.first; 
+        iter != matches.second; iter++)
+    {
+        SamRecord*& slot = myRing[iter->second & mask];
+        if(strcmp(slot->getReadName(), readName) == 0)
+        {
+            // Found the match, so remove it.
+            SamRecord* mate = slot;
+            slot = NULL;
+            myMateIndex.erase(iter);
+            MemoryBudget::add(MemoryBudget::MATE_MAPS, -INDEX_ENTRY_BYTES);
+            --myNumRecords;
+            skipRemoved();
+            return(mate);
+        }
+    }
+    return(NULL);
+}
+
+
+void MateRingBuffer::add(SamRecord& record)
+{
+    if((myTail - myHead) == myRing.size())
+    {
+        grow();
+    }
+    myRing[myTail & (myRing.size() - 1)] = &record;
+    myMateIndex.insert(std::make_pair(SamHelper::combineChromPos(record.getMateReferenceID(),
+                                                                 record.get0BasedMatePosition()),
+                                      myTail));
+    MemoryBudget::add(MemoryBudget::MATE_MAPS, INDEX_ENTRY_BYTES);
+    ++myTail;
+    ++myNumRecords;
+}
+
+
+SamRecord* MateRingBuffer::first()
+{
+    if(myNumRecords == 0)
+    {
+        return(NULL);
+    }
+    // skipRemoved keeps a record at the front of the ring.
+    return(myRing[myHead & (myRing.size() - 1)]);
+}
+
+
+void MateRingBuffer::popFirst()
+{
+    SamRecord* firstRec = first();
+    if(firstRec != NULL)
+    {
+        removeFromIndex(SamHelper::combineChromPos(firstRec->getMateReferenceID(),
+                                                   firstRec->get0BasedMatePosition()),
+                        myHead);
+        myRing[myHead & (myRing.size() - 1)] = NULL;
+        --myNumRecords;
+        ++myHead;
+        skipRemoved();
+    }
+}
+
+
+void MateRingBuffer::grow()
+{
+    std::vector<SamRecord*> newRing(myRing.size() * 2, NULL);
+    uint64_t oldMask = myRing.size() - 1;
+    uint64_t newMask = newRing.size() - 1;
+    for(uint64_t entry = myHead; entry != myTail; entry++)
+    {
+        newRing[entry & newMask] = myRing[entry & oldMask];
+    }
+    myRing.swap(newRing);
+    MemoryBudget::add(MemoryBudget::MATE_MAPS,
+                      newRing.size() * sizeof(SamRecord*));
+}
+
+
+void MateRingBuffer::removeFromIndex(uint64_t mateKey, uint64_t entry)
+{
+    std::pair<MATE_INDEX::iterator,MATE_INDEX::iterator> matches =
+        myMateIndex.equal_range(mateKey);
+    for(MATE_INDEX::iterator iter = matches.first; 
+        iter != matches.second; iter++)
+    {
+        if(iter->second == entry)
+        {
+            myMateIndex.erase(iter);
+            MemoryBudget::add(MemoryBudget::MATE_MAPS, -INDEX_ENTRY_BYTES);
+            return;
+        }
+    }
+}
+
+
+void MateRingBuffer::skipRemoved()
+{
+    uint64_t mask = myRing.size() - 1;
+    while((myHead != myTail) && (myRing[myHead & mask] == NULL))
+    {
+        ++myHead;
+    }
+}
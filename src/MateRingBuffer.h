@@ -0,0 +1,89 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MATE_RING_BUFFER_H__
+#define __MATE_RING_BUFFER_H__
+
+#include <vector>
+#include <unordered_map>
+
+#include "SamRecord.h"
+
+/// Buffer of reads waiting for their mates, for records added in
+/// coordinate order.  The records are kept in a ring in the order they
+/// were added, so the first record is always the one with the earliest
+/// position, and are indexed by their mate's chromosome/position so a
+/// mate is found in constant time.  The ring grows as needed.  The ring
+/// and index are added to the MemoryBudget (the records are accounted
+/// for by their pool).
+/// Assumes the mate chromosome/position information on reads are accurate
+/// otherwise the mates will not be found.
+class MateRingBuffer
+{
+public:
+    MateRingBuffer();
+    ~MateRingBuffer();
+
+    /// Return the mate of the specified record, or NULL if mate is not found.
+    /// The mate is removed from this buffer if it is found.
+    SamRecord* getMate(SamRecord& record);
+
+    /// Add the specified record to this buffer.  Records must be added in
+    /// coordinate order.
+    void add(SamRecord& record);
+
+    /// Return the first record (position-wise).
+    /// If there are no records, NULL is returned.
+    /// The record is NOT removed from the buffer, call popFirst to remove
+    /// the record.
+    SamRecord* first();
+
+    /// Remove the first record from the buffer.
+    void popFirst();
+
+    /// Return the number of records in the buffer.
+    unsigned int size() { return(myNumRecords); }
+
+private:
+    static const unsigned int INITIAL_RING_SIZE = 1024;
+    // Estimated memory per mate index entry: the value, the node's next
+    // pointer and hash, and the bucket.
+    static const int INDEX_ENTRY_BYTES = sizeof(std::pair<uint64_t, uint64_t>) + 3 * sizeof(void*);
+
+    // Grow the ring, keeping the records in the same order.
+    void grow();
+    // Remove the specified entry from the mate index.
+    void removeFromIndex(uint64_t mateKey, uint64_t entry);
+    // Skip past entries at the front of the ring that were removed.
+    void skipRemoved();
+
+    // Ring of records, the size is always a power of 2.  Removed records
+    // are set to NULL until they reach the front of the ring.
+    std::vector<SamRecord*> myRing;
+    // Entry numbers of the first entry and one past the last entry.
+    // The slot for an entry is the entry number masked by the ring size.
+    uint64_t myHead;
+    uint64_t myTail;
+    unsigned int myNumRecords;
+
+    // Mate chromosome/position to entry number.
+    typedef std::unordered_multimap<uint64_t, uint64_t> MATE_INDEX;
+    MATE_INDEX myMateIndex;
+};
+
+
+#endif
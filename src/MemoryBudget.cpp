@@ -0,0 +1,81 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <ctype.h>
+#include "MemoryBudget.h"
+#include "Profile.h"
+
+uint64_t MemoryBudget::ourLimit = 0;
+std::atomic<uint64_t> MemoryBudget::ourUsed(0);
+std::atomic<uint64_t> MemoryBudget::ourUsedBy[MemoryBudget::NUM_USES];
+
+
+bool MemoryBudget::parseSize(const char* value, uint64_t& bytes)
+{
+    if((value == NULL) || !isdigit(*value))
+    {
+        return(false);
+    }
+    char* endPtr = NULL;
+    unsigned long long size = strtoull(value, &endPtr, 10);
+    int shift = 20;
+    switch(toupper(*endPtr))
+    {
+        case '\0':
+            break;
+        case 'K':
+            shift = 10;
+            break;
+        case 'M':
+            shift = 20;
+            break;
+        case 'G':
+            shift = 30;
+            break;
+        default:
+            return(false);
+    }
+    if((*endPtr != '\0') && (*(++endPtr) != '\0'))
+    {
+        return(false);
+    }
+    bytes = size << shift;
+    return((bytes >> shift) == size);
+}
+
+
+void MemoryBudget::add(Use use, int64_t bytes)
+{
+    ourUsedBy[use] += bytes;
+    uint64_t used = (ourUsed += bytes);
+    if(bytes > 0)
+    {
+        Profile::setMaxValue("MemoryBudget::peakBytes", used);
+    }
+}
+
+
+uint64_t MemoryBudget::getRoom()
+{
+    if(ourLimit == 0)
+    {
+        return(UINT64_MAX);
+    }
+    uint64_t used = ourUsed;
+    return((used < ourLimit) ? ourLimit - used : 0);
+}
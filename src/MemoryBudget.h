@@ -0,0 +1,68 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MEMORY_BUDGET_H__
+#define __MEMORY_BUDGET_H__
+
+#include <atomic>
+#include <stdint.h>
+
+/// Process wide accounting of the memory held by the large in memory
+/// structures (record pools, mate maps, and recalibration tables) against
+/// the --maxMem budget.  The structures add the (estimated) bytes they
+/// allocate and release; those that can react to pressure, by spilling,
+/// flushing, or limiting their pool, check isOverLimit or getRoom.
+/// Memory that is not added here, such as I/O buffers, is not counted.
+/// Tools that size their own buffers by memory (sort, dedup_LowMem) use
+/// the budget as their limit.
+class MemoryBudget
+{
+public:
+    enum Use { RECORDS, MATE_MAPS, RECAB_TABLES, NUM_USES };
+
+    /// Parse a size in megabytes, or in the units of a K, M, or G suffix
+    /// (powers of 1024), into bytes, returning false if it is invalid.
+    static bool parseSize(const char* value, uint64_t& bytes);
+
+    /// Set the budget in bytes, 0 for no budget.
+    static void setLimit(uint64_t bytes) { ourLimit = bytes; }
+    static uint64_t getLimit() { return(ourLimit); }
+    static bool hasLimit() { return(ourLimit != 0); }
+
+    /// Add the bytes allocated for a use, or release them if negative.
+    static void add(Use use, int64_t bytes);
+
+    static uint64_t getUsed() { return(ourUsed); }
+    static uint64_t getUsed(Use use) { return(ourUsedBy[use]); }
+
+    /// Returns true if there is a budget and more than it is in use.
+    static bool isOverLimit()
+    {
+        return((ourLimit != 0) && (ourUsed > ourLimit));
+    }
+
+    /// Returns the number of bytes that can be added before the budget
+    /// is exceeded, UINT64_MAX if there is no budget.
+    static uint64_t getRoom();
+
+private:
+    static uint64_t ourLimit;
+    static std::atomic<uint64_t> ourUsed;
+    static std::atomic<uint64_t> ourUsedBy[NUM_USES];
+};
+
+#endif
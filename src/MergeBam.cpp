@@ -21,11 +21,22 @@
 #include <map>
 #include <vector>
 #include <string>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <future>
+#include <stdexcept>
 #include <unistd.h>
 #include <getopt.h>
-#include "SamFile.h"
+#include "ThreadedSamFile.h"
+#include "ParallelBgzf.h"
+#include "BamIndexBuilder.h"
 #include "MergeBam.h"
+#include "RemoteBamCache.h"
 #include "Logger.h"
 #include "PhoneHome.h"
 
@@ -50,6 +61,29 @@ public:
   std::string s_header_line;
 };
 
+// Writes BAM records, without a header, to a BGZF file on the calling
+// thread so the file can later be appended to the output BAM.
+class BamPartWriter {
+public:
+  BamPartWriter() : myWritten(true) {}
+  bool OpenForWrite(const char* filename) { return myWriter.open(filename); }
+  bool Close() { return myWriter.close() && myWritten; }
+  bool WriteRecord(SamFileHeader& header, SamRecord& record) {
+    // Write the record buffer, which starts with the block size.
+    const char* buffer = (const char*)record.getRecordBuffer(SamRecord::NONE);
+    if ( buffer == NULL ) {
+      throw(std::runtime_error("Failed to get the BAM record buffer"));
+    }
+    int32_t blockSize = 0;
+    memcpy(&blockSize, buffer, sizeof(blockSize));
+    myWritten = myWritten && myWriter.write(buffer, blockSize + sizeof(blockSize));
+    return myWritten;
+  }
+private:
+  ParallelBgzfWriter myWriter;
+  bool myWritten;
+};
+
 // Global variables
 uint64_t MAX_GENOMIC_COORDINATE = 0xffffffffffffffffULL;
 uint64_t UNMAPPED_GENOMIC_COORDINATE = 0xfffffffffffffffeULL;
@@ -61,12 +95,19 @@ uint64_t getGenomicCoordinate(SamRecord& r);
 void addReadGroupToHeader(SamFileHeader& header, ReadGroup& rg);
 void addReadGroupTag(SamRecord& record, ReadGroup& rg);
 uint32_t addTokenizedStrings(const std::string& str, const std::string& delimiters, vector<std::string>& tokens);
+template<class OutFile>
+uint32_t mergeRecords(SamFile* in_bams, SamFileHeader* in_headers, uint32_t n_bams, uint32_t firstIndex, vector<ReadGroup>& readGroups, OutFile& out, SamFileHeader& outHeader, bool logProgress);
 
 MergeBam::MergeBam()
     : BamExecutable(),
       myRegionArray(),
       myRegionArrayIndex(-1),
-      myRegionFile(NULL)
+      myRegionFile(NULL),
+      mySectionsDone(false),
+      myHasSection(false),
+      mySectionChr(),
+      mySectionStart(-1),
+      mySectionEnd(-1)
 {
 }
 
@@ -85,11 +126,13 @@ void MergeBam::printDescription(std::ostream& os)
 void MergeBam::printUsage(std::ostream& os)
 {
     BamExecutable::printUsage(os);
-    os << "Usage: mergeBam [-v] [--log logFile] [--ignorePI] --list <listFile> --out <outFile>\n" << std::endl;
+    os << "Usage: mergeBam [-v] [--log logFile] [--ignorePI] [--index] --list <listFile> --out <outFile>\n" << std::endl;
     os << "Required parameters :" << std::endl;
     os << "--out/-o : Output BAM file (sorted)" << std::endl;
     os << "--in/-i  : BAM file to be input, must be more than one of these options." << std::endl;
     os << "            cannot be used with --list/-l" << std::endl;
+    os << "            may be an http://, s3://, or file:// URL, only the blocks needed" << std::endl;
+    os << "            for the regions are fetched into the remote cache ($BAM_REMOTE_CACHE)" << std::endl;
     os << "--list/-l : RGAList File. Tab-delimited list consisting of following columns (with headers):" << std::endl;
     os << "\tBAM* : Input BAM file name to be merged" << std::endl;
     os << "\tID* : Unique read group identifier" << std::endl;
@@ -106,6 +149,12 @@ void MergeBam::printUsage(std::ostream& os)
     os << "--regions/-r : list of intervals, '<chr>:<start>-<end>', to merge separated by commas, ','\n";
     os << "--regionFile/-R : file containing list of intervals, '<chr>:<start>-<end>', to merge, one per line\n";
     os << "--ignorePI/-I : Ignore the RG PI field when comparing headers\n";
+    os << "--maxOpen : Maximum number of input BAMs to have open at a time, default 0 (no limit).\n";
+    os << "            If there are more inputs, they are merged in groups through temporary files\n";
+    os << "--tmpPrefix : Prefix for the temporary files used with --maxOpen or --threads, default is the output file\n";
+    os << "--index : Index the BAM output as it is written (<outFile>.bai, or .csi if a reference is longer than 512Mb)\n";
+    os << "With --threads and a BAM output, each reference of indexed input BAMs is merged on its own thread\n";
+    os << "  (with --index, the output is then indexed by reading it back)\n";
     os << "--log/-L : Log file" << std::endl;
     os << "--verbose/-v : Turn on verbose mode" << std::endl;
 }
@@ -124,6 +173,9 @@ int MergeBam::execute(int argc, char ** argv)
       { "ignorePI", no_argument, NULL, 'I'},
       { "regions", required_argument, NULL, 'r'},
       { "regionFile", required_argument, NULL, 'R'},
+      { "maxOpen", required_argument, NULL, 'm'},
+      { "tmpPrefix", required_argument, NULL, 'x'},
+      { "index", no_argument, NULL, 'X'},
       { "noPhoneHome", no_argument, NULL, 'p'},
       { "nophonehome", no_argument, NULL, 'P'},
       { "phoneHomeThinning", required_argument, NULL, 't'},
@@ -143,6 +195,9 @@ int MergeBam::execute(int argc, char ** argv)
   bool noPhoneHome = false;
   String regions = "";
   std::string regionFile = "";
+  int maxOpen = 0;
+  std::string s_tmpPrefix = "";
+  bool index = false;
   vector<std::string> vs_in_bam_files; // input BAM files
 
   std::string s_list, s_out, s_logger;
@@ -173,6 +228,15 @@ int MergeBam::execute(int argc, char ** argv)
     case 'R':
       regionFile = optarg;
       break;
+    case 'm':
+      maxOpen = atoi(optarg);
+      break;
+    case 'x':
+      s_tmpPrefix = optarg;
+      break;
+    case 'X':
+      index = true;
+      break;
     case 'p':
     case 'P':
       noPhoneHome = true;
@@ -193,7 +257,7 @@ int MergeBam::execute(int argc, char ** argv)
   }
   
   if ( s_logger.empty() ) {
-      if(s_out.empty())
+      if(s_out.empty() || ThreadedSamFile::isPipeName(s_out.c_str()))
       {
           s_logger = "-";
       }
@@ -229,6 +293,15 @@ int MergeBam::execute(int argc, char ** argv)
       Logger::gLogger->error("Cannot specify both --regions/-r and --regionFile/-R");
   }
 
+  if((maxOpen < 0) || (maxOpen == 1))
+  {
+      Logger::gLogger->error("--maxOpen must be 0 (no limit) or at least 2");
+  }
+  if(s_tmpPrefix.empty())
+  {
+      s_tmpPrefix = s_out;
+  }
+
   if(!regions.IsEmpty())
   {
       // Setup the region array
@@ -289,6 +362,73 @@ int MergeBam::execute(int argc, char ** argv)
       Logger::gLogger->error("At least two BAM files must be specified for merging");
   }
 
+  // Remote inputs are read from local caches of just the blocks needed
+  // for the regions (all of them if not reading by region).
+  std::vector<RemoteBamCache::Region> remoteRegions;
+  bool remoteRegionsSet = false;
+  for(uint32_t i = 0; i < n_bams; ++i)
+  {
+      if(!RemoteFile::isRemote(vs_in_bam_files[i].c_str()))
+      {
+          continue;
+      }
+      if(!remoteRegionsSet)
+      {
+          remoteRegionsSet = true;
+          std::vector<std::string> regionStrs;
+          for(int r = 0; r < myRegionArray.Length(); ++r)
+          {
+              regionStrs.push_back(myRegionArray[r].c_str());
+          }
+          if(!regionFile.empty())
+          {
+              std::ifstream regionIn(regionFile.c_str());
+              std::string line;
+              while(std::getline(regionIn, line))
+              {
+                  if(!line.empty())
+                  {
+                      regionStrs.push_back(line);
+                  }
+              }
+          }
+          for(unsigned int r = 0; r < regionStrs.size(); ++r)
+          {
+              // chr[:start[-end]], the start is 1-based and the end
+              // inclusive; bad positions are reported when reading.
+              const std::string& regionStr = regionStrs[r];
+              size_t colon = regionStr.find(':');
+              int start = 0;
+              int end = -1;
+              if(colon != std::string::npos)
+              {
+                  start = std::max(atoi(regionStr.c_str() + colon + 1) - 1, 0);
+                  size_t dash = regionStr.find('-', colon);
+                  if(dash != std::string::npos)
+                  {
+                      end = atoi(regionStr.c_str() + dash + 1);
+                  }
+              }
+              remoteRegions.push_back(RemoteBamCache::Region(regionStr.substr(0, colon),
+                                                             start, end));
+          }
+      }
+      std::string indexFile = "";
+      if(!RemoteBamCache::localize(vs_in_bam_files[i], indexFile, remoteRegions))
+      {
+          Logger::gLogger->error("Failed to read remote BAM file %s",
+                                 vs_in_bam_files[i].c_str());
+      }
+  }
+
+  // With too many inputs to open at once, the headers are read up front,
+  // but the records are merged in groups.
+  bool mergeGroups = (maxOpen != 0) && (n_bams > (uint32_t)maxOpen);
+  if(mergeGroups)
+  {
+      Logger::gLogger->writeLog("Merging at most %d BAM files at a time", maxOpen);
+  }
+
   // create SamFile and SamFileHeader object for each BAM file
   SamFile *p_in_bams = new SamFile[n_bams];
   SamFileHeader *p_headers = new SamFileHeader[n_bams];
@@ -311,7 +451,12 @@ int MergeBam::execute(int argc, char ** argv)
       
       p_in_bams[i].ReadHeader(p_headers[i]);
 
-      if((myRegionFile != NULL) || (myRegionArrayIndex != -1))
+      if(mergeGroups)
+      {
+          // The records are read when merging each group.
+          p_in_bams[i].Close();
+      }
+      else if((myRegionFile != NULL) || (myRegionArrayIndex != -1))
       {
           // Reading just specific regions, so read each index file.
           p_in_bams[i].ReadBamIndex();
@@ -346,8 +491,31 @@ int MergeBam::execute(int argc, char ** argv)
     addReadGroupToHeader(newHeader, v_uniq_readgroups[i]);
   }
 
-  // Write an output file with new headers
-  SamFile bam_out;
+  // With multiple threads, merge each reference on its own thread if
+  // every input can be read by reference.
+  bool byReference = false;
+  if((BamExecutable::getNumThreads() > 1) && !mergeGroups &&
+     (myRegionFile == NULL) && (myRegionArrayIndex == -1) &&
+     (s_out.size() > 4) && (s_out.compare(s_out.size() - 4, 4, ".bam") == 0))
+  {
+      byReference = true;
+      for(uint32_t i=0; byReference && (i < n_bams); ++i)
+      {
+          SamFile indexCheck(ErrorHandler::RETURN);
+          byReference = indexCheck.OpenForRead(vs_in_bam_files[i].c_str()) &&
+              indexCheck.ReadBamIndex();
+      }
+      if(!byReference)
+      {
+          Logger::gLogger->writeLog("Not every input BAM file is indexed, so merging on one thread");
+      }
+  }
+
+  // Write an output file with new headers.  The references merged on
+  // their own threads are appended to it, so it cannot be indexed as it
+  // is written.
+  ThreadedSamFile bam_out;
+  bam_out.setWriteIndex(index && !byReference);
   if ( !bam_out.OpenForWrite(s_out.c_str()) )
   {
     Logger::gLogger->error("Cannot open BAM file %s for writing",s_out.c_str());
@@ -355,94 +523,52 @@ int MergeBam::execute(int argc, char ** argv)
   bam_out.setSortedValidation(SamFile::COORDINATE);
   bam_out.WriteHeader(newHeader);
 
-  // create SamRecords and GenomicCoordinates for each input BAM file
-  SamRecord* p_records = new SamRecord[n_bams];
-  uint64_t* p_gcoordinates = new uint64_t[n_bams];
+  uint32_t numByReference = 0;
+  if(byReference)
+  {
+      numByReference = mergeByReference(vs_in_bam_files, v_readgroups,
+                                        s_tmpPrefix, bam_out, newHeader);
+  }
 
   // Loop through, processing each section.
-  while(getNextSection(p_in_bams, n_bams))
+  while(!byReference && getNextSection())
   {
-      // read the first record for every input BAM file
-      for(uint32_t i=0; i < n_bams; ++i) {
-          if ( p_in_bams[i].ReadRecord(p_headers[i],p_records[i]) ) {
-              if ( p_records[i].isValid(p_headers[i]) ) {
-                  p_gcoordinates[i] = getGenomicCoordinate(p_records[i]);
-              }
-              else {
-                  Logger::gLogger->error("Invalid record found at the first line of file %u. Failure code is %d", i, static_cast<int>(p_in_bams[i].GetFailure()));
-              }
-          }
-          else {
-              if ( p_in_bams[i].GetFailure() == SamStatus::NO_MORE_RECS ) {
-                  // the BAM file has no record
-                  p_gcoordinates[i] = MAX_GENOMIC_COORDINATE;
-              }
-              else {
-                  Logger::gLogger->error("Invalid record found at the first line of file %u. Failure code is %d", i, static_cast<int>(p_in_bams[i].GetFailure()));
-              }
-          }
+      if(mergeGroups)
+      {
+          mergeInGroups(vs_in_bam_files, v_readgroups, s_tmpPrefix,
+                        maxOpen, bam_out, newHeader);
       }
-      
-      // Routine for writing output BAM file
-      uint32_t nWrittenRecords = 0; // number of written BAM records
-      while(true) {
-          // scan the minimum index of genomic coordinate
-          int min_idx = -1;
-          uint64_t min_gcoordinate = MAX_GENOMIC_COORDINATE;
-          for(uint32_t i=0; i < n_bams; ++i) {
-              if ( min_gcoordinate > p_gcoordinates[i] ) {
-                  min_gcoordinate = p_gcoordinates[i];
-                  min_idx = static_cast<int>(i);
-              }
-          }
-          
-          // If every file reached EOF, exit the loop
-          if ( min_idx < 0 ) break;
-          
-          
-          // If adding read groups, add the tag.
-          if(!v_readgroups.empty())
-          {
-              // add readGroup tag to the record to write and write to output BAM file
-              //Logger::gLogger->writeLog("%d",min_idx);
-              addReadGroupTag(p_records[min_idx], v_readgroups[min_idx]);
-          }
-          bam_out.WriteRecord(newHeader, p_records[min_idx]);
-          ++nWrittenRecords;
-          if ( nWrittenRecords % 1000000 == 0 ) {
-              Logger::gLogger->writeLog("Writing %u records to the output file",nWrittenRecords);
-          }
-          
-          // Read a record from the input BAM file 
-          if ( p_in_bams[min_idx].ReadRecord(p_headers[min_idx], p_records[min_idx]) ) {
-              if ( p_records[min_idx].isValid(p_headers[min_idx]) ) {
-                  p_gcoordinates[min_idx] = getGenomicCoordinate(p_records[min_idx]);
-              }
-              else { // if invalid record found
-                  Logger::gLogger->error("Invalid record found at recordCount %d of file %d. Failure code is %d", p_in_bams[min_idx].GetCurrentRecordCount(), min_idx, static_cast<int>(p_in_bams[min_idx].GetFailure()));
-              }
-          }
-          else {
-              if ( p_in_bams[min_idx].GetFailure() == SamStatus::NO_MORE_RECS ) {
-                  p_gcoordinates[min_idx] = MAX_GENOMIC_COORDINATE; // Mark that all record has been read
-              }
-              else {
-                  Logger::gLogger->error("Cannot read record at recordCount %d of file %d. Failure code is %d", p_in_bams[min_idx].GetCurrentRecordCount(), min_idx, static_cast<int>(p_in_bams[min_idx].GetFailure()));
-              }
-          }
+      else
+      {
+          setSection(p_in_bams, n_bams);
+          mergeRecords(p_in_bams, p_headers, n_bams, 0, v_readgroups,
+                       bam_out, newHeader, true);
       }
   }
 
   // close files and free allocated memory
-  Logger::gLogger->writeLog("Finished writing %d records into the output BAM file",bam_out.GetCurrentRecordCount());
+  Logger::gLogger->writeLog("Finished writing %d records into the output BAM file",
+                            byReference ? numByReference : bam_out.GetCurrentRecordCount());
   bam_out.Close();
+  if(bam_out.writeIndexFailed())
+  {
+      Logger::gLogger->error("Failed to index %s", s_out.c_str());
+  }
+  if(index && byReference && (s_out != "-.bam"))
+  {
+      BamIndexBuilder builder;
+      bool csi = BamIndexBuilder::needsCsi(newHeader);
+      std::string indexFile = BamIndexBuilder::getDefaultName(s_out.c_str(), csi);
+      if(!builder.build(s_out.c_str(), indexFile.c_str(), csi))
+      {
+          Logger::gLogger->error("Failed to index %s", s_out.c_str());
+      }
+  }
   for(uint32_t i=0; i < n_bams; ++i) {
     p_in_bams[i].Close();
   }
-  delete[] p_records;
   delete[] p_in_bams;
   delete[] p_headers;
-  delete[] p_gcoordinates;
   delete Logger::gLogger;
   return 0;
 }
@@ -722,17 +848,21 @@ void parseOutRG(SamFileHeader& header, std::string& noRgPgString, SamFileHeader*
 
 
 // make a 64-bit genomic coordinate [24bit-chr][32bit-pos][8bit-orientation]
-uint64_t getGenomicCoordinate(SamRecord& r) {
+uint64_t MergeBam::getGenomicCoordinate(int32_t refID, int32_t pos, uint16_t flag) {
   // 64bit string consisting of
   // 24bit refID, 32bit pos, 8bit orientation
-  if ( ( r.getReferenceID() < 0 ) || ( r.get0BasedPosition() < 0 ) ) {
+  if ( ( refID < 0 ) || ( pos < 0 ) ) {
     return UNMAPPED_GENOMIC_COORDINATE;
   }
   else {
-    return ( ( static_cast<uint64_t>(r.getReferenceID()) << 40 ) | ( static_cast<uint64_t>(r.get0BasedPosition()) << 8 ) | static_cast<uint64_t>( r.getFlag() & 0x0010 ) );
+    return ( ( static_cast<uint64_t>(refID) << 40 ) | ( static_cast<uint64_t>(pos) << 8 ) | static_cast<uint64_t>( flag & 0x0010 ) );
   }
 }
 
+uint64_t getGenomicCoordinate(SamRecord& r) {
+  return MergeBam::getGenomicCoordinate(r.getReferenceID(), r.get0BasedPosition(), r.getFlag());
+}
+
 // add readgroup header line to the SamFileHeader
 void addReadGroupToHeader(SamFileHeader& header, ReadGroup& rg) {
   if ( !header.addHeaderLine(rg.s_header_line.c_str()) ) {
@@ -747,6 +877,69 @@ void addReadGroupTag(SamRecord& record, ReadGroup& rg) {
   }
 }
 
+// Read the next record of the specified BAM, returning its genomic
+// coordinate, or MAX_GENOMIC_COORDINATE if there are no more records.
+static uint64_t readNextRecord(SamFile& in_bam, SamFileHeader& header, SamRecord& record, uint32_t fileIndex) {
+  if ( in_bam.ReadRecord(header, record) ) {
+    if ( record.isValid(header) ) {
+      return getGenomicCoordinate(record);
+    }
+    Logger::gLogger->error("Invalid record found at recordCount %d of file %u. Failure code is %d", in_bam.GetCurrentRecordCount(), fileIndex, static_cast<int>(in_bam.GetFailure()));
+  }
+  else if ( in_bam.GetFailure() != SamStatus::NO_MORE_RECS ) {
+    Logger::gLogger->error("Cannot read record at recordCount %d of file %u. Failure code is %d", in_bam.GetCurrentRecordCount(), fileIndex, static_cast<int>(in_bam.GetFailure()));
+  }
+  // the BAM file has no more records
+  return MAX_GENOMIC_COORDINATE;
+}
+
+// Merge the records of the open BAM files into the output, adding the
+// read group of each file (firstIndex + i) if readGroups is not empty.
+// The next record of each file is kept in a min-heap keyed on its genomic
+// coordinate and then the file index, so records with the same coordinate
+// are written in input order.  Returns the number of records written.
+template<class OutFile>
+uint32_t mergeRecords(SamFile* in_bams, SamFileHeader* in_headers, uint32_t n_bams, uint32_t firstIndex, vector<ReadGroup>& readGroups, OutFile& out, SamFileHeader& outHeader, bool logProgress) {
+  typedef std::pair<uint64_t, uint32_t> HeapEntry;
+  std::priority_queue<HeapEntry, vector<HeapEntry>, std::greater<HeapEntry> > heap;
+
+  // read the first record for every input BAM file
+  SamRecord* p_records = new SamRecord[n_bams];
+  for(uint32_t i=0; i < n_bams; ++i) {
+    uint64_t gcoordinate = readNextRecord(in_bams[i], in_headers[i], p_records[i], firstIndex + i);
+    if ( gcoordinate != MAX_GENOMIC_COORDINATE ) {
+      heap.push(HeapEntry(gcoordinate, i));
+    }
+  }
+
+  // Routine for writing output BAM file
+  uint32_t nWrittenRecords = 0; // number of written BAM records
+  while( !heap.empty() ) {
+    uint32_t min_idx = heap.top().second;
+    heap.pop();
+
+    // If adding read groups, add the tag.
+    if(!readGroups.empty())
+    {
+      // add readGroup tag to the record to write and write to output BAM file
+      addReadGroupTag(p_records[min_idx], readGroups[firstIndex + min_idx]);
+    }
+    out.WriteRecord(outHeader, p_records[min_idx]);
+    ++nWrittenRecords;
+    if ( logProgress && ( nWrittenRecords % 1000000 == 0 ) ) {
+      Logger::gLogger->writeLog("Writing %u records to the output file",nWrittenRecords);
+    }
+
+    // Read a record from the input BAM file
+    uint64_t gcoordinate = readNextRecord(in_bams[min_idx], in_headers[min_idx], p_records[min_idx], firstIndex + min_idx);
+    if ( gcoordinate != MAX_GENOMIC_COORDINATE ) {
+      heap.push(HeapEntry(gcoordinate, min_idx));
+    }
+  }
+  delete[] p_records;
+  return nWrittenRecords;
+}
+
 uint32_t addTokenizedStrings(const std::string& str, const std::string& delimiters, vector<std::string>& tokens)
 {
   std::string::size_type delimPos = 0, tokenPos = 0, pos = 0;
@@ -791,11 +984,248 @@ uint32_t addTokenizedStrings(const std::string& str, const std::string& delimite
 }
 
 
-bool MergeBam::getNextSection(SamFile *in_bams, uint32_t numBams)
+void MergeBam::mergeInGroups(std::vector<std::string>& bamFiles,
+                             std::vector<ReadGroup>& readGroups,
+                             const std::string& tmpPrefix, uint32_t maxOpen,
+                             ThreadedSamFile& out, SamFileHeader& outHeader)
 {
-    static bool done = false;
+    // The first level reads the input files, setting the section and
+    // adding read groups.  Later levels just merge the temporary files
+    // written by the previous level.  Each group is a contiguous range of
+    // files, so merging groups keeps records with the same coordinate in
+    // input order, just as when merging all files at once.
+    std::vector<std::string> inputs(bamFiles);
+    std::vector<ReadGroup> noReadGroups;
+    for(uint32_t level = 0; ; ++level)
+    {
+        bool firstLevel = (level == 0);
+        bool lastLevel = (inputs.size() <= maxOpen);
+        std::vector<std::string> outputs;
+
+        try
+        {
+            for(uint32_t first = 0; first < inputs.size(); first += maxOpen)
+            {
+                uint32_t numBams = std::min(maxOpen, (uint32_t)(inputs.size() - first));
+                SamFile* in_bams = new SamFile[numBams];
+                SamFileHeader* in_headers = new SamFileHeader[numBams];
+                for(uint32_t i = 0; i < numBams; ++i)
+                {
+                    const char* fileName = inputs[first + i].c_str();
+                    if(!in_bams[i].OpenForRead(fileName))
+                    {
+                        Logger::gLogger->error("Cannot open BAM file %s for reading", fileName);
+                    }
+                    in_bams[i].setSortedValidation(SamFile::COORDINATE);
+                    in_bams[i].ReadHeader(in_headers[i]);
+                    if(firstLevel && myHasSection)
+                    {
+                        in_bams[i].ReadBamIndex();
+                    }
+                }
+                if(firstLevel)
+                {
+                    setSection(in_bams, numBams);
+                }
+
+                uint32_t firstIndex = firstLevel ? first : 0;
+                std::vector<ReadGroup>& groupReadGroups = 
+                    firstLevel ? readGroups : noReadGroups;
+                if(lastLevel)
+                {
+                    mergeRecords(in_bams, in_headers, numBams, firstIndex,
+                                 groupReadGroups, out, outHeader, true);
+                }
+                else
+                {
+                    // Merge this group into an uncompressed temporary BAM.
+                    std::stringstream tmpName;
+                    tmpName << tmpPrefix << ".merge" << level << "." 
+                            << outputs.size() << ".ubam";
+                    outputs.push_back(tmpName.str());
+
+                    ThreadedSamFile tmpOut;
+                    if(!tmpOut.OpenForWrite(outputs.back().c_str()))
+                    {
+                        Logger::gLogger->error("Cannot open BAM file %s for writing",
+                                               outputs.back().c_str());
+                    }
+                    tmpOut.setSortedValidation(SamFile::COORDINATE);
+                    tmpOut.WriteHeader(outHeader);
+                    mergeRecords(in_bams, in_headers, numBams, firstIndex,
+                                 groupReadGroups, tmpOut, outHeader, false);
+                    tmpOut.Close();
+                }
+
+                for(uint32_t i = 0; i < numBams; ++i)
+                {
+                    in_bams[i].Close();
+                }
+                delete[] in_bams;
+                delete[] in_headers;
+            }
+        }
+        catch(std::exception& e)
+        {
+            // Remove the temporary files of this level and the previous one.
+            for(uint32_t i = 0; i < outputs.size(); ++i)
+            {
+                remove(outputs[i].c_str());
+            }
+            for(uint32_t i = 0; !firstLevel && (i < inputs.size()); ++i)
+            {
+                remove(inputs[i].c_str());
+            }
+            throw;
+        }
+
+        if(!firstLevel)
+        {
+            // Remove the temporary files merged by this level.
+            for(uint32_t i = 0; i < inputs.size(); ++i)
+            {
+                remove(inputs[i].c_str());
+            }
+        }
+        if(lastLevel)
+        {
+            break;
+        }
+        inputs.swap(outputs);
+    }
+}
+
+
+void MergeBam::mergeSortedFiles(std::vector<std::string>& bamFiles,
+                                const std::string& tmpPrefix,
+                                uint32_t maxOpen, ThreadedSamFile& out,
+                                SamFileHeader& outHeader)
+{
+    // Without regions or read groups, so the files are merged as is.
+    MergeBam merger;
+    std::vector<ReadGroup> noReadGroups;
+    merger.mergeInGroups(bamFiles, noReadGroups, tmpPrefix,
+                         std::max(maxOpen, (uint32_t)2), out, outHeader);
+}
+
+
+uint32_t MergeBam::mergeByReference(std::vector<std::string>& bamFiles,
+                                    std::vector<ReadGroup>& readGroups,
+                                    const std::string& tmpPrefix,
+                                    ThreadedSamFile& out,
+                                    SamFileHeader& outHeader)
+{
+    // One section per reference followed by the unmapped reads, so the
+    // sections are in the order they are sorted in the output.
+    int numRefs = outHeader.getReferenceInfo().getNumEntries();
+    std::vector<std::string> partNames;
+    for(int i = 0; i <= numRefs; i++)
+    {
+        std::stringstream partName;
+        partName << tmpPrefix << ".part" << i << ".bgzf";
+        partNames.push_back(partName.str());
+    }
+    std::vector<uint32_t> partCounts(partNames.size(), 0);
 
-    if(done == true)
+    int numWorkers = BamExecutable::getNumThreads();
+    if(numWorkers > (int)partNames.size())
+    {
+        numWorkers = partNames.size();
+    }
+    Logger::gLogger->writeLog("Merging %d references on %d threads",
+                              numRefs, numWorkers);
+
+    // Each worker opens every input and merges the next reference that has
+    // not been started into its part file.
+    std::atomic<unsigned int> nextSection(0);
+    uint32_t n_bams = bamFiles.size();
+    std::vector< std::future<void> > workers;
+    for(int w = 0; w < numWorkers; w++)
+    {
+        workers.push_back(BamExecutable::getThreadPool().submit([&]()
+            {
+                SamFile* in_bams = new SamFile[n_bams];
+                SamFileHeader* in_headers = new SamFileHeader[n_bams];
+                try
+                {
+                    for(uint32_t i = 0; i < n_bams; ++i)
+                    {
+                        in_bams[i].OpenForRead(bamFiles[i].c_str(), &in_headers[i]);
+                        in_bams[i].ReadBamIndex();
+                    }
+                    unsigned int section;
+                    while((section = nextSection++) < partNames.size())
+                    {
+                        int refID = (section < (unsigned int)numRefs) ? section : -1;
+                        for(uint32_t i = 0; i < n_bams; ++i)
+                        {
+                            in_bams[i].SetReadSection(refID);
+                        }
+                        BamPartWriter partOut;
+                        if(!partOut.OpenForWrite(partNames[section].c_str()))
+                        {
+                            throw(std::runtime_error("Failed to open " + partNames[section] +
+                                                     " for writing"));
+                        }
+                        partCounts[section] = 
+                            mergeRecords(in_bams, in_headers, n_bams, 0, readGroups,
+                                         partOut, outHeader, false);
+                        if(!partOut.Close())
+                        {
+                            throw(std::runtime_error("Failed to write " + partNames[section]));
+                        }
+                    }
+                }
+                catch(...)
+                {
+                    delete[] in_bams;
+                    delete[] in_headers;
+                    throw;
+                }
+                delete[] in_bams;
+                delete[] in_headers;
+            }));
+    }
+    for(unsigned int i = 0; i < workers.size(); i++)
+    {
+        workers[i].wait();
+    }
+    try
+    {
+        for(unsigned int i = 0; i < workers.size(); i++)
+        {
+            workers[i].get();
+        }
+    }
+    catch(std::exception& e)
+    {
+        for(unsigned int i = 0; i < partNames.size(); i++)
+        {
+            remove(partNames[i].c_str());
+        }
+        throw;
+    }
+
+    // Concatenate the compressed parts in order.
+    uint32_t numRecords = 0;
+    bool appended = true;
+    for(unsigned int i = 0; i < partNames.size(); i++)
+    {
+        appended = appended && out.appendBamRecords(partNames[i].c_str());
+        remove(partNames[i].c_str());
+        numRecords += partCounts[i];
+    }
+    if(!appended)
+    {
+        Logger::gLogger->error("Failed to write the merged references to the output BAM file");
+    }
+    return(numRecords);
+}
+
+
+bool MergeBam::getNextSection()
+{
+    if(mySectionsDone == true)
     {
         return(false);
     }
@@ -805,10 +1235,10 @@ bool MergeBam::getNextSection(SamFile *in_bams, uint32_t numBams)
         // Not reading by section, so don't set a section, just return true.
         // Set the done flag so on the next call it will return false -
         //  done = false means nothing more to process.
-        done = true;
+        mySectionsDone = true;
+        myHasSection = false;
         return(true);
     }
-
     // Get the next region from the specified file/string
     String regionStr;
 
@@ -817,7 +1247,7 @@ bool MergeBam::getNextSection(SamFile *in_bams, uint32_t numBams)
         if(myRegionArrayIndex >= myRegionArray.Length())
         {
             // Done processing, so set done and return false - no more regions.
-            done = true;
+            mySectionsDone = true;
             return(false);
         }
         // Get the next region string, then increment the index
@@ -834,7 +1264,7 @@ bool MergeBam::getNextSection(SamFile *in_bams, uint32_t numBams)
             {
                 // done processing, so set done and return false
                 // no more regions.
-                done = true;
+                mySectionsDone = true;
                 return(false);
             }
             else
@@ -900,6 +1330,21 @@ bool MergeBam::getNextSection(SamFile *in_bams, uint32_t numBams)
         // SetReadSection expects.
     }
   
+    myHasSection = true;
+    mySectionChr = chr;
+    mySectionStart = start;
+    mySectionEnd = end;
+    return(true);
+}
+
+
+void MergeBam::setSection(SamFile *in_bams, uint32_t numBams)
+{
+    if(!myHasSection)
+    {
+        return;
+    }
+
     // Set the next section in every bam.
     for(uint32_t i = 0; i < numBams; ++i)
     {
@@ -907,7 +1352,6 @@ bool MergeBam::getNextSection(SamFile *in_bams, uint32_t numBams)
         // start is 1-based inclusive, so subtract 1 from start
         // SetReadSection end parameter is 0-based exclusive,
         // end is 1-based inclusive, which is the same as 0-based exclusive
-        in_bams[i].SetReadSection(chr.c_str(), start, end);
+        in_bams[i].SetReadSection(mySectionChr.c_str(), mySectionStart, mySectionEnd);
     }
-    return(true);
 }
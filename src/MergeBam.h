@@ -22,7 +22,12 @@
 #ifndef __MERGE_BAM_H__
 #define __MERGE_BAM_H__
 
+#include <string>
+#include <vector>
 #include "BamExecutable.h"
+#include "ThreadedSamFile.h"
+
+class ReadGroup;
 
 class MergeBam : public BamExecutable
 {
@@ -33,12 +38,54 @@ public:
     void printUsage(std::ostream& os);
     int execute(int argc, char **argv);
     virtual const char* getProgramName() {return("bam:mergeBam");}
+
+    /// Returns the key records are merged by, the reference id, the
+    /// position, and then the strand, with records that do not have a
+    /// reference id or position last.
+    static uint64_t getGenomicCoordinate(int32_t refID, int32_t pos,
+                                         uint16_t flag);
+
+    /// Merge the coordinate sorted BAM files into the output, whose
+    /// header has already been written, merging at most maxOpen (at
+    /// least 2) files at a time through temporary files starting with
+    /// tmpPrefix.  Records with the same key are written in file order.
+    static void mergeSortedFiles(std::vector<std::string>& bamFiles,
+                                 const std::string& tmpPrefix,
+                                 uint32_t maxOpen, ThreadedSamFile& out,
+                                 SamFileHeader& outHeader);
+
 private:
-    bool getNextSection(SamFile *in_bams, uint32_t numBams);
+    // Determine the next section to merge, returning false when there
+    // are no more sections.
+    bool getNextSection();
+    // Set the current section (if any) in the specified bams.
+    void setSection(SamFile *in_bams, uint32_t numBams);
+
+    // Merge the current section of more than maxOpen bams by merging
+    // groups of at most maxOpen files into temporary files, repeating
+    // until the remaining files can be merged into the output.
+    void mergeInGroups(std::vector<std::string>& bamFiles,
+                       std::vector<ReadGroup>& readGroups,
+                       const std::string& tmpPrefix, uint32_t maxOpen,
+                       ThreadedSamFile& out, SamFileHeader& outHeader);
+
+    // Merge each reference of the indexed bams on its own thread into a
+    // BGZF part file, and append the parts to the output, returning the
+    // number of records written.
+    uint32_t mergeByReference(std::vector<std::string>& bamFiles,
+                              std::vector<ReadGroup>& readGroups,
+                              const std::string& tmpPrefix,
+                              ThreadedSamFile& out, SamFileHeader& outHeader);
 
     StringArray myRegionArray;
     int32_t myRegionArrayIndex;
     IFILE myRegionFile;
+
+    bool mySectionsDone;
+    bool myHasSection;
+    String mySectionChr;
+    int mySectionStart;
+    int mySectionEnd;
 };
 
 #endif
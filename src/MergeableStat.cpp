@@ -0,0 +1,92 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include "MergeableStat.h"
+
+MergeableStat::MergeableStat()
+    : myNumValues(0),
+      myMean(0),
+      mySumSquares(0)
+{
+}
+
+
+void MergeableStat::clear()
+{
+    myNumValues = 0;
+    myMean = 0;
+    mySumSquares = 0;
+}
+
+
+void MergeableStat::push(double value)
+{
+    // Same update as RunningStat so single threaded results do not change.
+    ++myNumValues;
+    if(myNumValues == 1)
+    {
+        myMean = value;
+        mySumSquares = 0;
+    }
+    else
+    {
+        double prevMean = myMean;
+        myMean = prevMean + (value - prevMean) / myNumValues;
+        mySumSquares += (value - prevMean) * (value - myMean);
+    }
+}
+
+
+void MergeableStat::merge(const MergeableStat& other)
+{
+    if(other.myNumValues == 0)
+    {
+        return;
+    }
+    if(myNumValues == 0)
+    {
+        *this = other;
+        return;
+    }
+    // Combine the two sets of values (Chan et al.).
+    double numValues = (double)myNumValues + other.myNumValues;
+    double delta = other.myMean - myMean;
+    myMean += delta * other.myNumValues / numValues;
+    mySumSquares += other.mySumSquares + 
+        delta * delta * myNumValues * other.myNumValues / numValues;
+    myNumValues += other.myNumValues;
+}
+
+
+double MergeableStat::mean() const
+{
+    return((myNumValues > 0) ? myMean : 0.0);
+}
+
+
+double MergeableStat::variance() const
+{
+    return((myNumValues > 1) ? mySumSquares / (myNumValues - 1) : 0.0);
+}
+
+
+double MergeableStat::standardDeviation() const
+{
+    return(sqrt(variance()));
+}
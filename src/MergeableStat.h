@@ -0,0 +1,51 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MERGEABLE_STAT_H__
+#define __MERGEABLE_STAT_H__
+
+#include <stdint.h>
+
+/// Running mean/standard deviation like RunningStat, that can also be
+/// merged with the values pushed into another MergeableStat, so values
+/// can be collected on separate threads and then combined.
+class MergeableStat
+{
+public:
+    MergeableStat();
+
+    void clear();
+
+    /// Add a value.
+    void push(double value);
+
+    /// Add all of the values pushed into other.
+    void merge(const MergeableStat& other);
+
+    uint64_t numDataValues() const { return(myNumValues); }
+    double mean() const;
+    double variance() const;
+    double standardDeviation() const;
+
+private:
+    uint64_t myNumValues;
+    double myMean;
+    // Sum of the squared differences from the mean.
+    double mySumSquares;
+};
+
+#endif
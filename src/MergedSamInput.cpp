@@ -0,0 +1,224 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <iostream>
+#include <stdexcept>
+
+#include "MergedSamInput.h"
+
+MergedSamInput::MergedSamInput()
+    : myFiles(),
+      myHeader(NULL),
+      myStatus(SamStatus::SUCCESS)
+{
+}
+
+
+MergedSamInput::~MergedSamInput()
+{
+    Close();
+}
+
+
+bool MergedSamInput::open(const std::vector<std::string>& files,
+                          SamFileHeader& header)
+{
+    Close();
+    myHeader = &header;
+    myStatus = SamStatus::SUCCESS;
+    for(unsigned int i = 0; i < files.size(); i++)
+    {
+        Input input;
+        input.file = new ThreadedSamFile();
+        // The first file's header is read directly into the merged header.
+        input.header = (i == 0) ? NULL : new SamFileHeader();
+        input.record = new SamRecord();
+        input.buffer = NULL;
+        input.size = 0;
+        input.key = 0;
+        input.done = true;
+        input.name = files[i];
+        myFiles.push_back(input);
+
+        input.file->OpenForRead(files[i].c_str());
+        // If the file isn't sorted it will throw an exception.
+        input.file->setSortedValidation(SamFile::COORDINATE);
+        input.file->ReadHeader((i == 0) ? header : *input.header);
+    }
+
+    for(unsigned int i = 1; i < myFiles.size(); i++)
+    {
+        SamFileHeader& fileHeader = *myFiles[i].header;
+        if(header.getReferenceInfo() != fileHeader.getReferenceInfo())
+        {
+            std::cerr << "ERROR: " << myFiles[i].name
+                      << " does not have the same references as "
+                      << myFiles[0].name << std::endl;
+            return(false);
+        }
+        // Add the read groups and programs the merged header is missing.
+        std::string prevString;
+        std::string newString;
+        fileHeader.resetHeaderRecordIter();
+        SamHeaderRecord* rec = fileHeader.getNextHeaderRecord();
+        for(; rec != NULL; rec = fileHeader.getNextHeaderRecord())
+        {
+            SamHeaderRecord* prev = NULL;
+            if(rec->getType() == SamHeaderRecord::RG)
+            {
+                prev = header.getRG(rec->getTagValue("ID"));
+            }
+            else if(rec->getType() == SamHeaderRecord::PG)
+            {
+                prev = header.getPG(rec->getTagValue("ID"));
+            }
+            else
+            {
+                continue;
+            }
+            if(prev == NULL)
+            {
+                if(!header.addRecordCopy(*rec))
+                {
+                    std::cerr << "ERROR: Failed to add a header line of "
+                              << myFiles[i].name << ", "
+                              << header.getErrorMessage() << std::endl;
+                    return(false);
+                }
+                continue;
+            }
+            prevString.clear();
+            newString.clear();
+            prev->appendString(prevString);
+            rec->appendString(newString);
+            if((prevString != newString) &&
+               (rec->getType() == SamHeaderRecord::RG))
+            {
+                // The records would be assigned to the wrong read group.
+                std::cerr << "ERROR: " << myFiles[i].name
+                          << " has a different RG line with ID "
+                          << rec->getTagValue("ID") << std::endl;
+                return(false);
+            }
+            // Programs with the same ID are kept from the first file.
+        }
+        fileHeader.resetHeaderRecordIter();
+    }
+
+    if(myFiles.size() > 1)
+    {
+        // Read the first record of each file.
+        for(unsigned int i = 0; i < myFiles.size(); i++)
+        {
+            advance(i);
+        }
+    }
+    return(true);
+}
+
+
+bool MergedSamInput::ReadRecord(SamFileHeader& header, SamRecord& record)
+{
+    if(myFiles.size() == 1)
+    {
+        return(myFiles[0].file->ReadRecord(header, record));
+    }
+
+    // The inputs are usually few (lanes), so just find the first.
+    int first = -1;
+    for(unsigned int i = 0; i < myFiles.size(); i++)
+    {
+        if(!myFiles[i].done &&
+           ((first < 0) || (myFiles[i].key < myFiles[first].key)))
+        {
+            first = i;
+        }
+    }
+    if(first < 0)
+    {
+        if(myStatus == SamStatus::SUCCESS)
+        {
+            myStatus = SamStatus::NO_MORE_RECS;
+        }
+        return(false);
+    }
+    Input& input = myFiles[first];
+    if(record.setBuffer(input.buffer, input.size, header) !=
+       SamStatus::SUCCESS)
+    {
+        throw std::runtime_error("Failed to read a merged record from " +
+                                 input.name);
+    }
+    advance(first);
+    return(true);
+}
+
+
+SamStatus::Status MergedSamInput::GetStatus()
+{
+    if(myFiles.size() == 1)
+    {
+        return(myFiles[0].file->GetStatus());
+    }
+    return(myStatus);
+}
+
+
+void MergedSamInput::Close()
+{
+    for(unsigned int i = 0; i < myFiles.size(); i++)
+    {
+        myFiles[i].file->Close();
+        delete myFiles[i].file;
+        delete myFiles[i].header;
+        delete myFiles[i].record;
+    }
+    myFiles.clear();
+    myHeader = NULL;
+}
+
+
+void MergedSamInput::advance(unsigned int index)
+{
+    Input& input = myFiles[index];
+    bool firstRecord = input.done;
+    uint64_t prevKey = input.key;
+    input.done = false;
+    // The raw records are not checked by the file's sort validation.
+    if(!input.file->ReadRawRecord((index == 0) ? *myHeader : *input.header,
+                                  *input.record, input.buffer, input.size))
+    {
+        input.done = true;
+        SamStatus::Status status = input.file->GetStatus();
+        if((status != SamStatus::SUCCESS) &&
+           (status != SamStatus::NO_MORE_RECS))
+        {
+            myStatus = status;
+        }
+        return;
+    }
+    int32_t refID = 0;
+    int32_t pos = 0;
+    memcpy(&refID, input.buffer + 4, sizeof(refID));
+    memcpy(&pos, input.buffer + 8, sizeof(pos));
+    input.key = ((uint64_t)(uint32_t)refID << 32) | (uint32_t)pos;
+    if(!firstRecord && (input.key < prevKey))
+    {
+        throw std::runtime_error(input.name + " is not coordinate sorted");
+    }
+}
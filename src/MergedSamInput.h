@@ -0,0 +1,85 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MERGED_SAM_INPUT_H__
+#define __MERGED_SAM_INPUT_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "ThreadedSamFile.h"
+
+/// Reads several coordinate sorted files as one coordinate sorted stream,
+/// merging them on the fly, for example the per-lane files of a sample.
+/// Records at the same position are returned in the order of the files,
+/// so reading the files again returns the records in the same order.
+/// A single file is read as is through ThreadedSamFile.
+class MergedSamInput
+{
+public:
+    MergedSamInput();
+    ~MergedSamInput();
+
+    /// Open the files and read their headers into header: the first
+    /// file's header plus the RG and PG lines of the other files that it
+    /// does not have.  The files must have the same references and must
+    /// not have different RG lines with the same ID.  Returns false after
+    /// reporting the reason to stderr if they cannot be merged.
+    /// Throws if a file cannot be opened, like ThreadedSamFile.
+    bool open(const std::vector<std::string>& files, SamFileHeader& header);
+
+    /// Read the next record in coordinate order.  Returns false when
+    /// there are no more records (see GetStatus).  Throws
+    /// std::runtime_error if a file is not coordinate sorted.
+    bool ReadRecord(SamFileHeader& header, SamRecord& record);
+
+    SamStatus::Status GetStatus();
+
+    void Close();
+
+    unsigned int getNumFiles() const { return(myFiles.size()); }
+
+private:
+    MergedSamInput(const MergedSamInput&);
+    MergedSamInput& operator=(const MergedSamInput&);
+
+    // Read the next record of the file, setting its key, or done at the
+    // end of the file.
+    void advance(unsigned int index);
+
+    struct Input
+    {
+        ThreadedSamFile* file;
+        SamFileHeader* header;
+        SamRecord* record;
+        // BAM buffer of the next record, valid until the file is read again.
+        const char* buffer;
+        uint32_t size;
+        // Coordinate key of the next record (see ParallelRecordMap).
+        uint64_t key;
+        bool done;
+        std::string name;
+    };
+
+    std::vector<Input> myFiles;
+    // The merged header, which the first file was read with.
+    SamFileHeader* myHeader;
+    SamStatus::Status myStatus;
+};
+
+#endif
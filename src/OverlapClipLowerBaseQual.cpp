@@ -21,6 +21,7 @@
 #include "CigarHelper.h"
 #include "SamFlag.h"
 #include "SamFilter.h"
+#include "QualitySum.h"
 
 OverlapClipLowerBaseQual::OverlapClipLowerBaseQual()
     : OverlapHandler(),
@@ -322,36 +323,27 @@ double OverlapClipLowerBaseQual::getAvgQual(SamRecord& record,
                                             int32_t startPos, 
                                             int32_t endPos)
 {
-    int32_t qualSum = 0;
     const char* quality = record.getQuality();
-    int numVals = 0;
+    int32_t qualLen = strlen(quality);
 
     // Check for invalid start position.
-    if((startPos < 0) || ((uint32_t)startPos > strlen(quality)))
+    if((startPos < 0) || (startPos > qualLen))
     {
         // Invalid start position, just return 0.
         return(0);
     }
 
-    for(int i = startPos; i <= endPos; i++)
+    // Stop at the end of the quality string if it is shorter than the read.
+    if(endPos >= qualLen)
     {
-        // Check for the null terminator at the end of the quality string.
-        if(quality[i] == 0)
-        {
-            // Qual is shorter than the read, so break.
-            break;
-        }
-        qualSum += quality[i];
-        // increment the number of values.
-        ++numVals;
-    }
-    if(numVals != 0)
-    {
-        return(qualSum/(double)numVals);
+        endPos = qualLen - 1;
     }
-    else
+    int32_t numVals = endPos - startPos + 1;
+    if(numVals <= 0)
     {
         return(0);
     }
+
+    return(sumQualities(quality + startPos, numVals)/(double)numVals);
 }
 
@@ -43,8 +43,8 @@ public:
 
 private:
     // Calculate the average of the qualities at read positions starting at 
-    // startPos and ending with endPos (included).  Stops reading if a 0 is
-    // found, indicating the end of the string.
+    // startPos and ending with endPos (included).  endPos is limited to
+    // the length of the quality string.
     double getAvgQual(SamRecord& record, int32_t startPos, int32_t endPos);
 
 
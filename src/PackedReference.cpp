@@ -0,0 +1,399 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+
+#include "PackedReference.h"
+#include "BaseUtilities.h"
+
+// The shared memory segment is a sequence of 64-bit words:
+//   magic, 1 once it is packed, number of chromosomes, length in bytes,
+//   per chromosome: start, end, offset of its packed bases in bytes,
+// followed by the packed bases of each chromosome.
+static const char SHARED_MAGIC[8] = {'B', 'A', 'M', 'P', 'R', 'E', 'F', 1};
+static const uint64_t SHARED_HEADER_WORDS = 4;
+static const uint64_t SHARED_ENTRY_WORDS = 3;
+// How long to wait for a segment whose creator is not holding its lock
+// to be packed before treating it as left by a failed job.
+static const int SHARED_ATTACH_TRIES = 100;
+static const useconds_t SHARED_ATTACH_WAIT = 10000;
+
+PackedReference::PackedReference()
+    : myReference(NULL),
+      myDbSNP(NULL),
+      myKnownSites(NULL),
+      myChromosomes(),
+      myShared(NULL),
+      mySharedLen(0)
+{
+}
+
+
+PackedReference::~PackedReference()
+{
+    closeShared();
+}
+
+
+void PackedReference::setReference(GenomeSequence* reference,
+                                   mmapArrayBool_t* dbSNP,
+                                   const KnownSites* knownSites)
+{
+    myReference = reference;
+    myDbSNP = dbSNP;
+    myKnownSites = knownSites;
+    closeShared();
+}
+
+
+const PackedReference::Chromosome* PackedReference::getChromosome(const char* chromosomeName)
+{
+    if(myReference == NULL)
+    {
+        return(NULL);
+    }
+    int chromIndex = myReference->getChromosome(chromosomeName);
+    if((chromIndex < 0) || (chromIndex >= (int)myChromosomes.size()))
+    {
+        return(NULL);
+    }
+    if(myChromosomes[chromIndex])
+    {
+        // Already packed or shared.
+        return(myChromosomes[chromIndex].get());
+    }
+
+    Chromosome* chrom = new Chromosome;
+    myChromosomes[chromIndex].reset(chrom);
+    chrom->myStart = myReference->getChromosomeStart(chromIndex);
+    chrom->myEnd = chrom->myStart + myReference->getChromosomeSize(chromIndex);
+    chrom->myData.assign(((chrom->myEnd - chrom->myStart) + 1) >> 1, 0);
+    chrom->myPacked = chrom->myData.data();
+    chrom->mySize = chrom->myData.size();
+    pack(chromIndex, chrom->myData.data());
+    return(chrom);
+}
+
+
+bool PackedReference::attachShared(const char* refFile, const char* dbsnpFile)
+{
+    if(myReference == NULL)
+    {
+        return(false);
+    }
+    std::string name = getSharedName(refFile, dbsnpFile);
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if(fd < 0)
+    {
+        return(false);
+    }
+
+    // The creator holds an exclusive lock until it is done packing.
+    void* map = NULL;
+    uint64_t mapLen = 0;
+    bool ready = false;
+    for(int tries = 0; !ready && (tries < SHARED_ATTACH_TRIES); tries++)
+    {
+        if(tries != 0)
+        {
+            // The creator may not have locked it yet.
+            usleep(SHARED_ATTACH_WAIT);
+        }
+        if(flock(fd, LOCK_SH) != 0)
+        {
+            break;
+        }
+        struct stat fileStat;
+        if((map == NULL) && (fstat(fd, &fileStat) == 0) &&
+           (fileStat.st_size >= 
+            (off_t)(SHARED_HEADER_WORDS * sizeof(uint64_t))))
+        {
+            mapLen = fileStat.st_size;
+            map = mmap(NULL, mapLen, PROT_READ, MAP_SHARED, fd, 0);
+            if(map == MAP_FAILED)
+            {
+                map = NULL;
+            }
+        }
+        ready = (map != NULL) &&
+            (__atomic_load_n((const uint64_t*)map + 1, __ATOMIC_ACQUIRE) == 1);
+        flock(fd, LOCK_UN);
+    }
+    // The mapping keeps the segment open.
+    close(fd);
+
+    if(!ready)
+    {
+        if(map != NULL)
+        {
+            munmap(map, mapLen);
+        }
+        std::cerr << "WARNING: Removing the shared reference " << name
+                  << " that was not finished.\n";
+        shm_unlink(name.c_str());
+        return(false);
+    }
+    if(!useShared(map, mapLen))
+    {
+        std::cerr << "WARNING: The shared reference " << name
+                  << " does not match " << refFile << ".\n";
+        return(false);
+    }
+    return(true);
+}
+
+
+bool PackedReference::openShared(const char* refFile, const char* dbsnpFile)
+{
+    if(myReference == NULL)
+    {
+        return(false);
+    }
+    if(attachShared(refFile, dbsnpFile))
+    {
+        return(true);
+    }
+    std::string name = getSharedName(refFile, dbsnpFile);
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if(fd < 0)
+    {
+        // Another job may have just created it.
+        if((errno == EEXIST) && attachShared(refFile, dbsnpFile))
+        {
+            return(true);
+        }
+        std::cerr << "ERROR: Failed to create the shared reference "
+                  << name << ".\n";
+        return(false);
+    }
+    // Hold the lock while packing so other jobs wait for it.
+    flock(fd, LOCK_EX);
+
+    // Lay out the chromosomes, each starting on a new word.
+    uint64_t numChroms = myReference->getChromosomeCount();
+    std::vector<uint64_t> offsets(numChroms);
+    uint64_t mapLen = (SHARED_HEADER_WORDS + numChroms * SHARED_ENTRY_WORDS) *
+        sizeof(uint64_t);
+    for(uint64_t i = 0; i < numChroms; i++)
+    {
+        offsets[i] = mapLen;
+        uint64_t size = ((uint64_t)myReference->getChromosomeSize(i) + 1) >> 1;
+        mapLen += (size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+    }
+    void* map = MAP_FAILED;
+    if(ftruncate(fd, mapLen) == 0)
+    {
+        // The new segment is zeroed.
+        map = mmap(NULL, mapLen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if(map == MAP_FAILED)
+    {
+        std::cerr << "ERROR: Failed to allocate the shared reference "
+                  << name << ".\n";
+        shm_unlink(name.c_str());
+        close(fd);
+        return(false);
+    }
+
+    uint64_t* words = (uint64_t*)map;
+    memcpy(words, SHARED_MAGIC, sizeof(SHARED_MAGIC));
+    words[2] = numChroms;
+    words[3] = mapLen;
+    for(uint64_t i = 0; i < numChroms; i++)
+    {
+        uint64_t* entry = words + SHARED_HEADER_WORDS + i * SHARED_ENTRY_WORDS;
+        entry[0] = myReference->getChromosomeStart(i);
+        entry[1] = entry[0] + myReference->getChromosomeSize(i);
+        entry[2] = offsets[i];
+        pack(i, (uint8_t*)map + offsets[i]);
+    }
+    __atomic_store_n(words + 1, (uint64_t)1, __ATOMIC_RELEASE);
+    flock(fd, LOCK_UN);
+    close(fd);
+
+    mprotect(map, mapLen, PROT_READ);
+    return(useShared(map, mapLen));
+}
+
+
+uint8_t PackedReference::getShared(genomeIndex_t pos) const
+{
+    if(myShared == NULL)
+    {
+        return(OUTSIDE);
+    }
+    int chromIndex = myReference->getChromosome(pos);
+    if((chromIndex < 0) || (chromIndex >= (int)myChromosomes.size()))
+    {
+        return(OUTSIDE);
+    }
+    return(myChromosomes[chromIndex]->get(pos));
+}
+
+
+std::string PackedReference::getSharedName(const char* refFile,
+                                           const char* dbsnpFile)
+{
+    // FNV-1a hash of the files' paths, sizes, and modification times.
+    uint64_t hash = 14695981039346656037ULL;
+    const char* files[2] = {refFile, dbsnpFile};
+    for(int i = 0; i < 2; i++)
+    {
+        std::string key = (files[i] == NULL) ? "" : files[i];
+        char path[PATH_MAX];
+        struct stat fileStat;
+        if(!key.empty() && (realpath(files[i], path) != NULL))
+        {
+            key = path;
+        }
+        if(!key.empty() && (stat(key.c_str(), &fileStat) == 0))
+        {
+            key += ":" + std::to_string((long long)fileStat.st_size) +
+                ":" + std::to_string((long long)fileStat.st_mtime);
+        }
+        key += '\0';
+        for(size_t j = 0; j < key.size(); j++)
+        {
+            hash ^= (unsigned char)key[j];
+            hash *= 1099511628211ULL;
+        }
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "/bamUtil.packedRef.%016llx",
+             (unsigned long long)hash);
+    return(name);
+}
+
+
+void PackedReference::pack(int chromIndex, uint8_t* packed)
+{
+    genomeIndex_t start = myReference->getChromosomeStart(chromIndex);
+    genomeIndex_t end = start + myReference->getChromosomeSize(chromIndex);
+
+    // Read the reference and dbSNP in order, so each is a sequential pass.
+    for(genomeIndex_t pos = start; pos < end; pos++)
+    {
+        char base = (*myReference)[pos];
+        uint8_t value;
+        switch(base)
+        {
+            case 'A':
+                value = 0;
+                break;
+            case 'C':
+                value = 1;
+                break;
+            case 'G':
+                value = 2;
+                break;
+            case 'T':
+                value = 3;
+                break;
+            default:
+                if(BaseUtilities::isAmbiguous(base))
+                {
+                    value = AMBIGUOUS;
+                }
+                else
+                {
+                    value = OTHER_BASE;
+                }
+                break;
+        }
+        uint32_t offset = pos - start;
+        if((myDbSNP != NULL) && (*myDbSNP)[pos])
+        {
+            value |= DBSNP;
+        }
+        // Known site positions are 1-based.
+        else if((myKnownSites != NULL) && 
+                myKnownSites->hasPosition(chromIndex, offset + 1))
+        {
+            value |= DBSNP;
+        }
+        packed[offset >> 1] |= (value << ((offset & 1) << 2));
+    }
+}
+
+
+bool PackedReference::useShared(void* map, uint64_t mapLen)
+{
+    const uint64_t* words = (const uint64_t*)map;
+    uint64_t numChroms = words[2];
+    bool valid = (memcmp(words, SHARED_MAGIC, sizeof(SHARED_MAGIC)) == 0) &&
+        (words[3] == mapLen) &&
+        (numChroms == (uint64_t)myReference->getChromosomeCount()) &&
+        (numChroms <= (mapLen / sizeof(uint64_t) - SHARED_HEADER_WORDS) /
+         SHARED_ENTRY_WORDS);
+    std::vector<std::unique_ptr<Chromosome> > chromosomes;
+    for(uint64_t i = 0; valid && (i < numChroms); i++)
+    {
+        const uint64_t* entry = 
+            words + SHARED_HEADER_WORDS + i * SHARED_ENTRY_WORDS;
+        genomeIndex_t start = myReference->getChromosomeStart(i);
+        genomeIndex_t end = start + myReference->getChromosomeSize(i);
+        uint64_t size = ((uint64_t)(end - start) + 1) >> 1;
+        if((entry[0] != start) || (entry[1] != end) ||
+           (entry[2] > mapLen) || (size > mapLen - entry[2]))
+        {
+            valid = false;
+            break;
+        }
+        Chromosome* chrom = new Chromosome;
+        chromosomes.push_back(std::unique_ptr<Chromosome>(chrom));
+        chrom->myStart = start;
+        chrom->myEnd = end;
+        chrom->myPacked = (const uint8_t*)map + entry[2];
+        chrom->mySize = size;
+    }
+    if(!valid)
+    {
+        munmap(map, mapLen);
+        return(false);
+    }
+    closeShared();
+    myChromosomes.swap(chromosomes);
+    myShared = map;
+    mySharedLen = mapLen;
+    return(true);
+}
+
+
+void PackedReference::closeShared()
+{
+    myChromosomes.clear();
+    if(myReference != NULL)
+    {
+        myChromosomes.resize(myReference->getChromosomeCount());
+    }
+    if(myShared != NULL)
+    {
+        munmap(myShared, mySharedLen);
+    }
+    myShared = NULL;
+    mySharedLen = 0;
+}
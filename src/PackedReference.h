@@ -0,0 +1,155 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PACKED_REFERENCE_H__
+#define __PACKED_REFERENCE_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include "GenomeSequence.h"
+#include "MemoryMapArray.h"
+#include "KnownSites.h"
+
+/// Reference bases and dbSNP sites packed into 4 bits per position, so
+/// building a recalibration table reads one small array rather than
+/// making random accesses into both the GenomeSequence and the dbSNP
+/// memory maps.  Each chromosome is packed in one sequential pass the
+/// first time it is requested.
+/// Alternatively the whole reference can be packed once into a named
+/// shared memory segment (see openShared) that later jobs on the node
+/// attach to read-only, so they neither pack the reference nor load dbSNP.
+class PackedReference
+{
+public:
+    /// Low 3 bits of a position: 0-3 for A, C, G, T, or one of these.
+    static const uint8_t AMBIGUOUS = 4;
+    /// Not ACGT or ambiguous, so the GenomeSequence must be checked.
+    static const uint8_t OTHER_BASE = 5;
+    static const uint8_t BASE_MASK = 0x7;
+    /// Set if the position is in dbSNP.
+    static const uint8_t DBSNP = 0x8;
+    /// Returned for positions outside of the chromosome.
+    static const uint8_t OUTSIDE = 0xFF;
+
+    class Chromosome
+    {
+    public:
+        /// Returns the packed value for the genome index, or OUTSIDE.
+        inline uint8_t get(genomeIndex_t pos) const
+        {
+            if((pos < myStart) || (pos >= myEnd))
+            {
+                return(OUTSIDE);
+            }
+            uint32_t offset = pos - myStart;
+            return((myPacked[offset >> 1] >> ((offset & 1) << 2)) & 0xF);
+        }
+
+        /// Prefetch the positions a read starting at pos may touch.
+        inline void prefetch(genomeIndex_t pos, int32_t length) const
+        {
+            if((pos < myStart) || (pos >= myEnd))
+            {
+                return;
+            }
+            uint32_t start = (pos - myStart) >> 1;
+            uint32_t end = std::min((uint64_t)(pos - myStart + length) >> 1,
+                                    (uint64_t)mySize - 1);
+            for(uint32_t i = start; i <= end; i += CACHE_LINE_SIZE)
+            {
+                __builtin_prefetch(&(myPacked[i]));
+            }
+            __builtin_prefetch(&(myPacked[end]));
+        }
+
+    private:
+        friend class PackedReference;
+        static const uint32_t CACHE_LINE_SIZE = 64;
+
+        genomeIndex_t myStart;
+        genomeIndex_t myEnd;
+        // Points into myData or the shared memory segment.
+        const uint8_t* myPacked;
+        uint32_t mySize;
+        std::vector<uint8_t> myData;
+    };
+
+    PackedReference();
+    ~PackedReference();
+
+    /// Set the reference to pack and the dbSNP sites (NULL if none),
+    /// either genome indexed or as known sites mapped to the reference.
+    void setReference(GenomeSequence* reference, mmapArrayBool_t* dbSNP,
+                      const KnownSites* knownSites = NULL);
+
+    /// Returns the named chromosome, packing it if this is the first
+    /// request for it, or NULL if it is not in the reference.
+    const Chromosome* getChromosome(const char* chromosomeName);
+
+    /// Attach to the shared memory segment of the reference and dbSNP
+    /// files if another job already packed them, waiting for it to
+    /// finish packing.  setReference must already have been called, but
+    /// dbSNP need not be loaded.  Returns false if there is no such
+    /// segment.
+    bool attachShared(const char* refFile, const char* dbsnpFile);
+
+    /// Pack the whole reference into the shared memory segment of the
+    /// reference and dbSNP files, or attach to it if another job created
+    /// it first.  Returns false after printing the reason to stderr if
+    /// shared memory cannot be used, leaving chromosomes to be packed
+    /// privately.  The segment stays until it is removed from /dev/shm
+    /// (or the node restarts).
+    bool openShared(const char* refFile, const char* dbsnpFile);
+
+    bool isShared() const { return(myShared != NULL); }
+
+    /// Returns the packed value for the genome index of a shared
+    /// reference, or OUTSIDE if it is not shared.
+    uint8_t getShared(genomeIndex_t pos) const;
+
+    /// The name of the shared memory segment of the reference and dbSNP
+    /// (empty if none) files, which depends on their paths, sizes, and
+    /// modification times, so changed files get a new segment.
+    static std::string getSharedName(const char* refFile,
+                                     const char* dbsnpFile);
+
+private:
+    PackedReference(const PackedReference&);
+    PackedReference& operator=(const PackedReference&);
+
+    // Pack the chromosome into packed, which must be zeroed.
+    void pack(int chromIndex, uint8_t* packed);
+
+    // Use the mapped segment for the chromosomes if it matches the
+    // reference, otherwise unmap it and return false.
+    bool useShared(void* map, uint64_t mapLen);
+    void closeShared();
+
+    GenomeSequence* myReference;
+    mmapArrayBool_t* myDbSNP;
+    const KnownSites* myKnownSites;
+    std::vector<std::unique_ptr<Chromosome> > myChromosomes;
+
+    // The mapped shared memory segment, NULL if not shared.
+    void* myShared;
+    uint64_t mySharedLen;
+};
+
+#endif
@@ -0,0 +1,837 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdexcept>
+#include <string>
+#include <zlib.h>
+
+#include "ParallelBgzf.h"
+#include "Profile.h"
+
+const uint32_t ParallelBgzf::MAX_BLOCK_DATA_SIZE = 0x10000;
+const uint32_t ParallelBgzf::BLOCK_HEADER_SIZE = 18;
+const uint32_t ParallelBgzf::BLOCK_FOOTER_SIZE = 8;
+const uint32_t ParallelBgzf::MAX_BLOCK_SIZE = 0x10000;
+
+const unsigned char ParallelBgzf::EOF_MARKER[] =
+{
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff,
+    0x06, 0x00, 0x42, 0x43, 0x02, 0x00, 0x1b, 0x00, 0x03, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+const uint32_t ParallelBgzf::EOF_MARKER_SIZE = 28;
+
+// Fixed portion of the gzip header written on every block, followed by
+// the 2 byte block size.
+static const unsigned char BLOCK_HEADER[] =
+{
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff,
+    0x06, 0x00, 0x42, 0x43, 0x02, 0x00
+};
+
+// Windows bits for raw deflate data (no zlib/gzip wrapper).
+static const int RAW_DEFLATE_WINDOW_BITS = -15;
+static const int DEFAULT_MEM_LEVEL = 8;
+
+
+static inline uint32_t readLittleEndian16(const unsigned char* ptr)
+{
+    return(ptr[0] | (ptr[1] << 8));
+}
+
+
+static inline uint32_t readLittleEndian32(const unsigned char* ptr)
+{
+    return(ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((uint32_t)ptr[3] << 24));
+}
+
+
+static inline void writeLittleEndian16(unsigned char* ptr, uint32_t value)
+{
+    ptr[0] = value & 0xFF;
+    ptr[1] = (value >> 8) & 0xFF;
+}
+
+
+static inline void writeLittleEndian32(unsigned char* ptr, uint32_t value)
+{
+    ptr[0] = value & 0xFF;
+    ptr[1] = (value >> 8) & 0xFF;
+    ptr[2] = (value >> 16) & 0xFF;
+    ptr[3] = (value >> 24) & 0xFF;
+}
+
+
+// Returns true if the specified 12 bytes are the start of a gzip
+// member with the extra field set.
+static inline bool isBgzfMagic(const unsigned char* header)
+{
+    return((header[0] == 0x1f) && (header[1] == 0x8b) &&
+           (header[2] == 0x08) && ((header[3] & 0x04) != 0));
+}
+
+
+bool ParallelBgzf::isBgzfWithEof(const char* filename)
+{
+    if((filename == NULL) || (strcmp(filename, "-") == 0))
+    {
+        return(false);
+    }
+    FILE* filePtr = fopen(filename, "rb");
+    if(filePtr == NULL)
+    {
+        return(false);
+    }
+
+    bool result = false;
+    unsigned char buffer[EOF_MARKER_SIZE];
+    if((fread(buffer, 1, 12, filePtr) == 12) && isBgzfMagic(buffer) &&
+       (fseek(filePtr, -(long)EOF_MARKER_SIZE, SEEK_END) == 0) &&
+       (fread(buffer, 1, EOF_MARKER_SIZE, filePtr) == EOF_MARKER_SIZE))
+    {
+        result = (memcmp(buffer, EOF_MARKER, EOF_MARKER_SIZE) == 0);
+    }
+    fclose(filePtr);
+    return(result);
+}
+
+
+ParallelBgzf::BufferPtr ParallelBgzf::inflateBlock(BufferPtr block)
+{
+    static Profile::Stage& stage = Profile::getStage("ParallelBgzf::inflateBlock");
+    Profile::Timer timer(stage);
+    const unsigned char* blockPtr = (const unsigned char*)&((*block)[0]);
+    uint32_t blockSize = block->size();
+    uint32_t dataStart = 12 + readLittleEndian16(blockPtr + 10);
+    if(blockSize < dataStart + BLOCK_FOOTER_SIZE)
+    {
+        throw(std::runtime_error("Invalid BGZF block size."));
+    }
+    uint32_t compressedSize = blockSize - dataStart - BLOCK_FOOTER_SIZE;
+    uint32_t expectedCrc =
+        readLittleEndian32(blockPtr + blockSize - BLOCK_FOOTER_SIZE);
+    uint32_t dataSize = readLittleEndian32(blockPtr + blockSize - 4);
+    if(dataSize > MAX_BLOCK_DATA_SIZE)
+    {
+        throw(std::runtime_error("Invalid BGZF block, uncompressed size is too large."));
+    }
+
+    BufferPtr data = std::make_shared<Buffer>(dataSize);
+    if(dataSize == 0)
+    {
+        return(data);
+    }
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if(inflateInit2(&zs, RAW_DEFLATE_WINDOW_BITS) != Z_OK)
+    {
+        throw(std::runtime_error("Failed to initialize BGZF block decompression."));
+    }
+    zs.next_in = (Bytef*)(blockPtr + dataStart);
+    zs.avail_in = compressedSize;
+    zs.next_out = (Bytef*)&((*data)[0]);
+    zs.avail_out = dataSize;
+    int status = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    if((status != Z_STREAM_END) || (zs.avail_out != 0))
+    {
+        throw(std::runtime_error("Failed to decompress BGZF block."));
+    }
+    if(crc32(crc32(0L, Z_NULL, 0), (const Bytef*)&((*data)[0]), dataSize)
+       != expectedCrc)
+    {
+        throw(std::runtime_error("BGZF block CRC check failed."));
+    }
+    return(data);
+}
+
+
+ParallelBgzf::BufferPtr ParallelBgzf::deflateBlock(BufferPtr data, int level)
+{
+    static Profile::Stage& stage = Profile::getStage("ParallelBgzf::deflateBlock");
+    Profile::Timer timer(stage);
+    BufferPtr blocks = std::make_shared<Buffer>();
+    const unsigned char* dataPtr = (const unsigned char*)&((*data)[0]);
+    uint32_t remaining = data->size();
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if(deflateInit2(&zs, level, Z_DEFLATED, RAW_DEFLATE_WINDOW_BITS,
+                    DEFAULT_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        throw(std::runtime_error("Failed to initialize BGZF block compression."));
+    }
+
+    unsigned char block[MAX_BLOCK_SIZE];
+    while(remaining > 0)
+    {
+        uint32_t inputSize = remaining;
+        if(inputSize > MAX_BLOCK_DATA_SIZE)
+        {
+            inputSize = MAX_BLOCK_DATA_SIZE;
+        }
+
+        // Like the serial bgzf writer, drop 1024 bytes at a time until
+        // the compressed data fits in a single block.
+        while(true)
+        {
+            deflateReset(&zs);
+            zs.next_in = (Bytef*)dataPtr;
+            zs.avail_in = inputSize;
+            zs.next_out = block + BLOCK_HEADER_SIZE;
+            zs.avail_out = MAX_BLOCK_SIZE - BLOCK_HEADER_SIZE - BLOCK_FOOTER_SIZE;
+            int status = deflate(&zs, Z_FINISH);
+            if(status == Z_STREAM_END)
+            {
+                break;
+            }
+            if((status != Z_OK) || (inputSize <= 1024))
+            {
+                deflateEnd(&zs);
+                throw(std::runtime_error("Failed to compress BGZF block."));
+            }
+            inputSize -= 1024;
+        }
+
+        uint32_t blockSize = BLOCK_HEADER_SIZE + zs.total_out + BLOCK_FOOTER_SIZE;
+        memcpy(block, BLOCK_HEADER, sizeof(BLOCK_HEADER));
+        writeLittleEndian16(block + 16, blockSize - 1);
+        writeLittleEndian32(block + blockSize - BLOCK_FOOTER_SIZE,
+                            crc32(crc32(0L, Z_NULL, 0), dataPtr, inputSize));
+        writeLittleEndian32(block + blockSize - 4, inputSize);
+        blocks->insert(blocks->end(), block, block + blockSize);
+
+        dataPtr += inputSize;
+        remaining -= inputSize;
+    }
+    deflateEnd(&zs);
+    return(blocks);
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// ParallelBgzfReader
+
+ParallelBgzfReader::ParallelBgzfReader()
+    : myPool(NULL),
+      myMaxInFlight(1),
+      myFile(NULL),
+      myIsStdin(false),
+      myFileDone(false),
+      myLastBlockEmpty(false),
+      myPending(),
+      myPendingOffsets(),
+      myCurrent(),
+      myCurrentPos(0),
+      myCurrentOffset(0),
+      myNextOffset(0)
+{
+}
+
+
+ParallelBgzfReader::~ParallelBgzfReader()
+{
+    close();
+}
+
+
+bool ParallelBgzfReader::open(const char* filename, ThreadPool& pool,
+                              int maxInFlight)
+{
+    close();
+    myPool = &pool;
+    myMaxInFlight = (maxInFlight < 1) ? 1 : maxInFlight;
+    return(openFile(filename));
+}
+
+
+bool ParallelBgzfReader::open(const char* filename)
+{
+    close();
+    myPool = NULL;
+    myMaxInFlight = 1;
+    return(openFile(filename));
+}
+
+
+bool ParallelBgzfReader::openFile(const char* filename)
+{
+    if(strcmp(filename, "-") == 0)
+    {
+        myFile = stdin;
+        myIsStdin = true;
+    }
+    else
+    {
+        myFile = fopen(filename, "rb");
+        myIsStdin = false;
+    }
+    if(myFile == NULL)
+    {
+        return(false);
+    }
+
+    // Verify the first block is BGZF.
+    int firstChar = getc(myFile);
+    if(firstChar == EOF)
+    {
+        // Empty file.
+        myFileDone = true;
+        return(true);
+    }
+    if((firstChar != 0x1f) || (ungetc(firstChar, myFile) == EOF))
+    {
+        close();
+        return(false);
+    }
+    fillQueue();
+    return(true);
+}
+
+
+void ParallelBgzfReader::close()
+{
+    // Wait for any outstanding blocks so the pool no longer references
+    // their buffers.
+    while(!myPending.empty())
+    {
+        myPending.front().wait();
+        myPending.pop_front();
+    }
+    myPendingOffsets.clear();
+    if((myFile != NULL) && !myIsStdin)
+    {
+        fclose(myFile);
+    }
+    myFile = NULL;
+    myIsStdin = false;
+    myFileDone = false;
+    myLastBlockEmpty = false;
+    myCurrent.reset();
+    myCurrentPos = 0;
+    myCurrentOffset = 0;
+    myNextOffset = 0;
+}
+
+
+uint32_t ParallelBgzfReader::read(void* buffer, uint32_t len)
+{
+    char* outPtr = (char*)buffer;
+    uint32_t numRead = 0;
+    while(numRead < len)
+    {
+        if(!myCurrent || (myCurrentPos >= myCurrent->size()))
+        {
+            if(!nextBlock())
+            {
+                break;
+            }
+        }
+        uint32_t copyLen = myCurrent->size() - myCurrentPos;
+        if(copyLen > (len - numRead))
+        {
+            copyLen = len - numRead;
+        }
+        memcpy(outPtr + numRead, &((*myCurrent)[myCurrentPos]), copyLen);
+        myCurrentPos += copyLen;
+        numRead += copyLen;
+    }
+    return(numRead);
+}
+
+
+uint32_t ParallelBgzfReader::skip(uint32_t len)
+{
+    uint32_t numSkipped = 0;
+    while(numSkipped < len)
+    {
+        if(!myCurrent || (myCurrentPos >= myCurrent->size()))
+        {
+            if(!nextBlock())
+            {
+                break;
+            }
+        }
+        uint32_t skipLen = myCurrent->size() - myCurrentPos;
+        if(skipLen > (len - numSkipped))
+        {
+            skipLen = len - numSkipped;
+        }
+        myCurrentPos += skipLen;
+        numSkipped += skipLen;
+    }
+    return(numSkipped);
+}
+
+
+bool ParallelBgzfReader::isEOF()
+{
+    if(myCurrent && (myCurrentPos < myCurrent->size()))
+    {
+        return(false);
+    }
+    return(!nextBlock());
+}
+
+
+uint64_t ParallelBgzfReader::tell()
+{
+    if(myCurrent && (myCurrentPos < myCurrent->size()))
+    {
+        return((myCurrentOffset << 16) | myCurrentPos);
+    }
+    // The current block has been read, so the next byte is at the
+    // start of the next block.
+    if(!myPendingOffsets.empty())
+    {
+        return(myPendingOffsets.front() << 16);
+    }
+    return(myNextOffset << 16);
+}
+
+
+uint32_t ParallelBgzfReader::readRestOfBlock(std::vector<char>& buffer)
+{
+    if(!myCurrent || (myCurrentPos >= myCurrent->size()))
+    {
+        return(0);
+    }
+    uint32_t restLen = myCurrent->size() - myCurrentPos;
+    buffer.insert(buffer.end(), myCurrent->begin() + myCurrentPos,
+                  myCurrent->end());
+    myCurrentPos = myCurrent->size();
+    return(restLen);
+}
+
+
+bool ParallelBgzfReader::seek(uint64_t virtualOffset)
+{
+    if((myFile == NULL) || myIsStdin)
+    {
+        return(false);
+    }
+    uint64_t blockOffset = virtualOffset >> 16;
+    uint32_t dataOffset = virtualOffset & 0xFFFF;
+
+    if(!myCurrent || (myCurrentOffset != blockOffset))
+    {
+        // Discard the blocks read ahead from the old position.
+        while(!myPending.empty())
+        {
+            myPending.front().wait();
+            myPending.pop_front();
+        }
+        myPendingOffsets.clear();
+        myCurrent.reset();
+        if(fseeko(myFile, blockOffset, SEEK_SET) != 0)
+        {
+            return(false);
+        }
+        myNextOffset = blockOffset;
+        myFileDone = false;
+        if(!nextBlock())
+        {
+            // At the end of the file, which is only valid at the
+            // start of a block.
+            return(dataOffset == 0);
+        }
+        if((myCurrentOffset != blockOffset) && (dataOffset != 0))
+        {
+            // The block at the offset was empty.
+            return(false);
+        }
+    }
+    if(dataOffset > myCurrent->size())
+    {
+        return(false);
+    }
+    myCurrentPos = dataOffset;
+    return(true);
+}
+
+
+ParallelBgzf::BufferPtr ParallelBgzfReader::readCompressedBlock()
+{
+    if(myFileDone || (myFile == NULL))
+    {
+        return(ParallelBgzf::BufferPtr());
+    }
+
+    unsigned char header[12];
+    size_t headerRead = fread(header, 1, sizeof(header), myFile);
+    if(headerRead == 0)
+    {
+        myFileDone = true;
+        return(ParallelBgzf::BufferPtr());
+    }
+    if((headerRead != sizeof(header)) || !isBgzfMagic(header))
+    {
+        throw(std::runtime_error("Invalid BGZF block header."));
+    }
+
+    // Find the BC subfield containing the block size.
+    uint32_t extraLen = readLittleEndian16(header + 10);
+    std::vector<unsigned char> extra(extraLen);
+    if((extraLen == 0) ||
+       (fread(&(extra[0]), 1, extraLen, myFile) != extraLen))
+    {
+        throw(std::runtime_error("Truncated BGZF block header."));
+    }
+    uint32_t blockSize = 0;
+    for(uint32_t pos = 0; pos + 4 <= extraLen;)
+    {
+        uint32_t subLen = readLittleEndian16(&(extra[pos + 2]));
+        if((extra[pos] == 'B') && (extra[pos + 1] == 'C') && (subLen == 2) &&
+           (pos + 6 <= extraLen))
+        {
+            blockSize = readLittleEndian16(&(extra[pos + 4])) + 1;
+            break;
+        }
+        pos += 4 + subLen;
+    }
+    if(blockSize < 12 + extraLen + 8)
+    {
+        throw(std::runtime_error("Invalid BGZF block, missing the block size."));
+    }
+
+    ParallelBgzf::BufferPtr block =
+        std::make_shared<ParallelBgzf::Buffer>(blockSize);
+    memcpy(&((*block)[0]), header, sizeof(header));
+    memcpy(&((*block)[sizeof(header)]), &(extra[0]), extraLen);
+    uint32_t remaining = blockSize - sizeof(header) - extraLen;
+    if(fread(&((*block)[sizeof(header) + extraLen]), 1, remaining, myFile)
+       != remaining)
+    {
+        throw(std::runtime_error("Truncated BGZF block."));
+    }
+    myNextOffset += blockSize;
+    return(block);
+}
+
+
+void ParallelBgzfReader::fillQueue()
+{
+    while(myPending.size() < myMaxInFlight)
+    {
+        ParallelBgzf::BufferPtr block = readCompressedBlock();
+        if(!block)
+        {
+            return;
+        }
+        myPendingOffsets.push_back(myNextOffset - block->size());
+        if(myPool == NULL)
+        {
+            // Not using the pool, so inflate the block when it is needed.
+            myPending.push_back(std::async(std::launch::deferred,
+                                           &ParallelBgzf::inflateBlock, block));
+        }
+        else
+        {
+            myPending.push_back(myPool->submit(std::bind(&ParallelBgzf::inflateBlock,
+                                                        block)));
+        }
+    }
+}
+
+
+bool ParallelBgzfReader::nextBlock()
+{
+    while(true)
+    {
+        fillQueue();
+        if(myPending.empty())
+        {
+            myCurrent.reset();
+            myCurrentPos = 0;
+            return(false);
+        }
+        myCurrent = myPending.front().get();
+        myPending.pop_front();
+        myCurrentOffset = myPendingOffsets.front();
+        myPendingOffsets.pop_front();
+        myCurrentPos = 0;
+        myLastBlockEmpty = myCurrent->empty();
+        if(!myLastBlockEmpty)
+        {
+            return(true);
+        }
+        // Skip empty blocks (the EOF marker).
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// ParallelBgzfWriter
+
+ParallelBgzfWriter::ParallelBgzfWriter()
+    : myPool(NULL),
+      myMaxInFlight(1),
+      myLevel(Z_DEFAULT_COMPRESSION),
+      myFile(NULL),
+      myIsStdout(false),
+      myFailed(false),
+      myPending(),
+      myCurrent(),
+      myBlockListener(),
+      myFileOffset(0),
+      myDataOffset(0)
+{
+}
+
+
+ParallelBgzfWriter::~ParallelBgzfWriter()
+{
+    try
+    {
+        close();
+    }
+    catch(std::runtime_error& e)
+    {
+        // Cannot throw from a destructor, the close failure is lost.
+    }
+}
+
+
+bool ParallelBgzfWriter::open(const char* filename, ThreadPool& pool,
+                              int maxInFlight)
+{
+    close();
+    myPool = &pool;
+    myMaxInFlight = (maxInFlight < 1) ? 1 : maxInFlight;
+    return(openFile(filename));
+}
+
+
+bool ParallelBgzfWriter::open(const char* filename)
+{
+    close();
+    myPool = NULL;
+    myMaxInFlight = 1;
+    return(openFile(filename));
+}
+
+
+bool ParallelBgzfWriter::close()
+{
+    if(myFile == NULL)
+    {
+        return(true);
+    }
+    if(!myCurrent->empty())
+    {
+        queueBlock();
+    }
+    while(!myPending.empty())
+    {
+        writeFirstPending();
+    }
+    if(myBlockListener)
+    {
+        myBlockListener(myFileOffset, 0);
+    }
+    if(fwrite(ParallelBgzf::EOF_MARKER, 1, ParallelBgzf::EOF_MARKER_SIZE,
+              myFile) != ParallelBgzf::EOF_MARKER_SIZE)
+    {
+        myFailed = true;
+    }
+    myFileOffset += ParallelBgzf::EOF_MARKER_SIZE;
+    if(myIsStdout)
+    {
+        if(fflush(myFile) != 0)
+        {
+            myFailed = true;
+        }
+    }
+    else if(fclose(myFile) != 0)
+    {
+        myFailed = true;
+    }
+    myFile = NULL;
+    myIsStdout = false;
+    myCurrent.reset();
+    return(!myFailed);
+}
+
+
+bool ParallelBgzfWriter::write(const void* buffer, uint32_t len)
+{
+    if(myFile == NULL)
+    {
+        return(false);
+    }
+    const char* inPtr = (const char*)buffer;
+    myDataOffset += len;
+    while(len > 0)
+    {
+        uint32_t copyLen = ParallelBgzf::MAX_BLOCK_DATA_SIZE - myCurrent->size();
+        if(copyLen > len)
+        {
+            copyLen = len;
+        }
+        myCurrent->insert(myCurrent->end(), inPtr, inPtr + copyLen);
+        inPtr += copyLen;
+        len -= copyLen;
+        if(myCurrent->size() == ParallelBgzf::MAX_BLOCK_DATA_SIZE)
+        {
+            queueBlock();
+        }
+    }
+    return(!myFailed);
+}
+
+
+bool ParallelBgzfWriter::appendFile(const char* filename, uint64_t startOffset)
+{
+    if(myFile == NULL)
+    {
+        return(false);
+    }
+    // Write everything so far, so the appended blocks follow it.
+    if(!myCurrent->empty())
+    {
+        queueBlock();
+    }
+    while(!myPending.empty())
+    {
+        writeFirstPending();
+    }
+
+    FILE* inFile = fopen(filename, "rb");
+    if(inFile == NULL)
+    {
+        return(false);
+    }
+    // Find the length of the file without the EOF marker.
+    long copyLen = -1;
+    if(fseek(inFile, 0, SEEK_END) == 0)
+    {
+        copyLen = ftell(inFile);
+    }
+    if(copyLen >= (long)ParallelBgzf::EOF_MARKER_SIZE)
+    {
+        unsigned char lastBlock[ParallelBgzf::EOF_MARKER_SIZE];
+        if((fseek(inFile, -(long)ParallelBgzf::EOF_MARKER_SIZE, SEEK_END) == 0) &&
+           (fread(lastBlock, 1, ParallelBgzf::EOF_MARKER_SIZE, inFile) ==
+            ParallelBgzf::EOF_MARKER_SIZE) &&
+           (memcmp(lastBlock, ParallelBgzf::EOF_MARKER,
+                   ParallelBgzf::EOF_MARKER_SIZE) == 0))
+        {
+            copyLen -= ParallelBgzf::EOF_MARKER_SIZE;
+        }
+    }
+    if((copyLen < (long)startOffset) || 
+       (fseeko(inFile, startOffset, SEEK_SET) != 0))
+    {
+        fclose(inFile);
+        return(false);
+    }
+    copyLen -= startOffset;
+
+    std::vector<char> buffer(1 << 20);
+    while(copyLen > 0)
+    {
+        size_t readLen = (copyLen < (long)buffer.size()) ? copyLen : buffer.size();
+        if(fread(&(buffer[0]), 1, readLen, inFile) != readLen)
+        {
+            fclose(inFile);
+            return(false);
+        }
+        if(fwrite(&(buffer[0]), 1, readLen, myFile) != readLen)
+        {
+            myFailed = true;
+        }
+        myFileOffset += readLen;
+        copyLen -= readLen;
+    }
+    fclose(inFile);
+    return(!myFailed);
+}
+
+
+bool ParallelBgzfWriter::openFile(const char* filename)
+{
+    if(strcmp(filename, "-") == 0)
+    {
+        myFile = stdout;
+        myIsStdout = true;
+    }
+    else
+    {
+        myFile = fopen(filename, "wb");
+        myIsStdout = false;
+    }
+    myFailed = false;
+    myFileOffset = 0;
+    myDataOffset = 0;
+    myCurrent = std::make_shared<ParallelBgzf::Buffer>();
+    myCurrent->reserve(ParallelBgzf::MAX_BLOCK_DATA_SIZE);
+    return(myFile != NULL);
+}
+
+
+void ParallelBgzfWriter::queueBlock()
+{
+    if(myPool == NULL)
+    {
+        // Not using the pool, so deflate the block here.
+        writeBlocks(ParallelBgzf::deflateBlock(myCurrent, myLevel));
+    }
+    else
+    {
+        if(myPending.size() >= myMaxInFlight)
+        {
+            writeFirstPending();
+        }
+        myPending.push_back(myPool->submit(std::bind(&ParallelBgzf::deflateBlock,
+                                                    myCurrent, myLevel)));
+    }
+    myCurrent = std::make_shared<ParallelBgzf::Buffer>();
+    myCurrent->reserve(ParallelBgzf::MAX_BLOCK_DATA_SIZE);
+}
+
+
+void ParallelBgzfWriter::writeFirstPending()
+{
+    ParallelBgzf::BufferPtr blocks = myPending.front().get();
+    myPending.pop_front();
+    writeBlocks(blocks);
+}
+
+
+void ParallelBgzfWriter::writeBlocks(const ParallelBgzf::BufferPtr& blocks)
+{
+    if(!blocks->empty() &&
+       (fwrite(&((*blocks)[0]), 1, blocks->size(), myFile) != blocks->size()))
+    {
+        myFailed = true;
+    }
+    if(myBlockListener)
+    {
+        // Report each of the blocks the data was deflated into.
+        const unsigned char* blockPtr = (const unsigned char*)blocks->data();
+        for(uint32_t pos = 0; pos < blocks->size(); )
+        {
+            uint32_t blockSize = readLittleEndian16(blockPtr + pos + 16) + 1;
+            myBlockListener(myFileOffset + pos,
+                            readLittleEndian32(blockPtr + pos + blockSize - 4));
+            pos += blockSize;
+        }
+    }
+    myFileOffset += blocks->size();
+}
@@ -0,0 +1,220 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//////////////////////////////////////////////////////////////////////////
+// BGZF block level reader/writer that inflates and deflates blocks on a
+// ThreadPool while keeping the blocks in file order.
+
+#ifndef __PARALLEL_BGZF_H__
+#define __PARALLEL_BGZF_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+
+#include "ThreadPool.h"
+
+class ParallelBgzf
+{
+public:
+    typedef std::vector<char> Buffer;
+    typedef std::shared_ptr<Buffer> BufferPtr;
+
+    /// Maximum number of uncompressed bytes stored in a single block.
+    static const uint32_t MAX_BLOCK_DATA_SIZE;
+
+    /// Return true if the file starts with a BGZF block header and ends
+    /// with the BGZF EOF marker block.  Always returns false for stdin.
+    static bool isBgzfWithEof(const char* filename);
+
+    /// Inflate the specified BGZF block (header through ISIZE).
+    /// Throws std::runtime_error if the block is corrupt.
+    static BufferPtr inflateBlock(BufferPtr block);
+
+    /// Deflate the specified data into one or more BGZF blocks.
+    static BufferPtr deflateBlock(BufferPtr data, int level);
+
+    /// The empty block that marks the end of a BGZF file.
+    static const unsigned char EOF_MARKER[];
+    static const uint32_t EOF_MARKER_SIZE;
+
+private:
+    static const uint32_t BLOCK_HEADER_SIZE;
+    static const uint32_t BLOCK_FOOTER_SIZE;
+    static const uint32_t MAX_BLOCK_SIZE;
+};
+
+
+/// Reads a BGZF file, inflating blocks ahead of the caller on a thread pool.
+class ParallelBgzfReader
+{
+public:
+    ParallelBgzfReader();
+    ~ParallelBgzfReader();
+
+    /// Open the file ("-" for stdin), inflating up to maxInFlight blocks
+    /// ahead on the specified pool.  Returns false if the file cannot be
+    /// opened or does not start with a BGZF block.
+    bool open(const char* filename, ThreadPool& pool, int maxInFlight);
+
+    /// Open the file ("-" for stdin), inflating blocks on the calling
+    /// thread.  Used when already running as a task on the thread pool.
+    bool open(const char* filename);
+    void close();
+    bool isOpen() { return(myFile != NULL); }
+
+    /// Read len bytes into buffer, returning the number of bytes read,
+    /// which is only less than len at the end of the file.
+    /// Throws std::runtime_error on a corrupt or truncated file.
+    uint32_t read(void* buffer, uint32_t len);
+
+    /// Skip over len bytes, returning the number of bytes skipped, which
+    /// is only less than len at the end of the file.
+    /// Throws std::runtime_error on a corrupt or truncated file.
+    uint32_t skip(uint32_t len);
+
+    /// Return true if all of the data in the file has been read.
+    bool isEOF();
+
+    /// Return true if the last block read was the empty EOF marker block.
+    bool sawEofMarker() { return(myLastBlockEmpty); }
+
+    /// Return the BGZF virtual file offset (the file offset of the block
+    /// in the upper 48 bits and the offset within its data in the lower
+    /// 16 bits) of the next byte to be read.
+    uint64_t tell();
+
+    /// Move to the specified virtual file offset, returning false if it
+    /// is past the end of the file or the file is stdin.
+    /// Throws std::runtime_error on a corrupt or truncated file.
+    bool seek(uint64_t virtualOffset);
+
+    /// Append the data left in the current block to buffer, so the next
+    /// byte read starts a new block, and return the number of bytes added.
+    uint32_t readRestOfBlock(std::vector<char>& buffer);
+
+private:
+    ParallelBgzfReader(const ParallelBgzfReader&);
+    ParallelBgzfReader& operator=(const ParallelBgzfReader&);
+
+    // Open the file after the pool settings have been set.
+    bool openFile(const char* filename);
+
+    // Read the next compressed block from the file, returning NULL at the
+    // end of the file.
+    ParallelBgzf::BufferPtr readCompressedBlock();
+    // Keep the read ahead queue full.
+    void fillQueue();
+    // Move to the next block that contains data, returning false at the
+    // end of the file.
+    bool nextBlock();
+
+    ThreadPool* myPool;
+    unsigned int myMaxInFlight;
+    FILE* myFile;
+    bool myIsStdin;
+    bool myFileDone;
+    bool myLastBlockEmpty;
+    std::deque< std::future<ParallelBgzf::BufferPtr> > myPending;
+    // File offsets of the blocks in myPending.
+    std::deque<uint64_t> myPendingOffsets;
+    ParallelBgzf::BufferPtr myCurrent;
+    uint32_t myCurrentPos;
+    // File offset of myCurrent.
+    uint64_t myCurrentOffset;
+    // File offset of the next compressed block to read.
+    uint64_t myNextOffset;
+};
+
+
+/// Writes a BGZF file, deflating blocks on a thread pool and writing them
+/// in the order the data was written.
+class ParallelBgzfWriter
+{
+public:
+    ParallelBgzfWriter();
+    ~ParallelBgzfWriter();
+
+    /// Open the file ("-" for stdout), deflating up to maxInFlight blocks
+    /// at a time on the specified pool.
+    bool open(const char* filename, ThreadPool& pool, int maxInFlight);
+
+    /// Open the file ("-" for stdout), deflating blocks on the calling
+    /// thread.  Used when already running as a task on the thread pool.
+    bool open(const char* filename);
+
+    /// Write out all data, the EOF marker, and close the file.
+    /// Returns false if any of the writes failed.
+    bool close();
+    bool isOpen() { return(myFile != NULL); }
+
+    /// Set the zlib compression level used for new blocks.
+    void setCompressionLevel(int level) { myLevel = level; }
+
+    /// Call listener with the file offset and data size of each block as
+    /// it is written to the file, including the empty EOF marker block.
+    /// Blocks copied by appendFile are not reported.
+    void setBlockListener(const std::function<void(uint64_t, uint32_t)>& listener)
+    { myBlockListener = listener; }
+
+    /// Number of uncompressed bytes passed to write since the file was
+    /// opened, the offset of the next byte written (excluding appended
+    /// files).
+    uint64_t getDataOffset() { return(myDataOffset); }
+
+    /// Returns false if a write to the file has failed.
+    bool write(const void* buffer, uint32_t len);
+
+    /// After the data written so far, copy the blocks of the specified
+    /// BGZF file (excluding its EOF marker), starting with the block at
+    /// file offset startOffset.  The data in the file must continue the
+    /// data written so far (for example, more BAM records).
+    /// Returns false if the file could not be read or written.
+    bool appendFile(const char* filename, uint64_t startOffset = 0);
+
+private:
+    ParallelBgzfWriter(const ParallelBgzfWriter&);
+    ParallelBgzfWriter& operator=(const ParallelBgzfWriter&);
+
+    // Open the file after the pool settings have been set.
+    bool openFile(const char* filename);
+    // Queue the current block for compression.
+    void queueBlock();
+    // Write the first compressed block to the file.
+    void writeFirstPending();
+    // Write the compressed blocks to the file.
+    void writeBlocks(const ParallelBgzf::BufferPtr& blocks);
+
+    ThreadPool* myPool;
+    unsigned int myMaxInFlight;
+    int myLevel;
+    FILE* myFile;
+    bool myIsStdout;
+    bool myFailed;
+    std::deque< std::future<ParallelBgzf::BufferPtr> > myPending;
+    ParallelBgzf::BufferPtr myCurrent;
+    std::function<void(uint64_t, uint32_t)> myBlockListener;
+    // Number of bytes written to the file.
+    uint64_t myFileOffset;
+    uint64_t myDataOffset;
+};
+
+#endif
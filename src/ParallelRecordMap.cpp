@@ -0,0 +1,235 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+
+#include "ParallelRecordMap.h"
+#include "BamExecutable.h"
+
+ParallelRecordMap::RecordBatch::RecordBatch()
+    : records(BATCH_SIZE),
+      inputKeys(BATCH_SIZE, 0),
+      numRecords(0),
+      numToWrite(0),
+      worker(0)
+{
+    for(unsigned int i = 0; i < BATCH_SIZE; i++)
+    {
+        records[i].reset(new SamRecord());
+    }
+}
+
+
+ParallelRecordMap::ParallelRecordMap()
+    : myStopped(false)
+{
+}
+
+
+ParallelRecordMap::~ParallelRecordMap()
+{
+}
+
+
+unsigned int ParallelRecordMap::getNumWorkers()
+{
+    if(BamExecutable::getNumThreads() <= 1)
+    {
+        return(1);
+    }
+    // Keep twice as many batches as threads in flight.
+    return(BamExecutable::getNumThreads() * 2);
+}
+
+
+SamStatus::Status ParallelRecordMap::run(ThreadedSamFile& samIn,
+                                         ThreadedSamFile& samOut,
+                                         SamFileHeader& header,
+                                         Transform transform)
+{
+    return(run(samIn, header, transform,
+               [&samOut, &header](SamRecord& record, uint64_t)
+               {
+                   if(!samOut.WriteRecord(header, record))
+                   {
+                       // Failed to write a record.
+                       fprintf(stderr, "%s\n", samOut.GetStatusMessage());
+                       return(samOut.GetStatus());
+                   }
+                   return(SamStatus::SUCCESS);
+               }));
+}
+
+
+SamStatus::Status ParallelRecordMap::run(ThreadedSamFile& samIn,
+                                         SamFileHeader& header,
+                                         Transform transform,
+                                         Writer writer)
+{
+    SamStatus::Status status = SamStatus::SUCCESS;
+    myStopped = false;
+
+    if(BamExecutable::getNumThreads() <= 1)
+    {
+        SamRecord record;
+        while(samIn.ReadRecord(header, record))
+        {
+            uint64_t inputKey = getCoordKey(record);
+            if(!transform(record, 0))
+            {
+                myStopped = true;
+                break;
+            }
+            SamStatus::Status writeStatus = writer(record, inputKey);
+            if(writeStatus != SamStatus::SUCCESS)
+            {
+                status = writeStatus;
+            }
+        }
+        return(status);
+    }
+
+    unsigned int numWorkers = getNumWorkers();
+    std::deque<PendingBatch> pending;
+    std::vector< std::unique_ptr<RecordBatch> > freeBatches;
+    // Each batch in flight has its own worker.
+    std::vector<unsigned int> freeWorkers;
+    for(unsigned int i = numWorkers; i > 0; i--)
+    {
+        freeWorkers.push_back(i - 1);
+    }
+
+    try
+    {
+        bool moreRecords = true;
+        while(moreRecords || !pending.empty())
+        {
+            if(moreRecords && (pending.size() < numWorkers))
+            {
+                std::unique_ptr<RecordBatch> batch;
+                if(freeBatches.empty())
+                {
+                    batch.reset(new RecordBatch);
+                }
+                else
+                {
+                    batch = std::move(freeBatches.back());
+                    freeBatches.pop_back();
+                }
+                batch->numRecords = 0;
+                while(batch->numRecords < BATCH_SIZE)
+                {
+                    SamRecord& record = *(batch->records[batch->numRecords]);
+                    if(!samIn.ReadRecord(header, record))
+                    {
+                        moreRecords = false;
+                        break;
+                    }
+                    batch->inputKeys[batch->numRecords] = getCoordKey(record);
+                    ++batch->numRecords;
+                }
+                if(batch->numRecords != 0)
+                {
+                    batch->worker = freeWorkers.back();
+                    freeWorkers.pop_back();
+                    RecordBatch* batchPtr = batch.get();
+                    PendingBatch next;
+                    next.batch = std::move(batch);
+                    next.result = BamExecutable::getThreadPool().submit(
+                        [batchPtr, &transform]()
+                        {
+                            transformBatch(*batchPtr, transform);
+                        });
+                    pending.push_back(std::move(next));
+                }
+                else
+                {
+                    freeBatches.push_back(std::move(batch));
+                }
+                continue;
+            }
+
+            // Write the oldest batch once it is transformed.
+            PendingBatch& oldest = pending.front();
+            oldest.result.get();
+            bool stopped = !writeBatch(*(oldest.batch), writer, status);
+            freeWorkers.push_back(oldest.batch->worker);
+            freeBatches.push_back(std::move(oldest.batch));
+            pending.pop_front();
+            if(stopped)
+            {
+                // Wait for the batches still being transformed before
+                // returning since they reference the transform.
+                myStopped = true;
+                waitForPending(pending);
+                break;
+            }
+        }
+    }
+    catch(...)
+    {
+        // Wait for the batches still being transformed before
+        // passing on the exception since they reference the transform.
+        waitForPending(pending);
+        throw;
+    }
+    return(status);
+}
+
+
+void ParallelRecordMap::waitForPending(std::deque<PendingBatch>& pending)
+{
+    while(!pending.empty())
+    {
+        if(pending.front().result.valid())
+        {
+            pending.front().result.wait();
+        }
+        pending.pop_front();
+    }
+}
+
+
+void ParallelRecordMap::transformBatch(RecordBatch& batch,
+                                       Transform& transform)
+{
+    batch.numToWrite = batch.numRecords;
+    for(unsigned int i = 0; i < batch.numRecords; i++)
+    {
+        if(!transform(*(batch.records[i]), batch.worker))
+        {
+            batch.numToWrite = i;
+            break;
+        }
+    }
+}
+
+
+bool ParallelRecordMap::writeBatch(RecordBatch& batch, Writer& writer,
+                                   SamStatus::Status& status)
+{
+    for(unsigned int i = 0; i < batch.numToWrite; i++)
+    {
+        SamStatus::Status writeStatus = 
+            writer(*(batch.records[i]), batch.inputKeys[i]);
+        if(writeStatus != SamStatus::SUCCESS)
+        {
+            status = writeStatus;
+        }
+    }
+    return(batch.numToWrite == batch.numRecords);
+}
@@ -0,0 +1,111 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PARALLEL_RECORD_MAP_H__
+#define __PARALLEL_RECORD_MAP_H__
+
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "ThreadedSamFile.h"
+
+/// Reads the records of a file, transforms batches of them on the thread
+/// pool, and writes them in their original order.  With only 1 thread,
+/// each record is transformed and written as it is read.
+class ParallelRecordMap
+{
+public:
+    /// Transform the record.  Return false to stop processing, in which
+    /// case this record and the ones after it are not written.
+    /// Transforms with the same worker (0 to getNumWorkers() - 1) are
+    /// never run at the same time, so per worker state needs no locking.
+    typedef std::function<bool(SamRecord& record, unsigned int worker)> Transform;
+
+    /// Write a transformed record, in the original order, on the calling
+    /// thread.  inputKey is the record's coordinate key (see getCoordKey)
+    /// from before it was transformed.  Returns SUCCESS or the status of
+    /// the failure after reporting it.
+    typedef std::function<SamStatus::Status(SamRecord& record, 
+                                            uint64_t inputKey)> Writer;
+
+    ParallelRecordMap();
+    ~ParallelRecordMap();
+
+    /// Number of workers that transforms may be called with.
+    static unsigned int getNumWorkers();
+
+    /// Transform and write all remaining records from samIn.
+    /// Write failures are reported, and processing continues.
+    /// Returns SUCCESS or the status of the last failed write.
+    SamStatus::Status run(ThreadedSamFile& samIn, ThreadedSamFile& samOut,
+                          SamFileHeader& header, Transform transform);
+
+    /// Transform all remaining records from samIn, passing them to writer.
+    /// Returns SUCCESS or the status of the last failed write.
+    SamStatus::Status run(ThreadedSamFile& samIn, SamFileHeader& header,
+                          Transform transform, Writer writer);
+
+    /// Key that orders records by coordinate, with records without a
+    /// reference (ID -1) last.
+    static uint64_t getCoordKey(SamRecord& record)
+    {
+        return(((uint64_t)(uint32_t)record.getReferenceID() << 32) |
+               (uint32_t)record.get0BasedPosition());
+    }
+
+    /// Returns true if the last run was stopped by a transform.
+    bool wasStopped() { return(myStopped); }
+
+    static const unsigned int BATCH_SIZE = 1000;
+
+private:
+    ParallelRecordMap(const ParallelRecordMap&);
+    ParallelRecordMap& operator=(const ParallelRecordMap&);
+
+    struct RecordBatch
+    {
+        RecordBatch();
+        std::vector< std::unique_ptr<SamRecord> > records;
+        // Coordinate keys of the records when they were read.
+        std::vector<uint64_t> inputKeys;
+        unsigned int numRecords;
+        // Number of records to write, less than numRecords if stopped.
+        unsigned int numToWrite;
+        unsigned int worker;
+    };
+
+    struct PendingBatch
+    {
+        std::unique_ptr<RecordBatch> batch;
+        std::future<void> result;
+    };
+
+    // Wait for and discard all pending batches.
+    static void waitForPending(std::deque<PendingBatch>& pending);
+    // Transform the records of the batch.
+    static void transformBatch(RecordBatch& batch, Transform& transform);
+    // Write the batch, returning false if it was stopped.
+    bool writeBatch(RecordBatch& batch, Writer& writer,
+                    SamStatus::Status& status);
+
+    bool myStopped;
+};
+
+#endif
@@ -0,0 +1,619 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <stdexcept>
+#include <functional>
+
+#include "ParallelSamText.h"
+#include "SamRecordHelper.h"
+
+// Number of fields every SAM record has before its tags.
+static const int NUM_SAM_FIELDS = 11;
+
+static const char BAM_MAGIC[4] = {'B', 'A', 'M', 1};
+
+// Set value to the integer in str, returning false if str is not an
+// integer in the specified range.
+static bool parseInteger(const char* str, long minValue, long maxValue,
+                         long& value)
+{
+    if(*str == '\0')
+    {
+        return(false);
+    }
+    char* end = NULL;
+    errno = 0;
+    value = strtol(str, &end, 10);
+    return((errno == 0) && (*end == '\0') &&
+           (value >= minValue) && (value <= maxValue));
+}
+
+
+ParallelSamText::BufferPtr ParallelSamText::parseLines(BufferPtr text,
+                                                     SamFileHeader* header)
+{
+    BufferPtr records = std::make_shared<Buffer>();
+    records->reserve(text->size());
+    SamRecord record;
+    std::string errorMessage;
+    // Make sure the last line is terminated so it can be parsed in place.
+    text->push_back('\n');
+    char* linePtr = &((*text)[0]);
+    char* endPtr = linePtr + text->size();
+    while(linePtr < endPtr)
+    {
+        char* lineEnd = (char*)memchr(linePtr, '\n', endPtr - linePtr);
+        // Drop the carriage return of a CRLF line ending, else it ends up
+        // in the last field.
+        char* fieldsEnd = lineEnd;
+        if((fieldsEnd != linePtr) && (*(fieldsEnd - 1) == '\r'))
+        {
+            --fieldsEnd;
+        }
+        *fieldsEnd = '\0';
+        if(fieldsEnd != linePtr)
+        {
+            if(!parseLine(linePtr, *header, record, errorMessage))
+            {
+                throw(std::runtime_error(errorMessage));
+            }
+            // The record buffer starts with the block size.
+            const char* buffer = 
+                (const char*)record.getRecordBuffer(SamRecord::NONE);
+            if(buffer == NULL)
+            {
+                throw(std::runtime_error("Failed to get the BAM record buffer."));
+            }
+            int32_t blockSize = 0;
+            memcpy(&blockSize, buffer, sizeof(blockSize));
+            records->insert(records->end(), buffer, 
+                            buffer + blockSize + sizeof(blockSize));
+        }
+        linePtr = lineEnd + 1;
+    }
+    return(records);
+}
+
+
+ParallelSamText::BufferPtr ParallelSamText::formatRecords(BufferPtr records,
+                                                        SamFileHeader* header)
+{
+    std::string text;
+    text.reserve(records->size() * 2);
+    SamRecord record;
+    uint32_t pos = 0;
+    while(pos < records->size())
+    {
+        int32_t blockSize = 0;
+        memcpy(&blockSize, &((*records)[pos]), sizeof(blockSize));
+        uint32_t recordSize = blockSize + sizeof(blockSize);
+        if((record.setBuffer(&((*records)[pos]), recordSize, *header) != 
+            SamStatus::SUCCESS) || !formatRecord(record, text))
+        {
+            throw(std::runtime_error("Failed to format the SAM record."));
+        }
+        pos += recordSize;
+    }
+    return(std::make_shared<Buffer>(text.begin(), text.end()));
+}
+
+
+bool ParallelSamText::parseLine(char* line, SamFileHeader& header,
+                                SamRecord& record, std::string& errorMessage)
+{
+    // Split the line into its tab separated fields.
+    std::vector<char*> fields;
+    fields.push_back(line);
+    for(char* tabPtr = strchr(line, '\t'); tabPtr != NULL;
+        tabPtr = strchr(tabPtr + 1, '\t'))
+    {
+        *tabPtr = '\0';
+        fields.push_back(tabPtr + 1);
+    }
+    if(fields.size() < (unsigned int)NUM_SAM_FIELDS)
+    {
+        errorMessage = "Too few columns (" + std::to_string(fields.size()) +
+            ") in the Record, expected at least 11.";
+        return(false);
+    }
+
+    // Reset the record before setting any fields.
+    record.resetRecord();
+    if(!record.setReadName(fields[0]))
+    {
+        errorMessage = std::string("Invalid read name: ") + fields[0];
+        return(false);
+    }
+    long flag = 0;
+    if(!parseInteger(fields[1], 0, UINT16_MAX, flag))
+    {
+        errorMessage = std::string("Flag, ") + fields[1] + 
+            ", is not an integer in the range of a flag.";
+        return(false);
+    }
+    record.setFlag(flag);
+    record.setReferenceName(header, fields[2]);
+    long pos = 0;
+    if(!parseInteger(fields[3], 0, INT32_MAX, pos))
+    {
+        errorMessage = std::string("Position, ") + fields[3] + 
+            ", is not an integer.";
+        return(false);
+    }
+    record.set1BasedPosition(pos);
+    long mapQuality = 0;
+    if(!parseInteger(fields[4], 0, UINT8_MAX, mapQuality))
+    {
+        errorMessage = std::string("MAPQ, ") + fields[4] + 
+            ", is not an integer in the range of a MAPQ.";
+        return(false);
+    }
+    record.setMapQuality(mapQuality);
+    record.setCigar(fields[5]);
+    record.setMateReferenceName(header, fields[6]);
+    long matePos = 0;
+    if(!parseInteger(fields[7], 0, INT32_MAX, matePos))
+    {
+        errorMessage = std::string("Mate Position, ") + fields[7] + 
+            ", is not an integer.";
+        return(false);
+    }
+    record.set1BasedMatePosition(matePos);
+    long insertSize = 0;
+    if(!parseInteger(fields[8], INT32_MIN, INT32_MAX, insertSize))
+    {
+        errorMessage = std::string("Insert Size, ") + fields[8] + 
+            ", is not an integer.";
+        return(false);
+    }
+    record.setInsertSize(insertSize);
+    record.setSequence(fields[9]);
+    record.setQuality(fields[10]);
+
+    // Add the tags, formatted as cc:c:x*.
+    for(unsigned int i = NUM_SAM_FIELDS; i < fields.size(); i++)
+    {
+        char* tag = fields[i];
+        // Z & H values may be empty, as in XX:Z:
+        if((strlen(tag) < 5) || (tag[2] != ':') || (tag[4] != ':'))
+        {
+            errorMessage = std::string("Invalid Tag Format: ") + tag + 
+                ", should be cc:c:x*.";
+            return(false);
+        }
+        char tagName[3] = {tag[0], tag[1], '\0'};
+        if(!record.addTag(tagName, tag[3], tag + 5))
+        {
+            errorMessage = std::string("Failed to add the tag: ") + tag;
+            return(false);
+        }
+    }
+    return(true);
+}
+
+
+bool ParallelSamText::formatRecord(SamRecord& record, std::string& text)
+{
+    text += record.getReadName();
+    text += '\t';
+    text += std::to_string(record.getFlag());
+    text += '\t';
+    text += record.getReferenceName();
+    text += '\t';
+    text += std::to_string(record.get1BasedPosition());
+    text += '\t';
+    text += std::to_string(record.getMapQuality());
+    text += '\t';
+    text += record.getCigar();
+    text += '\t';
+    text += record.getMateReferenceNameOrEqual();
+    text += '\t';
+    text += std::to_string(record.get1BasedMatePosition());
+    text += '\t';
+    text += std::to_string(record.getInsertSize());
+    text += '\t';
+    text += record.getSequence();
+    text += '\t';
+    text += record.getQuality();
+    String tags;
+    if(!SamRecordHelper::genSamTagsString(record, tags, '\t'))
+    {
+        return(false);
+    }
+    if(!tags.IsEmpty())
+    {
+        text += '\t';
+        text += tags.c_str();
+    }
+    text += '\n';
+    return(true);
+}
+
+
+ParallelSamReader::ParallelSamReader()
+    : myPool(NULL),
+      myMaxInFlight(1),
+      myFile(NULL),
+      myFileDone(false),
+      myHeader(NULL),
+      myPartialLine(),
+      myPending(),
+      myCurrent(),
+      myCurrentPos(0)
+{
+}
+
+
+ParallelSamReader::~ParallelSamReader()
+{
+    close();
+}
+
+
+bool ParallelSamReader::isSam(const char* filename)
+{
+    if((strcmp(filename, "-") == 0) || (strncmp(filename, "-.", 2) == 0))
+    {
+        return(false);
+    }
+    FILE* file = fopen(filename, "rb");
+    if(file == NULL)
+    {
+        return(false);
+    }
+    char start[sizeof(BAM_MAGIC)];
+    size_t startLen = fread(start, 1, sizeof(start), file);
+    fclose(file);
+    if((startLen > 0) && ((unsigned char)start[0] == 0x1f))
+    {
+        // gzip/BGZF compressed.
+        return(false);
+    }
+    return((startLen < sizeof(BAM_MAGIC)) ||
+           (memcmp(start, BAM_MAGIC, sizeof(BAM_MAGIC)) != 0));
+}
+
+
+bool ParallelSamReader::open(const char* filename, ThreadPool& pool,
+                             int maxInFlight)
+{
+    close();
+    myPool = &pool;
+    myMaxInFlight = (maxInFlight < 1) ? 1 : maxInFlight;
+    myFile = fopen(filename, "rb");
+    myFileDone = false;
+    return(myFile != NULL);
+}
+
+
+void ParallelSamReader::close()
+{
+    // Wait for any parsing of the file to finish.
+    while(!myPending.empty())
+    {
+        myPending.front().wait();
+        myPending.pop_front();
+    }
+    if(myFile != NULL)
+    {
+        fclose(myFile);
+        myFile = NULL;
+    }
+    myFileDone = false;
+    myHeader = NULL;
+    myPartialLine.clear();
+    myCurrent.reset();
+    myCurrentPos = 0;
+}
+
+
+bool ParallelSamReader::readHeader(std::string& text)
+{
+    text.clear();
+    if(myFile == NULL)
+    {
+        return(false);
+    }
+    int nextChar = getc(myFile);
+    while(nextChar == '@')
+    {
+        // Copy the header line including its newline.
+        while((nextChar != EOF) && (nextChar != '\n'))
+        {
+            text += (char)nextChar;
+            nextChar = getc(myFile);
+        }
+        if(!text.empty() && (text[text.size() - 1] == '\r'))
+        {
+            // A CRLF line ending.
+            text.erase(text.size() - 1);
+        }
+        text += '\n';
+        nextChar = getc(myFile);
+    }
+    if(nextChar != EOF)
+    {
+        if(ungetc(nextChar, myFile) == EOF)
+        {
+            return(false);
+        }
+    }
+    return(ferror(myFile) == 0);
+}
+
+
+uint32_t ParallelSamReader::read(void* buffer, uint32_t len)
+{
+    char* outPtr = (char*)buffer;
+    uint32_t numRead = 0;
+    while(numRead < len)
+    {
+        if(!myCurrent || (myCurrentPos >= myCurrent->size()))
+        {
+            if(!nextChunk())
+            {
+                break;
+            }
+        }
+        uint32_t copyLen = myCurrent->size() - myCurrentPos;
+        if(copyLen > (len - numRead))
+        {
+            copyLen = len - numRead;
+        }
+        memcpy(outPtr + numRead, &((*myCurrent)[myCurrentPos]), copyLen);
+        myCurrentPos += copyLen;
+        numRead += copyLen;
+    }
+    return(numRead);
+}
+
+
+bool ParallelSamReader::isEOF()
+{
+    while(!myCurrent || (myCurrentPos >= myCurrent->size()))
+    {
+        if(!nextChunk())
+        {
+            return(true);
+        }
+    }
+    return(false);
+}
+
+
+void ParallelSamReader::fillQueue()
+{
+    while(!myFileDone && (myPending.size() < myMaxInFlight))
+    {
+        ParallelSamText::BufferPtr chunk = 
+            std::make_shared<ParallelSamText::Buffer>();
+        chunk->swap(myPartialLine);
+        size_t startLen = chunk->size();
+        chunk->resize(startLen + ParallelSamText::CHUNK_SIZE);
+        size_t readLen = fread(&((*chunk)[startLen]), 1, 
+                               ParallelSamText::CHUNK_SIZE, myFile);
+        chunk->resize(startLen + readLen);
+        if(readLen < ParallelSamText::CHUNK_SIZE)
+        {
+            if(ferror(myFile))
+            {
+                throw(std::runtime_error("Failed to read the SAM file."));
+            }
+            myFileDone = true;
+        }
+        else
+        {
+            // Keep the partial last line for the next chunk.
+            size_t lineEnd = chunk->size();
+            while((lineEnd > 0) && ((*chunk)[lineEnd - 1] != '\n'))
+            {
+                --lineEnd;
+            }
+            if(lineEnd == 0)
+            {
+                // No complete line yet, so read more with it.
+                chunk->swap(myPartialLine);
+                continue;
+            }
+            myPartialLine.assign(chunk->begin() + lineEnd, chunk->end());
+            chunk->resize(lineEnd);
+        }
+        if(chunk->empty())
+        {
+            continue;
+        }
+        myPending.push_back(myPool->submit(std::bind(&ParallelSamText::parseLines,
+                                                    chunk, myHeader)));
+    }
+}
+
+
+bool ParallelSamReader::nextChunk()
+{
+    if((myFile == NULL) || (myHeader == NULL))
+    {
+        return(false);
+    }
+    fillQueue();
+    while(!myPending.empty())
+    {
+        myCurrent = myPending.front().get();
+        myPending.pop_front();
+        myCurrentPos = 0;
+        fillQueue();
+        if(!myCurrent->empty())
+        {
+            return(true);
+        }
+    }
+    myCurrent.reset();
+    myCurrentPos = 0;
+    return(false);
+}
+
+
+ParallelSamWriter::ParallelSamWriter()
+    : myPool(NULL),
+      myMaxInFlight(1),
+      myFile(NULL),
+      myIsStdout(false),
+      myFailed(false),
+      myHeader(NULL),
+      myPending(),
+      myCurrent()
+{
+}
+
+
+ParallelSamWriter::~ParallelSamWriter()
+{
+    try
+    {
+        close();
+    }
+    catch(std::runtime_error& e)
+    {
+        // Cannot throw from a destructor, the close failure is lost.
+    }
+}
+
+
+bool ParallelSamWriter::isSam(const char* filename)
+{
+    if((strcmp(filename, "-") == 0) || (strcmp(filename, "-.sam") == 0))
+    {
+        return(true);
+    }
+    const char* extension = strrchr(filename, '.');
+    return((extension != NULL) && (strcmp(extension, ".sam") == 0));
+}
+
+
+bool ParallelSamWriter::open(const char* filename, ThreadPool& pool,
+                             int maxInFlight)
+{
+    close();
+    myPool = &pool;
+    myMaxInFlight = (maxInFlight < 1) ? 1 : maxInFlight;
+    if((strcmp(filename, "-") == 0) || (strcmp(filename, "-.sam") == 0))
+    {
+        myFile = stdout;
+        myIsStdout = true;
+    }
+    else
+    {
+        myFile = fopen(filename, "wb");
+        myIsStdout = false;
+    }
+    myFailed = false;
+    myHeader = NULL;
+    myCurrent = std::make_shared<ParallelSamText::Buffer>();
+    return(myFile != NULL);
+}
+
+
+bool ParallelSamWriter::close()
+{
+    if(myFile == NULL)
+    {
+        return(true);
+    }
+    if(!myCurrent->empty())
+    {
+        queueChunk();
+    }
+    while(!myPending.empty())
+    {
+        writeFirstPending();
+    }
+    if(myIsStdout)
+    {
+        if(fflush(myFile) != 0)
+        {
+            myFailed = true;
+        }
+    }
+    else if(fclose(myFile) != 0)
+    {
+        myFailed = true;
+    }
+    myFile = NULL;
+    myIsStdout = false;
+    myHeader = NULL;
+    myCurrent.reset();
+    return(!myFailed);
+}
+
+
+bool ParallelSamWriter::writeHeader(const std::string& text,
+                                    SamFileHeader* header)
+{
+    if(myFile == NULL)
+    {
+        return(false);
+    }
+    myHeader = header;
+    if(!text.empty() &&
+       (fwrite(text.c_str(), 1, text.length(), myFile) != text.length()))
+    {
+        myFailed = true;
+    }
+    return(!myFailed);
+}
+
+
+bool ParallelSamWriter::write(const void* buffer, uint32_t len)
+{
+    if((myFile == NULL) || (myHeader == NULL))
+    {
+        return(false);
+    }
+    const char* inPtr = (const char*)buffer;
+    myCurrent->insert(myCurrent->end(), inPtr, inPtr + len);
+    if(myCurrent->size() >= ParallelSamText::CHUNK_SIZE)
+    {
+        queueChunk();
+    }
+    return(!myFailed);
+}
+
+
+void ParallelSamWriter::queueChunk()
+{
+    if(myPending.size() >= myMaxInFlight)
+    {
+        writeFirstPending();
+    }
+    myPending.push_back(myPool->submit(std::bind(&ParallelSamText::formatRecords,
+                                                myCurrent, myHeader)));
+    myCurrent = std::make_shared<ParallelSamText::Buffer>();
+}
+
+
+void ParallelSamWriter::writeFirstPending()
+{
+    ParallelSamText::BufferPtr text = myPending.front().get();
+    myPending.pop_front();
+    if(!text->empty() &&
+       (fwrite(&((*text)[0]), 1, text->size(), myFile) != text->size()))
+    {
+        myFailed = true;
+    }
+}
@@ -0,0 +1,173 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//////////////////////////////////////////////////////////////////////////
+// SAM text reader/writer that parses and formats chunks of records on a
+// ThreadPool while keeping the records in file order.
+
+#ifndef __PARALLEL_SAM_TEXT_H__
+#define __PARALLEL_SAM_TEXT_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <future>
+#include <memory>
+
+#include "ThreadPool.h"
+#include "SamFileHeader.h"
+#include "SamRecord.h"
+
+class ParallelSamText
+{
+public:
+    typedef std::vector<char> Buffer;
+    typedef std::shared_ptr<Buffer> BufferPtr;
+
+    /// Parse the SAM lines in text into uncompressed BAM records.
+    /// Empty lines are skipped.
+    /// Throws std::runtime_error if a line cannot be parsed.
+    static BufferPtr parseLines(BufferPtr text, SamFileHeader* header);
+
+    /// Format the uncompressed BAM records as SAM lines.
+    /// Throws std::runtime_error if a record cannot be formatted.
+    static BufferPtr formatRecords(BufferPtr records, SamFileHeader* header);
+
+    /// Set the record from the SAM line (without the newline), which is
+    /// modified while it is parsed.  Returns false and sets the error
+    /// message if it cannot be parsed.
+    static bool parseLine(char* line, SamFileHeader& header,
+                          SamRecord& record, std::string& errorMessage);
+
+    /// Append the SAM line (with the newline) for the record to text.
+    /// Returns false if the tags cannot be formatted.
+    static bool formatRecord(SamRecord& record, std::string& text);
+
+    /// Number of bytes of lines/records handled by each task.
+    static const uint32_t CHUNK_SIZE = 1024 * 1024;
+};
+
+
+/// Reads an uncompressed SAM file, returning its records as uncompressed
+/// BAM records parsed ahead of the caller on a thread pool.
+class ParallelSamReader
+{
+public:
+    ParallelSamReader();
+    ~ParallelSamReader();
+
+    /// Return true if the file is an uncompressed SAM file, which is
+    /// any file that is not gzip/BGZF compressed or uncompressed BAM.
+    /// Always returns false for stdin.
+    static bool isSam(const char* filename);
+
+    /// Open the file, parsing up to maxInFlight chunks at a time on the
+    /// specified pool.
+    bool open(const char* filename, ThreadPool& pool, int maxInFlight);
+    void close();
+    bool isOpen() { return(myFile != NULL); }
+
+    /// Read the header lines (the lines at the start of the file that
+    /// start with '@').
+    bool readHeader(std::string& text);
+
+    /// Start parsing the records using the specified header, which must
+    /// not change while the records are being read.
+    void setHeader(SamFileHeader* header) { myHeader = header; }
+
+    /// Read len bytes of the BAM records into buffer, returning the number
+    /// of bytes read, which is only less than len at the end of the file.
+    /// Throws std::runtime_error if a record cannot be read or parsed.
+    uint32_t read(void* buffer, uint32_t len);
+
+    /// Return true if all of the records have been read.
+    bool isEOF();
+
+private:
+    ParallelSamReader(const ParallelSamReader&);
+    ParallelSamReader& operator=(const ParallelSamReader&);
+
+    // Queue chunks of lines until maxInFlight are pending or the file ends.
+    void fillQueue();
+    // Move to the next parsed chunk, returning false at the end of the file.
+    bool nextChunk();
+
+    ThreadPool* myPool;
+    unsigned int myMaxInFlight;
+    FILE* myFile;
+    bool myFileDone;
+    SamFileHeader* myHeader;
+    // Partial line read after the last queued chunk.
+    ParallelSamText::Buffer myPartialLine;
+    std::deque< std::future<ParallelSamText::BufferPtr> > myPending;
+    ParallelSamText::BufferPtr myCurrent;
+    uint32_t myCurrentPos;
+};
+
+
+/// Writes an uncompressed SAM file, formatting the uncompressed BAM
+/// records written to it on a thread pool.
+class ParallelSamWriter
+{
+public:
+    ParallelSamWriter();
+    ~ParallelSamWriter();
+
+    /// Return true if SamFile would write the file as SAM and it is one
+    /// that is written by this class: "-" (stdout) or a ".sam" file.
+    static bool isSam(const char* filename);
+
+    /// Open the file ("-" or "-.sam" for stdout), formatting up to
+    /// maxInFlight chunks at a time on the specified pool.
+    bool open(const char* filename, ThreadPool& pool, int maxInFlight);
+
+    /// Write out all records and close the file.
+    /// Returns false if any of the writes failed.
+    bool close();
+    bool isOpen() { return(myFile != NULL); }
+
+    /// Write the header text, which must be written before any records,
+    /// and use the header to format the records.  The header must not
+    /// change while records are being written.
+    bool writeHeader(const std::string& text, SamFileHeader* header);
+
+    /// Write complete uncompressed BAM records.
+    /// Returns false if a write to the file has failed.
+    bool write(const void* buffer, uint32_t len);
+
+private:
+    ParallelSamWriter(const ParallelSamWriter&);
+    ParallelSamWriter& operator=(const ParallelSamWriter&);
+
+    // Queue the current records for formatting.
+    void queueChunk();
+    // Write the first formatted chunk to the file.
+    void writeFirstPending();
+
+    ThreadPool* myPool;
+    unsigned int myMaxInFlight;
+    FILE* myFile;
+    bool myIsStdout;
+    bool myFailed;
+    SamFileHeader* myHeader;
+    std::deque< std::future<ParallelSamText::BufferPtr> > myPending;
+    ParallelSamText::BufferPtr myCurrent;
+};
+
+#endif
@@ -21,6 +21,7 @@
 
 #include <stdexcept>
 #include "PileupElementBaseQCStats.h"
+#include "BaseQCFile.h"
 #include "SamFlag.h"
 
 /////////////////////////////////////////////////////////////////////////////
@@ -32,21 +33,11 @@ bool PileupElementBaseQCStats::ourFilterDups = true;
 bool PileupElementBaseQCStats::ourFilterQCFail = true;
 int PileupElementBaseQCStats::ourMinMapQuality = 0;
 IFILE PileupElementBaseQCStats::ourOutputFile = 0;
+BaseQCFile* PileupElementBaseQCStats::ourBinaryOutput = NULL;
 bool PileupElementBaseQCStats::ourPercentStats = false;
-RunningStat PileupElementBaseQCStats::avgTotalReads; 
-RunningStat PileupElementBaseQCStats::avgDups;
-RunningStat PileupElementBaseQCStats::avgQCFail;
-RunningStat PileupElementBaseQCStats::avgMapped;
-RunningStat PileupElementBaseQCStats::avgPaired;
-RunningStat PileupElementBaseQCStats::avgProperPaired;
-RunningStat PileupElementBaseQCStats::avgZeroMapQ;
-RunningStat PileupElementBaseQCStats::avgLT10MapQ;
-RunningStat PileupElementBaseQCStats::avgMapQ255;
-RunningStat PileupElementBaseQCStats::avgMapQPass;
-RunningStat PileupElementBaseQCStats::avgAvgMapQ;
-RunningStat PileupElementBaseQCStats::avgAvgMapQCount;
-RunningStat PileupElementBaseQCStats::avgDepth;
-RunningStat PileupElementBaseQCStats::avgQ20;
+PileupElementBaseQCStats::Summary PileupElementBaseQCStats::ourSummary;
+thread_local std::string* PileupElementBaseQCStats::ourThreadOutput = NULL;
+thread_local PileupElementBaseQCStats::Summary* PileupElementBaseQCStats::ourThreadSummary = NULL;
 bool PileupElementBaseQCStats::ourBaseSum = false;
 
 void PileupElementBaseQCStats::filterDups(bool filterDups)
@@ -69,6 +60,11 @@ void PileupElementBaseQCStats::setOutputFile(IFILE outputPtr)
     ourOutputFile = outputPtr;
 }
 
+void PileupElementBaseQCStats::setBinaryOutput(BaseQCFile* binaryOutput)
+{
+    ourBinaryOutput = binaryOutput;
+}
+
 void PileupElementBaseQCStats::printHeader()
 {
     if(ourPercentStats)
@@ -99,26 +95,79 @@ void PileupElementBaseQCStats::printSummary()
 {
     if(ourBaseSum)
     {
-        fprintf(stderr, "\nSummary of Pileup Stats (1st Row is Mean, 2nd Row is Standard Deviation)\nTotalReads\tDups\tQCFail\tMapped\tPaired\tProperPaired\tZeroMapQual\tMapQual<10\tMapQual255\tPassMapQual\tAverageMapQuality\tAverageMapQualCount\tDepth\tQ20Bases\n");
-        
-        fprintf(stderr, 
-                 "%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\n",
-                 avgTotalReads.Mean(), avgDups.Mean(), avgQCFail.Mean(),
-                 avgMapped.Mean(), avgPaired.Mean(), avgProperPaired.Mean(),
-                 avgZeroMapQ.Mean(), avgLT10MapQ.Mean(), avgMapQ255.Mean(), 
-                 avgMapQPass.Mean(), avgAvgMapQ.Mean(), avgAvgMapQCount.Mean(),
-                 avgDepth.Mean(), avgQ20.Mean());
-        fprintf(stderr, 
-                 "%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\n\n",
-                 avgTotalReads.StandardDeviation(), avgDups.StandardDeviation(), avgQCFail.StandardDeviation(),
-                 avgMapped.StandardDeviation(), avgPaired.StandardDeviation(), avgProperPaired.StandardDeviation(),
-                 avgZeroMapQ.StandardDeviation(), avgLT10MapQ.StandardDeviation(), avgMapQ255.StandardDeviation(), 
-                 avgMapQPass.StandardDeviation(), avgAvgMapQ.StandardDeviation(), avgAvgMapQCount.StandardDeviation(),
-                 avgDepth.StandardDeviation(), avgQ20.StandardDeviation());
+        ourSummary.print();
     }
 }
 
 
+void PileupElementBaseQCStats::setThreadOutput(std::string* output,
+                                               Summary* summary)
+{
+    ourThreadOutput = output;
+    ourThreadSummary = summary;
+}
+
+
+void PileupElementBaseQCStats::Summary::push(const Counts& counts)
+{
+    // Update the average values.
+    avgTotalReads.push(counts.numEntries);
+    avgDups.push(counts.numDups);
+    avgQCFail.push(counts.numQCFail);
+    avgMapped.push(counts.numMapped);
+    avgPaired.push(counts.numPaired);
+    avgProperPaired.push(counts.numProperPaired);
+    avgZeroMapQ.push(counts.numZeroMapQ);
+    avgLT10MapQ.push(counts.numLT10MapQ);
+    avgMapQ255.push(counts.numMapQ255);
+    avgMapQPass.push(counts.numMapQPass);
+    avgAvgMapQ.push( ((double)counts.sumMapQ)/counts.averageMapQCount);
+    avgAvgMapQCount.push(counts.averageMapQCount);
+    avgDepth.push(counts.depth);
+    avgQ20.push(counts.numQ20);
+}
+
+
+void PileupElementBaseQCStats::Summary::merge(const Summary& other)
+{
+    avgTotalReads.merge(other.avgTotalReads);
+    avgDups.merge(other.avgDups);
+    avgQCFail.merge(other.avgQCFail);
+    avgMapped.merge(other.avgMapped);
+    avgPaired.merge(other.avgPaired);
+    avgProperPaired.merge(other.avgProperPaired);
+    avgZeroMapQ.merge(other.avgZeroMapQ);
+    avgLT10MapQ.merge(other.avgLT10MapQ);
+    avgMapQ255.merge(other.avgMapQ255);
+    avgMapQPass.merge(other.avgMapQPass);
+    avgAvgMapQ.merge(other.avgAvgMapQ);
+    avgAvgMapQCount.merge(other.avgAvgMapQCount);
+    avgDepth.merge(other.avgDepth);
+    avgQ20.merge(other.avgQ20);
+}
+
+
+void PileupElementBaseQCStats::Summary::print()
+{
+    fprintf(stderr, "\nSummary of Pileup Stats (1st Row is Mean, 2nd Row is Standard Deviation)\nTotalReads\tDups\tQCFail\tMapped\tPaired\tProperPaired\tZeroMapQual\tMapQual<10\tMapQual255\tPassMapQual\tAverageMapQuality\tAverageMapQualCount\tDepth\tQ20Bases\n");
+        
+    fprintf(stderr, 
+            "%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\n",
+            avgTotalReads.mean(), avgDups.mean(), avgQCFail.mean(),
+            avgMapped.mean(), avgPaired.mean(), avgProperPaired.mean(),
+            avgZeroMapQ.mean(), avgLT10MapQ.mean(), avgMapQ255.mean(), 
+            avgMapQPass.mean(), avgAvgMapQ.mean(), avgAvgMapQCount.mean(),
+            avgDepth.mean(), avgQ20.mean());
+    fprintf(stderr, 
+            "%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\n\n",
+            avgTotalReads.standardDeviation(), avgDups.standardDeviation(), avgQCFail.standardDeviation(),
+            avgMapped.standardDeviation(), avgPaired.standardDeviation(), avgProperPaired.standardDeviation(),
+            avgZeroMapQ.standardDeviation(), avgLT10MapQ.standardDeviation(), avgMapQ255.standardDeviation(), 
+            avgMapQPass.standardDeviation(), avgAvgMapQ.standardDeviation(), avgAvgMapQCount.standardDeviation(),
+            avgDepth.standardDeviation(), avgQ20.standardDeviation());
+}
+
+
 PileupElementBaseQCStats::PileupElementBaseQCStats()
     : PileupElement()
 {
@@ -149,16 +198,16 @@ void PileupElementBaseQCStats::addEntry(SamRecord& record)
         cigar->getQueryIndex(getRefPosition(), record.get0BasedPosition());
 
     // Increment the counts
-    ++numEntries;
+    ++myCounts.numEntries;
     uint16_t flag = record.getFlag();
     
     if(SamFlag::isDuplicate(flag))
     {
-        ++numDups;
+        ++myCounts.numDups;
     }
     if(SamFlag::isQCFailure(flag))
     {
-        ++numQCFail;
+        ++myCounts.numQCFail;
     }
 
     if((ourFilterDups && SamFlag::isDuplicate(flag)) ||
@@ -175,38 +224,38 @@ void PileupElementBaseQCStats::addEntry(SamRecord& record)
         return;
     }
 
-    ++numMapped;
+    ++myCounts.numMapped;
 
     // It is mapped, so check pairing.
     if(SamFlag::isPaired(flag))
     {
-        ++numPaired;
+        ++myCounts.numPaired;
         if(SamFlag::isProperPair(flag))
         {
-            ++numProperPaired;
+            ++myCounts.numProperPaired;
         }
     }
 
     // It is mapped, so check the mapping quality.
     if(record.getMapQuality() < 10)
     {
-        ++numLT10MapQ;
+        ++myCounts.numLT10MapQ;
         if(record.getMapQuality() == 0)
         {
-            ++numZeroMapQ;
+            ++myCounts.numZeroMapQ;
         }
     }
     
     // Check for map filter.
     if(record.getMapQuality() >= ourMinMapQuality)
     {
-        numMapQPass++;
+        myCounts.numMapQPass++;
     }
 
     if(record.getMapQuality() == 255)
     {
         // Do not include mapping quality greater than 255.
-        ++numMapQ255;
+        ++myCounts.numMapQ255;
         return;
     }
     else
@@ -216,23 +265,23 @@ void PileupElementBaseQCStats::addEntry(SamRecord& record)
         // Also store the number of entries used for calculating the mapping
         // quality.
         // Store this for overflow check.
-        uint32_t prevMapQ = sumMapQ;
-        sumMapQ += record.getMapQuality();
+        uint32_t prevMapQ = myCounts.sumMapQ;
+        myCounts.sumMapQ += record.getMapQuality();
         // Increment the number of entries in the mapping quality sum.
-        ++averageMapQCount;
+        ++myCounts.averageMapQCount;
         
         // Check for overflow.
-        if(prevMapQ > sumMapQ)
+        if(prevMapQ > myCounts.sumMapQ)
         {
             std::cerr << "Mapping Quality Overflow for chromosome: "
                       << getChromosome() << ", Position: " << getRefPosition() 
                       << "\n";
             // So just calculate the previous average, then start adding to that.
             // This is not a good indicator, but it really shouldn't overflow.
-            --averageMapQCount;
-            sumMapQ = prevMapQ / averageMapQCount;
-            sumMapQ += record.getMapQuality();
-            averageMapQCount = 2;
+            --myCounts.averageMapQCount;
+            myCounts.sumMapQ = prevMapQ / myCounts.averageMapQCount;
+            myCounts.sumMapQ += record.getMapQuality();
+            myCounts.averageMapQCount = 2;
         }
     }
 
@@ -250,13 +299,13 @@ void PileupElementBaseQCStats::addEntry(SamRecord& record)
         return;      
     }
 
-    ++depth;
+    ++myCounts.depth;
  
     // Check for Q20 base.
     if(record.getQuality(readIndex) >= Q20_CHAR_VAL)
     {
         // Greater than or equal to q20.
-        ++numQ20;
+        ++myCounts.numQ20;
     }    
 }
 
@@ -267,173 +316,205 @@ void PileupElementBaseQCStats::addEntry(SamRecord& record)
 void PileupElementBaseQCStats::analyze()
 {
     // Only output if the position is covered.
-    if(numEntries != 0)
+    if(myCounts.numEntries != 0)
     {
-        if(ourPercentStats)
+        myOutputString.Clear();
+        formatRow(getChromosome(), getRefPosition(), myCounts, myOutputString);
+        writeRows(myOutputString);
+        addToSummary(myCounts);
+    }
+}
+
+
+// Resets the entry, setting the new position associated with this element.
+void PileupElementBaseQCStats::reset(int32_t refPosition)
+{
+    // Call the base class.
+    PileupElement::reset(refPosition);
+
+    initVars();
+}
+
+void PileupElementBaseQCStats::formatRow(const char* chromosome,
+                                         int32_t refPosition,
+                                         const Counts& counts,
+                                         String& output)
+{
+    if(ourPercentStats)
+    {
+        int32_t startPos = refPosition;
+        output += chromosome;
+        output += "\t";
+        output += startPos;
+        output += "\t";
+        output += startPos + 1;
+        output += "\t";
+        output += counts.depth;
+        output += "\t";
+        output += counts.numQ20;
+        //        output += (double(counts.numQ20))/E9_CALC;
+        output += "\t";
+        if(counts.depth == 0)
         {
-            int32_t startPos = getRefPosition();
-            myOutputString = getChromosome();
-            myOutputString += "\t";
-            myOutputString += startPos;
-            myOutputString += "\t";
-            myOutputString += startPos + 1;
-            myOutputString += "\t";
-            myOutputString += depth;
-            myOutputString += "\t";
-            myOutputString += numQ20;
-            //        myOutputString += (double(numQ20))/E9_CALC;
-            myOutputString += "\t";
-            if(depth == 0)
-            {
-                myOutputString += (double)0;
-            }
-            else
-            {
-                myOutputString += 100 * (double(numQ20))/depth;
-            }
-            myOutputString += "\t";
-            myOutputString += numEntries;
-            //        myOutputString += numEntries/E6_CALC;
-            myOutputString += "\t";
-            myOutputString += numMapped;
-            //        myOutputString += ((double)numMapped)/E9_CALC;
-            myOutputString += "\t";
-            if(numEntries == 0)
-            {
-                myOutputString += "0.000\t0.000\t0.000\t0.000\t0.000\t0.000\t0.000\t0.000";
-            }
-            else
-            {
-                myOutputString += 100 * ((double)numMapped)/numEntries;
-                myOutputString += "\t";
-                myOutputString += 100 * ((double)numMapQPass)/numEntries;
-                myOutputString += "\t";
-                myOutputString += 100 * ((double)numZeroMapQ)/numEntries;
-                myOutputString += "\t";
-                myOutputString += 100 * ((double)numLT10MapQ)/numEntries;
-                myOutputString += "\t";
-                myOutputString += 100 * ((double)numPaired)/numEntries;
-                myOutputString += "\t";
-                myOutputString += 100 * ((double)numProperPaired)/numEntries;
-                myOutputString += "\t";
-                myOutputString += 100 * ((double)numDups)/numEntries;
-                myOutputString += "\t";
-                myOutputString += 100 * ((double)numQCFail)/numEntries;
-            }
-
-            myOutputString += "\t";
-            if(averageMapQCount != 0)
-            {
-                myOutputString += ((double)sumMapQ)/averageMapQCount;
-            }
-            else
-            {
-                myOutputString += "0.000";
-            }
-            myOutputString += "\t";
-            myOutputString += averageMapQCount;
-            // myOutputString += ((double)averageMapQCount)/E9_CALC;
-            myOutputString += "\n";
-        
-            ifprintf(ourOutputFile, myOutputString.c_str());
+            output += (double)0;
         }
         else
         {
-            // Summary stats.
-            int32_t startPos = getRefPosition();
-            myOutputString = getChromosome();
-            myOutputString += "\t";
-            myOutputString += startPos;
-            myOutputString += "\t";
-            myOutputString += startPos + 1;
-            myOutputString += "\t";
-            myOutputString += numEntries;
-            myOutputString += "\t";
-            myOutputString += numDups;
-            myOutputString += "\t";
-            myOutputString += numQCFail;
-            myOutputString += "\t";
-            myOutputString += numMapped;
-            myOutputString += "\t";
-            myOutputString += numPaired;
-            myOutputString += "\t";
-            myOutputString += numProperPaired;
-            myOutputString += "\t";
-            myOutputString += numZeroMapQ;
-            myOutputString += "\t";
-            myOutputString += numLT10MapQ;
-            myOutputString += "\t";
-            myOutputString += numMapQ255;
-            myOutputString += "\t";
-            myOutputString += numMapQPass;
-            myOutputString += "\t";
-            if(averageMapQCount != 0)
-            {
-                myOutputString += ((double)sumMapQ)/averageMapQCount;
-            }
-            else
-            {
-                myOutputString += "0.000";
-            }
-            myOutputString += "\t";
-            myOutputString += averageMapQCount;
-            myOutputString += "\t";
-            myOutputString += depth;
-            myOutputString += "\t";
-            myOutputString += numQ20;
-            myOutputString += "\n";
-        
-            ifprintf(ourOutputFile, myOutputString.c_str());
+            output += 100 * (double(counts.numQ20))/counts.depth;
+        }
+        output += "\t";
+        output += counts.numEntries;
+        //        output += counts.numEntries/E6_CALC;
+        output += "\t";
+        output += counts.numMapped;
+        //        output += ((double)counts.numMapped)/E9_CALC;
+        output += "\t";
+        if(counts.numEntries == 0)
+        {
+            output += "0.000\t0.000\t0.000\t0.000\t0.000\t0.000\t0.000\t0.000";
+        }
+        else
+        {
+            output += 100 * ((double)counts.numMapped)/counts.numEntries;
+            output += "\t";
+            output += 100 * ((double)counts.numMapQPass)/counts.numEntries;
+            output += "\t";
+            output += 100 * ((double)counts.numZeroMapQ)/counts.numEntries;
+            output += "\t";
+            output += 100 * ((double)counts.numLT10MapQ)/counts.numEntries;
+            output += "\t";
+            output += 100 * ((double)counts.numPaired)/counts.numEntries;
+            output += "\t";
+            output += 100 * ((double)counts.numProperPaired)/counts.numEntries;
+            output += "\t";
+            output += 100 * ((double)counts.numDups)/counts.numEntries;
+            output += "\t";
+            output += 100 * ((double)counts.numQCFail)/counts.numEntries;
         }
 
-        if(ourBaseSum)
+        output += "\t";
+        if(counts.averageMapQCount != 0)
+        {
+            output += ((double)counts.sumMapQ)/counts.averageMapQCount;
+        }
+        else
         {
-            // Update the average values.
-            avgTotalReads.Push(numEntries);
-            avgDups.Push(numDups);
-            avgQCFail.Push(numQCFail);
-            avgMapped.Push(numMapped);
-            avgPaired.Push(numPaired);
-            avgProperPaired.Push(numProperPaired);
-            avgZeroMapQ.Push(numZeroMapQ);
-            avgLT10MapQ.Push(numLT10MapQ);
-            avgMapQ255.Push(numMapQ255);
-            avgMapQPass.Push(numMapQPass);
-            avgAvgMapQ.Push( ((double)sumMapQ)/averageMapQCount);
-            avgAvgMapQCount.Push(averageMapQCount);
-            avgDepth.Push(depth);
-            avgQ20.Push(numQ20);
+            output += "0.000";
         }
+        output += "\t";
+        output += counts.averageMapQCount;
+        // output += ((double)counts.averageMapQCount)/E9_CALC;
+        output += "\n";
+    }
+    else
+    {
+        // Summary stats.
+        int32_t startPos = refPosition;
+        output += chromosome;
+        output += "\t";
+        output += startPos;
+        output += "\t";
+        output += startPos + 1;
+        output += "\t";
+        output += counts.numEntries;
+        output += "\t";
+        output += counts.numDups;
+        output += "\t";
+        output += counts.numQCFail;
+        output += "\t";
+        output += counts.numMapped;
+        output += "\t";
+        output += counts.numPaired;
+        output += "\t";
+        output += counts.numProperPaired;
+        output += "\t";
+        output += counts.numZeroMapQ;
+        output += "\t";
+        output += counts.numLT10MapQ;
+        output += "\t";
+        output += counts.numMapQ255;
+        output += "\t";
+        output += counts.numMapQPass;
+        output += "\t";
+        if(counts.averageMapQCount != 0)
+        {
+            output += ((double)counts.sumMapQ)/counts.averageMapQCount;
+        }
+        else
+        {
+            output += "0.000";
+        }
+        output += "\t";
+        output += counts.averageMapQCount;
+        output += "\t";
+        output += counts.depth;
+        output += "\t";
+        output += counts.numQ20;
+        output += "\n";
     }
 }
 
 
-// Resets the entry, setting the new position associated with this element.
-void PileupElementBaseQCStats::reset(int32_t refPosition)
+void PileupElementBaseQCStats::writeRows(const String& rows)
 {
-    // Call the base class.
-    PileupElement::reset(refPosition);
+    if(ourThreadOutput != NULL)
+    {
+        ourThreadOutput->append(rows.c_str(), rows.Length());
+    }
+    else if(rows.Length() != 0)
+    {
+        ifwrite(ourOutputFile, rows.c_str(), rows.Length());
+    }
+}
 
-    initVars();
+
+void PileupElementBaseQCStats::writeBinaryRow(int32_t refID,
+                                              int32_t refPosition,
+                                              const Counts& counts)
+{
+    if(ourThreadOutput != NULL)
+    {
+        BaseQCFile::packRow(refID, refPosition, counts, *ourThreadOutput);
+    }
+    else
+    {
+        ourBinaryOutput->addRow(refID, refPosition, counts);
+    }
 }
 
+
+void PileupElementBaseQCStats::addToSummary(const Counts& counts)
+{
+    if(ourBaseSum)
+    {
+        if(ourThreadSummary != NULL)
+        {
+            ourThreadSummary->push(counts);
+        }
+        else
+        {
+            ourSummary.push(counts);
+        }
+    }
+}
+
+
 void PileupElementBaseQCStats::initVars()
 {
-    numEntries = 0;
-    numQ20 = 0;
-    depth = 0;
-    numDups = 0;
-    numReads = 0;
-    numMapped = 0;
-    numMapQPass = 0;
-    numZeroMapQ = 0;
-    numLT10MapQ = 0;
-    numPaired = 0;
-    numProperPaired = 0;
-    numQCFail = 0;
-    numMapQ255 = 0;
-    sumMapQ = 0;
-    averageMapQCount = 0;
+    myCounts.numEntries = 0;
+    myCounts.numQ20 = 0;
+    myCounts.depth = 0;
+    myCounts.numDups = 0;
+    myCounts.numMapped = 0;
+    myCounts.numMapQPass = 0;
+    myCounts.numZeroMapQ = 0;
+    myCounts.numLT10MapQ = 0;
+    myCounts.numPaired = 0;
+    myCounts.numProperPaired = 0;
+    myCounts.numQCFail = 0;
+    myCounts.numMapQ255 = 0;
+    myCounts.sumMapQ = 0;
+    myCounts.averageMapQCount = 0;
     myOutputString.Clear();
 }
 
@@ -22,12 +22,61 @@
 #ifndef __PILEUP_ELEMENT_BASE_QC_STATS_H__
 #define __PILEUP_ELEMENT_BASE_QC_STATS_H__
 
+#include <string>
+
 #include "PileupElement.h"
-#include "SimpleStats.h"
+#include "MergeableStat.h"
+
+class BaseQCFile;
 
 class PileupElementBaseQCStats : public PileupElement
 {
 public:
+    /// Counts collected for a single reference position.
+    struct Counts
+    {
+        int numEntries;
+        int numQ20;
+        int depth;
+        int numDups;
+        int numMapped;
+        int numMapQPass;
+        int numZeroMapQ;
+        int numLT10MapQ;
+        int numPaired;
+        int numProperPaired;
+        int numQCFail;
+        int numMapQ255;
+        uint64_t sumMapQ;
+        int averageMapQCount;
+    };
+
+    /// Summary of the per base statistics, which can be collected
+    /// separately on each thread and then merged.
+    class Summary
+    {
+    public:
+        void push(const Counts& counts);
+        void merge(const Summary& other);
+        void print();
+
+    private:
+        MergeableStat avgTotalReads; 
+        MergeableStat avgDups;
+        MergeableStat avgQCFail;
+        MergeableStat avgMapped;
+        MergeableStat avgPaired;
+        MergeableStat avgProperPaired;
+        MergeableStat avgZeroMapQ;
+        MergeableStat avgLT10MapQ;
+        MergeableStat avgMapQ255;
+        MergeableStat avgMapQPass;
+        MergeableStat avgAvgMapQ;
+        MergeableStat avgAvgMapQCount;
+        MergeableStat avgDepth;
+        MergeableStat avgQ20;
+    };
+
     /// Set whether or not to filter duplicates (default is to filter them).
     static void filterDups(bool filterDups);
     /// Set whether or not to filter QC failures (default is to filter them).
@@ -40,6 +89,10 @@ public:
     /// Set the output file to the already opened file.
     static void setOutputFile(IFILE outputPtr);
 
+    /// Write the rows to the already opened binary file rather than
+    /// formatting them as text (see BaseQCFile).
+    static void setBinaryOutput(BaseQCFile* binaryOutput);
+
     // Print the output format, make sure you call after setSumStats
     // if you want summary statistics or your output file
     // will have the wrong header..
@@ -54,6 +107,46 @@ public:
     /// Prints a summary to stderr if setBaseSum was passed true.
     static void printSummary();
 
+    /// Get the summary printed by printSummary.
+    static Summary& getSummary() { return(ourSummary); }
+
+    /// For elements analyzed on the calling thread, append the output to
+    /// the specified string and update the specified summary rather
+    /// than writing to the output file/updating the summary returned
+    /// by getSummary.  Pass NULL to go back to the defaults.
+    static void setThreadOutput(std::string* output, Summary* summary);
+
+    /// Append the output row for the specified position and counts.
+    static void formatRow(const char* chromosome, int32_t refPosition,
+                          const Counts& counts, String& output);
+
+    /// Write the already formatted rows to the output for this thread.
+    static void writeRows(const String& rows);
+
+    /// Write the row for the specified position and counts to the binary
+    /// output, or pack it into the thread's output (see BaseQCFile::packRow).
+    static void writeBinaryRow(int32_t refID, int32_t refPosition,
+                               const Counts& counts);
+
+    /// Add the position's counts to the summary for this thread
+    /// if setBaseSum was passed true.
+    static void addToSummary(const Counts& counts);
+
+    /// Minimum quality character for a base to be counted as Q20.
+    static const int Q20_CHAR_VAL = 53;
+
+    /// Returns true if per base output rows are written.
+    static bool hasOutput()
+    { return((ourOutputFile != NULL) || (ourBinaryOutput != NULL)); }
+
+    /// Returns true if per base output rows are written to a binary file.
+    static bool hasBinaryOutput() { return(ourBinaryOutput != NULL); }
+
+    /// Get the minimum mapping quality set by setMapQualFilter.
+    static int getMinMapQuality() { return(ourMinMapQuality); }
+    static bool getFilterDups() { return(ourFilterDups); }
+    static bool getFilterQCFail() { return(ourFilterQCFail); }
+
     PileupElementBaseQCStats();
 
     virtual ~PileupElementBaseQCStats();
@@ -76,44 +169,19 @@ private:
     static bool ourFilterQCFail;
     static int ourMinMapQuality;
     static IFILE ourOutputFile;
+    static BaseQCFile* ourBinaryOutput;
     static bool ourPercentStats;
-    static const int Q20_CHAR_VAL = 53;
     static const int E9_CALC = 1000000000;
     static const int E6_CALC = 1000000;
 
     // These are for summary values.
-    static RunningStat avgTotalReads; 
-    static RunningStat avgDups;
-    static RunningStat avgQCFail;
-    static RunningStat avgMapped;
-    static RunningStat avgPaired;
-    static RunningStat avgProperPaired;
-    static RunningStat avgZeroMapQ;
-    static RunningStat avgLT10MapQ;
-    static RunningStat avgMapQ255;
-    static RunningStat avgMapQPass;
-    static RunningStat avgAvgMapQ;
-    static RunningStat avgAvgMapQCount;
-    static RunningStat avgDepth;
-    static RunningStat avgQ20;
+    static Summary ourSummary;
+    static thread_local std::string* ourThreadOutput;
+    static thread_local Summary* ourThreadSummary;
 
     static bool ourBaseSum;
 
-    int numEntries;
-    int numQ20;
-    int depth;
-    int numDups;
-    int numReads;
-    int numMapped;
-    int numMapQPass;
-    int numZeroMapQ;
-    int numLT10MapQ;
-    int numPaired;
-    int numProperPaired;
-    int numQCFail;
-    int numMapQ255;
-    uint64_t sumMapQ;
-    int averageMapQCount;
+    Counts myCounts;
 
     String myOutputString;
 };
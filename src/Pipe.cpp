@@ -0,0 +1,316 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//////////////////////////////////////////////////////////////////////////
+// This file contains the processing for the executable option "pipe"
+// which runs several tools, passing the records written by each tool
+// to the next without compressing them.
+//
+// Each stage runs in its own process (the tools keep global state, so
+// they cannot share one) connected to the next stage by a pipe carrying
+// uncompressed BAM, so only the first stage decompresses and only the
+// last stage compresses.
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include "Pipe.h"
+#include "ThreadedSamFile.h"
+
+// Defined in Main.cpp.
+extern BamExecutable* CreateBamExe(const std::string& name);
+
+const char* Pipe::THEN_ARG = "--then";
+
+void Pipe::printPipeDescription(std::ostream& os)
+{
+    os << " pipe - Run multiple tools, passing records between them without recompressing" << std::endl;
+}
+
+
+void Pipe::printDescription(std::ostream& os)
+{
+    printPipeDescription(os);
+}
+
+
+void Pipe::printUsage(std::ostream& os)
+{
+    BamExecutable::printUsage(os);
+    os << "\t./bam pipe <tool> <tool arguments> --then <tool> <tool arguments> [--then <tool> <tool arguments>...]" << std::endl;
+    os << "\tThe first tool is run with its --in and the last tool with its --out as specified." << std::endl;
+    os << "\tEach other tool's --out is passed to the next tool's --in as uncompressed BAM," << std::endl;
+    os << "\tso do not specify --out except for the last tool or --in except for the first tool." << std::endl;
+    os << "\tOnly tools that read their input once and write records to --out can be" << std::endl;
+    os << "\tpiped (for example convert, filter, revert, squeeze, dedup --onePass, and" << std::endl;
+    os << "\trecab --buildSample or --loadTable).  dedup --recab needs a second pass, so to" << std::endl;
+    os << "\trecalibrate after dedup in a pipe, run recab --buildSample as the next tool." << std::endl;
+    os << "\tExamples:" << std::endl;
+    os << "\t\t./bam pipe revert --in in.bam --cigar --qual --then squeeze --binMid --then convert --out out.bam" << std::endl;
+    os << "\t\t./bam pipe polishBam --in in.bam --fasta ref.fa --then dedup --onePass --then recab --refFile ref.fa --buildSample 1000000 --then squeeze --out out.bam" << std::endl;
+}
+
+
+int Pipe::execute(int argc, char **argv)
+{
+    // Split the arguments (after "bam pipe") into stages.
+    std::vector<std::vector<char*> > stages(1);
+    for(int i = 2; i < argc; i++)
+    {
+        if(strcmp(argv[i], THEN_ARG) == 0)
+        {
+            stages.push_back(std::vector<char*>());
+        }
+        else
+        {
+            stages.back().push_back(argv[i]);
+        }
+    }
+
+    if(stages.size() < 2)
+    {
+        printUsage(std::cerr);
+        std::cerr << "\nAt least 2 tools must be specified, separated by "
+                  << THEN_ARG << ".\n";
+        return(-1);
+    }
+
+    for(unsigned int stage = 0; stage < stages.size(); stage++)
+    {
+        std::vector<char*>& stageArgs = stages[stage];
+        BamExecutable* bamExe = NULL;
+        std::string tool;
+        if(!stageArgs.empty() && (strcmp(stageArgs[0], "pipe") != 0))
+        {
+            tool = stageArgs[0];
+            std::transform(tool.begin(), tool.end(), tool.begin(), ::tolower);
+            bamExe = CreateBamExe(tool);
+        }
+        if(bamExe == NULL)
+        {
+            printUsage(std::cerr);
+            std::cerr << "\nInvalid tool for pipe stage " << stage + 1
+                      << ".\n";
+            return(-1);
+        }
+        delete bamExe;
+
+        for(unsigned int i = 1; i < stageArgs.size(); i++)
+        {
+            if(((stage != 0) && (strcmp(stageArgs[i], "--in") == 0)) ||
+               ((stage != stages.size() - 1) &&
+                (strcmp(stageArgs[i], "--out") == 0)))
+            {
+                printUsage(std::cerr);
+                std::cerr << "\nPipe stage " << stage + 1 << " ("
+                          << stageArgs[0] << ") cannot specify "
+                          << stageArgs[i] << ".\n";
+                return(-1);
+            }
+        }
+
+        // The stages after the first read a pipe, which can be read once.
+        if((stage != 0) && (tool == "dedup") &&
+           (!hasArg(stageArgs, "--onePass") || hasArg(stageArgs, "--recab")))
+        {
+            printUsage(std::cerr);
+            std::cerr << "\nPipe stage " << stage + 1 << " (dedup) reads a pipe, "
+                      << "so it must use --onePass, which cannot be used with --recab.\n"
+                      << "To recalibrate, add " << THEN_ARG
+                      << " recab --buildSample <numRecords> after it.\n";
+            return(-1);
+        }
+        if((stage != 0) && (tool == "recab") &&
+           !hasArg(stageArgs, "--buildSample") && !hasArg(stageArgs, "--loadTable"))
+        {
+            printUsage(std::cerr);
+            std::cerr << "\nPipe stage " << stage + 1 << " (recab) reads a pipe, "
+                      << "so it must use --buildSample or --loadTable.\n";
+            return(-1);
+        }
+    }
+
+    // Create a pipe between each pair of stages.
+    std::vector<int> pipeFds;
+    for(unsigned int i = 0; i < stages.size() - 1; i++)
+    {
+        int fds[2];
+        if(pipe(fds) != 0)
+        {
+            std::cerr << "Failed to create a pipe: " << strerror(errno)
+                      << std::endl;
+            for(unsigned int j = 0; j < pipeFds.size(); j++)
+            {
+                close(pipeFds[j]);
+            }
+            return(-1);
+        }
+        pipeFds.push_back(fds[0]);
+        pipeFds.push_back(fds[1]);
+    }
+
+    // Do not duplicate any buffered output in the children.
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(NULL);
+
+    std::vector<pid_t> pids;
+    for(unsigned int stage = 0; stage < stages.size(); stage++)
+    {
+        // Read from the previous pipe and write to the next one.
+        std::string inName;
+        std::string outName;
+        int inFd = -1;
+        int outFd = -1;
+        if(stage != 0)
+        {
+            inFd = pipeFds[(stage - 1) * 2];
+            inName = ThreadedSamFile::getPipeName(inFd);
+        }
+        if(stage != stages.size() - 1)
+        {
+            outFd = pipeFds[(stage * 2) + 1];
+            outName = ThreadedSamFile::getPipeName(outFd);
+        }
+
+        pid_t pid = fork();
+        if(pid < 0)
+        {
+            std::cerr << "Failed to start pipe stage " << stage + 1
+                      << ": " << strerror(errno) << std::endl;
+            break;
+        }
+        if(pid == 0)
+        {
+            for(unsigned int i = 0; i < pipeFds.size(); i++)
+            {
+                if((pipeFds[i] != inFd) && (pipeFds[i] != outFd))
+                {
+                    close(pipeFds[i]);
+                }
+            }
+            // A write to a stage that exited returns an error instead of
+            // killing this stage.
+            signal(SIGPIPE, SIG_IGN);
+
+            std::vector<char*>& stageArgs = stages[stage];
+            char inArg[] = "--in";
+            char outArg[] = "--out";
+            if(inFd >= 0)
+            {
+                stageArgs.push_back(inArg);
+                stageArgs.push_back(&(inName[0]));
+            }
+            if(outFd >= 0)
+            {
+                stageArgs.push_back(outArg);
+                stageArgs.push_back(&(outName[0]));
+            }
+            exit(runStage(argv[0], stageArgs));
+        }
+        pids.push_back(pid);
+    }
+
+    // Only the stages use the pipes.
+    for(unsigned int i = 0; i < pipeFds.size(); i++)
+    {
+        close(pipeFds[i]);
+    }
+
+    int ret = (pids.size() == stages.size()) ? 0 : -1;
+    for(unsigned int stage = 0; stage < pids.size(); stage++)
+    {
+        int status = 0;
+        while(waitpid(pids[stage], &status, 0) < 0)
+        {
+            if(errno != EINTR)
+            {
+                status = -1;
+                break;
+            }
+        }
+        if(WIFEXITED(status) && (WEXITSTATUS(status) == 0))
+        {
+            continue;
+        }
+        ret = -1;
+        std::cerr << "Pipe stage " << stage + 1 << " ("
+                  << stages[stage][0] << ") ";
+        if(WIFSIGNALED(status))
+        {
+            std::cerr << "was killed by signal " << WTERMSIG(status)
+                      << std::endl;
+        }
+        else
+        {
+            std::cerr << "failed" << std::endl;
+        }
+    }
+    return(ret);
+}
+
+
+bool Pipe::hasArg(const std::vector<char*>& stageArgs, const char* arg)
+{
+    for(unsigned int i = 1; i < stageArgs.size(); i++)
+    {
+        if(strcmp(stageArgs[i], arg) == 0)
+        {
+            return(true);
+        }
+    }
+    return(false);
+}
+
+
+int Pipe::runStage(char* programName, std::vector<char*>& stageArgs)
+{
+    std::string tool = stageArgs[0];
+    std::transform(tool.begin(), tool.end(), tool.begin(), ::tolower);
+    BamExecutable* bamExe = CreateBamExe(tool);
+
+    // Set up the arguments as if the tool was run directly.
+    std::vector<char*> args;
+    args.push_back(programName);
+    args.insert(args.end(), stageArgs.begin(), stageArgs.end());
+    args.push_back(NULL);
+
+    int ret = 0;
+    try
+    {
+        ret = bamExe->execute(args.size() - 1, &(args[0]));
+    }
+    catch (std::runtime_error e)
+    {
+        std::string errorMsg = "Exiting due to ERROR:\n\t";
+        errorMsg += e.what();
+        std::cerr << errorMsg << std::endl;
+        ret = -1;
+    }
+    delete bamExe;
+    std::cout.flush();
+    std::cerr.flush();
+    return(ret);
+}
@@ -0,0 +1,51 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//////////////////////////////////////////////////////////////////////////
+// This file contains the processing for the executable option "pipe"
+// which runs several tools, passing the records written by each tool
+// to the next without compressing them.
+
+#ifndef __PIPE_H__
+#define __PIPE_H__
+
+#include <string>
+#include <vector>
+
+#include "BamExecutable.h"
+
+class Pipe : public BamExecutable
+{
+public:
+    static void printPipeDescription(std::ostream& os);
+    void printDescription(std::ostream& os);
+    void printUsage(std::ostream& os);
+    int execute(int argc, char **argv);
+    virtual const char* getProgramName() {return("bam:pipe");}
+
+private:
+    static const char* THEN_ARG;
+
+    // Return true if the stage's arguments (after the tool) include arg.
+    static bool hasArg(const std::vector<char*>& stageArgs, const char* arg);
+
+    // Run the specified stage in this (child) process, returning its
+    // exit status.
+    int runStage(char* programName, std::vector<char*>& stageArgs);
+};
+
+#endif
@@ -21,8 +21,13 @@
 #include <cstdlib>
 #include <unistd.h>
 #include <getopt.h>
+#include <sys/stat.h>
+#include <atomic>
 #include "CSG_MD5.h"
-#include "SamFile.h"
+#include "ThreadedSamFile.h"
+#include "ParallelBgzf.h"
+#include "BamIndexBuilder.h"
+#include "BamRecordEditor.h"
 #include "PolishBam.h"
 #include "Logger.h"
 #include "PhoneHome.h"
@@ -38,107 +43,223 @@ public:
   std::vector<std::string> vsSequenceNames;
   std::vector<std::string> vsMD5sums;
   std::vector<uint32_t> vnSequenceLengths;
-  std::ifstream ifsIn;
-  char* pcLine;
-  static const uint32_t nDefaultMaxLineLength = 100000;
-  uint32_t nMaxLineLength;
-
-  MD5_CTX curMD5Ctx;
-  std::string curSeqName;
-  uint32_t curSeqLength;
-  int curSeqIndex;
-  uint32_t nCurrentLine;
-
-  FastaFile() : pcLine(NULL), nMaxLineLength(nDefaultMaxLineLength) {}
-  ~FastaFile() {close();}
+  // file offsets of the first base and the end of each sequence
+  std::vector<uint64_t> vnSequenceStarts;
+  std::vector<uint64_t> vnSequenceEnds;
+  uint64_t nFileSize;
+  int64_t nModTime;
+  static const uint32_t nBufferSize = 1048576;
+
+  FastaFile() : nFileSize(0), nModTime(0) {}
   bool open(const char* fileName);
-  void close() {freeBuffer();}
-  void allocateBuffer(int bufLength = nDefaultMaxLineLength);
-  void freeBuffer();
-  bool readLine();
-  void readThru();
-  void updateCurrentSequenceInfo();
+  bool readCache(const char* cacheName);
+  bool writeCache(const char* cacheName);
+  bool readThru(int numThreads);
   static uint32_t tokenizeString(const char* s, 
                                  std::vector<std::string>& tokens);
+private:
+  bool indexSequences();
+  bool hashSequence(FILE* fp, uint32_t index, std::vector<char>& buffer);
 };
 
 bool FastaFile::open(const char* fileName) {
-  if ( sFileName.empty() && ( pcLine == NULL ) ) {
+  struct stat fileStat;
+  if ( sFileName.empty() && ( stat(fileName, &fileStat) == 0 ) ) {
     sFileName = fileName;
-    ifsIn.open(fileName, std::ios::in);
-    if ( ifsIn.good() ) {
-      nCurrentLine = 0;
-      curSeqIndex = -1;
-      curSeqLength = 0;
-      allocateBuffer();
-      return true;
-    }
-    else {
-      return false;
-    }
+    nFileSize = fileStat.st_size;
+    nModTime = fileStat.st_mtime;
+    return true;
   }
   else {
     return false;
   }
 }
 
-void FastaFile::allocateBuffer(int bufLength) {
-  freeBuffer();
-  pcLine = new char[bufLength];
-  nMaxLineLength = bufLength;
+// The cache starts with the size and modification time of the reference
+// it was computed from, followed by the name, length and MD5 of each
+// sequence, tab separated.
+bool FastaFile::readCache(const char* cacheName) {
+  std::ifstream ifsCache(cacheName, std::ios::in);
+  std::string line;
+  char key[256];
+  sprintf(key, "#refInfo\t%llu\t%lld", (unsigned long long)nFileSize,
+          (long long)nModTime);
+  if ( ( ! std::getline(ifsCache, line) ) || ( line.compare(key) != 0 ) ) {
+    return false;
+  }
+  while( std::getline(ifsCache, line) ) {
+    size_t tab1 = line.find('\t');
+    size_t tab2 = ( tab1 == std::string::npos ) ? tab1 : line.find('\t', tab1+1);
+    if ( ( tab2 == std::string::npos ) || ( line.size() - tab2 - 1 != 32 ) ) {
+      vsSequenceNames.clear();
+      vnSequenceLengths.clear();
+      vsMD5sums.clear();
+      return false;
+    }
+    vsSequenceNames.push_back(line.substr(0, tab1));
+    vnSequenceLengths.push_back(strtoul(line.c_str() + tab1 + 1, NULL, 10));
+    vsMD5sums.push_back(line.substr(tab2+1));
+  }
+  return ( ! vsSequenceNames.empty() );
 }
 
-void FastaFile::freeBuffer() {
-  if ( pcLine != NULL ) {
-    delete[] pcLine;
-    pcLine = NULL;
+bool FastaFile::writeCache(const char* cacheName) {
+  // write to a temporary file first so a concurrent reader never sees
+  // a partial cache.
+  char tmpName[32];
+  sprintf(tmpName, ".%d", static_cast<int>(getpid()));
+  std::string sTmpName(cacheName);
+  sTmpName += tmpName;
+  FILE* fp = fopen(sTmpName.c_str(), "w");
+  if ( fp == NULL ) {
+    return false;
+  }
+  bool success = ( fprintf(fp, "#refInfo\t%llu\t%lld\n", (unsigned long long)nFileSize,
+                           (long long)nModTime) > 0 );
+  for(uint32_t i=0; success && ( i < vsSequenceNames.size() ); ++i) {
+    success = ( fprintf(fp, "%s\t%u\t%s\n", vsSequenceNames[i].c_str(),
+                        vnSequenceLengths[i], vsMD5sums[i].c_str()) > 0 );
   }
+  success = ( fclose(fp) == 0 ) && success;
+  if ( success && ( rename(sTmpName.c_str(), cacheName) == 0 ) ) {
+    return true;
+  }
+  remove(sTmpName.c_str());
+  return false;
 }
 
-bool FastaFile::readLine() {
-  int n;
-
-  ifsIn.getline(pcLine, nMaxLineLength);
-  if ( pcLine[0] == '>' ) {
-    if ( curSeqIndex >= 0 ) {
-      updateCurrentSequenceInfo();
+// Find the name and the range of bases of each sequence.
+bool FastaFile::indexSequences() {
+  FILE* fp = fopen(sFileName.c_str(), "rb");
+  if ( fp == NULL ) {
+    return false;
+  }
+  std::vector<char> buffer(nBufferSize);
+  std::string headerLine;
+  bool lineStart = true;
+  bool inHeader = false;
+  uint64_t offset = 0;
+  size_t n;
+  while( ( n = fread(&(buffer[0]), 1, buffer.size(), fp) ) > 0 ) {
+    char* pos = &(buffer[0]);
+    char* end = pos + n;
+    while( pos < end ) {
+      if ( lineStart && ( *pos == '>' ) ) {
+        if ( ! vnSequenceStarts.empty() ) {
+          vnSequenceEnds.push_back(offset + (pos - &(buffer[0])));
+        }
+        inHeader = true;
+        headerLine.clear();
+      }
+      char* lineEnd = (char*)memchr(pos, '\n', end - pos);
+      if ( lineEnd == NULL ) {
+        if ( inHeader ) {
+          headerLine.append(pos, end - pos);
+        }
+        lineStart = false;
+        break;
+      }
+      if ( inHeader ) {
+        headerLine.append(pos, lineEnd - pos);
+        std::vector<std::string> tokens;
+        tokenizeString(headerLine.c_str(), tokens);
+        // make SeqName without leading '>'
+        vsSequenceNames.push_back(tokens.empty() ? std::string() : tokens[0].substr(1));
+        vnSequenceStarts.push_back(offset + (lineEnd + 1 - &(buffer[0])));
+        inHeader = false;
+      }
+      lineStart = true;
+      pos = lineEnd + 1;
     }
+    offset += n;
+  }
+  bool success = ( ferror(fp) == 0 );
+  fclose(fp);
+  if ( inHeader ) {
+    // the last header has no sequence
     std::vector<std::string> tokens;
-    tokenizeString(pcLine, tokens);
-    curSeqName = tokens[0].substr(1); // make SeqName without leading '>'
-    MD5Init(&curMD5Ctx);
-    curSeqLength = 0;
-    ++curSeqIndex;
+    tokenizeString(headerLine.c_str(), tokens);
+    vsSequenceNames.push_back(tokens.empty() ? std::string() : tokens[0].substr(1));
+    vnSequenceStarts.push_back(offset);
   }
-  else {
-    n = strlen(pcLine);
-    // convert to upper-case for calculating FASTA MD5
-    for(int i = 0; i < n; ++i)
-    {
-        pcLine[i] = toupper(pcLine[i]);
-    }
-    MD5Update(&curMD5Ctx, (unsigned char*)pcLine, n);
-    curSeqLength += n;
+  if ( ! vnSequenceStarts.empty() ) {
+    vnSequenceEnds.push_back(offset);
   }
-  ++nCurrentLine;
-  return ifsIn.good();
+  return success;
 }
 
-void FastaFile::readThru() {
-    while(readLine());
-    updateCurrentSequenceInfo();
-}
+// Compute the length and the MD5 of the upper-cased bases of a sequence.
+bool FastaFile::hashSequence(FILE* fp, uint32_t index, std::vector<char>& buffer) {
+  if ( fseeko(fp, vnSequenceStarts[index], SEEK_SET) != 0 ) {
+    return false;
+  }
+  MD5_CTX md5Ctx;
+  MD5Init(&md5Ctx);
+  uint32_t seqLength = 0;
+  uint64_t remaining = vnSequenceEnds[index] - vnSequenceStarts[index];
+  while( remaining > 0 ) {
+    size_t n = fread(&(buffer[0]), 1,
+                     ( remaining < buffer.size() ) ? remaining : buffer.size(), fp);
+    if ( n == 0 ) {
+      return false;
+    }
+    remaining -= n;
+    // drop the newlines and convert to upper-case in place
+    uint32_t numBases = 0;
+    for(size_t i = 0; i < n; ++i) {
+      if ( buffer[i] != '\n' ) {
+        buffer[numBases++] = toupper(buffer[i]);
+      }
+    }
+    MD5Update(&md5Ctx, (unsigned char*)&(buffer[0]), numBases);
+    seqLength += numBases;
+  }
 
-void FastaFile::updateCurrentSequenceInfo() {
-  unsigned char md5digest[1024];
-  char md5string[1024];
-  vsSequenceNames.push_back(curSeqName);
-  vnSequenceLengths.push_back(curSeqLength);
-  MD5Final(md5digest, &curMD5Ctx);
+  unsigned char md5digest[16];
+  char md5string[33];
+  MD5Final(md5digest, &md5Ctx);
   for(int i=0; i < 16; ++i) {
     sprintf(&md5string[i*2],"%02x",static_cast<int>(md5digest[i]));
   }
-  vsMD5sums.push_back(md5string);
+  vnSequenceLengths[index] = seqLength;
+  vsMD5sums[index] = md5string;
+  return true;
+}
+
+// Compute the sequence MD5s, hashing numThreads sequences at a time.
+bool FastaFile::readThru(int numThreads) {
+  if ( ! indexSequences() ) {
+    return false;
+  }
+  vnSequenceLengths.assign(vsSequenceNames.size(), 0);
+  vsMD5sums.assign(vsSequenceNames.size(), std::string());
+  if ( numThreads > static_cast<int>(vsSequenceNames.size()) ) {
+    numThreads = vsSequenceNames.size();
+  }
+  if ( numThreads == 0 ) {
+    return true;
+  }
+
+  // each worker hashes whole sequences with its own file handle.
+  std::atomic<uint32_t> nextSeq(0);
+  std::atomic<bool> failed(false);
+  BamExecutable::runWorkers([&]()
+    {
+      FILE* fp = fopen(sFileName.c_str(), "rb");
+      if ( fp == NULL ) {
+        failed = true;
+        return;
+      }
+      std::vector<char> buffer(nBufferSize);
+      uint32_t index;
+      while( ( ! failed ) && ( ( index = nextSeq++ ) < vsSequenceNames.size() ) ) {
+        if ( ! hashSequence(fp, index, buffer) ) {
+          failed = true;
+        }
+      }
+      fclose(fp);
+    }, numThreads);
+  return ( ! failed );
 }
 
 uint32_t FastaFile::tokenizeString(const char* s, 
@@ -219,7 +340,11 @@ void PolishBam::printUsage(std::ostream& os)
     os << "--AS : AS tag for genome assembly identifier" << std::endl;
     os << "--UR : UR tag for @SQ tag (if different from --fasta)" << std::endl;
     os << "--SP : SP tag for @SQ tag" << std:: endl;
+    os << "--noRefCache : do not read or write the <fasta>.refinfo cache of reference names, lengths, and MD5sums" << std::endl;
     os << "--checkSQ : check the consistency of SQ tags (SN and LN) with existing header lines. Must be used with --fasta option" << std::endl;
+    os << "--headerOnly : only rewrite the header, copying the compressed records of a BAM file unchanged. Cannot be used with --RG" << std::endl;
+    os << "--index : index the coordinate sorted BAM output as it is written (<outBamFile>.bai, or .csi if a reference is longer than 512Mb)." << std::endl;
+    os << "          With --headerOnly, the output is indexed by reading it back since the records are copied" << std::endl;
     os << "\n" << std::endl;
 }
 
@@ -281,6 +406,9 @@ int PolishBam::execute(int argc, char ** argv)
       { "PG", required_argument, NULL, 0},
       { "CO", required_argument, NULL, 0},
       { "checkSQ", no_argument, NULL, 0},
+      { "headerOnly", no_argument, NULL, 0},
+      { "noRefCache", no_argument, NULL, 0},
+      { "index", no_argument, NULL, 0},
       { "noPhoneHome", no_argument, NULL, 'p'},
       { "nophonehome", no_argument, NULL, 'P'},
       { "phoneHomeThinning", required_argument, NULL, 't'},
@@ -295,11 +423,12 @@ int PolishBam::execute(int argc, char ** argv)
   int n_option_index = 0, c;
   
   std::string sAS, sUR, sSP, sFasta, sInFile, sOutFile, sLogFile;
-  bool bClear, bCheckSQ, bVerbose;
+  bool bClear, bCheckSQ, bVerbose, bHeaderOnly, bNoRefCache;
   std::vector<std::string> vsHDHeaders, vsRGHeaders, vsPGHeaders, vsCOHeaders;
   bool noPhoneHome = false;
+  bool bIndex = false;
 
-  bCheckSQ = bVerbose = false;
+  bCheckSQ = bVerbose = bHeaderOnly = bNoRefCache = false;
   bClear = true;
 
   while ( (c = getopt_long(argc, argv, "vf:i:o:l:", getopt_long_options, &n_option_index)) != -1 ) {
@@ -349,6 +478,15 @@ int PolishBam::execute(int argc, char ** argv)
     else if ( strcmp(getopt_long_options[n_option_index].name,"checkSQ") == 0 ) {
       bCheckSQ = true;
     }
+    else if ( strcmp(getopt_long_options[n_option_index].name,"headerOnly") == 0 ) {
+      bHeaderOnly = true;
+    }
+    else if ( strcmp(getopt_long_options[n_option_index].name,"noRefCache") == 0 ) {
+      bNoRefCache = true;
+    }
+    else if ( strcmp(getopt_long_options[n_option_index].name,"index") == 0 ) {
+      bIndex = true;
+    }
     else {
       std::cerr << "Error: Unrecognized option " << getopt_long_options[n_option_index].name << std::endl;
       return(-1);
@@ -362,7 +500,7 @@ int PolishBam::execute(int argc, char ** argv)
 
   if ((sLogFile.compare("__NONE__") == 0) ||  sLogFile.empty())
   {
-      if(sOutFile.empty())
+      if(sOutFile.empty() || ThreadedSamFile::isPipeName(sOutFile.c_str()))
       {
           sLogFile = "-";
       }
@@ -389,6 +527,11 @@ int PolishBam::execute(int argc, char ** argv)
     Logger::gLogger->error("--checkSQ option must be used with --fasta option");
   }
 
+  if ( ( bHeaderOnly ) && ( ! vsRGHeaders.empty() ) ) {
+    printUsage(std::cerr);
+    Logger::gLogger->error("--headerOnly option cannot be used with --RG option since the RG tag is added to every record");
+  }
+
   // check whether each header line starts with a correct tag
   checkHeaderStarts(vsHDHeaders, "@HD\t");
   checkHeaderStarts(vsRGHeaders, "@RG\t");
@@ -404,6 +547,15 @@ int PolishBam::execute(int argc, char ** argv)
   Logger::gLogger->writeLog("\t--UR [%s]",sUR.c_str());
   Logger::gLogger->writeLog("\t--SP [%s]",sSP.c_str());
   Logger::gLogger->writeLog("\t--checkSQ [%s]",bClear ? "ON" : "OFF" );
+  if ( bHeaderOnly ) {
+    Logger::gLogger->writeLog("\t--headerOnly [ON]");
+  }
+  if ( bNoRefCache ) {
+    Logger::gLogger->writeLog("\t--noRefCache [ON]");
+  }
+  if ( bIndex ) {
+    Logger::gLogger->writeLog("\t--index [ON]");
+  }
   if ( vsHDHeaders.empty() ) {
     Logger::gLogger->writeLog("\t--HD []");
   }
@@ -445,8 +597,17 @@ int PolishBam::execute(int argc, char ** argv)
   if ( ! sFasta.empty() ) {
     if ( fastaFile.open(sFasta.c_str()) ) {
       Logger::gLogger->writeLog("Reading the reference file %s",sFasta.c_str());
-      fastaFile.readThru();
-      fastaFile.close();
+      // The cache is reused while the size and modification time of the
+      // reference are unchanged.
+      std::string sCache = sFasta + ".refinfo";
+      if ( bNoRefCache || ( ! fastaFile.readCache(sCache.c_str()) ) ) {
+        if ( ! fastaFile.readThru(getNumThreads()) ) {
+          Logger::gLogger->error("Failed to read reference file %s",sFasta.c_str());
+        }
+        if ( ( ! bNoRefCache ) && ( ! fastaFile.writeCache(sCache.c_str()) ) ) {
+          Logger::gLogger->warning("Failed to write the reference cache %s",sCache.c_str());
+        }
+      }
       Logger::gLogger->writeLog("Finished reading the reference file %s",sFasta.c_str());      
     }
     else {
@@ -454,13 +615,14 @@ int PolishBam::execute(int argc, char ** argv)
     }
   }
 
-  SamFile samIn;
-  SamFile samOut;
+  ThreadedSamFile samIn;
+  ThreadedSamFile samOut;
+  samOut.setWriteIndex(bIndex);
 
   if ( ! samIn.OpenForRead(sInFile.c_str()) ) {
     Logger::gLogger->error("Cannot open BAM file %s for reading - %s",sInFile.c_str(), SamStatus::getStatusString(samIn.GetStatus()) );
   }
-  if ( ! samOut.OpenForWrite(sOutFile.c_str()) ) {
+  if ( ( ! bHeaderOnly ) && ( ! samOut.OpenForWrite(sOutFile.c_str()) ) ) {
     Logger::gLogger->error("Cannot open BAM file %s for writing - %s",sOutFile.c_str(), SamStatus::getStatusString(samOut.GetStatus()) );
   }
 
@@ -571,6 +733,24 @@ int PolishBam::execute(int argc, char ** argv)
       }
   }
 
+  if ( bHeaderOnly ) {
+    samIn.Close();
+    Logger::gLogger->writeLog("Successfully added %d HD, %d RG, %d PG, and %d CO headers",numHdSuccess, numRgSuccess, numPgSuccess, numCoSuccess);
+    Logger::gLogger->writeLog("Copying the records of %s without decoding them",sInFile.c_str());
+    copyWithNewHeader(sInFile.c_str(), sOutFile.c_str(), samHeader);
+    Logger::gLogger->writeLog("Finished writing output BAM file");
+    if ( bIndex ) {
+      BamIndexBuilder builder;
+      bool csi = BamIndexBuilder::needsCsi(samHeader);
+      std::string indexFile = BamIndexBuilder::getDefaultName(sOutFile.c_str(), csi);
+      if ( ! builder.build(sOutFile.c_str(), indexFile.c_str(), csi) ) {
+        Logger::gLogger->error("Failed to index %s",sOutFile.c_str());
+      }
+    }
+    delete Logger::gLogger;
+    return 0;
+  }
+
   samOut.WriteHeader(samHeader);
   Logger::gLogger->writeLog("Successfully added %d HD, %d RG, %d PG, and %d CO headers",numHdSuccess, numRgSuccess, numPgSuccess, numCoSuccess);
   Logger::gLogger->writeLog("Finished writing output headers");
@@ -589,10 +769,16 @@ int PolishBam::execute(int argc, char ** argv)
   
   Logger::gLogger->writeLog("Writing output BAM file");
   SamRecord samRecord;
+  BamRecordEditor editor;
   while (samIn.ReadRecord(samHeader, samRecord) == true) {
     if ( !sRGID.empty() ) {
-      if ( samRecord.addTag("RG",'Z',sRGID.c_str()) == false ) {
-	Logger::gLogger->error("Failed to add a RG tag %s",sRGID.c_str());
+      // set the RG tag directly in the BAM record
+      if ( !editor.load(samRecord) ) {
+	Logger::gLogger->error("Failed to add a RG tag %s: %s",sRGID.c_str(),editor.getStatus().getStatusMessage());
+      }
+      editor.setStringTag("RG",sRGID.c_str());
+      if ( editor.store(samRecord, samHeader) == false ) {
+	Logger::gLogger->error("Failed to add a RG tag %s: %s",sRGID.c_str(),editor.getStatus().getStatusMessage());
       }
       // temporary code added
       if ( strncmp(samRecord.getReadName(),"seqcore_",8) == 0 ) {
@@ -605,7 +791,79 @@ int PolishBam::execute(int argc, char ** argv)
     //if ( samIn.GetCurrentRecordCount() == 1000 ) break;
   }
   samOut.Close();
+  if ( samOut.writeIndexFailed() ) {
+    Logger::gLogger->error("Failed to index %s",sOutFile.c_str());
+  }
   Logger::gLogger->writeLog("Successfully written %d records",samIn.GetCurrentRecordCount());
   delete Logger::gLogger;
   return 0;
 }
+
+
+void PolishBam::copyWithNewHeader(const char* inFile, const char* outFile,
+                                  SamFileHeader& header)
+{
+  if ( ! ParallelBgzf::isBgzfWithEof(inFile) ) {
+    Logger::gLogger->error("--headerOnly option requires a BGZF compressed BAM input file, %s is not",inFile);
+  }
+
+  // Skip over the original header, checking it has the same references
+  // since the records refer to them by index.
+  ParallelBgzfReader bamIn;
+  if ( ! bamIn.open(inFile) ) {
+    Logger::gLogger->error("Cannot open BAM file %s for reading",inFile);
+  }
+  char magic[4];
+  int32_t textLen = 0;
+  int32_t numRefs = 0;
+  if ( ( bamIn.read(magic, sizeof(magic)) != sizeof(magic) ) ||
+       ( memcmp(magic, "BAM\1", sizeof(magic)) != 0 ) ||
+       ( bamIn.read(&textLen, sizeof(textLen)) != sizeof(textLen) ) ||
+       ( textLen < 0 ) ||
+       ( bamIn.skip(textLen) != (uint32_t)textLen ) ||
+       ( bamIn.read(&numRefs, sizeof(numRefs)) != sizeof(numRefs) ) ) {
+    Logger::gLogger->error("Failed to read the header of BAM file %s",inFile);
+  }
+  const SamReferenceInfo& refInfo = header.getReferenceInfo();
+  if ( numRefs != refInfo.getNumEntries() ) {
+    Logger::gLogger->error("--headerOnly option requires the same references as the original BAM, but the # of references changed from %d to %d",numRefs,refInfo.getNumEntries());
+  }
+  std::vector<char> refName;
+  for(int32_t i=0; i < numRefs; ++i) {
+    int32_t nameLen = 0;
+    int32_t refLen = 0;
+    if ( ( bamIn.read(&nameLen, sizeof(nameLen)) != sizeof(nameLen) ) || ( nameLen <= 0 ) ) {
+      Logger::gLogger->error("Failed to read the header of BAM file %s",inFile);
+    }
+    refName.resize(nameLen);
+    if ( ( bamIn.read(&(refName[0]), nameLen) != (uint32_t)nameLen ) ||
+         ( bamIn.read(&refLen, sizeof(refLen)) != sizeof(refLen) ) ) {
+      Logger::gLogger->error("Failed to read the header of BAM file %s",inFile);
+    }
+    refName[nameLen-1] = '\0';
+    if ( ( strcmp(&(refName[0]), refInfo.getReferenceName(i)) != 0 ) ||
+         ( refLen != refInfo.getReferenceLength(i) ) ) {
+      Logger::gLogger->error("--headerOnly option requires the same references as the original BAM, but reference %d changed from %s",i,&(refName[0]));
+    }
+  }
+
+  // The new header and the records sharing the block that ends the old
+  // header are compressed again, and the remaining blocks are copied.
+  std::vector<char> buffer;
+  if ( ! ThreadedSamFile::getBamHeader(header, buffer) ) {
+    Logger::gLogger->error("Failed to get the header string");
+  }
+  bamIn.readRestOfBlock(buffer);
+  uint64_t copyOffset = bamIn.tell() >> 16;
+  bamIn.close();
+
+  ParallelBgzfWriter bamOut;
+  if ( ! bamOut.open(outFile) ) {
+    Logger::gLogger->error("Cannot open BAM file %s for writing",outFile);
+  }
+  if ( ( ! bamOut.write(&(buffer[0]), buffer.size()) ) ||
+       ( ! bamOut.appendFile(inFile, copyOffset) ) ||
+       ( ! bamOut.close() ) ) {
+    Logger::gLogger->error("Failed to write BAM file %s",outFile);
+  }
+}
@@ -23,6 +23,7 @@
 #define __POLISH_BAM_H__
 
 #include "BamExecutable.h"
+#include "SamFileHeader.h"
 
 class PolishBam : public BamExecutable
 {
@@ -32,6 +33,13 @@ public:
     void printUsage(std::ostream& os);
     int execute(int argc, char **argv);
     virtual const char* getProgramName() {return("bam:polishBam");}
+
+private:
+    // Write the input BAM file with the new header to the output, copying
+    // the compressed blocks of records after the header unchanged.
+    // Logs an error if the references of the header differ from the input.
+    static void copyWithNewHeader(const char* inFile, const char* outFile,
+                                  SamFileHeader& header);
 };
 
 #endif
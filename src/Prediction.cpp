@@ -61,6 +61,43 @@ int Prediction::fitModel(bool writeModelFlag, std::string& filename)
 	return 0;
 }
 
+int Prediction::fitReadGroupModels(ThreadPool& pool, int numRG)
+{
+  int nrrounds = 30;
+
+  rgModels.assign(numRG, std::vector<double>());
+
+  // Each read group is fit with its own data and workspace, only reading
+  // the (unchanging) error model.
+  std::vector< std::future<void> > fits;
+  for(int rg = 0; rg < numRG; rg++)
+  {
+    fits.push_back(pool.submit([this, rg, nrrounds]()
+      {
+        Matrix rgX;
+        Vector rgSucc;
+        Vector rgTotal;
+        LogisticRegression rgEngine;
+        phasherrormodel->setDataforPrediction(rgX, rgSucc, rgTotal, false, rg);
+        if((rgX.rows > 0) && 
+           rgEngine.FitLogisticModel(rgX, rgSucc, rgTotal, nrrounds))
+        {
+          for(int i=0;i<rgEngine.B.Length();i++)
+            rgModels[rg].push_back(rgEngine.B[i]);
+        }
+      }));
+  }
+
+  int numFit = 0;
+  for(int rg = 0; rg < numRG; rg++)
+  {
+    fits[rg].get();
+    if(!rgModels[rg].empty())
+      ++numFit;
+  }
+  return numFit;
+}
+
 void Prediction::setErrorModel(HashErrorModel *phasherrormodel)
 {
    this->phasherrormodel = phasherrormodel;
@@ -25,6 +25,7 @@
 #include "Parameters.h"
 #include "MemoryAllocators.h"
 #include "HashErrorModel.h"
+#include "ThreadPool.h"
 #include <vector>
 
 
@@ -42,12 +43,19 @@ class Prediction {
    // # parameters: slope + # co-variates;
    Matrix X;
 
+   // Model of each read group, empty if it did not converge or had no data.
+   std::vector< std::vector<double> > rgModels;
+
    Prediction(HashErrorModel *phasherrormodel);
    Prediction();
    ~Prediction();
    int fitModel(bool writeModelFlag, std::string& filename);
    void setErrorModel(HashErrorModel *phasherrormodel);
    std::vector<double> getModel();
+   // Fit a separate model for each of the numRG read groups on the pool,
+   // returning the number of read groups whose model converged.
+   int fitReadGroupModels(ThreadPool& pool, int numRG);
+   const std::vector< std::vector<double> >& getReadGroupModels() { return rgModels; }
    int writeLogRegdata(std::string& filename);
 };
 
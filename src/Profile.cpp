@@ -0,0 +1,195 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Profile.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <deque>
+#include <map>
+#include <mutex>
+
+bool Profile::ourEnabled = false;
+std::string Profile::ourReportFile;
+uint64_t Profile::ourStartWallNs = 0;
+
+namespace
+{
+    // Stages are never removed, so references to them stay valid.
+    struct Registry
+    {
+        std::mutex mutex;
+        std::deque<Profile::Stage> stages;
+        std::map<std::string, uint64_t> maxValues;
+    };
+
+    Registry& getRegistry()
+    {
+        static Registry registry;
+        return(registry);
+    }
+
+    uint64_t getNs(clockid_t clock)
+    {
+        struct timespec ts;
+        clock_gettime(clock, &ts);
+        return((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+    }
+
+    double toSeconds(uint64_t ns)
+    {
+        return(ns / 1e9);
+    }
+
+    double toSeconds(const struct timeval& tv)
+    {
+        return(tv.tv_sec + tv.tv_usec / 1e6);
+    }
+
+    void writeJsonString(FILE* fp, const char* str)
+    {
+        fputc('"', fp);
+        for(; *str != '\0'; ++str)
+        {
+            if((*str == '"') || (*str == '\\'))
+            {
+                fputc('\\', fp);
+            }
+            fputc(*str, fp);
+        }
+        fputc('"', fp);
+    }
+}
+
+
+void Profile::Timer::start()
+{
+    myWallStart = getNs(CLOCK_MONOTONIC);
+    myCpuStart = getNs(CLOCK_THREAD_CPUTIME_ID);
+}
+
+
+void Profile::Timer::stop()
+{
+    myStage->cpuNs += getNs(CLOCK_THREAD_CPUTIME_ID) - myCpuStart;
+    myStage->wallNs += getNs(CLOCK_MONOTONIC) - myWallStart;
+    ++(myStage->count);
+}
+
+
+Profile::Stage& Profile::getStage(const char* name)
+{
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for(std::deque<Stage>::iterator it = registry.stages.begin();
+        it != registry.stages.end(); ++it)
+    {
+        if(it->name == std::string(name))
+        {
+            return(*it);
+        }
+    }
+    registry.stages.emplace_back(name);
+    return(registry.stages.back());
+}
+
+
+void Profile::updateMaxValue(const char* name, uint64_t value)
+{
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    uint64_t& maxValue = registry.maxValues[name];
+    if(value > maxValue)
+    {
+        maxValue = value;
+    }
+}
+
+
+void Profile::enable(const std::string& reportFile)
+{
+    ourReportFile = reportFile;
+    ourStartWallNs = getNs(CLOCK_MONOTONIC);
+    ourEnabled = true;
+}
+
+
+void Profile::writeReport(const char* toolName, int numThreads)
+{
+    if(!ourEnabled)
+    {
+        return;
+    }
+    ourEnabled = false;
+
+    FILE* fp = stderr;
+    if(!ourReportFile.empty())
+    {
+        fp = fopen(ourReportFile.c_str(), "w");
+        if(fp == NULL)
+        {
+            fprintf(stderr, "Failed to open the profile report file %s\n",
+                    ourReportFile.c_str());
+            return;
+        }
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    fprintf(fp, "{\n  \"tool\": ");
+    writeJsonString(fp, toolName);
+    fprintf(fp, ",\n  \"threads\": %d", numThreads);
+    fprintf(fp, ",\n  \"wallSeconds\": %.6f", 
+            toSeconds(getNs(CLOCK_MONOTONIC) - ourStartWallNs));
+    fprintf(fp, ",\n  \"userCpuSeconds\": %.6f", toSeconds(usage.ru_utime));
+    fprintf(fp, ",\n  \"systemCpuSeconds\": %.6f", toSeconds(usage.ru_stime));
+    // Linux reports ru_maxrss in KB.
+    fprintf(fp, ",\n  \"peakRssKB\": %ld", usage.ru_maxrss);
+
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    fprintf(fp, ",\n  \"stages\": [");
+    const char* separator = "";
+    for(std::deque<Stage>::iterator it = registry.stages.begin();
+        it != registry.stages.end(); ++it)
+    {
+        fprintf(fp, "%s\n    {\"name\": ", separator);
+        writeJsonString(fp, it->name);
+        fprintf(fp, ", \"count\": %llu, \"wallSeconds\": %.6f, \"cpuSeconds\": %.6f}",
+                (unsigned long long)it->count, toSeconds(it->wallNs),
+                toSeconds(it->cpuNs));
+        separator = ",";
+    }
+    fprintf(fp, "\n  ],\n  \"maxValues\": {");
+    separator = "";
+    for(std::map<std::string, uint64_t>::iterator it = registry.maxValues.begin();
+        it != registry.maxValues.end(); ++it)
+    {
+        fprintf(fp, "%s\n    ", separator);
+        writeJsonString(fp, it->first.c_str());
+        fprintf(fp, ": %llu", (unsigned long long)it->second);
+        separator = ",";
+    }
+    fprintf(fp, "\n  }\n}\n");
+
+    if(fp != stderr)
+    {
+        fclose(fp);
+    }
+}
@@ -0,0 +1,107 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+/// Opt-in (--profile) timing of the main stages of a tool.  Each stage
+/// keeps its call count and its wall and thread CPU time, summed over all
+/// threads.  The totals, the process CPU time, and the peak RSS are
+/// written as JSON when the tool exits.
+class Profile
+{
+public:
+    /// Totals for one named stage, updated from any thread.
+    struct Stage
+    {
+        Stage(const char* stageName)
+            : name(stageName), count(0), wallNs(0), cpuNs(0) {}
+        const char* name;
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> wallNs;
+        std::atomic<uint64_t> cpuNs;
+    };
+
+    /// Adds the time until it goes out of scope to a stage when
+    /// profiling is enabled, otherwise does nothing.
+    class Timer
+    {
+    public:
+        Timer(Stage& stage) : myStage(ourEnabled ? &stage : NULL)
+        {
+            if(myStage != NULL)
+            {
+                start();
+            }
+        }
+        ~Timer()
+        {
+            if(myStage != NULL)
+            {
+                stop();
+            }
+        }
+
+    private:
+        Timer(const Timer&);
+        Timer& operator=(const Timer&);
+
+        void start();
+        void stop();
+
+        Stage* myStage;
+        uint64_t myWallStart;
+        uint64_t myCpuStart;
+    };
+
+    /// Get the stage with the specified name, creating it on first use.
+    /// The name must stay valid, typically it is a string literal held
+    /// in a function static: 
+    ///     static Profile::Stage& stage = Profile::getStage("Tool::method");
+    static Stage& getStage(const char* name);
+
+    /// Record a size, such as the number of pooled records in use,
+    /// keeping the largest value when profiling is enabled.
+    static void setMaxValue(const char* name, uint64_t value)
+    {
+        if(ourEnabled)
+        {
+            updateMaxValue(name, value);
+        }
+    }
+
+    /// Start profiling, reporting to the specified file, or stderr if
+    /// it is empty.
+    static void enable(const std::string& reportFile);
+    static bool isEnabled() { return(ourEnabled); }
+
+    /// Write the JSON report if profiling is enabled.
+    static void writeReport(const char* toolName, int numThreads);
+
+private:
+    static void updateMaxValue(const char* name, uint64_t value);
+
+    static bool ourEnabled;
+    static std::string ourReportFile;
+    static uint64_t ourStartWallNs;
+};
+
+#endif
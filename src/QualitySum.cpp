@@ -0,0 +1,55 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "QualitySum.h"
+#include "BamRecordView.h"
+
+int sumRecordQualities(SamRecord& record, int minQual)
+{
+    // Sum the raw BAM qualities when the record has a buffer, so the
+    // qualities and sequence are not decoded into strings.
+    const char* buffer = (const char*)record.getRecordBuffer(SamRecord::NONE);
+    BamRecordView view;
+    int32_t blockSize = 0;
+    if(buffer != NULL)
+    {
+        memcpy(&blockSize, buffer, sizeof(blockSize));
+    }
+    const char* baseQualities = NULL;
+    if((buffer != NULL) && 
+       view.set(buffer, blockSize + sizeof(blockSize)) &&
+       ((baseQualities = view.getQualities()) != NULL))
+    {
+        int readLength = view.getReadLength();
+        if((readLength == 0) || ((unsigned char)baseQualities[0] == 0xFF))
+        {
+            // No qualities.
+            return(0);
+        }
+        return(sumQualities(baseQualities, readLength, minQual, 0));
+    }
+
+    baseQualities = record.getQuality();
+    if(strcmp(baseQualities, "*") == 0)
+    {
+        return(0);
+    }
+    return(sumQualities(baseQualities, record.getReadLength(), 
+                        minQual, 33));
+}
@@ -0,0 +1,114 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//////////////////////////////////////////////////////////////////////////
+// Sums of base quality characters, used when comparing read qualities.
+// These use SSE2 when it is available, 16 qualities at a time.
+
+#ifndef __QUALITY_SUM_H__
+#define __QUALITY_SUM_H__
+
+#include <stdint.h>
+
+#include "SamRecord.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/// Return the sum of the length quality characters starting at qualities.
+inline int sumQualities(const char* qualities, int length)
+{
+    const unsigned char* qual = (const unsigned char*)qualities;
+    int sum = 0;
+    int i = 0;
+#ifdef __SSE2__
+    __m128i zero = _mm_setzero_si128();
+    __m128i total = zero;
+    for(; i + 16 <= length; i += 16)
+    {
+        __m128i vals = _mm_loadu_si128((const __m128i*)(qual + i));
+        total = _mm_add_epi64(total, _mm_sad_epu8(vals, zero));
+    }
+    sum = _mm_cvtsi128_si32(total) + 
+        _mm_cvtsi128_si32(_mm_unpackhi_epi64(total, total));
+#endif
+    for(; i < length; i++)
+    {
+        sum += qual[i];
+    }
+    return(sum);
+}
+
+
+/// Return the sum of the quality values that are at least minQual, where
+/// the value of a quality character is the character minus offset
+/// (33 for SAM quality strings, 0 for raw BAM qualities).
+inline int sumQualities(const char* qualities, int length, 
+                        int minQual, int offset)
+{
+    const unsigned char* qual = (const unsigned char*)qualities;
+    // Characters below threshold are not counted.
+    int threshold = minQual + offset;
+    if(threshold < 0)
+    {
+        threshold = 0;
+    }
+    if(threshold > 255)
+    {
+        return(0);
+    }
+    int sum = 0;
+    int count = 0;
+    int i = 0;
+#ifdef __SSE2__
+    __m128i zero = _mm_setzero_si128();
+    __m128i ones = _mm_set1_epi8(1);
+    __m128i minVal = _mm_set1_epi8((char)threshold);
+    __m128i total = zero;
+    __m128i numKept = zero;
+    for(; i + 16 <= length; i += 16)
+    {
+        __m128i vals = _mm_loadu_si128((const __m128i*)(qual + i));
+        // All bits set for the values that are at least the threshold.
+        __m128i keep = _mm_cmpeq_epi8(_mm_max_epu8(vals, minVal), vals);
+        total = _mm_add_epi64(total, 
+                              _mm_sad_epu8(_mm_and_si128(vals, keep), zero));
+        numKept = _mm_add_epi64(numKept, 
+                                _mm_sad_epu8(_mm_and_si128(ones, keep), zero));
+    }
+    sum = _mm_cvtsi128_si32(total) + 
+        _mm_cvtsi128_si32(_mm_unpackhi_epi64(total, total));
+    count = _mm_cvtsi128_si32(numKept) + 
+        _mm_cvtsi128_si32(_mm_unpackhi_epi64(numKept, numKept));
+#endif
+    for(; i < length; i++)
+    {
+        if(qual[i] >= threshold)
+        {
+            sum += qual[i];
+            ++count;
+        }
+    }
+    return(sum - count * offset);
+}
+
+/// Return the sum of the record's quality values that are at least
+/// minQual, 0 if it does not have qualities.
+int sumRecordQualities(SamRecord& record, int minQual);
+
+#endif
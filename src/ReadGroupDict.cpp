@@ -0,0 +1,129 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ReadGroupDict.h"
+
+ReadGroupDict::ReadGroupDict()
+    : myNames(),
+      mySlots(),
+      mySeed(0),
+      myMask(0),
+      myLastIndex(-1)
+{
+}
+
+
+void ReadGroupDict::clear()
+{
+    myNames.clear();
+    mySlots.clear();
+    mySeed = 0;
+    myMask = 0;
+    myLastIndex = -1;
+}
+
+
+void ReadGroupDict::init(SamFileHeader& header)
+{
+    clear();
+    header.resetRGRecordIter();
+    SamHeaderRecord* headerRecord = header.getNextRGRecord();
+    while(headerRecord != NULL)
+    {
+        const char* id = headerRecord->getTagValue("ID");
+        uint32_t length = strlen(id);
+        if(find(id, length) < 0)
+        {
+            myNames.push_back(std::string(id, length));
+            buildTable();
+        }
+        headerRecord = header.getNextRGRecord();
+    }
+    header.resetRGRecordIter();
+}
+
+
+int32_t ReadGroupDict::find(const char* readGroup, uint32_t length)
+{
+    if((myLastIndex >= 0) && matches(myLastIndex, readGroup, length))
+    {
+        return(myLastIndex);
+    }
+    if(mySlots.empty())
+    {
+        return(-1);
+    }
+    int32_t index = mySlots[getSlot(readGroup, length, mySeed)];
+    if((index < 0) || !matches(index, readGroup, length))
+    {
+        return(-1);
+    }
+    myLastIndex = index;
+    return(index);
+}
+
+
+int32_t ReadGroupDict::insert(const char* readGroup, uint32_t length)
+{
+    int32_t index = find(readGroup, length);
+    if(index < 0)
+    {
+        index = myNames.size();
+        myNames.push_back(std::string(readGroup, length));
+        buildTable();
+        myLastIndex = index;
+    }
+    return(index);
+}
+
+
+void ReadGroupDict::buildTable()
+{
+    // Start with at least twice as many slots as names so a seed without
+    // collisions is found quickly.
+    uint64_t numSlots = 4;
+    while(numSlots < myNames.size() * 2)
+    {
+        numSlots *= 2;
+    }
+    for(;; numSlots *= 2)
+    {
+        myMask = numSlots - 1;
+        for(int seedTry = 0; seedTry < NUM_SEED_TRIES; seedTry++)
+        {
+            mySeed = seedTry * 0x9E3779B97F4A7C15ULL;
+            mySlots.assign(numSlots, -1);
+            bool collision = false;
+            for(uint32_t i = 0; i < myNames.size(); i++)
+            {
+                int32_t& slot = 
+                    mySlots[getSlot(myNames[i].data(), myNames[i].length(), 
+                                    mySeed)];
+                if(slot >= 0)
+                {
+                    collision = true;
+                    break;
+                }
+                slot = i;
+            }
+            if(!collision)
+            {
+                return;
+            }
+        }
+    }
+}
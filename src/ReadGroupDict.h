@@ -0,0 +1,94 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __READ_GROUP_DICT_H__
+#define __READ_GROUP_DICT_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "SamFileHeader.h"
+
+/// Maps read group IDs to dense indices without allocating a string per
+/// lookup, using a perfect hash of the known IDs that is rebuilt when
+/// an ID is added.  The most recently found ID is checked first since
+/// records are often grouped by read group.
+class ReadGroupDict
+{
+public:
+    ReadGroupDict();
+
+    /// Remove all read groups.
+    void clear();
+
+    /// Set the read groups to the IDs of the header's RG records, so
+    /// their indices are in header order.  Repeated IDs are only added once.
+    void init(SamFileHeader& header);
+
+    /// Return the index of the read group, -1 if it is not found.
+    int32_t find(const char* readGroup, uint32_t length);
+
+    /// Return the index of the read group, adding it if it is not 
+    /// already in the dictionary.  Indices are assigned in the order
+    /// the read groups are added.
+    int32_t insert(const char* readGroup, uint32_t length);
+
+    /// Get the ID of the read group at the specified index.
+    const std::string& getName(int32_t index) const { return(myNames[index]); }
+
+    uint32_t size() const { return(myNames.size()); }
+
+private:
+    // Number of seeds to try before growing the table.
+    static const int NUM_SEED_TRIES = 32;
+
+    inline uint32_t getSlot(const char* readGroup, uint32_t length,
+                            uint64_t seed) const
+    {
+        // FNV-1a with the seed mixed into the offset & the result.
+        uint64_t hash = 14695981039346656037ULL ^ seed;
+        for(uint32_t i = 0; i < length; i++)
+        {
+            hash ^= (unsigned char)readGroup[i];
+            hash *= 1099511628211ULL;
+        }
+        hash ^= hash >> 29;
+        return((uint32_t)(hash & myMask));
+    }
+
+    inline bool matches(int32_t index, const char* readGroup, 
+                        uint32_t length) const
+    {
+        const std::string& name = myNames[index];
+        return((name.length() == length) && 
+               (memcmp(name.data(), readGroup, length) == 0));
+    }
+
+    // Rebuild the hash table for the current names.
+    void buildTable();
+
+    std::vector<std::string> myNames;
+    // Perfect hash table of indices into myNames, -1 if the slot is empty.
+    std::vector<int32_t> mySlots;
+    uint64_t mySeed;
+    uint64_t myMask;
+    int32_t myLastIndex;
+};
+
+#endif
@@ -20,8 +20,17 @@
 // which reads an indexed BAM file by chromosome and writes it into a new
 // file sorted from reference id -1 to maxRefID.
 
+#include <atomic>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
 #include "ReadIndexedBam.h"
 #include "SamFile.h"
+#include "ThreadedSamFile.h"
+#include "ParallelBgzf.h"
+#include "RemoteBamCache.h"
 #include "Parameters.h"
 #include "SamValidation.h"
 #include "PhoneHome.h"
@@ -67,6 +76,18 @@ int ReadIndexedBam::readIndexedBam(const char* inputFilename,
                                    const char* outputFilename,
                                    const char* indexFilename)
 {
+    // A remote file is read from its local cache, every section is read
+    // so all of it is fetched.
+    std::string inFile = inputFilename;
+    std::string indexFile = indexFilename;
+    if(!RemoteBamCache::localize(inFile, indexFile,
+                                 std::vector<RemoteBamCache::Region>()))
+    {
+        return(-1);
+    }
+    inputFilename = inFile.c_str();
+    indexFilename = indexFile.c_str();
+
     // Open the input file for reading.
     SamFile samIn;
     samIn.OpenForRead(inputFilename);
@@ -75,7 +96,7 @@ int ReadIndexedBam::readIndexedBam(const char* inputFilename,
     samIn.ReadBamIndex(indexFilename);
 
     // Open the output file for writing.
-    SamFile samOut;
+    ThreadedSamFile samOut;
     samOut.OpenForWrite(outputFilename);
 
     // Read the sam header.
@@ -85,6 +106,15 @@ int ReadIndexedBam::readIndexedBam(const char* inputFilename,
     // Write the sam header.
     samOut.WriteHeader(samHeader);
 
+    if(samOut.isThreaded())
+    {
+        // Writing BAM on multiple threads, so read the references in
+        // parallel and append them to the output in order.
+        samIn.Close();
+        return(readInParallel(inputFilename, outputFilename, indexFilename,
+                              samHeader, samOut));
+    }
+
     SamRecord samRecord;
     SamValidationErrors samInvalidErrors;
 
@@ -115,3 +145,103 @@ int ReadIndexedBam::readIndexedBam(const char* inputFilename,
 }
 
 
+int ReadIndexedBam::readInParallel(const char* inputFilename,
+                                   const char* outputFilename,
+                                   const char* indexFilename,
+                                   SamFileHeader& samHeader,
+                                   ThreadedSamFile& samOut)
+{
+    // Section i is reference ID i - 1, starting with the unmapped reads.
+    int numReferences = samHeader.getReferenceInfo().getNumEntries();
+    std::vector<int> numSectionRecords(numReferences + 1, 0);
+    std::vector<std::string> partNames;
+    for(int i = 0; i <= numReferences; i++)
+    {
+        partNames.push_back(std::string(outputFilename) + ".part" + 
+                            std::to_string(i) + ".bgzf");
+    }
+    int numWorkers = getNumThreads();
+    if(numWorkers > (int)partNames.size())
+    {
+        numWorkers = partNames.size();
+    }
+
+    // Each worker reads references with its own file handle and writes
+    // their records to a part file on the worker's thread.
+    std::atomic<unsigned int> nextSection(0);
+    try
+    {
+        runWorkers([&]()
+            {
+                SamFile sectionIn;
+                SamFileHeader sectionHeader;
+                sectionIn.OpenForRead(inputFilename, &sectionHeader);
+                sectionIn.ReadBamIndex(indexFilename);
+                SamRecord samRecord;
+                unsigned int section;
+                while((section = nextSection++) < partNames.size())
+                {
+                    ParallelBgzfWriter partOut;
+                    if(!partOut.open(partNames[section].c_str()))
+                    {
+                        throw(std::runtime_error("Failed to open " + 
+                                                 partNames[section] +
+                                                 " for writing"));
+                    }
+                    sectionIn.SetReadSection((int)section - 1);
+                    bool written = true;
+                    while(sectionIn.ReadRecord(sectionHeader, samRecord))
+                    {
+                        ++numSectionRecords[section];
+                        // The record buffer starts with the block size.
+                        const char* buffer = (const char*)
+                            samRecord.getRecordBuffer(SamRecord::NONE);
+                        if(buffer == NULL)
+                        {
+                            throw(std::runtime_error("Failed to get the BAM record buffer"));
+                        }
+                        int32_t blockSize = 0;
+                        memcpy(&blockSize, buffer, sizeof(blockSize));
+                        written = written && 
+                            partOut.write(buffer, blockSize + sizeof(blockSize));
+                    }
+                    if(!partOut.close() || !written)
+                    {
+                        throw(std::runtime_error("Failed to write " + 
+                                                 partNames[section]));
+                    }
+                }
+            }, numWorkers);
+    }
+    catch(std::exception& e)
+    {
+        for(unsigned int i = 0; i < partNames.size(); i++)
+        {
+            remove(partNames[i].c_str());
+        }
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return(-1);
+    }
+
+    // Concatenate the references in order.
+    int numRecords = 0;
+    bool appended = true;
+    for(unsigned int i = 0; i < partNames.size(); i++)
+    {
+        appended = appended && samOut.appendBamRecords(partNames[i].c_str());
+        remove(partNames[i].c_str());
+        std::cerr << "Reference ID " << (int)i - 1 << " has " 
+                  << numSectionRecords[i] << " records" << std::endl;
+        numRecords += numSectionRecords[i];
+    }
+    if(!appended)
+    {
+        std::cerr << "ERROR: " << samOut.GetStatusMessage() << std::endl;
+        return(-1);
+    }
+    samOut.Close();
+
+    std::cerr << "Number of records = " << numRecords << std::endl;
+   
+    return(0);
+}
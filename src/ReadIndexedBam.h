@@ -24,6 +24,7 @@
 #define __READ_INDEXED_BAM_H__
 
 #include "BamExecutable.h"
+#include "ThreadedSamFile.h"
 
 class ReadIndexedBam : public BamExecutable
 {
@@ -38,6 +39,13 @@ private:
     int readIndexedBam(const char* inputFilename,
                        const char* outputFilename,
                        const char* indexFilename);
+    // Read each reference on a separate worker, appending them to the
+    // already opened samOut in order.
+    int readInParallel(const char* inputFilename,
+                       const char* outputFilename,
+                       const char* indexFilename,
+                       SamFileHeader& samHeader,
+                       ThreadedSamFile& samOut);
 };
 
 #endif
@@ -0,0 +1,321 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ReadNameIndex.h"
+#include "ReadNameMap.h"
+#include "BamExecutable.h"
+
+const char ReadNameIndex::MAGIC[4] = {'R', 'N', 'I', 1};
+
+ReadNameIndex::ReadNameIndex()
+    : myMap(NULL),
+      myMapLen(0),
+      myEntries(NULL),
+      myNumEntries(0),
+      myReader(),
+      myBuffer()
+{
+}
+
+
+ReadNameIndex::~ReadNameIndex()
+{
+    close();
+}
+
+
+bool ReadNameIndex::build(const char* bamFile, const char* indexFile,
+                          uint64_t& numRecords)
+{
+    numRecords = 0;
+    int64_t bamSize = getFileSize(bamFile);
+    ParallelBgzfReader reader;
+    if((bamSize < 0) || 
+       !reader.open(bamFile, BamExecutable::getThreadPool(),
+                    BamExecutable::getNumThreads() * BLOCKS_PER_THREAD))
+    {
+        std::cerr << "ERROR: Failed to open " << bamFile 
+                  << " as a BAM file.\n";
+        return(false);
+    }
+
+    std::vector<Entry> entries;
+    try
+    {
+        if(!skipHeader(reader))
+        {
+            std::cerr << "ERROR: Failed to read the BAM header of " 
+                      << bamFile << ".\n";
+            return(false);
+        }
+
+        std::vector<char> record;
+        while(true)
+        {
+            Entry entry;
+            entry.offset = reader.tell();
+            uint32_t blockSize = 0;
+            uint32_t numRead = reader.read(&blockSize, sizeof(blockSize));
+            if(numRead == 0)
+            {
+                // End of the records.
+                break;
+            }
+            // The read name starts 32 bytes into the record data.
+            if((numRead != sizeof(blockSize)) || (blockSize <= 32))
+            {
+                std::cerr << "ERROR: Invalid BAM record in " << bamFile
+                          << ".\n";
+                return(false);
+            }
+            if(record.size() < blockSize + 1)
+            {
+                record.resize(blockSize + 1);
+            }
+            if(reader.read(&(record[0]), blockSize) != blockSize)
+            {
+                std::cerr << "ERROR: Truncated BAM record in " << bamFile
+                          << ".\n";
+                return(false);
+            }
+            // Terminate the name in case it is not.
+            record[blockSize] = 0;
+            uint64_t hash2;
+            ReadNameMap::hashName(&(record[32]), entry.hash, hash2);
+            entries.push_back(entry);
+        }
+    }
+    catch(std::runtime_error& e)
+    {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return(false);
+    }
+    reader.close();
+
+    std::sort(entries.begin(), entries.end());
+
+    FILE* out = fopen(indexFile, "wb");
+    if(out == NULL)
+    {
+        std::cerr << "ERROR: Failed to open " << indexFile 
+                  << " for writing.\n";
+        return(false);
+    }
+    uint64_t header[2] = {(uint64_t)bamSize, entries.size()};
+    bool success = 
+        (fwrite(MAGIC, sizeof(MAGIC), 1, out) == 1) &&
+        (fwrite(header, sizeof(header), 1, out) == 1) &&
+        (entries.empty() ||
+         (fwrite(&(entries[0]), sizeof(Entry), entries.size(), out) ==
+          entries.size()));
+    success &= (fclose(out) == 0);
+    if(!success)
+    {
+        std::cerr << "ERROR: Failed to write " << indexFile << ".\n";
+        unlink(indexFile);
+        return(false);
+    }
+    numRecords = entries.size();
+    return(true);
+}
+
+
+bool ReadNameIndex::open(const char* indexFile, const char* bamFile)
+{
+    close();
+    int fd = ::open(indexFile, O_RDONLY);
+    if(fd < 0)
+    {
+        std::cerr << "ERROR: Failed to open the read name index " 
+                  << indexFile << ".\n";
+        return(false);
+    }
+    struct stat fileStat;
+    if((fstat(fd, &fileStat) == 0) && (fileStat.st_size >= HEADER_SIZE))
+    {
+        myMapLen = fileStat.st_size;
+        myMap = mmap(NULL, myMapLen, PROT_READ, MAP_SHARED, fd, 0);
+        if(myMap == MAP_FAILED)
+        {
+            myMap = NULL;
+        }
+    }
+    // The mapping keeps the file open.
+    ::close(fd);
+
+    const char* data = (const char*)myMap;
+    uint64_t header[2] = {0, 0};
+    if(data != NULL)
+    {
+        memcpy(header, data + sizeof(MAGIC), sizeof(header));
+    }
+    if((data == NULL) || (memcmp(data, MAGIC, sizeof(MAGIC)) != 0) ||
+       (myMapLen != HEADER_SIZE + header[1] * sizeof(Entry)))
+    {
+        std::cerr << "ERROR: " << indexFile 
+                  << " is not a valid read name index.\n";
+        close();
+        return(false);
+    }
+    if(getFileSize(bamFile) != (int64_t)header[0])
+    {
+        std::cerr << "ERROR: The read name index " << indexFile 
+                  << " is out of date, rebuild it for " << bamFile << ".\n";
+        close();
+        return(false);
+    }
+    myEntries = (const Entry*)(data + HEADER_SIZE);
+    myNumEntries = header[1];
+
+    // Only a few blocks are read after each seek.
+    if(!myReader.open(bamFile, BamExecutable::getThreadPool(), 1))
+    {
+        std::cerr << "ERROR: Failed to open " << bamFile 
+                  << " as a BAM file.\n";
+        close();
+        return(false);
+    }
+    return(true);
+}
+
+
+void ReadNameIndex::close()
+{
+    if(myMap != NULL)
+    {
+        munmap(myMap, myMapLen);
+    }
+    myMap = NULL;
+    myMapLen = 0;
+    myEntries = NULL;
+    myNumEntries = 0;
+    myReader.close();
+}
+
+
+void ReadNameIndex::find(const char* readName, std::vector<uint64_t>& offsets)
+{
+    Entry key;
+    uint64_t hash2;
+    ReadNameMap::hashName(readName, key.hash, hash2);
+    key.offset = 0;
+    const Entry* end = myEntries + myNumEntries;
+    for(const Entry* entry = std::lower_bound(myEntries, end, key);
+        (entry != end) && (entry->hash == key.hash); ++entry)
+    {
+        offsets.push_back(entry->offset);
+    }
+}
+
+
+bool ReadNameIndex::readRecord(uint64_t offset, SamFileHeader& header, 
+                               SamRecord& record)
+{
+    try
+    {
+        uint32_t blockSize = 0;
+        if(!myReader.seek(offset) ||
+           (myReader.read(&blockSize, sizeof(blockSize)) != sizeof(blockSize)))
+        {
+            std::cerr << "ERROR: Failed to read the record at offset " 
+                      << offset << " from the read name index.\n";
+            return(false);
+        }
+        myBuffer.resize(sizeof(blockSize) + blockSize);
+        memcpy(&(myBuffer[0]), &blockSize, sizeof(blockSize));
+        if(myReader.read(&(myBuffer[sizeof(blockSize)]), blockSize) != 
+           blockSize)
+        {
+            std::cerr << "ERROR: Truncated BAM record at offset "
+                      << offset << ".\n";
+            return(false);
+        }
+    }
+    catch(std::runtime_error& e)
+    {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return(false);
+    }
+    if(record.setBuffer(&(myBuffer[0]), myBuffer.size(), header) != 
+       SamStatus::SUCCESS)
+    {
+        std::cerr << "ERROR: Failed to parse the BAM record at offset "
+                  << offset << ".\n";
+        return(false);
+    }
+    return(true);
+}
+
+
+std::string ReadNameIndex::getDefaultName(const char* bamFile)
+{
+    std::string name = bamFile;
+    name += ".rni";
+    return(name);
+}
+
+
+bool ReadNameIndex::skipHeader(ParallelBgzfReader& reader)
+{
+    char magic[4];
+    int32_t textLen = 0;
+    int32_t numRefs = 0;
+    if((reader.read(magic, sizeof(magic)) != sizeof(magic)) ||
+       (memcmp(magic, "BAM\1", sizeof(magic)) != 0) ||
+       (reader.read(&textLen, sizeof(textLen)) != sizeof(textLen)) ||
+       (textLen < 0) ||
+       (reader.skip(textLen) != (uint32_t)textLen) ||
+       (reader.read(&numRefs, sizeof(numRefs)) != sizeof(numRefs)) ||
+       (numRefs < 0))
+    {
+        return(false);
+    }
+    for(int32_t i = 0; i < numRefs; i++)
+    {
+        int32_t nameLen = 0;
+        // Skip the name and the reference length.
+        if((reader.read(&nameLen, sizeof(nameLen)) != sizeof(nameLen)) ||
+           (nameLen < 0) ||
+           (reader.skip(nameLen + sizeof(int32_t)) != 
+            nameLen + sizeof(int32_t)))
+        {
+            return(false);
+        }
+    }
+    return(true);
+}
+
+
+int64_t ReadNameIndex::getFileSize(const char* filename)
+{
+    struct stat fileStat;
+    if(stat(filename, &fileStat) != 0)
+    {
+        return(-1);
+    }
+    return(fileStat.st_size);
+}
@@ -0,0 +1,101 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __READ_NAME_INDEX_H__
+#define __READ_NAME_INDEX_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "ParallelBgzf.h"
+#include "SamFileHeader.h"
+#include "SamRecord.h"
+
+/// Sidecar index of a BAM file mapping hashed read names to the BGZF
+/// virtual file offsets of their records, so records with specific read
+/// names can be read without scanning the whole file.
+/// The index file contains a magic number, the size of the BAM file it
+/// was built from, the number of entries, and then the entries (64-bit
+/// name hash and virtual offset) sorted by hash and offset.
+/// Different names can share a hash, so callers must check the read name
+/// of the records that are read.
+class ReadNameIndex
+{
+public:
+    ReadNameIndex();
+    ~ReadNameIndex();
+
+    /// Build an index of the specified BAM file, writing it to indexFile.
+    /// Returns false and prints the error on failure.
+    static bool build(const char* bamFile, const char* indexFile,
+                      uint64_t& numRecords);
+
+    /// Open the index and the BAM file it was built from.
+    /// Returns false and prints the error on failure, including when the
+    /// BAM file has changed size since the index was built.
+    bool open(const char* indexFile, const char* bamFile);
+    void close();
+
+    /// Append the virtual offsets of the records that may have the
+    /// specified read name.
+    void find(const char* readName, std::vector<uint64_t>& offsets);
+
+    /// Read the record at the specified virtual offset.
+    /// Returns false and prints the error on failure.
+    bool readRecord(uint64_t offset, SamFileHeader& header, 
+                    SamRecord& record);
+
+    /// The default name of the index for the BAM file.
+    static std::string getDefaultName(const char* bamFile);
+
+    /// Skip over the BAM header, returning false if it is truncated.
+    static bool skipHeader(ParallelBgzfReader& reader);
+
+private:
+    ReadNameIndex(const ReadNameIndex&);
+    ReadNameIndex& operator=(const ReadNameIndex&);
+
+    struct Entry
+    {
+        uint64_t hash;
+        uint64_t offset;
+        bool operator<(const Entry& other) const
+        {
+            return((hash < other.hash) || 
+                   ((hash == other.hash) && (offset < other.offset)));
+        }
+    };
+
+    // Return the size of the file or -1 if it does not exist.
+    static int64_t getFileSize(const char* filename);
+
+    static const char MAGIC[4];
+    static const uint32_t HEADER_SIZE = 20;
+    static const int BLOCKS_PER_THREAD = 4;
+
+    // The memory mapped index.
+    void* myMap;
+    size_t myMapLen;
+    const Entry* myEntries;
+    uint64_t myNumEntries;
+
+    ParallelBgzfReader myReader;
+    std::vector<char> myBuffer;
+};
+
+#endif
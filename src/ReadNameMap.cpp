@@ -0,0 +1,193 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "ReadNameMap.h"
+
+void ReadNameMap::hashName(const char* name, uint64_t& hash1, uint64_t& hash2)
+{
+    // FNV-1a & a multiplicative hash with a different seed.
+    hash1 = 0xcbf29ce484222325ULL;
+    hash2 = 0x9e3779b97f4a7c15ULL;
+    for(const unsigned char* ptr = (const unsigned char*)name; *ptr != 0; ptr++)
+    {
+        hash1 = (hash1 ^ *ptr) * 0x100000001b3ULL;
+        hash2 = (hash2 + *ptr) * 0xff51afd7ed558ccdULL;
+        hash2 ^= hash2 >> 29;
+    }
+    // Final mixing so the low bits used for the slot are well distributed.
+    hash1 ^= hash1 >> 33;
+    hash1 *= 0xc4ceb9fe1a85ec53ULL;
+    hash1 ^= hash1 >> 33;
+}
+
+
+ReadNameMap::ReadNameMap()
+    : myFileName(),
+      myTable(NULL),
+      myNumSlots(0),
+      mySize(0)
+{
+}
+
+
+ReadNameMap::~ReadNameMap()
+{
+    close();
+}
+
+
+bool ReadNameMap::open(const std::string& fileName)
+{
+    close();
+    myFileName = fileName;
+    myTable = mapTable(myFileName, INITIAL_SLOTS);
+    if(myTable == NULL)
+    {
+        return(false);
+    }
+    myNumSlots = INITIAL_SLOTS;
+    mySize = 0;
+    return(true);
+}
+
+
+void ReadNameMap::close()
+{
+    if(myTable != NULL)
+    {
+        unmapTable(myTable, myNumSlots);
+        unlink(myFileName.c_str());
+        myTable = NULL;
+    }
+    myNumSlots = 0;
+    mySize = 0;
+}
+
+
+int32_t ReadNameMap::find(const char* readName, int32_t newId, bool& added)
+{
+    // Keep the table at most half full.
+    if((mySize + 1) * 2 > myNumSlots)
+    {
+        if(!grow())
+        {
+            throw(std::runtime_error("Failed to grow the read name map in " +
+                                     myFileName));
+        }
+    }
+
+    uint64_t hash1;
+    uint64_t hash2;
+    hashName(readName, hash1, hash2);
+
+    uint64_t mask = myNumSlots - 1;
+    for(uint64_t slot = hash1 & mask; ; slot = (slot + 1) & mask)
+    {
+        Entry& entry = myTable[slot];
+        if(!entry.used)
+        {
+            entry.hash1 = hash1;
+            entry.hash2 = hash2;
+            entry.id = newId;
+            entry.used = 1;
+            ++mySize;
+            added = true;
+            return(newId);
+        }
+        if((entry.hash1 == hash1) && (entry.hash2 == hash2))
+        {
+            added = false;
+            return(entry.id);
+        }
+    }
+}
+
+
+ReadNameMap::Entry* ReadNameMap::mapTable(const std::string& fileName,
+                                          uint64_t numSlots)
+{
+    int fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if(fd < 0)
+    {
+        return(NULL);
+    }
+    size_t length = numSlots * sizeof(Entry);
+    void* table = MAP_FAILED;
+    if(ftruncate(fd, length) == 0)
+    {
+        table = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    // The mapping keeps the file open.
+    ::close(fd);
+    if(table == MAP_FAILED)
+    {
+        unlink(fileName.c_str());
+        return(NULL);
+    }
+    return((Entry*)table);
+}
+
+
+void ReadNameMap::unmapTable(Entry* table, uint64_t numSlots)
+{
+    munmap(table, numSlots * sizeof(Entry));
+}
+
+
+bool ReadNameMap::grow()
+{
+    std::string newFileName = myFileName + ".grow";
+    uint64_t newNumSlots = myNumSlots * 2;
+    Entry* newTable = mapTable(newFileName, newNumSlots);
+    if(newTable == NULL)
+    {
+        return(false);
+    }
+
+    // Move the entries to the new table.
+    uint64_t mask = newNumSlots - 1;
+    for(uint64_t i = 0; i < myNumSlots; i++)
+    {
+        if(!myTable[i].used)
+        {
+            continue;
+        }
+        uint64_t slot = myTable[i].hash1 & mask;
+        while(newTable[slot].used)
+        {
+            slot = (slot + 1) & mask;
+        }
+        newTable[slot] = myTable[i];
+    }
+
+    unmapTable(myTable, myNumSlots);
+    if(rename(newFileName.c_str(), myFileName.c_str()) != 0)
+    {
+        // Keep using the table under the new name.
+        unlink(myFileName.c_str());
+        myFileName = newFileName;
+    }
+    myTable = newTable;
+    myNumSlots = newNumSlots;
+    return(true);
+}
@@ -0,0 +1,83 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __READ_NAME_MAP_H__
+#define __READ_NAME_MAP_H__
+
+#include <stdint.h>
+#include <string>
+
+/// Maps read names to the integers assigned to them without keeping the
+/// names in memory.  Each name is stored as a 128-bit fingerprint in an
+/// open addressing hash table that is memory mapped from a temporary file,
+/// so the operating system can page it out rather than it taking memory
+/// proportional to the number of reads.
+class ReadNameMap
+{
+public:
+    ReadNameMap();
+    ~ReadNameMap();
+
+    /// Create the table in the specified temporary file, which is
+    /// removed when the map is closed.  Returns false on failure.
+    bool open(const std::string& fileName);
+
+    /// Remove the table and its temporary file.
+    void close();
+
+    /// Return the integer for the read name.  If the name is not in the map,
+    /// it is added with newId, setting added to true.
+    /// Throws std::runtime_error if the table could not be grown.
+    int32_t find(const char* readName, int32_t newId, bool& added);
+
+    /// Number of read names in the map.
+    uint64_t size() { return(mySize); }
+
+    /// Compute two independent 64-bit hashes of the name, the first
+    /// is also used for the slot.
+    static void hashName(const char* name, uint64_t& hash1, uint64_t& hash2);
+
+private:
+    struct Entry
+    {
+        uint64_t hash1;
+        uint64_t hash2;
+        int32_t id;
+        // 0 for an empty slot, since new files are zero filled.
+        int32_t used;
+    };
+
+    static const uint64_t INITIAL_SLOTS = 1 << 20;
+
+    ReadNameMap(const ReadNameMap&);
+    ReadNameMap& operator=(const ReadNameMap&);
+
+    // Map a zero filled table with the specified number of slots (a power
+    // of 2) in the specified file, returning NULL on failure.
+    static Entry* mapTable(const std::string& fileName, uint64_t numSlots);
+    static void unmapTable(Entry* table, uint64_t numSlots);
+
+    // Double the size of the table.
+    bool grow();
+
+    std::string myFileName;
+    Entry* myTable;
+    uint64_t myNumSlots;
+    uint64_t mySize;
+};
+
+#endif
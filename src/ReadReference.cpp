@@ -18,6 +18,8 @@
 //////////////////////////////////////////////////////////////////////////
 #include "ReadReference.h"
 
+#include <fstream>
+#include <sstream>
 #include "Parameters.h"
 #include "BgzfFileType.h"
 #include "GenomeSequence.h"
@@ -38,6 +40,7 @@ void ReadReference::printUsage(std::ostream& os)
 {
     BamExecutable::printUsage(os);
     os << "\t./bam readReference --refFile <referenceFilename> --refName <reference Name> --start <0 based start> --end <0 based end>|--numBases <number of bases> [--params]"<< std::endl;
+    os << "\t./bam readReference --refFile <referenceFilename> --regionFile <regionFilename> [--params]"<< std::endl;
     os << "\tRequired Parameters:\n"
               << "\t\t--refFile  : the reference\n"
               << "\t\t--refName  : the SAM/BAM reference Name to read\n"
@@ -46,6 +49,11 @@ void ReadReference::printUsage(std::ostream& os)
               << "\tRequired Length Parameter (one but not both needs to be specified):\n"
               << "\t\t--end      : exclusive 0-based end position\n"
               << "\t\t--numBases : number of bases from start to display\n"
+              << "\tBatch Parameter (replaces --refName, --start, and --end/--numBases):\n"
+              << "\t\t--regionFile : file with one region per line, \"-\" for stdin,\n"
+              << "\t\t               as: <reference Name> <0 based start> <0 based end>\n"
+              << "\t\t               The reference string of each region is printed\n"
+              << "\t\t               on its own line.\n"
               << std::endl;
 }
 
@@ -56,6 +64,7 @@ int ReadReference::execute(int argc, char **argv)
     static const int UNSPECIFIED_INT = -1;
     String refFile = "";
     String refName = "";
+    String regionFile = "";
     int start = UNSPECIFIED_INT;
     int numBases = UNSPECIFIED_INT;
     int end = UNSPECIFIED_INT;
@@ -69,6 +78,7 @@ int ReadReference::execute(int argc, char **argv)
         LONG_INTPARAMETER("start", &start)
         LONG_INTPARAMETER("end", &end)
         LONG_INTPARAMETER("numBases", &numBases)
+        LONG_STRINGPARAMETER("regionFile", &regionFile)
         LONG_PARAMETER("params", &params)
         LONG_PHONEHOME(VERSION)
         END_LONG_PARAMETERS();
@@ -79,6 +89,24 @@ int ReadReference::execute(int argc, char **argv)
     // parameters start at index 2 rather than 1.
     inputParameters.Read(argc, argv, 2);
     
+    if(regionFile != "")
+    {
+        if((refName != "") || (start != UNSPECIFIED_INT) ||
+           (end != UNSPECIFIED_INT) || (numBases != UNSPECIFIED_INT))
+        {
+            printUsage(std::cerr);
+            inputParameters.Status();
+            std::cerr << "--regionFile cannot be specified with --refName, "
+                      << "--start, --end, or --numBases\n\n";
+            return(-1);
+        }
+        if(params)
+        {
+            inputParameters.Status();
+        }
+        return(readRegions(refFile, regionFile));
+    }
+
     if((refName == "") || (start == UNSPECIFIED_INT) || 
        ((end == UNSPECIFIED_INT) && (numBases == UNSPECIFIED_INT)))
     {
@@ -124,3 +152,64 @@ int ReadReference::execute(int argc, char **argv)
     
     return(0);
 }
+
+
+int ReadReference::readRegions(const String& refFile, const String& regionFile)
+{
+    std::ifstream regionStream;
+    std::istream* regionIn = &std::cin;
+    if(regionFile != "-")
+    {
+        regionStream.open(regionFile.c_str());
+        if(!regionStream.is_open())
+        {
+            std::cerr << "Failed to open the region file: " 
+                      << regionFile.c_str() << std::endl;
+            return(-1);
+        }
+        regionIn = &regionStream;
+    }
+
+    // Open the reference once for all of the regions.
+    GenomeSequence reference(refFile);
+
+    int status = 0;
+    int lineNum = 0;
+    std::string line;
+    std::string refName;
+    std::string refString;
+    while(std::getline(*regionIn, line))
+    {
+        ++lineNum;
+        if(line.empty() || (line[0] == '#'))
+        {
+            continue;
+        }
+        std::istringstream lineStream(line);
+        long start = 0;
+        long end = 0;
+        if(!(lineStream >> refName >> start >> end) ||
+           (start < 0) || (end < start))
+        {
+            std::cerr << "Invalid region on line " << lineNum 
+                      << " of " << regionFile.c_str() << ": " << line
+                      << std::endl;
+            status = -1;
+            continue;
+        }
+
+        uint32_t refStart = reference.getGenomePosition(refName.c_str());
+        if(refStart == INVALID_GENOME_INDEX)
+        {
+            std::cerr << "Reference Name: " << refName
+                      << " not found in the reference file\n"; 
+            status = -1;
+            continue;
+        }
+        refString.clear();
+        reference.getString(refString, refStart + start, end - start);
+        std::cout << refString << '\n';
+    }
+    std::cout.flush();
+    return(status);
+}
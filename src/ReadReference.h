@@ -30,6 +30,10 @@ public:
     void printUsage(std::ostream& os);
     int execute(int argc, char **argv);
     virtual const char* getProgramName() {return("bam:readReference");}
+
+private:
+    // Print the reference string of each region in the region file.
+    static int readRegions(const String& refFile, const String& regionFile);
 };
 
 #endif
@@ -32,6 +32,8 @@
 #include "BaseUtilities.h"
 #include "SamFlag.h"
 #include "BgzfFileType.h"
+#include "ThreadedSamFile.h"
+#include "Profile.h"
 
 // STL headers
 #include <map>
@@ -47,6 +49,8 @@ Recab::Recab()
       myDbsnpFile(""),
       myQField(""),
       myStoreQualTag(""),
+      myLoadTable(""),
+      mySaveTable(""),
       myBuildExcludeFlags("0x0F04"),
       myApplyExcludeFlags("0x0000"),
       myIntBuildExcludeFlags(0),
@@ -65,27 +69,54 @@ Recab::Recab()
     myNumApplySkipped = 0;
     myNumApplyReads = 0;
     myNumQualTagErrors = 0;
-    myNumDBSnpSkips = 0;
-    mySubMinQual = 0;
-    myAmbiguous = 0;
-    myBMatchCount = 0;
-    myBMismatchCount = 0;
-    myBasecounts = 0;
+    myCountOnly = false;
 
     myBlendedWeight = 0;
     myFitModel = false;
     myFast = false;
+    mySharedRef = false;
     myKeepPrevDbsnp = false;
     myKeepPrevNonAdjacent = false;
     myLogReg = false;
+    myFitPerRG = false;
     myMinBaseQual = DEFAULT_MIN_BASE_QUAL;
     myMaxBaseQual = DEFAULT_MAX_BASE_QUAL;
     myMaxBaseQualChar = BaseUtilities::getAsciiQuality(DEFAULT_MAX_BASE_QUAL);
+    selectKernels();
 }
 
 
 Recab::~Recab()
 {
+    // Do not leave tasks running that reference this object.
+    while(!myPendingBuilds.empty())
+    {
+        myPendingBuilds.front().result.wait();
+        myPendingBuilds.pop_front();
+    }
+}
+
+
+Recab::BaseCounts::BaseCounts()
+    : numDBSnpSkips(0),
+      subMinQual(0),
+      ambiguous(0),
+      bMatchCount(0),
+      bMismatchCount(0),
+      basecounts(0)
+{
+}
+
+
+Recab::BaseCounts& Recab::BaseCounts::operator+=(const BaseCounts& other)
+{
+    numDBSnpSkips += other.numDBSnpSkips;
+    subMinQual += other.subMinQual;
+    ambiguous += other.ambiguous;
+    bMatchCount += other.bMatchCount;
+    bMismatchCount += other.bMismatchCount;
+    basecounts += other.basecounts;
+    return(*this);
 }
 
 
@@ -103,7 +134,7 @@ void Recab::printDescription(std::ostream& os)
 
 void Recab::printUsage(std::ostream& os)
 {
-    os << "Usage: ./bam recab (options) --in <InputBamFile> --out <OutputFile> [--log <logFile>] [--verbose] [--noeof] [--params] ";
+    os << "Usage: ./bam recab (options) --in <InputBamFile> --out <OutputFile> [--log <logFile>] [--verbose] [--noeof] [--params] [--buildSample <numRecords>] [--buildBases <numBases>] ";
     printRecabSpecificUsageLine(os);
     os << std::endl << std::endl;
 
@@ -115,6 +146,11 @@ void Recab::printUsage(std::ostream& os)
     os << "\t--verbose       : Turn on verbose mode" << std::endl;
     os << "\t--noeof         : do not expect an EOF block on a bam file." << std::endl;
     os << "\t--params        : print the parameter settings" << std::endl;
+    os << "\t--buildSample <numRecords> : build the table from just the first numRecords records and" << std::endl;
+    os << "\t                  apply it in the same pass, so the input may be stdin" << std::endl;
+    os << "\t                  (with --loadTable the input is also read only once)" << std::endl;
+    os << "\t--buildBases <numBases> : build the table from about numBases read bases, sampled from" << std::endl;
+    os << "\t                  evenly spaced regions of an indexed BAM (requires <infile>.bai)" << std::endl;
     printRecabSpecificUsage(os);
     os << "\n" << std::endl;
 }
@@ -122,7 +158,7 @@ void Recab::printUsage(std::ostream& os)
 
 void Recab::printRecabSpecificUsageLine(std::ostream& os)
 {
-    os << "--refFile <ReferenceFile> [--dbsnp <dbsnpFile>] [--minBaseQual <minBaseQual>] [--maxBaseQual <maxBaseQual>] [--blended <weight>] [--fitModel] [--fast] [--keepPrevDbsnp] [--keepPrevNonAdjacent] [--useLogReg] [--qualField <tag>] [--storeQualTag <tag>] [--buildExcludeFlags <flag>] [--applyExcludeFlags <flag>] ";
+    os << "--refFile <ReferenceFile> [--dbsnp <dbsnpFile>] [--sharedRef] [--minBaseQual <minBaseQual>] [--maxBaseQual <maxBaseQual>] [--blended <weight>] [--fitModel] [--fast] [--keepPrevDbsnp] [--keepPrevNonAdjacent] [--useLogReg] [--fitPerRG] [--qualField <tag>] [--storeQualTag <tag>] [--buildExcludeFlags <flag>] [--applyExcludeFlags <flag>] [--loadTable <file>[,<file>...]] [--saveTable <file>] ";
     mySqueeze.printBinningUsageLine(os);
 }
 
@@ -132,6 +168,10 @@ void Recab::printRecabSpecificUsage(std::ostream& os)
     os << "\t--refFile <reference file>    : reference file name" << std::endl;
     os << "Recab Specific Optional Parameters : " << std::endl;
     os << "\t--dbsnp <known variance file> : dbsnp file of positions" << std::endl;
+    os << "\t                                (text, or a bitmap from 'bam indexSites')" << std::endl;
+    os << "\t--sharedRef                   : pack the reference & dbsnp into shared memory once, so" << std::endl;
+    os << "\t                                other jobs on the node with the same files attach to it" << std::endl;
+    os << "\t                                rather than loading them.  Remove it from /dev/shm when done" << std::endl;
     os << "\t--minBaseQual <minBaseQual>   : minimum base quality of bases to recalibrate (default: " << DEFAULT_MIN_BASE_QUAL << ")" << std::endl;
     os << "\t--maxBaseQual <maxBaseQual>   : maximum recalibrated base quality (default: " << DEFAULT_MAX_BASE_QUAL << ")" << std::endl;
     os << "\t                                qualities over this value will be set to this value." << std::endl;
@@ -139,12 +179,9 @@ void Recab::printRecabSpecificUsage(std::ostream& os)
     os << "\t--blended <weight>            : blended model weight" << std::endl;
     os << "\t--fitModel                    : check if the logistic regression model fits the data" << std::endl;
     os << "\t                                overriden by fast, but automatically applied by useLogReg" << std::endl;
-    os << "\t--fast                        : use a compact representation that only allows:" << std::endl;
-    os << "\t                                   * at most " << (BaseData::getFastMaxRG() + 1) << " Read Groups" << std::endl;
-    os << "\t                                   * maximum quality " << BaseData::getFastMaxQual() << std::endl;
-    os << "\t                                   * at most " << BaseData::getFastMaxCycles() << " cycles" << std::endl;
+    os << "\t--fast                        : do not fit the model (the recalibration table is always" << std::endl;
+    os << "\t                                a compact array unless it would be too large)" << std::endl;
     os << "\t                                overrides fitModel, but is overridden by useLogReg" << std::endl;
-    os << "\t                                uses up to about 2.25G more memory than running without --fast." << std::endl;
     os << "\t--keepPrevDbsnp               : do not exclude entries where the previous base is in dbsnp when\n";
     os << "\t                                building the recalibration table" << std::endl;
     os << "\t                                By default they are excluded from the table." << std::endl;
@@ -153,12 +190,19 @@ void Recab::printRecabSpecificUsage(std::ostream& os)
     os << "\t                                By default they are excluded from the table (except the first cycle)." << std::endl;
     os << "\t--useLogReg                   : use logistic regression calculated quality for the new quality" << std::endl;
     os << "\t                                automatically applies fitModel and overrides fast." << std::endl;
+    os << "\t--fitPerRG                    : also fit a logistic regression model for each read group" << std::endl;
+    os << "\t                                (in parallel with --threads), read groups whose model does" << std::endl;
+    os << "\t                                not converge use the model of all read groups" << std::endl;
     os << "\t--qualField <quality tag>     : tag to get the starting base quality\n";
     os << "\t                                (default is to get it from the Quality field)" << std::endl;
     os << "\t--storeQualTag <quality tag>  : tag to store the previous quality into" << std::endl;
     os << "\t--buildExcludeFlags <flag>    : exclude reads with any of these flags set when building the" << std::endl;
     os << "\t                                recalibration table.  Default is 0xF04" << std::endl;
     os << "\t--applyExcludeFlags <flag>    : do not apply the recalibration table to any reads with any of these flags set" << std::endl;
+    os << "\t--loadTable <file>[,...]      : load the table from files written by --saveTable rather than" << std::endl;
+    os << "\t                                building it, summing the counts of multiple files" << std::endl;
+    os << "\t                                --refFile is not required when loading a table" << std::endl;
+    os << "\t--saveTable <file>            : write the table counts to a binary file for --loadTable" << std::endl;
     mySqueeze.printBinningUsage(os);
 }
 
@@ -171,8 +215,10 @@ int Recab::execute(int argc, char *argv[])
 
     bool noeof = false;
     bool params = false;
+    int buildSample = 0;
+    String buildBases;
 
-    SamFile samIn,samOut;
+    ThreadedSamFile samIn,samOut;
 
     ParameterList inputParameters;
 
@@ -186,6 +232,8 @@ int Recab::execute(int argc, char *argv[])
     parameters.addBool("verbose", &verboseFlag);
     parameters.addBool("noeof", &noeof);
     parameters.addBool("params", &params);
+    parameters.addInt("buildSample", &buildSample);
+    parameters.addString("buildBases", &buildBases);
     parameters.addPhoneHome(VERSION);
     addRecabSpecificParameters(parameters);
     inputParameters.Add(new LongParameters ("Input Parameters", 
@@ -210,9 +258,34 @@ int Recab::execute(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
+    uint64_t targetBases = 0;
+    if(!buildBases.IsEmpty())
+    {
+        char* endPtr = NULL;
+        targetBases = strtoull(buildBases.c_str(), &endPtr, 10);
+        if((targetBases == 0) || (*endPtr != '\0'))
+        {
+            printUsage(std::cerr);
+            inputParameters.Status();
+            std::cerr << "--buildBases must be a positive number of bases" << std::endl;
+            return EXIT_FAILURE;
+        }
+        if((buildSample > 0) || !myLoadTable.IsEmpty() || (inFile[0] == '-'))
+        {
+            printUsage(std::cerr);
+            inputParameters.Status();
+            std::cerr << "--buildBases cannot be used with --buildSample, --loadTable, or stdin" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // With a leading sample or a loaded table, the input is read once,
+    // applying the table as soon as it is ready.
+    bool onePass = (buildSample > 0) || !myLoadTable.IsEmpty();
+
     // inFile is not empty, so there is at least one character.  Check if
-    // it is specifing stdin since that is not supported for Recab.
-    if(inFile[0] == '-')
+    // it is specifing stdin since that is not supported for two passes.
+    if((inFile[0] == '-') && !onePass)
     {
         // ERROR: stdin specified, but since Recab requires 2 passes through
         // the input file, stdin is not supported.
@@ -240,7 +313,14 @@ int Recab::execute(int argc, char *argv[])
 
     if ( logFile.IsEmpty() )
     {
-        logFile = outFile + ".log";
+        if(ThreadedSamFile::isPipeName(outFile.c_str()))
+        {
+            logFile = "-";
+        }
+        else
+        {
+            logFile = outFile + ".log";
+        }
     }
   
     if(params)
@@ -278,10 +358,31 @@ int Recab::execute(int argc, char *argv[])
 
     srand (time(NULL));
 
+    // Records read in a single pass are kept until the table is ready.
+    std::vector<std::unique_ptr<SamRecord> > sampleRecords;
     int numRecs = 0;
-    while(samIn.ReadRecord(samHeader, samRecord) == true)
+    if(targetBases != 0)
     {
-        processReadBuildTable(samRecord);
+        numRecs = buildSampledTable(inFile.c_str(), targetBases);
+    }
+    while(myLoadTable.IsEmpty() && (targetBases == 0) &&
+          ((buildSample <= 0) || (numRecs < buildSample)))
+    {
+        SamRecord* recordPtr = &samRecord;
+        if(onePass)
+        {
+            sampleRecords.push_back(std::unique_ptr<SamRecord>(new SamRecord));
+            recordPtr = sampleRecords.back().get();
+        }
+        if(!samIn.ReadRecord(samHeader, *recordPtr))
+        {
+            if(onePass)
+            {
+                sampleRecords.pop_back();
+            }
+            break;
+        }
+        processReadBuildTable(*recordPtr);
 
         //Status info
         numRecs++;
@@ -296,9 +397,10 @@ int Recab::execute(int argc, char *argv[])
     localtm = localtime(&now);
     Logger::gLogger->writeLog("End: %s", asctime(localtm));
 
-    if((outFile[0] == '-') && (logFile[0] != '-'))
+    if((outFile[0] == '-') || ThreadedSamFile::isPipeName(outFile.c_str()))
     {
-        // Since outFile is to stdout, and logfile isn't, pass logfile name 
+        // Since outFile is to stdout or a pipe, name the tables after the
+        // logfile (none are written if it is to stderr too).
         modelFitPrediction(logFile);
     }
     else
@@ -311,18 +413,43 @@ int Recab::execute(int argc, char *argv[])
     ////////////////////////
     ////////////////////////
     //// Write file
-    samIn.OpenForRead(inFile.c_str());
+    if(!onePass)
+    {
+        samIn.OpenForRead(inFile.c_str());
+        samIn.ReadHeader(samHeader);
+    }
     samOut.OpenForWrite(outFile.c_str());
-    samIn.ReadHeader(samHeader);
     samOut.WriteHeader(samHeader);
-    
+
+    for(unsigned int i = 0; i < sampleRecords.size(); i++)
+    {
+        processReadApplyTable(*(sampleRecords[i]));
+        samOut.WriteRecord(samHeader, *(sampleRecords[i]));
+    }
+    sampleRecords.clear();
+
+    // The reads after a leading sample are still counted for the report,
+    // before their qualities are recalibrated.
+    myCountOnly = (buildSample > 0);
+    uint64_t numAllRecs = numRecs;
     while(samIn.ReadRecord(samHeader, samRecord) == true)
     {
+        if(myCountOnly)
+        {
+            processReadBuildTable(samRecord);
+            ++numAllRecs;
+        }
         // Recalibrate.
         processReadApplyTable(samRecord);
         samOut.WriteRecord(samHeader, samRecord);
     }
 
+    if(myCountOnly)
+    {
+        Logger::gLogger->writeLog("Counts of all %llu records, the table was built from the first %d:",
+                                  (unsigned long long)numAllRecs, numRecs);
+        logBuildCounts();
+    }
     Logger::gLogger->writeLog("Total # Reads recab table not applied to: %ld", myNumApplySkipped);
     Logger::gLogger->writeLog("Total # Reads recab table applied to: %ld", myNumApplyReads);
     Logger::gLogger->writeLog("Recalibration successfully finished");
@@ -330,12 +457,159 @@ int Recab::execute(int argc, char *argv[])
 }
 
 
+int Recab::buildSampledTable(const char* inFile, uint64_t targetBases)
+{
+    // Indexed reading is not threaded, so use a SamFile.
+    SamFile sampleIn;
+    SamFileHeader sampleHeader;
+    if(!sampleIn.OpenForRead(inFile, &sampleHeader) || 
+       !sampleIn.ReadBamIndex())
+    {
+        Logger::gLogger->error("--buildBases requires a BAM file with an index, failed to open %s or its index", inFile);
+    }
+
+    const SamReferenceInfo& refInfo = sampleHeader.getReferenceInfo();
+    int numRefs = refInfo.getNumEntries();
+    uint64_t genomeLength = 0;
+    for(int i = 0; i < numRefs; i++)
+    {
+        genomeLength += refInfo.getReferenceLength(i);
+    }
+    if(genomeLength == 0)
+    {
+        Logger::gLogger->error("--buildBases requires reference lengths in the header of %s", inFile);
+    }
+
+    uint64_t windowLength = genomeLength / NUM_SAMPLE_WINDOWS;
+    if(windowLength == 0)
+    {
+        windowLength = 1;
+    }
+
+    // Each window starts at a multiple of windowLength across the
+    // concatenated references and ends at the end of its reference.
+    struct SampleWindow
+    {
+        int refID;
+        int32_t start;
+        int32_t end;
+        // Records already read from the window, which a later pass skips.
+        uint64_t numRead;
+        bool done;
+    };
+    std::vector<SampleWindow> windows;
+    uint64_t refStart = 0;
+    int refID = 0;
+    for(uint64_t windowStart = 0; windowStart < genomeLength; 
+        windowStart += windowLength)
+    {
+        while((refID < numRefs) && 
+              (windowStart >= refStart + refInfo.getReferenceLength(refID)))
+        {
+            refStart += refInfo.getReferenceLength(refID);
+            ++refID;
+        }
+        if(refID >= numRefs)
+        {
+            break;
+        }
+        SampleWindow window;
+        window.refID = refID;
+        window.start = windowStart - refStart;
+        uint64_t end = windowStart + windowLength - refStart;
+        if(end > (uint64_t)refInfo.getReferenceLength(refID))
+        {
+            end = refInfo.getReferenceLength(refID);
+        }
+        window.end = end;
+        window.numRead = 0;
+        window.done = false;
+        windows.push_back(window);
+    }
+
+    // Each window's quota is the bases still needed spread over the
+    // windows left, so the quota a sparse window doesn't use carries
+    // forward.  Windows that still have reads are read again until the
+    // target is reached or every window is used up.
+    SamRecord samRecord;
+    int numRecs = 0;
+    uint64_t numBases = 0;
+    uint64_t windowsLeft = windows.size();
+    while((numBases < targetBases) && (windowsLeft != 0))
+    {
+        uint64_t passWindows = windowsLeft;
+        for(size_t i = 0; (i < windows.size()) && (numBases < targetBases); i++)
+        {
+            SampleWindow& window = windows[i];
+            if(window.done)
+            {
+                continue;
+            }
+            uint64_t windowBases = (targetBases - numBases) / passWindows;
+            if(windowBases == 0)
+            {
+                windowBases = 1;
+            }
+            --passWindows;
+            if(!sampleIn.SetReadSection(window.refID, window.start, window.end))
+            {
+                window.done = true;
+                --windowsLeft;
+                continue;
+            }
+            // Skip the records used by the previous passes.
+            uint64_t skipped = 0;
+            bool hasRecord = true;
+            while((skipped < window.numRead) && 
+                  (hasRecord = sampleIn.ReadRecord(sampleHeader, samRecord)))
+            {
+                ++skipped;
+            }
+            uint64_t usedBases = 0;
+            while(hasRecord && (usedBases < windowBases) &&
+                  (hasRecord = sampleIn.ReadRecord(sampleHeader, samRecord)))
+            {
+                ++window.numRead;
+                // Reads starting before the window may have been used by
+                // the previous window.
+                if(samRecord.get0BasedPosition() < window.start)
+                {
+                    continue;
+                }
+                ++numRecs;
+                if(processReadBuildTable(samRecord))
+                {
+                    usedBases += samRecord.getReadLength();
+                }
+            }
+            if(!hasRecord)
+            {
+                window.done = true;
+                --windowsLeft;
+            }
+            numBases += usedBases;
+        }
+    }
+    Logger::gLogger->writeLog("Built the recalibration table from %llu bases of %d sampled records, the target was %llu bases",
+                              (unsigned long long)numBases, numRecs,
+                              (unsigned long long)targetBases);
+    if(numBases < targetBases)
+    {
+        Logger::gLogger->warning("%s has only %llu usable bases, fewer than --buildBases %llu",
+                                 inFile, (unsigned long long)numBases,
+                                 (unsigned long long)targetBases);
+    }
+    return(numRecs);
+}
+
+
 void Recab::addRecabSpecificParameters(LongParamContainer& params)
 {
     params.addGroup("Required Recab Parameters");
     params.addString("refFile", &myRefFile);
     params.addGroup("Optional Recab Parameters");
     params.addString("dbsnp", &myDbsnpFile);
+    params.addBool("sharedRef", &mySharedRef);
     params.addInt("minBaseQual", &myMinBaseQual);
     params.addInt("maxBaseQual", &myMaxBaseQual);
     params.addInt("blended", &myBlendedWeight);
@@ -344,10 +618,13 @@ void Recab::addRecabSpecificParameters(LongParamContainer& params)
     params.addBool("keepPrevDbsnp", &myKeepPrevDbsnp);
     params.addBool("keepPrevNonAdjacent", &myKeepPrevNonAdjacent);
     params.addBool("useLogReg", &myLogReg);
+    params.addBool("fitPerRG", &myFitPerRG);
     params.addString("qualField", &myQField);
     params.addString("storeQualTag", &myStoreQualTag);
     params.addString("buildExcludeFlags", &myBuildExcludeFlags);
     params.addString("applyExcludeFlags", &myApplyExcludeFlags);
+    params.addString("loadTable", &myLoadTable);
+    params.addString("saveTable", &mySaveTable);
     myParamsSetup = false;
     mySqueeze.addBinningParameters(params);
 
@@ -356,7 +633,7 @@ void Recab::addRecabSpecificParameters(LongParamContainer& params)
 
 int Recab::processRecabParam()
 {
-    if(myRefFile.IsEmpty())
+    if(myRefFile.IsEmpty() && myLoadTable.IsEmpty())
     {
         std::cerr << "Missing required --refFile parameter" << std::endl;
         return EXIT_FAILURE;
@@ -367,15 +644,26 @@ int Recab::processRecabParam()
 }
 
 
+uint16_t Recab::getReadGroupId(SamRecord& samRecord)
+{
+    const String* rgPtr = samRecord.getStringTag("RG");
+    int32_t rgid = (rgPtr == NULL) ? myReadGroups.insert("", 0) :
+        myReadGroups.insert(rgPtr->c_str(), rgPtr->Length());
+    if((uint32_t)rgid == myId2Rg.size())
+    {
+        // New read group.
+        myId2Rg.push_back(myReadGroups.getName(rgid));
+    }
+    return(rgid);
+}
+
+
 bool Recab::processReadBuildTable(SamRecord& samRecord)
 {
-    static BaseData data;
-    static std::string chromosomeName;
-    static std::string readGroup;
-    static std::string aligTypes;
+    static Profile::Stage& stage = Profile::getStage("Recab::processReadBuildTable");
+    Profile::Timer timer(stage);
+    std::string chromosomeName;
 
-    int seqLen = samRecord.getReadLength();
-    
     // Check if the parameters have been processed.
     if(!myParamsSetup)
     {
@@ -383,6 +671,12 @@ bool Recab::processReadBuildTable(SamRecord& samRecord)
         processParams();
     }
 
+    if(!myLoadTable.IsEmpty())
+    {
+        // The table was loaded rather than built.
+        return(false);
+    }
+
     uint16_t  flag = samRecord.getFlag();
 
     if(!SamFlag::isMapped(flag))
@@ -439,28 +733,7 @@ bool Recab::processReadBuildTable(SamRecord& samRecord)
     }
     
     chromosomeName = samRecord.getReferenceName();
-    readGroup = samRecord.getString("RG").c_str();
-
-    // Look for the read group in the map.
-    // TODO - extra string constructor??
-    RgInsertReturn insertRet = 
-        myRg2Id.insert(std::pair<std::string, uint16_t>(readGroup, 0));
-    if(insertRet.second == true)
-    {
-        // New element inserted.
-        insertRet.first->second = myId2Rg.size();
-        myId2Rg.push_back(readGroup);
-    }
-
-    data.rgid = insertRet.first->second;
-
-
-    //reverse
-    bool reverse;
-    if(SamFlag::isReverse(flag))
-        reverse = true;
-    else
-        reverse = false;
+    uint16_t rgid = getReadGroupId(samRecord);
 
     if(myReferenceGenome == NULL)
     {
@@ -479,47 +752,61 @@ bool Recab::processReadBuildTable(SamRecord& samRecord)
         return false;
     }
 
-    if(!myQField.IsEmpty())
+    const PackedReference::Chromosome* chromosome = 
+        myPackedReference.getChromosome(chromosomeName.c_str());
+
+    if((getNumThreads() > 1) && !myCountOnly)
     {
-        // Check if there is an old quality.
-        const String* oldQPtr = 
-            samRecord.getStringTag(myQField.c_str());
-        if((oldQPtr != NULL) && (oldQPtr->Length() == seqLen))
+        // Copy the record so another thread decodes its qualities,
+        // sequence, & cigar and counts its bases.
+        const char* buffer = 
+            (const char*)samRecord.getRecordBuffer(SamRecord::NONE);
+        if(buffer == NULL)
         {
-            // There is an old quality, so use that.
-            myQualityStrings.oldq = oldQPtr->c_str();
+            Logger::gLogger->warning("Failed to get the record buffer");
+            ++myNumBuildSkipped;
+            return(false);
         }
-        else
+        if(!myBuildBatch)
         {
-            // Tag was not found, so use the current quality.
-            ++myNumQualTagErrors;
-            if(myNumQualTagErrors == 1)
+            if(myFreeBatches.empty())
             {
-                Logger::gLogger->warning("Recab: %s tag was not found/invalid, so using the quality field in records without the tag", myQField.c_str());
+                myBuildBatch.reset(new BuildBatch);
+            }
+            else
+            {
+                myBuildBatch = std::move(myFreeBatches.back());
+                myFreeBatches.pop_back();
             }
-            myQualityStrings.oldq = samRecord.getQuality();
         }
-        //printf("%s\n",samRecord.getQuality());
-        //printf("%s:%s\n",myQField.c_str(),temp.c_str());
-    }
-    else
-    {
-        myQualityStrings.oldq = samRecord.getQuality();
+        BuildRead& read = myBuildBatch->reads[myBuildBatch->numReads++];
+        read.mapPos = mapPos;
+        read.chromosome = chromosome;
+        read.flag = flag;
+        read.rgid = rgid;
+        read.record.assign(buffer, *(const int32_t*)buffer + sizeof(int32_t));
+        if(myBuildBatch->numReads == BUILD_BATCH_SIZE)
+        {
+            submitBuildBatch();
+        }
+        return true;
     }
 
-    if(myQualityStrings.oldq.length() != (unsigned int)seqLen)
+    uint64_t prevQualTagErrors = myNumQualTagErrors;
+    const char* warning = getBuildQuality(samRecord, myQualityStrings.oldq,
+                                          myNumQualTagErrors);
+    if((prevQualTagErrors == 0) && (myNumQualTagErrors != 0))
     {
-        Logger::gLogger->warning("Quality is not the correct length, so skipping recalibration on that record.");
-        ++myNumBuildSkipped;
-        return(false);
+        Logger::gLogger->warning("Recab: %s tag was not found/invalid, so using the quality field in records without the tag", myQField.c_str());
     }
-
-    aligTypes = "";
     Cigar* cigarPtr = samRecord.getCigarInfo();
-
-    if(cigarPtr == NULL)
+    if((warning == NULL) && (cigarPtr == NULL))
     {
-        Logger::gLogger->warning("Failed to get the cigar");
+        warning = "Failed to get the cigar";
+    }
+    if(warning != NULL)
+    {
+        Logger::gLogger->warning("%s", warning);
         ++myNumBuildSkipped;
         return(false);
     }
@@ -527,50 +814,59 @@ bool Recab::processReadBuildTable(SamRecord& samRecord)
     // This read will be used for building the recab table.
     ++myNumBuildReads;
 
+    (this->*myAddReadToTable)(mapPos, chromosome, flag, rgid,
+                              samRecord.getSequence(),
+                              myQualityStrings.oldq, *cigarPtr, myBaseCounts,
+                              myCountOnly ? myCountOnlyTable : hasherrormodel,
+                              myReadCovariates);
+    return true;
+}
+
+
+template<bool USE_DBSNP, bool KEEP_PREV_DBSNP, bool KEEP_PREV_NON_ADJACENT>
+void Recab::addReadToTable(genomeIndex_t mapPos, 
+                           const PackedReference::Chromosome* chromosome,
+                           uint16_t flag, uint16_t rgid,
+                           const char* sequence, const std::string& quality,
+                           Cigar& cigar, BaseCounts& counts,
+                           HashErrorModel& table, ReadCovariates& covariates)
+{
+    int seqLen = quality.length();
+
+    if(chromosome != NULL)
+    {
+        chromosome->prefetch(mapPos, seqLen);
+    }
+
+    //reverse
+    bool reverse;
+    if(SamFlag::isReverse(flag))
+        reverse = true;
+    else
+        reverse = false;
+
+    // Mark as first if it is not paired or if it is the first in the pair.
+    bool secondRead = 
+        SamFlag::isPaired(flag) && !SamFlag::isFirstFragment(flag);
+
+    // Extract the keys of all of the cycles, then pick the ones to count.
+    covariates.extract(sequence, quality.c_str(), seqLen, reverse,
+                       secondRead, rgid);
+
     ////////////////
     ////// iterate sequence
     ////////////////
     genomeIndex_t refPos = 0;
     int32_t refOffset = 0;
     int32_t prevRefOffset = Cigar::INDEX_NA;
-    int32_t seqPos = 0;
-    int seqIncr = 1;
-    if(reverse)
-    {
-        seqPos = seqLen - 1;
-        seqIncr = -1;
-    }
-
-    // read
-    if(!SamFlag::isPaired(flag) || SamFlag::isFirstFragment(flag))
-        // Mark as first if it is not paired or if it is the
-        // first in the pair.
-        data.read = 0;
-    else
-        data.read = 1;
-
-    // Set unsetbase for curBase.
-    // This will be used for the prebase of cycle 0.
-    data.curBase = 'K';
+    int seqIncr = reverse ? -1 : 1;
 
-    for (data.cycle = 0; data.cycle < seqLen; data.cycle++, seqPos += seqIncr)
+    for (int32_t cycle = 0; cycle < seqLen; cycle++)
     {
-        // Store the previous current base in preBase.
-        data.preBase = data.curBase;
+        int32_t seqPos = covariates.getSeqPos(cycle);
 
-        // Get the current base before checking if we are going to
-        // process this position so it will be set for the next position.
-        data.curBase = samRecord.getSequence(seqPos);
-        if(reverse)
-        {
-            // Complement the current base.
-            // The prebase is already complemented.
-            data.curBase = 
-                BaseAsciiMap::base2complement[(unsigned int)(data.curBase)];
-        }
-        
         // Get the reference offset.
-        refOffset = cigarPtr->getRefOffset(seqPos);
+        refOffset = cigar.getRefOffset(seqPos);
         if(refOffset == Cigar::INDEX_NA)
         {
             // Not a match/mismatch, so continue to the next one which will
@@ -587,12 +883,12 @@ bool Recab::processReadBuildTable(SamRecord& samRecord)
         // Check to see if we should process this position.
         // Do not process if it is cycle 0 and:
         //   1) current base is in dbsnp
-        if(data.cycle == 0)
+        if(cycle == 0)
         {
-            if(!(myDbsnpFile.IsEmpty()) && myDbSNP[refPos])
+            if(USE_DBSNP && isDbSNP(chromosome, refPos))
             {
                 // Save the previous reference offset.
-                ++myNumDBSnpSkips;
+                ++counts.numDBSnpSkips;
                 prevRefOffset = refOffset;
                 continue;
             }
@@ -604,18 +900,18 @@ bool Recab::processReadBuildTable(SamRecord& samRecord)
             //      (not a match/mismatch)
             //   2) previous base is in dbsnp
             //   3) current base is in dbsnp
-            if((!myKeepPrevNonAdjacent && (refOffset != (prevRefOffset + seqIncr))) ||
-               (data.preBase == 'K'))
+            if((!KEEP_PREV_NON_ADJACENT && (refOffset != (prevRefOffset + seqIncr))) ||
+               (covariates.bases[cycle - 1] == 'K'))
             {
                 // Save the previous reference offset.
                 prevRefOffset = refOffset;
                 continue;
             }
-            if(!(myDbsnpFile.IsEmpty()) && 
-               (myDbSNP[refPos] ||
-                (!myKeepPrevDbsnp && myDbSNP[refPos - seqIncr])))
+            if(USE_DBSNP && 
+               (isDbSNP(chromosome, refPos) ||
+                (!KEEP_PREV_DBSNP && isDbSNP(chromosome, refPos - seqIncr))))
             {
-                ++myNumDBSnpSkips;
+                ++counts.numDBSnpSkips;
                 // Save the previous reference offset.
                 prevRefOffset = refOffset;
                 continue;
@@ -626,12 +922,26 @@ bool Recab::processReadBuildTable(SamRecord& samRecord)
         prevRefOffset = refOffset;
 
         // Set the reference & read bases in the Covariates
-        char refBase = (*myReferenceGenome)[refPos];
+        char refBase;
+        uint8_t packed = PackedReference::OUTSIDE;
+        if(chromosome != NULL)
+        {
+            packed = chromosome->get(refPos);
+        }
+        if((packed != PackedReference::OUTSIDE) && 
+           ((packed & PackedReference::BASE_MASK) <= PackedReference::AMBIGUOUS))
+        {
+            refBase = "ACGTN"[packed & PackedReference::BASE_MASK];
+        }
+        else
+        {
+            refBase = (*myReferenceGenome)[refPos];
+        }
 
         if(BaseUtilities::isAmbiguous(refBase))
         {
             // N reference, so skip it when building the table.
-            ++myAmbiguous;
+            ++counts.ambiguous;
             continue;
         }
 
@@ -640,35 +950,200 @@ bool Recab::processReadBuildTable(SamRecord& samRecord)
             refBase = BaseAsciiMap::base2complement[(unsigned int)(refBase)];
         }
 
-        // Get quality char
-        data.qual = 
-            BaseUtilities::getPhredBaseQuality(myQualityStrings.oldq[seqPos]);
-
         // skip bases with quality below the minimum set.
-        if(data.qual < myMinBaseQual)
+        if(covariates.quals[cycle] < myMinBaseQual)
         {
-            ++mySubMinQual;
+            ++counts.subMinQual;
             continue;
         }
 
-        if(BaseUtilities::areEqual(refBase, data.curBase)
-           && (BaseAsciiMap::base2int[(unsigned int)(data.curBase)] < 4))
-            myBMatchCount++;
+        char curBase = covariates.bases[cycle];
+        bool equal = BaseUtilities::areEqual(refBase, curBase);
+        if(equal && (BaseAsciiMap::base2int[(unsigned int)(curBase)] < 4))
+            counts.bMatchCount++;
         else
-            myBMismatchCount++;
+            counts.bMismatchCount++;
 
-        hasherrormodel.setCell(data, refBase);
-        myBasecounts++;
+        covariates.counted[cycle] = 
+            equal ? ReadCovariates::MATCH : ReadCovariates::MISMATCH;
+        counts.basecounts++;
     }
-    return true;
+
+    table.addRead(covariates);
+}
+
+
+const char* Recab::getBuildQuality(SamRecord& samRecord, 
+                                   std::string& quality,
+                                   uint64_t& numQualTagErrors)
+{
+    int seqLen = samRecord.getReadLength();
+    if(!myQField.IsEmpty())
+    {
+        // Check if there is an old quality.
+        const String* oldQPtr = 
+            samRecord.getStringTag(myQField.c_str());
+        if((oldQPtr != NULL) && (oldQPtr->Length() == seqLen))
+        {
+            // There is an old quality, so use that.
+            quality = oldQPtr->c_str();
+        }
+        else
+        {
+            // Tag was not found, so use the current quality.
+            ++numQualTagErrors;
+            quality = samRecord.getQuality();
+        }
+    }
+    else
+    {
+        quality = samRecord.getQuality();
+    }
+
+    if(quality.length() != (unsigned int)seqLen)
+    {
+        return("Quality is not the correct length, so skipping recalibration on that record.");
+    }
+    return(NULL);
+}
+
+
+void Recab::buildBatch(BuildBatch& batch, BuildShard& shard)
+{
+    for(unsigned int i = 0; i < batch.numReads; i++)
+    {
+        BuildRead& read = batch.reads[i];
+        if(shard.record.setBuffer(read.record.c_str(), read.record.size(),
+                                  shard.header) != SamStatus::SUCCESS)
+        {
+            throw std::runtime_error("Failed to copy a record to build the recalibration table");
+        }
+        uint64_t prevQualTagErrors = batch.numQualTagErrors;
+        const char* warning = getBuildQuality(shard.record, shard.quality,
+                                              batch.numQualTagErrors);
+        if((prevQualTagErrors == 0) && (batch.numQualTagErrors != 0))
+        {
+            // Logged by retireBuildBatch if it is the first tag error.
+            batch.warnings.push_back(NULL);
+        }
+        Cigar* cigarPtr = shard.record.getCigarInfo();
+        if((warning == NULL) && (cigarPtr == NULL))
+        {
+            warning = "Failed to get the cigar";
+        }
+        if(warning != NULL)
+        {
+            batch.warnings.push_back(warning);
+            ++batch.numSkipped;
+            continue;
+        }
+        ++batch.numUsed;
+        (this->*myAddReadToTable)(read.mapPos, read.chromosome,
+                                  read.flag, read.rgid,
+                                  shard.record.getSequence(), shard.quality,
+                                  *cigarPtr, shard.counts,
+                                  shard.table, shard.covariates);
+    }
+}
+
+
+void Recab::retireBuildBatch(PendingBuild& pending)
+{
+    pending.result.get();
+    BuildBatch& batch = *(pending.batch);
+
+    // Log and count the batch's reads as if they were added in order.
+    bool firstQualTagError = (myNumQualTagErrors == 0);
+    for(unsigned int i = 0; i < batch.warnings.size(); i++)
+    {
+        if(batch.warnings[i] != NULL)
+        {
+            Logger::gLogger->warning("%s", batch.warnings[i]);
+        }
+        else if(firstQualTagError)
+        {
+            Logger::gLogger->warning("Recab: %s tag was not found/invalid, so using the quality field in records without the tag", myQField.c_str());
+            firstQualTagError = false;
+        }
+    }
+    myNumBuildReads += batch.numUsed;
+    myNumBuildSkipped += batch.numSkipped;
+    myNumQualTagErrors += batch.numQualTagErrors;
+
+    batch.numReads = 0;
+    batch.numUsed = 0;
+    batch.numSkipped = 0;
+    batch.numQualTagErrors = 0;
+    batch.warnings.clear();
+    myFreeBatches.push_back(std::move(pending.batch));
+    myFreeShards.push_back(pending.shard);
+}
+
+
+void Recab::submitBuildBatch()
+{
+    if(myPendingBuilds.size() >= (unsigned int)getNumThreads())
+    {
+        // Reuse the oldest batch and its shard once it is done.
+        retireBuildBatch(myPendingBuilds.front());
+        myPendingBuilds.pop_front();
+    }
+
+    if(myFreeShards.empty())
+    {
+        myShards.push_back(std::unique_ptr<BuildShard>(new BuildShard));
+        myFreeShards.push_back(myShards.back().get());
+    }
+
+    PendingBuild pending;
+    pending.batch = std::move(myBuildBatch);
+    pending.shard = myFreeShards.back();
+    myFreeShards.pop_back();
+
+    BuildBatch* batch = pending.batch.get();
+    BuildShard* shard = pending.shard;
+    pending.result = getThreadPool().submit([this, batch, shard]()
+        {
+            buildBatch(*batch, *shard);
+        });
+    myPendingBuilds.push_back(std::move(pending));
+}
+
+
+void Recab::finishBuildTable()
+{
+    if(myBuildBatch && (myBuildBatch->numReads != 0))
+    {
+        submitBuildBatch();
+    }
+    while(!myPendingBuilds.empty())
+    {
+        retireBuildBatch(myPendingBuilds.front());
+        myPendingBuilds.pop_front();
+    }
+
+    if(!myShards.empty())
+    {
+        std::vector<HashErrorModel*> tables;
+        for(unsigned int i = 0; i < myShards.size(); i++)
+        {
+            myBaseCounts += myShards[i]->counts;
+            tables.push_back(&(myShards[i]->table));
+        }
+        hasherrormodel.addCounts(tables);
+    }
+    myShards.clear();
+    myFreeShards.clear();
+    myFreeBatches.clear();
+    myBuildBatch.reset();
 }
 
 
 bool Recab::processReadApplyTable(SamRecord& samRecord)
 {
-    static BaseData data;
-    static std::string readGroup;
-    static std::string aligTypes;
+    static Profile::Stage& stage = Profile::getStage("Recab::processReadApplyTable");
+    Profile::Timer timer(stage);
+    BaseData data;
 
     int seqLen = samRecord.getReadLength();
 
@@ -683,20 +1158,7 @@ bool Recab::processReadApplyTable(SamRecord& samRecord)
     }
     ++myNumApplyReads;
    
-    readGroup = samRecord.getString("RG").c_str();
-
-    // Look for the read group in the map.
-    // TODO - extra string constructor??
-    RgInsertReturn insertRet = 
-        myRg2Id.insert(std::pair<std::string, uint16_t>(readGroup, 0));
-    if(insertRet.second == true)
-    {
-        // New element inserted.
-        insertRet.first->second = myId2Rg.size();
-        myId2Rg.push_back(readGroup);
-    }
-
-    data.rgid = insertRet.first->second;
+    data.rgid = getReadGroupId(samRecord);
 
     if(!myQField.IsEmpty())
     {
@@ -726,6 +1188,22 @@ bool Recab::processReadApplyTable(SamRecord& samRecord)
 
     myQualityStrings.newq.resize(seqLen);
 
+    (this->*myApplyTableToRead)(samRecord, data, seqLen, flag);
+
+    if(!myStoreQualTag.IsEmpty())
+    {
+        samRecord.addTag(myStoreQualTag, 'Z', myQualityStrings.oldq.c_str());
+    }
+    samRecord.setQuality(myQualityStrings.newq.c_str());
+
+    return true;
+}
+
+
+template<bool USE_LOG_REG>
+void Recab::applyTableToRead(SamRecord& samRecord, BaseData& data,
+                             int seqLen, uint16_t flag)
+{
     ////////////////
     ////// iterate sequence
     ////////////////
@@ -755,54 +1233,97 @@ bool Recab::processReadApplyTable(SamRecord& samRecord)
     // This will be used for the prebase of cycle 0.
     data.curBase = 'K';
 
-    for (data.cycle = 0; data.cycle < seqLen; data.cycle++, seqPos += seqIncr)
+    if((data.rgid < myQualLookup.numRG) && (seqLen <= myQualLookup.numCycles))
     {
-        // Set the preBase to the previous cycle's current base.
-        // For cycle 0, curBase was set to a default value.
-        data.preBase = data.curBase;
+        // All cycles of this read are in the lookup table, so just index
+        // it by quality and bases, using getNewQual for any that are not.
+        const char* sequence = samRecord.getSequence();
+        const uint8_t* lookup = &(myQualLookup.table[0]);
+        uint64_t offset = myQualLookup.getOffset(data.rgid, data.read);
+        unsigned int qualStep = myQualLookup.qualStep;
+        unsigned int baseStep = myQualLookup.baseStep;
+        unsigned int curCode = BaseAsciiMap::base2int[(int)data.curBase];
+        for (data.cycle = 0; data.cycle < seqLen; 
+             data.cycle++, seqPos += seqIncr, offset += myQualLookup.cycleStep)
+        {
+            data.preBase = data.curBase;
+            unsigned int preCode = curCode;
 
-        // Get the current base.
-        data.curBase = samRecord.getSequence(seqPos);
+            data.curBase = sequence[seqPos];
+            if(reverse)
+            {
+                // Complement the current base.
+                data.curBase =
+                    BaseAsciiMap::base2complement[(unsigned int)(data.curBase)];
+            }
+            curCode = BaseAsciiMap::base2int[(int)data.curBase];
 
-        if(reverse)
-        {
-            // Complement the current base.
-            data.curBase =
-                BaseAsciiMap::base2complement[(unsigned int)(data.curBase)];
+            data.qual = 
+                BaseUtilities::getPhredBaseQuality(myQualityStrings.oldq[seqPos]);
+            if((data.qual < myQualLookup.numQuals) && 
+               (preCode < baseStep) && (curCode < baseStep))
+            {
+                myQualityStrings.newq[seqPos] = 
+                    lookup[offset + data.qual * qualStep + 
+                           preCode * baseStep + curCode];
+            }
+            else
+            {
+                myQualityStrings.newq[seqPos] = 
+                    getNewQual<USE_LOG_REG>(data, myQualityStrings.oldq[seqPos]);
+            }
         }
+    }
+    else
+    {
+        for (data.cycle = 0; data.cycle < seqLen; data.cycle++, seqPos += seqIncr)
+        {
+            // Set the preBase to the previous cycle's current base.
+            // For cycle 0, curBase was set to a default value.
+            data.preBase = data.curBase;
 
-        // Get quality
-        data.qual = 
-            BaseUtilities::getPhredBaseQuality(myQualityStrings.oldq[seqPos]);
+            // Get the current base.
+            data.curBase = samRecord.getSequence(seqPos);
 
-        // skip bases with quality below the minimum set.
-        if(data.qual < myMinBaseQual)
-        {
-            myQualityStrings.newq[seqPos] = myQualityStrings.oldq[seqPos];
-            continue;
-        }
+            if(reverse)
+            {
+                // Complement the current base.
+                data.curBase =
+                    BaseAsciiMap::base2complement[(unsigned int)(data.curBase)];
+            }
 
-        // Update quality score
-        uint8_t qemp = hasherrormodel.getQemp(data);
-        qemp = mySqueeze.getQualCharFromQemp(qemp);
-        if(qemp > myMaxBaseQualChar)
-        {
-            qemp = myMaxBaseQualChar;
+            // Get quality
+            data.qual = 
+                BaseUtilities::getPhredBaseQuality(myQualityStrings.oldq[seqPos]);
+
+            myQualityStrings.newq[seqPos] = 
+                getNewQual<USE_LOG_REG>(data, myQualityStrings.oldq[seqPos]);
         }
-        myQualityStrings.newq[seqPos] = qemp;
     }
+}
 
-    if(!myStoreQualTag.IsEmpty())
+
+template<bool USE_LOG_REG>
+char Recab::getNewQual(BaseData& data, char oldQual)
+{
+    // skip bases with quality below the minimum set.
+    if(data.qual < myMinBaseQual)
     {
-        samRecord.addTag(myStoreQualTag, 'Z', myQualityStrings.oldq.c_str());
+        return(oldQual);
     }
-    samRecord.setQuality(myQualityStrings.newq.c_str());
 
-    return true;
+    // Update quality score
+    uint8_t qemp = hasherrormodel.getQemp<USE_LOG_REG>(data);
+    qemp = mySqueeze.getQualCharFromQemp(qemp);
+    if(qemp > myMaxBaseQualChar)
+    {
+        qemp = myMaxBaseQualChar;
+    }
+    return(qemp);
 }
 
 
-void Recab::modelFitPrediction(const char* outputBase)
+void Recab::logBuildCounts()
 {
     Logger::gLogger->writeLog("# mapped Reads observed: %ld", myMappedCount);
     Logger::gLogger->writeLog("# unmapped Reads observed: %ld", myUnMappedCount);
@@ -816,9 +1337,41 @@ void Recab::modelFitPrediction(const char* outputBase)
     Logger::gLogger->writeLog("Total # Reads used for building recab table: %ld", myNumBuildReads);
 
     Logger::gLogger->writeLog("# Bases observed: %ld - #match: %ld; #mismatch: %ld",
-                              myBasecounts, myBMatchCount, myBMismatchCount);
+                              myBaseCounts.basecounts, 
+                              myBaseCounts.bMatchCount,
+                              myBaseCounts.bMismatchCount);
     Logger::gLogger->writeLog("# Bases Skipped for DBSNP: %ld, for BaseQual < %ld: %ld, ref 'N': %ld", 
-                              myNumDBSnpSkips, myMinBaseQual, mySubMinQual, myAmbiguous);
+                              myBaseCounts.numDBSnpSkips, myMinBaseQual,
+                              myBaseCounts.subMinQual, myBaseCounts.ambiguous);
+}
+
+
+void Recab::modelFitPrediction(const char* outputBase)
+{
+    if(!myParamsSetup && !myLoadTable.IsEmpty())
+    {
+        // Load the table.
+        processParams();
+    }
+
+    finishBuildTable();
+    logBuildCounts();
+
+    if(hasherrormodel.useHash())
+    {
+        Logger::gLogger->writeLog("Too many read groups/cycles/qualities for an array, so the recalibration table was hashed");
+    }
+
+    if(!mySaveTable.IsEmpty())
+    {
+        Logger::gLogger->writeLog("Writing recalibration counts %s",
+                                  mySaveTable.c_str());
+        if(!hasherrormodel.writeTable(mySaveTable.c_str(), myId2Rg))
+        {
+            Logger::gLogger->error("Writing recalibration counts to %s not possible!",
+                                   mySaveTable.c_str());
+        }
+    }
     if(myNumQualTagErrors != 0)
     {
         Logger::gLogger->warning("%ld records did not have tag %s or it was invalid, so the quality field was used for those records.", myNumQualTagErrors, myQField.c_str());
@@ -844,7 +1397,18 @@ void Recab::modelFitPrediction(const char* outputBase)
             Logger::gLogger->error("Could not fit model!");
         }
         
-        hasherrormodel.addPrediction(prediction.getModel(),myBlendedWeight);
+        if(myFitPerRG)
+        {
+            Logger::gLogger->writeLog("Start model fitting of %d read groups!",
+                                      (int)myId2Rg.size());
+            int numFit = prediction.fitReadGroupModels(getThreadPool(),
+                                                       myId2Rg.size());
+            Logger::gLogger->writeLog("%d of %d read groups have their own model",
+                                      numFit, (int)myId2Rg.size());
+        }
+        
+        hasherrormodel.addPrediction(prediction.getModel(),myBlendedWeight,
+                                     prediction.getReadGroupModels());
 
         if(outputBase[0] != '-')
         {
@@ -866,12 +1430,57 @@ void Recab::modelFitPrediction(const char* outputBase)
                                            myId2Rg, false)))
             Logger::gLogger->error("Writing errormodel not possible!");
     }
+
+    // The table no longer changes, so compute the new quality for each
+    // entry once rather than for every base.
+    hasherrormodel.buildQualLookup(myQualLookup,
+                                   [this](uint8_t qual, uint8_t qemp)
+        {
+            if(qual < myMinBaseQual)
+            {
+                // Not recalibrated, so keep the original quality.
+                return((uint8_t)BaseUtilities::getAsciiQuality(qual));
+            }
+            qemp = mySqueeze.getQualCharFromQemp(qemp);
+            if(qemp > myMaxBaseQualChar)
+            {
+                qemp = myMaxBaseQualChar;
+            }
+            return(qemp);
+        });
 }
 
 
 void Recab::processParams()
 {
-    if(myReferenceGenome == NULL)
+    if(!myLoadTable.IsEmpty())
+    {
+        // The reference is only needed to build the table.
+        StringArray tableFiles;
+        tableFiles.AddTokens(myLoadTable, ',');
+        for(int i = 0; i < tableFiles.Length(); i++)
+        {
+            Logger::gLogger->writeLog("Loading recalibration counts %s",
+                                      tableFiles[i].c_str());
+            std::map<std::string, uint16_t> rg2id;
+            for(uint16_t id = 0; id < myId2Rg.size(); id++)
+            {
+                rg2id[myId2Rg[id]] = id;
+            }
+            if(!hasherrormodel.readTable(tableFiles[i].c_str(), 
+                                         rg2id, myId2Rg))
+            {
+                Logger::gLogger->error("Failed to read recalibration counts from %s",
+                                       tableFiles[i].c_str());
+            }
+            // Add the new read groups in the same order.
+            for(uint32_t id = myReadGroups.size(); id < myId2Rg.size(); id++)
+            {
+                myReadGroups.insert(myId2Rg[id].data(), myId2Rg[id].length());
+            }
+        }
+    }
+    else if(myReferenceGenome == NULL)
     {
         Logger::gLogger->writeLog("Open reference");
         myReferenceGenome = new GenomeSequence(myRefFile);
@@ -881,15 +1490,70 @@ void Recab::processParams()
         }
         Logger::gLogger->writeLog("Done! Sequence length %u",
                                   myReferenceGenome->sequenceLength());
+        if(mySharedRef)
+        {
+            // Another job may have already packed the reference & dbSNP.
+            myPackedReference.setReference(myReferenceGenome, NULL);
+            if(myPackedReference.attachShared(myRefFile.c_str(),
+                                              myDbsnpFile.c_str()))
+            {
+                Logger::gLogger->writeLog("Attached to the shared reference %s",
+                                          PackedReference::getSharedName(myRefFile.c_str(), myDbsnpFile.c_str()).c_str());
+            }
+        }
         //dbSNP
-        if(myDbsnpFile.IsEmpty())
+        if(myPackedReference.isShared())
+        {
+            // dbSNP is in the shared reference.
+        }
+        else if(myDbsnpFile.IsEmpty())
         {
             Logger::gLogger->writeLog("No dbSNP File");
         }
+        else if(KnownSites::isKnownSitesFile(myDbsnpFile.c_str()))
+        {
+            // Memory map the bitmap rather than building one.
+            if(!myKnownSites.open(myDbsnpFile.c_str()))
+            {
+                Logger::gLogger->error("Failed to open dbSNP file.");
+            }
+            myKnownSites.setReference(*myReferenceGenome);
+        }
         else if(myReferenceGenome->loadDBSNP(myDbSNP,myDbsnpFile.c_str()))
         {
             Logger::gLogger->error("Failed to open dbSNP file.");
         }
+        if(myPackedReference.isShared())
+        {
+            // Already attached.
+        }
+        else if(myDbsnpFile.IsEmpty())
+        {
+            myPackedReference.setReference(myReferenceGenome, NULL);
+        }
+        else if(myKnownSites.isOpen())
+        {
+            myPackedReference.setReference(myReferenceGenome, NULL,
+                                           &myKnownSites);
+        }
+        else
+        {
+            myPackedReference.setReference(myReferenceGenome, &myDbSNP);
+        }
+        if(mySharedRef && !myPackedReference.isShared())
+        {
+            Logger::gLogger->writeLog("Pack the shared reference %s",
+                                      PackedReference::getSharedName(myRefFile.c_str(), myDbsnpFile.c_str()).c_str());
+            if(myPackedReference.openShared(myRefFile.c_str(),
+                                            myDbsnpFile.c_str()))
+            {
+                Logger::gLogger->writeLog("Done!");
+            }
+            else
+            {
+                Logger::gLogger->warning("Failed to share the reference, so packing it for this job only");
+            }
+        }
     }
 
     if(myLogReg && myFast)
@@ -910,10 +1574,38 @@ void Recab::processParams()
     }
 
     HashErrorModel::setUseLogReg(myLogReg);
-    HashErrorModel::setUseFast(myFast);
+    selectKernels();
 
     myIntBuildExcludeFlags = myBuildExcludeFlags.AsInteger();
     myIntApplyExcludeFlags = myApplyExcludeFlags.AsInteger();
 
     myParamsSetup = true;
 }
+
+
+void Recab::selectKernels()
+{
+    if(HashErrorModel::getUseLogReg())
+    {
+        myApplyTableToRead = &Recab::applyTableToRead<true>;
+    }
+    else
+    {
+        myApplyTableToRead = &Recab::applyTableToRead<false>;
+    }
+
+    static const AddReadFunc addReadFuncs[8] = 
+        {
+            &Recab::addReadToTable<false, false, false>,
+            &Recab::addReadToTable<false, false, true>,
+            &Recab::addReadToTable<false, true, false>,
+            &Recab::addReadToTable<false, true, true>,
+            &Recab::addReadToTable<true, false, false>,
+            &Recab::addReadToTable<true, false, true>,
+            &Recab::addReadToTable<true, true, false>,
+            &Recab::addReadToTable<true, true, true>
+        };
+    myAddReadToTable = addReadFuncs[(myDbsnpFile.IsEmpty() ? 0 : 4) +
+                                    (myKeepPrevDbsnp ? 2 : 0) +
+                                    (myKeepPrevNonAdjacent ? 1 : 0)];
+}
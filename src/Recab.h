@@ -30,16 +30,23 @@
 
 #include <stdint.h>
 #include <string>
+#include <deque>
+#include <future>
+#include <memory>
 // imports from samtools
 #include "SamFile.h"
 #include "Generic.h"
 #include "GenomeSequence.h"
+#include "Cigar.h"
 #include "MemoryMapArray.h"
 #include "HashErrorModel.h"
+#include "PackedReference.h"
+#include "KnownSites.h"
 #include "Prediction.h"
 #include "BaseAsciiMap.h"
 #include "BamExecutable.h"
 #include "Squeeze.h"
+#include "ReadGroupDict.h"
 
 class Recab : public BamExecutable
 {
@@ -66,20 +73,193 @@ private:
     static const int DEFAULT_MIN_BASE_QUAL = 5;
     static const int DEFAULT_MAX_BASE_QUAL = 50;
 
+    // Number of reads handed to a thread at a time when building the
+    // recalibration table with multiple threads.
+    static const unsigned int BUILD_BATCH_SIZE = 1000;
+
+    // Number of evenly spaced regions of the genome read when building
+    // the table from a sample of bases (--buildBases).
+    static const unsigned int NUM_SAMPLE_WINDOWS = 1000;
+
     // quality String
     typedef struct {
         std::string oldq;
         std::string newq;
     } quality_t;
 
+    // Per base counts from building the table.
+    struct BaseCounts
+    {
+        BaseCounts();
+        BaseCounts& operator+=(const BaseCounts& other);
+
+        uint64_t numDBSnpSkips;
+        uint64_t subMinQual;
+        uint64_t ambiguous;
+        uint64_t bMatchCount;
+        uint64_t bMismatchCount;
+        // should be sum of bMatchCount & bMismatchCount
+        uint64_t basecounts;
+    };
+
+    // Copy of a record to add its bases to the table on another thread,
+    // with the fields that are looked up in the order of the records.
+    struct BuildRead
+    {
+        genomeIndex_t mapPos;
+        const PackedReference::Chromosome* chromosome;
+        uint16_t flag;
+        uint16_t rgid;
+        // The BAM record buffer.
+        std::string record;
+    };
+
+    // Reads waiting to be added to a table by another thread.
+    struct BuildBatch
+    {
+        BuildBatch()
+            : reads(BUILD_BATCH_SIZE), numReads(0), numUsed(0),
+              numSkipped(0), numQualTagErrors(0), warnings() {}
+        std::vector<BuildRead> reads;
+        unsigned int numReads;
+        // Results that are logged & counted by retireBuildBatch in
+        // the order of the batches.  A NULL warning is a tag error.
+        uint64_t numUsed;
+        uint64_t numSkipped;
+        uint64_t numQualTagErrors;
+        std::vector<const char*> warnings;
+    };
+
+    // Table and counts owned by one thread at a time, so no locking
+    // is needed while counting.  They are merged by finishBuildTable.
+    struct BuildShard
+    {
+        HashErrorModel table;
+        BaseCounts counts;
+        ReadCovariates covariates;
+        // The record being added, which needs no references from the
+        // header to be decoded.
+        SamFileHeader header;
+        SamRecord record;
+        std::string quality;
+    };
+
+    struct PendingBuild
+    {
+        std::unique_ptr<BuildBatch> batch;
+        BuildShard* shard;
+        std::future<void> result;
+    };
+
     void processParams();
 
+    // The per base work is done by versions of these functions compiled
+    // for each setting of the options they check, which selectKernels
+    // picks once the options are known, so the options are not checked
+    // for every base.
+
+    // Recalibrated quality for a base the lookup table does not cover.
+    template<bool USE_LOG_REG>
+    char getNewQual(BaseData& data, char oldQual);
+
+    // Set the new qualities of a read that passed the read level checks
+    // from myQualityStrings.oldq.
+    template<bool USE_LOG_REG>
+    void applyTableToRead(SamRecord& samRecord, BaseData& data,
+                          int seqLen, uint16_t flag);
+
+    // Add the bases of a read that passed the read level checks.
+    template<bool USE_DBSNP, bool KEEP_PREV_DBSNP, bool KEEP_PREV_NON_ADJACENT>
+    void addReadToTable(genomeIndex_t mapPos, 
+                        const PackedReference::Chromosome* chromosome,
+                        uint16_t flag, uint16_t rgid,
+                        const char* sequence, const std::string& quality,
+                        Cigar& cigar, BaseCounts& counts,
+                        HashErrorModel& table, ReadCovariates& covariates);
+
+    typedef void (Recab::*ApplyTableFunc)(SamRecord& samRecord, BaseData& data,
+                                          int seqLen, uint16_t flag);
+    typedef void (Recab::*AddReadFunc)(genomeIndex_t mapPos, 
+                                       const PackedReference::Chromosome* chromosome,
+                                       uint16_t flag, uint16_t rgid,
+                                       const char* sequence,
+                                       const std::string& quality,
+                                       Cigar& cigar, BaseCounts& counts,
+                                       HashErrorModel& table,
+                                       ReadCovariates& covariates);
+
+    // Set myApplyTableToRead & myAddReadToTable for the current options.
+    void selectKernels();
+
+    // Returns whether pos is in dbSNP, using the packed chromosome if
+    // it covers pos.
+    inline bool isDbSNP(const PackedReference::Chromosome* chromosome,
+                        genomeIndex_t pos)
+    {
+        uint8_t packed = PackedReference::OUTSIDE;
+        if(chromosome != NULL)
+        {
+            packed = chromosome->get(pos);
+        }
+        if(packed == PackedReference::OUTSIDE)
+        {
+            if(myPackedReference.isShared())
+            {
+                // dbSNP was not loaded.
+                packed = myPackedReference.getShared(pos);
+                return((packed != PackedReference::OUTSIDE) &&
+                       ((packed & PackedReference::DBSNP) != 0));
+            }
+            if(myKnownSites.isOpen())
+            {
+                return(myKnownSites.hasGenomePosition(*myReferenceGenome, pos));
+            }
+            return(myDbSNP[pos]);
+        }
+        return((packed & PackedReference::DBSNP) != 0);
+    }
+
+    // Get the id of the record's read group, adding it if it is new.
+    uint16_t getReadGroupId(SamRecord& samRecord);
+
+    // Set quality to the qualities of the record to build the table with,
+    // those in myQField if it is set and valid, incrementing
+    // numQualTagErrors if it is not.  Returns the warning to log if the
+    // record cannot be used, otherwise NULL.
+    const char* getBuildQuality(SamRecord& samRecord, std::string& quality,
+                                uint64_t& numQualTagErrors);
+
+    // Add the reads of the batch to the shard's table (on another thread).
+    void buildBatch(BuildBatch& batch, BuildShard& shard);
+
+    // Wait for the batch, then log its warnings, add its counts, and
+    // free it and its shard for reuse.
+    void retireBuildBatch(PendingBuild& pending);
+
+    // Hand the current batch to the thread pool, waiting for the oldest
+    // batch if all shards are busy.
+    void submitBuildBatch();
+
+    // Wait for all batches and merge the shards into hasherrormodel.
+    void finishBuildTable();
+
+    // Build the table from reads at the start of evenly spaced regions of
+    // the indexed BAM until about targetBases read bases are used, reading
+    // further into the regions while the target is not reached.
+    // Returns the number of records read.
+    int buildSampledTable(const char* inFile, uint64_t targetBases);
+
+    // Log the read & base counts of the reads processed for the table.
+    void logBuildCounts();
+
     // So external programs can read recab parameters.
     bool myParamsSetup;
     String myRefFile;
     String myDbsnpFile;
     String myQField;  // Quality TAG
     String myStoreQualTag;  // Store old quality into this TAG
+    String myLoadTable;  // Comma separated --saveTable files to load
+    String mySaveTable;
     String myBuildExcludeFlags;
     String myApplyExcludeFlags;
     uint16_t myIntBuildExcludeFlags;
@@ -90,9 +270,11 @@ private:
     int myBlendedWeight;
     bool myFitModel;
     bool myFast;
+    bool mySharedRef;
     bool myKeepPrevDbsnp;
     bool myKeepPrevNonAdjacent;
     bool myLogReg;
+    bool myFitPerRG;
 
     // Per read counts
     uint64_t myMappedCount;
@@ -111,27 +293,43 @@ private:
     // Couldn't find quality tag, so using current quality.
     uint64_t myNumQualTagErrors;
 
-    // Per base counts.
-    uint64_t myNumDBSnpSkips;
-    uint64_t mySubMinQual;
-    uint64_t myAmbiguous;
-    uint64_t myBMatchCount;
-    uint64_t myBMismatchCount;
+    ApplyTableFunc myApplyTableToRead;
+    AddReadFunc myAddReadToTable;
 
-    // should be sum of myBMatchCount & myBMismatchCount
-    uint64_t myBasecounts;
+    // Per base counts (only from this thread when building with threads).
+    BaseCounts myBaseCounts;
+    // Covariates of the read being added to the table on this thread.
+    ReadCovariates myReadCovariates;
 
     GenomeSequence* myReferenceGenome;
     mmapArrayBool_t myDbSNP;
+    KnownSites myKnownSites;
+    PackedReference myPackedReference;
     HashErrorModel hasherrormodel;
     Prediction prediction;
 
+    // Set once a leading sample (--buildSample) has built the table, so
+    // later reads are only counted for the report: their matches go to
+    // myCountOnlyTable, leaving hasherrormodel as it was applied.
+    bool myCountOnly;
+    HashErrorModel myCountOnlyTable;
+
+    // New quality of each entry of hasherrormodel, set after it is built.
+    HashErrorModel::QualLookup myQualLookup;
+
+    // Used when building the table with multiple threads.
+    std::unique_ptr<BuildBatch> myBuildBatch;
+    std::vector<std::unique_ptr<BuildBatch> > myFreeBatches;
+    std::vector<std::unique_ptr<BuildShard> > myShards;
+    std::vector<BuildShard*> myFreeShards;
+    std::deque<PendingBuild> myPendingBuilds;
+
     // Make this member data so it reuses the string structures everytime
     // rather than constructing new ones every time.
     quality_t myQualityStrings;
 
-    std::map<std::string, uint16_t> myRg2Id;
-    typedef std::pair<std::map<std::string, uint16_t>::iterator, bool> RgInsertReturn;
+    // Read group ids are assigned in the order the read groups are seen.
+    ReadGroupDict myReadGroups;
     std::vector<std::string> myId2Rg;
 
     // Squeeze
@@ -0,0 +1,294 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string.h>
+
+#include "RecordCollator.h"
+#include "ReadNameMap.h"
+
+// Offset of the read name in a raw record that starts with its block size.
+static const uint32_t READ_NAME_OFFSET = 36;
+
+namespace
+{
+    // Orders record offsets by the read name of the record.
+    struct ReadNameLess
+    {
+        const char* myRecords;
+        ReadNameLess(const char* records) : myRecords(records) {}
+        bool operator()(uint64_t left, uint64_t right) const
+        {
+            return(strcmp(myRecords + left + READ_NAME_OFFSET,
+                          myRecords + right + READ_NAME_OFFSET) < 0);
+        }
+    };
+}
+
+
+RecordCollator::RecordCollator()
+    : myTmpPrefix(),
+      myMaxBytes(DEFAULT_MAX_BYTES),
+      myNumFiles(0),
+      myNumRecords(0),
+      myPartition(),
+      myPending(),
+      myLoaded(),
+      myRecords(),
+      myOrder(),
+      myNext(0)
+{
+}
+
+
+RecordCollator::~RecordCollator()
+{
+    clear();
+}
+
+
+void RecordCollator::init(const std::string& tmpPrefix, uint64_t maxBytes)
+{
+    clear();
+    myTmpPrefix = tmpPrefix;
+    myMaxBytes = maxBytes;
+    myPartition.resize(NUM_BUCKETS);
+}
+
+
+void RecordCollator::add(SamRecord& record)
+{
+    const char* buffer =
+        (const char*)record.getRecordBuffer(SamRecord::NONE);
+    if(buffer == NULL)
+    {
+        throw std::runtime_error("Failed to get the record to collate");
+    }
+    uint32_t size = *(const int32_t*)buffer + sizeof(int32_t);
+    write(myPartition[getBucket(buffer + READ_NAME_OFFSET, 0)],
+          buffer, size);
+    ++myNumRecords;
+}
+
+
+void RecordCollator::finishPartition()
+{
+    closeBuckets(myPartition);
+    myPartition.clear();
+}
+
+
+bool RecordCollator::ReadRecord(SamFileHeader& header, SamRecord& record)
+{
+    while(myNext >= myOrder.size())
+    {
+        if(!loadBucket())
+        {
+            return(false);
+        }
+    }
+    const char* buffer = &(myRecords[myOrder[myNext++]]);
+    if(record.setBuffer(buffer, *(const int32_t*)buffer + sizeof(int32_t),
+                        header) != SamStatus::SUCCESS)
+    {
+        throw std::runtime_error("Failed to read a collated record");
+    }
+    return(true);
+}
+
+
+void RecordCollator::rewind()
+{
+    myPending.insert(myPending.begin(), myLoaded.begin(), myLoaded.end());
+    myLoaded.clear();
+    myOrder.clear();
+    myNext = 0;
+}
+
+
+void RecordCollator::clear()
+{
+    for(size_t i = 0; i < myPartition.size(); i++)
+    {
+        if(myPartition[i].file != NULL)
+        {
+            fclose(myPartition[i].file);
+            remove(myPartition[i].fileName.c_str());
+        }
+    }
+    myPartition.clear();
+    for(size_t i = 0; i < myPending.size(); i++)
+    {
+        remove(myPending[i].fileName.c_str());
+    }
+    myPending.clear();
+    for(size_t i = 0; i < myLoaded.size(); i++)
+    {
+        remove(myLoaded[i].fileName.c_str());
+    }
+    myLoaded.clear();
+    std::vector<char>().swap(myRecords);
+    std::vector<uint64_t>().swap(myOrder);
+    myNext = 0;
+    myNumRecords = 0;
+}
+
+
+uint32_t RecordCollator::getBucket(const char* readName, uint32_t level)
+{
+    uint64_t hash1;
+    uint64_t hash2;
+    ReadNameMap::hashName(readName, hash1, hash2);
+    // A different combination of the hashes at each level so the records
+    // of a bucket are spread over the next level's buckets.
+    uint64_t hash = hash1 + level * hash2;
+    hash ^= hash >> 31;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 32;
+    return(hash % NUM_BUCKETS);
+}
+
+
+void RecordCollator::write(Bucket& bucket, const char* buffer, uint32_t size)
+{
+    if(bucket.file == NULL)
+    {
+        std::stringstream fileName;
+        fileName << myTmpPrefix << ".collate" << myNumFiles++;
+        bucket.fileName = fileName.str();
+        bucket.file = fopen(bucket.fileName.c_str(), "wb");
+        if(bucket.file == NULL)
+        {
+            throw std::runtime_error("Failed to open the collate file " +
+                                     bucket.fileName);
+        }
+        setvbuf(bucket.file, NULL, _IOFBF, FILE_BUFFER_SIZE);
+    }
+    if(fwrite(buffer, 1, size, bucket.file) != size)
+    {
+        throw std::runtime_error("Failed to write the collate file " +
+                                 bucket.fileName);
+    }
+    bucket.numBytes += size;
+}
+
+
+void RecordCollator::closeBuckets(std::vector<Bucket>& buckets)
+{
+    // Queue in front of the remaining buckets so the buckets split from
+    // one bucket are read before moving on to the next.
+    std::deque<Bucket>::iterator pos = myPending.begin();
+    for(size_t i = 0; i < buckets.size(); i++)
+    {
+        Bucket& bucket = buckets[i];
+        if(bucket.file == NULL)
+        {
+            continue;
+        }
+        bool failed = (fclose(bucket.file) != 0);
+        bucket.file = NULL;
+        pos = myPending.insert(pos, bucket) + 1;
+        if(failed)
+        {
+            throw std::runtime_error("Failed to write the collate file " +
+                                     bucket.fileName);
+        }
+    }
+}
+
+
+void RecordCollator::split(Bucket& bucket)
+{
+    FILE* in = fopen(bucket.fileName.c_str(), "rb");
+    if(in == NULL)
+    {
+        throw std::runtime_error("Failed to open the collate file " +
+                                 bucket.fileName);
+    }
+    setvbuf(in, NULL, _IOFBF, FILE_BUFFER_SIZE);
+
+    std::vector<Bucket> buckets(NUM_BUCKETS);
+    for(size_t i = 0; i < buckets.size(); i++)
+    {
+        buckets[i].level = bucket.level + 1;
+    }
+    std::vector<char> buffer;
+    int32_t blockSize;
+    while(fread(&blockSize, sizeof(blockSize), 1, in) == 1)
+    {
+        buffer.resize(blockSize + sizeof(blockSize));
+        memcpy(&(buffer[0]), &blockSize, sizeof(blockSize));
+        if((blockSize < 0) ||
+           (fread(&(buffer[sizeof(blockSize)]), 1, blockSize, in) !=
+            (size_t)blockSize))
+        {
+            fclose(in);
+            throw std::runtime_error("Failed to read the collate file " +
+                                     bucket.fileName);
+        }
+        write(buckets[getBucket(&(buffer[READ_NAME_OFFSET]), bucket.level + 1)],
+              &(buffer[0]), buffer.size());
+    }
+    fclose(in);
+    remove(bucket.fileName.c_str());
+    closeBuckets(buckets);
+}
+
+
+bool RecordCollator::loadBucket()
+{
+    myOrder.clear();
+    myNext = 0;
+    while(!myPending.empty())
+    {
+        Bucket bucket = myPending.front();
+        myPending.pop_front();
+        if((bucket.numBytes > myMaxBytes) && (bucket.level + 1 < MAX_LEVELS))
+        {
+            split(bucket);
+            continue;
+        }
+
+        FILE* in = fopen(bucket.fileName.c_str(), "rb");
+        myRecords.resize(bucket.numBytes);
+        if((in == NULL) ||
+           (fread(&(myRecords[0]), 1, bucket.numBytes, in) != bucket.numBytes))
+        {
+            if(in != NULL)
+            {
+                fclose(in);
+            }
+            myLoaded.push_back(bucket);
+            throw std::runtime_error("Failed to read the collate file " +
+                                     bucket.fileName);
+        }
+        fclose(in);
+        myLoaded.push_back(bucket);
+
+        for(uint64_t offset = 0; offset < bucket.numBytes;
+            offset += *(const int32_t*)&(myRecords[offset]) + sizeof(int32_t))
+        {
+            myOrder.push_back(offset);
+        }
+        std::stable_sort(myOrder.begin(), myOrder.end(),
+                         ReadNameLess(&(myRecords[0])));
+        return(true);
+    }
+    return(false);
+}
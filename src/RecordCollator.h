@@ -0,0 +1,138 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RECORD_COLLATOR_H__
+#define __RECORD_COLLATOR_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "SamFileHeader.h"
+#include "SamRecord.h"
+
+/// Groups the records with the same read name without sorting the file.
+/// Records are hash partitioned by read name into temporary bucket files,
+/// then each bucket is read back into memory and ordered by read name
+/// (keeping the input order of records with the same name), so mates are
+/// returned next to each other.  A bucket larger than the memory limit is
+/// partitioned again with a different hash, so memory stays bounded
+/// however far apart the mates are in the input.
+class RecordCollator
+{
+public:
+    RecordCollator();
+    ~RecordCollator();
+
+    /// Set the prefix of the temporary files and the most bytes of records
+    /// to load into memory at once.
+    void init(const std::string& tmpPrefix, uint64_t maxBytes = DEFAULT_MAX_BYTES);
+
+    /// Partition all records from the opened file (SamFile or
+    /// ThreadedSamFile) whose header has already been read.
+    /// Throws std::runtime_error if the file could not be read.
+    template<class IN>
+    void partition(IN& samIn, SamFileHeader& header)
+    {
+        SamRecord record;
+        while(samIn.ReadRecord(header, record))
+        {
+            add(record);
+        }
+        finishPartition();
+        if(samIn.GetStatus() != SamStatus::NO_MORE_RECS)
+        {
+            throw std::runtime_error("Failed to read the records to collate");
+        }
+    }
+
+    /// Add a record to its bucket.
+    /// Throws std::runtime_error if the bucket could not be written.
+    void add(SamRecord& record);
+
+    /// Done adding records, close the bucket files.
+    void finishPartition();
+
+    /// Read the next record, records with the same read name are returned
+    /// consecutively.  Returns false when there are no more records.
+    bool ReadRecord(SamFileHeader& header, SamRecord& record);
+
+    /// Return the records again starting from the first one.
+    void rewind();
+
+    /// Remove the temporary files.
+    void clear();
+
+    uint64_t getNumRecords() { return(myNumRecords); }
+
+private:
+    struct Bucket
+    {
+        std::string fileName;
+        FILE* file;
+        uint64_t numBytes;
+        uint32_t level;
+        Bucket() : fileName(), file(NULL), numBytes(0), level(0) {}
+    };
+
+    static const uint32_t NUM_BUCKETS = 64;
+    // Number of times a bucket may be partitioned before it is loaded
+    // no matter its size.
+    static const uint32_t MAX_LEVELS = 4;
+    static const uint64_t DEFAULT_MAX_BYTES = 256 << 20;
+    static const size_t FILE_BUFFER_SIZE = 64 << 10;
+
+    RecordCollator(const RecordCollator&);
+    RecordCollator& operator=(const RecordCollator&);
+
+    static uint32_t getBucket(const char* readName, uint32_t level);
+
+    // Append the raw record (starting with its block size) to the
+    // bucket, opening its file if needed.
+    void write(Bucket& bucket, const char* buffer, uint32_t size);
+
+    // Close the buckets, queueing the non-empty ones to be read.
+    void closeBuckets(std::vector<Bucket>& buckets);
+
+    // Partition the bucket's records into the next level of buckets.
+    void split(Bucket& bucket);
+
+    // Load the next bucket into memory, returning false if there are none.
+    bool loadBucket();
+
+    std::string myTmpPrefix;
+    uint64_t myMaxBytes;
+    uint32_t myNumFiles;
+    uint64_t myNumRecords;
+
+    // Buckets being written.
+    std::vector<Bucket> myPartition;
+    // Buckets waiting to be read.
+    std::deque<Bucket> myPending;
+    // Buckets that were already read, kept for rewind.
+    std::vector<Bucket> myLoaded;
+
+    // Records of the loaded bucket and their offsets in read name order.
+    std::vector<char> myRecords;
+    std::vector<uint64_t> myOrder;
+    size_t myNext;
+};
+
+#endif
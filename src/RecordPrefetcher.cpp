@@ -0,0 +1,275 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "RecordPrefetcher.h"
+
+// Offset of the flag in a BAM record buffer (after the block size).
+static const uint32_t FLAG_OFFSET = 18;
+
+RecordPrefetcher::RecordPrefetcher()
+    : myReadFunc(),
+      myRequiredFlags(0),
+      myExcludedFlags(0),
+      myThread(),
+      myMutex(),
+      myCondition(),
+      myFull(),
+      myFree(),
+      myBatches(),
+      myStopping(false),
+      myReadDone(false),
+      myReadError(),
+      myException(),
+      myCurrent(NULL),
+      myCurrentIndex(0),
+      myDone(false),
+      myError()
+{
+}
+
+
+RecordPrefetcher::~RecordPrefetcher()
+{
+    stop();
+}
+
+
+void RecordPrefetcher::start(ReadFunc readFunc, uint16_t requiredFlags,
+                             uint16_t excludedFlags)
+{
+    stop();
+
+    myReadFunc = readFunc;
+    myRequiredFlags = requiredFlags;
+    myExcludedFlags = excludedFlags;
+    myBatches.resize(NUM_BATCHES);
+    for(unsigned int i = 0; i < myBatches.size(); i++)
+    {
+        myFree.push_back(&(myBatches[i]));
+    }
+    myStopping = false;
+    myReadDone = false;
+    myReadError.clear();
+    myException = nullptr;
+    myCurrent = NULL;
+    myCurrentIndex = 0;
+    myDone = false;
+    myError.clear();
+
+    myThread = std::thread(&RecordPrefetcher::readBatches, this);
+}
+
+
+void RecordPrefetcher::stop()
+{
+    if(!myThread.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(myMutex);
+        myStopping = true;
+    }
+    myCondition.notify_all();
+    myThread.join();
+
+    myFull.clear();
+    myFree.clear();
+    myCurrent = NULL;
+    myDone = true;
+    myReadFunc = ReadFunc();
+}
+
+
+bool RecordPrefetcher::next(const char*& record, uint32_t& size)
+{
+    while((myCurrent == NULL) ||
+          (myCurrentIndex == myCurrent->offsets.size()))
+    {
+        if(!nextBatch())
+        {
+            return(false);
+        }
+    }
+
+    uint32_t offset = myCurrent->offsets[myCurrentIndex];
+    ++myCurrentIndex;
+    uint32_t end = myCurrent->data.size();
+    if(myCurrentIndex < myCurrent->offsets.size())
+    {
+        end = myCurrent->offsets[myCurrentIndex];
+    }
+    record = &(myCurrent->data[offset]);
+    size = end - offset;
+    return(true);
+}
+
+
+bool RecordPrefetcher::isDone()
+{
+    if(myDone)
+    {
+        return(true);
+    }
+    if((myCurrent != NULL) &&
+       (myCurrentIndex < myCurrent->offsets.size()))
+    {
+        return(false);
+    }
+    std::unique_lock<std::mutex> lock(myMutex);
+    myCondition.wait(lock, [this]() { return(!myFull.empty() || myReadDone); });
+    return(myFull.empty());
+}
+
+
+void RecordPrefetcher::readBatches()
+{
+    try
+    {
+        while(true)
+        {
+            RecordBatch* batch = NULL;
+            {
+                std::unique_lock<std::mutex> lock(myMutex);
+                myCondition.wait(lock, [this]() 
+                                 { return(myStopping || !myFree.empty()); });
+                if(myStopping)
+                {
+                    myReadDone = true;
+                    return;
+                }
+                batch = myFree.front();
+                myFree.pop_front();
+            }
+
+            bool more = fillBatch(*batch);
+            {
+                std::lock_guard<std::mutex> lock(myMutex);
+                if(batch->offsets.empty())
+                {
+                    myFree.push_back(batch);
+                }
+                else
+                {
+                    myFull.push_back(batch);
+                }
+                myReadDone = !more;
+            }
+            myCondition.notify_all();
+            if(!more)
+            {
+                return;
+            }
+        }
+    }
+    catch(...)
+    {
+        {
+            std::lock_guard<std::mutex> lock(myMutex);
+            myException = std::current_exception();
+            myReadDone = true;
+        }
+        myCondition.notify_all();
+    }
+}
+
+
+bool RecordPrefetcher::fillBatch(RecordBatch& batch)
+{
+    batch.data.clear();
+    batch.offsets.clear();
+    batch.data.reserve(BATCH_SIZE);
+
+    while(batch.data.size() < BATCH_SIZE)
+    {
+        int32_t blockSize = 0;
+        uint32_t numRead = myReadFunc(&blockSize, sizeof(blockSize));
+        if(numRead == 0)
+        {
+            return(false);
+        }
+        if((numRead != sizeof(blockSize)) || (blockSize <= 0))
+        {
+            myReadError = "Failed to read the record block size.";
+            return(false);
+        }
+
+        // The record buffer starts with the block size.
+        uint32_t offset = batch.data.size();
+        batch.data.resize(offset + sizeof(blockSize) + blockSize);
+        memcpy(&(batch.data[offset]), &blockSize, sizeof(blockSize));
+        if(myReadFunc(&(batch.data[offset + sizeof(blockSize)]), blockSize) !=
+           (uint32_t)blockSize)
+        {
+            batch.data.resize(offset);
+            myReadError = "Failed to read the BAM record, the file is truncated.";
+            return(false);
+        }
+
+        // Too short records are left for the caller to fail parsing.
+        if((blockSize + sizeof(blockSize)) >= (FLAG_OFFSET + sizeof(uint16_t)))
+        {
+            uint16_t flag = 0;
+            memcpy(&flag, &(batch.data[offset + FLAG_OFFSET]), sizeof(flag));
+            if(((flag & myRequiredFlags) != myRequiredFlags) ||
+               ((flag & myExcludedFlags) != 0))
+            {
+                batch.data.resize(offset);
+                continue;
+            }
+        }
+        batch.offsets.push_back(offset);
+    }
+    return(true);
+}
+
+
+bool RecordPrefetcher::nextBatch()
+{
+    if(myDone)
+    {
+        return(false);
+    }
+
+    std::unique_lock<std::mutex> lock(myMutex);
+    if(myCurrent != NULL)
+    {
+        myFree.push_back(myCurrent);
+        myCurrent = NULL;
+        myCondition.notify_all();
+    }
+    myCondition.wait(lock, [this]() { return(!myFull.empty() || myReadDone); });
+    if(!myFull.empty())
+    {
+        myCurrent = myFull.front();
+        myFull.pop_front();
+        myCurrentIndex = 0;
+        return(true);
+    }
+
+    myDone = true;
+    myError = myReadError;
+    if(myException)
+    {
+        std::exception_ptr exception = myException;
+        myException = nullptr;
+        std::rethrow_exception(exception);
+    }
+    return(false);
+}
@@ -0,0 +1,115 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RECORD_PREFETCHER_H__
+#define __RECORD_PREFETCHER_H__
+
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+/// Reads uncompressed BAM records on a background thread into a ring of
+/// record batches, so reading/inflating the file overlaps with the
+/// caller's processing of the records.
+class RecordPrefetcher
+{
+public:
+    /// Reads up to len bytes, returning the number read, which is only
+    /// less than len at the end of the input.  May throw.
+    typedef std::function<uint32_t(void*, uint32_t)> ReadFunc;
+
+    RecordPrefetcher();
+    ~RecordPrefetcher();
+
+    /// Start reading the records (the input must be positioned after the
+    /// header) on a background thread.  Records without all of the
+    /// required flags or with any of the excluded flags are skipped.
+    /// readFunc is only called from the background thread until stop.
+    void start(ReadFunc readFunc, uint16_t requiredFlags,
+               uint16_t excludedFlags);
+
+    /// Stop reading and wait for the background thread to exit.
+    void stop();
+
+    bool isRunning() { return(myThread.joinable()); }
+
+    /// Set record to the next record's BAM buffer (starting with the block
+    /// size), which is valid until the next call.  Returns false if there
+    /// are no more records, in which case getError is empty at the end of
+    /// the input and otherwise says why the records could not be read.
+    /// Rethrows any exception thrown by readFunc.
+    bool next(const char*& record, uint32_t& size);
+
+    /// Return true if there are no more records.
+    bool isDone();
+
+    const std::string& getError() { return(myError); }
+
+    /// Records are read in batches of about this many bytes.
+    static const uint32_t BATCH_SIZE = 1024 * 1024;
+    /// Number of batches that can be read ahead of the caller.
+    static const unsigned int NUM_BATCHES = 4;
+
+private:
+    RecordPrefetcher(const RecordPrefetcher&);
+    RecordPrefetcher& operator=(const RecordPrefetcher&);
+
+    struct RecordBatch
+    {
+        std::vector<char> data;
+        // Offset of each record in data.
+        std::vector<uint32_t> offsets;
+    };
+
+    // Background thread loop.
+    void readBatches();
+    // Read records into the batch until it is full or the input ends.
+    // Returns false at the end of the input or on an error.
+    bool fillBatch(RecordBatch& batch);
+    // Move on to the next full batch, returning false if there are none.
+    bool nextBatch();
+
+    ReadFunc myReadFunc;
+    uint16_t myRequiredFlags;
+    uint16_t myExcludedFlags;
+
+    std::thread myThread;
+    std::mutex myMutex;
+    std::condition_variable myCondition;
+    std::deque<RecordBatch*> myFull;
+    std::deque<RecordBatch*> myFree;
+    std::vector<RecordBatch> myBatches;
+    bool myStopping;
+    // Set by the background thread once it will not add more batches.
+    bool myReadDone;
+    std::string myReadError;
+    std::exception_ptr myException;
+
+    // Batch being returned to the caller, NULL if none.
+    RecordBatch* myCurrent;
+    uint32_t myCurrentIndex;
+    bool myDone;
+    std::string myError;
+};
+
+#endif
@@ -0,0 +1,639 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <functional>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include "RemoteBamCache.h"
+#include "BamExecutable.h"
+#include "ParallelBgzf.h"
+
+// BAI bin holding the reference's metadata rather than chunks.
+static const uint32_t BAI_META_BIN = 37450;
+// Largest position a BAI can index.
+static const int32_t BAI_MAX_POS = 1 << 29;
+
+template<class T>
+static T readValue(const char* ptr)
+{
+    T value;
+    memcpy(&value, ptr, sizeof(T));
+    return(value);
+}
+
+
+// Add the BAI bins that may hold records overlapping [beg, end).
+static void reg2bins(uint32_t beg, uint32_t end, std::vector<uint32_t>& bins)
+{
+    static const uint32_t FIRST_BIN[] = {0, 1, 9, 73, 585, 4681};
+    static const int SHIFT[] = {29, 26, 23, 20, 17, 14};
+    --end;
+    for(int level = 0; level < 6; level++)
+    {
+        for(uint32_t bin = FIRST_BIN[level] + (beg >> SHIFT[level]);
+            bin <= FIRST_BIN[level] + (end >> SHIFT[level]); bin++)
+        {
+            bins.push_back(bin);
+        }
+    }
+}
+
+
+RemoteBamCache::RemoteBamCache()
+    : myRemote(),
+      myBamFile(),
+      myIndexFile(),
+      myFetchedFile(),
+      myFd(-1),
+      myFetched(),
+      myRefNames(),
+      myIndex()
+{
+}
+
+
+RemoteBamCache::~RemoteBamCache()
+{
+    if(myFd >= 0)
+    {
+        close(myFd);
+    }
+}
+
+
+bool RemoteBamCache::open(const std::string& url, const std::string& indexUrl)
+{
+    if(!myRemote.open(url))
+    {
+        return(false);
+    }
+
+    // The cache files are named by the URL and size, so a changed
+    // remote file gets new ones.
+    std::string cacheDir;
+    const char* envDir = getenv("BAM_REMOTE_CACHE");
+    if((envDir != NULL) && (*envDir != '\0'))
+    {
+        cacheDir = envDir;
+    }
+    else
+    {
+        const char* tmpDir = getenv("TMPDIR");
+        cacheDir = (tmpDir == NULL) ? "/tmp" : tmpDir;
+        cacheDir += "/bamRemoteCache";
+    }
+    if((mkdir(cacheDir.c_str(), 0755) != 0) && (errno != EEXIST))
+    {
+        std::cerr << "Failed to create the remote cache directory "
+                  << cacheDir << ": " << strerror(errno) << std::endl;
+        return(false);
+    }
+    std::ostringstream baseName;
+    baseName << cacheDir << "/" << std::hex
+             << std::hash<std::string>()(url) << std::dec
+             << "_" << myRemote.getSize();
+    myBamFile = baseName.str() + ".bam";
+    myIndexFile = myBamFile + ".bai";
+    myFetchedFile = baseName.str() + ".fetched";
+
+    uint64_t numBlocks =
+        (myRemote.getSize() + CACHE_BLOCK_SIZE - 1) / CACHE_BLOCK_SIZE;
+    myFetched.assign(numBlocks, 0);
+    myFd = ::open(myBamFile.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat cacheStat;
+    if((myFd < 0) || (fstat(myFd, &cacheStat) != 0))
+    {
+        std::cerr << "Failed to open the remote cache file " << myBamFile
+                  << ": " << strerror(errno) << std::endl;
+        return(false);
+    }
+    FILE* fetchedFile = fopen(myFetchedFile.c_str(), "rb");
+    if(fetchedFile != NULL)
+    {
+        // Use the blocks fetched by previous runs if the file is complete.
+        std::vector<char> fetched(numBlocks);
+        if((fread(fetched.data(), 1, numBlocks, fetchedFile) == numBlocks) &&
+           ((uint64_t)cacheStat.st_size == myRemote.getSize()))
+        {
+            myFetched.swap(fetched);
+        }
+        fclose(fetchedFile);
+    }
+    if(((uint64_t)cacheStat.st_size != myRemote.getSize()) &&
+       (ftruncate(myFd, myRemote.getSize()) != 0))
+    {
+        std::cerr << "Failed to size the remote cache file " << myBamFile
+                  << ": " << strerror(errno) << std::endl;
+        return(false);
+    }
+
+    // Fetch the index if it is not already cached.
+    struct stat indexStat;
+    if(stat(myIndexFile.c_str(), &indexStat) != 0)
+    {
+        bool fetched = false;
+        if(!indexUrl.empty())
+        {
+            fetched = RemoteFile::download(indexUrl, myIndexFile);
+        }
+        else
+        {
+            // Try name.bam.bai, then name.bai.
+            fetched = RemoteFile::download(url + ".bai", myIndexFile, true);
+            if(!fetched && (url.size() > 4) &&
+               (url.compare(url.size() - 4, 4, ".bam") == 0))
+            {
+                fetched = RemoteFile::download(url.substr(0, url.size() - 4) +
+                                               ".bai", myIndexFile, true);
+            }
+            if(!fetched)
+            {
+                std::cerr << "Failed to find the index for " << url
+                          << ", tried " << url << ".bai" << std::endl;
+            }
+        }
+        if(!fetched)
+        {
+            unlink(myIndexFile.c_str());
+            return(false);
+        }
+    }
+
+    if(!readIndex() || !readHeader())
+    {
+        return(false);
+    }
+
+    // SamFile checks for the EOF marker when opening the file.
+    std::vector<std::pair<uint64_t, uint64_t> > ranges;
+    uint64_t eofSize = std::min((uint64_t)ParallelBgzf::EOF_MARKER_SIZE,
+                                myRemote.getSize());
+    ranges.push_back(std::make_pair(myRemote.getSize() - eofSize,
+                                    myRemote.getSize()));
+    return(fetchRanges(ranges));
+}
+
+
+bool RemoteBamCache::fetchRegions(const std::vector<Region>& regions)
+{
+    std::vector<std::pair<uint64_t, uint64_t> > ranges;
+    for(unsigned int i = 0; i < regions.size(); i++)
+    {
+        const Region& region = regions[i];
+        int32_t refID = region.refID;
+        if(region.refName == "*")
+        {
+            refID = -1;
+        }
+        else if(!region.refName.empty())
+        {
+            std::vector<std::string>::const_iterator found =
+                std::find(myRefNames.begin(), myRefNames.end(),
+                          region.refName);
+            if(found == myRefNames.end())
+            {
+                continue;
+            }
+            refID = found - myRefNames.begin();
+        }
+        addRegionRanges(refID, region.start, region.end, ranges);
+    }
+    return(fetchRanges(ranges));
+}
+
+
+bool RemoteBamCache::fetchAll()
+{
+    std::vector<std::pair<uint64_t, uint64_t> > ranges;
+    ranges.push_back(std::make_pair(0, myRemote.getSize()));
+    return(fetchRanges(ranges));
+}
+
+
+bool RemoteBamCache::localize(std::string& inFile, std::string& indexFile,
+                              const std::vector<Region>& regions)
+{
+    if(!RemoteFile::isRemote(inFile.c_str()))
+    {
+        return(true);
+    }
+    RemoteBamCache cache;
+    if(!cache.open(inFile, indexFile) ||
+       !(regions.empty() ? cache.fetchAll() : cache.fetchRegions(regions)))
+    {
+        std::cerr << "Failed to read the remote file " << inFile << std::endl;
+        return(false);
+    }
+    inFile = cache.getBamFile();
+    indexFile = cache.getIndexFile();
+    return(true);
+}
+
+
+bool RemoteBamCache::readRegionFile(const char* fileName,
+                                    std::vector<Region>& regions)
+{
+    std::ifstream regionFile(fileName);
+    if(!regionFile)
+    {
+        std::cerr << "Failed to open the region file " << fileName << std::endl;
+        return(false);
+    }
+    std::string line;
+    while(std::getline(regionFile, line))
+    {
+        if(line.empty() || (line[0] == '#') || (line.compare(0, 5, "track") == 0))
+        {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string chrom;
+        int64_t start = 0;
+        int64_t end = 0;
+        if(fields >> chrom >> start >> end)
+        {
+            regions.push_back(Region(chrom, std::max(start - 1, (int64_t)0),
+                                     std::min(end + 1, (int64_t)BAI_MAX_POS)));
+        }
+    }
+    return(true);
+}
+
+
+bool RemoteBamCache::readIndex()
+{
+    std::vector<char> index;
+    FILE* indexFile = fopen(myIndexFile.c_str(), "rb");
+    if(indexFile != NULL)
+    {
+        char buffer[65536];
+        size_t numRead = 0;
+        while((numRead = fread(buffer, 1, sizeof(buffer), indexFile)) > 0)
+        {
+            index.insert(index.end(), buffer, buffer + numRead);
+        }
+        fclose(indexFile);
+    }
+
+    // Check each field fits before reading it.
+    const char* ptr = index.data();
+    const char* end = ptr + index.size();
+    bool valid = ((index.size() >= 8) && (memcmp(ptr, "BAI\1", 4) == 0));
+    int32_t numRefs = valid ? readValue<int32_t>(ptr + 4) : 0;
+    ptr += 8;
+    // Each reference takes at least 8 bytes.
+    valid = valid && (numRefs >= 0) && ((end - ptr) / 8 >= numRefs);
+    myIndex.assign(valid ? numRefs : 0, RefIndex());
+    for(int32_t ref = 0; valid && (ref < numRefs); ref++)
+    {
+        RefIndex& refIndex = myIndex[ref];
+        valid = (end - ptr >= 4);
+        int32_t numBins = valid ? readValue<int32_t>(ptr) : 0;
+        ptr += 4;
+        for(int32_t bin = 0; valid && (bin < numBins); bin++)
+        {
+            valid = (end - ptr >= 8);
+            if(!valid)
+            {
+                break;
+            }
+            uint32_t binNum = readValue<uint32_t>(ptr);
+            int32_t numChunks = readValue<int32_t>(ptr + 4);
+            ptr += 8;
+            valid = ((numChunks >= 0) && (end - ptr >= (int64_t)numChunks * 16));
+            if(!valid)
+            {
+                break;
+            }
+            if(binNum != BAI_META_BIN)
+            {
+                std::vector<Chunk>& chunks = refIndex.bins[binNum];
+                for(int32_t c = 0; c < numChunks; c++)
+                {
+                    Chunk chunk;
+                    chunk.begin = readValue<uint64_t>(ptr + c * 16);
+                    chunk.end = readValue<uint64_t>(ptr + c * 16 + 8);
+                    chunks.push_back(chunk);
+                }
+            }
+            ptr += numChunks * 16;
+        }
+        valid = valid && (end - ptr >= 4);
+        int32_t numIntervals = valid ? readValue<int32_t>(ptr) : 0;
+        ptr += 4;
+        valid = valid && (numIntervals >= 0) &&
+            (end - ptr >= (int64_t)numIntervals * 8);
+        for(int32_t i = 0; valid && (i < numIntervals); i++)
+        {
+            refIndex.linear.push_back(readValue<uint64_t>(ptr + i * 8));
+        }
+        ptr += numIntervals * 8;
+    }
+    if(!valid)
+    {
+        std::cerr << "Invalid or missing BAI index for "
+                  << myRemote.getUrl() << std::endl;
+        unlink(myIndexFile.c_str());
+    }
+    return(valid);
+}
+
+
+bool RemoteBamCache::readHeader()
+{
+    // Inflate blocks from the start of the file until the whole header
+    // has been read, fetching them as needed.
+    static const uint32_t BGZF_HEADER_SIZE = 18;
+    std::vector<char> header;
+    uint64_t offset = 0;
+    while(offset < myRemote.getSize())
+    {
+        std::vector<std::pair<uint64_t, uint64_t> > ranges;
+        ranges.push_back(std::make_pair(offset, offset + BGZF_HEADER_SIZE));
+        std::vector<char> blockHeader;
+        if(!fetchRanges(ranges) ||
+           !readCached(offset, BGZF_HEADER_SIZE, blockHeader))
+        {
+            return(false);
+        }
+        uint64_t blockSize =
+            readValue<uint16_t>(blockHeader.data() + 16) + (uint64_t)1;
+        ranges[0].second = offset + blockSize;
+        ParallelBgzf::BufferPtr block = std::make_shared<ParallelBgzf::Buffer>();
+        if(!fetchRanges(ranges) || !readCached(offset, blockSize, *block))
+        {
+            return(false);
+        }
+        try
+        {
+            ParallelBgzf::BufferPtr data = ParallelBgzf::inflateBlock(block);
+            header.insert(header.end(), data->begin(), data->end());
+        }
+        catch(std::runtime_error& e)
+        {
+            std::cerr << "Invalid BGZF block at the start of "
+                      << myRemote.getUrl() << ": " << e.what() << std::endl;
+            return(false);
+        }
+        offset += blockSize;
+
+        // Parse the header as far as it has been read.
+        const char* ptr = header.data();
+        const char* end = ptr + header.size();
+        if((end - ptr < 8) || (memcmp(ptr, "BAM\1", 4) != 0))
+        {
+            if(header.size() >= 4)
+            {
+                std::cerr << myRemote.getUrl() << " is not a BAM file\n";
+                return(false);
+            }
+            continue;
+        }
+        int64_t textLength = readValue<int32_t>(ptr + 4);
+        if(textLength < 0)
+        {
+            std::cerr << "Invalid BAM header in " << myRemote.getUrl() << std::endl;
+            return(false);
+        }
+        ptr += 8;
+        if(end - ptr < textLength + 4)
+        {
+            continue;
+        }
+        ptr += textLength;
+        int32_t numRefs = readValue<int32_t>(ptr);
+        ptr += 4;
+        std::vector<std::string> refNames;
+        for(int32_t ref = 0; ref < numRefs; ref++)
+        {
+            if(end - ptr < 4)
+            {
+                break;
+            }
+            int32_t nameLength = readValue<int32_t>(ptr);
+            if(end - ptr < 8 + (int64_t)nameLength)
+            {
+                break;
+            }
+            // The name includes its terminating null.
+            refNames.push_back(std::string(ptr + 4));
+            ptr += 8 + nameLength;
+        }
+        if(refNames.size() == (size_t)numRefs)
+        {
+            myRefNames.swap(refNames);
+            return(true);
+        }
+    }
+    std::cerr << "Failed to read the header of " << myRemote.getUrl() << std::endl;
+    return(false);
+}
+
+
+void RemoteBamCache::addRegionRanges(int32_t refID, int32_t start, int32_t end,
+                                     std::vector<std::pair<uint64_t, uint64_t> >& ranges)
+{
+    if(refID == -1)
+    {
+        // The unmapped reads follow the last chunk of any reference.
+        uint64_t maxOffset = 0;
+        for(unsigned int ref = 0; ref < myIndex.size(); ref++)
+        {
+            std::map<uint32_t, std::vector<Chunk> >::const_iterator iter;
+            for(iter = myIndex[ref].bins.begin();
+                iter != myIndex[ref].bins.end(); ++iter)
+            {
+                for(unsigned int c = 0; c < iter->second.size(); c++)
+                {
+                    maxOffset = std::max(maxOffset, iter->second[c].end);
+                }
+            }
+        }
+        ranges.push_back(std::make_pair(maxOffset >> 16, myRemote.getSize()));
+        return;
+    }
+    if((refID < 0) || (refID >= (int32_t)myIndex.size()))
+    {
+        return;
+    }
+    if((end < 0) || (end > BAI_MAX_POS))
+    {
+        end = BAI_MAX_POS;
+    }
+    start = std::max(start, 0);
+    if(start >= end)
+    {
+        return;
+    }
+    const RefIndex& refIndex = myIndex[refID];
+
+    // Chunks ending before the linear index offset of the start window
+    // cannot hold records overlapping the region.
+    uint64_t minOffset = 0;
+    uint32_t window = start >> 14;
+    if(!refIndex.linear.empty())
+    {
+        minOffset = refIndex.linear[std::min((size_t)window,
+                                             refIndex.linear.size() - 1)];
+    }
+
+    std::vector<uint32_t> bins;
+    reg2bins(start, end, bins);
+    for(unsigned int i = 0; i < bins.size(); i++)
+    {
+        std::map<uint32_t, std::vector<Chunk> >::const_iterator iter =
+            refIndex.bins.find(bins[i]);
+        if(iter == refIndex.bins.end())
+        {
+            continue;
+        }
+        for(unsigned int c = 0; c < iter->second.size(); c++)
+        {
+            const Chunk& chunk = iter->second[c];
+            if(chunk.end <= minOffset)
+            {
+                continue;
+            }
+            // The chunk ends in the block starting at its end offset.
+            ranges.push_back(std::make_pair(chunk.begin >> 16,
+                                            (chunk.end >> 16) + MAX_BGZF_BLOCK_SIZE));
+        }
+    }
+}
+
+
+bool RemoteBamCache::fetchRanges(const std::vector<std::pair<uint64_t, uint64_t> >& ranges)
+{
+    // Find the blocks that are needed but have not been fetched.
+    std::vector<char> needed(myFetched.size(), 0);
+    for(unsigned int i = 0; i < ranges.size(); i++)
+    {
+        uint64_t end = std::min(ranges[i].second, myRemote.getSize());
+        if(ranges[i].first >= end)
+        {
+            continue;
+        }
+        for(uint64_t block = ranges[i].first / CACHE_BLOCK_SIZE;
+            block <= (end - 1) / CACHE_BLOCK_SIZE; block++)
+        {
+            needed[block] = !myFetched[block];
+        }
+    }
+
+    // Fetch runs of needed blocks in parallel, in file order.
+    struct Fetch
+    {
+        uint64_t firstBlock;
+        uint64_t numBlocks;
+        std::future<bool> result;
+    };
+    std::vector<Fetch> fetches;
+    for(uint64_t block = 0; block < needed.size(); block++)
+    {
+        if(!needed[block])
+        {
+            continue;
+        }
+        if(fetches.empty() ||
+           (fetches.back().firstBlock + fetches.back().numBlocks != block) ||
+           (fetches.back().numBlocks == MAX_FETCH_BLOCKS))
+        {
+            Fetch fetch;
+            fetch.firstBlock = block;
+            fetch.numBlocks = 0;
+            fetches.push_back(std::move(fetch));
+        }
+        ++fetches.back().numBlocks;
+    }
+    for(unsigned int i = 0; i < fetches.size(); i++)
+    {
+        uint64_t offset = fetches[i].firstBlock * CACHE_BLOCK_SIZE;
+        uint64_t length = std::min(fetches[i].numBlocks * CACHE_BLOCK_SIZE,
+                                   myRemote.getSize() - offset);
+        const RemoteFile* remote = &myRemote;
+        int fd = myFd;
+        fetches[i].result = BamExecutable::getThreadPool().submit(
+            [remote, fd, offset, length]()
+            {
+                std::vector<char> data;
+                return(remote->read(offset, length, data) &&
+                       (pwrite(fd, data.data(), length, offset) == (ssize_t)length));
+            });
+    }
+    bool success = true;
+    for(unsigned int i = 0; i < fetches.size(); i++)
+    {
+        if(fetches[i].result.get())
+        {
+            std::fill(myFetched.begin() + fetches[i].firstBlock,
+                      myFetched.begin() + fetches[i].firstBlock +
+                      fetches[i].numBlocks, 1);
+        }
+        else
+        {
+            success = false;
+        }
+    }
+    if(!fetches.empty() && !saveFetched())
+    {
+        success = false;
+    }
+    return(success);
+}
+
+
+bool RemoteBamCache::readCached(uint64_t offset, uint64_t length,
+                                std::vector<char>& data)
+{
+    data.resize(length);
+    if((length != 0) &&
+       (pread(myFd, data.data(), length, offset) != (ssize_t)length))
+    {
+        std::cerr << "Failed to read the remote cache file " << myBamFile
+                  << std::endl;
+        return(false);
+    }
+    return(true);
+}
+
+
+bool RemoteBamCache::saveFetched()
+{
+    FILE* fetchedFile = fopen(myFetchedFile.c_str(), "wb");
+    if((fetchedFile == NULL) ||
+       (fwrite(myFetched.data(), 1, myFetched.size(), fetchedFile) !=
+        myFetched.size()) ||
+       (fclose(fetchedFile) != 0))
+    {
+        std::cerr << "Failed to write the remote cache file "
+                  << myFetchedFile << std::endl;
+        return(false);
+    }
+    return(true);
+}
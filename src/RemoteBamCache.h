@@ -0,0 +1,144 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __REMOTE_BAM_CACHE_H__
+#define __REMOTE_BAM_CACHE_H__
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "RemoteFile.h"
+
+/// Local copy of the parts of a remote BAM file (see RemoteFile) needed
+/// to read regions of it with its BAI index.  The cache file is the size
+/// of the remote file, but only the blocks holding the header, the EOF
+/// marker, and the index chunks of the requested regions are fetched, so
+/// SamFile can read the regions from it using the downloaded index as if
+/// it were the whole file.  Missing blocks are fetched in parallel on the
+/// thread pool.  The cache is kept in $BAM_REMOTE_CACHE (default
+/// $TMPDIR/bamRemoteCache) so later runs only fetch blocks they have not
+/// already fetched.  Caches are not shared safely between concurrent runs.
+class RemoteBamCache
+{
+public:
+    /// Region to fetch: 0-based start and exclusive end, -1 for the end
+    /// of the reference.  The reference is specified by name, or if the
+    /// name is empty, by ID.  The reference "*" (ID -1) is the unmapped
+    /// reads at the end of the file.
+    struct Region
+    {
+        std::string refName;
+        int32_t refID;
+        int32_t start;
+        int32_t end;
+        Region(const std::string& name, int32_t regionStart = 0,
+               int32_t regionEnd = -1)
+            : refName(name), refID(0), start(regionStart), end(regionEnd) {}
+        Region(int32_t id, int32_t regionStart = 0, int32_t regionEnd = -1)
+            : refName(), refID(id), start(regionStart), end(regionEnd) {}
+    };
+
+    /// Size of the blocks the cache is fetched and tracked in.
+    static const uint64_t CACHE_BLOCK_SIZE = 64 * 1024;
+
+    RemoteBamCache();
+    ~RemoteBamCache();
+
+    /// Open the remote BAM file, fetching its index (indexUrl, or the
+    /// URL + ".bai" if it is empty), its header, and its EOF marker.
+    /// Returns false after reporting the reason to stderr on failure.
+    bool open(const std::string& url, const std::string& indexUrl);
+
+    /// Fetch the blocks needed to read the regions.  Regions on unknown
+    /// references are skipped, reading them reports the error.
+    bool fetchRegions(const std::vector<Region>& regions);
+
+    /// Fetch all of the blocks, for reading the whole file.
+    bool fetchAll();
+
+    /// Local files to read instead of the remote ones once the needed
+    /// blocks are fetched.  The index is the BAM file name + ".bai".
+    const std::string& getBamFile() const { return(myBamFile); }
+    const std::string& getIndexFile() const { return(myIndexFile); }
+
+    /// If inFile is a remote URL, fetch the regions of it (all of it if
+    /// regions is empty) and replace inFile with the local cache file
+    /// and indexFile (the remote index, or empty for the default) with
+    /// the local index.  Does nothing if inFile is a local file.
+    /// Returns false after reporting the reason to stderr on failure.
+    static bool localize(std::string& inFile, std::string& indexFile,
+                         const std::vector<Region>& regions);
+
+    /// Add the regions of a file with a "chrom start end" region per
+    /// line, such as a BED file.  Lines starting with '#' or "track" are
+    /// skipped.  The regions are widened by a base in case the starts
+    /// are 1-based.  Returns false if the file cannot be read.
+    static bool readRegionFile(const char* fileName,
+                               std::vector<Region>& regions);
+
+private:
+    RemoteBamCache(const RemoteBamCache&);
+    RemoteBamCache& operator=(const RemoteBamCache&);
+
+    struct Chunk
+    {
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    struct RefIndex
+    {
+        std::map<uint32_t, std::vector<Chunk> > bins;
+        std::vector<uint64_t> linear;
+    };
+
+    // Read the BAI index, returning false if it is invalid.
+    bool readIndex();
+    // Fetch and parse the BAM header for the reference names.
+    bool readHeader();
+    // Add the compressed file ranges of the index chunks that overlap
+    // the region (refID -1 for the unmapped reads).
+    void addRegionRanges(int32_t refID, int32_t start, int32_t end,
+                         std::vector<std::pair<uint64_t, uint64_t> >& ranges);
+    // Fetch the cache blocks overlapping the file ranges that are not
+    // already cached.
+    bool fetchRanges(const std::vector<std::pair<uint64_t, uint64_t> >& ranges);
+    // Read from the cache file, the range must already be fetched.
+    bool readCached(uint64_t offset, uint64_t length, std::vector<char>& data);
+    bool saveFetched();
+
+    // Largest BGZF block, the most read past the start of a chunk's end block.
+    static const uint64_t MAX_BGZF_BLOCK_SIZE = 64 * 1024;
+    // Most cache blocks fetched by one request.
+    static const uint64_t MAX_FETCH_BLOCKS = 16;
+
+    RemoteFile myRemote;
+    std::string myBamFile;
+    std::string myIndexFile;
+    std::string myFetchedFile;
+    int myFd;
+    // One entry per cache block, non-zero if it has been fetched.
+    std::vector<char> myFetched;
+
+    std::vector<std::string> myRefNames;
+    std::vector<RefIndex> myIndex;
+};
+
+#endif
@@ -0,0 +1,759 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+#include "RemoteFile.h"
+
+// Connect the socket, failing if the server does not answer within
+// timeoutSeconds.
+static bool connectWithTimeout(int sock, const struct sockaddr* addr,
+                               socklen_t addrLength, int timeoutSeconds)
+{
+    int flags = fcntl(sock, F_GETFL, 0);
+    if((flags < 0) || (fcntl(sock, F_SETFL, flags | O_NONBLOCK) != 0))
+    {
+        return(false);
+    }
+    int result = connect(sock, addr, addrLength);
+    if((result != 0) && (errno == EINPROGRESS))
+    {
+        struct pollfd pollSock;
+        pollSock.fd = sock;
+        pollSock.events = POLLOUT;
+        int error = 0;
+        socklen_t errorLength = sizeof(error);
+        if((poll(&pollSock, 1, timeoutSeconds * 1000) == 1) &&
+           (getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &errorLength) == 0) &&
+           (error == 0))
+        {
+            result = 0;
+        }
+    }
+    if(fcntl(sock, F_SETFL, flags) != 0)
+    {
+        return(false);
+    }
+    return(result == 0);
+}
+
+
+// Buffered reads from a connected socket.
+class SocketReader
+{
+public:
+    SocketReader(int sock)
+        : mySock(sock), myBuffer(65536), myPos(0), myEnd(0), myFailed(false),
+          myTimedOut(false)
+    {
+    }
+
+    /// Read a line without its CRLF, failing at the end of the stream
+    /// or if the line is longer than maxLength.
+    bool readLine(std::string& line, size_t maxLength)
+    {
+        line.clear();
+        while((myPos < myEnd) || fill())
+        {
+            char c = myBuffer[myPos++];
+            if(c == '\n')
+            {
+                if(!line.empty() && (line[line.size() - 1] == '\r'))
+                {
+                    line.resize(line.size() - 1);
+                }
+                return(true);
+            }
+            // Leave room for the CR.
+            if(line.size() > maxLength)
+            {
+                return(false);
+            }
+            line += c;
+        }
+        return(false);
+    }
+
+    /// Pass up to length bytes to writer, stopping early if it returns
+    /// false.  Returns the number of bytes read, less than length at the
+    /// end of the stream.
+    template<class WRITER>
+    uint64_t read(uint64_t length, WRITER& writer, bool& stopped)
+    {
+        uint64_t numRead = 0;
+        stopped = false;
+        while((numRead < length) && ((myPos < myEnd) || fill()))
+        {
+            size_t size = std::min((uint64_t)(myEnd - myPos), length - numRead);
+            numRead += size;
+            myPos += size;
+            if(!writer(&(myBuffer[myPos - size]), size))
+            {
+                stopped = true;
+                break;
+            }
+        }
+        return(numRead);
+    }
+
+    /// Return true if the last read failed rather than reaching the
+    /// end of the stream, and if that was because the server stopped
+    /// sending.
+    bool failed() const { return(myFailed); }
+    bool timedOut() const { return(myTimedOut); }
+
+private:
+    bool fill()
+    {
+        ssize_t numRead = 0;
+        do
+        {
+            numRead = recv(mySock, &(myBuffer[0]), myBuffer.size(), 0);
+        } while((numRead < 0) && (errno == EINTR));
+        myFailed = (numRead < 0);
+        myTimedOut = ((numRead < 0) &&
+                      ((errno == EAGAIN) || (errno == EWOULDBLOCK)));
+        myPos = 0;
+        myEnd = (numRead > 0) ? numRead : 0;
+        return(numRead > 0);
+    }
+
+    int mySock;
+    std::vector<char> myBuffer;
+    size_t myPos;
+    size_t myEnd;
+    bool myFailed;
+    bool myTimedOut;
+};
+
+
+RemoteFile::RemoteFile()
+    : myUrl(),
+      myIsFile(false),
+      myHost(),
+      myPort(),
+      myPath(),
+      myFd(-1),
+      mySize(0)
+{
+}
+
+
+RemoteFile::~RemoteFile()
+{
+    if(myFd >= 0)
+    {
+        ::close(myFd);
+    }
+}
+
+
+bool RemoteFile::isRemote(const char* name)
+{
+    return((strncmp(name, "http://", 7) == 0) ||
+           (strncmp(name, "https://", 8) == 0) ||
+           (strncmp(name, "s3://", 5) == 0) ||
+           (strncmp(name, "file://", 7) == 0));
+}
+
+
+bool RemoteFile::open(const std::string& url)
+{
+    myUrl = url;
+    mySize = 0;
+    if(!parseUrl(url, myIsFile, myHost, myPort, myPath))
+    {
+        return(false);
+    }
+    if(myIsFile)
+    {
+        myFd = ::open(myPath.c_str(), O_RDONLY);
+        struct stat fileStat;
+        if((myFd < 0) || (fstat(myFd, &fileStat) != 0))
+        {
+            std::cerr << "Failed to open " << url << ": "
+                      << strerror(errno) << std::endl;
+            return(false);
+        }
+        mySize = fileStat.st_size;
+        return(true);
+    }
+
+    // Request the first byte to get the size from the Content-Range.
+    BodyWriter ignore = [](const char*, size_t) { return(true); };
+    return(get(0, 1, ignore, mySize));
+}
+
+
+bool RemoteFile::read(uint64_t offset, uint64_t length,
+                      std::vector<char>& data) const
+{
+    data.resize(length);
+    if(length == 0)
+    {
+        return(true);
+    }
+    if(myIsFile)
+    {
+        uint64_t numRead = 0;
+        while(numRead < length)
+        {
+            ssize_t result = pread(myFd, &(data[numRead]), length - numRead,
+                                   offset + numRead);
+            if(result <= 0)
+            {
+                std::cerr << "Failed to read " << myUrl << " at offset "
+                          << offset + numRead << std::endl;
+                return(false);
+            }
+            numRead += result;
+        }
+        return(true);
+    }
+
+    data.clear();
+    BodyWriter append = [&data](const char* piece, size_t size)
+        {
+            data.insert(data.end(), piece, piece + size);
+            return(true);
+        };
+    uint64_t total = 0;
+    if(!get(offset, length, append, total))
+    {
+        return(false);
+    }
+    if(data.size() != length)
+    {
+        std::cerr << "Failed to read " << myUrl << ": expected " << length
+                  << " bytes at offset " << offset << ", but got "
+                  << data.size() << std::endl;
+        return(false);
+    }
+    return(true);
+}
+
+
+bool RemoteFile::download(const std::string& url, const std::string& localFile,
+                          bool quiet)
+{
+    RemoteFile remote;
+    if(!parseUrl(url, remote.myIsFile, remote.myHost, remote.myPort,
+                 remote.myPath))
+    {
+        return(false);
+    }
+    remote.myUrl = url;
+    if(remote.myIsFile)
+    {
+        struct stat fileStat;
+        if(stat(remote.myPath.c_str(), &fileStat) != 0)
+        {
+            if(!quiet)
+            {
+                std::cerr << "Failed to open " << url << ": "
+                          << strerror(errno) << std::endl;
+            }
+            return(false);
+        }
+    }
+
+    // Only a complete download is renamed to the local file, so a failed
+    // one is never taken for the file.
+    std::ostringstream tempName;
+    tempName << localFile << "." << getpid() << ".part";
+    std::string tempFile = tempName.str();
+    FILE* outFile = fopen(tempFile.c_str(), "wb");
+    if(outFile == NULL)
+    {
+        std::cerr << "Failed to write " << tempFile << ": "
+                  << strerror(errno) << std::endl;
+        return(false);
+    }
+    bool writeFailed = false;
+    BodyWriter write = [outFile, &writeFailed](const char* data, size_t size)
+        {
+            writeFailed = (fwrite(data, 1, size, outFile) != size);
+            return(!writeFailed);
+        };
+
+    bool success = true;
+    if(remote.myIsFile)
+    {
+        success = remote.open(url);
+        std::vector<char> data;
+        for(uint64_t offset = 0; success && (offset < remote.getSize());
+            offset += DOWNLOAD_PIECE_SIZE)
+        {
+            uint64_t length = std::min((uint64_t)DOWNLOAD_PIECE_SIZE,
+                                       remote.getSize() - offset);
+            success = remote.read(offset, length, data) &&
+                write(data.data(), data.size());
+        }
+    }
+    else
+    {
+        uint64_t total = 0;
+        success = remote.get(0, 0, write, total, quiet);
+    }
+    if(fclose(outFile) != 0)
+    {
+        writeFailed = true;
+        success = false;
+    }
+    if(writeFailed)
+    {
+        std::cerr << "Failed to write " << tempFile << std::endl;
+    }
+    if(success && (rename(tempFile.c_str(), localFile.c_str()) != 0))
+    {
+        std::cerr << "Failed to rename " << tempFile << " to " << localFile
+                  << ": " << strerror(errno) << std::endl;
+        success = false;
+    }
+    if(!success)
+    {
+        unlink(tempFile.c_str());
+    }
+    return(success);
+}
+
+
+bool RemoteFile::parseUrl(const std::string& url, bool& isFile,
+                          std::string& host, std::string& port,
+                          std::string& path)
+{
+    isFile = false;
+    std::string hostPath;
+    if(url.compare(0, 7, "file://") == 0)
+    {
+        isFile = true;
+        path = url.substr(7);
+        return(true);
+    }
+    else if(url.compare(0, 7, "http://") == 0)
+    {
+        hostPath = url.substr(7);
+    }
+    else if(url.compare(0, 5, "s3://") == 0)
+    {
+        std::string bucketKey = url.substr(5);
+        const char* endpoint = getenv("S3_ENDPOINT");
+        if((endpoint != NULL) && (*endpoint != '\0'))
+        {
+            std::string endpointUrl = endpoint;
+            if(endpointUrl[endpointUrl.size() - 1] != '/')
+            {
+                endpointUrl += '/';
+            }
+            return(parseUrl(endpointUrl + bucketKey, isFile, host, port, path));
+        }
+        size_t slash = bucketKey.find('/');
+        if(slash == std::string::npos)
+        {
+            std::cerr << "Invalid S3 URL, " << url
+                      << ", it must be s3://bucket/key\n";
+            return(false);
+        }
+        hostPath = bucketKey.substr(0, slash) + ".s3.amazonaws.com" +
+            bucketKey.substr(slash);
+    }
+    else if(url.compare(0, 8, "https://") == 0)
+    {
+        std::cerr << "https is not supported, use an http endpoint for "
+                  << url << std::endl;
+        return(false);
+    }
+    else
+    {
+        std::cerr << "Unsupported URL: " << url << std::endl;
+        return(false);
+    }
+
+    size_t slash = hostPath.find('/');
+    host = hostPath.substr(0, slash);
+    path = (slash == std::string::npos) ? "/" : hostPath.substr(slash);
+    port = "80";
+    size_t colon = host.find(':');
+    if(colon != std::string::npos)
+    {
+        port = host.substr(colon + 1);
+        host.resize(colon);
+    }
+    if(host.empty())
+    {
+        std::cerr << "Invalid URL, no host: " << url << std::endl;
+        return(false);
+    }
+    return(true);
+}
+
+
+bool RemoteFile::get(uint64_t offset, uint64_t length,
+                     const BodyWriter& writer, uint64_t& total,
+                     bool quietNotFound) const
+{
+    std::string host = myHost;
+    std::string port = myPort;
+    std::string path = myPath;
+    for(int i = 0; i <= MAX_REDIRECTS; i++)
+    {
+        std::string location;
+        int status = request(host, port, path, offset, length,
+                             writer, total, location);
+        if(status < 0)
+        {
+            return(false);
+        }
+        if((status == 200) || (status == 206))
+        {
+            return(true);
+        }
+        if((status == 301) || (status == 302) || (status == 303) ||
+           (status == 307) || (status == 308))
+        {
+            bool isFile = false;
+            if(location.empty())
+            {
+                std::cerr << "Failed to read " << myUrl
+                          << ": redirect without a location\n";
+                return(false);
+            }
+            if(location[0] == '/')
+            {
+                path = location;
+            }
+            else if(!parseUrl(location, isFile, host, port, path) || isFile)
+            {
+                return(false);
+            }
+            continue;
+        }
+        if(!quietNotFound || (status != 404))
+        {
+            std::cerr << "Failed to read " << myUrl << ": HTTP status "
+                      << status << std::endl;
+        }
+        return(false);
+    }
+    std::cerr << "Failed to read " << myUrl << ": too many redirects\n";
+    return(false);
+}
+
+
+int RemoteFile::request(const std::string& host, const std::string& port,
+                        const std::string& path, uint64_t offset,
+                        uint64_t length, const BodyWriter& writer,
+                        uint64_t& total, std::string& location) const
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* addresses = NULL;
+    int error = getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+    if(error != 0)
+    {
+        std::cerr << "Failed to find the host " << host << " for " << myUrl
+                  << ": " << gai_strerror(error) << std::endl;
+        return(-1);
+    }
+    struct timeval timeout;
+    timeout.tv_sec = IO_TIMEOUT_SECONDS;
+    timeout.tv_usec = 0;
+    int sock = -1;
+    for(struct addrinfo* addr = addresses; addr != NULL; addr = addr->ai_next)
+    {
+        sock = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+        if(sock < 0)
+        {
+            continue;
+        }
+        if((setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO,
+                       &timeout, sizeof(timeout)) == 0) &&
+           (setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO,
+                       &timeout, sizeof(timeout)) == 0) &&
+           connectWithTimeout(sock, addr->ai_addr, addr->ai_addrlen,
+                              IO_TIMEOUT_SECONDS))
+        {
+            break;
+        }
+        ::close(sock);
+        sock = -1;
+    }
+    freeaddrinfo(addresses);
+    if(sock < 0)
+    {
+        std::cerr << "Failed to connect to " << host << ":" << port
+                  << " for " << myUrl << std::endl;
+        return(-1);
+    }
+
+    std::ostringstream requestText;
+    requestText << "GET " << path << " HTTP/1.1\r\n"
+                << "Host: " << host << "\r\n";
+    if(length != 0)
+    {
+        requestText << "Range: bytes=" << offset << "-"
+                    << offset + length - 1 << "\r\n";
+    }
+    requestText << "User-Agent: bamUtil/" << VERSION << "\r\n"
+                << "Connection: close\r\n\r\n";
+    std::string text = requestText.str();
+    for(size_t sent = 0; sent < text.size(); )
+    {
+        ssize_t result = send(sock, text.data() + sent, text.size() - sent, 0);
+        if((result < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        if(result <= 0)
+        {
+            ::close(sock);
+            std::cerr << "Failed to send the request for " << myUrl << std::endl;
+            return(-1);
+        }
+        sent += result;
+    }
+
+    // Parse the status and the headers needed: the size and the
+    // redirect location.
+    SocketReader reader(sock);
+    std::string line;
+    int status = 0;
+    if(!reader.readLine(line, MAX_HEADER_SIZE) ||
+       (sscanf(line.c_str(), "HTTP/%*s %d", &status) != 1))
+    {
+        ::close(sock);
+        std::cerr << (reader.timedOut() ? "Timed out waiting for" : "Invalid")
+                  << " HTTP response for " << myUrl << std::endl;
+        return(-1);
+    }
+    bool chunked = false;
+    total = 0;
+    uint64_t contentLength = UINT64_MAX;
+    uint64_t rangeFirst = UINT64_MAX;
+    uint64_t rangeLength = UINT64_MAX;
+    size_t headerSize = line.size();
+    while(true)
+    {
+        if(!reader.readLine(line, MAX_HEADER_SIZE - headerSize))
+        {
+            ::close(sock);
+            std::cerr << (reader.timedOut() ? "Timed out waiting for" : "Invalid")
+                      << " HTTP response for " << myUrl << std::endl;
+            return(-1);
+        }
+        if(line.empty())
+        {
+            break;
+        }
+        headerSize += line.size();
+        size_t colon = line.find(':');
+        if(colon == std::string::npos)
+        {
+            continue;
+        }
+        std::string name = line.substr(0, colon);
+        std::string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+        if(strcasecmp(name.c_str(), "Content-Range") == 0)
+        {
+            unsigned long long first = 0;
+            unsigned long long last = 0;
+            if((sscanf(value.c_str(), "bytes %llu-%llu", &first, &last) == 2) &&
+               (last >= first))
+            {
+                rangeFirst = first;
+                rangeLength = last - first + 1;
+            }
+            size_t slash = value.find('/');
+            if(slash != std::string::npos)
+            {
+                total = strtoull(value.c_str() + slash + 1, NULL, 10);
+            }
+        }
+        else if(strcasecmp(name.c_str(), "Content-Length") == 0)
+        {
+            contentLength = strtoull(value.c_str(), NULL, 10);
+        }
+        else if(strcasecmp(name.c_str(), "Location") == 0)
+        {
+            location = value;
+        }
+        else if(strcasecmp(name.c_str(), "Transfer-Encoding") == 0)
+        {
+            chunked = (strcasecmp(value.c_str(), "chunked") == 0);
+        }
+    }
+    if((status != 200) && (status != 206))
+    {
+        // The body is not needed.
+        ::close(sock);
+        return(status);
+    }
+    if(chunked)
+    {
+        // The length is that of the chunks.
+        contentLength = UINT64_MAX;
+    }
+
+    // The body bytes to skip, and the number after them to pass on.
+    uint64_t skip = 0;
+    uint64_t keep = UINT64_MAX;
+    if(status == 206)
+    {
+        // The body is stored at offset, so it must be the requested range.
+        if((rangeFirst != offset) || 
+           ((length != 0) && (rangeFirst + rangeLength < offset + length)))
+        {
+            ::close(sock);
+            std::cerr << "Invalid HTTP response for " << myUrl
+                      << ": the Content-Range does not match the requested range\n";
+            return(-1);
+        }
+        if((contentLength != UINT64_MAX) && (contentLength != rangeLength))
+        {
+            ::close(sock);
+            std::cerr << "Invalid HTTP response for " << myUrl
+                      << ": the Content-Length does not match the Content-Range\n";
+            return(-1);
+        }
+        contentLength = rangeLength;
+    }
+    if(length != 0)
+    {
+        keep = length;
+        if(status == 200)
+        {
+            // The server ignored the range and is sending the whole
+            // file, so keep the range and stop reading after it.
+            if(contentLength == UINT64_MAX)
+            {
+                ::close(sock);
+                std::cerr << "Failed to read " << myUrl << ": the server "
+                          << "ignored the range without sending the size\n";
+                return(-1);
+            }
+            skip = offset;
+        }
+    }
+    if((status == 200) && (contentLength != UINT64_MAX))
+    {
+        total = contentLength;
+    }
+
+    // Pass the data from skip to skip + keep on to the writer as it is
+    // read, stopping after it.
+    uint64_t bodyRead = 0;
+    bool aborted = false;
+    auto pass = [&](const char* data, size_t size) -> bool
+        {
+            uint64_t start = bodyRead;
+            bodyRead += size;
+            if(bodyRead <= skip)
+            {
+                return(true);
+            }
+            uint64_t begin = (start < skip) ? skip - start : 0;
+            uint64_t end = std::min((uint64_t)size,
+                                    (skip + keep > start) ?
+                                    skip + keep - start : 0);
+            if((begin < end) && !writer(data + begin, end - begin))
+            {
+                aborted = true;
+                return(false);
+            }
+            return(bodyRead < skip + keep);
+        };
+    // The body length expected, reduced to where reading stops.
+    uint64_t expected = contentLength;
+    if(keep != UINT64_MAX)
+    {
+        expected = std::min(expected, skip + keep);
+    }
+    bool stopped = false;
+    bool complete = true;
+    if(!chunked)
+    {
+        reader.read(expected, pass, stopped);
+        complete = stopped || (expected == UINT64_MAX) || (bodyRead == expected);
+    }
+    else
+    {
+        // Each chunk is its hex size, CRLF, the data, and CRLF, until an
+        // empty chunk.
+        complete = false;
+        while(!stopped && reader.readLine(line, MAX_HEADER_SIZE))
+        {
+            uint64_t chunkSize = strtoull(line.c_str(), NULL, 16);
+            if(chunkSize == 0)
+            {
+                complete = true;
+                break;
+            }
+            if(reader.read(chunkSize, pass, stopped) != chunkSize)
+            {
+                break;
+            }
+            if(stopped)
+            {
+                complete = true;
+            }
+            else if(!reader.readLine(line, 0))
+            {
+                break;
+            }
+        }
+    }
+    ::close(sock);
+    if(aborted)
+    {
+        // The writer reported why.
+        return(-1);
+    }
+    if(!complete || reader.failed())
+    {
+        std::cerr << "Failed to read " << myUrl << ": "
+                  << (reader.timedOut() ? "timed out" : "the response ended")
+                  << " after " << bodyRead << " bytes";
+        if(expected != UINT64_MAX)
+        {
+            std::cerr << " of " << expected;
+        }
+        std::cerr << std::endl;
+        return(-1);
+    }
+    if((status == 200) && (total == 0))
+    {
+        total = bodyRead;
+    }
+    return(status);
+}
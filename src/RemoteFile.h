@@ -0,0 +1,114 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __REMOTE_FILE_H__
+#define __REMOTE_FILE_H__
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+/// Reads byte ranges of a remote file with HTTP range requests.
+/// Supports http:// URLs, s3://bucket/key (read from the S3_ENDPOINT
+/// environment variable's http endpoint as endpoint/bucket/key if it is
+/// set, otherwise from http://bucket.s3.amazonaws.com/key, so the object
+/// must be public or the endpoint must handle authentication), and
+/// file:// URLs, which are read with pread.  https is not supported.
+/// Ranges can be read from multiple threads at once, each read uses its
+/// own connection.  A server that stops responding for IO_TIMEOUT_SECONDS
+/// fails the read, as does a response that ends before its length.
+class RemoteFile
+{
+public:
+    RemoteFile();
+    ~RemoteFile();
+
+    /// Return true if the file name is a URL handled by this class.
+    static bool isRemote(const char* name);
+
+    /// Open the URL, getting its size.  Returns false after reporting
+    /// the reason to stderr if it cannot be read.
+    bool open(const std::string& url);
+
+    uint64_t getSize() const { return(mySize); }
+    const std::string& getUrl() const { return(myUrl); }
+
+    /// Read length bytes starting at offset into data.  Returns false
+    /// after reporting the reason to stderr on failure.
+    bool read(uint64_t offset, uint64_t length, std::vector<char>& data) const;
+
+    /// Copy the whole file at the URL to the local file, streaming it
+    /// through a temporary file that is renamed to the local file once
+    /// it is complete.  Returns false after reporting the reason to
+    /// stderr on failure, or without reporting if quiet is set and the
+    /// URL does not exist.
+    static bool download(const std::string& url, const std::string& localFile,
+                         bool quiet = false);
+
+private:
+    RemoteFile(const RemoteFile&);
+    RemoteFile& operator=(const RemoteFile&);
+
+    // Receives the body of a response in pieces as it is read, returning
+    // false to abort the request.
+    typedef std::function<bool(const char* data, size_t size)> BodyWriter;
+
+    // Split the URL into its host, port, and path, or for file:// URLs,
+    // set isFile and the path to the local file name.
+    static bool parseUrl(const std::string& url, bool& isFile,
+                         std::string& host, std::string& port,
+                         std::string& path);
+
+    // Read the range (the whole file if length is 0) following
+    // redirects, passing the data to writer and setting total to the
+    // file size.  Returns false after reporting the reason to stderr,
+    // unless quietNotFound is set and the file does not exist.
+    bool get(uint64_t offset, uint64_t length, const BodyWriter& writer,
+             uint64_t& total, bool quietNotFound = false) const;
+
+    // Send one GET request for the range (the whole file if length is 0),
+    // passing the data of a 200 or 206 response to writer, setting total
+    // to the file size, and location to the redirect location.  Only the
+    // range is passed on if the server ignores it and sends the whole
+    // file.  Returns the HTTP status, or -1 after reporting a connection
+    // failure or a response shorter than its length.
+    int request(const std::string& host, const std::string& port,
+                const std::string& path, uint64_t offset, uint64_t length,
+                const BodyWriter& writer, uint64_t& total,
+                std::string& location) const;
+
+    // Maximum number of redirects followed for a request.
+    static const int MAX_REDIRECTS = 5;
+    // Seconds to wait to connect to, send to, or receive from a server
+    // before failing.
+    static const int IO_TIMEOUT_SECONDS = 60;
+    // Largest response header accepted.
+    static const size_t MAX_HEADER_SIZE = 65536;
+    // Size of the pieces file:// URLs are downloaded in.
+    static const uint64_t DOWNLOAD_PIECE_SIZE = 1 << 20;
+
+    std::string myUrl;
+    bool myIsFile;
+    std::string myHost;
+    std::string myPort;
+    std::string myPath;
+    int myFd;
+    uint64_t mySize;
+};
+
+#endif
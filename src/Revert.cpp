@@ -20,11 +20,25 @@
 // which reads an SAM/BAM file and writes a SAM/BAM file with the 
 // specified previous values restored if the values are known.
 
+#include <vector>
+
 #include "Revert.h"
-#include "SamFile.h"
+#include "ThreadedSamFile.h"
 #include "Parameters.h"
 #include "BgzfFileType.h"
 #include "SamTags.h"
+#include "ParallelRecordMap.h"
+
+Revert::RevertState::RevertState()
+    : editor(),
+      hasOrigCigar(false),
+      origCigar(),
+      hasOrigPos(false),
+      origPos(0),
+      status(SamStatus::SUCCESS)
+{
+}
+
 
 Revert::Revert()
     : myKeepTags(false)
@@ -130,11 +144,11 @@ int Revert::execute(int argc, char **argv)
     }
 
     // Open the input file for reading.
-    SamFile samIn;
+    ThreadedSamFile samIn;
     samIn.OpenForRead(inFile);
 
     // Open the output file for writing.
-    SamFile samOut;
+    ThreadedSamFile samOut;
     samOut.OpenForWrite(outFile);
 
     // Read the sam header.
@@ -144,62 +158,81 @@ int Revert::execute(int argc, char **argv)
     // Write the sam header.
     samOut.WriteHeader(samHeader);
 
-    SamRecord samRecord;
-
-    // Set returnStatus to success.  It will be changed to the
-    // failure reason if any of the writes or updates fail.
-    SamStatus::Status returnStatus = SamStatus::SUCCESS;
+    std::vector<RevertState> states(ParallelRecordMap::getNumWorkers());
 
-    // Keep reading records until ReadRecord returns false.
-    while(samIn.ReadRecord(samHeader, samRecord))
+    // Records are reverted on the thread pool when using multiple threads
+    // and written in their original order.
+    ParallelRecordMap recordMap;
+    SamStatus::Status returnStatus = 
+        recordMap.run(samIn, samOut, samHeader,
+                      [&](SamRecord& samRecord, unsigned int worker)
     {
-        // Update the cigar & position.
-        if(cigar)
+        RevertState& state = states[worker];
+        BamRecordEditor& editor = state.editor;
+        // Update the tags & quality directly in the BAM record.
+        if(!editor.load(samRecord))
         {
-            if(!updateCigar(samRecord))
-            {
-                // Failed to update the cigar & position.
-                fprintf(stderr, "%s\n", samIn.GetStatusMessage());
-                returnStatus = samIn.GetStatus();
-            }
+            // Failed to get the record buffer.
+            fprintf(stderr, "%s\n", editor.getStatus().getStatusMessage());
+            state.status = editor.getStatus().getStatus();
         }
-        if(qual)
+        else
         {
-            if(!updateQual(samRecord))
+            if(cigar)
             {
-                // Failed to update the quality.
-                fprintf(stderr, "%s\n", samIn.GetStatusMessage());
-                returnStatus = samIn.GetStatus();
+                getOrigCigar(state);
+            }
+            if(qual)
+            {
+                if(!updateQual(state))
+                {
+                    // Failed to update the quality.
+                    fprintf(stderr, "%s\n", editor.getStatus().getStatusMessage());
+                    state.status = editor.getStatus().getStatus();
+                }
             }
-        }
 
-        if(rmBQ)
-        {
-            if(!removeBQ(samRecord))
+            if(rmBQ)
             {
-                // Failed to remove BQ.
-                fprintf(stderr, "%s\n", samIn.GetStatusMessage());
-                returnStatus = samIn.GetStatus();
+                removeBQ(state);
             }
-        }
 
-        if(rmTags != "")
-        {
-            if(!samRecord.rmTags(rmTags.c_str()))
+            if(rmTags != "")
             {
-                // Failed to remove the specified tags.
-                fprintf(stderr, "%s\n", samIn.GetStatusMessage());
-                returnStatus = samIn.GetStatus();
+                if(!editor.removeTags(rmTags.c_str()))
+                {
+                    // Failed to remove the specified tags.
+                    fprintf(stderr, "%s\n", editor.getStatus().getStatusMessage());
+                    state.status = editor.getStatus().getStatus();
+                }
             }
-        }
 
-        // Successfully read a record from the file, so write it.
-        if(!samOut.WriteRecord(samHeader, samRecord))
-        {
-            // Failed to write a record.
-            fprintf(stderr, "%s\n", samOut.GetStatusMessage());
-            returnStatus = samOut.GetStatus();
+            if(!editor.store(samRecord, samHeader))
+            {
+                // Failed to update the record.
+                fprintf(stderr, "%s\n", editor.getStatus().getStatusMessage());
+                state.status = editor.getStatus().getStatus();
+            }
+            // Update the cigar & position.
+            else if(cigar)
+            {
+                if(!updateCigar(state, samRecord))
+                {
+                    // Failed to update the cigar & position.
+                    fprintf(stderr, "%s\n", samRecord.getStatus().getStatusMessage());
+                    state.status = samRecord.getStatus().getStatus();
+                }
+            }
         }
+        return(true);
+    });
+
+    // Set returnStatus to the failure reason if any of the updates failed
+    // and none of the writes did.
+    for(unsigned int i = 0; 
+        (i < states.size()) && (returnStatus == SamStatus::SUCCESS); i++)
+    {
+        returnStatus = states[i].status;
     }
 
     std::cerr << std::endl << "Number of records read = " << 
@@ -213,66 +246,74 @@ int Revert::execute(int argc, char **argv)
     return(returnStatus);
 }
 
-bool Revert::updateCigar(SamRecord& samRecord)
+void Revert::getOrigCigar(RevertState& state)
 {
     // Get the OC tag, which is a string.
-    const String* oldCigar = samRecord.getStringTag(SamTags::ORIG_CIGAR_TAG);
+    state.hasOrigCigar = 
+        state.editor.getStringTag(SamTags::ORIG_CIGAR_TAG, state.origCigar);
     // Get the OP tag, which is an integer.
+    state.hasOrigPos = 
+        state.editor.getIntegerTag(SamTags::ORIG_POS_TAG, state.origPos);
 
-    bool status = true;
-    if(oldCigar != NULL)
+    if(!myKeepTags)
     {
-        // The old cigar was found, so set it in the record.
-        status &= samRecord.setCigar((*oldCigar).c_str());
-
-        if(!myKeepTags)
+        // Remove the tags.
+        if(state.hasOrigCigar)
         {
-            // Remove the tag.
-            status &= samRecord.rmTag(SamTags::ORIG_CIGAR_TAG, SamTags::ORIG_CIGAR_TAG_TYPE);
+            state.editor.removeTag(SamTags::ORIG_CIGAR_TAG, 
+                                   SamTags::ORIG_CIGAR_TAG_TYPE);
+        }
+        if(state.hasOrigPos)
+        {
+            state.editor.removeTag(SamTags::ORIG_POS_TAG, 
+                                   SamTags::ORIG_POS_TAG_TYPE);
         }
     }
+}
+
 
-    int oldPos = 0;
-    if(samRecord.getIntegerTag(SamTags::ORIG_POS_TAG, oldPos))
+bool Revert::updateCigar(RevertState& state, SamRecord& samRecord)
+{
+    bool status = true;
+    if(state.hasOrigCigar)
     {
-        // The old position was found, so set it in the record.
-        status &= samRecord.set1BasedPosition(oldPos);
+        // The old cigar was found, so set it in the record.
+        status &= samRecord.setCigar(state.origCigar.c_str());
+    }
 
-        if(!myKeepTags)
-        {
-            // Remove the tag.
-            status &= samRecord.rmTag(SamTags::ORIG_POS_TAG, SamTags::ORIG_POS_TAG_TYPE);
-        }
+    if(state.hasOrigPos)
+    {
+        // The old position was found, so set it in the record.
+        status &= samRecord.set1BasedPosition(state.origPos);
     }
 
     return(status);
 }
 
 
-bool Revert::updateQual(SamRecord& samRecord)
+bool Revert::updateQual(RevertState& state)
 {
-        // Get the OQ tag, which is a string.
-    const String* oldQual = samRecord.getStringTag(SamTags::ORIG_QUAL_TAG);
+    // Get the OQ tag, which is a string.
+    std::string oldQual;
 
     bool status = true;
-    if(oldQual != NULL)
+    if(state.editor.getStringTag(SamTags::ORIG_QUAL_TAG, oldQual))
     {
         // The old quality was found, so set it in the record.
-        status &= samRecord.setQuality((*oldQual).c_str());
+        status &= state.editor.setQualities(oldQual.c_str());
 
         if(!myKeepTags)
         {
             // Remove the tag.
-            samRecord.rmTag(SamTags::ORIG_QUAL_TAG, SamTags::ORIG_QUAL_TAG_TYPE);
+            state.editor.removeTag(SamTags::ORIG_QUAL_TAG, SamTags::ORIG_QUAL_TAG_TYPE);
         }
     }
     return(status);
 }
 
 
-bool Revert::removeBQ(SamRecord& samRecord)
+void Revert::removeBQ(RevertState& state)
 {
     // Remove the tag.
-    return(samRecord.rmTag(SamTags::BQ_TAG, SamTags::BQ_TAG_TYPE));
+    state.editor.removeTag(SamTags::BQ_TAG, SamTags::BQ_TAG_TYPE);
 }
-
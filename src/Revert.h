@@ -23,8 +23,11 @@
 #ifndef __REVERT_H__
 #define __REVERT_H__
 
+#include <string>
+
 #include "BamExecutable.h"
 #include "SamRecord.h"
+#include "BamRecordEditor.h"
 
 class Revert : public BamExecutable
 {
@@ -36,9 +39,27 @@ public:
     int execute(int argc, char **argv);
     virtual const char* getProgramName() {return("bam:revert");}
 private:
-    bool updateCigar(SamRecord& samRecord);
-    bool updateQual(SamRecord& samRecord);
-    bool removeBQ(SamRecord& samRecord);
+    // Values found in the record being reverted, one per worker so
+    // records can be reverted in parallel.
+    struct RevertState
+    {
+        RevertState();
+        BamRecordEditor editor;
+        bool hasOrigCigar;
+        std::string origCigar;
+        bool hasOrigPos;
+        int origPos;
+        // Status of the last failed update.
+        SamStatus::Status status;
+    };
+
+    // The tags & qualities are updated in the record loaded in the editor.
+    // Changing the cigar/position also changes the bin, so they are
+    // found by getOrigCigar & then set in the record by updateCigar.
+    void getOrigCigar(RevertState& state);
+    bool updateCigar(RevertState& state, SamRecord& samRecord);
+    bool updateQual(RevertState& state);
+    void removeBQ(RevertState& state);
 
 
     bool myKeepTags;
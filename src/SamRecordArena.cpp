@@ -0,0 +1,138 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SamRecordArena.h"
+#include "MemoryBudget.h"
+
+SamRecordArena::SamRecordArena(int maxNumRecs)
+    : myBlocks(),
+      myBlockIndex(0),
+      myBlockPos(0),
+      myFree(),
+      myNumInUse(0),
+      myMaxNumRecs(maxNumRecs),
+      myLimitByBudget(false),
+      myNumAllocated(0)
+{
+}
+
+
+SamRecordArena::~SamRecordArena()
+{
+    MemoryBudget::add(MemoryBudget::RECORDS,
+                      -(int64_t)myNumAllocated * EST_RECORD_BYTES);
+}
+
+
+SamRecord* SamRecordArena::getRecord()
+{
+    if((myMaxNumRecs != -1) && (myNumInUse >= myMaxNumRecs))
+    {
+        return(NULL);
+    }
+
+    SamRecord* record = NULL;
+    if(!myFree.empty())
+    {
+        record = myFree.back();
+        myFree.pop_back();
+    }
+    else
+    {
+        // Move to the next block with unused records, allocating a new
+        // block if all of them have been used.
+        while((myBlockIndex < myBlocks.size()) &&
+              (myBlockPos == myBlocks[myBlockIndex].size))
+        {
+            ++myBlockIndex;
+            myBlockPos = 0;
+        }
+        if(myBlockIndex == myBlocks.size())
+        {
+            Block block;
+            block.size = BLOCK_SIZE;
+            if((myMaxNumRecs != -1) && (myMaxNumRecs - myNumInUse < BLOCK_SIZE))
+            {
+                block.size = myMaxNumRecs - myNumInUse;
+            }
+            if(myLimitByBudget && MemoryBudget::hasLimit())
+            {
+                // Always allow one record in use so callers make progress.
+                uint64_t roomRecs = MemoryBudget::getRoom() / EST_RECORD_BYTES;
+                if(roomRecs == 0)
+                {
+                    if(myNumInUse != 0)
+                    {
+                        return(NULL);
+                    }
+                    roomRecs = 1;
+                }
+                if(roomRecs < (uint64_t)block.size)
+                {
+                    block.size = roomRecs;
+                }
+            }
+            block.records.reset(new SamRecord[block.size]);
+            myNumAllocated += block.size;
+            MemoryBudget::add(MemoryBudget::RECORDS,
+                              (int64_t)block.size * EST_RECORD_BYTES);
+            myBlocks.push_back(std::move(block));
+            myBlockPos = 0;
+        }
+        record = &(myBlocks[myBlockIndex].records[myBlockPos]);
+        ++myBlockPos;
+    }
+    ++myNumInUse;
+    return(record);
+}
+
+
+bool SamRecordArena::isExhausted()
+{
+    if(!myFree.empty())
+    {
+        return(false);
+    }
+    // Blocks after myBlockIndex are unused.
+    if((myBlockIndex < myBlocks.size()) &&
+       ((myBlockPos < myBlocks[myBlockIndex].size) ||
+        (myBlockIndex + 1 < myBlocks.size())))
+    {
+        return(false);
+    }
+    return(true);
+}
+
+
+void SamRecordArena::releaseRecord(SamRecord* record)
+{
+    if(record == NULL)
+    {
+        return;
+    }
+    myFree.push_back(record);
+    --myNumInUse;
+}
+
+
+void SamRecordArena::releaseAll()
+{
+    myFree.clear();
+    myBlockIndex = 0;
+    myBlockPos = 0;
+    myNumInUse = 0;
+}
@@ -0,0 +1,92 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SAM_RECORD_ARENA_H__
+#define __SAM_RECORD_ARENA_H__
+
+#include <memory>
+#include <vector>
+
+#include "SamRecord.h"
+
+/// Drop in replacement for SamRecordPool that allocates records in
+/// contiguous blocks rather than one at a time.  Released records are
+/// reused most recently released first and keep the buffers they have
+/// grown, so reused records rarely reallocate.  All records can also be
+/// released at once when a batch of records is done.  Allocated blocks
+/// are added to the MemoryBudget, and the arena can also be limited by it.
+class SamRecordArena
+{
+public:
+    /// maxNumRecs is the maximum number of records in use at a time,
+    /// -1 for no maximum.
+    SamRecordArena(int maxNumRecs = -1);
+    ~SamRecordArena();
+
+    /// Get a record to use, returning NULL if the maximum number of
+    /// records are already in use, or if limited by the budget, no
+    /// records are free and the budget has no room for more.
+    SamRecord* getRecord();
+
+    /// Return a record obtained from getRecord so it can be reused.
+    void releaseRecord(SamRecord* record);
+
+    /// Release all records obtained from getRecord.  Any pointers to them
+    /// must no longer be used.
+    void releaseAll();
+
+    void setMaxAllocatedRecs(int maxNumRecs) { myMaxNumRecs = maxNumRecs; }
+
+    /// Limit the number of records allocated by the MemoryBudget (when
+    /// --maxMem is set) in addition to the maximum number of records.
+    void setLimitByBudget(bool limit) { myLimitByBudget = limit; }
+
+    int getNumInUse() { return(myNumInUse); }
+
+    /// Returns true if the next getRecord has to allocate a new block.
+    bool isExhausted();
+
+    /// Maximum number of records allocated together.
+    static const int BLOCK_SIZE = 256;
+
+    /// Estimated memory per allocated record: the record plus the buffers
+    /// it grows for a typical short read and its tags.
+    static const int EST_RECORD_BYTES = sizeof(SamRecord) + 1024;
+
+private:
+    SamRecordArena(const SamRecordArena&);
+    SamRecordArena& operator=(const SamRecordArena&);
+
+    struct Block
+    {
+        std::unique_ptr<SamRecord[]> records;
+        int size;
+    };
+
+    std::vector<Block> myBlocks;
+    // Block/position of the next never used (since releaseAll) record.
+    unsigned int myBlockIndex;
+    int myBlockPos;
+    std::vector<SamRecord*> myFree;
+    int myNumInUse;
+    int myMaxNumRecs;
+    bool myLimitByBudget;
+    // Number of records allocated in myBlocks.
+    int myNumAllocated;
+};
+
+#endif
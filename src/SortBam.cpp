@@ -0,0 +1,407 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//////////////////////////////////////////////////////////////////////////
+// This file contains the processing for the executable option "sort"
+// which sorts a SAM/BAM file by coordinate.
+
+#include <algorithm>
+#include <cstdlib>
+#include <future>
+#include <sstream>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "SortBam.h"
+#include "MergeBam.h"
+#include "BamRecordView.h"
+#include "BgzfFileType.h"
+#include "Logger.h"
+#include "MemoryBudget.h"
+#include "Parameters.h"
+#include "SamStatus.h"
+
+SortBam::SortBam()
+    : BamExecutable(),
+      myRecords(),
+      myEntries(),
+      myTmpPrefix(),
+      myRunFiles()
+{
+}
+
+
+void SortBam::printSortBamDescription(std::ostream& os)
+{
+    os << " sort - Sort a SAM/BAM file by coordinate" << std::endl;
+}
+
+
+void SortBam::printDescription(std::ostream& os)
+{
+    printSortBamDescription(os);
+}
+
+
+void SortBam::printUsage(std::ostream& os)
+{
+    BamExecutable::printUsage(os);
+    os << "\t./bam sort --in <inputFile> --out <outputFile> [--maxMem <MB>] [--maxRecords <records>] [--tmpPrefix <prefix>] [--maxOpen <files>] [--log <logFile>] [--verbose] [--noeof] [--params]" << std::endl;
+    os << "\tRequired Parameters:" << std::endl;
+    os << "\t\t--in         : the SAM/BAM file to sort" << std::endl;
+    os << "\t\t--out        : the coordinate sorted SAM/BAM file to write" << std::endl;
+    os << "\tOptional Parameters:" << std::endl;
+    os << "\t\t--maxMem     : megabytes (or K/M/G) of records to sort in memory at a time (default: " << DEFAULT_MAX_MEM << ")." << std::endl;
+    os << "\t\t               Each batch is written to a sorted temporary file, and the files are merged" << std::endl;
+    os << "\t\t--maxRecords : maximum number of records to sort in memory at a time (default: 0, no limit)" << std::endl;
+    os << "\t\t--tmpPrefix  : prefix for the temporary files (default: $TMPDIR/bamSort.<pid>)" << std::endl;
+    os << "\t\t--maxOpen    : maximum number of temporary files to merge at a time (default: " << DEFAULT_MAX_OPEN << ")" << std::endl;
+    os << "\t\t--log        : log file (default: [outfile].log)" << std::endl;
+    os << "\t\t--verbose    : turn on verbose mode" << std::endl;
+    os << "\t\t--noeof      : do not expect an EOF block on a bam file." << std::endl;
+    os << "\t\t--params     : print the parameter settings" << std::endl;
+    os << "\tWith --threads, each batch is sorted on multiple threads." << std::endl;
+    os << std::endl;
+}
+
+
+int SortBam::execute(int argc, char **argv)
+{
+    // Extract command line arguments.
+    String inFile = "";
+    String outFile = "";
+    String logFile = "";
+    String tmpPrefix = "";
+    int maxRecords = 0;
+    int maxOpen = DEFAULT_MAX_OPEN;
+    bool verbose = false;
+    bool noeof = false;
+    bool params = false;
+
+    LongParamContainer parameters;
+    parameters.addGroup("Required Parameters");
+    parameters.addString("in", &inFile);
+    parameters.addString("out", &outFile);
+    parameters.addGroup("Optional Parameters");
+    parameters.addInt("maxRecords", &maxRecords);
+    parameters.addString("tmpPrefix", &tmpPrefix);
+    parameters.addInt("maxOpen", &maxOpen);
+    parameters.addString("log", &logFile);
+    parameters.addBool("verbose", &verbose);
+    parameters.addBool("noeof", &noeof);
+    parameters.addBool("params", &params);
+    parameters.addPhoneHome(VERSION);
+
+    ParameterList inputParameters;
+    inputParameters.Add(new LongParameters ("Input Parameters", 
+                                            parameters.getLongParameterList()));
+
+    // parameters start at index 2 rather than 1.
+    inputParameters.Read(argc, argv, 2);
+
+    // If no eof block is required for a bgzf file, set the bgzf file type to 
+    // not look for it.
+    if(noeof)
+    {
+        // Set that the eof block is not required.
+        BgzfFileType::setRequireEofBlock(false);
+    }
+
+    if(inFile.IsEmpty() || outFile.IsEmpty())
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        std::cerr << "Specify both an input and an output file" << std::endl;
+        return(EXIT_FAILURE);
+    }
+    if((maxRecords < 0) || (maxOpen < 2))
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        std::cerr << "ERROR: --maxRecords must not be negative, and --maxOpen must be at least 2.\n";
+        return(EXIT_FAILURE);
+    }
+
+    if(tmpPrefix.IsEmpty())
+    {
+        const char* tmpDir = getenv("TMPDIR");
+        tmpPrefix = (tmpDir == NULL) ? "/tmp" : tmpDir;
+        tmpPrefix += "/bamSort.";
+        tmpPrefix += (int)getpid();
+    }
+    myTmpPrefix = tmpPrefix.c_str();
+
+    if(logFile.IsEmpty())
+    {
+        if(ThreadedSamFile::isPipeName(outFile.c_str()))
+        {
+            logFile = "-";
+        }
+        else
+        {
+            logFile = outFile + ".log";
+        }
+    }
+
+    if(params)
+    {
+        inputParameters.Status();
+    }
+
+    Logger::gLogger = new Logger(logFile.c_str(), verbose);
+
+    ThreadedSamFile samIn;
+    samIn.OpenForRead(inFile.c_str());
+    SamFileHeader header;
+    samIn.ReadHeader(header);
+
+    SamFileHeader outHeader = header;
+    if(outHeader.getHDTagValue("VN")[0] == 0)
+    {
+        // A new HD line needs the format version.
+        outHeader.setHDTag("VN", "1.4");
+    }
+    outHeader.setHDTag("SO", "coordinate");
+
+    // The records and entries of a batch share the memory limit, which
+    // is the common --maxMem budget.
+    uint64_t maxBytes = MemoryBudget::hasLimit() ? MemoryBudget::getLimit() :
+        (uint64_t)DEFAULT_MAX_MEM * 1024 * 1024;
+    // Reserve for an estimated number of records rather than the whole
+    // budget, which small inputs and --maxRecords batches never use.
+    uint64_t estimatedRecords = 
+        maxBytes / (ESTIMATED_RECORD_SIZE + sizeof(SortEntry));
+    if((maxRecords != 0) && ((uint64_t)maxRecords < estimatedRecords))
+    {
+        estimatedRecords = maxRecords;
+    }
+    if(estimatedRecords > MAX_INITIAL_RECORDS)
+    {
+        estimatedRecords = MAX_INITIAL_RECORDS;
+    }
+    myEntries.reserve(estimatedRecords);
+    myRecords.reserve(estimatedRecords * ESTIMATED_RECORD_SIZE);
+
+    SamRecord samRecord;
+    BamRecordView recordView;
+    const char* recordBuffer = NULL;
+    uint32_t recordSize = 0;
+    uint64_t numRecords = 0;
+    try
+    {
+        while(samIn.ReadRawRecord(header, samRecord, recordBuffer, recordSize))
+        {
+            if(!recordView.set(recordBuffer, recordSize))
+            {
+                Logger::gLogger->error("Invalid record found at recordCount %u",
+                                       samIn.GetCurrentRecordCount());
+            }
+            bool batchFull = 
+                ((maxRecords != 0) && (myEntries.size() >= (uint32_t)maxRecords)) ||
+                (myRecords.size() + recordSize + 
+                 (myEntries.size() + 1) * sizeof(SortEntry) > maxBytes);
+            if(batchFull && !myEntries.empty())
+            {
+                spillBatch(outHeader);
+            }
+            uint64_t needed = myRecords.size() + recordSize;
+            if(needed > myRecords.capacity())
+            {
+                // Grow by doubling, but not past the memory limit.
+                uint64_t capacity = 
+                    std::max((uint64_t)myRecords.capacity() * 2, needed);
+                myRecords.reserve(std::max(std::min(capacity, maxBytes), needed));
+            }
+            SortEntry entry;
+            entry.key = 
+                MergeBam::getGenomicCoordinate(recordView.getReferenceID(),
+                                               recordView.get0BasedPosition(),
+                                               recordView.getFlag());
+            entry.offset = myRecords.size();
+            myEntries.push_back(entry);
+            myRecords.insert(myRecords.end(), recordBuffer,
+                             recordBuffer + recordSize);
+            ++numRecords;
+        }
+        samIn.Close();
+
+        ThreadedSamFile samOut;
+        if(!samOut.OpenForWrite(outFile.c_str()))
+        {
+            Logger::gLogger->error("Cannot open %s for writing", outFile.c_str());
+        }
+        samOut.WriteHeader(outHeader);
+        if(myRunFiles.empty())
+        {
+            // Everything fit in memory.
+            sortBatch();
+            writeBatch(samOut, outHeader);
+            clearBatch();
+        }
+        else
+        {
+            if(!myEntries.empty())
+            {
+                spillBatch(outHeader);
+            }
+            Logger::gLogger->writeLog("Merging %u sorted temporary files",
+                                      (uint32_t)myRunFiles.size());
+            MergeBam::mergeSortedFiles(myRunFiles, myTmpPrefix, maxOpen,
+                                       samOut, outHeader);
+            removeRunFiles();
+        }
+        samOut.Close();
+    }
+    catch(std::exception& e)
+    {
+        removeRunFiles();
+        throw;
+    }
+
+    Logger::gLogger->writeLog("Sorted %llu records", 
+                              (unsigned long long)numRecords);
+    delete Logger::gLogger;
+    Logger::gLogger = NULL;
+    return(SamStatus::SUCCESS);
+}
+
+
+void SortBam::sortBatch()
+{
+    size_t numChunks = BamExecutable::getNumThreads();
+    if(numChunks > myEntries.size() / MIN_THREAD_ENTRIES)
+    {
+        numChunks = myEntries.size() / MIN_THREAD_ENTRIES;
+    }
+    if(numChunks <= 1)
+    {
+        std::sort(myEntries.begin(), myEntries.end());
+        return;
+    }
+
+    // Sort equal sized chunks, then merge neighboring pairs of chunks
+    // until there is just one.
+    std::vector<size_t> bounds;
+    for(size_t i = 0; i <= numChunks; i++)
+    {
+        bounds.push_back(myEntries.size() * i / numChunks);
+    }
+    std::vector<SortEntry>::iterator begin = myEntries.begin();
+    std::vector< std::future<void> > tasks;
+    for(size_t i = 0; i < numChunks; i++)
+    {
+        size_t start = bounds[i];
+        size_t end = bounds[i + 1];
+        tasks.push_back(BamExecutable::getThreadPool().submit([=]()
+            {
+                std::sort(begin + start, begin + end);
+            }));
+    }
+    for(size_t i = 0; i < tasks.size(); i++)
+    {
+        tasks[i].get();
+    }
+    while(bounds.size() > 2)
+    {
+        tasks.clear();
+        std::vector<size_t> merged;
+        merged.push_back(0);
+        size_t i = 0;
+        for(; i + 2 < bounds.size(); i += 2)
+        {
+            size_t start = bounds[i];
+            size_t middle = bounds[i + 1];
+            size_t end = bounds[i + 2];
+            tasks.push_back(BamExecutable::getThreadPool().submit([=]()
+                {
+                    std::inplace_merge(begin + start, begin + middle,
+                                       begin + end);
+                }));
+            merged.push_back(end);
+        }
+        if(i + 1 < bounds.size())
+        {
+            // Odd number of chunks, so the last one is merged next round.
+            merged.push_back(bounds.back());
+        }
+        for(size_t j = 0; j < tasks.size(); j++)
+        {
+            tasks[j].get();
+        }
+        bounds.swap(merged);
+    }
+}
+
+
+void SortBam::writeBatch(ThreadedSamFile& out, SamFileHeader& header)
+{
+    for(size_t i = 0; i < myEntries.size(); i++)
+    {
+        const char* buffer = &(myRecords[myEntries[i].offset]);
+        int32_t blockSize = 0;
+        memcpy(&blockSize, buffer, sizeof(blockSize));
+        if(!out.WriteRawRecord(header, buffer, blockSize + sizeof(blockSize)))
+        {
+            Logger::gLogger->error("Failed to write a sorted record: %s",
+                                   out.GetStatusMessage());
+        }
+    }
+}
+
+
+void SortBam::spillBatch(SamFileHeader& header)
+{
+    // Uncompressed since the file is only read back by the merge.
+    std::stringstream runName;
+    runName << myTmpPrefix << ".sort" << myRunFiles.size() << ".ubam";
+    myRunFiles.push_back(runName.str());
+
+    sortBatch();
+    ThreadedSamFile runOut;
+    if(!runOut.OpenForWrite(myRunFiles.back().c_str()))
+    {
+        Logger::gLogger->error("Cannot open BAM file %s for writing",
+                               myRunFiles.back().c_str());
+    }
+    runOut.WriteHeader(header);
+    writeBatch(runOut, header);
+    runOut.Close();
+    Logger::gLogger->writeLog("Wrote %u sorted records to %s",
+                              (uint32_t)myEntries.size(),
+                              myRunFiles.back().c_str());
+    clearBatch();
+}
+
+
+void SortBam::clearBatch()
+{
+    // Keep the memory for the next batch.
+    myRecords.clear();
+    myEntries.clear();
+}
+
+
+void SortBam::removeRunFiles()
+{
+    for(uint32_t i = 0; i < myRunFiles.size(); i++)
+    {
+        remove(myRunFiles[i].c_str());
+    }
+    myRunFiles.clear();
+}
@@ -0,0 +1,91 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//////////////////////////////////////////////////////////////////////////
+// This file contains the processing for the executable option "sort"
+// which sorts a SAM/BAM file by coordinate.
+
+#ifndef __SORT_BAM_H__
+#define __SORT_BAM_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "BamExecutable.h"
+#include "ThreadedSamFile.h"
+
+/// Sorts records by coordinate in batches that fit in the memory limit.
+/// Each batch is sorted on the thread pool.  If all records fit in one
+/// batch, it is written straight to the output, otherwise each batch is
+/// written to a temporary BAM file and the files are merged with
+/// MergeBam::mergeSortedFiles.  The sort is stable, records with the same
+/// position and strand are written in their input order.
+class SortBam : public BamExecutable
+{
+public:
+    SortBam();
+
+    static void printSortBamDescription(std::ostream& os);
+    void printDescription(std::ostream& os);
+    void printUsage(std::ostream& os);
+    int execute(int argc, char **argv);
+    virtual const char* getProgramName() {return("bam:sort");}
+
+private:
+    struct SortEntry
+    {
+        // MergeBam::getGenomicCoordinate of the record.
+        uint64_t key;
+        // Offset of the record in myRecords, which is in input order.
+        uint64_t offset;
+        bool operator<(const SortEntry& other) const
+        {
+            return((key < other.key) ||
+                   ((key == other.key) && (offset < other.offset)));
+        }
+    };
+
+    static const int DEFAULT_MAX_MEM = 1024;
+    static const int DEFAULT_MAX_OPEN = 256;
+    // Smallest number of entries worth sorting on their own thread.
+    static const size_t MIN_THREAD_ENTRIES = 10000;
+    // Record size used to estimate how many records a batch holds, and
+    // the most records reserved for before the batch size is known.
+    static const uint64_t ESTIMATED_RECORD_SIZE = 300;
+    static const uint64_t MAX_INITIAL_RECORDS = 1 << 16;
+
+    // Sort the batch, in chunks on the thread pool that are then merged.
+    void sortBatch();
+    // Write the sorted batch.
+    void writeBatch(ThreadedSamFile& out, SamFileHeader& header);
+    // Sort the batch and write it to a new temporary file.
+    void spillBatch(SamFileHeader& header);
+    void clearBatch();
+    // Delete the temporary files written by spillBatch.
+    void removeRunFiles();
+
+    // BAM buffers of the records in the batch, each starting with its
+    // block size.
+    std::vector<char> myRecords;
+    std::vector<SortEntry> myEntries;
+
+    std::string myTmpPrefix;
+    std::vector<std::string> myRunFiles;
+};
+
+#endif
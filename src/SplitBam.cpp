@@ -26,6 +26,7 @@
 #include <getopt.h>
 #include "SplitBam.h"
 #include "SamFile.h"
+#include "BatchedBamWriter.h"
 #include "Logger.h"
 #include "BgzfFileType.h"
 #include "PhoneHome.h"
@@ -88,6 +89,9 @@ void SplitBam::printUsage(std::ostream& os)
     os << "-L/--log [logFile]  : log file name. default is listFile.log" << std::endl;
     os << "-v/--verbose : turn on verbose mode" << std::endl;
     os << "-n/--noeof : turn off the check for an EOF block at the end of a bam file" << std::endl;
+    os << "--maxOpen [n] : maximum number of output files open at a time, default " << BatchedBamWriter::DEFAULT_MAX_OPEN << std::endl;
+    os << "--batchBlocks [n] : number of 64KB blocks of records to buffer per output before compressing," << std::endl;
+    os << "                    default " << BatchedBamWriter::DEFAULT_BATCH_BLOCKS << std::endl;
 }
 
 // main function
@@ -101,6 +105,8 @@ int SplitBam::execute(int argc, char ** argv)
       { "verbose", no_argument, NULL, 'v'},
       { "noeof", no_argument, NULL, 'n'},
       { "log", required_argument, NULL, 'L'},
+      { "maxOpen", required_argument, NULL, 'm'},
+      { "batchBlocks", required_argument, NULL, 'b'},
       { "noPhoneHome", no_argument, NULL, 'p'},
       { "nophonehome", no_argument, NULL, 'P'},
       { "phoneHomeThinning", required_argument, NULL, 't'},
@@ -113,6 +119,8 @@ int SplitBam::execute(int argc, char ** argv)
   bool b_verbose = false;
   bool noeof = false;
   bool noPhoneHome = false;
+  int maxOpen = BatchedBamWriter::DEFAULT_MAX_OPEN;
+  int batchBlocks = BatchedBamWriter::DEFAULT_BATCH_BLOCKS;
 
   std::string s_in, s_out, s_logger;
 
@@ -133,6 +141,12 @@ int SplitBam::execute(int argc, char ** argv)
     case 'L':
       s_logger = optarg;
       break;
+    case 'm':
+      maxOpen = atoi(optarg);
+      break;
+    case 'b':
+      batchBlocks = atoi(optarg);
+      break;
     case 'p':
     case 'P':
       noPhoneHome = true;
@@ -185,6 +199,10 @@ int SplitBam::execute(int argc, char ** argv)
     Logger::gLogger->error("At least one of the required argument is missing");
   }
 
+  if ( ( maxOpen < 1 ) || ( batchBlocks < 1 ) ) {
+    Logger::gLogger->error("--maxOpen and --batchBlocks must be at least 1");
+  }
+
   Logger::gLogger->writeLog("Input BAM file : %s",s_in.c_str());
   Logger::gLogger->writeLog("Output BAM prefix : %s",s_out.c_str());
   Logger::gLogger->writeLog("Output log file : %s",s_logger.c_str());
@@ -195,8 +213,9 @@ int SplitBam::execute(int argc, char ** argv)
   SamFileHeader inHeader;
   std::map<std::string,uint32_t> msRGidx;
   std::vector<std::string> vsRGIDs;
-  std::vector<SamFile*> vpOutBams;
   std::vector<SamFileHeader*> vpOutHeaders;
+  // Records are buffered per output file and written in batches.
+  BatchedBamWriter outBams(maxOpen, batchBlocks);
 
   if ( ! (inBam.OpenForRead(s_in.c_str()))  ) {
     Logger::gLogger->error("Cannot open BAM file %s for reading - %s",s_in.c_str(), SamStatus::getStatusString(inBam.GetStatus()) );
@@ -214,14 +233,6 @@ int SplitBam::execute(int argc, char ** argv)
       vsRGIDs.push_back(sRGID);
       uint32_t idx = msRGidx.size();
       msRGidx[sRGID] = idx;
-      SamFile* pNewFile = new SamFile;
-      vpOutBams.push_back(pNewFile);
-      
-      std::string outFileName = s_out + "." + sRGID + ".bam";
-      if ( !pNewFile->OpenForWrite(outFileName.c_str()) ) {
-	Logger::gLogger->error("Cannot open BAM file %s for writing",outFileName.c_str());
-      }
-      
       SamFileHeader* pNewHeader = new SamFileHeader(inHeader);
       vpOutHeaders.push_back(pNewHeader);
     }
@@ -250,9 +261,13 @@ int SplitBam::execute(int argc, char ** argv)
     }
   }
 
-  // write headers to the output file
+  // create the output files with their headers
   for(uint32_t i=0; i < vsRGIDs.size(); ++i) {
-    vpOutBams[i]->WriteHeader(*vpOutHeaders[i]);
+    std::string outFileName = s_out + "." + vsRGIDs[i] + ".bam";
+    uint32_t outIdx = 0;
+    if ( !outBams.addFile(outFileName.c_str(), *vpOutHeaders[i], outIdx) ) {
+      Logger::gLogger->error("Cannot open BAM file %s for writing",outFileName.c_str());
+    }
   }
 
   SamRecord record;
@@ -269,7 +284,9 @@ int SplitBam::execute(int argc, char ** argv)
 	  if ( msRGidx.find(sValue) != msRGidx.end() ) {
 	    uint32_t idx = msRGidx[sValue];
 	    if ( (idx >= 0 ) && ( idx < vsRGIDs.size () ) ) {
-	      vpOutBams[idx]->WriteRecord(inHeader, record);
+	      if ( !outBams.writeRecord(idx, record) ) {
+		Logger::gLogger->error("Failed to write readName %s to %s",record.getReadName(),outBams.getFileName(idx).c_str());
+	      }
 	    }
 	    else {
 	      Logger::gLogger->error("ReadGroup Index Lookup Failure");
@@ -290,10 +307,11 @@ int SplitBam::execute(int argc, char ** argv)
     }
   }
 
+  if ( !outBams.close() ) {
+    Logger::gLogger->error("Failed to write the output BAM files");
+  }
   for(uint32_t i=0; i < vsRGIDs.size(); ++i) {
-    Logger::gLogger->writeLog("Successfully wrote %d record for readGroup %s",vpOutBams[i]->GetCurrentRecordCount(), vsRGIDs[i].c_str());
-    vpOutBams[i]->Close();
-    delete vpOutBams[i];
+    Logger::gLogger->writeLog("Successfully wrote %d record for readGroup %s",outBams.getRecordCount(i), vsRGIDs[i].c_str());
     delete vpOutHeaders[i];
   }
 
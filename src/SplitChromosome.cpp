@@ -18,11 +18,58 @@
 //////////////////////////////////////////////////////////////////////////
 // This file contains the processing for the executable option "splitChromosome"
 // which splits a sorted/indexed BAM file into one file per chromosome.
+#include <atomic>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
 #include "SplitChromosome.h"
+#include "BalancedShards.h"
 #include "SamFile.h"
+#include "ThreadedSamFile.h"
 #include "Parameters.h"
 #include "BgzfFileType.h"
 
+// Get the name of the output file for the specified reference.
+static String getOutputName(const String& outFileBase, const char* refName,
+                            bool bamOut)
+{
+    String outputName = outFileBase;
+    if(strcmp(refName, "*") == 0)
+    {
+        outputName += "UnknownChrom";
+    }
+    else
+    {
+        outputName += refName;
+    }
+    // Append the extension.
+    if(bamOut)
+    {
+        outputName += ".bam";
+    }
+    else
+    {
+        outputName += ".sam";
+    }
+    return(outputName);
+}
+
+// Get the name of the output file for the specified shard, numbered from 1
+// with enough digits for all of the shards so they sort in order.
+static String getShardName(const String& outFileBase, int shard,
+                           int numShards, bool bamOut)
+{
+    int digits = std::to_string(numShards).size();
+    std::string number = std::to_string(shard + 1);
+    String outputName = outFileBase;
+    outputName += "shard";
+    outputName += std::string(digits - number.size(), '0').c_str();
+    outputName += number.c_str();
+    outputName += bamOut ? ".bam" : ".sam";
+    return(outputName);
+}
+
 void SplitChromosome::printSplitChromosomeDescription(std::ostream& os)
 {
     os << " splitChromosome - Split BAM by Chromosome" << std::endl;
@@ -38,12 +85,23 @@ void SplitChromosome::printDescription(std::ostream& os)
 void SplitChromosome::printUsage(std::ostream& os)
 {
     BamExecutable::printUsage(os);
-    os << "\t./bam splitChromosome --in <inputFilename>  --out <outputFileBaseName> [--noeof] [--bamout|--samout] [--params]"<< std::endl;
+    os << "\t./bam splitChromosome --in <inputFilename>  --out <outputFileBaseName> [--bamIndex <bamIndexFile>] [--shards <numShards>] [--index] [--noeof] [--bamout|--samout] [--params]"<< std::endl;
     os << "\tRequired Parameters:" << std::endl;
     os << "\t\t--in       : the BAM file to be split" << std::endl;
     os << "\t\t--out      : the base filename for the SAM/BAM files to write into.  Does not include the extension.\n";
     os << "                 CHROM.bam or CHROM.sam will be appended to the basename where CHROM is the chromosome name.\n";
     os << "\tOptional Parameters:" << std::endl;
+    os << "\t\t--bamIndex : the path/name of the bam index file, used to split the\n";
+    os << "\t\t             chromosomes in parallel with --threads" << std::endl;
+    os << "\t\t             (if not specified, uses the --in value + \".bai\")" << std::endl;
+    os << "\t\t--shards   : rather than by chromosome, split into this many shards with about the\n";
+    os << "\t\t             same amount of data, estimated from the BAI index, which is required.\n";
+    os << "\t\t             Shards are cut on 16kb boundaries, may hold several chromosomes,\n";
+    os << "\t\t             and hold the records that start in them.  They are written to\n";
+    os << "\t\t             shardN.bam or shardN.sam appended to the basename, and their regions\n";
+    os << "\t\t             (0-based, end exclusive) to shards.txt, with * for the unmapped reads\n";
+    os << "\t\t--index  : index each BAM output file as it is written (CHROM.bam.bai," << std::endl;
+    os << "\t\t           or .csi if a reference is longer than 512Mb)" << std::endl;
     os << "\t\t--noeof  : do not expect an EOF block on a bam file." << std::endl;
     os << "\t\t--bamout : write the output files in BAM format (default)." << std::endl;
     os << "\t\t--samout : write the output files in SAM format." << std::endl;
@@ -59,15 +117,21 @@ int SplitChromosome::execute(int argc, char **argv)
     // Extract command line arguments.
     String inFile = "";
     String outFileBase = "";
+    String indexFile = "";
+    int numShards = 0;
     bool noeof = false;
     bool bamOut = false;
     bool samOut = false;
+    bool index = false;
     bool params = false;
 
     ParameterList inputParameters;
     BEGIN_LONG_PARAMETERS(longParameterList)
         LONG_STRINGPARAMETER("in", &inFile)
         LONG_STRINGPARAMETER("out", &outFileBase)
+        LONG_STRINGPARAMETER("bamIndex", &indexFile)
+        LONG_INTPARAMETER("shards", &numShards)
+        LONG_PARAMETER("index", &index)
         LONG_PARAMETER("noeof", &noeof)
         LONG_PARAMETER("params", &params)
         LONG_PARAMETER_GROUP("Output Type")
@@ -115,11 +179,44 @@ int SplitChromosome::execute(int argc, char **argv)
         return(-1);
     }
 
+    if(index && samOut)
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        std::cerr << "--index cannot be used with --samout" << std::endl;
+        return(-1);
+    }
+
+    if(indexFile == "")
+    {
+        // In file was not specified, so set it to the in file
+        // + ".bai"
+        indexFile = inFile + ".bai";
+    }
+
     if(params)
     {
         inputParameters.Status();
     }
 
+    if(numShards > 0)
+    {
+        return(splitShards(inFile, indexFile, outFileBase, bamOut, index,
+                           numShards));
+    }
+
+    if(getNumThreads() > 1)
+    {
+        // Check that the index can be read before starting the threads.
+        SamFile indexCheck(ErrorHandler::RETURN);
+        if(indexCheck.OpenForRead(inFile) && indexCheck.ReadBamIndex(indexFile))
+        {
+            return(splitInParallel(inFile, indexFile, outFileBase, bamOut,
+                                   index));
+        }
+        // Without an index, the chromosomes are split in one pass.
+    }
+
     SamFile samIn;
     // Open the file for reading.   
     samIn.OpenForRead(inFile);
@@ -137,7 +234,8 @@ int SplitChromosome::execute(int argc, char **argv)
     SamStatus::Status status = SamStatus::SUCCESS;
 
     // Do not open the file until there is a record to write into it.
-    SamFileWriter outFile;
+    ThreadedSamFile outFile;
+    outFile.setWriteIndex(index);
 
     String outputName;
     
@@ -157,27 +255,14 @@ int SplitChromosome::execute(int argc, char **argv)
                           << samHeader.getReferenceLabel(prevRefID)
                           << " has " << numSectionRecords << " records\n";
             }
-            outputName = outFileBase;
-
-            // Open a new file (will close the previous one)
-            const char* refName = samRecord.getReferenceName();
-            if(strcmp(refName, "*") == 0)
-            {
-                outputName += "UnknownChrom";
-            }
-            else
-            {
-                outputName += refName;
-            }
-            // Append the extension.
-            if(bamOut)
-            {
-                outputName += ".bam";
-            }
-            else
+            // Close the previous file, writing its index.
+            outFile.Close();
+            if(outFile.writeIndexFailed())
             {
-                outputName += ".sam";
+                status = SamStatus::FAIL_IO;
             }
+            outputName = getOutputName(outFileBase,
+                                       samRecord.getReferenceName(), bamOut);
             outFile.OpenForWrite(outputName.c_str());
             outFile.WriteHeader(samHeader);
             numSectionRecords = 0;
@@ -190,6 +275,12 @@ int SplitChromosome::execute(int argc, char **argv)
         outFile.WriteRecord(samHeader, samRecord);
     }
 
+    outFile.Close();
+    if(outFile.writeIndexFailed())
+    {
+        status = SamStatus::FAIL_IO;
+    }
+
     // Output the last chromosome's info.
     if(numSectionRecords != 0)
     {
@@ -205,3 +296,247 @@ int SplitChromosome::execute(int argc, char **argv)
     return(status);
 }
 
+
+int SplitChromosome::splitInParallel(const String& inFile,
+                                     const String& indexFile,
+                                     const String& outFileBase, bool bamOut,
+                                     bool index)
+{
+    SamFile samIn;
+    SamFileHeader samHeader;
+    samIn.OpenForRead(inFile, &samHeader);
+    samIn.Close();
+
+    // One section per reference followed by the unmapped reads, which
+    // is the order they are in the sorted file.
+    int numRefs = samHeader.getReferenceInfo().getNumEntries();
+    std::vector<int> numSectionRecords(numRefs + 1, 0);
+    int numWorkers = getNumThreads();
+    if(numWorkers > (int)numSectionRecords.size())
+    {
+        numWorkers = numSectionRecords.size();
+    }
+
+    // Each worker reads the chromosomes with its own file handle and 
+    // writes them without the thread pool, which is running the workers.
+    std::atomic<unsigned int> nextSection(0);
+    std::atomic<bool> indexFailed(false);
+    try
+    {
+        runWorkers([&]()
+            {
+                SamFile sectionIn;
+                SamFileHeader sectionHeader;
+                sectionIn.OpenForRead(inFile, &sectionHeader);
+                sectionIn.ReadBamIndex(indexFile);
+                sectionIn.setSortedValidation(SamFile::COORDINATE);
+                SamRecord samRecord;
+                unsigned int section;
+                while((section = nextSection++) < numSectionRecords.size())
+                {
+                    int refID = ((int)section < numRefs) ? section : -1;
+                    sectionIn.SetReadSection(refID);
+                    // Do not open the file until there is a record to
+                    // write into it.
+                    ThreadedSamFile outFile;
+                    outFile.setThreadedWrite(false);
+                    outFile.setWriteIndex(index);
+                    while(sectionIn.ReadRecord(sectionHeader, samRecord))
+                    {
+                        if(numSectionRecords[section] == 0)
+                        {
+                            String outputName = 
+                                getOutputName(outFileBase,
+                                              samRecord.getReferenceName(),
+                                              bamOut);
+                            outFile.OpenForWrite(outputName.c_str());
+                            outFile.WriteHeader(sectionHeader);
+                        }
+                        ++numSectionRecords[section];
+                        outFile.WriteRecord(sectionHeader, samRecord);
+                    }
+                    outFile.Close();
+                    if(outFile.writeIndexFailed())
+                    {
+                        indexFailed = true;
+                    }
+                }
+            }, numWorkers);
+    }
+    catch(std::exception& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return(-1);
+    }
+
+    int numRecords = 0;
+    for(unsigned int i = 0; i < numSectionRecords.size(); i++)
+    {
+        if(numSectionRecords[i] != 0)
+        {
+            int refID = ((int)i < numRefs) ? i : -1;
+            std::cerr << "Reference Name: "
+                      << samHeader.getReferenceLabel(refID)
+                      << " has " << numSectionRecords[i] << " records\n";
+        }
+        numRecords += numSectionRecords[i];
+    }
+
+    std::cerr << "Number of records = " << numRecords << std::endl;
+
+    SamStatus::Status status = 
+        indexFailed ? SamStatus::FAIL_IO : SamStatus::SUCCESS;
+    fprintf(stderr, "Returning: %d (%s)\n", status, SamStatus::getStatusString(status));
+    return(status);
+}
+
+
+int SplitChromosome::splitShards(const String& inFile,
+                                 const String& indexFile,
+                                 const String& outFileBase, bool bamOut,
+                                 bool index, int numShards)
+{
+    SamFile samIn;
+    SamFileHeader samHeader;
+    samIn.OpenForRead(inFile, &samHeader);
+    samIn.Close();
+    const SamReferenceInfo& refInfo = samHeader.getReferenceInfo();
+
+    std::vector<BalancedShards::Shard> shards;
+    if(!BalancedShards::plan(inFile.c_str(), indexFile.c_str(),
+                             refInfo.getNumEntries(), numShards, shards))
+    {
+        std::cerr << "--shards requires a BAM file with a BAI index.\n";
+        return(-1);
+    }
+
+    // Records read from each region of each shard.
+    std::vector<std::vector<int> > numRegionRecords(shards.size());
+    for(unsigned int i = 0; i < shards.size(); i++)
+    {
+        numRegionRecords[i].assign(shards[i].regions.size(), 0);
+    }
+    int numWorkers = getNumThreads();
+    if(numWorkers > (int)shards.size())
+    {
+        numWorkers = shards.size();
+    }
+
+    // Each worker reads the shards with its own file handle and writes
+    // them without the thread pool, which is running the workers.
+    std::atomic<unsigned int> nextShard(0);
+    std::atomic<bool> indexFailed(false);
+    try
+    {
+        runWorkers([&]()
+            {
+                SamFile shardIn;
+                SamFileHeader shardHeader;
+                shardIn.OpenForRead(inFile, &shardHeader);
+                shardIn.ReadBamIndex(indexFile);
+                shardIn.setSortedValidation(SamFile::COORDINATE);
+                SamRecord samRecord;
+                unsigned int shard;
+                while((shard = nextShard++) < shards.size())
+                {
+                    // Every shard is written, even if it has no records.
+                    ThreadedSamFile outFile;
+                    outFile.setThreadedWrite(false);
+                    outFile.setWriteIndex(index);
+                    String outputName = getShardName(outFileBase, shard,
+                                                     shards.size(), bamOut);
+                    outFile.OpenForWrite(outputName.c_str());
+                    outFile.WriteHeader(shardHeader);
+                    const std::vector<BalancedShards::Region>& regions =
+                        shards[shard].regions;
+                    for(unsigned int i = 0; i < regions.size(); i++)
+                    {
+                        const BalancedShards::Region& region = regions[i];
+                        if(region.refID < 0)
+                        {
+                            shardIn.SetReadSection(-1);
+                        }
+                        else
+                        {
+                            shardIn.SetReadSection(region.refID,
+                                                   region.start, region.end);
+                        }
+                        while(shardIn.ReadRecord(shardHeader, samRecord))
+                        {
+                            // Records overlapping the start of the region
+                            // are in the previous shard.
+                            if((region.refID >= 0) &&
+                               (samRecord.get0BasedPosition() < region.start))
+                            {
+                                continue;
+                            }
+                            ++numRegionRecords[shard][i];
+                            outFile.WriteRecord(shardHeader, samRecord);
+                        }
+                        if(shardIn.GetStatus() != SamStatus::NO_MORE_RECS)
+                        {
+                            throw(std::runtime_error(shardIn.GetStatusMessage()));
+                        }
+                    }
+                    outFile.Close();
+                    if(outFile.writeIndexFailed())
+                    {
+                        indexFailed = true;
+                    }
+                }
+            }, numWorkers);
+    }
+    catch(std::exception& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return(-1);
+    }
+
+    // Write the manifest of the shard regions.
+    String manifestName = outFileBase + "shards.txt";
+    std::ofstream manifest(manifestName.c_str());
+    manifest << "#file\tchrom\tstart\tend\trecords\n";
+    int numRecords = 0;
+    for(unsigned int shard = 0; shard < shards.size(); shard++)
+    {
+        String outputName = getShardName(outFileBase, shard, shards.size(),
+                                         bamOut);
+        const std::vector<BalancedShards::Region>& regions =
+            shards[shard].regions;
+        int numShardRecords = 0;
+        for(unsigned int i = 0; i < regions.size(); i++)
+        {
+            const BalancedShards::Region& region = regions[i];
+            int32_t end = region.end;
+            if(region.refID < 0)
+            {
+                end = 0;
+            }
+            else if(end < 0)
+            {
+                end = refInfo.getReferenceLength(region.refID);
+            }
+            manifest << outputName.c_str() << "\t"
+                     << samHeader.getReferenceLabel(region.refID) << "\t"
+                     << region.start << "\t" << end << "\t"
+                     << numRegionRecords[shard][i] << "\n";
+            numShardRecords += numRegionRecords[shard][i];
+        }
+        std::cerr << "Shard: " << outputName << " has "
+                  << numShardRecords << " records\n";
+        numRecords += numShardRecords;
+    }
+    manifest.close();
+
+    std::cerr << "Number of records = " << numRecords << std::endl;
+
+    SamStatus::Status status = 
+        indexFailed ? SamStatus::FAIL_IO : SamStatus::SUCCESS;
+    if(!manifest)
+    {
+        std::cerr << "ERROR: Failed to write " << manifestName << std::endl;
+        status = SamStatus::FAIL_IO;
+    }
+    fprintf(stderr, "Returning: %d (%s)\n", status, SamStatus::getStatusString(status));
+    return(status);
+}
@@ -32,6 +32,19 @@ public:
     void printUsage(std::ostream& os);
     int execute(int argc, char **argv);
     virtual const char* getProgramName() {return("bam:splitChromosome");}
+
+private:
+    // Split each chromosome on a separate worker using the index,
+    // indexing each output as it is written if index is set.
+    int splitInParallel(const String& inFile, const String& indexFile,
+                        const String& outFileBase, bool bamOut, bool index);
+
+    // Split into shards of about the same size using the index (see
+    // BalancedShards), writing them on separate workers along with a
+    // manifest of their regions.
+    int splitShards(const String& inFile, const String& indexFile,
+                    const String& outFileBase, bool bamOut, bool index,
+                    int numShards);
 };
 
 #endif
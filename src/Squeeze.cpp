@@ -21,6 +21,8 @@
 // #include <string.h>
 // #include "SamFile.h"
 #include "SamFlag.h"
+#include "ThreadedSamFile.h"
+#include "ReadNameMap.h"
 
 Squeeze::Squeeze()
     : myBinMid(false),
@@ -76,7 +78,7 @@ void Squeeze::printBinningUsage(std::ostream& os)
 void Squeeze::printUsage(std::ostream& os)
 {
     BamExecutable::printUsage(os);
-    os << "\t./bam squeeze --in <inputFile> --out <outputFile.sam/bam/ubam (ubam is uncompressed bam)> [--refFile <refFilePath/Name>] [--keepOQ] [--keepDups] [--readName <readNameMapFile.txt>] [--sReadName <readNameMapFile.txt>] [--rmTags <Tag:Type[,Tag:Type]*>] [--noeof] [--params] ";
+    os << "\t./bam squeeze --in <inputFile> --out <outputFile.sam/bam/ubam (ubam is uncompressed bam)> [--refFile <refFilePath/Name>] [--keepOQ] [--keepDups] [--readName <readNameMapFile.txt>] [--sReadName <readNameMapFile.txt>] [--rmTags <Tag:Type[,Tag:Type]*>] [--index] [--noeof] [--params] ";
     printBinningUsageLine(os);
     os << std::endl;
     os << "\tRequired Parameters:" << std::endl;
@@ -92,8 +94,11 @@ void Squeeze::printUsage(std::ostream& os)
     os << "                   get mapped to multiple new values." << std::endl;
     os << "\t\t--readName   : Replace read names with unique integers and write the mapping to the specified file." << std::endl;
     os << "                   This version does not require the input file to have been presorted by readname," << std::endl;
-    os << "                   but uses a lot of memory since it stores all the read names." << std::endl;
+    os << "                   It keeps a fingerprint of each read name in a memory mapped table in a" << std::endl;
+    os << "                   temporary file, <readNameMapFile.txt>.idx, that is removed when done." << std::endl;
     os << "\t\t--rmTags     : Remove the specified Tags formatted as Tag:Type,Tag:Type,Tag:Type..." << std::endl;
+    os << "\t\t--index      : index the coordinate sorted BAM output as it is written (<outputFile>.bai," << std::endl;
+    os << "                   or .csi if a reference is longer than 512Mb)" << std::endl;
     os << "\t\t--noeof      : do not expect an EOF block on a bam file." << std::endl;
     os << "\t\t--params     : print the parameter settings" << std::endl;
     printBinningUsage(os);
@@ -110,6 +115,7 @@ int Squeeze::execute(int argc, char ** argv)
     bool params = false;
     bool keepOQ = false;
     bool keepDups =  false;
+    bool index = false;
     String readName = "";
     String sReadName = "";
     IFILE readNameFile = NULL;
@@ -131,6 +137,7 @@ int Squeeze::execute(int argc, char ** argv)
     parameters.addString("readName", &readName);
     parameters.addString("sReadName", &sReadName);
     parameters.addString("rmTags", &rmTags);
+    parameters.addBool("index", &index);
     parameters.addBool("noeof", &noeof);
     parameters.addBool("params", &params);
     parameters.addPhoneHome(VERSION);
@@ -210,11 +217,12 @@ int Squeeze::execute(int argc, char ** argv)
     }
 
     // Open the input file for reading.
-    SamFile samIn;
+    ThreadedSamFile samIn;
     samIn.OpenForRead(inFile);
 
     // Open the output file for writing.
-    SamFile samOut;
+    ThreadedSamFile samOut;
+    samOut.setWriteIndex(index);
     samOut.OpenForWrite(outFile);
     // Check to see if the ref file was specified.
     // Open the reference.
@@ -222,10 +230,9 @@ int Squeeze::execute(int argc, char ** argv)
     if(refFile != "")
     {
         refPtr = new GenomeSequence(refFile);
-        // Since a reference was specified, convert matching bases to '='.
-        samOut.SetWriteSequenceTranslation(SamRecord::EQUAL);
-        // Set the reference for the output file.
-        samOut.SetReference(refPtr);
+        // Since a reference was specified, convert matching bases to '='
+        // in the BAM records as they are edited.
+        myEqualsEncoder.setReference(refPtr);
     }
 
     // Read the sam header.
@@ -237,11 +244,20 @@ int Squeeze::execute(int argc, char ** argv)
 
     SamRecord samRecord;
 
-    // Create the hash for readnames.
-    StringIntHash rnHash;
+    // Create the map for readnames.
+    ReadNameMap rnMap;
+    if((readNameFile != NULL) && sReadName.IsEmpty())
+    {
+        std::string rnMapFile = readName.c_str();
+        rnMapFile += ".idx";
+        if(!rnMap.open(rnMapFile))
+        {
+            std::cerr << "Failed to create the readName map file: " << rnMapFile << std::endl;
+            return(-1);
+        }
+    }
     // Track the next read name to assign.
     int32_t nextRn = 0;
-    int32_t numHashEntries = rnHash.Entries();
     String newRn = "";
     String prevRn = "";
 
@@ -249,6 +265,10 @@ int Squeeze::execute(int argc, char ** argv)
     // failure reason if any of the writes or updates fail.
     SamStatus::Status returnStatus = SamStatus::SUCCESS;
   
+    // Only load the BAM record for editing if it will be changed.
+    bool editRecord = !keepOQ || !rmTags.IsEmpty() || 
+        !myBinQualS.IsEmpty() || (refPtr != NULL);
+
     // Keep reading records until ReadRecord returns false.
     while(samIn.ReadRecord(samHeader, samRecord))
     {
@@ -271,14 +291,14 @@ int Squeeze::execute(int argc, char ** argv)
             
             if(sReadName.IsEmpty())
             {
-                // Lookup the readname in the hash.
-                int index = rnHash.Find(readName, nextRn);
+                // Lookup the readname in the map.
+                bool added = false;
+                int32_t rn = rnMap.find(readName, nextRn, added);
                 
-                // Check to see if the nextRn was added to the hash.
-                if(rnHash.Entries() != numHashEntries)
+                // Check to see if the nextRn was added to the map.
+                if(added)
                 {
-                    // New Read Name was added to the hash.
-                    numHashEntries = rnHash.Entries();
+                    // New Read Name was added to the map.
                     newRn = nextRn;
                     
                     // Write it to the file.
@@ -290,7 +310,7 @@ int Squeeze::execute(int argc, char ** argv)
                 else
                 {
                     // Found the read name, so use that value.
-                    newRn = rnHash.Integer(index);
+                    newRn = rn;
                 }
             }
             else
@@ -314,32 +334,53 @@ int Squeeze::execute(int argc, char ** argv)
             samRecord.setReadName(newRn.c_str());
         }
 
-        // Remove the OQ tag if we are not supposed to remove OQ tags.
-        if(!keepOQ)
+        // Remove the tags & bin the qualities directly in the BAM record.
+        if(editRecord)
         {
-            if(!samRecord.rmTag("OQ", 'Z'))
+            if(!myEditor.load(samRecord))
             {
-                // Failed to remove a tag.
-                SamStatus errorStatus = samRecord.getStatus();
-                fprintf(stderr, "%s\n", errorStatus.getStatusMessage());
-                returnStatus = errorStatus.getStatus();
+                // Failed to get the record buffer.
+                fprintf(stderr, "%s\n", myEditor.getStatus().getStatusMessage());
+                returnStatus = myEditor.getStatus().getStatus();
             }
-        }
-
-        // Remove any specified tags.
-        if(!rmTags.IsEmpty())
-        {
-            if(!samRecord.rmTags(rmTags.c_str()))
+            else
             {
-                // Failed to remove the specified tags.
-                fprintf(stderr, "%s\n", samIn.GetStatusMessage());
-                returnStatus = samIn.GetStatus();
+                // Remove the OQ tag if we are not supposed to keep OQ tags.
+                if(!keepOQ)
+                {
+                    myEditor.removeTag("OQ", 'Z');
+                }
+
+                // Remove any specified tags.
+                if(!rmTags.IsEmpty())
+                {
+                    if(!myEditor.removeTags(rmTags.c_str()))
+                    {
+                        // Failed to remove the specified tags.
+                        fprintf(stderr, "%s\n", myEditor.getStatus().getStatusMessage());
+                        returnStatus = myEditor.getStatus().getStatus();
+                    }
+                }
+
+                // Bin the qualities.
+                bin();
+
+                if((refPtr != NULL) && 
+                   !myEditor.setMatchesToEquals(myEqualsEncoder, samHeader))
+                {
+                    fprintf(stderr, "%s\n", myEditor.getStatus().getStatusMessage());
+                    returnStatus = myEditor.getStatus().getStatus();
+                }
+
+                if(!myEditor.store(samRecord, samHeader))
+                {
+                    // Failed to update the record.
+                    fprintf(stderr, "%s\n", myEditor.getStatus().getStatusMessage());
+                    returnStatus = myEditor.getStatus().getStatus();
+                }
             }
         }
 
-        // Bin the qualities.
-        bin(samRecord);
-
         if(!samOut.WriteRecord(samHeader, samRecord))
         {
             // Failed to write a record.
@@ -365,6 +406,10 @@ int Squeeze::execute(int argc, char ** argv)
     // their failure status.
     samIn.Close();
     samOut.Close();
+    if(samOut.writeIndexFailed())
+    {
+        returnStatus = SamStatus::FAIL_IO;
+    }
     return returnStatus;
 }
 
@@ -540,23 +585,12 @@ void Squeeze::binPhredQuals(int binStartPhred, int binEndPhred)
 }
 
 
-void Squeeze::bin(SamRecord& samRecord)
+void Squeeze::bin()
 {
-    static String qual = "";
     if (!myBinQualS.IsEmpty())
     {
-        qual = samRecord.getQuality();
-        
-        if(qual != "*")
-        {
-            // Only bin set qualities.
-            for(int i = 0; i < qual.Length(); i++)
-            {
-                // Update the quality by looking its value up
-                // in the quality bin map.
-                qual[i] = (char)(myQualBinMap[(int)(qual[i])]);
-            }
-            samRecord.setQuality(qual);
-        }
+        // Update the qualities by looking their values up
+        // in the quality bin map.
+        myEditor.mapQualities(myQualBinMap, MAX_QUAL_CHAR);
     }
 }
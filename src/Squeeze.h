@@ -28,6 +28,7 @@
 #include <map>
 #include "BamExecutable.h"
 #include "SamFile.h"
+#include "BamRecordEditor.h"
 
 class Squeeze : public BamExecutable
 {
@@ -48,7 +49,8 @@ public:
 
 private:
     void binPhredQuals(int binStartPhred, int binEndPhred);
-    void bin(SamRecord& samRecord);
+    // Bin the qualities of the record loaded in myEditor.
+    void bin();
 
     // Non-phred max
     static const int MAX_QUAL_CHAR = 126;
@@ -61,6 +63,9 @@ private:
     String myBinQualF;
     // Non-phred indices
     int myQualBinMap[MAX_QUAL_CHAR+1];
+    BamRecordEditor myEditor;
+    // Replaces the bases matching the --refFile reference with '='.
+    EqualsEncoder myEqualsEncoder;
 };
 
 #endif
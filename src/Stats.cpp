@@ -18,12 +18,28 @@
 //////////////////////////////////////////////////////////////////////////
 // This file contains the processing for the executable option "stats"
 // which generates some statistics for SAM/BAM files.
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <condition_variable>
+#include <iomanip>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
 #include "Stats.h"
-#include "SamFile.h"
+#include "BalancedShards.h"
+#include "ThreadedSamFile.h"
 #include "BgzfFileType.h"
+#include "BaseQCFile.h"
+#include "BaseQCPileup.h"
 #include "Pileup.h"
-#include "PileupElementBaseQCStats.h"
 #include "SamFlag.h"
+#include "FileBatch.h"
+#include "RemoteBamCache.h"
+#include "BamRecordView.h"
 
 void Stats::printStatsDescription(std::ostream& os)
 {
@@ -40,21 +56,45 @@ void Stats::printDescription(std::ostream& os)
 void Stats::printUsage(std::ostream& os)
 {
     BamExecutable::printUsage(os);
-    os << "\t./bam stats --in <inputFile> [--basic] [--qual] [--phred] [--pBaseQC <outputFileName>] [--cBaseQC <outputFileName>] [--maxNumReads <maxNum>]"
+    os << "\t./bam stats --in <inputFile>|--inList <listFile> [--basic] [--idxStats] [--qual] [--phred] [--pBaseQC <outputFileName>] [--cBaseQC <outputFileName>] [--bBaseQC <outputFileName>] [--maxNumReads <maxNum>] [--sample <numSamples>] [--sampleReads <numReads>]"
               << "[--unmapped] [--bamIndex <bamIndexFile>] [--regionList <regFileName>] [--requiredFlags <integerRequiredFlags>] [--excludeFlags <integerExcludeFlags>] [--noeof] [--params] [--withinRegion] [--baseSum] [--bufferSize <buffSize>] [--minMapQual <minMapQ>] [--dbsnp <dbsnpFile>]" << std::endl;
     os << "\tRequired Parameters:" << std::endl;
-    os << "\t\t--in : the SAM/BAM file to calculate stats for" << std::endl;
+    os << "\t\t--in : the SAM/BAM file to calculate stats for, or an http://, s3://, or file://" << std::endl;
+    os << "\t\t       URL of a BAM file, of which only the blocks needed for --regionList" << std::endl;
+    os << "\t\t       or --unmapped are fetched (cached in $BAM_REMOTE_CACHE)" << std::endl;
+    os << "\t\t  or" << std::endl;
+    os << "\t\t--inList : file listing the SAM/BAM files to calculate stats for, one per line." << std::endl;
+    os << "\t\t           The files are processed several at a time (see --threads)," << std::endl;
+    os << "\t\t           printing the stats of each of them and then the totals." << std::endl;
+    os << "\t\t           Only --basic, --qual, --phred, --maxNumReads (per file)," << std::endl;
+    os << "\t\t           --requiredFlags, and --excludeFlags apply to listed files." << std::endl;
     os << "\tTypes of Statistics that can be generated:" << std::endl;
     os << "\t\t--basic         : Turn on basic statistic generation" << std::endl;
+    os << "\t\t                  Without the other statistics, reads the --in value + \".bfc\"" << std::endl;
+    os << "\t\t                  field cache (see cacheFields) instead if it is up to date." << std::endl;
+    os << "\t\t--idxStats      : Print the number of mapped/unmapped reads for each reference." << std::endl;
+    os << "\t\t                  Read from the bamIndex, reading only the records of" << std::endl;
+    os << "\t\t                  references whose counts are not in the index." << std::endl;
     os << "\t\t--qual          : Generate a count for each quality (displayed as non-phred quality)" << std::endl;
     os << "\t\t--phred         : Generate a count for each quality (displayed as phred quality)" << std::endl;
     os << "\t\t--pBaseQC       : Write per base statistics as Percentages to the specified file. (use - for stdout)" << std::endl;
-    os << "\t\t                  pBaseQC & cBaseQC cannot both be specified." << std::endl;
+    os << "\t\t                  Only one of pBaseQC, cBaseQC, & bBaseQC can be specified." << std::endl;
     os << "\t\t--cBaseQC       : Write per base statistics as Counts to the specified file. (use - for stdout)" << std::endl;
-    os << "\t\t                  pBaseQC & cBaseQC cannot both be specified." << std::endl;
+    os << "\t\t                  Only one of pBaseQC, cBaseQC, & bBaseQC can be specified." << std::endl;
+    os << "\t\t--bBaseQC       : Write per base statistics to the specified file in an indexed binary" << std::endl;
+    os << "\t\t                  format, which 'bam baseQC' converts to pBaseQC/cBaseQC text" << std::endl;
+    os << "\t\t                  for all or a region of the positions." << std::endl;
+    os << "\t\t                  Only one of pBaseQC, cBaseQC, & bBaseQC can be specified." << std::endl;
     os << "\tOptional Parameters:" << std::endl;
     os << "\t\t--maxNumReads   : Maximum number of reads to process" << std::endl;
     os << "\t\t                  Defaults to -1 to indicate all reads." << std::endl;
+    os << "\t\t--sample        : Quickly estimate the --basic, --qual, and --phred stats, with 95%" << std::endl;
+    os << "\t\t                  confidence intervals, from the reads at this many points spread" << std::endl;
+    os << "\t\t                  evenly over the data of an indexed BAM file plus the unmapped" << std::endl;
+    os << "\t\t                  reads at the end (requires a bamIndex file)." << std::endl;
+    os << "\t\t                  Can't be used with --maxNumReads, --unmapped, --regionList, or baseQC." << std::endl;
+    os << "\t\t--sampleReads   : Number of reads to read at each --sample point." << std::endl;
+    os << "\t\t                  Default: " << DEFAULT_SAMPLE_READS << std::endl;
     os << "\t\t--unmapped      : Only process unmapped reads (requires a bamIndex file)" << std::endl;
     os << "\t\t--bamIndex      : The path/name of the bam index file" << std::endl;
     os << "\t\t                  (if required and not specified, uses the --in value + \".bai\")" << std::endl;
@@ -76,6 +116,7 @@ void Stats::printUsage(std::ostream& os)
     os << "\t\t                  Default: " << PileupHelper::DEFAULT_WINDOW_SIZE << std::endl;
     os << "\t\t--minMapQual    : The minimum mapping quality for filtering reads in the baseQC stats." << std::endl;
     os << "\t\t--dbsnp         : The dbSnp file of positions to exclude from baseQC analysis." << std::endl;
+    os << "\t\t                  (text, or a bitmap from 'bam indexSites')" << std::endl;
     os << std::endl;
 }
 
@@ -84,23 +125,28 @@ int Stats::execute(int argc, char **argv)
 {
     // Extract command line arguments.
     String inFile = "";
+    String inList = "";
     String indexFile = "";
     bool basic = false;
+    bool idxStats = false;
     bool noeof = false;
     bool params = false;
     bool qual = false;
     bool phred = false;
     int maxNumReads = -1;
+    int sample = 0;
+    int sampleReads = DEFAULT_SAMPLE_READS;
     bool unmapped = false;
     String pBaseQC = "";
     String cBaseQC = "";
+    String bBaseQC = "";
     String regionList = "";
     int excludeFlags = 0;
     int requiredFlags = 0;
     bool withinRegion = false;
     int minMapQual = 0;
     String dbsnp = "";
-    PosList *dbsnpListPtr = NULL;
+    KnownSites *dbsnpListPtr = NULL;
     bool baseSum = false;
     int bufferSize = PileupHelper::DEFAULT_WINDOW_SIZE;
 
@@ -108,14 +154,19 @@ int Stats::execute(int argc, char **argv)
     BEGIN_LONG_PARAMETERS(longParameterList)
         LONG_PARAMETER_GROUP("Required Parameters")
         LONG_STRINGPARAMETER("in", &inFile)
+        LONG_STRINGPARAMETER("inList", &inList)
         LONG_PARAMETER_GROUP("Types of Statistics")
         LONG_PARAMETER("basic", &basic)
+        LONG_PARAMETER("idxStats", &idxStats)
         LONG_PARAMETER("qual", &qual)
         LONG_PARAMETER("phred", &phred)
         LONG_STRINGPARAMETER("pBaseQC", &pBaseQC)
         LONG_STRINGPARAMETER("cBaseQC", &cBaseQC)
+        LONG_STRINGPARAMETER("bBaseQC", &bBaseQC)
         LONG_PARAMETER_GROUP("Optional Parameters")
         LONG_INTPARAMETER("maxNumReads", &maxNumReads)
+        LONG_INTPARAMETER("sample", &sample)
+        LONG_INTPARAMETER("sampleReads", &sampleReads)
         LONG_PARAMETER("unmapped", &unmapped)
         LONG_STRINGPARAMETER("bamIndex", &indexFile)
         LONG_STRINGPARAMETER("regionList", &regionList)
@@ -147,6 +198,32 @@ int Stats::execute(int argc, char **argv)
         BgzfFileType::setRequireEofBlock(false);
     }
 
+    if(inList != "")
+    {
+        if((inFile != "") || idxStats || unmapped || !regionList.IsEmpty() ||
+           !indexFile.IsEmpty() || !pBaseQC.IsEmpty() ||
+           !cBaseQC.IsEmpty() || !bBaseQC.IsEmpty() || baseSum ||
+           withinRegion || (sample > 0))
+        {
+            printUsage(std::cerr);
+            inputParameters.Status();
+            std::cerr << "--inList cannot be used with --in or with the "
+                      << "index, region, sample, or baseQC parameters" << std::endl;
+            return(-1);
+        }
+        if(params)
+        {
+            inputParameters.Status();
+        }
+        myQualStats = qual || phred;
+        myWithinRegion = false;
+        myPhred = phred;
+        myQualExcludeClips = excludeFlags & SamFlag::UNMAPPED;
+        myRequiredFlags = requiredFlags;
+        myExcludeFlags = excludeFlags;
+        return(statsList(inList, basic, qual, phred, maxNumReads));
+    }
+
     // Check to see if the in file was specified, if not, report an error.
     if(inFile == "")
     {
@@ -158,8 +235,44 @@ int Stats::execute(int argc, char **argv)
         return(-1);
     }
 
-    // Use the index file if unmapped or regionList is not empty.
-    bool useIndex = (unmapped|| (!regionList.IsEmpty()));
+    if((sample > 0) && 
+       ((maxNumReads >= 0) || unmapped || !regionList.IsEmpty() ||
+        !pBaseQC.IsEmpty() || !cBaseQC.IsEmpty() || !bBaseQC.IsEmpty() ||
+        baseSum || (sampleReads <= 0)))
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        std::cerr << "--sample cannot be used with --maxNumReads, --unmapped, "
+                  << "--regionList, or the baseQC parameters, and requires "
+                  << "a positive --sampleReads" << std::endl;
+        return(-1);
+    }
+
+    // Use the index file if unmapped, sample, or regionList is not empty.
+    bool useIndex = (unmapped|| (!regionList.IsEmpty()) || (sample > 0));
+
+    // Only fetch the parts of a remote file needed for the regions.
+    if(RemoteFile::isRemote(inFile.c_str()))
+    {
+        std::vector<RemoteBamCache::Region> regions;
+        if(unmapped)
+        {
+            regions.push_back(RemoteBamCache::Region("*"));
+        }
+        if(!regionList.IsEmpty() &&
+           !RemoteBamCache::readRegionFile(regionList.c_str(), regions))
+        {
+            return(-1);
+        }
+        std::string localIn = inFile.c_str();
+        std::string localIndex = indexFile.c_str();
+        if(!RemoteBamCache::localize(localIn, localIndex, regions))
+        {
+            return(-1);
+        }
+        inFile = localIn.c_str();
+        indexFile = localIndex.c_str();
+    }
 
     // IndexFile is required, so check to see if it has been set.
     if(useIndex && (indexFile == ""))
@@ -170,19 +283,26 @@ int Stats::execute(int argc, char **argv)
     }
     ////////////////////////////////////////
     // Setup in case pileup is used.
-    Pileup<PileupElementBaseQCStats> pileup(bufferSize);
+    BaseQCPileup pileup(bufferSize);
     // Initialize start/end positions.
     myStartPos = 0;
     myEndPos = -1;
     
     // Open the output qc file if applicable.
     IFILE baseQCPtr = NULL;
-    if(!pBaseQC.IsEmpty() && !cBaseQC.IsEmpty())
+    if((!pBaseQC.IsEmpty() + !cBaseQC.IsEmpty() + !bBaseQC.IsEmpty()) > 1)
     {
         printUsage(std::cerr);
         inputParameters.Status();
-        // Cannot specify both types of baseQC.
-        std::cerr << "Cannot specify both --pBaseQC & --cBaseQC." << std::endl;
+        // Cannot specify more than one type of baseQC.
+        if(bBaseQC.IsEmpty())
+        {
+            std::cerr << "Cannot specify both --pBaseQC & --cBaseQC." << std::endl;
+        }
+        else
+        {
+            std::cerr << "Cannot specify --bBaseQC with --pBaseQC or --cBaseQC." << std::endl;
+        }
         return(-1);
     }
     else if(!pBaseQC.IsEmpty())
@@ -201,7 +321,10 @@ int Stats::execute(int argc, char **argv)
         PileupElementBaseQCStats::setOutputFile(baseQCPtr);
         PileupElementBaseQCStats::printHeader();
     }
-    if((baseQCPtr != NULL) || baseSum)
+    // The binary baseQC file is opened once the references are known.
+    BaseQCFile baseQCBin;
+    bool baseQCOut = (baseQCPtr != NULL) || !bBaseQC.IsEmpty();
+    if(baseQCOut || baseSum)
     {
         PileupElementBaseQCStats::setMapQualFilter(minMapQual);
         PileupElementBaseQCStats::setBaseSum(baseSum);
@@ -212,8 +335,48 @@ int Stats::execute(int argc, char **argv)
         inputParameters.Status();
     }
 
-    // Open the file for reading.
-    SamFile samIn;
+    if(idxStats)
+    {
+        int status = printIndexStats(inFile, indexFile,
+                                     requiredFlags, excludeFlags);
+        if((status != 0) ||
+           !(basic || qual || phred || baseQCOut || baseSum))
+        {
+            // Done, no other statistics to generate.
+            ifclose(baseQCPtr);
+            return(status);
+        }
+    }
+
+    if(sample > 0)
+    {
+        myQualStats = qual || phred;
+        myWithinRegion = false;
+        myQualExcludeClips = excludeFlags & SamFlag::UNMAPPED;
+        myRequiredFlags = requiredFlags;
+        myExcludeFlags = excludeFlags;
+        return(statsBySample(inFile, indexFile, sample, sampleReads,
+                             basic, qual, phred));
+    }
+
+    // The basic statistics only need the flags and read lengths, so
+    // read them from the field cache if there is an up to date one.
+    if(basic && !useIndex && !qual && !phred && !baseQCOut && !baseSum)
+    {
+        FieldCache fieldCache;
+        if(fieldCache.open(FieldCache::getDefaultName(inFile.c_str()).c_str(),
+                           inFile.c_str()))
+        {
+            myRequiredFlags = requiredFlags;
+            myExcludeFlags = excludeFlags;
+            return(statsFromCache(fieldCache, maxNumReads));
+        }
+    }
+
+    // Open the file for reading.  The index and the basic statistics
+    // are only available when read through SamFile.
+    ThreadedSamFile samIn;
+    samIn.setThreadedRead(!useIndex && !basic);
     if(!samIn.OpenForRead(inFile))
     {
         fprintf(stderr, "%s\n", samIn.GetStatusMessage());
@@ -233,6 +396,15 @@ int Stats::execute(int argc, char **argv)
         return(samIn.GetStatus());
     }
 
+    if(!bBaseQC.IsEmpty())
+    {
+        if(!baseQCBin.openForWrite(bBaseQC.c_str(), samHeader))
+        {
+            return(SamStatus::FAIL_IO);
+        }
+        PileupElementBaseQCStats::setBinaryOutput(&baseQCBin);
+    }
+
     // Open the bam index file for reading if we are
     // doing unmapped reads (also set the read section).
     if(useIndex)
@@ -252,74 +424,16 @@ int Stats::execute(int argc, char **argv)
 
     //////////////////////////
     // Read dbsnp if specified and doing baseQC
-    if(((baseQCPtr != NULL) || baseSum) && (!dbsnp.IsEmpty()))
-    {
-        // Read the dbsnp file.
-        IFILE fdbSnp;
-        fdbSnp = ifopen(dbsnp,"r");
-        // Determine how many entries.
-        const SamReferenceInfo& refInfo = samHeader.getReferenceInfo();
-        int maxRefLen = 0;
-        for(int i = 0; i < refInfo.getNumEntries(); i++)
-        {
-            int refLen = refInfo.getReferenceLength(i);
-            if(refLen >= maxRefLen)
-            {
-                maxRefLen = refLen + 1;
-            }
-        }
-        
-        dbsnpListPtr = new PosList(refInfo.getNumEntries(),maxRefLen);
-
-        if(fdbSnp==NULL)
+    if((baseQCOut || baseSum) && (!dbsnp.IsEmpty()))
+    {
+        // Read the dbsnp file, memory mapping it if it was converted
+        // by indexSites.  On failure, no positions are excluded.
+        dbsnpListPtr = new KnownSites();
+        if(!dbsnpListPtr->load(dbsnp.c_str()))
         {
             std::cerr << "Open dbSNP file " << dbsnp.c_str() << " failed!\n";
         }
-        else if(dbsnpListPtr == NULL)
-        {
-            std::cerr << "Failed to init the memory allocation for the dbsnpList.\n";
-        }
-        else
-        {
-            // Read the dbsnp file.
-            StringArray tokens;
-            String buffer;
-            int position = 0;
-            int refID = 0;
-
-            // Loop til the end of the file.
-            while (!ifeof(fdbSnp))
-            {
-                // Read the next line.
-                buffer.ReadLine(fdbSnp);
-                // If it does not have at least 2 columns, 
-                // continue to the next line.
-                if (buffer.IsEmpty() || buffer[0] == '#') continue;
-                tokens.AddTokens(buffer);
-                if(tokens.Length() < 2) continue;
-
-                if(!tokens[1].AsInteger(position))
-                {
-                    std::cerr << "Improperly formatted region line, start position "
-                              << "(2nd column) is not an integer: "
-                              << tokens[1]
-                              << "; Skipping to the next line.\n";         
-                    continue;
-                }
-
-                // Look up the reference name.
-                refID = samHeader.getReferenceID(tokens[0]);
-                if(refID != SamReferenceInfo::NO_REF_ID)
-                {
-                    // Reference id was found, so add it to the dbsnp
-                    dbsnpListPtr->addPosition(refID, position);
-                }
-        
-                tokens.Clear();
-                buffer.Clear();
-            }
-        }
-        ifclose(fdbSnp);
+        dbsnpListPtr->setReference(samHeader);
     }
 
     // Read the sam records.
@@ -330,33 +444,45 @@ int Stats::execute(int argc, char **argv)
     //////////////////////
     // Setup in case doing a quality count.
     // Quality histogram.
-    const int MAX_QUAL = 126;
-    const int START_QUAL = 33;
-    uint64_t qualCount[MAX_QUAL+1];
-    for(int i = 0; i <= MAX_QUAL; i++)
+    QualityCounts qualCounts;
+
+    myQualStats = qual || phred;
+    myWithinRegion = withinRegion;
+    myPhred = phred;
+    myPileupStats = baseQCOut || baseSum;
+    myBufferSize = bufferSize;
+    myDbsnpListPtr = dbsnpListPtr;
+    // Exclude clips from the qual/phred counts if unmapped reads are excluded.
+    myQualExcludeClips = excludeFlags & SamFlag::UNMAPPED;
+    myRequiredFlags = requiredFlags;
+    myExcludeFlags = excludeFlags;
+
+    // Process an indexed BAM on multiple threads if the whole
+    // file is being processed.
+    bool byShard = false;
+    uint64_t numShardReads = 0;
+    if((BamExecutable::getNumThreads() > 1) && !useIndex && 
+       !basic && (maxNumReads < 0))
     {
-        qualCount[i] = 0;
+        SamFile indexCheck(ErrorHandler::RETURN);
+        byShard = indexCheck.OpenForRead(inFile) &&
+            (indexFile.IsEmpty() ? indexCheck.ReadBamIndex() :
+             indexCheck.ReadBamIndex(indexFile));
+        if(!byShard)
+        {
+            std::cerr << "Input is not an indexed BAM file, so calculating stats on one thread.\n";
+        }
     }
-    
-    const int START_PHRED = 0;
-    const int PHRED_DIFF = START_QUAL - START_PHRED;
-    const int MAX_PHRED = MAX_QUAL - PHRED_DIFF;
-    uint64_t phredCount[MAX_PHRED+1];
-    for(int i = 0; i <= MAX_PHRED; i++)
+    if(byShard)
     {
-        phredCount[i] = 0;
+        numShardReads = statsByShard(inFile, indexFile, samHeader,
+                                     baseQCPtr, &baseQCBin, qualCounts);
     }
-    
-    int refPos = 0;
-    Cigar* cigarPtr = NULL;
-    char cigarChar = '?';
-    // Exclude clips from the qual/phred counts if unmapped reads are excluded.
-    bool qualExcludeClips = excludeFlags & SamFlag::UNMAPPED;
 
     //////////////////////////////////
     // When not reading by sections, getNextSection returns true
     // the first time, then false the next time.
-    while(getNextSection(samIn))
+    while(!byShard && getNextSection(samIn))
     {
         // Keep reading records from the file until SamFile::ReadRecord
         // indicates to stop (returns false).
@@ -365,104 +491,13 @@ int Stats::execute(int argc, char **argv)
             // Another record was read, so increment the number of reads.
             ++numReads;
             // See if the quality histogram should be genereated.
-            if(qual || phred)
+            if(myQualStats)
             {
-                // Get the quality.
-                const char* qual = samRecord.getQuality();
-                // Check for no quality ('*').
-                if((qual[0] == '*') && (qual[1] == 0))
-                {
-                    // This record does not have a quality string, so no 
-                    // quality processing is necessary.
-                }
-                else
-                {
-                    int index = 0;
-                    cigarPtr = samRecord.getCigarInfo();
-                    cigarChar = '?';
-                    refPos = samRecord.get0BasedPosition();
-                    if(!qualExcludeClips && (cigarPtr != NULL))
-                    {
-                        // Offset the reference position by any soft clips
-                        // by subtracting the queryIndex of this start position.
-                        // refPos is now the start position of the clips.
-                        refPos -= cigarPtr->getQueryIndex(0);
-                    }
-
-                    while(qual[index] != 0)
-                    {
-                        // Skip this quality if it is clipped and we are skipping clips.
-                        if(cigarPtr != NULL)
-                        {
-                            cigarChar = cigarPtr->getCigarCharOpFromQueryIndex(index);
-                        }
-                        if(qualExcludeClips && Cigar::isClip(cigarChar))
-                        {
-                            // Skip a clipped quality.
-                            ++index;
-                            // Increment the position.
-                            continue;
-                        }
-
-                        if(withinRegion && (myEndPos != -1) && (refPos >= myEndPos))
-                        {
-                            // We have hit the end of the region, stop processing this
-                            // quality string.
-                            break;
-                        }
-
-                        if(withinRegion && (refPos < myStartPos))
-                        {
-                            // This position is not in the target.
-                            ++index;
-                            // Update the position if this is found in the reference or a clip.
-                            if(Cigar::foundInReference(cigarChar) || Cigar::isClip(cigarChar))
-                            {
-                                ++refPos;
-                            }
-                            continue;
-                        }
-
-                        // Check for valid quality.
-                        if((qual[index] < START_QUAL) || (qual[index] > MAX_QUAL))
-                        {
-                            if(qual)
-                            {
-                                std::cerr << "Invalid Quality found: " << qual[index] 
-                                          << ".  Must be between "
-                                          << START_QUAL << " and " << MAX_QUAL << ".\n";
-                            }
-                            if(phred)
-                            {
-                                std::cerr << "Invalid Phred Quality found: " << qual[index] - PHRED_DIFF
-                                          << ".  Must be between "
-                                          << START_QUAL << " and " << MAX_QUAL << ".\n";
-                            }
-                            // Skip an invalid quality.
-                            ++index;
-                            // Update the position if this is found in the reference or a clip.
-                            if(Cigar::foundInReference(cigarChar) || Cigar::isClip(cigarChar))
-                            {
-                                ++refPos;
-                            }
-                            continue;
-                        }
-                        
-                        // Increment the count for this quality.
-                        ++(qualCount[(int)(qual[index])]);
-                        ++(phredCount[(int)(qual[index]) - PHRED_DIFF]);
-                        // Update the position if this is found in the reference or a clip.
-                        if(Cigar::foundInReference(cigarChar) || Cigar::isClip(cigarChar))
-                        {
-                            ++refPos;
-                        }
-                        ++index;
-                    }
-                }
+                countQualities(samRecord, qualCounts, myStartPos, myEndPos);
             }
 
             // Check the next thing to do for the read.
-            if((baseQCPtr != NULL) || baseSum)
+            if(myPileupStats)
             {
                 // Pileup the bases for this read.
                 pileup.processAlignmentRegion(samRecord, myStartPos, myEndPos, dbsnpListPtr);
@@ -475,14 +510,26 @@ int Stats::execute(int argc, char **argv)
         pileup.flushPileup();
     }
 
-    if((baseQCPtr != NULL) || baseSum)
+    if(baseQCOut || baseSum)
     {
         PileupElementBaseQCStats::printSummary();
         ifclose(baseQCPtr);
+        PileupElementBaseQCStats::setBinaryOutput(NULL);
+        if(!bBaseQC.IsEmpty() && !baseQCBin.close())
+        {
+            return(SamStatus::FAIL_IO);
+        }
     }
 
-    std::cerr << "Number of records read = " << 
-        samIn.GetCurrentRecordCount() << std::endl;
+    if(byShard)
+    {
+        std::cerr << "Number of records read = " << numShardReads << std::endl;
+    }
+    else
+    {
+        std::cerr << "Number of records read = " << 
+            samIn.GetCurrentRecordCount() << std::endl;
+    }
 
     if(basic)
     {
@@ -490,39 +537,166 @@ int Stats::execute(int argc, char **argv)
         samIn.PrintStatistics();
     }
 
+    printQualityCounts(qualCounts, qual, phred, std::cerr);
+
+    SamStatus::Status status = samIn.GetStatus();
+    if(byShard || (status == SamStatus::NO_MORE_RECS))
+    {
+        // A status of NO_MORE_RECS means that all reads were successful.
+        status = SamStatus::SUCCESS;
+    }
+
+    return(status);
+}
+
+
+void Stats::printQualityCounts(const QualityCounts& qualCounts, 
+                               bool qual, bool phred, std::ostream& out)
+{
     // Print the quality stats.
     if(qual)
     {
-        std::cerr << std::endl;
-        std::cerr << "Quality\tCount\n";
+        out << std::endl;
+        out << "Quality\tCount\n";
         for(int i = START_QUAL; i <= MAX_QUAL; i++)
         {
-            std::cerr << i << "\t" << qualCount[i] << std::endl;
+            out << i << "\t" << qualCounts.count[i] << std::endl;
         }
     }
     // Print the phred quality stats.
     if(phred)
     {
-        std::cerr << std::endl;
-        std::cerr << "Phred\tCount\n";
+        out << std::endl;
+        out << "Phred\tCount\n";
         for(int i = START_PHRED; i <= MAX_PHRED; i++)
         {
-            std::cerr << i << "\t" << phredCount[i] << std::endl;
+            out << i << "\t" << qualCounts.count[i + PHRED_DIFF] << std::endl;
         }
     }
+}
 
-    SamStatus::Status status = samIn.GetStatus();
-    if(status == SamStatus::NO_MORE_RECS)
+
+int Stats::statsList(const String& inList, bool basic, bool qual, bool phred,
+                     int maxNumReads)
+{
+    FileBatch batch;
+    if(!batch.readList(inList.c_str()))
     {
-        // A status of NO_MORE_RECS means that all reads were successful.
-        status = SamStatus::SUCCESS;
+        return(-1);
     }
 
+    std::vector<FileStats> fileStats(batch.getFiles().size());
+    std::vector<int> statuses(batch.getFiles().size(), SamStatus::SUCCESS);
+    unsigned int numFailed = batch.run([&](unsigned int index,
+                                           const std::string& file,
+                                           std::ostream& out)
+        {
+            FileStats& stats = fileStats[index];
+            statuses[index] = statsFile(file.c_str(), maxNumReads, stats, out);
+            if(statuses[index] == SamStatus::SUCCESS)
+            {
+                if(basic)
+                {
+                    out << std::endl;
+                    stats.basicCounts.print(out);
+                }
+                printQualityCounts(stats.qualCounts, qual, phred, out);
+            }
+            return(statuses[index]);
+        }, std::cerr);
+
+    // The totals include the records read from files that failed.
+    FileStats total;
+    int status = SamStatus::SUCCESS;
+    for(unsigned int i = 0; i < fileStats.size(); i++)
+    {
+        total.numReads += fileStats[i].numReads;
+        total.basicCounts.merge(fileStats[i].basicCounts);
+        total.qualCounts.merge(fileStats[i].qualCounts);
+        if(status == SamStatus::SUCCESS)
+        {
+            status = statuses[i];
+        }
+    }
+    std::cerr << "Totals over " << fileStats.size() << " files:\n";
+    std::cerr << "Number of records read = " << total.numReads << std::endl;
+    if(basic)
+    {
+        std::cerr << std::endl;
+        total.basicCounts.print(std::cerr);
+    }
+    printQualityCounts(total.qualCounts, qual, phred, std::cerr);
+    std::cerr << std::endl;
+    std::cerr << "Number of files = " << fileStats.size() << "\n";
+    std::cerr << "Number of failed files = " << numFailed << "\n";
     return(status);
 }
 
 
-bool Stats::getNextSection(SamFile &samIn)
+int Stats::statsFile(const char* inFile, int maxNumReads, FileStats& stats,
+                     std::ostream& out)
+{
+    // Read on this thread, since the files are processed on the pool.
+    ThreadedSamFile samIn(ErrorHandler::RETURN);
+    samIn.setThreadedRead(false);
+    SamFileHeader samHeader;
+    if(!samIn.OpenForRead(inFile) || !samIn.ReadHeader(samHeader))
+    {
+        out << samIn.GetStatusMessage() << std::endl;
+        return(samIn.GetStatus());
+    }
+    samIn.SetReadFlags(myRequiredFlags, myExcludeFlags);
+
+    SamRecord samRecord;
+    while(((maxNumReads < 0) || (stats.numReads < (uint64_t)maxNumReads)) &&
+          samIn.ReadRecord(samHeader, samRecord))
+    {
+        ++stats.numReads;
+        stats.basicCounts.add(samRecord);
+        if(myQualStats)
+        {
+            countQualities(samRecord, stats.qualCounts, 0, -1);
+        }
+    }
+    out << "Number of records read = " << stats.numReads << std::endl;
+
+    SamStatus::Status status = samIn.GetStatus();
+    if((status != SamStatus::SUCCESS) && (status != SamStatus::NO_MORE_RECS))
+    {
+        out << samIn.GetStatusMessage() << std::endl;
+        return(status);
+    }
+    return(SamStatus::SUCCESS);
+}
+
+
+int Stats::statsFromCache(FieldCache& fieldCache, int maxNumReads)
+{
+    BasicCounts counts;
+    BamRecordView recordView;
+    const char* record = NULL;
+    uint32_t size = 0;
+    while(((maxNumReads < 0) || (counts.numReads < (uint64_t)maxNumReads)) &&
+          fieldCache.next(record, size))
+    {
+        // The cached records are always complete.
+        recordView.set(record, size);
+        uint16_t flag = recordView.getFlag();
+        if(((flag & myRequiredFlags) != myRequiredFlags) ||
+           ((flag & myExcludeFlags) != 0))
+        {
+            continue;
+        }
+        counts.add(flag, recordView.getReadLength());
+    }
+    std::cerr << "Number of records read = " << counts.numReads << std::endl;
+    std::cerr << std::endl;
+    counts.print(std::cerr);
+    return(SamStatus::SUCCESS);
+}
+
+
+bool Stats::getNextSection(ThreadedSamFile &samIn)
 {
     static bool alreadyRead = false;
     if(myRegionList == NULL)
@@ -610,3 +784,909 @@ bool Stats::getNextSection(SamFile &samIn)
 
 
 
+
+
+Stats::QualityCounts::QualityCounts()
+{
+    for(int i = 0; i <= MAX_QUAL; i++)
+    {
+        count[i] = 0;
+    }
+}
+
+
+void Stats::QualityCounts::merge(const QualityCounts& other)
+{
+    for(int i = 0; i <= MAX_QUAL; i++)
+    {
+        count[i] += other.count[i];
+    }
+}
+
+
+Stats::BasicCounts::BasicCounts()
+    : numReads(0),
+      numMapped(0),
+      numPaired(0),
+      numProperPair(0),
+      numDuplicate(0),
+      numQCFailure(0),
+      numBases(0),
+      numMappedBases(0)
+{
+}
+
+
+void Stats::BasicCounts::add(SamRecord& record)
+{
+    add(record.getFlag(), record.getReadLength());
+}
+
+
+void Stats::BasicCounts::add(uint16_t flag, int32_t readLength)
+{
+    ++numReads;
+    numBases += readLength;
+    if(SamFlag::isMapped(flag))
+    {
+        ++numMapped;
+        numMappedBases += readLength;
+    }
+    if(SamFlag::isPaired(flag))
+    {
+        ++numPaired;
+    }
+    if(SamFlag::isProperPair(flag))
+    {
+        ++numProperPair;
+    }
+    if(SamFlag::isDuplicate(flag))
+    {
+        ++numDuplicate;
+    }
+    if(SamFlag::isQCFailure(flag))
+    {
+        ++numQCFailure;
+    }
+}
+
+
+void Stats::BasicCounts::merge(const BasicCounts& other)
+{
+    numReads += other.numReads;
+    numMapped += other.numMapped;
+    numPaired += other.numPaired;
+    numProperPair += other.numProperPair;
+    numDuplicate += other.numDuplicate;
+    numQCFailure += other.numQCFailure;
+    numBases += other.numBases;
+    numMappedBases += other.numMappedBases;
+}
+
+
+void Stats::BasicCounts::print(std::ostream& out) const
+{
+    // Large counts are printed in millions.
+    double divide = 1;
+    std::string units = "";
+    if(numReads >= 1000000)
+    {
+        divide = 1000000;
+        units = "(e6)";
+    }
+    // Percent of the reads, 0 if there are none.
+    double percent = (numReads == 0) ? 0 : 100.0 / numReads;
+
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(2);
+    out << "TotalReads" << units << "\t" << numReads / divide << "\n";
+    out << "MappedReads" << units << "\t" << numMapped / divide << "\n";
+    out << "PairedReads" << units << "\t" << numPaired / divide << "\n";
+    out << "ProperPair" << units << "\t" << numProperPair / divide << "\n";
+    out << "DuplicateReads" << units << "\t" << numDuplicate / divide << "\n";
+    out << "QCFailureReads" << units << "\t" << numQCFailure / divide << "\n";
+    out << "\n";
+    out << "MappingRate(%)\t" << numMapped * percent << "\n";
+    out << "PairedReads(%)\t" << numPaired * percent << "\n";
+    out << "ProperPair(%)\t" << numProperPair * percent << "\n";
+    out << "DupRate(%)\t" << numDuplicate * percent << "\n";
+    out << "QCFailRate(%)\t" << numQCFailure * percent << "\n";
+    out << "\n";
+    out << "TotalBases" << units << "\t" << numBases / divide << "\n";
+    out << "BasesInMappedReads" << units << "\t" << numMappedBases / divide 
+        << std::endl;
+    out.flags(flags);
+    out.precision(precision);
+}
+
+
+void Stats::countQualities(SamRecord& record, QualityCounts& counts,
+                           int32_t startPos, int32_t endPos)
+{
+    // Qualities outside of a region can be counted without the cigar.
+    if(!myWithinRegion && countRawQualities(record, counts))
+    {
+        return;
+    }
+
+    int refPos = 0;
+    Cigar* cigarPtr = NULL;
+    char cigarChar = '?';
+
+    // Get the quality.
+    const char* qual = record.getQuality();
+    // Check for no quality ('*').
+    if((qual[0] == '*') && (qual[1] == 0))
+    {
+        // This record does not have a quality string, so no 
+        // quality processing is necessary.
+    }
+    else
+    {
+        int index = 0;
+        cigarPtr = record.getCigarInfo();
+        cigarChar = '?';
+        refPos = record.get0BasedPosition();
+        if(!myQualExcludeClips && (cigarPtr != NULL))
+        {
+            // Offset the reference position by any soft clips
+            // by subtracting the queryIndex of this start position.
+            // refPos is now the start position of the clips.
+            refPos -= cigarPtr->getQueryIndex(0);
+        }
+
+        while(qual[index] != 0)
+        {
+            // Skip this quality if it is clipped and we are skipping clips.
+            if(cigarPtr != NULL)
+            {
+                cigarChar = cigarPtr->getCigarCharOpFromQueryIndex(index);
+            }
+            if(myQualExcludeClips && Cigar::isClip(cigarChar))
+            {
+                // Skip a clipped quality.
+                ++index;
+                // Increment the position.
+                continue;
+            }
+
+            if(myWithinRegion && (endPos != -1) && (refPos >= endPos))
+            {
+                // We have hit the end of the region, stop processing this
+                // quality string.
+                break;
+            }
+
+            if(myWithinRegion && (refPos < startPos))
+            {
+                // This position is not in the target.
+                ++index;
+                // Update the position if this is found in the reference or a clip.
+                if(Cigar::foundInReference(cigarChar) || Cigar::isClip(cigarChar))
+                {
+                    ++refPos;
+                }
+                continue;
+            }
+
+            // Check for valid quality.
+            if((qual[index] < START_QUAL) || (qual[index] > MAX_QUAL))
+            {
+                if(qual)
+                {
+                    std::cerr << "Invalid Quality found: " << qual[index] 
+                              << ".  Must be between "
+                              << START_QUAL << " and " << MAX_QUAL << ".\n";
+                }
+                if(myPhred)
+                {
+                    std::cerr << "Invalid Phred Quality found: " << qual[index] - PHRED_DIFF
+                              << ".  Must be between "
+                              << START_QUAL << " and " << MAX_QUAL << ".\n";
+                }
+                // Skip an invalid quality.
+                ++index;
+                // Update the position if this is found in the reference or a clip.
+                if(Cigar::foundInReference(cigarChar) || Cigar::isClip(cigarChar))
+                {
+                    ++refPos;
+                }
+                continue;
+            }
+            
+            // Increment the count for this quality.
+            ++(counts.count[(int)(qual[index])]);
+            // Update the position if this is found in the reference or a clip.
+            if(Cigar::foundInReference(cigarChar) || Cigar::isClip(cigarChar))
+            {
+                ++refPos;
+            }
+            ++index;
+        }
+    }
+}
+
+
+bool Stats::countRawQualities(SamRecord& record, QualityCounts& counts)
+{
+    // Get the BAM record buffer, which starts with the block size.
+    const unsigned char* buffer = 
+        (const unsigned char*)record.getRecordBuffer(SamRecord::NONE);
+    if(buffer == NULL)
+    {
+        return(false);
+    }
+    uint8_t readNameLength = buffer[12];
+    uint16_t cigarLength = 0;
+    int32_t readLength = 0;
+    memcpy(&cigarLength, buffer + 16, sizeof(cigarLength));
+    memcpy(&readLength, buffer + 20, sizeof(readLength));
+
+    const unsigned char* cigar = buffer + 36 + readNameLength;
+    const unsigned char* qual = 
+        cigar + (cigarLength * sizeof(uint32_t)) + ((readLength + 1) / 2);
+
+    if((readLength <= 0) || (qual[0] == 0xFF))
+    {
+        // This record does not have a quality string, so no 
+        // quality processing is necessary.
+        return(true);
+    }
+
+    int32_t start = 0;
+    int32_t end = readLength;
+    if(myQualExcludeClips)
+    {
+        // Skip the soft clips at the start & end of the read.
+        uint32_t cigarOp = 0;
+        for(int i = 0; i < cigarLength; i++)
+        {
+            memcpy(&cigarOp, cigar + (i * sizeof(uint32_t)), sizeof(cigarOp));
+            if((cigarOp & 0xF) == BAM_SOFT_CLIP)
+            {
+                start += cigarOp >> 4;
+            }
+            else if((cigarOp & 0xF) != BAM_HARD_CLIP)
+            {
+                break;
+            }
+        }
+        for(int i = cigarLength - 1; i >= 0; i--)
+        {
+            memcpy(&cigarOp, cigar + (i * sizeof(uint32_t)), sizeof(cigarOp));
+            if((cigarOp & 0xF) == BAM_SOFT_CLIP)
+            {
+                end -= cigarOp >> 4;
+            }
+            else if((cigarOp & 0xF) != BAM_HARD_CLIP)
+            {
+                break;
+            }
+        }
+    }
+    if(end <= start)
+    {
+        // All qualities are clipped.
+        return(true);
+    }
+
+    // Raw qualities are phred values, so the largest valid one is MAX_PHRED.
+    // Check them all before counting any.
+    unsigned char maxQual = 0;
+    for(int32_t i = start; i < end; i++)
+    {
+        maxQual = (qual[i] > maxQual) ? qual[i] : maxQual;
+    }
+    if(maxQual > MAX_PHRED)
+    {
+        // Let the caller report the invalid quality.
+        return(false);
+    }
+    for(int32_t i = start; i < end; i++)
+    {
+        ++(counts.count[qual[i] + PHRED_DIFF]);
+    }
+    return(true);
+}
+
+
+int Stats::printIndexStats(const String& inFile, const String& indexFile,
+                           int requiredFlags, int excludeFlags)
+{
+    SamFile samIn;
+    SamFileHeader header;
+    if(!samIn.OpenForRead(inFile) || !samIn.ReadHeader(header))
+    {
+        fprintf(stderr, "%s\n", samIn.GetStatusMessage());
+        return(samIn.GetStatus());
+    }
+    if(!(indexFile.IsEmpty() ? samIn.ReadBamIndex() : 
+         samIn.ReadBamIndex(indexFile)))
+    {
+        fprintf(stderr, "%s\n", samIn.GetStatusMessage());
+        std::cerr << "--idxStats requires a BAM file with an index.\n";
+        return(samIn.GetStatus());
+    }
+    samIn.SetReadFlags(requiredFlags, excludeFlags);
+
+    // The index counts include all records, so they cannot be used
+    // if records are being filtered.
+    bool useIndexCounts = (requiredFlags == 0) && (excludeFlags == 0);
+    int numScanned = 0;
+
+    const SamReferenceInfo& refInfo = header.getReferenceInfo();
+    int numRefs = refInfo.getNumEntries();
+
+    std::cerr << "Reference\tLength\tMapped\tUnmapped\n";
+    // Reads without a coordinate (refID -1) are printed last.
+    for(int i = 0; i <= numRefs; i++)
+    {
+        int32_t refID = (i == numRefs) ? -1 : i;
+        int64_t numMapped = -1;
+        int64_t numUnmapped = -1;
+        if(useIndexCounts)
+        {
+            numMapped = (refID == -1) ? 0 :
+                samIn.getNumMappedReadsFromIndex(refID);
+            numUnmapped = samIn.getNumUnMappedReadsFromIndex(refID);
+        }
+
+        if((numMapped < 0) || (numUnmapped < 0))
+        {
+            // Not in the index, so read the records.
+            ++numScanned;
+            numMapped = 0;
+            numUnmapped = 0;
+            SamRecord record;
+            samIn.SetReadSection(refID);
+            while(samIn.ReadRecord(header, record))
+            {
+                if(SamFlag::isMapped(record.getFlag()))
+                {
+                    ++numMapped;
+                }
+                else
+                {
+                    ++numUnmapped;
+                }
+            }
+            if(samIn.GetStatus() != SamStatus::NO_MORE_RECS)
+            {
+                fprintf(stderr, "%s\n", samIn.GetStatusMessage());
+                return(samIn.GetStatus());
+            }
+        }
+
+        if(refID == -1)
+        {
+            std::cerr << "*\t0";
+        }
+        else
+        {
+            std::cerr << refInfo.getReferenceName(refID) << "\t"
+                      << refInfo.getReferenceLength(refID);
+        }
+        std::cerr << "\t" << numMapped << "\t" << numUnmapped << "\n";
+    }
+
+    if(numScanned != 0)
+    {
+        std::cerr << "Read the records of " << numScanned
+                  << " reference(s) whose counts were not in the index.\n";
+    }
+    std::cerr << std::endl;
+    return(0);
+}
+
+
+uint64_t Stats::statsByShard(const String& inFile, const String& indexFile,
+                             SamFileHeader& header, IFILE baseQCPtr,
+                             BaseQCFile* baseQCBin,
+                             QualityCounts& qualCounts)
+{
+    // Split each reference into shards, then add one for the reads
+    // without a reference.
+    std::vector<Shard> shards;
+    const SamReferenceInfo& refInfo = header.getReferenceInfo();
+    for(int refID = 0; refID < refInfo.getNumEntries(); refID++)
+    {
+        int32_t refLen = refInfo.getReferenceLength(refID);
+        int32_t start = 0;
+        for(; (start + SHARD_SIZE) < refLen; start += SHARD_SIZE)
+        {
+            shards.push_back(Shard(refID, start, start + SHARD_SIZE));
+        }
+        // The last shard goes to the end of the reference.
+        shards.push_back(Shard(refID, start, -1));
+    }
+    shards.push_back(Shard(-1, 0, -1));
+
+    // Workers process the next shard that has not been started, but
+    // do not get more than maxAhead shards ahead of the results that have
+    // been written, so the per base output held in memory is bounded.
+    int numWorkers = BamExecutable::getNumThreads();
+    unsigned int maxAhead = 2 * numWorkers;
+    std::mutex shardLock;
+    std::condition_variable shardCond;
+    unsigned int nextShard = 0;
+    unsigned int numWritten = 0;
+    std::vector<bool> done(shards.size(), false);
+    bool failed = false;
+
+    std::vector< std::future<void> > workers;
+    for(int w = 0; w < numWorkers; w++)
+    {
+        workers.push_back(BamExecutable::getThreadPool().submit([&]()
+            {
+                try
+                {
+                    SamFile samIn;
+                    SamFileHeader shardHeader;
+                    samIn.OpenForRead(inFile, &shardHeader);
+                    if(indexFile.IsEmpty())
+                    {
+                        samIn.ReadBamIndex();
+                    }
+                    else
+                    {
+                        samIn.ReadBamIndex(indexFile);
+                    }
+                    samIn.SetReadFlags(myRequiredFlags, myExcludeFlags);
+                    while(true)
+                    {
+                        unsigned int shard;
+                        {
+                            std::unique_lock<std::mutex> guard(shardLock);
+                            shardCond.wait(guard, [&]()
+                                           { return(failed || 
+                                                    (nextShard < numWritten + maxAhead)); });
+                            if(failed || (nextShard >= shards.size()))
+                            {
+                                return;
+                            }
+                            shard = nextShard++;
+                        }
+                        processShard(samIn, shardHeader, shards[shard]);
+                        std::lock_guard<std::mutex> guard(shardLock);
+                        done[shard] = true;
+                        shardCond.notify_all();
+                    }
+                }
+                catch(...)
+                {
+                    std::lock_guard<std::mutex> guard(shardLock);
+                    failed = true;
+                    shardCond.notify_all();
+                    throw;
+                }
+            }));
+    }
+
+    // Add the results of each shard in order.
+    uint64_t numReads = 0;
+    for(unsigned int i = 0; i < shards.size(); i++)
+    {
+        {
+            std::unique_lock<std::mutex> guard(shardLock);
+            shardCond.wait(guard, [&]() { return(failed || done[i]); });
+            if(failed)
+            {
+                break;
+            }
+        }
+        Shard& shard = shards[i];
+        if((baseQCPtr != NULL) && !shard.baseQC.empty())
+        {
+            ifwrite(baseQCPtr, shard.baseQC.c_str(), shard.baseQC.size());
+        }
+        else if(PileupElementBaseQCStats::hasBinaryOutput())
+        {
+            baseQCBin->addPackedRows(shard.baseQC);
+        }
+        std::string().swap(shard.baseQC);
+        PileupElementBaseQCStats::getSummary().merge(shard.summary);
+        qualCounts.merge(shard.qualCounts);
+        numReads += shard.numReads;
+
+        std::lock_guard<std::mutex> guard(shardLock);
+        ++numWritten;
+        shardCond.notify_all();
+    }
+
+    // Wait for the workers, rethrowing any failure.
+    for(unsigned int i = 0; i < workers.size(); i++)
+    {
+        workers[i].wait();
+    }
+    for(unsigned int i = 0; i < workers.size(); i++)
+    {
+        workers[i].get();
+    }
+    return(numReads);
+}
+
+
+void Stats::processShard(SamFile& samIn, SamFileHeader& header, Shard& shard)
+{
+    if(shard.refID == -1)
+    {
+        samIn.SetReadSection(-1);
+    }
+    else
+    {
+        samIn.SetReadSection(shard.refID, shard.start, shard.end);
+    }
+
+    // Per base stats for this shard go to the shard's results.
+    BaseQCPileup pileup(myBufferSize);
+    PileupElementBaseQCStats::setThreadOutput(&shard.baseQC, &shard.summary);
+
+    SamRecord samRecord;
+    while(samIn.ReadRecord(header, samRecord))
+    {
+        // Reads that start before this shard were counted by an earlier
+        // shard, only the part of them in this shard is piled up.
+        if((shard.refID == -1) || (samRecord.get0BasedPosition() >= shard.start))
+        {
+            ++shard.numReads;
+            if(myQualStats)
+            {
+                countQualities(samRecord, shard.qualCounts, 0, -1);
+            }
+        }
+        if(myPileupStats)
+        {
+            pileup.processAlignmentRegion(samRecord, shard.start, shard.end,
+                                          myDbsnpListPtr);
+        }
+    }
+    pileup.flushPileup();
+    PileupElementBaseQCStats::setThreadOutput(NULL, NULL);
+
+    if(samIn.GetStatus() != SamStatus::NO_MORE_RECS)
+    {
+        throw(std::runtime_error(samIn.GetStatusMessage()));
+    }
+}
+
+
+int Stats::statsBySample(const String& inFile, const String& indexFile,
+                         int numSamples, int sampleReads,
+                         bool basic, bool qual, bool phred)
+{
+    SamFile samIn(ErrorHandler::RETURN);
+    SamFileHeader header;
+    if(!samIn.OpenForRead(inFile) || !samIn.ReadHeader(header) ||
+       !samIn.ReadBamIndex(indexFile))
+    {
+        fprintf(stderr, "%s\n", samIn.GetStatusMessage());
+        std::cerr << "--sample requires a BAM file with an index.\n";
+        return(-1);
+    }
+    const SamReferenceInfo& refInfo = header.getReferenceInfo();
+    int numRefs = refInfo.getNumEntries();
+
+    // Sample at the start of shards with about the same amount of data,
+    // so each sampled read stands for about the same number of records.
+    std::vector<BalancedShards::Shard> shards;
+    if(!BalancedShards::plan(inFile.c_str(), indexFile.c_str(), numRefs,
+                             numSamples, shards))
+    {
+        std::cerr << "--sample requires a BAM file with a BAI index.\n";
+        return(-1);
+    }
+
+    // The mapped reads and the unmapped reads at the end of the file are
+    // sampled separately and weighted by their counts in the index.
+    enum {MAPPED_STRATUM, UNMAPPED_STRATUM, NUM_STRATA};
+    std::vector<SampleStratum> strata(NUM_STRATA);
+    int64_t numMappedRecords = 0;
+    for(int refID = 0; (refID < numRefs) && (numMappedRecords >= 0); refID++)
+    {
+        int64_t numMapped = samIn.getNumMappedReadsFromIndex(refID);
+        int64_t numUnmapped = samIn.getNumUnMappedReadsFromIndex(refID);
+        numMappedRecords = ((numMapped < 0) || (numUnmapped < 0)) ? -1 :
+            numMappedRecords + numMapped + numUnmapped;
+    }
+    strata[MAPPED_STRATUM].numRecords = numMappedRecords;
+    strata[UNMAPPED_STRATUM].numRecords = 
+        samIn.getNumUnMappedReadsFromIndex(-1);
+    if((strata[MAPPED_STRATUM].numRecords < 0) || 
+       (strata[UNMAPPED_STRATUM].numRecords < 0))
+    {
+        // Without the counts, the sampled reads are not weighted.
+        strata[MAPPED_STRATUM].numRecords = -1;
+        strata[UNMAPPED_STRATUM].numRecords = -1;
+    }
+    samIn.Close();
+
+    // A cluster per shard, then the clusters of the unmapped reads.
+    std::vector<SampleCluster>& mappedClusters = 
+        strata[MAPPED_STRATUM].clusters;
+    std::vector<SampleCluster>& unmappedClusters = 
+        strata[UNMAPPED_STRATUM].clusters;
+    mappedClusters.resize(shards.size());
+    std::atomic<unsigned int> nextSample(0);
+    int numWorkers = getNumThreads();
+    if(numWorkers > (int)shards.size() + 1)
+    {
+        numWorkers = shards.size() + 1;
+    }
+    try
+    {
+        runWorkers([&]()
+            {
+                SamFile sampleIn;
+                SamFileHeader sampleHeader;
+                sampleIn.OpenForRead(inFile, &sampleHeader);
+                sampleIn.ReadBamIndex(indexFile);
+                sampleIn.SetReadFlags(myRequiredFlags, myExcludeFlags);
+                SamRecord samRecord;
+                unsigned int sample;
+                while((sample = nextSample++) <= shards.size())
+                {
+                    int numRead = 0;
+                    if(sample == shards.size())
+                    {
+                        // The unmapped reads at the end of the file.
+                        sampleIn.SetReadSection(-1);
+                        while((numRead < sampleReads) && 
+                              sampleIn.ReadRecord(sampleHeader, samRecord))
+                        {
+                            if((numRead % SAMPLE_CLUSTER_READS) == 0)
+                            {
+                                unmappedClusters.push_back(SampleCluster());
+                            }
+                            ++numRead;
+                            SampleCluster& cluster = unmappedClusters.back();
+                            cluster.basicCounts.add(samRecord);
+                            if(myQualStats)
+                            {
+                                countQualities(samRecord, cluster.qualCounts,
+                                               0, -1);
+                            }
+                        }
+                    }
+                    else
+                    {
+                        const std::vector<BalancedShards::Region>& regions =
+                            shards[sample].regions;
+                        SampleCluster& cluster = mappedClusters[sample];
+                        for(unsigned int i = 0; 
+                            (i < regions.size()) && (numRead < sampleReads); i++)
+                        {
+                            const BalancedShards::Region& region = regions[i];
+                            if(region.refID < 0)
+                            {
+                                // Sampled separately.
+                                continue;
+                            }
+                            sampleIn.SetReadSection(region.refID, region.start,
+                                                    region.end);
+                            while((numRead < sampleReads) && 
+                                  sampleIn.ReadRecord(sampleHeader, samRecord))
+                            {
+                                // Records overlapping the start of the region
+                                // are in the previous shard.
+                                if(samRecord.get0BasedPosition() < region.start)
+                                {
+                                    continue;
+                                }
+                                ++numRead;
+                                cluster.basicCounts.add(samRecord);
+                                if(myQualStats)
+                                {
+                                    countQualities(samRecord, cluster.qualCounts,
+                                                   0, -1);
+                                }
+                            }
+                        }
+                    }
+                    SamStatus::Status status = sampleIn.GetStatus();
+                    if((status != SamStatus::SUCCESS) && 
+                       (status != SamStatus::NO_MORE_RECS))
+                    {
+                        throw(std::runtime_error(sampleIn.GetStatusMessage()));
+                    }
+                }
+            }, numWorkers);
+    }
+    catch(std::exception& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return(-1);
+    }
+
+    // The sampled counts.
+    SampleCluster total;
+    for(unsigned int s = 0; s < strata.size(); s++)
+    {
+        for(unsigned int i = 0; i < strata[s].clusters.size(); i++)
+        {
+            strata[s].numReads += 
+                strata[s].clusters[i].basicCounts.numReads;
+            total.basicCounts.merge(strata[s].clusters[i].basicCounts);
+            total.qualCounts.merge(strata[s].clusters[i].qualCounts);
+        }
+    }
+    std::cerr << "Number of records read = " << total.basicCounts.numReads
+              << std::endl;
+    if(basic)
+    {
+        std::cerr << std::endl;
+        total.basicCounts.print(std::cerr);
+    }
+    printQualityCounts(total.qualCounts, qual, phred, std::cerr);
+
+    std::cerr << std::endl;
+    std::cerr << "Sampled " << total.basicCounts.numReads << " ";
+    if(strata[MAPPED_STRATUM].numRecords >= 0)
+    {
+        std::cerr << "of " << (strata[MAPPED_STRATUM].numRecords + 
+                               strata[UNMAPPED_STRATUM].numRecords) << " ";
+    }
+    std::cerr << "records at " << shards.size() << " points and "
+              << strata[UNMAPPED_STRATUM].numReads 
+              << " unmapped records at the end of the file.\n";
+    std::cerr << "Estimate\tValue\t95%CILower\t95%CIUpper\n";
+    SampleValue reads = [](const SampleCluster& c) 
+        { return((double)c.basicCounts.numReads); };
+    if(basic)
+    {
+        printEstimate("MappingRate(%)", strata, 
+                      [](const SampleCluster& c) 
+                      { return((double)c.basicCounts.numMapped); },
+                      reads, 100, 100, std::cerr);
+        printEstimate("PairedReads(%)", strata, 
+                      [](const SampleCluster& c) 
+                      { return((double)c.basicCounts.numPaired); },
+                      reads, 100, 100, std::cerr);
+        printEstimate("ProperPair(%)", strata, 
+                      [](const SampleCluster& c) 
+                      { return((double)c.basicCounts.numProperPair); },
+                      reads, 100, 100, std::cerr);
+        printEstimate("DupRate(%)", strata, 
+                      [](const SampleCluster& c) 
+                      { return((double)c.basicCounts.numDuplicate); },
+                      reads, 100, 100, std::cerr);
+        printEstimate("QCFailRate(%)", strata, 
+                      [](const SampleCluster& c) 
+                      { return((double)c.basicCounts.numQCFailure); },
+                      reads, 100, 100, std::cerr);
+        printEstimate("MeanReadLength", strata, 
+                      [](const SampleCluster& c) 
+                      { return((double)c.basicCounts.numBases); },
+                      reads, 1, HUGE_VAL, std::cerr);
+    }
+    if(myQualStats)
+    {
+        SampleValue quals = [](const SampleCluster& c) 
+            {
+                double numQuals = 0;
+                for(int i = START_QUAL; i <= MAX_QUAL; i++)
+                {
+                    numQuals += c.qualCounts.count[i];
+                }
+                return(numQuals);
+            };
+        printEstimate("MeanPhred", strata, 
+                      [](const SampleCluster& c) 
+                      {
+                          double sum = 0;
+                          for(int i = START_QUAL; i <= MAX_QUAL; i++)
+                          {
+                              sum += (double)(i - PHRED_DIFF) * 
+                                  c.qualCounts.count[i];
+                          }
+                          return(sum);
+                      },
+                      quals, 1, MAX_PHRED, std::cerr);
+        printEstimate("Q30Bases(%)", strata, 
+                      [](const SampleCluster& c) 
+                      {
+                          double numHigh = 0;
+                          for(int i = SAMPLE_HIGH_PHRED + PHRED_DIFF; 
+                              i <= MAX_QUAL; i++)
+                          {
+                              numHigh += c.qualCounts.count[i];
+                          }
+                          return(numHigh);
+                      },
+                      quals, 100, 100, std::cerr);
+    }
+    return(0);
+}
+
+
+double Stats::estimateRatio(const std::vector<SampleStratum>& strata,
+                            const SampleValue& value,
+                            const SampleValue& base, double& halfWidth)
+{
+    // Combined ratio estimate of the stratified totals.
+    std::vector<double> weights(strata.size(), 1);
+    double valueTotal = 0;
+    double baseTotal = 0;
+    for(unsigned int s = 0; s < strata.size(); s++)
+    {
+        const SampleStratum& stratum = strata[s];
+        if((stratum.numRecords >= 0) && (stratum.numReads > 0))
+        {
+            weights[s] = (double)stratum.numRecords / stratum.numReads;
+        }
+        for(unsigned int i = 0; i < stratum.clusters.size(); i++)
+        {
+            valueTotal += weights[s] * value(stratum.clusters[i]);
+            baseTotal += weights[s] * base(stratum.clusters[i]);
+        }
+    }
+    halfWidth = -1;
+    if(baseTotal <= 0)
+    {
+        return(-1);
+    }
+    double ratio = valueTotal / baseTotal;
+
+    // Linearized variance, treating the clusters of each stratum as
+    // sampled with replacement.
+    double variance = 0;
+    for(unsigned int s = 0; s < strata.size(); s++)
+    {
+        const std::vector<SampleCluster>& clusters = strata[s].clusters;
+        if(strata[s].numReads == 0)
+        {
+            continue;
+        }
+        if(clusters.size() < 2)
+        {
+            // The variance of the stratum is unknown.
+            return(ratio);
+        }
+        std::vector<double> residuals(clusters.size());
+        double mean = 0;
+        for(unsigned int i = 0; i < clusters.size(); i++)
+        {
+            residuals[i] = value(clusters[i]) - ratio * base(clusters[i]);
+            mean += residuals[i] / clusters.size();
+        }
+        double sumSquares = 0;
+        for(unsigned int i = 0; i < clusters.size(); i++)
+        {
+            sumSquares += (residuals[i] - mean) * (residuals[i] - mean);
+        }
+        variance += weights[s] * weights[s] * sumSquares * 
+            clusters.size() / (clusters.size() - 1);
+    }
+    halfWidth = 1.96 * sqrt(variance) / baseTotal;
+    return(ratio);
+}
+
+
+void Stats::printEstimate(const char* name,
+                          const std::vector<SampleStratum>& strata,
+                          const SampleValue& value, const SampleValue& base,
+                          double scale, double maxValue, std::ostream& out)
+{
+    double halfWidth = -1;
+    double estimate = estimateRatio(strata, value, base, halfWidth);
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(2);
+    out << name << "\t";
+    if(estimate < 0)
+    {
+        out << "NA\tNA\tNA\n";
+    }
+    else if(halfWidth < 0)
+    {
+        out << estimate * scale << "\tNA\tNA\n";
+    }
+    else
+    {
+        out << estimate * scale << "\t"
+            << std::max(0.0, (estimate - halfWidth) * scale) << "\t"
+            << std::min(maxValue, (estimate + halfWidth) * scale) << "\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -22,8 +22,15 @@
 #ifndef __STATS_H__
 #define __STATS_H__
 
+#include <functional>
+#include <string>
+#include <vector>
+
 #include "BamExecutable.h"
-#include "SamFile.h"
+#include "ThreadedSamFile.h"
+#include "FieldCache.h"
+#include "PileupElementBaseQCStats.h"
+#include "KnownSites.h"
 
 class Stats : public BamExecutable
 {
@@ -35,7 +42,188 @@ public:
     virtual const char* getProgramName() {return("bam:stats");}
 
 private:
-    bool getNextSection(SamFile& samIn);
+    // Size of the regions processed on separate threads.
+    static const int32_t SHARD_SIZE = 1000000;
+
+    static const int MAX_QUAL = 126;
+    static const int START_QUAL = 33;
+    static const int START_PHRED = 0;
+    static const int PHRED_DIFF = START_QUAL - START_PHRED;
+    static const int MAX_PHRED = MAX_QUAL - PHRED_DIFF;
+
+    // Count of each quality, the phred quality counts are offset by
+    // PHRED_DIFF.
+    struct QualityCounts
+    {
+        uint64_t count[MAX_QUAL+1];
+        QualityCounts();
+        void merge(const QualityCounts& other);
+    };
+
+    // Counts of the reads for --basic, in the same format as 
+    // SamFile::PrintStatistics, that can be added up over several files.
+    struct BasicCounts
+    {
+        uint64_t numReads;
+        uint64_t numMapped;
+        uint64_t numPaired;
+        uint64_t numProperPair;
+        uint64_t numDuplicate;
+        uint64_t numQCFailure;
+        uint64_t numBases;
+        uint64_t numMappedBases;
+        BasicCounts();
+        void add(SamRecord& record);
+        void add(uint16_t flag, int32_t readLength);
+        void merge(const BasicCounts& other);
+        void print(std::ostream& out) const;
+    };
+
+    // Results of one of the files of --inList.
+    struct FileStats
+    {
+        uint64_t numReads;
+        BasicCounts basicCounts;
+        QualityCounts qualCounts;
+        FileStats() : numReads(0) {}
+    };
+
+    // Cigar operations in the BAM record buffer.
+    static const uint32_t BAM_SOFT_CLIP = 4;
+    static const uint32_t BAM_HARD_CLIP = 5;
+
+    // Region of the file processed on one thread and its results.
+    struct Shard
+    {
+        int32_t refID;
+        int32_t start;
+        // -1 for the end of the reference.
+        int32_t end;
+        uint64_t numReads;
+        QualityCounts qualCounts;
+        // Text rows, or packed rows for a binary baseQC file.
+        std::string baseQC;
+        PileupElementBaseQCStats::Summary summary;
+        Shard(int32_t ref, int32_t startPos, int32_t endPos)
+            : refID(ref), start(startPos), end(endPos), numReads(0) {}
+    };
+
+    // Records read at each sample point for --sample by default.
+    static const int DEFAULT_SAMPLE_READS = 1000;
+    // The unmapped reads at the end of the file are sampled at one
+    // point, so they are split into clusters of this many reads to
+    // estimate the variance.
+    static const uint64_t SAMPLE_CLUSTER_READS = 100;
+    // Quality (phred) counted by Q30Bases.
+    static const int SAMPLE_HIGH_PHRED = 30;
+
+    // Counts of a cluster of reads sampled for --sample.
+    struct SampleCluster
+    {
+        BasicCounts basicCounts;
+        QualityCounts qualCounts;
+    };
+
+    // The clusters sampled from a part of the file (the mapped reads or
+    // the unmapped reads at the end), which are weighted by the number
+    // of records in the part per sampled read.
+    struct SampleStratum
+    {
+        std::vector<SampleCluster> clusters;
+        uint64_t numReads;
+        // Records in the part from the index, -1 if not in the index.
+        int64_t numRecords;
+        SampleStratum() : clusters(), numReads(0), numRecords(-1) {}
+    };
+
+    typedef std::function<double(const SampleCluster&)> SampleValue;
+
+    bool getNextSection(ThreadedSamFile& samIn);
+
+    static void printQualityCounts(const QualityCounts& qualCounts, 
+                                   bool qual, bool phred, std::ostream& out);
+
+    // Calculate and print the stats for each of the files listed in
+    // inList, several at a time on the thread pool, then the totals.
+    // Returns the status of the first file that failed, or 0.
+    int statsList(const String& inList, bool basic, bool qual, bool phred,
+                  int maxNumReads);
+
+    // Read the records of the file on this thread, counting them into
+    // stats.  Returns 0 on success, otherwise the failure status after
+    // writing the failure to out.
+    int statsFile(const char* inFile, int maxNumReads, FileStats& stats,
+                  std::ostream& out);
+
+    // Calculate and print the --basic stats of the records with the
+    // required & without the excluded flags from the field cache.
+    // Returns 0 on success.
+    int statsFromCache(FieldCache& fieldCache, int maxNumReads);
+
+    // Print the number of mapped & unmapped records for each reference,
+    // using the counts in the index when available and reading the
+    // records for the rest.  Returns 0 on success.
+    int printIndexStats(const String& inFile, const String& indexFile,
+                        int requiredFlags, int excludeFlags);
+
+    // Add the qualities of the record to the counts.
+    // If myWithinRegion is set, only qualities between startPos and endPos 
+    // (-1 for no end) are counted.
+    void countQualities(SamRecord& record, QualityCounts& counts,
+                        int32_t startPos, int32_t endPos);
+
+    // Add the qualities of the record to the counts using the qualities
+    // in the BAM record buffer, ignoring any region.  Returns false without
+    // updating the counts if they cannot be counted this way, including
+    // if there are invalid qualities.
+    bool countRawQualities(SamRecord& record, QualityCounts& counts);
+
+    // Calculate the stats over the whole indexed file by splitting it
+    // into shards that are processed on the thread pool.  The results are
+    // written/added to the outputs in file order.
+    // Returns the number of records read.
+    uint64_t statsByShard(const String& inFile, const String& indexFile,
+                          SamFileHeader& header, IFILE baseQCPtr,
+                          BaseQCFile* baseQCBin, QualityCounts& qualCounts);
+
+    // Calculate the stats for the shard.
+    void processShard(SamFile& samIn, SamFileHeader& header, Shard& shard);
+
+    // Estimate the --basic, --qual, and --phred stats from up to
+    // sampleReads reads at each of numSamples points spread evenly over
+    // the data of the indexed file (see BalancedShards) plus the unmapped
+    // reads at the end, printing the sampled counts and the estimates
+    // with their confidence intervals.  Returns 0 on success.
+    int statsBySample(const String& inFile, const String& indexFile,
+                      int numSamples, int sampleReads,
+                      bool basic, bool qual, bool phred);
+
+    // Ratio of the sums of the value to the sums of the base over the
+    // sampled clusters, weighted by stratum, setting halfWidth to the
+    // half width of its 95% confidence interval, or to -1 if it cannot
+    // be estimated.  Returns -1 if there is no base.
+    static double estimateRatio(const std::vector<SampleStratum>& strata,
+                                const SampleValue& value,
+                                const SampleValue& base, double& halfWidth);
+
+    // Print a line with the estimate and its 95% confidence interval,
+    // limiting the interval to [0, maxValue].
+    static void printEstimate(const char* name,
+                              const std::vector<SampleStratum>& strata,
+                              const SampleValue& value,
+                              const SampleValue& base,
+                              double scale, double maxValue,
+                              std::ostream& out);
+
+    // Settings for countQualities & processShard.
+    bool myQualStats;
+    bool myPhred;
+    bool myPileupStats;
+    bool myQualExcludeClips;
+    int myBufferSize;
+    KnownSites* myDbsnpListPtr;
+    uint16_t myRequiredFlags;
+    uint16_t myExcludeFlags;
 
     // Pointer to the region list file
     IFILE  myRegionList;
@@ -0,0 +1,73 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+/// Fixed size pool of worker threads that run submitted tasks in FIFO order.
+/// Tasks must not wait on other tasks submitted to the same pool.
+class ThreadPool
+{
+public:
+    /// Start numThreads worker threads (at least 1).
+    ThreadPool(int numThreads);
+
+    /// Finish all queued tasks and join the worker threads.
+    ~ThreadPool();
+
+    /// Queue the specified task, returning a future for its result.
+    /// Exceptions thrown by the task are rethrown by future::get().
+    template<class FUNC>
+    std::future<typename std::result_of<FUNC()>::type> submit(FUNC func)
+    {
+        typedef typename std::result_of<FUNC()>::type RESULT_TYPE;
+        std::shared_ptr< std::packaged_task<RESULT_TYPE()> > task =
+            std::make_shared< std::packaged_task<RESULT_TYPE()> >(func);
+        std::future<RESULT_TYPE> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(myMutex);
+            myTasks.push([task]() { (*task)(); });
+        }
+        myCondition.notify_one();
+        return(result);
+    }
+
+    int getNumThreads() const { return(myWorkers.size()); }
+
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void workerLoop();
+
+    std::vector<std::thread> myWorkers;
+    std::queue< std::function<void()> > myTasks;
+    std::mutex myMutex;
+    std::condition_variable myCondition;
+    bool myStopping;
+};
+
+#endif
@@ -0,0 +1,1113 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <string>
+#include <stdexcept>
+
+#include "ThreadedSamFile.h"
+#include "Profile.h"
+#include "BamExecutable.h"
+
+const int ThreadedSamFile::BLOCKS_PER_THREAD = 4;
+const char* ThreadedSamFile::PIPE_PREFIX = "bampipe:";
+
+static const char BAM_MAGIC[4] = {'B', 'A', 'M', 1};
+
+
+ThreadedSamFile::ThreadedSamFile(ErrorHandler::HandlingType errorHandlingType)
+    : SamFile(errorHandlingType),
+      myReader(),
+      myWriter(),
+      mySamReader(),
+      mySamWriter(),
+      myThreadedStatus(errorHandlingType),
+      myAttemptRecovery(false),
+      myThreadedRead(true),
+      myThreadedWrite(true),
+      myRequiredFlags(0),
+      myExcludedFlags(0),
+      myHasHeader(false),
+      myThreadedRecordCount(0),
+      myRefPtr(NULL),
+      myReadTranslation(SamRecord::NONE),
+      myWriteTranslation(SamRecord::NONE),
+      myPrefetcher(),
+      myRawRecord(),
+      myWriteIndex(false),
+      myWriteIndexFailed(false),
+      myIndexedFile(),
+      myIndexBuilder(),
+      myPipeFd(-1),
+      myPipeWrite(false),
+      myPipeEOF(false),
+      myPipeBuffer(),
+      myPipePos(0),
+      myPipeLen(0),
+      myMap(NULL),
+      myMapLen(0),
+      myMapPos(0)
+{
+}
+
+
+ThreadedSamFile::~ThreadedSamFile()
+{
+    try
+    {
+        Close();
+    }
+    catch(std::runtime_error& e)
+    {
+        // Cannot throw from a destructor, the close failure is lost.
+    }
+}
+
+
+std::string ThreadedSamFile::getPipeName(int fd)
+{
+    return(PIPE_PREFIX + std::to_string(fd));
+}
+
+
+bool ThreadedSamFile::isPipeName(const char* filename)
+{
+    return(strncmp(filename, PIPE_PREFIX, strlen(PIPE_PREFIX)) == 0);
+}
+
+
+bool ThreadedSamFile::OpenForRead(const char* filename, SamFileHeader* header)
+{
+    Close();
+
+    if(openPipe(filename, false))
+    {
+        char magic[sizeof(BAM_MAGIC)];
+        if(!readBytes(magic, sizeof(magic), "header") ||
+           (memcmp(magic, BAM_MAGIC, sizeof(magic)) != 0))
+        {
+            myThreadedStatus.setStatus(SamStatus::FAIL_PARSE,
+                                       "The pipe does not contain BAM data.");
+            return(false);
+        }
+        myThreadedStatus.setStatus(SamStatus::SUCCESS, "");
+        if(header != NULL)
+        {
+            return(ReadHeader(*header));
+        }
+        return(true);
+    }
+
+    if(!myAttemptRecovery && myThreadedRead && openMap(filename))
+    {
+        // Skip the magic, which openMap checked.
+        myMapPos = sizeof(BAM_MAGIC);
+        myThreadedStatus.setStatus(SamStatus::SUCCESS, "");
+        if(header != NULL)
+        {
+            return(ReadHeader(*header));
+        }
+        return(true);
+    }
+
+    // Only regular BAM files with an EOF marker and uncompressed SAM
+    // files are read using threads, everything else (and stdin/missing
+    // EOF handling) is left to SamFile.
+    if((BamExecutable::getNumThreads() <= 1) || myAttemptRecovery ||
+       !myThreadedRead)
+    {
+        return(SamFile::OpenForRead(filename, header));
+    }
+
+    if(ParallelSamReader::isSam(filename))
+    {
+        if(!mySamReader.open(filename, BamExecutable::getThreadPool(),
+                             BamExecutable::getNumThreads() * BLOCKS_PER_THREAD))
+        {
+            std::string errorMessage = "Failed to Open ";
+            errorMessage += filename;
+            errorMessage += " for reading";
+            myThreadedStatus.setStatus(SamStatus::FAIL_IO, errorMessage.c_str());
+            return(false);
+        }
+        myThreadedStatus.setStatus(SamStatus::SUCCESS, "");
+        if(header != NULL)
+        {
+            return(ReadHeader(*header));
+        }
+        return(true);
+    }
+
+    if(!ParallelBgzf::isBgzfWithEof(filename))
+    {
+        return(SamFile::OpenForRead(filename, header));
+    }
+
+    if(!myReader.open(filename, BamExecutable::getThreadPool(),
+                      BamExecutable::getNumThreads() * BLOCKS_PER_THREAD))
+    {
+        std::string errorMessage = "Failed to Open ";
+        errorMessage += filename;
+        errorMessage += " for reading";
+        myThreadedStatus.setStatus(SamStatus::FAIL_IO, errorMessage.c_str());
+        return(false);
+    }
+    char magic[sizeof(BAM_MAGIC)];
+    if((myReader.read(magic, sizeof(magic)) != sizeof(magic)) ||
+       (memcmp(magic, BAM_MAGIC, sizeof(magic)) != 0))
+    {
+        // BGZF compressed, but not BAM, let SamFile handle it.
+        myReader.close();
+        return(SamFile::OpenForRead(filename, header));
+    }
+
+    myThreadedStatus.setStatus(SamStatus::SUCCESS, "");
+    if(header != NULL)
+    {
+        return(ReadHeader(*header));
+    }
+    return(true);
+}
+
+
+bool ThreadedSamFile::OpenForWrite(const char* filename, SamFileHeader* header)
+{
+    Close();
+    myWriteIndexFailed = false;
+
+    if(openPipe(filename, true))
+    {
+        if(myWriteIndex)
+        {
+            std::cerr << "WARNING: Not indexing " << filename
+                      << " since it is a pipe.\n";
+        }
+        myThreadedStatus.setStatus(SamStatus::SUCCESS, "");
+        if(header != NULL)
+        {
+            return(WriteHeader(*header));
+        }
+        return(true);
+    }
+
+    // Only BAM files written to a file can be indexed.
+    const char* extension = strrchr(filename, '.');
+    bool isBam = (extension != NULL) && (strcmp(extension, ".bam") == 0);
+    bool index = myWriteIndex && isBam && (strcmp(filename, "-.bam") != 0);
+    if(myWriteIndex && !index)
+    {
+        std::cerr << "WARNING: Not indexing " << filename
+                  << " since only BAM files written to a file can be indexed.\n";
+    }
+
+    bool threaded = (BamExecutable::getNumThreads() > 1) && myThreadedWrite;
+    if(threaded && ParallelSamWriter::isSam(filename))
+    {
+        if(!mySamWriter.open(filename, BamExecutable::getThreadPool(),
+                             BamExecutable::getNumThreads() * BLOCKS_PER_THREAD))
+        {
+            std::string errorMessage = "Failed to Open ";
+            errorMessage += filename;
+            errorMessage += " for writing";
+            myThreadedStatus.setStatus(SamStatus::FAIL_IO, errorMessage.c_str());
+            return(false);
+        }
+        myThreadedStatus.setStatus(SamStatus::SUCCESS, "");
+        if(header != NULL)
+        {
+            return(WriteHeader(*header));
+        }
+        return(true);
+    }
+
+    // Otherwise only BAM files are written using threads, or when indexed
+    // since the index is built from the blocks as they are written.
+    if(!isBam || (!threaded && !index))
+    {
+        return(SamFile::OpenForWrite(filename, header));
+    }
+
+    // "-.bam" is BAM to stdout.
+    const char* outName = filename;
+    if(strcmp(filename, "-.bam") == 0)
+    {
+        outName = "-";
+    }
+    bool opened = false;
+    if(!threaded)
+    {
+        opened = myWriter.open(outName);
+    }
+    else
+    {
+        opened = myWriter.open(outName, BamExecutable::getThreadPool(),
+                               BamExecutable::getNumThreads() * BLOCKS_PER_THREAD);
+    }
+    if(!opened)
+    {
+        std::string errorMessage = "Failed to Open ";
+        errorMessage += filename;
+        errorMessage += " for writing";
+        myThreadedStatus.setStatus(SamStatus::FAIL_IO, errorMessage.c_str());
+        return(false);
+    }
+    if(index)
+    {
+        // The blocks are reported as they are written, so the records
+        // can be indexed once their virtual offsets are known.
+        myIndexedFile = filename;
+        myWriter.setBlockListener([this](uint64_t fileOffset, uint32_t dataSize)
+                                  { myIndexBuilder.addBlock(fileOffset, dataSize); });
+    }
+
+    myThreadedStatus.setStatus(SamStatus::SUCCESS, "");
+    if(header != NULL)
+    {
+        return(WriteHeader(*header));
+    }
+    return(true);
+}
+
+
+void ThreadedSamFile::Close()
+{
+    // Stop reading ahead before closing the input.
+    myPrefetcher.stop();
+    if(myWriter.isOpen() && !myWriter.close())
+    {
+        myThreadedStatus.setStatus(SamStatus::FAIL_IO,
+                                   "Failed to write the BAM file.");
+        if(isIndexing())
+        {
+            myWriteIndexFailed = true;
+            myIndexedFile.clear();
+        }
+    }
+    myWriter.setBlockListener(std::function<void(uint64_t, uint32_t)>());
+    finishIndex();
+    if(mySamWriter.isOpen() && !mySamWriter.close())
+    {
+        myThreadedStatus.setStatus(SamStatus::FAIL_IO,
+                                   "Failed to write the SAM file.");
+    }
+    myReader.close();
+    mySamReader.close();
+    if(myPipeFd >= 0)
+    {
+        if((myPipeWrite && !flushPipe()) || (close(myPipeFd) != 0))
+        {
+            myThreadedStatus.setStatus(SamStatus::FAIL_IO,
+                                       "Failed to write the BAM pipe.");
+        }
+        myPipeFd = -1;
+        myPipeBuffer.clear();
+    }
+    if(myMap != NULL)
+    {
+        munmap((void*)myMap, myMapLen);
+        myMap = NULL;
+        myMapLen = 0;
+        myMapPos = 0;
+    }
+    myHasHeader = false;
+    myThreadedRecordCount = 0;
+    // Reset SamFile as well, including its sort validation state.
+    SamFile::Close();
+}
+
+
+bool ThreadedSamFile::IsOpen()
+{
+    return(isThreaded() || SamFile::IsOpen());
+}
+
+
+bool ThreadedSamFile::IsEOF()
+{
+    if(myPrefetcher.isRunning())
+    {
+        return(myPrefetcher.isDone());
+    }
+    if(myReader.isOpen())
+    {
+        return(myReader.isEOF());
+    }
+    if(mySamReader.isOpen())
+    {
+        return(mySamReader.isEOF());
+    }
+    if(myMap != NULL)
+    {
+        return(myMapPos >= myMapLen);
+    }
+    if(isReading())
+    {
+        return(myPipeEOF && (myPipePos == myPipeLen));
+    }
+    return(SamFile::IsEOF());
+}
+
+
+bool ThreadedSamFile::ReadHeader(SamFileHeader& header)
+{
+    if(!isReading())
+    {
+        return(SamFile::ReadHeader(header));
+    }
+    if(myHasHeader)
+    {
+        myThreadedStatus.setStatus(SamStatus::FAIL_ORDER,
+                                   "Cannot read header since it has already been read.");
+        return(false);
+    }
+
+    header.resetHeader();
+
+    if(mySamReader.isOpen())
+    {
+        // The SAM header lines, the references come from the @SQ lines.
+        std::string text;
+        if(!mySamReader.readHeader(text))
+        {
+            myThreadedStatus.setStatus(SamStatus::FAIL_IO,
+                                       "Failed to read the SAM header.");
+            return(false);
+        }
+        if(!header.addHeader(text.c_str()))
+        {
+            myThreadedStatus.setStatus(SamStatus::FAIL_PARSE,
+                                       header.getErrorMessage());
+            return(false);
+        }
+        mySamReader.setHeader(&header);
+        myHasHeader = true;
+        myThreadedStatus.setStatus(SamStatus::SUCCESS, "");
+        return(true);
+    }
+
+    int32_t textLen = 0;
+    if(!readBytes(&textLen, sizeof(textLen), "header") || (textLen < 0))
+    {
+        return(false);
+    }
+    std::string text(textLen, '\0');
+    if((textLen > 0) && !readBytes(&(text[0]), textLen, "header"))
+    {
+        return(false);
+    }
+    if(!header.addHeader(text.c_str()))
+    {
+        myThreadedStatus.setStatus(SamStatus::FAIL_PARSE,
+                                   header.getErrorMessage());
+        return(false);
+    }
+
+    int32_t numRefs = 0;
+    if(!readBytes(&numRefs, sizeof(numRefs), "header"))
+    {
+        return(false);
+    }
+    SamReferenceInfo& refInfo = header.getReferenceInfoForBamInterface();
+    refInfo.clear();
+    std::vector<char> refName;
+    for(int32_t i = 0; i < numRefs; i++)
+    {
+        int32_t nameLen = 0;
+        int32_t refLen = 0;
+        if(!readBytes(&nameLen, sizeof(nameLen), "header") || (nameLen <= 0))
+        {
+            return(false);
+        }
+        refName.resize(nameLen + 1);
+        if(!readBytes(&(refName[0]), nameLen, "header") ||
+           !readBytes(&refLen, sizeof(refLen), "header"))
+        {
+            return(false);
+        }
+        refName[nameLen] = '\0';
+        refInfo.add(&(refName[0]), refLen);
+    }
+
+    myHasHeader = true;
+    myThreadedStatus.setStatus(SamStatus::SUCCESS, "");
+    return(true);
+}
+
+
+bool ThreadedSamFile::WriteHeader(SamFileHeader& header)
+{
+    if(!isWriting())
+    {
+        return(SamFile::WriteHeader(header));
+    }
+    if(myHasHeader)
+    {
+        myThreadedStatus.setStatus(SamStatus::FAIL_ORDER,
+                                   "Cannot write header since it has already been written");
+        return(false);
+    }
+
+    if(mySamWriter.isOpen())
+    {
+        std::string text;
+        if(!header.getHeaderString(text))
+        {
+            myThreadedStatus.setStatus(SamStatus::FAIL_PARSE,
+                                       "Failed to get the header string.");
+            return(false);
+        }
+        if(!mySamWriter.writeHeader(text, &header))
+        {
+            myThreadedStatus.setStatus(SamStatus::FAIL_IO,
+                                       "Failed to write the SAM header.");
+            return(false);
+        }
+        myHasHeader = true;
+        myThreadedStatus.setStatus(SamStatus::SUCCESS, "");
+        return(true);
+    }
+
+    std::vector<char> buffer;
+    if(!getBamHeader(header, buffer))
+    {
+        myThreadedStatus.setStatus(SamStatus::FAIL_PARSE,
+                                   "Failed to get the header string.");
+        return(false);
+    }
+    if(isIndexing() &&
+       !myIndexBuilder.start(header, BamIndexBuilder::needsCsi(header)))
+    {
+        myThreadedStatus.setStatus(SamStatus::FAIL_PARSE,
+                                   "The references cannot be indexed.");
+        return(false);
+    }
+    if(!writeStream(&(buffer[0]), buffer.size()))
+    {
+        myThreadedStatus.setStatus(SamStatus::FAIL_IO,
+                                   "Failed to write the BAM header.");
+        return(false);
+    }
+    myHasHeader = true;
+    myThreadedStatus.setStatus(SamStatus::SUCCESS, "");
+    return(true);
+}
+
+
+bool ThreadedSamFile::getBamHeader(SamFileHeader& header,
+                                   std::vector<char>& buffer)
+{
+    buffer.clear();
+    std::string text;
+    if(!header.getHeaderString(text))
+    {
+        return(false);
+    }
+    int32_t textLen = text.length();
+    buffer.insert(buffer.end(), BAM_MAGIC, BAM_MAGIC + sizeof(BAM_MAGIC));
+    buffer.insert(buffer.end(), (const char*)&textLen,
+                  (const char*)&textLen + sizeof(textLen));
+    buffer.insert(buffer.end(), text.begin(), text.end());
+
+    const SamReferenceInfo& refInfo = header.getReferenceInfo();
+    int32_t numRefs = refInfo.getNumEntries();
+    buffer.insert(buffer.end(), (const char*)&numRefs,
+                  (const char*)&numRefs + sizeof(numRefs));
+    for(int32_t i = 0; i < numRefs; i++)
+    {
+        const char* refName = refInfo.getReferenceName(i);
+        int32_t nameLen = strlen(refName) + 1;
+        int32_t refLen = refInfo.getReferenceLength(i);
+        buffer.insert(buffer.end(), (const char*)&nameLen,
+                      (const char*)&nameLen + sizeof(nameLen));
+        buffer.insert(buffer.end(), refName, refName + nameLen);
+        buffer.insert(buffer.end(), (const char*)&refLen,
+                      (const char*)&refLen + sizeof(refLen));
+    }
+    return(true);
+}
+
+
+bool ThreadedSamFile::ReadRecord(SamFileHeader& header, SamRecord& record)
+{
+    static Profile::Stage& stage = Profile::getStage("ThreadedSamFile::ReadRecord");
+    Profile::Timer timer(stage);
+    if(!isReading())
+    {
+        return(SamFile::ReadRecord(header, record));
+    }
+    if(!myHasHeader)
+    {
+        myThreadedStatus.setStatus(SamStatus::FAIL_ORDER,
+                                   "Cannot read record since the header has not been read.");
+        return(false);
+    }
+
+    // Read until a record passes the flag filter.
+    do
+    {
+        if(!readNextRecord(header, record))
+        {
+            return(false);
+        }
+    }
+    while(((record.getFlag() & myRequiredFlags) != myRequiredFlags) ||
+          ((record.getFlag() & myExcludedFlags) != 0));
+    return(true);
+}
+
+
+bool ThreadedSamFile::ReadRawRecord(SamFileHeader& header, SamRecord& record,
+                                    const char*& buffer, uint32_t& size)
+{
+    if(!isReading())
+    {
+        if(!SamFile::ReadRecord(header, record))
+        {
+            return(false);
+        }
+        buffer = (const char*)record.getRecordBuffer(SamRecord::NONE);
+        if(buffer == NULL)
+        {
+            myThreadedStatus.setStatus(SamStatus::FAIL_MEM,
+                                       "Failed to get the BAM record buffer.");
+            return(false);
+        }
+        int32_t blockSize = 0;
+        memcpy(&blockSize, buffer, sizeof(blockSize));
+        size = blockSize + sizeof(blockSize);
+        return(true);
+    }
+    if(!myHasHeader)
+    {
+        myThreadedStatus.setStatus(SamStatus::FAIL_ORDER,
+                                   "Cannot read record since the header has not been read.");
+        return(false);
+    }
+    // The prefetcher already skips records that do not pass the flag filter.
+    if(!nextRecordBuffer(buffer, size))
+    {
+        return(false);
+    }
+    ++myThreadedRecordCount;
+    myThreadedStatus.setStatus(SamStatus::SUCCESS, "");
+    return(true);
+}
+
+
+bool ThreadedSamFile::WriteRawRecord(SamFileHeader& header, 
+                                     const char* buffer, uint32_t size)
+{
+    if(!isWriting() || (myWriteTranslation != SamRecord::NONE))
+    {
+        // Needs to be written through a record.
+        if(myRawRecord.setBuffer(buffer, size, header) != SamStatus::SUCCESS)
+        {
+            myThreadedStatus.setStatus(SamStatus::FAIL_PARSE,
+                                       "Failed to parse the BAM record.");
+            return(false);
+        }
+        return(WriteRecord(header, myRawRecord));
+    }
+    if(!myHasHeader)
+    {
+        myThreadedStatus.setStatus(SamStatus::FAIL_ORDER,
+                                   "Cannot write record since the header has not been written");
+        return(false);
+    }
+    if(!writeRecordBuffer(buffer, size))
+    {
+        myThreadedStatus.setStatus(SamStatus::FAIL_IO,
+                                   "Failed to write the BAM record.");
+        return(false);
+    }
+    ++myThreadedRecordCount;
+    myThreadedStatus.setStatus(SamStatus::SUCCESS, "");
+    return(true);
+}
+
+
+bool ThreadedSamFile::nextRecordBuffer(const char*& buffer, uint32_t& size)
+{
+    if(myMap != NULL)
+    {
+        // The records are already in memory, so are not read ahead.
+        return(nextMappedRecord(buffer, size));
+    }
+
+    // Records are read ahead on a background thread once the header
+    // has been read.
+    if(!myPrefetcher.isRunning())
+    {
+        myPrefetcher.start([this](void* buffer, uint32_t len)
+                           { return(readStream(buffer, len)); },
+                           myRequiredFlags, myExcludedFlags);
+    }
+
+    if(!myPrefetcher.next(buffer, size))
+    {
+        if(myPrefetcher.getError().empty())
+        {
+            myThreadedStatus.setStatus(SamStatus::NO_MORE_RECS,
+                                       "No more records left to read.");
+        }
+        else
+        {
+            myThreadedStatus.setStatus(SamStatus::FAIL_IO,
+                                       myPrefetcher.getError().c_str());
+        }
+        return(false);
+    }
+    return(true);
+}
+
+
+bool ThreadedSamFile::readNextRecord(SamFileHeader& header, SamRecord& record)
+{
+    const char* buffer = NULL;
+    uint32_t bufferSize = 0;
+    if(!nextRecordBuffer(buffer, bufferSize))
+    {
+        return(false);
+    }
+
+    SamStatus::Status status = record.setBuffer(buffer, bufferSize, header);
+    if(status != SamStatus::SUCCESS)
+    {
+        myThreadedStatus.setStatus(status, "Failed to parse the BAM record.");
+        return(false);
+    }
+    record.setReference(myRefPtr);
+    record.setSequenceTranslation(myReadTranslation);
+
+    if(!validateSortOrder(record, header))
+    {
+        std::string errorMessage = "ERROR: File is not sorted at record ";
+        errorMessage += std::to_string(myThreadedRecordCount);
+        myThreadedStatus.setStatus(SamStatus::INVALID_SORT,
+                                   errorMessage.c_str());
+        return(false);
+    }
+
+    ++myThreadedRecordCount;
+    myThreadedStatus.setStatus(SamStatus::SUCCESS, "");
+    return(true);
+}
+
+
+bool ThreadedSamFile::WriteRecord(SamFileHeader& header, SamRecord& record)
+{
+    static Profile::Stage& stage = Profile::getStage("ThreadedSamFile::WriteRecord");
+    Profile::Timer timer(stage);
+    if(!isWriting())
+    {
+        return(SamFile::WriteRecord(header, record));
+    }
+    if(!myHasHeader)
+    {
+        myThreadedStatus.setStatus(SamStatus::FAIL_ORDER,
+                                   "Cannot write record since the header has not been written");
+        return(false);
+    }
+
+    record.setReference(myRefPtr);
+    const char* buffer =
+        (const char*)record.getRecordBuffer(myWriteTranslation);
+    if(buffer == NULL)
+    {
+        myThreadedStatus.setStatus(SamStatus::FAIL_MEM,
+                                   "Failed to get the BAM record buffer.");
+        return(false);
+    }
+    int32_t blockSize = 0;
+    memcpy(&blockSize, buffer, sizeof(blockSize));
+    if(!writeRecordBuffer(buffer, blockSize + sizeof(blockSize)))
+    {
+        myThreadedStatus.setStatus(SamStatus::FAIL_IO,
+                                   "Failed to write the BAM record.");
+        return(false);
+    }
+    ++myThreadedRecordCount;
+    myThreadedStatus.setStatus(SamStatus::SUCCESS, "");
+    return(true);
+}
+
+
+bool ThreadedSamFile::appendBamRecords(const char* filename)
+{
+    if(!myWriter.isOpen() || !myHasHeader)
+    {
+        myThreadedStatus.setStatus(SamStatus::FAIL_ORDER,
+                                   "Cannot append records unless writing a threaded BAM file with a header.");
+        return(false);
+    }
+    if(isIndexing())
+    {
+        // The appended records are not seen, so cannot be indexed.
+        myThreadedStatus.setStatus(SamStatus::FAIL_ORDER,
+                                   "Cannot append records to a BAM file that is indexed as it is written.");
+        return(false);
+    }
+    if(!myWriter.appendFile(filename))
+    {
+        std::string errorMessage = "Failed to append the records from ";
+        errorMessage += filename;
+        myThreadedStatus.setStatus(SamStatus::FAIL_IO, errorMessage.c_str());
+        return(false);
+    }
+    myThreadedStatus.setStatus(SamStatus::SUCCESS, "");
+    return(true);
+}
+
+
+void ThreadedSamFile::SetReference(GenomeSequence* reference)
+{
+    myRefPtr = reference;
+    SamFile::SetReference(reference);
+}
+
+
+void ThreadedSamFile::SetReadSequenceTranslation(SamRecord::SequenceTranslation translation)
+{
+    myReadTranslation = translation;
+    SamFile::SetReadSequenceTranslation(translation);
+}
+
+
+void ThreadedSamFile::SetWriteSequenceTranslation(SamRecord::SequenceTranslation translation)
+{
+    myWriteTranslation = translation;
+    SamFile::SetWriteSequenceTranslation(translation);
+}
+
+
+void ThreadedSamFile::setAttemptRecovery(bool attemptRecovery)
+{
+    myAttemptRecovery = attemptRecovery;
+    SamFile::setAttemptRecovery(attemptRecovery);
+}
+
+
+void ThreadedSamFile::SetReadFlags(uint16_t requiredFlags,
+                                   uint16_t excludedFlags)
+{
+    myRequiredFlags = requiredFlags;
+    myExcludedFlags = excludedFlags;
+    SamFile::SetReadFlags(requiredFlags, excludedFlags);
+}
+
+
+uint32_t ThreadedSamFile::GetCurrentRecordCount()
+{
+    if(isThreaded())
+    {
+        return(myThreadedRecordCount);
+    }
+    return(SamFile::GetCurrentRecordCount());
+}
+
+
+SamStatus::Status ThreadedSamFile::GetStatus()
+{
+    if(isThreaded())
+    {
+        return(myThreadedStatus.getStatus());
+    }
+    return(SamFile::GetStatus());
+}
+
+
+SamStatus::Status ThreadedSamFile::GetFailure()
+{
+    return(GetStatus());
+}
+
+
+const char* ThreadedSamFile::GetStatusMessage()
+{
+    if(isThreaded())
+    {
+        return(myThreadedStatus.getStatusMessage());
+    }
+    return(SamFile::GetStatusMessage());
+}
+
+
+bool ThreadedSamFile::readBytes(void* buffer, uint32_t len, const char* what)
+{
+    if(readStream(buffer, len) != len)
+    {
+        std::string errorMessage = "Failed to read the BAM ";
+        errorMessage += what;
+        errorMessage += ", the file is truncated.";
+        myThreadedStatus.setStatus(SamStatus::FAIL_IO, errorMessage.c_str());
+        return(false);
+    }
+    return(true);
+}
+
+
+bool ThreadedSamFile::openPipe(const char* filename, bool write)
+{
+    size_t prefixLen = strlen(PIPE_PREFIX);
+    if(strncmp(filename, PIPE_PREFIX, prefixLen) != 0)
+    {
+        return(false);
+    }
+    char* end = NULL;
+    long fd = strtol(filename + prefixLen, &end, 10);
+    if((end == filename + prefixLen) || (*end != '\0') || (fd < 0))
+    {
+        return(false);
+    }
+    myPipeFd = fd;
+    myPipeWrite = write;
+    myPipeEOF = false;
+    myPipeBuffer.resize(PIPE_BUFFER_SIZE);
+    myPipePos = 0;
+    myPipeLen = 0;
+    return(true);
+}
+
+
+bool ThreadedSamFile::openMap(const char* filename)
+{
+    if((filename == NULL) || (strcmp(filename, "-") == 0))
+    {
+        return(false);
+    }
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0)
+    {
+        return(false);
+    }
+    struct stat fileStat;
+    char magic[sizeof(BAM_MAGIC)];
+    void* map = MAP_FAILED;
+    // Only regular files starting with the BAM magic rather than a
+    // BGZF block are uncompressed BAM.
+    if((fstat(fd, &fileStat) == 0) && S_ISREG(fileStat.st_mode) &&
+       (fileStat.st_size >= (off_t)sizeof(magic)) &&
+       (pread(fd, magic, sizeof(magic), 0) == (ssize_t)sizeof(magic)) &&
+       (memcmp(magic, BAM_MAGIC, sizeof(magic)) == 0))
+    {
+        map = mmap(NULL, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    // The mapping keeps the file open.
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        return(false);
+    }
+    madvise(map, fileStat.st_size, MADV_SEQUENTIAL);
+    myMap = (const char*)map;
+    myMapLen = fileStat.st_size;
+    myMapPos = 0;
+    return(true);
+}
+
+
+bool ThreadedSamFile::nextMappedRecord(const char*& buffer, uint32_t& size)
+{
+    // Offset of the flag in the record, after the block size.
+    static const uint32_t FLAG_OFFSET = 18;
+    // Size of the fixed fields, after the block size.
+    static const int32_t MIN_BLOCK_SIZE = 32;
+    while(myMapPos < myMapLen)
+    {
+        int32_t blockSize = 0;
+        if(myMapLen - myMapPos >= sizeof(blockSize))
+        {
+            memcpy(&blockSize, myMap + myMapPos, sizeof(blockSize));
+        }
+        if((blockSize < MIN_BLOCK_SIZE) ||
+           ((uint64_t)blockSize > myMapLen - myMapPos - sizeof(blockSize)))
+        {
+            myMapPos = myMapLen;
+            myThreadedStatus.setStatus(SamStatus::FAIL_IO,
+                                       "Failed to read the BAM record, the file is truncated.");
+            return(false);
+        }
+        buffer = myMap + myMapPos;
+        size = blockSize + sizeof(blockSize);
+        myMapPos += size;
+        uint16_t flag = 0;
+        memcpy(&flag, buffer + FLAG_OFFSET, sizeof(flag));
+        if(((flag & myRequiredFlags) == myRequiredFlags) &&
+           ((flag & myExcludedFlags) == 0))
+        {
+            return(true);
+        }
+    }
+    myThreadedStatus.setStatus(SamStatus::NO_MORE_RECS,
+                               "No more records left to read.");
+    return(false);
+}
+
+
+uint32_t ThreadedSamFile::readStream(void* buffer, uint32_t len)
+{
+    if(myMap != NULL)
+    {
+        if(len > myMapLen - myMapPos)
+        {
+            len = myMapLen - myMapPos;
+        }
+        memcpy(buffer, myMap + myMapPos, len);
+        myMapPos += len;
+        return(len);
+    }
+    if(mySamReader.isOpen())
+    {
+        return(mySamReader.read(buffer, len));
+    }
+    if(myPipeFd < 0)
+    {
+        return(myReader.read(buffer, len));
+    }
+    char* out = (char*)buffer;
+    uint32_t numRead = 0;
+    while(numRead < len)
+    {
+        if(myPipePos == myPipeLen)
+        {
+            if(myPipeEOF)
+            {
+                break;
+            }
+            ssize_t result = ::read(myPipeFd, &(myPipeBuffer[0]),
+                                    myPipeBuffer.size());
+            if(result < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                // Treat a failed read as truncation.
+                myPipeEOF = true;
+                break;
+            }
+            if(result == 0)
+            {
+                myPipeEOF = true;
+                break;
+            }
+            myPipePos = 0;
+            myPipeLen = result;
+        }
+        uint32_t copyLen = myPipeLen - myPipePos;
+        if(copyLen > len - numRead)
+        {
+            copyLen = len - numRead;
+        }
+        memcpy(out + numRead, &(myPipeBuffer[myPipePos]), copyLen);
+        myPipePos += copyLen;
+        numRead += copyLen;
+    }
+    return(numRead);
+}
+
+
+bool ThreadedSamFile::writeStream(const void* buffer, uint32_t len)
+{
+    if(mySamWriter.isOpen())
+    {
+        return(mySamWriter.write(buffer, len));
+    }
+    if(myPipeFd < 0)
+    {
+        return(myWriter.write(buffer, len));
+    }
+    const char* in = (const char*)buffer;
+    while(len > 0)
+    {
+        if(myPipeLen == myPipeBuffer.size())
+        {
+            if(!flushPipe())
+            {
+                return(false);
+            }
+        }
+        uint32_t copyLen = myPipeBuffer.size() - myPipeLen;
+        if(copyLen > len)
+        {
+            copyLen = len;
+        }
+        memcpy(&(myPipeBuffer[myPipeLen]), in, copyLen);
+        myPipeLen += copyLen;
+        in += copyLen;
+        len -= copyLen;
+    }
+    return(true);
+}
+
+
+bool ThreadedSamFile::writeRecordBuffer(const char* buffer, uint32_t size)
+{
+    if(isIndexing())
+    {
+        myIndexBuilder.addRecord(buffer, size, myWriter.getDataOffset());
+    }
+    return(writeStream(buffer, size));
+}
+
+
+void ThreadedSamFile::finishIndex()
+{
+    if(!isIndexing())
+    {
+        return;
+    }
+    std::string indexFile =
+        BamIndexBuilder::getDefaultName(myIndexedFile.c_str(),
+                                        myIndexBuilder.isCsi());
+    myIndexedFile.clear();
+    if(!myIndexBuilder.finish(indexFile.c_str()))
+    {
+        myWriteIndexFailed = true;
+        myThreadedStatus.setStatus(SamStatus::FAIL_IO,
+                                   "Failed to write the BAM index.");
+    }
+}
+
+
+bool ThreadedSamFile::flushPipe()
+{
+    uint32_t numWritten = 0;
+    while(numWritten < myPipeLen)
+    {
+        ssize_t result = ::write(myPipeFd, &(myPipeBuffer[numWritten]),
+                                 myPipeLen - numWritten);
+        if(result < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return(false);
+        }
+        numWritten += result;
+    }
+    myPipeLen = 0;
+    return(true);
+}
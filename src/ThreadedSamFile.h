@@ -0,0 +1,220 @@
+/*
+ *  Copyright (C) 2026  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//////////////////////////////////////////////////////////////////////////
+// SamFile that inflates/deflates BAM BGZF blocks on the shared thread pool
+// when more than one thread was requested with --threads.
+
+#ifndef __THREADED_SAM_FILE_H__
+#define __THREADED_SAM_FILE_H__
+
+#include <string>
+#include <vector>
+
+#include "SamFile.h"
+#include "BamIndexBuilder.h"
+#include "ParallelBgzf.h"
+#include "ParallelSamText.h"
+#include "RecordPrefetcher.h"
+
+/// Drop in replacement for SamFile for sequentially reading/writing files.
+/// When BamExecutable::getNumThreads() is greater than 1, BAM files are
+/// read/written using the thread pool, and uncompressed SAM files are
+/// parsed/formatted on it.  Otherwise, and for compressed SAM files,
+/// reading from stdin, or BAM files without an EOF marker, all calls are
+/// passed to SamFile.
+/// SamFile's methods are not virtual, so objects of this class must be 
+/// accessed as ThreadedSamFile, not through a SamFile pointer/reference.
+/// Index based reading (SetReadSection) is not supported when threaded.
+/// When threaded, records are read ahead on a background thread.
+/// Files named by getPipeName are read/written as uncompressed BAM on the
+/// specified pipe, which is how "bam pipe" passes records between stages.
+/// Uncompressed BAM (ubam) files are memory mapped when read, with or
+/// without threads, and ReadRawRecord returns the records in the mapping
+/// without copying them.
+/// BAM files written to a file can be indexed as they are written (see
+/// setWriteIndex), even when not threaded.
+class ThreadedSamFile : public SamFile
+{
+public:
+    ThreadedSamFile(ErrorHandler::HandlingType errorHandlingType = ErrorHandler::EXCEPTION);
+    ~ThreadedSamFile();
+
+    bool OpenForRead(const char* filename, SamFileHeader* header = NULL);
+    bool OpenForWrite(const char* filename, SamFileHeader* header = NULL);
+    void Close();
+    bool IsOpen();
+    bool IsEOF();
+
+    bool ReadHeader(SamFileHeader& header);
+    bool WriteHeader(SamFileHeader& header);
+    bool ReadRecord(SamFileHeader& header, SamRecord& record);
+    bool WriteRecord(SamFileHeader& header, SamRecord& record);
+
+    /// Read the next record's BAM buffer (starting with the block size)
+    /// without parsing it into a record when threaded.  The buffer is
+    /// valid until the next read.  When not threaded, the record is read
+    /// into the specified record and the buffer is its BAM buffer.
+    /// The read sequence translation and the sort order are not applied.
+    bool ReadRawRecord(SamFileHeader& header, SamRecord& record,
+                       const char*& buffer, uint32_t& size);
+    /// Write the BAM buffer (starting with the block size) of a record.
+    bool WriteRawRecord(SamFileHeader& header, 
+                        const char* buffer, uint32_t size);
+
+    void SetReference(GenomeSequence* reference);
+    void SetReadSequenceTranslation(SamRecord::SequenceTranslation translation);
+    void SetWriteSequenceTranslation(SamRecord::SequenceTranslation translation);
+
+    /// Files read with recovery enabled are not threaded.
+    void setAttemptRecovery(bool attemptRecovery = false);
+
+    /// Set to false before opening a file to read it through SamFile even
+    /// when there are multiple threads, for example to use SetReadSection.
+    void setThreadedRead(bool threadedRead) { myThreadedRead = threadedRead; }
+
+    /// Set to false before opening a file to write it on the calling thread
+    /// even when there are multiple threads, for example when already
+    /// running as a task on the thread pool.
+    void setThreadedWrite(bool threadedWrite) { myThreadedWrite = threadedWrite; }
+
+    /// Set before opening a BAM file for writing to build its index from
+    /// the records as they are written, instead of re-reading the file.
+    /// The records must be written in coordinate order.  When the file is
+    /// closed, the index is written to the file name + ".bai", or ".csi"
+    /// if a reference is too long for a BAI.  SAM files, stdout, and pipes
+    /// are written without an index.
+    void setWriteIndex(bool writeIndex) { myWriteIndex = writeIndex; }
+
+    /// Returns true if the index of the last file written was requested
+    /// but could not be written (the reason was reported to stderr).
+    bool writeIndexFailed() { return(myWriteIndexFailed); }
+
+    /// Only return records with all of the required flags set and none
+    /// of the excluded flags set.  When threaded, this must be set before
+    /// the first record is read.
+    void SetReadFlags(uint16_t requiredFlags, uint16_t excludedFlags);
+
+    uint32_t GetCurrentRecordCount();
+    SamStatus::Status GetStatus();
+    SamStatus::Status GetFailure();
+    const char* GetStatusMessage();
+
+    /// When threaded and writing, append the BAM records from the
+    /// specified BGZF file (records only, no header) after the records
+    /// written so far.  Fails if the file is being indexed.
+    bool appendBamRecords(const char* filename);
+
+    /// Set buffer to the uncompressed BAM header (magic through the
+    /// references) for the specified header.  Returns false if the
+    /// header text could not be generated.
+    static bool getBamHeader(SamFileHeader& header, std::vector<char>& buffer);
+
+    /// Return whether or not this file is being handled by this class
+    /// (the thread pool or a pipe) rather than SamFile.
+    bool isThreaded() { return(isReading() || isWriting()); }
+
+    /// Get the file name to use to read/write uncompressed BAM on the
+    /// specified pipe file descriptor.
+    static std::string getPipeName(int fd);
+
+    /// Return true if the file name is one returned by getPipeName.
+    /// Tools log to stderr rather than next to such an output.
+    static bool isPipeName(const char* filename);
+
+private:
+    ThreadedSamFile(const ThreadedSamFile&);
+    ThreadedSamFile& operator=(const ThreadedSamFile&);
+
+    bool isReading() { return(myReader.isOpen() || mySamReader.isOpen() ||
+                              (myMap != NULL) ||
+                              ((myPipeFd >= 0) && !myPipeWrite)); }
+    bool isWriting() { return(myWriter.isOpen() || mySamWriter.isOpen() ||
+                              ((myPipeFd >= 0) && myPipeWrite)); }
+    bool isIndexing() { return(!myIndexedFile.empty()); }
+    // Open the pipe if the file name is a pipe name, returning false
+    // if it is not.
+    bool openPipe(const char* filename, bool write);
+    // Memory map the file if it is uncompressed BAM, returning false if
+    // it is not (or cannot be mapped).
+    bool openMap(const char* filename);
+    // Get the next record that passes the flag filter from the mapping.
+    bool nextMappedRecord(const char*& buffer, uint32_t& size);
+    // Read/write from the threaded reader/writer or pipe.
+    uint32_t readStream(void* buffer, uint32_t len);
+    bool writeStream(const void* buffer, uint32_t len);
+    // Write the record's BAM buffer, adding it to the index if indexing.
+    bool writeRecordBuffer(const char* buffer, uint32_t size);
+    // Write the index when closing the indexed file.
+    void finishIndex();
+    bool flushPipe();
+
+    // Get the next record's buffer from the threaded reader.
+    bool nextRecordBuffer(const char*& buffer, uint32_t& size);
+    // Read the next record from the threaded reader.
+    bool readNextRecord(SamFileHeader& header, SamRecord& record);
+    // Read len bytes from the threaded reader, returning false and setting
+    // the status if they could not be read.
+    bool readBytes(void* buffer, uint32_t len, const char* what);
+
+    // Number of blocks each reader/writer keeps queued per thread.
+    static const int BLOCKS_PER_THREAD;
+    static const char* PIPE_PREFIX;
+    static const uint32_t PIPE_BUFFER_SIZE = 256 * 1024;
+
+    ParallelBgzfReader myReader;
+    ParallelBgzfWriter myWriter;
+    ParallelSamReader mySamReader;
+    ParallelSamWriter mySamWriter;
+    SamStatus myThreadedStatus;
+    bool myAttemptRecovery;
+    bool myThreadedRead;
+    bool myThreadedWrite;
+    uint16_t myRequiredFlags;
+    uint16_t myExcludedFlags;
+    bool myHasHeader;
+    uint32_t myThreadedRecordCount;
+    GenomeSequence* myRefPtr;
+    SamRecord::SequenceTranslation myReadTranslation;
+    SamRecord::SequenceTranslation myWriteTranslation;
+    RecordPrefetcher myPrefetcher;
+    // Record used to write raw records when not threaded.
+    SamRecord myRawRecord;
+
+    bool myWriteIndex;
+    bool myWriteIndexFailed;
+    // Name of the BAM file being indexed, empty if not indexing.
+    std::string myIndexedFile;
+    BamIndexBuilder myIndexBuilder;
+
+    // Pipe file descriptor, -1 if not reading/writing a pipe.
+    int myPipeFd;
+    bool myPipeWrite;
+    bool myPipeEOF;
+    // Data read from/to be written to the pipe.
+    std::vector<char> myPipeBuffer;
+    uint32_t myPipePos;
+    uint32_t myPipeLen;
+
+    // Mapped uncompressed BAM file, NULL if not reading one, and the
+    // offset of the next byte to read.
+    const char* myMap;
+    uint64_t myMapLen;
+    uint64_t myMapPos;
+};
+
+#endif
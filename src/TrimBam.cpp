@@ -21,16 +21,20 @@
 #include <stdio.h>
 #include <string.h>
 #include <getopt.h>
-#include "SamFile.h"
+#include <string>
+#include <vector>
+#include "ThreadedSamFile.h"
 #include "SamFlag.h"
 #include "BgzfFileType.h"
 #include "TrimBam.h"
 #include "PhoneHome.h"
 #include "SamFilter.h"
+#include "ParallelRecordMap.h"
+#include "CoordReorderBuffer.h"
 
 void TrimBam::printTrimBamDescription(std::ostream& os)
 {
-    os << " trimBam - Trim the ends of reads in a SAM/BAM file changing read ends to 'N' and quality to '!' or softclipping the ends (resulting file will not be sorted)" << std::endl;
+    os << " trimBam - Trim the ends of reads in a SAM/BAM file changing read ends to 'N' and quality to '!' or softclipping the ends (resulting file will not be sorted unless --keepSorted)" << std::endl;
 }
 
 
@@ -57,6 +61,8 @@ void TrimBam::printUsage(std::ostream& os)
     os << "\t        * run samtools fixmate to fix mate information (will first need to sort by read name)\n";
     os << "\t  * output is not sorted (start positions/mapping may change after soft clipping)\n";
     os << "\t        * run samtools sort to resort by coordinate (after fixmate)\n";
+    os << "\t        * or specify --keepSorted/-s with a coordinate sorted input to keep the output sorted:\n";
+    os << "\t          records whose start moved past later records are held until they can be written in order\n";
     os << "\t  * soft clips already in the read are maintained or added to\n";
     os << "\t        * if 3 bases were clipped and 2 are specified to be clipped, no change is made to that end\n";
     os << "\t        * if 3 bases were clipped and 5 are specified to be clipped, 2 additional bases are clipped from that end\n";
@@ -65,13 +71,14 @@ void TrimBam::printUsage(std::ostream& os)
 // main function
 int TrimBam::execute(int argc, char ** argv)
 {
-  SamFile samIn;
-  SamFile samOut;
+  ThreadedSamFile samIn;
+  ThreadedSamFile samOut;
   int numTrimBaseL = 0;
   int numTrimBaseR = 0;
   bool noeof = false;
   bool ignoreStrand = false;
   bool clip = false;
+  bool keepSorted = false;
   bool noPhoneHome = false;
   std::string inName = "";
   std::string outName = "";
@@ -90,6 +97,7 @@ int TrimBam::execute(int argc, char ** argv)
       { "right", required_argument, NULL, 'R'},
       { "ignoreStrand", no_argument, NULL, 'i'},
       { "clip", no_argument, NULL, 'c'},
+      { "keepSorted", no_argument, NULL, 's'},
       { "noeof", no_argument, NULL, 'n'},
       { "noPhoneHome", no_argument, NULL, 'p'},
       { "nophonehome", no_argument, NULL, 'P'},
@@ -112,7 +120,7 @@ int TrimBam::execute(int argc, char ** argv)
   int n_option_index = 0;
   // Process any additional parameters
   while ( ( c = getopt_long(argc-3, &(argv[3]),
-                            "L:R:icn", getopt_long_options, &n_option_index) )
+                            "L:R:icsn", getopt_long_options, &n_option_index) )
           != -1 )
   {
       switch(c) 
@@ -129,6 +137,9 @@ int TrimBam::execute(int argc, char ** argv)
           case 'c':
               clip = true;
               break;
+          case 's':
+              keepSorted = true;
+              break;
           case 'n':
               noeof = true;
               break;
@@ -162,6 +173,11 @@ int TrimBam::execute(int argc, char ** argv)
       fprintf(stderr, "***Problem opening %s\n",inName.c_str());
     return(-1);
   }
+  if(keepSorted)
+  {
+      // Held records are only written in order if the input is sorted.
+      samIn.setSortedValidation(SamFile::COORDINATE);
+  }
 
   if(!samOut.OpenForWrite(outName.c_str())) {
     fprintf(stderr, "%s\n", samOut.GetStatusMessage());
@@ -171,6 +187,10 @@ int TrimBam::execute(int argc, char ** argv)
   fprintf(stderr,"Arguments in effect: \n");
   fprintf(stderr,"\tInput file : %s\n",inName.c_str());
   fprintf(stderr,"\tOutput file : %s\n",outName.c_str());
+  if(keepSorted)
+  {
+      fprintf(stderr,"\tKeep sorted : on\n");
+  }
   std::string trimType = "trim";
   if(clip) { trimType = "clip"; }
   if(numTrimBaseL == numTrimBaseR)
@@ -217,16 +237,19 @@ int TrimBam::execute(int argc, char ** argv)
       return(samOut.GetStatus());     
    }
 
-   SamRecord samRecord;
-   char seq[65536];
-   char qual[65536];
-   int i, len;
+   // Sequence & quality buffers, one per worker so records can be
+   // trimmed on the thread pool when using multiple threads.
+   std::vector<std::string> seqs(ParallelRecordMap::getNumWorkers());
+   std::vector<std::string> quals(ParallelRecordMap::getNumWorkers());
 
-   // Keep reading records until ReadRecord returns false.
-   while(samIn.ReadRecord(samHeader, samRecord)) {
-     // Successfully read a record from the file, so write it.
-     strcpy(seq,samRecord.getSequence());
-     strcpy(qual,samRecord.getQuality());
+   // Trim the records, writing them in their original order.
+   ParallelRecordMap::Transform trim = 
+     [&](SamRecord& samRecord, unsigned int worker) {
+     std::string& seq = seqs[worker];
+     std::string& qual = quals[worker];
+     int i, len;
+     seq = samRecord.getSequence();
+     qual = samRecord.getQuality();
 
      // Number of bases to trim from the left/right,
      // set based on ignoreStrand flag and strand info.
@@ -243,18 +266,18 @@ int TrimBam::execute(int argc, char ** argv)
          }
      }
 
-     len = strlen(seq);
+     len = seq.length();
      // Do not trim if sequence is '*'
-     if ( strcmp(seq, "*") != 0 ) {
+     if ( seq != "*" ) {
        bool qualValue = true;
-       if(strcmp(qual, "*") == 0)
+       if(qual == "*")
        {
            qualValue = false;
        }
-       int qualLen = strlen(qual);
+       int qualLen = qual.length();
        if ( (qualLen != len) && qualValue ) {
          fprintf(stderr,"ERROR: Sequence and Quality have different length\n");
-         return(-1);
+         return(false);
        }
 
        if(clip)
@@ -295,17 +318,50 @@ int TrimBam::execute(int argc, char ** argv)
                    }
                }
            }
-           samRecord.setSequence(seq);
-           samRecord.setQuality(qual);
+           samRecord.setSequence(seq.c_str());
+           samRecord.setQuality(qual.c_str());
        }
      }
+     return(true);
+   };
 
-     if(!samOut.WriteRecord(samHeader, samRecord)) {
-         // Failed to write a record.
-       fprintf(stderr, "Failure in writing record %s\n", samOut.GetStatusMessage());
-       return(-1);
+   ParallelRecordMap recordMap;
+   SamStatus::Status writeStatus = SamStatus::SUCCESS;
+   CoordReorderBuffer reorderBuffer;
+   if(keepSorted)
+   {
+     // Clipping the start only moves records forward, so they are
+     // reordered as they are written.
+     reorderBuffer.init(&samOut, &samHeader);
+     writeStatus = 
+       recordMap.run(samIn, samHeader, trim,
+                     [&reorderBuffer](SamRecord& samRecord, uint64_t inputKey) {
+                       return(reorderBuffer.add(samRecord, inputKey));
+                     });
+     SamStatus::Status flushStatus = SamStatus::SUCCESS;
+     if(!recordMap.wasStopped())
+     {
+       flushStatus = reorderBuffer.flushAll();
+     }
+     if(flushStatus != SamStatus::SUCCESS)
+     {
+       writeStatus = flushStatus;
      }
    }
+   else
+   {
+     writeStatus = recordMap.run(samIn, samOut, samHeader, trim);
+   }
+
+   if(recordMap.wasStopped())
+   {
+     // Sequence and quality lengths did not match.
+     return(-1);
+   }
+   if(writeStatus != SamStatus::SUCCESS) {
+     // Failed to write a record.
+     return(-1);
+   }
    
    if(samIn.GetStatus() != SamStatus::NO_MORE_RECS)
    {
@@ -317,6 +373,17 @@ int TrimBam::execute(int argc, char ** argv)
      samIn.GetCurrentRecordCount() << std::endl;
    std::cerr << "Number of records written = " << 
      samOut.GetCurrentRecordCount() << std::endl;
+   if(keepSorted)
+   {
+     std::cerr << "Number of records held to keep the output sorted = " <<
+       reorderBuffer.getNumHeld() << " (at most " << 
+       reorderBuffer.getMaxHeld() << " at a time)" << std::endl;
+     if(reorderBuffer.getNumOutOfOrder() != 0)
+     {
+       std::cerr << "WARNING: Resulting File out of Order by " <<
+         reorderBuffer.getNumOutOfOrder() << " records.\n";
+     }
+   }
 
    if(samIn.GetStatus() != SamStatus::NO_MORE_RECS)
    {
@@ -19,11 +19,27 @@
 // This file contains the processing for the executable option "validate"
 // which reads and validates SAM/BAM file and can generate some statistics
 // from it.
+#include <sstream>
+#include <stdexcept>
+#include <string.h>
+
 #include "Validate.h"
-#include "SamFile.h"
+#include "ThreadedSamFile.h"
 #include "Parameters.h"
 #include "BgzfFileType.h"
 #include "SamValidation.h"
+#include "FileBatch.h"
+
+Validate::Validate()
+    : myRefPtr(NULL),
+      mySortType(SamFile::UNSORTED),
+      myMaxErrors(-1),
+      myPrintableErrors(100),
+      myVerbose(false),
+      myDisableStatistics(false)
+{
+}
+
 
 void Validate::printValidateDescription(std::ostream& os)
 {
@@ -40,9 +56,14 @@ void Validate::printDescription(std::ostream& os)
 void Validate::printUsage(std::ostream& os)
 {
     BamExecutable::printUsage(os);
-    os << "\t./bam validate --in <inputFile> [--noeof] [--so_flag|--so_coord|--so_query] [--maxErrors <numErrors>] [--verbose] [--printableErrors <numReportedErrors>] [--disableStatistics] [--params]" << std::endl;
+    os << "\t./bam validate --in <inputFile>|--inList <listFile> [--noeof] [--so_flag|--so_coord|--so_query] [--maxErrors <numErrors>] [--verbose] [--printableErrors <numReportedErrors>] [--disableStatistics] [--structureOnly] [--params]" << std::endl;
     os << "\tRequired Parameters:" << std::endl;
     os << "\t\t--in : the SAM/BAM file to be validated" << std::endl;
+    os << "\t\t  or" << std::endl;
+    os << "\t\t--inList : file listing the SAM/BAM files to validate, one per line." << std::endl;
+    os << "\t\t           The files are validated several at a time (see --threads)," << std::endl;
+    os << "\t\t           reporting each of them and then the totals over all files." << std::endl;
+    os << "\t\t           Statistics are not generated for listed files." << std::endl;
     os << "\tOptional Parameters:" << std::endl;
     os << "\t\t--noeof             : do not expect an EOF block on a bam file." << std::endl;
     os << "\t\t--refFile           : the reference file" << std::endl;
@@ -57,6 +78,9 @@ void Validate::printUsage(std::ostream& os)
               << "\t\t                      before suppressing them when in verbose (defaults to 100)" 
               << std::endl;
     os << "\t\t--disableStatistics : Turn off statistic generation" << std::endl;
+    os << "\t\t--structureOnly     : Only check that a BAM file is not truncated or corrupt:" << std::endl;
+    os << "\t\t                      the BGZF blocks, their CRCs, the EOF block, and the record" << std::endl;
+    os << "\t\t                      lengths, without validating the record fields." << std::endl;
     os << "\t\t--params            : Print the parameter settings" << std::endl;
     //    std::cerr << "\t\t--quiet             : Suppress the display of errors and summary statistics" << std::endl;
     os << std::endl;
@@ -67,6 +91,7 @@ int Validate::execute(int argc, char **argv)
 {
     // Extract command line arguments.
     String inFile = "";
+    String inList = "";
     String refFile = "";
     int maxErrors = -1;
     int printableErrors = 100;
@@ -75,18 +100,21 @@ int Validate::execute(int argc, char **argv)
     bool so_query = false;
     bool noeof = false;
     bool disableStatistics = false;
+    bool structureOnly = false;
     bool verbose = false;
     bool params = false;
 
     ParameterList inputParameters;
     BEGIN_LONG_PARAMETERS(longParameterList)
         LONG_STRINGPARAMETER("in", &inFile)
+        LONG_STRINGPARAMETER("inList", &inList)
         LONG_PARAMETER("noeof", &noeof)
         LONG_STRINGPARAMETER("refFile", &refFile)
         LONG_INTPARAMETER("maxErrors", &maxErrors)
         LONG_PARAMETER("verbose", &verbose)
         LONG_INTPARAMETER("printableErrors", &printableErrors)
         LONG_PARAMETER("disableStatistics", &disableStatistics)
+        LONG_PARAMETER("structureOnly", &structureOnly)
         LONG_PARAMETER("params", &params)
         LONG_PARAMETER_GROUP("SortOrder")
         EXCLUSIVE_PARAMETER("so_flag", &so_flag)
@@ -125,7 +153,7 @@ int Validate::execute(int argc, char **argv)
     }
 
     // Check to see if the in file was specified, if not, report an error.
-    if(inFile == "")
+    if((inFile == "") && (inList == ""))
     {
         printUsage(std::cerr);
         inputParameters.Status();
@@ -134,6 +162,44 @@ int Validate::execute(int argc, char **argv)
                   << "but was not specified" << std::endl;
         return(-1);
     }
+    if((inFile != "") && (inList != ""))
+    {
+        printUsage(std::cerr);
+        inputParameters.Status();
+        std::cerr << "Cannot specify both --in and --inList" << std::endl;
+        return(-1);
+    }
+
+    FileBatch batch;
+    if((inList != "") && !batch.readList(inList.c_str()))
+    {
+        return(-1);
+    }
+
+    if(structureOnly)
+    {
+        if(params)
+        {
+            inputParameters.Status();
+        }
+        // The records are not parsed, so the reference is not needed.
+        if(inList == "")
+        {
+            return(validateStructure(inFile.c_str(), !noeof, std::cerr));
+        }
+        // Each file is checked on the thread pool, so the files are
+        // checked one at a time.
+        std::vector<SamStatus::Status> statuses(batch.getFiles().size(),
+                                                SamStatus::SUCCESS);
+        unsigned int numFailed = batch.run([&](unsigned int index,
+                                               const std::string& file,
+                                               std::ostream& out)
+            {
+                statuses[index] = validateStructure(file.c_str(), !noeof, out);
+                return((int)statuses[index]);
+            }, std::cerr, false);
+        return(reportListStatus(statuses, numFailed));
+    }
 
     // Check to see if the ref file was specified.
     // Open the reference.
@@ -148,36 +214,81 @@ int Validate::execute(int argc, char **argv)
         inputParameters.Status();
     }
 
+    myRefPtr = refPtr;
+    mySortType = sortType;
+    myMaxErrors = maxErrors;
+    myPrintableErrors = printableErrors;
+    myVerbose = verbose;
+    myDisableStatistics = disableStatistics;
+
+    if(inList == "")
+    {
+        Tallies tallies;
+        return(validateFile(inFile.c_str(), true, std::cerr, tallies));
+    }
+
+    std::vector<Tallies> fileTallies(batch.getFiles().size());
+    std::vector<SamStatus::Status> statuses(batch.getFiles().size(),
+                                            SamStatus::SUCCESS);
+    unsigned int numFailed = batch.run([&](unsigned int index,
+                                           const std::string& file,
+                                           std::ostream& out)
+        {
+            statuses[index] = validateFile(file.c_str(), false, out,
+                                           fileTallies[index]);
+            return((int)statuses[index]);
+        }, std::cerr);
+
+    Tallies total;
+    for(unsigned int i = 0; i < fileTallies.size(); i++)
+    {
+        total.add(fileTallies[i]);
+    }
+    std::cerr << "Totals over " << batch.getFiles().size() << " files:";
+    printTallies(total, std::cerr);
+    return(reportListStatus(statuses, numFailed));
+}
+
+
+SamStatus::Status Validate::validateFile(const char* inFile, bool single,
+                                         std::ostream& out, Tallies& tallies)
+{
+    // Statistics are only generated for a single file.
+    bool generateStatistics = single && !myDisableStatistics;
+
     // Since we want to accumulate multiple errors, use RETURN rather
     // than throwing exceptions.
-    SamFile samIn(ErrorHandler::RETURN);
+    ThreadedSamFile samIn(ErrorHandler::RETURN);
+    // Statistics are only generated when read through SamFile, and
+    // listed files are read on the thread pool.
+    samIn.setThreadedRead(single && !generateStatistics);
     // Open the file for reading.   
     if(!samIn.OpenForRead(inFile))
     {
-        fprintf(stderr, "Failed opening the SAM/BAM file, returning: %d (%s)\n",
-                samIn.GetStatus(), 
-                SamStatus::getStatusString(samIn.GetStatus()));
-        fprintf(stderr, "%s\n", samIn.GetStatusMessage());
+        out << "Failed opening the SAM/BAM file, returning: "
+            << samIn.GetStatus() << " ("
+            << SamStatus::getStatusString(samIn.GetStatus()) << ")\n";
+        out << samIn.GetStatusMessage() << "\n";
         return(samIn.GetStatus());
     }
 
     // Set the reference.
-    samIn.SetReference(refPtr);
+    samIn.SetReference(myRefPtr);
 
     // Set the sorting validation type.
-    samIn.setSortedValidation(sortType);
+    samIn.setSortedValidation(mySortType);
 
     // Set that statistics should be generated.
-    samIn.GenerateStatistics(!disableStatistics);
+    samIn.GenerateStatistics(generateStatistics);
 
     // Read the sam header.
     SamFileHeader samHeader;
     if(!samIn.ReadHeader(samHeader))
     {
-        fprintf(stderr, "Failed header validation, returning: %d (%s)\n", 
-                samIn.GetStatus(), 
-                SamStatus::getStatusString(samIn.GetStatus()));
-        fprintf(stderr, "%s\n", samIn.GetStatusMessage());
+        out << "Failed header validation, returning: "
+            << samIn.GetStatus() << " ("
+            << SamStatus::getStatusString(samIn.GetStatus()) << ")\n";
+        out << samIn.GetStatusMessage() << "\n";
         return(samIn.GetStatus());
     }
 
@@ -200,70 +311,92 @@ int Validate::execute(int argc, char **argv)
 
     SamValidationErrors invalidSamErrors;
 
-    // Keep reading records from the file until SamFile::ReadRecord
-    // indicates to stop (returns false).
-    while( ( (maxErrors < 0) || (totalErrorRecords < maxErrors) ) &&
-           ( (samIn.ReadRecord(samHeader, samRecord)) || (SamStatus::isContinuableStatus(samIn.GetStatus())) ) )
+    int maxErrors = myMaxErrors;
+    int printableErrors = myPrintableErrors;
+    bool verbose = myVerbose;
+
+    if(single && (BamExecutable::getNumThreads() > 1) && (maxErrors < 0))
     {
-        ++numRecords;
-        if(samIn.GetStatus() == SamStatus::SUCCESS)
+        // Every record will be read, so they can be validated on other
+        // threads ahead of being reported.
+        status = validateInParallel(samIn, samHeader, verbose,
+                                    printableErrors, tallies,
+                                    numReportedErrors);
+        numRecords = tallies.numRecords;
+        numValidRecords = tallies.numValidRecords;
+        numInvalidRecords = tallies.numInvalidRecords;
+        numErrorRecords = tallies.numErrorRecords;
+        totalErrorRecords = numInvalidRecords + numErrorRecords;
+        errorStats.swap(tallies.errorStats);
+        invalidStats.swap(tallies.invalidStats);
+    }
+    else
+    {
+        // Keep reading records from the file until SamFile::ReadRecord
+        // indicates to stop (returns false).
+        while( ( (maxErrors < 0) || (totalErrorRecords < maxErrors) ) &&
+               ( (samIn.ReadRecord(samHeader, samRecord)) || (SamStatus::isContinuableStatus(samIn.GetStatus())) ) )
         {
-            // Successfully set the record, so check to see if it is valid.
-            // Clear any errors in the list.
-            invalidSamErrors.clear();
-            if(!SamValidator::isValid(samHeader, samRecord, invalidSamErrors))
+            ++numRecords;
+            if(samIn.GetStatus() == SamStatus::SUCCESS)
             {
-                // The record is not valid.
-                ++numInvalidRecords;
+                // Successfully set the record, so check to see if it is valid.
+                // Clear any errors in the list.
+                invalidSamErrors.clear();
+                if(!SamValidator::isValid(samHeader, samRecord, invalidSamErrors))
+                {
+                    // The record is not valid.
+                    ++numInvalidRecords;
+                    ++totalErrorRecords;
+                    if(verbose && (numReportedErrors < printableErrors))
+                    {
+                        out << "Record " << numRecords << std::endl
+                            << invalidSamErrors << std::endl;
+                        ++numReportedErrors;
+                    }
+                    // Update the statistics for all validation errors found in this record.
+                    invalidSamErrors.resetErrorIter();
+                    const SamValidationError* errorPtr = invalidSamErrors.getNextError();
+                    while(errorPtr != NULL)
+                    {
+                        ++invalidStats[errorPtr->getType()];
+                        errorPtr = invalidSamErrors.getNextError();
+                    }
+
+                    // If the status is not yet set, set it.
+                    if(status == SamStatus::SUCCESS)
+                    {
+                        status = SamStatus::INVALID;
+                    }
+                }
+                else
+                {
+                    // Valid record, so increment the counter.
+                    ++numValidRecords;
+                }
+            }
+            else
+            {
+                // Error reading the record.
+                ++numErrorRecords;
                 ++totalErrorRecords;
                 if(verbose && (numReportedErrors < printableErrors))
                 {
-                    std::cerr << "Record " << numRecords << std::endl
-                              << invalidSamErrors << std::endl;
+                    // report error.
+                    out << "Record " << numRecords << std::endl
+                        << samIn.GetStatusMessage() << std::endl
+                        << std::endl;
                     ++numReportedErrors;
                 }
-                // Update the statistics for all validation errors found in this record.
-                invalidSamErrors.resetErrorIter();
-                const SamValidationError* errorPtr = invalidSamErrors.getNextError();
-                while(errorPtr != NULL)
-                {
-                    ++invalidStats[errorPtr->getType()];
-                    errorPtr = invalidSamErrors.getNextError();
-                }
+                // Increment the statistics
+                ++errorStats[samIn.GetStatus()];
 
                 // If the status is not yet set, set it.
                 if(status == SamStatus::SUCCESS)
                 {
-                    status = SamStatus::INVALID;
+                    status = samIn.GetStatus();
                 }
             }
-            else
-            {
-                // Valid record, so increment the counter.
-                ++numValidRecords;
-            }
-        }
-        else
-        {
-            // Error reading the record.
-            ++numErrorRecords;
-            ++totalErrorRecords;
-            if(verbose && (numReportedErrors < printableErrors))
-            {
-                // report error.
-                std::cerr << "Record " << numRecords << std::endl
-                          << samIn.GetStatusMessage() << std::endl
-                          << std::endl;
-                ++numReportedErrors;
-            }
-            // Increment the statistics
-            ++errorStats[samIn.GetStatus()];
-
-            // If the status is not yet set, set it.
-            if(status == SamStatus::SUCCESS)
-            {
-                status = samIn.GetStatus();
-            }
         }
     }
 
@@ -277,8 +410,8 @@ int Validate::execute(int argc, char **argv)
         ++totalErrorRecords;
         if(numReportedErrors < printableErrors)
         {
-            std::cerr << "Record " << numRecords << ": ";
-            std::cerr << std::endl << samIn.GetStatusMessage() << std::endl;
+            out << "Record " << numRecords << ": ";
+            out << std::endl << samIn.GetStatusMessage() << std::endl;
         }
 
         // Increment the statistics
@@ -294,45 +427,420 @@ int Validate::execute(int argc, char **argv)
     {
         if(maxErrors == 0)
         {
-            std::cerr << "WARNING file was not read at all due to maxErrors setting, but returning Success.\n";
+            out << "WARNING file was not read at all due to maxErrors setting, but returning Success.\n";
         }
         else
         {
             // Print a note that the entire file was not read.
-            std::cerr << "File was not completely read due to the number of errors.\n";
-            std::cerr << "Statistics only reflect the part of the file that was read.\n";
+            out << "File was not completely read due to the number of errors.\n";
+            out << "Statistics only reflect the part of the file that was read.\n";
         }
     }
 
-    fprintf(stderr, "\nNumber of records read = %d\n", numRecords);
-    fprintf(stderr, "Number of valid records = %d\n", numValidRecords);
+    tallies.numRecords = numRecords;
+    tallies.numValidRecords = numValidRecords;
+    tallies.numInvalidRecords = numInvalidRecords;
+    tallies.numErrorRecords = numErrorRecords;
+    tallies.errorStats.swap(errorStats);
+    tallies.invalidStats.swap(invalidStats);
+    printTallies(tallies, out);
+    if(generateStatistics)
+    {
+        samIn.PrintStatistics();
+    }
+
+    out << "Returning: " << status << " ("
+        << SamStatus::getStatusString(status) << ")\n";
+    return(status);
+}
+
 
-    std::cerr << std::endl;
-    if(numRecords != numValidRecords)
+void Validate::printTallies(const Tallies& tallies, std::ostream& out)
+{
+    out << "\nNumber of records read = " << tallies.numRecords << "\n";
+    out << "Number of valid records = " << tallies.numValidRecords << "\n";
+
+    out << std::endl;
+    if(tallies.numRecords != tallies.numValidRecords)
     {
-        std::cerr << "Error Counts:\n";
+        out << "Error Counts:\n";
 
         // Loop through the non-validation errors.
-        std::map<SamStatus::Status, uint64_t>::iterator statusIter;
-        for(statusIter = errorStats.begin(); statusIter != errorStats.end(); statusIter++)
+        std::map<SamStatus::Status, uint64_t>::const_iterator statusIter;
+        for(statusIter = tallies.errorStats.begin(); 
+            statusIter != tallies.errorStats.end(); statusIter++)
+        {
+            out << "\t" << SamStatus::getStatusString(statusIter->first) << ": "
+                << statusIter->second << std::endl;
+        }
+
+        std::map<SamValidationError::Type, uint64_t>::const_iterator invalidIter;
+        for(invalidIter = tallies.invalidStats.begin(); 
+            invalidIter != tallies.invalidStats.end(); invalidIter++)
+        {
+            out << "\t" << SamValidationError::getTypeString(invalidIter->first) << ": "
+                << invalidIter->second << std::endl;
+        }
+
+        out << std::endl;
+    }
+}
+
+
+int Validate::reportListStatus(const std::vector<SamStatus::Status>& statuses,
+                               unsigned int numFailed)
+{
+    // Return the status of the first file that failed.
+    SamStatus::Status status = SamStatus::SUCCESS;
+    for(unsigned int i = 0; 
+        (i < statuses.size()) && (status == SamStatus::SUCCESS); i++)
+    {
+        status = statuses[i];
+    }
+    std::cerr << "Number of files = " << statuses.size() << "\n";
+    std::cerr << "Number of failed files = " << numFailed << "\n";
+    std::cerr << "Returning: " << status << " ("
+              << SamStatus::getStatusString(status) << ")\n";
+    return(status);
+}
+
+
+
+
+
+
+
+
+Validate::Tallies::Tallies()
+    : numRecords(0),
+      numValidRecords(0),
+      numInvalidRecords(0),
+      numErrorRecords(0),
+      errorStats(),
+      invalidStats()
+{
+}
+
+
+void Validate::Tallies::add(const Tallies& other)
+{
+    numRecords += other.numRecords;
+    numValidRecords += other.numValidRecords;
+    numInvalidRecords += other.numInvalidRecords;
+    numErrorRecords += other.numErrorRecords;
+    std::map<SamStatus::Status, uint64_t>::const_iterator statusIter;
+    for(statusIter = other.errorStats.begin();
+        statusIter != other.errorStats.end(); statusIter++)
+    {
+        errorStats[statusIter->first] += statusIter->second;
+    }
+    std::map<SamValidationError::Type, uint64_t>::const_iterator invalidIter;
+    for(invalidIter = other.invalidStats.begin();
+        invalidIter != other.invalidStats.end(); invalidIter++)
+    {
+        invalidStats[invalidIter->first] += invalidIter->second;
+    }
+}
+
+
+Validate::ValidateBatch::ValidateBatch()
+    : records(BATCH_SIZE),
+      statuses(BATCH_SIZE, SamStatus::SUCCESS),
+      statusMessages(BATCH_SIZE),
+      numRecords(0),
+      invalid(BATCH_SIZE, false),
+      invalidMessages(BATCH_SIZE),
+      tallies()
+{
+    for(unsigned int i = 0; i < BATCH_SIZE; i++)
+    {
+        records[i].reset(new SamRecord(ErrorHandler::RETURN));
+    }
+}
+
+
+SamStatus::Status Validate::validateInParallel(ThreadedSamFile& samIn,
+                                               SamFileHeader& samHeader,
+                                               bool verbose,
+                                               int printableErrors,
+                                               Tallies& tallies,
+                                               int& numReportedErrors)
+{
+    SamStatus::Status status = SamStatus::SUCCESS;
+    std::deque<PendingBatch> pending;
+    std::vector< std::unique_ptr<ValidateBatch> > freeBatches;
+    unsigned int maxPending = getNumThreads() * 2;
+
+    bool moreRecords = true;
+    while(moreRecords)
+    {
+        std::unique_ptr<ValidateBatch> batch;
+        if(freeBatches.empty())
+        {
+            batch.reset(new ValidateBatch);
+        }
+        else
+        {
+            batch = std::move(freeBatches.back());
+            freeBatches.pop_back();
+        }
+
+        // Read the records, stopping at the first failure that prevents
+        // reading further, which is reported by execute.
+        batch->numRecords = 0;
+        while(batch->numRecords < BATCH_SIZE)
         {
-            std::cerr << "\t" << SamStatus::getStatusString(statusIter->first) << ": "
-                      << statusIter->second << std::endl;
+            unsigned int index = batch->numRecords;
+            if(!samIn.ReadRecord(samHeader, *(batch->records[index])) &&
+               !SamStatus::isContinuableStatus(samIn.GetStatus()))
+            {
+                moreRecords = false;
+                break;
+            }
+            batch->statuses[index] = samIn.GetStatus();
+            if(batch->statuses[index] != SamStatus::SUCCESS)
+            {
+                batch->statusMessages[index] = samIn.GetStatusMessage();
+            }
+            ++batch->numRecords;
         }
 
-        std::map<SamValidationError::Type, uint64_t>::iterator invalidIter;
-        for(invalidIter = invalidStats.begin(); invalidIter != invalidStats.end(); invalidIter++)
+        if(batch->numRecords != 0)
         {
-            std::cerr << "\t" << SamValidationError::getTypeString(invalidIter->first) << ": "
-                      << invalidIter->second << std::endl;
+            ValidateBatch* batchPtr = batch.get();
+            PendingBatch next;
+            next.batch = std::move(batch);
+            next.result = getThreadPool().submit([&samHeader, verbose, batchPtr]()
+                {
+                    validateBatch(samHeader, verbose, *batchPtr);
+                });
+            pending.push_back(std::move(next));
         }
 
-        std::cerr << std::endl;
+        // Report the oldest batches once enough are queued.
+        while(!pending.empty() && 
+              (!moreRecords || (pending.size() > maxPending)))
+        {
+            PendingBatch& oldest = pending.front();
+            oldest.result.get();
+            reportBatch(*(oldest.batch), verbose, printableErrors,
+                        tallies, numReportedErrors, status);
+            freeBatches.push_back(std::move(oldest.batch));
+            pending.pop_front();
+        }
     }
-    samIn.PrintStatistics();
+    return(status);
+}
 
-    fprintf(stderr, "Returning: %d (%s)\n", status, SamStatus::getStatusString(status));
+
+void Validate::validateBatch(SamFileHeader& samHeader, bool verbose,
+                             ValidateBatch& batch)
+{
+    batch.tallies = Tallies();
+    SamValidationErrors invalidSamErrors;
+    for(unsigned int i = 0; i < batch.numRecords; i++)
+    {
+        batch.invalid[i] = false;
+        if(batch.statuses[i] != SamStatus::SUCCESS)
+        {
+            // Read errors are reported in order by reportBatch.
+            continue;
+        }
+
+        invalidSamErrors.clear();
+        if(SamValidator::isValid(samHeader, *(batch.records[i]),
+                                 invalidSamErrors))
+        {
+            ++batch.tallies.numValidRecords;
+            continue;
+        }
+
+        batch.invalid[i] = true;
+        ++batch.tallies.numInvalidRecords;
+        if(verbose)
+        {
+            std::ostringstream errorStream;
+            errorStream << invalidSamErrors;
+            batch.invalidMessages[i] = errorStream.str();
+        }
+        // Update the statistics for all validation errors found in this record.
+        invalidSamErrors.resetErrorIter();
+        const SamValidationError* errorPtr = invalidSamErrors.getNextError();
+        while(errorPtr != NULL)
+        {
+            ++batch.tallies.invalidStats[errorPtr->getType()];
+            errorPtr = invalidSamErrors.getNextError();
+        }
+    }
+}
+
+
+void Validate::reportBatch(ValidateBatch& batch, bool verbose,
+                           int printableErrors, Tallies& tallies,
+                           int& numReportedErrors, SamStatus::Status& status)
+{
+    for(unsigned int i = 0; i < batch.numRecords; i++)
+    {
+        ++tallies.numRecords;
+        if(batch.invalid[i])
+        {
+            if(verbose && (numReportedErrors < printableErrors))
+            {
+                std::cerr << "Record " << tallies.numRecords << std::endl
+                          << batch.invalidMessages[i] << std::endl;
+                ++numReportedErrors;
+            }
+            if(status == SamStatus::SUCCESS)
+            {
+                status = SamStatus::INVALID;
+            }
+        }
+        else if(batch.statuses[i] != SamStatus::SUCCESS)
+        {
+            // Error reading the record.
+            ++tallies.numErrorRecords;
+            if(verbose && (numReportedErrors < printableErrors))
+            {
+                std::cerr << "Record " << tallies.numRecords << std::endl
+                          << batch.statusMessages[i] << std::endl
+                          << std::endl;
+                ++numReportedErrors;
+            }
+            ++tallies.errorStats[batch.statuses[i]];
+            if(status == SamStatus::SUCCESS)
+            {
+                status = batch.statuses[i];
+            }
+        }
+    }
+    // The record counts were added above.
+    batch.tallies.numRecords = 0;
+    tallies.add(batch.tallies);
+}
+
+
+SamStatus::Status Validate::validateStructure(const char* inFile,
+                                              bool requireEof,
+                                              std::ostream& out)
+{
+    ParallelBgzfReader reader;
+    SamStatus::Status status = SamStatus::SUCCESS;
+    uint64_t numRecords = 0;
+    if(!reader.open(inFile, getThreadPool(), getNumThreads() * 4))
+    {
+        out << "Failed opening " << inFile
+            << ", it must be a BGZF compressed BAM file.\n";
+        status = SamStatus::FAIL_IO;
+    }
+    else
+    {
+        try
+        {
+            numRecords = checkFraming(reader);
+            if(requireEof && !reader.sawEofMarker())
+            {
+                out << "The file does not end with the BGZF EOF block, "
+                    << "it may be truncated.\n";
+                status = SamStatus::FAIL_IO;
+            }
+        }
+        catch(std::runtime_error& e)
+        {
+            out << e.what() << std::endl;
+            status = SamStatus::FAIL_PARSE;
+        }
+        reader.close();
+    }
+
+    out << "\nNumber of records read = " << numRecords << "\n";
+    out << "Returning: " << status << " ("
+        << SamStatus::getStatusString(status) << ")\n";
     return(status);
 }
 
 
+uint64_t Validate::checkFraming(ParallelBgzfReader& reader)
+{
+    static const char BAM_MAGIC[4] = {'B', 'A', 'M', 1};
+    // Fixed size portion of a record after the block size.
+    static const uint32_t FIXED_RECORD_SIZE = 32;
+
+    char magic[sizeof(BAM_MAGIC)];
+    int32_t textLen = 0;
+    int32_t numRefs = 0;
+    if((reader.read(magic, sizeof(magic)) != sizeof(magic)) ||
+       (memcmp(magic, BAM_MAGIC, sizeof(magic)) != 0))
+    {
+        throw(std::runtime_error("The file is not a BAM file."));
+    }
+    if((reader.read(&textLen, sizeof(textLen)) != sizeof(textLen)) ||
+       (textLen < 0) || (reader.skip(textLen) != (uint32_t)textLen) ||
+       (reader.read(&numRefs, sizeof(numRefs)) != sizeof(numRefs)) ||
+       (numRefs < 0))
+    {
+        throw(std::runtime_error("Truncated or invalid BAM header."));
+    }
+    for(int32_t i = 0; i < numRefs; i++)
+    {
+        int32_t nameLen = 0;
+        if((reader.read(&nameLen, sizeof(nameLen)) != sizeof(nameLen)) ||
+           (nameLen <= 0) ||
+           (reader.skip(nameLen + sizeof(int32_t)) != nameLen + sizeof(int32_t)))
+        {
+            throw(std::runtime_error("Truncated or invalid BAM header references."));
+        }
+    }
+
+    uint64_t numRecords = 0;
+    unsigned char fixed[FIXED_RECORD_SIZE];
+    while(true)
+    {
+        int32_t blockSize = 0;
+        uint32_t numRead = reader.read(&blockSize, sizeof(blockSize));
+        if(numRead == 0)
+        {
+            break;
+        }
+        ++numRecords;
+        std::string recordNum = std::to_string(numRecords);
+        if(numRead != sizeof(blockSize))
+        {
+            throw(std::runtime_error("Record " + recordNum + 
+                                     " is truncated."));
+        }
+        if(blockSize < (int32_t)FIXED_RECORD_SIZE)
+        {
+            throw(std::runtime_error("Record " + recordNum +
+                                     " has an invalid block size."));
+        }
+        if(reader.read(fixed, sizeof(fixed)) != sizeof(fixed))
+        {
+            throw(std::runtime_error("Record " + recordNum +
+                                     " is truncated."));
+        }
+
+        // The read name, cigar, sequence, and qualities must fit in
+        // the record.
+        uint32_t readNameLen = fixed[8];
+        uint32_t cigarLen = fixed[12] | (fixed[13] << 8);
+        int32_t readLen = 0;
+        memcpy(&readLen, fixed + 16, sizeof(readLen));
+        uint64_t variableLen = blockSize - FIXED_RECORD_SIZE;
+        uint64_t fieldsLen = (uint64_t)readNameLen + (4 * cigarLen);
+        if(readLen > 0)
+        {
+            fieldsLen += (((uint64_t)readLen + 1) / 2) + readLen;
+        }
+        if((readNameLen == 0) || (readLen < 0) || (fieldsLen > variableLen))
+        {
+            throw(std::runtime_error("Record " + recordNum +
+                                     " has fields longer than its block size."));
+        }
+        if(reader.skip(variableLen) != variableLen)
+        {
+            throw(std::runtime_error("Record " + recordNum +
+                                     " is truncated."));
+        }
+    }
+    return(numRecords);
+}
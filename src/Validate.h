@@ -23,16 +23,118 @@
 #ifndef __VALIDATE_H__
 #define __VALIDATE_H__
 
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "BamExecutable.h"
+#include "ThreadedSamFile.h"
+#include "ParallelBgzf.h"
+#include "SamValidation.h"
 
 class Validate : public BamExecutable
 {
 public:
+    Validate();
     static void printValidateDescription(std::ostream& os);
     void printDescription(std::ostream& os);
     void printUsage(std::ostream& os);
     int execute(int argc, char **argv);
     virtual const char* getProgramName() {return("bam:validate");}
+
+private:
+    static const unsigned int BATCH_SIZE = 1000;
+
+    // Counts summed over the validated records.
+    struct Tallies
+    {
+        Tallies();
+        void add(const Tallies& other);
+
+        int numRecords;
+        int numValidRecords;
+        int numInvalidRecords;
+        int numErrorRecords;
+        std::map<SamStatus::Status, uint64_t> errorStats;
+        std::map<SamValidationError::Type, uint64_t> invalidStats;
+    };
+
+    // Records read, in order, waiting to be validated by another thread.
+    struct ValidateBatch
+    {
+        ValidateBatch();
+        std::vector< std::unique_ptr<SamRecord> > records;
+        // Read status of each record, only SUCCESS records are validated.
+        std::vector<SamStatus::Status> statuses;
+        std::vector<std::string> statusMessages;
+        unsigned int numRecords;
+        // Set by the validating thread.
+        std::vector<bool> invalid;
+        // Errors of the invalid records when verbose.
+        std::vector<std::string> invalidMessages;
+        Tallies tallies;
+    };
+
+    struct PendingBatch
+    {
+        std::unique_ptr<ValidateBatch> batch;
+        std::future<void> result;
+    };
+
+    // Validate the file, writing the results to out and setting the
+    // counts in tallies.  A single file is read & validated on the thread
+    // pool and may generate statistics, otherwise it is all done on this
+    // thread (for validating listed files on the pool).
+    // Returns the first failure status or SUCCESS.
+    SamStatus::Status validateFile(const char* inFile, bool single,
+                                   std::ostream& out, Tallies& tallies);
+
+    // Print the record counts and the counts of each error.
+    static void printTallies(const Tallies& tallies, std::ostream& out);
+
+    // Print the number of listed files that failed, returning the status
+    // of the first one that failed or SUCCESS.
+    static int reportListStatus(const std::vector<SamStatus::Status>& statuses,
+                                unsigned int numFailed);
+
+    // Check the BGZF blocks (on the thread pool), the EOF block and the
+    // BAM header/record framing without parsing the records.
+    SamStatus::Status validateStructure(const char* inFile, bool requireEof,
+                                        std::ostream& out);
+    // Read the framing of the BAM header and records, returning the
+    // number of records, throwing std::runtime_error if it is invalid.
+    static uint64_t checkFraming(ParallelBgzfReader& reader);
+
+    // Validate the records of samIn on the thread pool.  The records are
+    // read (including the sort order check) on this thread and the
+    // results are reported in record order.  Returns the first failure
+    // status or SUCCESS.
+    SamStatus::Status validateInParallel(ThreadedSamFile& samIn,
+                                         SamFileHeader& samHeader,
+                                         bool verbose, int printableErrors,
+                                         Tallies& tallies,
+                                         int& numReportedErrors);
+
+    // Validate the successfully read records of the batch.
+    static void validateBatch(SamFileHeader& samHeader, bool verbose,
+                              ValidateBatch& batch);
+
+    // Add the batch's results to tallies, printing the errors.
+    static void reportBatch(ValidateBatch& batch, bool verbose,
+                            int printableErrors, Tallies& tallies,
+                            int& numReportedErrors,
+                            SamStatus::Status& status);
+
+    // Settings for validateFile.
+    GenomeSequence* myRefPtr;
+    SamFile::SortedType mySortType;
+    int myMaxErrors;
+    int myPrintableErrors;
+    bool myVerbose;
+    bool myDisableStatistics;
 };
 
 #endif
@@ -19,10 +19,15 @@
 // This file contains the processing for the executable option "writeRegion"
 // which writes a file with the reads in the specified region.
 
+#include <algorithm>
+
 #include "WriteRegion.h"
 #include "SamFile.h"
+#include "ThreadedSamFile.h"
 #include "Parameters.h"
 #include "BgzfFileType.h"
+#include "ReadNameIndex.h"
+#include "RemoteBamCache.h"
 
 #ifdef __GXX_EXPERIMENTAL_CXX0X__
 #include <unordered_set>
@@ -32,10 +37,36 @@ typedef std::unordered_set<std::string> ReadNameSet;
 typedef std::set<std::string> ReadNameSet;
 #endif
 
+// Returns true if no read names were specified or the record has one of
+// the specified read names.
+static bool matchesReadName(SamRecord& samRecord, const String& readName,
+                            const ReadNameSet& rnSet)
+{
+    if(!readName.IsEmpty())
+    {
+        // Check for readname.
+        if(strcmp(samRecord.getReadName(), readName.c_str()) != 0)
+        {
+            // not a matching read name.
+            return(false);
+        }
+    }
+    if(!rnSet.empty())
+    {
+        if(rnSet.count(samRecord.getReadName()) == 0)
+        {
+            // Not in the read name set.
+            return(false);
+        }
+    }
+    return(true);
+}
+
 WriteRegion::WriteRegion()
     : BamExecutable(),
       myWithinReg(false),
       myWroteReg(false),
+      myUseBed(false),
       myStart(UNSPECIFIED_INT),
       myEnd(UNSPECIFIED_INT),
       myPrevStart(UNSPECIFIED_INT),
@@ -44,11 +75,18 @@ WriteRegion::WriteRegion()
       myRefName(),
       myPrevRefName(),
       myBedRefID(SamReferenceInfo::NO_REF_ID),
-      myBedFile(NULL)
+      myOutputs(),
+      myBedSections(),
+      myBedSectionIndex(0)
 {
     
 }
 
+WriteRegion::~WriteRegion()
+{
+    closeOutputs();
+}
+
 void WriteRegion::printWriteRegionDescription(std::ostream& os)
 {
     os << " writeRegion - Write a file with reads in the specified region and/or have the specified read name" << std::endl;
@@ -62,13 +100,19 @@ void WriteRegion::printDescription(std::ostream& os)
 void WriteRegion::printUsage(std::ostream& os)
 {
     BamExecutable::printUsage(os);
-    os << "\t./bam writeRegion --in <inputFilename>  --out <outputFilename> [--bamIndex <bamIndexFile>] "
+    os << "\t./bam writeRegion --in <inputFilename>  (--out <outputFilename> | --manifest <manifestFilename>) [--bamIndex <bamIndexFile>] "
               << "[--refName <reference Name> | --refID <reference ID>] [--start <0-based start pos>] "
-              << "[--end <0-based end psoition>] [--bed <bed filename>] [--withinRegion] [--readName <readName>] [--rnFile <readNameFileName>] "
-              << "[--lshift] [--params] [--noeof]" << std::endl;
+              << "[--end <0-based end psoition>] [--bed <bed filename>] [--withinRegion] [--readName <readName>] [--rnFile <readNameFileName>] [--rnIndex <readNameIndex>] "
+              << "[--lshift] [--index] [--params] [--noeof]" << std::endl;
     os << "\tRequired Parameters:" << std::endl;
-    os << "\t\t--in        : the BAM file to be read" << std::endl;
+    os << "\t\t--in        : the BAM file to be read, or an http://, s3://, or file:// URL" << std::endl;
+    os << "\t\t              of one, of which only the blocks needed for the regions are fetched" << std::endl;
+    os << "\t\t              (cached in $BAM_REMOTE_CACHE, default $TMPDIR/bamRemoteCache)" << std::endl;
     os << "\t\t--out       : the SAM/BAM file to write to" << std::endl;
+    os << "\t\t--manifest  : instead of --out, a file of \"<bed filename>\\t<output filename>\" lines" << std::endl;
+    os << "\t\t              ('#' lines are skipped) to write the records in each bed file's" << std::endl;
+    os << "\t\t              regions to its output file, reading the union of the regions" << std::endl;
+    os << "\t\t              once.  Can't be used with --refName, --refID, --bed, or --rnIndex." << std::endl;
     os << "\tOptional Parameters for Specifying a Region:" << std::endl;
     os << "\t\t--bamIndex  : the path/name of the bam index file" << std::endl;
     os << "\t\t              (if not specified, uses the --in value + \".bai\")" << std::endl;
@@ -90,12 +134,17 @@ void WriteRegion::printUsage(std::ostream& os)
     os << "\t\t--readName  : only print reads with this read name." << std::endl;
     os << "\t\t--rnFile    : only print reads with read names found in the specified file,\n";
     os << "\t\t              delimited by comma, space, tab, or new line (',', ' ', '\\t', or '\\n')." << std::endl;
+    os << "\t\t--rnIndex   : read the records for --readName/--rnFile using the specified\n";
+    os << "\t\t              read name index (built by indexNames) rather than the whole file.\n";
+    os << "\t\t              Can't be used with a region." << std::endl;
     os << "\tOptional Parameters For Other Operations:\n";
     os << "\t\t--lshift        : left shift indels when writing records\n";
     os << "\t\t--excludeFlags  : Skip any records with any of the specified flags set\n";
     os << "\t\t                  (specify an integer representation of the flags)\n";
     os << "\t\t--requiredFlags : Only process records with all of the specified flags set\n";
     os << "\t\t                  (specify an integer representation of the flags)\n";
+    os << "\t\t--index         : index the BAM output as it is written (<outputFilename>.bai," << std::endl;
+    os << "\t\t                  or .csi if a reference is longer than 512Mb)" << std::endl;
     os << "\t\t--params        : print the parameter settings" << std::endl;
     os << "\t\t--noeof         : do not expect an EOF block on a bam file." << std::endl;
     os << std::endl;
@@ -110,7 +159,9 @@ int WriteRegion::execute(int argc, char **argv)
     String indexFile = "";
     String readName = "";
     String rnFile = "";
+    String rnIndex = "";
     String bed = "";
+    String manifest = "";
     ReadNameSet rnSet;
     myStart = UNSPECIFIED_INT;
     myEnd = UNSPECIFIED_INT;
@@ -120,19 +171,25 @@ int WriteRegion::execute(int argc, char **argv)
     myRefName.Clear();
     myPrevRefName.Clear();
     myBedRefID = SamReferenceInfo::NO_REF_ID;
+    closeOutputs();
+    myBedSections.clear();
+    myBedSectionIndex = 0;
     bool lshift = false;
+    bool index = false;
     bool noeof = false;
     bool params = false;
     String excludeFlags = "";
     String requiredFlags = "";
     myWithinReg = false;
     myWroteReg = false;
+    myUseBed = false;
 
     ParameterList inputParameters;
     BEGIN_LONG_PARAMETERS(longParameterList)
         LONG_PARAMETER_GROUP("Required Parameters")
         LONG_STRINGPARAMETER("in", &inFile)
         LONG_STRINGPARAMETER("out", &outFile)
+        LONG_STRINGPARAMETER("manifest", &manifest)
         LONG_PARAMETER_GROUP("Optional Region Parameters")        
         LONG_STRINGPARAMETER("bamIndex", &indexFile)
         LONG_STRINGPARAMETER("refName", &myRefName)
@@ -143,8 +200,10 @@ int WriteRegion::execute(int argc, char **argv)
         LONG_PARAMETER("withinReg", &myWithinReg)
         LONG_STRINGPARAMETER("readName", &readName)
         LONG_STRINGPARAMETER("rnFile", &rnFile)
+        LONG_STRINGPARAMETER("rnIndex", &rnIndex)
         LONG_PARAMETER_GROUP("Optional Other Parameters")
         LONG_PARAMETER("lshift", &lshift)
+        LONG_PARAMETER("index", &index)
         LONG_STRINGPARAMETER("excludeFlags", &excludeFlags)
         LONG_STRINGPARAMETER("requiredFlags", &requiredFlags)
         LONG_PARAMETER("noeof", &noeof)
@@ -175,7 +234,7 @@ int WriteRegion::execute(int argc, char **argv)
         std::cerr << "Missing mandatory argument: --in" << std::endl;
         return(-1);
     }
-    if(outFile == "")
+    if((outFile == "") && (manifest == ""))
     {
         printUsage(std::cerr);
         // mandatory argument was not specified.
@@ -183,7 +242,60 @@ int WriteRegion::execute(int argc, char **argv)
         std::cerr << "Missing mandatory argument: --out" << std::endl;
         return(-1);
     }
+    if(!manifest.IsEmpty())
+    {
+        if(!outFile.IsEmpty() || (myRefID != UNSET_REF) || 
+           (myRefName.Length() != 0) || !bed.IsEmpty() || !rnIndex.IsEmpty())
+        {
+            std::cerr << "Can't specify manifest with out, refID, refName, bed, or rnIndex" << std::endl;
+            inputParameters.Status();
+            return(-1);
+        }
+        if(!readManifest(manifest))
+        {
+            return(-1);
+        }
+    }
+    else
+    {
+        myOutputs.push_back(RegionOutput(bed, outFile));
+    }
     
+    // Only fetch the parts of a remote file that are needed.
+    if(RemoteFile::isRemote(inFile.c_str()))
+    {
+        std::vector<RemoteBamCache::Region> regions;
+        if(myRefName.Length() != 0)
+        {
+            regions.push_back(RemoteBamCache::Region(myRefName.c_str(),
+                                                     std::max(myStart, 0),
+                                                     myEnd));
+        }
+        else if(myRefID != UNSET_REF)
+        {
+            regions.push_back(RemoteBamCache::Region(myRefID,
+                                                     std::max(myStart, 0),
+                                                     myEnd));
+        }
+        for(unsigned int i = 0; i < myOutputs.size(); i++)
+        {
+            if(!myOutputs[i].bedName.IsEmpty() && 
+               !RemoteBamCache::readRegionFile(myOutputs[i].bedName.c_str(),
+                                               regions))
+            {
+                return(-1);
+            }
+        }
+        std::string localIn = inFile.c_str();
+        std::string localIndex = indexFile.c_str();
+        if(!RemoteBamCache::localize(localIn, localIndex, regions))
+        {
+            return(-1);
+        }
+        inFile = localIn.c_str();
+        indexFile = localIndex.c_str();
+    }
+
     if(indexFile == "")
     {
         // In file was not specified, so set it to the in file
@@ -210,9 +322,38 @@ int WriteRegion::execute(int argc, char **argv)
         return(-1);
     }
 
-    if(!bed.IsEmpty())
+    if(!rnIndex.IsEmpty())
     {
-        myBedFile = ifopen(bed, "r");
+        if((myRefID != UNSET_REF) || (myRefName.Length() != 0) || 
+           (bed.Length() != 0))
+        {
+            std::cerr << "Can't specify both a region and rnIndex" << std::endl;
+            inputParameters.Status();
+            return(-1);
+        }
+        if(readName.IsEmpty() && rnFile.IsEmpty())
+        {
+            std::cerr << "rnIndex requires readName or rnFile" << std::endl;
+            inputParameters.Status();
+            return(-1);
+        }
+    }
+
+    for(unsigned int i = 0; i < myOutputs.size(); i++)
+    {
+        RegionOutput& output = myOutputs[i];
+        if(output.bedName.IsEmpty())
+        {
+            continue;
+        }
+        output.bedFile = ifopen(output.bedName, "r");
+        if((output.bedFile == NULL) && !manifest.IsEmpty())
+        {
+            std::cerr << "ERROR: Could not open bed file: " 
+                      << output.bedName << std::endl;
+            return(-1);
+        }
+        myUseBed = myUseBed || (output.bedFile != NULL);
     }
 
     if(!rnFile.IsEmpty())
@@ -251,60 +392,124 @@ int WriteRegion::execute(int argc, char **argv)
 
     mySamIn.SetReadFlags(requiredFlags.AsInteger(), excludeFlags.AsInteger());
 
-    // Open the output file for writing.
-    SamFile samOut;
-    samOut.OpenForWrite(outFile);
+    // Open the output files for writing.
+    for(unsigned int i = 0; i < myOutputs.size(); i++)
+    {
+        myOutputs[i].samOut = new ThreadedSamFile();
+        myOutputs[i].samOut->setWriteIndex(index);
+        myOutputs[i].samOut->OpenForWrite(myOutputs[i].outName);
+    }
 
     // Open the bam index file for reading if a region was specified.
-    if((myRefName.Length() != 0) || (myRefID != UNSET_REF) || (myBedFile != NULL))
+    if((myRefName.Length() != 0) || (myRefID != UNSET_REF) || myUseBed)
     {
         mySamIn.ReadBamIndex(indexFile);
     }
 
     // Read & write the sam header.
     mySamIn.ReadHeader(mySamHeader);
-    samOut.WriteHeader(mySamHeader);
+    for(unsigned int i = 0; i < myOutputs.size(); i++)
+    {
+        myOutputs[i].samOut->WriteHeader(mySamHeader);
+    }
+
+    if(myUseBed)
+    {
+        RegionLists allRegions;
+        for(unsigned int i = 0; i < myOutputs.size(); i++)
+        {
+            if(myOutputs[i].bedFile != NULL)
+            {
+                loadBed(myOutputs[i], allRegions);
+                ifclose(myOutputs[i].bedFile);
+                myOutputs[i].bedFile = NULL;
+            }
+        }
+        setBedSections(allRegions);
+    }
 
     // Read the sam records.
     SamRecord samRecord;
-    // Track the status.
-    int numSectionRecords = 0;
 
     // Set returnStatus to success.  It will be changed
     // to the failure reason if any of the writes fail.
     SamStatus::Status returnStatus = SamStatus::SUCCESS;
         
+    if(!rnIndex.IsEmpty())
+    {
+        // Look up the records with the read names rather than reading
+        // the whole file.
+        ReadNameIndex nameIndex;
+        if(!nameIndex.open(rnIndex.c_str(), inFile.c_str()))
+        {
+            return(-1);
+        }
+        std::vector<uint64_t> offsets;
+        if(!readName.IsEmpty())
+        {
+            nameIndex.find(readName.c_str(), offsets);
+        }
+        for(ReadNameSet::const_iterator iter = rnSet.begin(); 
+            iter != rnSet.end(); ++iter)
+        {
+            nameIndex.find(iter->c_str(), offsets);
+        }
+        // Read the records once each in file order.
+        std::sort(offsets.begin(), offsets.end());
+        offsets.erase(std::unique(offsets.begin(), offsets.end()), 
+                      offsets.end());
+
+        uint16_t required = requiredFlags.AsInteger();
+        uint16_t excluded = excludeFlags.AsInteger();
+        for(unsigned int i = 0; i < offsets.size(); i++)
+        {
+            if(!nameIndex.readRecord(offsets[i], mySamHeader, samRecord))
+            {
+                returnStatus = SamStatus::FAIL_IO;
+                break;
+            }
+            if(((samRecord.getFlag() & required) != required) ||
+               ((samRecord.getFlag() & excluded) != 0))
+            {
+                continue;
+            }
+            // Different read names can have the same hash in the index.
+            if(!matchesReadName(samRecord, readName, rnSet))
+            {
+                continue;
+            }
+
+            // Shift left if applicable.
+            if(lshift)
+            {
+                samRecord.shiftIndelsLeft();
+            }
+            myOutputs[0].samOut->WriteRecord(mySamHeader, samRecord);
+            ++myOutputs[0].numRecords;
+        }
+        // There are no sections to read.
+        myWroteReg = true;
+    }
+
     while(getNextSection())
     {
         // Keep reading records until they aren't anymore.
         while(mySamIn.ReadRecord(mySamHeader, samRecord))
         {
-            if(!readName.IsEmpty())
+            if(!matchesReadName(samRecord, readName, rnSet))
             {
-                // Check for readname.
-                if(strcmp(samRecord.getReadName(), readName.c_str()) != 0)
-                {
-                    // not a matching read name, so continue to the next record.
-                    continue;
-                }
-            }
-            if(!rnSet.empty())
-            {
-                if(rnSet.count(samRecord.getReadName()) == 0)
-                {
-                    // Not in the read name set, so continue to the next record.
-                    continue;
-                }
+                // not a matching read name, so continue to the next record.
+                continue;
             }
 
             // Check to see if the read has already been processed.
             if(myPrevEnd != UNSPECIFIED_INT)
             {
-                // Because we already know that the bed was sorted, 
+                // Because the bed sections are sorted, 
                 // we know that the previous section started before
                 // this one, so if the previous end is greater than
                 // this record's start position we know that it
-                // was already written in the previous section.
+                // was already checked in the previous section.
                 // Note: can't be equal to the previous end since
                 // the end range was exclusive, while
                 // get0BasedPosition is inclusive.
@@ -312,30 +517,51 @@ int WriteRegion::execute(int argc, char **argv)
                 // chromosome is hit.
                 if(samRecord.get0BasedPosition() < myPrevEnd)
                 {
-                    // This record was already written.
+                    // This record was already checked.
                     continue;
                 }
             }
 
-            // Shift left if applicable.
-            if(lshift)
+            // Write the record to each output whose regions it is in.
+            bool shifted = false;
+            for(unsigned int i = 0; i < myOutputs.size(); i++)
             {
-                samRecord.shiftIndelsLeft();
-            }
+                RegionOutput& output = myOutputs[i];
+                if(myUseBed && !inBedRegion(samRecord, output.bedRegions))
+                {
+                    // The section also covers the gaps between bed
+                    // regions and the regions of the other outputs,
+                    // so skip records that are not in any of them.
+                    continue;
+                }
 
-            // Successfully read a record from the file, so write it.
-            samOut.WriteRecord(mySamHeader, samRecord);
-            ++numSectionRecords;
+                // Shift left if applicable.
+                if(lshift && !shifted)
+                {
+                    samRecord.shiftIndelsLeft();
+                    shifted = true;
+                }
+
+                // Successfully read a record from the file, so write it.
+                output.samOut->WriteRecord(mySamHeader, samRecord);
+                ++output.numRecords;
+            }
         }
         myWroteReg = true;
     }
 
-    if(myBedFile != NULL)
+    for(unsigned int i = 0; i < myOutputs.size(); i++)
     {
-        ifclose(myBedFile);
+        RegionOutput& output = myOutputs[i];
+        output.samOut->Close();
+        if(output.samOut->writeIndexFailed())
+        {
+            returnStatus = SamStatus::FAIL_IO;
+        }
+        std::cerr << "Wrote " << output.outName << " with " 
+                  << output.numRecords << " records.\n";
     }
-    std::cerr << "Wrote " << outFile << " with " << numSectionRecords
-              << " records.\n";
+    closeOutputs();
     return(returnStatus);
 }
 
@@ -366,123 +592,311 @@ bool WriteRegion::getNextSection()
         myStart = UNSPECIFIED_INT;
         myEnd = UNSPECIFIED_INT;
     }
-    else if(myBedFile != NULL)
+    else if(myUseBed)
     {
-        // There is a bed file, so read the next line.
-        while(!anotherSection)
+        if(myBedSectionIndex < myBedSections.size())
         {
-            myBedBuffer.Clear();
-            myBedBuffer.ReadLine(myBedFile);
-            if(ifeof(myBedFile) && myBedBuffer.IsEmpty())
+            BedSection& section = myBedSections[myBedSectionIndex];
+            // Records starting before the end of the previous section
+            // on this reference were already read in that section.
+            myPrevEnd = UNSPECIFIED_INT;
+            if((myBedSectionIndex != 0) && 
+               (myBedSections[myBedSectionIndex - 1].refID == section.refID))
             {
-                // End of the file, so break.
-                break;
-            }
-            // Not the end of the file, so parse the line.
-            myBedColumn.ReplaceColumns(myBedBuffer, '\t');
-            if(myBedColumn.Length() != 3)
-            {
-                // Incorrectly formatted line.
-                std::cerr << "Improperly formatted bed line: "
-                          << myBedBuffer
-                          << "; Skipping to the next line.\n";
+                myPrevEnd = myBedSections[myBedSectionIndex - 1].end;
             }
-            else
+            anotherSection = true;
+            // Read all records overlapping the section, inBedRegion
+            // checks them against the bed regions.
+            mySamIn.SetReadSection(section.refID, section.start, 
+                                   section.end, true);
+            ++myBedSectionIndex;
+        }
+    }
+    else
+    {
+        // If we have no bed file, then we only have another section
+        // if we have not already written a region.
+        anotherSection = !myWroteReg;
+    }
+    
+    return(anotherSection);
+}
+
+
+void WriteRegion::loadBed(RegionOutput& output, RegionLists& allRegions)
+{
+    RegionLists bedRegions;
+    myPrevRefName.Clear();
+    myBedRefID = SamReferenceInfo::NO_REF_ID;
+    myStart = UNSPECIFIED_INT;
+    myEnd = UNSPECIFIED_INT;
+    myPrevStart = UNSPECIFIED_INT;
+    myPrevEnd = UNSPECIFIED_INT;
+
+    while(true)
+    {
+        myBedBuffer.Clear();
+        myBedBuffer.ReadLine(output.bedFile);
+        if(ifeof(output.bedFile) && myBedBuffer.IsEmpty())
+        {
+            // End of the file, so break.
+            break;
+        }
+        // Not the end of the file, so parse the line.
+        myBedColumn.ReplaceColumns(myBedBuffer, '\t');
+        if(myBedColumn.Length() != 3)
+        {
+            // Incorrectly formatted line.
+            std::cerr << "Improperly formatted bed line: "
+                      << myBedBuffer
+                      << "; Skipping to the next line.\n";
+        }
+        else
+        {
+            // Check the reference name.
+            if(myPrevRefName != myBedColumn[0])
             {
-                // Check the reference name.
-                if(myPrevRefName != myBedColumn[0])
+                // New reference name (chromosome), so clear the previous
+                // start/end.
+                myPrevStart = UNSPECIFIED_INT;
+                myPrevEnd = UNSPECIFIED_INT;
+                myPrevRefName = myBedColumn[0];
+
+                // Get the reference ID for the reference name.
+                myBedRefID = mySamHeader.getReferenceID(myPrevRefName);
+                
+                // Check to see if the reference ID is found.
+                if(myBedRefID == SamReferenceInfo::NO_REF_ID)
                 {
-                    // New reference name (chromosome), so clear the previous
-                    // start/end.
-                    myPrevStart = UNSPECIFIED_INT;
-                    myPrevEnd = UNSPECIFIED_INT;
-                    myPrevRefName = myBedColumn[0];
-
-                    // Get the reference ID for the reference name.
-                    myBedRefID = mySamHeader.getReferenceID(myPrevRefName);
-                    
-                    // Check to see if the reference ID is found.
-                    if(myBedRefID == SamReferenceInfo::NO_REF_ID)
+                    // The specified Reference ID is not in the file,
+                    // so check to see if it has chr.
+                    // Check to see if it is the same except for 'chr' appended.
+                    if((myPrevRefName[0] == 'c') && 
+                       (myPrevRefName[1] == 'h') && 
+                       (myPrevRefName[2] == 'r'))
                     {
-                        // The specified Reference ID is not in the file,
-                        // so check to see if it has chr.
-                        // Check to see if it is the same except for 'chr' appended.
-                        if((myPrevRefName[0] == 'c') && 
-                           (myPrevRefName[1] == 'h') && 
-                           (myPrevRefName[2] == 'r'))
-                        {
-                            // It starts with chr, so look up with out the chr
-                            myBedRefID = mySamHeader.getReferenceID(myPrevRefName.c_str() + 3);
-                        }
+                        // It starts with chr, so look up with out the chr
+                        myBedRefID = mySamHeader.getReferenceID(myPrevRefName.c_str() + 3);
                     }
                 }
-                else
+            }
+            else
+            {
+                // Not a new reference name.
+                // Store the previous positions before overwriting them.
+                myPrevStart = myStart;
+                if(myPrevEnd < myEnd)
                 {
-                    // Not a new reference name.
-                    // Store the previous positions before overwriting them.
-                    myPrevStart = myStart;
-                    if(myPrevEnd < myEnd)
-                    {
-                        // The last section ends later than the previous one,
-                        // So update the previous latest end.
-                        myPrevEnd = myEnd;
-                    }
+                    // The last section ends later than the previous one,
+                    // So update the previous latest end.
+                    myPrevEnd = myEnd;
                 }
+            }
 
-                // If the refID is still NO_REF_ID, just continue to the next bed line.
-                if(myBedRefID == SamReferenceInfo::NO_REF_ID)
-                {
-                    continue;
-                }
+            // If the refID is still NO_REF_ID, just continue to the next bed line.
+            if(myBedRefID == SamReferenceInfo::NO_REF_ID)
+            {
+                continue;
+            }
 
-                // Correct number of columns, check the columns.
-                if(!myBedColumn[1].AsInteger(myStart))
-                {
-                    // The start position (2nd column) is not an integer.
-                    std::cerr << "Improperly formatted bed line, start position (2nd column) is not an integer: "
-                              << myBedColumn[1]
-                              << "; Skipping to the next line.\n";         
-                }
-                else if(!myBedColumn[2].AsInteger(myEnd))
-                {
-                    // The end position (3rd column) is not an integer.
-                    std::cerr << "Improperly formatted bed line, end position (3rd column) is not an integer: "
-                              << myBedColumn[2]
-                              << "; Skipping to the next line.\n";         
-                }
-                else if(myStart >= myEnd)
-                {
-                    // The start position is >= the end
-                    std::cerr << "Improperly formatted bed line, the start position is >= end position: "
-                              << myBedColumn[1]
-                              << " >= "
-                              << myBedColumn[2]
-                              << "; Skipping to the next line.\n";         
-                }
-                else if(myPrevStart > myStart)
-                {
-                    // Same reference name, but the position goes backwards.
-                    // This is against the assumption that the bed is sorted.
-                    std::cerr << "Improperly formatted bed, the start position is < the previous start (bed is assumed to be sorted): "
-                              << myStart
-                              << " < "
-                              << myPrevStart
-                              << "; Skipping to the next line.\n";
-                }
-                else
-                {
-                    anotherSection = true;
-                    mySamIn.SetReadSection(myBedRefID, myStart, myEnd, !myWithinReg);
-                }
+            // Correct number of columns, check the columns.
+            if(!myBedColumn[1].AsInteger(myStart))
+            {
+                // The start position (2nd column) is not an integer.
+                std::cerr << "Improperly formatted bed line, start position (2nd column) is not an integer: "
+                          << myBedColumn[1]
+                          << "; Skipping to the next line.\n";         
+            }
+            else if(!myBedColumn[2].AsInteger(myEnd))
+            {
+                // The end position (3rd column) is not an integer.
+                std::cerr << "Improperly formatted bed line, end position (3rd column) is not an integer: "
+                          << myBedColumn[2]
+                          << "; Skipping to the next line.\n";         
+            }
+            else if(myStart >= myEnd)
+            {
+                // The start position is >= the end
+                std::cerr << "Improperly formatted bed line, the start position is >= end position: "
+                          << myBedColumn[1]
+                          << " >= "
+                          << myBedColumn[2]
+                          << "; Skipping to the next line.\n";         
+            }
+            else if(myPrevStart > myStart)
+            {
+                // Same reference name, but the position goes backwards.
+                // This is against the assumption that the bed is sorted.
+                std::cerr << "Improperly formatted bed, the start position is < the previous start (bed is assumed to be sorted): "
+                          << myStart
+                          << " < "
+                          << myPrevStart
+                          << "; Skipping to the next line.\n";
+            }
+            else
+            {
+                bedRegions[myBedRefID].push_back(std::make_pair(myStart, myEnd));
             }
         }
     }
-    else
+
+    // Sort the regions on each reference.
+    RegionLists::iterator iter;
+    for(iter = bedRegions.begin(); iter != bedRegions.end(); ++iter)
     {
-        // If we have no bed file, then we only have another section
-        // if we have not already written a region.
-        anotherSection = !myWroteReg;
+        std::vector<std::pair<int, int> >& regions = iter->second;
+        std::sort(regions.begin(), regions.end());
+
+        BedRegions& sorted = output.bedRegions[iter->first];
+        int maxEnd = UNSPECIFIED_INT;
+        for(unsigned int i = 0; i < regions.size(); i++)
+        {
+            maxEnd = std::max(maxEnd, regions[i].second);
+            sorted.starts.push_back(regions[i].first);
+            sorted.maxEnds.push_back(maxEnd);
+        }
+        allRegions[iter->first].insert(allRegions[iter->first].end(),
+                                       regions.begin(), regions.end());
     }
-    
-    return(anotherSection);
+
+    myStart = UNSPECIFIED_INT;
+    myEnd = UNSPECIFIED_INT;
+    myPrevStart = UNSPECIFIED_INT;
+    myPrevEnd = UNSPECIFIED_INT;
+}
+
+
+void WriteRegion::setBedSections(RegionLists& allRegions)
+{
+    // Sort the regions on each reference and merge the nearby ones into
+    // the sections to read, so each part of the file is only read once.
+    RegionLists::iterator iter;
+    for(iter = allRegions.begin(); iter != allRegions.end(); ++iter)
+    {
+        std::vector<std::pair<int, int> >& regions = iter->second;
+        std::sort(regions.begin(), regions.end());
+        for(unsigned int i = 0; i < regions.size(); i++)
+        {
+            if(!myBedSections.empty() && 
+               (myBedSections.back().refID == iter->first) &&
+               (regions[i].first <= myBedSections.back().end + BED_MERGE_GAP))
+            {
+                // Close enough to read with the previous section.
+                myBedSections.back().end = 
+                    std::max(myBedSections.back().end, regions[i].second);
+            }
+            else
+            {
+                myBedSections.push_back(BedSection(iter->first, 
+                                                   regions[i].first,
+                                                   regions[i].second));
+            }
+        }
+    }
+}
+
+
+bool WriteRegion::inBedRegion(SamRecord& samRecord,
+                              const std::map<int, BedRegions>& bedRegions)
+{
+    std::map<int, BedRegions>::const_iterator iter = 
+        bedRegions.find(samRecord.getReferenceID());
+    if(iter == bedRegions.end())
+    {
+        return(false);
+    }
+    const BedRegions& regions = iter->second;
+
+    int start = samRecord.get0BasedPosition();
+    int end = samRecord.get0BasedAlignmentEnd();
+    if(end < start)
+    {
+        // No aligned bases, so just use the position.
+        end = start;
+    }
+
+    // Find the regions that start early enough to contain the record's
+    // start (withinReg) or its end (overlap).
+    int lastStart = end;
+    if(myWithinReg)
+    {
+        lastStart = start;
+    }
+    unsigned int numRegions = 
+        std::upper_bound(regions.starts.begin(), regions.starts.end(),
+                         lastStart) - regions.starts.begin();
+    if(numRegions == 0)
+    {
+        return(false);
+    }
+    // The bed end is exclusive.
+    if(myWithinReg)
+    {
+        return(regions.maxEnds[numRegions - 1] > end);
+    }
+    return(regions.maxEnds[numRegions - 1] > start);
+}
+
+
+bool WriteRegion::readManifest(const String& manifest)
+{
+    IFILE manifestFile = ifopen(manifest, "r");
+    if(manifestFile == NULL)
+    {
+        std::cerr << "ERROR: Could not open manifest file: " 
+                  << manifest << std::endl;
+        return(false);
+    }
+    String line;
+    StringArray columns;
+    bool valid = true;
+    while(valid)
+    {
+        line.Clear();
+        line.ReadLine(manifestFile);
+        if(ifeof(manifestFile) && line.IsEmpty())
+        {
+            break;
+        }
+        if(line.IsEmpty() || (line[0] == '#'))
+        {
+            continue;
+        }
+        columns.ReplaceColumns(line, '\t');
+        valid = ((columns.Length() == 2) && !columns[0].IsEmpty() && 
+                 !columns[1].IsEmpty());
+        if(!valid)
+        {
+            std::cerr << "ERROR: Improperly formatted manifest line, expected "
+                      << "<bed file>\\t<output file>: " << line << std::endl;
+        }
+        else
+        {
+            myOutputs.push_back(RegionOutput(columns[0], columns[1]));
+        }
+    }
+    ifclose(manifestFile);
+    if(valid && myOutputs.empty())
+    {
+        std::cerr << "ERROR: No outputs in manifest file: " 
+                  << manifest << std::endl;
+        valid = false;
+    }
+    return(valid);
+}
+
+
+void WriteRegion::closeOutputs()
+{
+    for(unsigned int i = 0; i < myOutputs.size(); i++)
+    {
+        if(myOutputs[i].bedFile != NULL)
+        {
+            ifclose(myOutputs[i].bedFile);
+        }
+        // Deleting an open file closes it.
+        delete myOutputs[i].samOut;
+    }
+    myOutputs.clear();
 }
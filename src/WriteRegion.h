@@ -22,13 +22,18 @@
 #ifndef __WRITE_REGION_H__
 #define __WRITE_REGION_H__
 
+#include <map>
+#include <vector>
+
 #include "BamExecutable.h"
 #include "SamFile.h"
+#include "ThreadedSamFile.h"
 
 class WriteRegion : public BamExecutable
 {
 public:
     WriteRegion();
+    ~WriteRegion();
     static void printWriteRegionDescription(std::ostream& os);
     void printDescription(std::ostream& os);
     void printUsage(std::ostream& os);
@@ -36,13 +41,71 @@ public:
     virtual const char* getProgramName() {return("bam:writeRegion");}
 
 private:
+    struct BedRegions;
+    struct RegionOutput;
+    // Regions by reference ID.
+    typedef std::map<int, std::vector<std::pair<int, int> > > RegionLists;
+
     bool getNextSection();
+    // Read the output's bed file into its sorted regions, adding them
+    // to allRegions.
+    void loadBed(RegionOutput& output, RegionLists& allRegions);
+    // Merge the regions of all of the outputs into the sections to read,
+    // so each part of the file is only read once.
+    void setBedSections(RegionLists& allRegions);
+    // Returns true if the record overlaps (or with --withinReg, is
+    // enclosed by) one of the bed regions on its reference.
+    bool inBedRegion(SamRecord& samRecord,
+                     const std::map<int, BedRegions>& bedRegions);
+    // Read the "<bed file>\t<output file>" lines of the manifest into
+    // the outputs.  Returns false after reporting the reason to stderr.
+    bool readManifest(const String& manifest);
+    void closeOutputs();
 
     static const int UNSPECIFIED_INT = -1;
     static const int UNSET_REF = -2;
+    // Bed regions closer than this are read as a single section.
+    // This is the size of the BAM linear index windows, so their
+    // index chunks would overlap, rereading the same blocks.
+    static const int BED_MERGE_GAP = 16384;
+
+    // The bed regions on a reference sorted by start position.
+    struct BedRegions
+    {
+        std::vector<int> starts;
+        // The largest end of the regions up to and including each one.
+        std::vector<int> maxEnds;
+    };
+
+    // A section of the file to read covering one or more bed regions.
+    struct BedSection
+    {
+        int refID;
+        int start;
+        int end;
+        BedSection(int id, int startPos, int endPos)
+            : refID(id), start(startPos), end(endPos) {}
+    };
+
+    // A file to write the records in the regions of a bed file to, or
+    // all of the records read if there are no bed files.
+    struct RegionOutput
+    {
+        String bedName;
+        String outName;
+        IFILE bedFile;
+        ThreadedSamFile* samOut;
+        std::map<int, BedRegions> bedRegions;
+        int numRecords;
+        RegionOutput(const String& bed, const String& out)
+            : bedName(bed), outName(out), bedFile(NULL), samOut(NULL),
+              bedRegions(), numRecords(0) {}
+    };
 
     bool myWithinReg;
     bool myWroteReg;
+    // Whether the sections to read are from bed files.
+    bool myUseBed;
 
     int myStart;
     int myEnd;
@@ -55,10 +118,13 @@ private:
     String myPrevRefName;
     int myBedRefID;
 
-    IFILE       myBedFile;
     String      myBedBuffer;
     StringArray myBedColumn;
 
+    std::vector<RegionOutput> myOutputs;
+    std::vector<BedSection> myBedSections;
+    unsigned int myBedSectionIndex;
+
     SamFile mySamIn;
     SamFileHeader mySamHeader;
 };
@@ -28,6 +28,45 @@ then
     ERROR=true
 fi
 
+# Validating on multiple threads reports the same results.
+../bin/bam validate --params --in testFiles/testInvalid.sam --refFile testFilesLibBam/chr1_partial.fa --v --noph --threads 3 2> results/validateInvalidThreads.txt
+diff results/validateInvalidThreads.txt expected/invalid.txt
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+../bin/bam validate --in testFiles/testInvalid2.bam  --v --noph --threads 2 2> results/validateInvalid2BamThreads.txt
+diff results/validateInvalid2BamThreads.txt expected/invalid2Bam.txt
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+../bin/bam validate --in testFiles/sortedBam1.bam --structureOnly --noph --threads 2 2> results/validateStructure.txt
+diff results/validateStructure.txt expected/validateStructure.txt
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+# Missing the EOF block.
+head -c 680 testFiles/sortedBam1.bam > results/validateStructureNoEof.bam
+../bin/bam validate --in results/validateStructureNoEof.bam --structureOnly --noph 2> results/validateStructureNoEof.txt
+diff results/validateStructureNoEof.txt expected/validateStructureNoEof.txt
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+# Truncated in the middle of a block.
+head -c 400 testFiles/sortedBam1.bam > results/validateStructureTruncated.bam
+../bin/bam validate --in results/validateStructureTruncated.bam --structureOnly --noph 2> results/validateStructureTruncated.txt
+if [ $? -eq 0 ]
+then
+    ERROR=true
+fi
+
 ../bin/bam validate --in testFiles/nonExistentFile.sam --refFile testFilesLibBam/chr1_partial.fa --v --noph 2> results/nonExistentFile.txt
 diff results/nonExistentFile.txt expected/nonExistentFile.txt
 if [ $? -ne 0 ]
@@ -35,6 +74,20 @@ then
     ERROR=true
 fi
 
+# Validating a list of files, several at a time, reports the same results.
+printf "testFiles/testInvalid.sam\ntestFiles/sortedBam1.bam\ntestFiles/testInvalid2.bam\n" > results/validateList.txt
+../bin/bam validate --inList results/validateList.txt --v --noph 2> results/validateList.log
+if [ $? -eq 0 ]
+then
+    ERROR=true
+fi
+../bin/bam validate --inList results/validateList.txt --v --noph --threads 3 2> results/validateListThreads.log
+diff results/validateListThreads.log results/validateList.log && grep -q "Number of failed files = 2" results/validateList.log
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
 if [ $? -ne 0 ]
 then
     ERROR=true
@@ -61,6 +114,21 @@ then
     ERROR=true
 fi
 
+# Test converting bam to sam and sam to bam, formatting/parsing the sam on multiple threads
+../bin/bam convert --in testFilesLibBam/testBam.bam --out results/convertBamThreads.sam --noph --threads 2 2> results/convertBamThreads.log && diff results/convertBamThreads.sam expected/convertBam.sam && diff results/convertBamThreads.log expected/convertSam.log \
+&& ../bin/bam convert --in testFilesLibBam/testSam.sam --out results/convertSamThreads.bam --noph --threads 2 2> results/convertSamThreads.log && diff results/convertSamThreads.bam expected/convertSam.bam && diff results/convertSamThreads.log expected/convertSam.log
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+# Test parsing a sam with CRLF line endings & empty Z tags on multiple threads
+../bin/bam convert --in testFiles/testCrlf.sam --out results/convertCrlfThreads.sam --noph --threads 2 2> results/convertCrlfThreads.log && diff results/convertCrlfThreads.sam expected/convertCrlfThreads.sam && diff results/convertCrlfThreads.log expected/convertCrlfThreads.log
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
 # Test converting sam to bam, writing to stdout
 ../bin/bam convert --in testFilesLibBam/testSam.sam --out -.bam --noph > results/convertSamStdout.bam 2> results/convertSamStdout.log && diff results/convertSamStdout.bam expected/convertSam.bam && diff results/convertSamStdout.log expected/convertSamStdout.log
 if [ $? -ne 0 ]
@@ -96,6 +164,13 @@ then
     ERROR=true
 fi
 
+# Test reading ubam, which is memory mapped
+../bin/bam convert --in testFilesLibBam/testBam.bam --out results/convertBam.ubam --noph 2> results/convertBamUbam.log && ../bin/bam convert --in results/convertBam.ubam --out results/convertUbam.sam --noph 2> results/convertUbam.log && diff results/convertUbam.sam expected/convertBam.sam && ../bin/bam convert --in results/convertBam.ubam --out results/convertUbamThreads.sam --threads 2 --noph 2> results/convertUbamThreads.log && diff results/convertUbamThreads.sam expected/convertBam.sam
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
 #TODO test reading & writing ubam over stdin/stdout.
 
 
@@ -4,6 +4,17 @@
 && diff results/splitSortedBam2.bam expected/splitSortedBam2.bam \
 && diff results/splitSortedBam3.bam expected/splitSortedBam3.bam \
 && diff results/splitSortedBamUnknownChrom.bam expected/splitSortedBamUnknownChrom.bam \
+&& \
+../bin/bam  splitChromosome --in testFilesLibBam/sortedBam.bam --out results/splitSortedBamThreads --noph --threads 2 2> results/splitChromosomeThreads.txt \
+&& diff results/splitChromosomeThreads.txt expected/splitChromosome.txt \
+&& diff results/splitSortedBamThreads1.bam expected/splitSortedBam1.bam \
+&& diff results/splitSortedBamThreads2.bam expected/splitSortedBam2.bam \
+&& diff results/splitSortedBamThreads3.bam expected/splitSortedBam3.bam \
+&& diff results/splitSortedBamThreadsUnknownChrom.bam expected/splitSortedBamUnknownChrom.bam \
+&& \
+../bin/bam  splitChromosome --in testFilesLibBam/sortedBam.bam --out results/shardSortedBam --shards 3 --noph --threads 2 2> results/splitChromosomeShards.txt \
+&& for shard in `grep -v "^#" results/shardSortedBamshards.txt | cut -f 1 | uniq`; do ../bin/bam convert --in $shard --out - --noph 2> /dev/null | grep -v "^@"; done > results/shardSortedBam.sam \
+&& ../bin/bam convert --in testFilesLibBam/sortedBam.bam --out - --noph 2> /dev/null | grep -v "^@" | diff - results/shardSortedBam.sam \
 
 if [ $? -ne 0 ]
 then
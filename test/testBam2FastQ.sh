@@ -25,6 +25,39 @@ let "status |= $?"
 diff results/testBam2FastQCoord.log expected/testBam2FastQCoord.log
 let "status |= $?"
 
+# Test limiting the mate map, spilling reads to disk to be paired at the
+# end.  The pairs are written in a different order, so compare sorted
+# records (with each first/second pair on one line).
+../bin/bam bam2FastQ --in testFiles/testBam2FastQCoord.sam --outBase results/testBam2FastQCoordSpill --maxMateMap 1 --noph 2> results/testBam2FastQCoordSpill.log
+let "status |= $?"
+diff <(paste - - - - < results/testBam2FastQCoordSpill.fastq | sort) <(paste - - - - < expected/testBam2FastQCoord.fastq | sort)
+let "status |= $?"
+diff <(paste <(paste - - - - < results/testBam2FastQCoordSpill_1.fastq) <(paste - - - - < results/testBam2FastQCoordSpill_2.fastq) | sort) <(paste <(paste - - - - < expected/testBam2FastQCoord_1.fastq) <(paste - - - - < expected/testBam2FastQCoord_2.fastq) | sort)
+let "status |= $?"
+diff <(grep "^Found \|^Failed \|^  (not" results/testBam2FastQCoordSpill.log) <(grep "^Found \|^Failed \|^  (not" expected/testBam2FastQCoord.log)
+let "status |= $?"
+if ls results/testBam2FastQCoordSpill.mateSpill* > /dev/null 2>&1
+then
+    echo "bam2FastQ did not remove its spill files."
+    let "status = 1"
+fi
+
+# Test collating the coordinate sorted file by read name through temporary
+# files, the pairs are written in read name bucket order.
+../bin/bam bam2FastQ --in testFiles/testBam2FastQCoord.sam --outBase results/testBam2FastQCoordCollate --collate --noph 2> results/testBam2FastQCoordCollate.log
+let "status |= $?"
+diff <(paste - - - - < results/testBam2FastQCoordCollate.fastq | sort) <(paste - - - - < expected/testBam2FastQCoord.fastq | sort)
+let "status |= $?"
+diff <(paste <(paste - - - - < results/testBam2FastQCoordCollate_1.fastq) <(paste - - - - < results/testBam2FastQCoordCollate_2.fastq) | sort) <(paste <(paste - - - - < expected/testBam2FastQCoord_1.fastq) <(paste - - - - < expected/testBam2FastQCoord_2.fastq) | sort)
+let "status |= $?"
+diff <(grep "^Found \|^Failed \|^  (not" results/testBam2FastQCoordCollate.log) <(grep "^Found \|^Failed \|^  (not" expected/testBam2FastQCoord.log)
+let "status |= $?"
+if ls results/testBam2FastQCoordCollate.collate* > /dev/null 2>&1
+then
+    echo "bam2FastQ did not remove its collate files."
+    let "status = 1"
+fi
+
 ##########################################
 # Test with secondary & supplementary
 ../bin/bam bam2FastQ --in testFiles/testBam2FastQCoordSecSup.sam --outBase results/testBam2FastQCoordSecSup --noph 2> results/testBam2FastQCoordSecSup.log
@@ -526,6 +559,30 @@ let "status |= $?"
 diff results/testBam2FastQCoordGZ.log expected/testBam2FastQCoord.log
 let "status |= $?"
 
+# Test writing compressed files with the FASTQ formatted and compressed on multiple threads.
+../bin/bam bam2FastQ --in testFiles/testBam2FastQCoord.sam --outBase results/testBam2FastQCoordGZThreads --gzip --noph --threads 3 2> results/testBam2FastQCoordGZThreads.log
+let "status |= $?"
+diff <(gunzip -c results/testBam2FastQCoordGZThreads.fastq) expected/testBam2FastQCoord.fastq
+let "status |= $?"
+diff <(gunzip -c results/testBam2FastQCoordGZThreads_1.fastq) expected/testBam2FastQCoord_1.fastq
+let "status |= $?"
+diff <(gunzip -c results/testBam2FastQCoordGZThreads_2.fastq) expected/testBam2FastQCoord_2.fastq
+let "status |= $?"
+diff results/testBam2FastQCoordGZThreads.log expected/testBam2FastQCoord.log
+let "status |= $?"
+
+# Test uncompressed files with the FASTQ formatted on multiple threads.
+../bin/bam bam2FastQ --in testFiles/testBam2FastQCoord.sam --outBase results/testBam2FastQCoordThreads --noph --threads 2 2> results/testBam2FastQCoordThreads.log
+let "status |= $?"
+diff results/testBam2FastQCoordThreads.fastq expected/testBam2FastQCoord.fastq
+let "status |= $?"
+diff results/testBam2FastQCoordThreads_1.fastq expected/testBam2FastQCoord_1.fastq
+let "status |= $?"
+diff results/testBam2FastQCoordThreads_2.fastq expected/testBam2FastQCoord_2.fastq
+let "status |= $?"
+diff results/testBam2FastQCoordThreads.log expected/testBam2FastQCoord.log
+let "status |= $?"
+
 ../bin/bam bam2FastQ --in testFiles/testBam2FastQCoordRG.sam --outBase results/testBam2FastQCoordRGgz --noph --splitRG --gzip 2> results/testBam2FastQCoordRGgz.log
 let "status |= $?"
 diff <(gunzip -c results/testBam2FastQCoordRGgz_1.fastq) expected/testBam2FastQCoordRG_1.fastq
@@ -614,6 +671,38 @@ let "status |= $?"
 diff results/testBam2FastQCoordChr1Pos76Baseg.log expected/testBam2FastQCoordChr1Pos76.log
 let "status |= $?"
 
+# Test reading each reference & the unmapped reads in parallel by index,
+# which must match reading the whole file.
+../bin/bam bam2FastQ --in testFiles/sortedBam1.bam --outBase results/testBam2FastQCoordAll --noph 2> results/testBam2FastQCoordAll.log
+let "status |= $?"
+../bin/bam bam2FastQ --in testFiles/sortedBam1.bam --outBase results/testBam2FastQCoordByIndex --byIndex --threads 3 --noph 2> results/testBam2FastQCoordByIndex.log
+let "status |= $?"
+diff results/testBam2FastQCoordByIndex.fastq results/testBam2FastQCoordAll.fastq
+let "status |= $?"
+diff results/testBam2FastQCoordByIndex_1.fastq results/testBam2FastQCoordAll_1.fastq
+let "status |= $?"
+diff results/testBam2FastQCoordByIndex_2.fastq results/testBam2FastQCoordAll_2.fastq
+let "status |= $?"
+diff results/testBam2FastQCoordByIndex.log results/testBam2FastQCoordAll.log
+let "status |= $?"
+# Test several regions, the overlapping ones read once.
+../bin/bam bam2FastQ --in testFiles/sortedBam1.bam --outBase results/testBam2FastQCoordRegions --noph --region 1:76:A,1:76 --threads 2 2> results/testBam2FastQCoordRegions.log
+let "status |= $?"
+diff results/testBam2FastQCoordRegions.fastq expected/testBam2FastQCoordChr1Pos76.fastq
+let "status |= $?"
+diff results/testBam2FastQCoordRegions_1.fastq expected/empty.txt
+let "status |= $?"
+diff results/testBam2FastQCoordRegions_2.fastq expected/empty.txt
+let "status |= $?"
+diff results/testBam2FastQCoordRegions.log expected/testBam2FastQCoordChr1Pos76.log
+let "status |= $?"
+../bin/bam bam2FastQ --in testFiles/sortedBam1.bam --outBase results/testBam2FastQCoordRegionsBase --noph --region 1:76:A,1:76:G 2> results/testBam2FastQCoordRegionsBase.log
+let "status |= $?"
+diff results/testBam2FastQCoordRegionsBase.fastq expected/testBam2FastQCoordChr1Pos76.fastq
+let "status |= $?"
+diff results/testBam2FastQCoordRegionsBase.log expected/testBam2FastQCoordChr1Pos76.log
+let "status |= $?"
+
 if [ $status != 0 ]
 then
   echo failed testBam2FastQ.sh
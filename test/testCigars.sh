@@ -5,5 +5,9 @@
 ../bin/bam findCigars --in testFiles/testRevert.sam --out results/cigarSoft.sam --csoft --noph 2> results/cigarSoft.log && diff results/cigarSoft.sam expected/cigarSoft.sam && diff results/cigarSoft.log expected/cigarSoft.log && \
 ../bin/bam findCigars --in testFiles/testRevert.sam --out results/cigarPad.sam --cpad --noph 2> results/cigarPad.log && diff results/cigarPad.sam expected/cigarPad.sam && diff results/cigarPad.log expected/cigarPad.log && \
 ../bin/bam findCigars --in testFiles/testRevert.sam --out results/cigarSkip.sam --cskip --noph 2> results/cigarSkip.log && diff results/cigarSkip.sam expected/cigarSkip.sam && diff results/cigarSkip.log expected/cigarSkip.log && \
-../bin/bam findCigars --in testFiles/testRevert.sam --out results/cigarDelHard.sam --cdel --chard --noph 2> results/cigarDelHard.log && diff results/cigarDelHard.sam expected/cigarDelHard.sam && diff results/cigarDelHard.log expected/cigarDelHard.log
+../bin/bam findCigars --in testFiles/testRevert.sam --out results/cigarDelHard.sam --cdel --chard --noph 2> results/cigarDelHard.log && diff results/cigarDelHard.sam expected/cigarDelHard.sam && diff results/cigarDelHard.log expected/cigarDelHard.log && \
+../bin/bam convert --in testFiles/testRevert.sam --out results/cachedCigars.bam --noph 2> results/cachedCigarsConvert.log && \
+../bin/bam findCigars --in results/cachedCigars.bam --out results/cigarDelHardBam.sam --cdel --chard --noph 2> results/cigarDelHardBam.log && \
+../bin/bam cacheFields --in results/cachedCigars.bam --noph 2> results/cachedCigarsCache.log && \
+../bin/bam findCigars --in results/cachedCigars.bam --out results/cigarDelHardCached.sam --cdel --chard --noph 2> results/cigarDelHardCached.log && diff results/cigarDelHardCached.sam results/cigarDelHardBam.sam && diff results/cigarDelHardCached.log results/cigarDelHardBam.log
 
@@ -17,6 +17,14 @@ let "status |= $?"
 diff results/testClipOverlapCoord.log expected/testClipOverlapCoord.log
 let "status |= $?"
 
+# A memory budget that fits the pool must not change the results
+../bin/bam clipOverlap --maxMem 64 --in testFiles/testClipOverlapCoord.sam --out results/testClipOverlapCoordMaxMem.sam --storeOrig XC --noph 2> results/testClipOverlapCoordMaxMem.log
+let "status |= $?"
+diff results/testClipOverlapCoordMaxMem.sam expected/testClipOverlapCoord.sam
+let "status |= $?"
+diff results/testClipOverlapCoordMaxMem.log expected/testClipOverlapCoord.log
+let "status |= $?"
+
 # Test clipping files sorted by coordinate with Secondary & Supplementary
 ../bin/bam clipOverlap --in testFiles/testClipOverlapCoordSecSup.sam --out results/testClipOverlapCoordSecSup.sam --storeOrig XC --noph 2> results/testClipOverlapCoordSecSup.log
 let "status |= $?"
@@ -69,6 +77,34 @@ let "status |= $?"
 diff results/testClipOverlapCoordPool0Clip.log expected/testClipOverlapCoordPool0Clip.log
 let "status |= $?"
 
+# Test clipping files sorted by coordinate with small pool spilling records
+# to temporary files rather than clipping without the mate.
+../bin/bam clipOverlap --in testFiles/testClipOverlapCoord.sam --out results/testClipOverlapCoordPool3Spill.sam --storeOrig XC --poolSize 3 --poolSpill --noph 2> results/testClipOverlapCoordPool3Spill.log
+let "status |= $?"
+diff <(grep -v "^@" results/testClipOverlapCoordPool3Spill.sam | sort) <(grep -v "^@" expected/testClipOverlapCoord.sam | sort)
+let "status |= $?"
+diff <(grep -v "^Spilled" results/testClipOverlapCoordPool3Spill.log) expected/testClipOverlapCoord.log
+let "status |= $?"
+if [ `ls results/testClipOverlapCoordPool3Spill.sam.clip* 2> /dev/null | wc -l` -ne 0 ]
+then
+    status=1
+    echo did not remove the clipOverlap spill files.
+fi
+
+# Test clipping after collating the records by read name through temporary
+# files, the pairs are written in read name bucket order.
+../bin/bam clipOverlap --collate --in testFiles/testClipOverlapReadName.sam --out results/testClipOverlapCollate.sam --storeOrig XC --noph 2> results/testClipOverlapCollate.log
+let "status |= $?"
+diff <(sort results/testClipOverlapCollate.sam) <(sort expected/testClipOverlapReadName.sam)
+let "status |= $?"
+diff results/testClipOverlapCollate.log expected/testClipOverlapReadName.log
+let "status |= $?"
+if [ `ls results/testClipOverlapCollate.sam.collate* 2> /dev/null | wc -l` -ne 0 ]
+then
+    status=1
+    echo did not remove the clipOverlap collate files.
+fi
+
 # Test clipping files sorted by read name with stats.
 ../bin/bam clipOverlap --stats --readName --in testFiles/testClipOverlapReadName.sam --out results/testClipOverlapReadNameStats.sam --storeOrig XC --noph 2> results/testClipOverlapReadNameStats.log
 let "status |= $?"
@@ -24,6 +24,72 @@ then
     let "status = 2"
 fi
 
+# single pass, reading from a file and from stdin
+../bin/bam dedup --onePass --in testFiles/testDedup.sam --out results/testDedupOnePass.sam --noph 2> results/testDedupOnePass.txt
+let "status |= $?"
+diff results/testDedupOnePass.txt expected/testDedup.txt
+let "status |= $?"
+diff results/testDedupOnePass.sam expected/testDedup.sam
+let "status |= $?"
+
+# use a small window to force records to be spilled to temporary files
+cat testFiles/testDedup.sam | ../bin/bam dedup --onePass --reorderWindow 3 --tmpPrefix results/testDedupSpill --in - --out results/testDedupOnePassStdin.sam --noph 2> results/testDedupOnePassStdin.txt
+let "status |= $?"
+diff results/testDedupOnePassStdin.txt expected/testDedup.txt
+let "status |= $?"
+diff results/testDedupOnePassStdin.sam expected/testDedup.sam
+let "status |= $?"
+
+# a memory budget smaller than the records must not change the results
+../bin/bam dedup --onePass --maxMem 1K --tmpPrefix results/testDedupMaxMem --in testFiles/testDedup.sam --out results/testDedupMaxMem.sam --noph 2> results/testDedupMaxMem.txt
+let "status |= $?"
+diff results/testDedupMaxMem.txt expected/testDedup.txt
+let "status |= $?"
+diff results/testDedupMaxMem.sam expected/testDedup.sam
+let "status |= $?"
+if ls results/testDedupSpill.* > /dev/null 2>&1
+then
+    echo "Dedup did not remove its temporary files."
+    let "status = 3"
+fi
+
+# merge the lanes of the file as they are read, in both modes
+../bin/bam dedup --list testFiles/testDedupLanes.txt --out results/testDedupLanes.sam --noph 2> results/testDedupLanes.txt
+let "status |= $?"
+diff results/testDedupLanes.sam expected/testDedup.sam
+let "status |= $?"
+../bin/bam dedup --onePass --list testFiles/testDedupLanes.txt --out results/testDedupLanesOnePass.sam --noph 2> results/testDedupLanesOnePass.txt
+let "status |= $?"
+diff results/testDedupLanesOnePass.sam expected/testDedup.sam
+let "status |= $?"
+
+../bin/bam dedup --onePass --reorderWindow 2 --tmpPrefix results/testDedup2Spill --in testFiles/testDedup2.sam --out results/testDedup2ForceOnePass.sam --force --noph 2> results/testDedup2ForceOnePass.txt
+let "status |= $?"
+diff results/testDedup2ForceOnePass.txt expected/testDedup.txt
+let "status |= $?"
+diff results/testDedup2ForceOnePass.sam expected/testDedup2F.sam
+let "status |= $?"
+
+# process each reference on its own thread, comparing against the
+# sequential results
+../bin/bam dedup --force --in testFiles/sortedBam1.bam --out results/testDedupSorted.bam --noph 2> results/testDedupSorted.txt
+let "status |= $?"
+../bin/bam dedup --threads 2 --byChrom --tmpPrefix results/testDedupByChrom --force --in testFiles/sortedBam1.bam --out results/testDedupByChrom.bam --noph 2> results/testDedupByChrom.txt
+let "status |= $?"
+diff results/testDedupByChrom.txt results/testDedupSorted.txt
+let "status |= $?"
+../bin/bam convert --in results/testDedupSorted.bam --out results/testDedupSorted.sam --noph 2> /dev/null
+let "status |= $?"
+../bin/bam convert --in results/testDedupByChrom.bam --out results/testDedupByChrom.sam --noph 2> /dev/null
+let "status |= $?"
+diff results/testDedupByChrom.sam results/testDedupSorted.sam
+let "status |= $?"
+if ls results/testDedupByChrom.part* > /dev/null 2>&1
+then
+    echo "Dedup did not remove its temporary files."
+    let "status = 3"
+fi
+
 ../bin/bam dedup --in testFiles/testDedup.sam --out results/testDedupIncSec.sam --excludeFlags 0xA04 --noph 2> results/testDedupIncSec.txt
 if [ $? -eq 0 ]
 then
@@ -61,6 +127,14 @@ let "status |= $?"
 sort results/testDedupRecab.sam.qemp | diff - expected/testDedupRecab.sam.qemp
 let "status |= $?"
 
+# build the table on the other threads while deduping
+../bin/bam dedup --recab --threads 3 --in testFiles/testDedup.sam --out results/testDedupRecabThreads.sam --refFile testFiles/ref_partial.fa --noph 2> results/testDedupRecabThreads.txt
+let "status |= $?"
+diff results/testDedupRecabThreads.sam expected/testDedupRecab.sam
+let "status |= $?"
+sort results/testDedupRecabThreads.sam.qemp | diff - expected/testDedupRecab.sam.qemp
+let "status |= $?"
+
 ../bin/bam recab --in results/testDedup.sam --out results/testDedupRecab2Step.sam --refFile testFiles/ref_partial.fa --noph 2> results/testDedupRecab2Step.txt
 let "status |= $?"
 diff results/testDedupRecab2Step.txt expected/empty.txt
@@ -199,6 +273,16 @@ let "status |= $?"
 sort results/testDedupRecabBin.sam.qemp | diff - expected/testDedupRecab.sam.qemp
 let "status |= $?"
 
+# dedup_LowMem with the keys sorted in temporary files must match keeping them in memory
+../bin/bam dedup_LowMem --in testFiles/testDedup.sam --out results/testDedupLowMem.sam --noph 2> results/testDedupLowMem.txt
+let "status |= $?"
+../bin/bam dedup_LowMem --maxMem 1 --tmpPrefix results/testDedupLowMemSort --in testFiles/testDedup.sam --out results/testDedupLowMemSort.sam --noph 2> results/testDedupLowMemSort.txt
+let "status |= $?"
+diff results/testDedupLowMemSort.txt results/testDedupLowMem.txt
+let "status |= $?"
+diff results/testDedupLowMemSort.sam results/testDedupLowMem.sam
+let "status |= $?"
+
 
 
 if [ $status != 0 ]
@@ -0,0 +1,32 @@
+#!/bin/bash
+
+status=0
+
+# The depth runs match the Depth column of the stats baseQC.
+../bin/bam depth --in testFiles/testStatsBaseQC.sam --out results/depthBaseQC.txt --noph 2> results/depthBaseQC.log
+let "status |= $?"
+diff results/depthBaseQC.txt expected/depthBaseQC.txt
+let "status |= $?"
+
+# Runs of the baseQC Depth column, joining adjacent positions with the same depth.
+../bin/bam stats --in testFiles/testStatsBaseQCSorted.bam --cBaseQC results/depthSortedBaseQC.txt --minMapQual 20 --noph 2> results/depthSortedBaseQC.log
+let "status |= $?"
+awk -F'\t' 'NR > 1 && $16 > 0 { if(($1 == c) && ($2 == e) && ($16 == d)) { e = $3 } else { if(c != "") print c"\t"s"\t"e"\t"d; c = $1; s = $2; e = $3; d = $16 } } END { if(c != "") print c"\t"s"\t"e"\t"d }' results/depthSortedBaseQC.txt > results/depthSortedExpected.txt
+../bin/bam depth --in testFiles/testStatsBaseQCSorted.bam --minMapQual 20 --noph > results/depthSorted.txt 2> results/depthSorted.log
+let "status |= $?"
+diff results/depthSorted.txt results/depthSortedExpected.txt
+let "status |= $?"
+
+# The indexed file is processed in shards on multiple threads.
+../bin/bam depth --in testFiles/testStatsBaseQCSorted.bam --minMapQual 20 --threads 3 --noph > results/depthSortedThreads.txt 2> results/depthSortedThreads.log
+let "status |= $?"
+diff results/depthSortedThreads.txt results/depthSortedExpected.txt
+let "status |= $?"
+
+if [ $status != 0 ]
+then
+  echo failed testDepth.sh
+  exit 1
+fi
+
+exit 0
@@ -1,6 +1,9 @@
 # Diff identical sam/bam
 ../bin/bam diff --in1 testFiles/testDiff1.sam --in2 testFiles/testDiff1.bam --seq --baseQual --tags "OP:i;MD:Z" --noph > results/diffSameSamBam.log 2> results/empty.log && diff results/diffSameSamBam.log expected/diffSameSamBam.log && diff results/empty.log expected/empty.txt \
 && \
+# Diff identical sam/bam matching by read name.
+../bin/bam diff --in1 testFiles/testDiff1.sam --in2 testFiles/testDiff1.bam --seq --baseQual --tags "OP:i;MD:Z" --byName --buckets 4 --tmpPrefix results/diffByName --noph > results/diffSameSamBamByName.log 2> results/empty.log && diff results/diffSameSamBamByName.log expected/diffSameSamBam.log && diff results/empty.log expected/empty.txt \
+&& \
 # Different order/pos on one of the records.
 ../bin/bam diff --in1 testFiles/testDiff1.sam --in2 testFiles/testDiff2.sam --seq --baseQual --tags "OP:i;MD:Z" --onlyDiffs --out results/diffOrderSam.log --noph 2> results/empty.log && diff results/diffOrderSam.log expected/diffOrderSam.log && diff results/empty.log expected/empty.txt \
 && \
@@ -7,6 +7,14 @@ then
     ERROR=true
 fi
 
+# Filtering on multiple threads writes the same records in the same order.
+../bin/bam filter --ref testFilesLibBam/chr1_partial.fa --in testFiles/testFilter.sam --mis .49 --qu 30 --noph --threads 3 > results/filterThreads.sam 2> results/filterThreads.log && diff results/filterThreads.sam expected/filter.sam && diff results/filterThreads.log expected/filter.log
+
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
 if($ERROR == true)
 then
   exit 1
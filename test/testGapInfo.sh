@@ -42,6 +42,16 @@ diff results/gapInfoDetailedCheckStrand.txt expected/gapInfoDetailedCheckStrand.
 let "status |= $?"
 diff results/gapInfoDetailedCheckStrand.log expected/empty.log
 let "status |= $?"
+../bin/bam convert --in testFiles/testGapInfo.sam --out results/cachedGapInfo.bam --noph 2> results/cachedGapInfoConvert.log
+let "status |= $?"
+../bin/bam cacheFields --in results/cachedGapInfo.bam --noph 2> results/cachedGapInfoCache.log
+let "status |= $?"
+../bin/bam gapInfo --in results/cachedGapInfo.bam --detailed --checkFirst --checkStrand --out results/gapInfoCached.txt --noph 2> results/gapInfoCached.log
+let "status |= $?"
+diff results/gapInfoCached.txt expected/gapInfoDetailedCheck.txt
+let "status |= $?"
+diff results/gapInfoCached.log expected/empty.log
+let "status |= $?"
 
 
 if [ $status != 0 ]
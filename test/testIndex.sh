@@ -0,0 +1,57 @@
+#!/bin/bash
+
+status=0
+
+# The BAI indexes match the ones distributed with the test files.
+../bin/bam index --in testFiles/sortedBam1.bam --out results/sortedBam1.bam.bai --noph 2> results/indexSortedBam1.txt
+let "status |= $?"
+cmp results/sortedBam1.bam.bai testFiles/sortedBam1.bam.bai
+let "status |= $?"
+diff results/indexSortedBam1.txt expected/indexSortedBam1.txt
+let "status |= $?"
+../bin/bam index --in testFiles/testStatsQual.bam --out results/testStatsQual.bam.bai --threads 3 --noph 2> results/indexStatsQual.txt
+let "status |= $?"
+cmp results/testStatsQual.bam.bai testFiles/testStatsQual.bam.bai
+let "status |= $?"
+
+# CSI indexes are BGZF compressed.
+../bin/bam index --in testFiles/sortedBam1.bam --out results/sortedBam1.bam.csi --csi --noph 2> results/indexSortedBam1Csi.txt
+let "status |= $?"
+if [ "`gzip -dc results/sortedBam1.bam.csi | head -c 3`" != "CSI" ]
+then
+  echo "bam index did not write a CSI index."
+  status=1
+fi
+
+# Indexes built while writing match those built by reading the output.
+../bin/bam writeRegion --in testFiles/sortedBam1.bam --out results/writeRegionIndexed.bam --index --noph 2> results/writeRegionIndexed.txt
+let "status |= $?"
+../bin/bam index --in results/writeRegionIndexed.bam --out results/writeRegionIndexed.bam.read.bai --noph 2> results/indexWriteRegionIndexed.txt
+let "status |= $?"
+cmp results/writeRegionIndexed.bam.bai results/writeRegionIndexed.bam.read.bai
+let "status |= $?"
+../bin/bam squeeze --in testFiles/testStatsQual.bam --out results/squeezeIndexed.bam --index --keepDups --threads 3 --noph 2> results/squeezeIndexed.txt
+let "status |= $?"
+../bin/bam index --in results/squeezeIndexed.bam --out results/squeezeIndexed.bam.read.bai --noph 2> results/indexSqueezeIndexed.txt
+let "status |= $?"
+cmp results/squeezeIndexed.bam.bai results/squeezeIndexed.bam.read.bai
+let "status |= $?"
+
+# Files not sorted by coordinate cannot be indexed.
+rm -f results/sortedReadName.bam.bai
+../bin/bam index --in testFiles/sortedReadName.bam --out results/sortedReadName.bam.bai --noph 2> results/indexSortedReadName.txt
+if [ $? == 0 ] || [ -e results/sortedReadName.bam.bai ]
+then
+  echo "bam index indexed an unsorted file."
+  status=1
+fi
+diff results/indexSortedReadName.txt expected/indexSortedReadName.txt
+let "status |= $?"
+
+if [ $status != 0 ]
+then
+  echo failed testIndex.sh
+  exit 1
+fi
+
+exit 0
@@ -320,6 +320,75 @@ then
 fi
 
 
+# Merge more files than can be open at once (in groups through temporary
+# files), and check it matches merging them all at once.
+../bin/bam mergeBam -o results/mergeSamMany.sam -i testFiles/sortedSam.sam -i testFiles/sortedSam1.sam -i testFiles/sortedSam.sam -i testFiles/sortedSam1.sam -i testFiles/sortedSam.sam --noph
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+../bin/bam mergeBam -o results/mergeSamManyMax2.sam -i testFiles/sortedSam.sam -i testFiles/sortedSam1.sam -i testFiles/sortedSam.sam -i testFiles/sortedSam1.sam -i testFiles/sortedSam.sam --noph --maxOpen 2 --tmpPrefix results/mergeSamManyTmp
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+diff results/mergeSamManyMax2.sam results/mergeSamMany.sam
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+if ls results/mergeSamManyTmp.merge* > /dev/null 2>&1
+then
+    echo "Unexpected temporary merge files."
+    ERROR=true
+fi
+
+../bin/bam mergeBam -o results/mergeBam3Reg13.sam -l testFiles/mergeBam3.list --noph -r 1,3
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+../bin/bam mergeBam -o results/mergeBam3Reg13Max2.sam -l testFiles/mergeBam3.list --noph -r 1,3 --maxOpen 2
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+diff results/mergeBam3Reg13Max2.sam results/mergeBam3Reg13.sam
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+
+# Merge each reference on its own thread, comparing against the
+# sequential results
+../bin/bam mergeBam --threads 3 --out results/mergeBamThreads.bam --list testFiles/mergeBam.list --tmpPrefix results/mergeBamThreads --noph
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+../bin/bam convert --in results/mergeBamThreads.bam --out results/mergeBamThreads.sam --noph 2> /dev/null
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+../bin/bam convert --in expected/mergeBam.bam --out results/mergeBamExpected.sam --noph 2> /dev/null
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+diff results/mergeBamThreads.sam results/mergeBamExpected.sam
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+if ls results/mergeBamThreads.part* > /dev/null 2>&1
+then
+    echo "Unexpected temporary merge files."
+    ERROR=true
+fi
+
+
 if($ERROR == true)
 then
   echo "Failed testMergeBam.sh"
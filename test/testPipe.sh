@@ -0,0 +1,77 @@
+ERROR=false
+
+../bin/bam pipe revert --in testFiles/testRevert.sam --cigar --qual --noph --then convert --out results/pipeRevert.sam --noph
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+diff results/pipeRevert.sam expected/revertSam.sam
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+../bin/bam pipe convert --in testFiles/testRevert.bam --noph --then revert --cigar --qual --noph --then convert --out results/pipeRevertBam.sam --noph
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+diff results/pipeRevertBam.sam expected/revertBam.sam
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+# A chain through dedup and recab matches running them one after another,
+# and its stages log to stderr rather than next to their pipe outputs.
+../bin/bam dedup --onePass --in testFiles/testDedup.sam --out results/pipeDedupSeq.bam --noph 2> results/pipeDedupSeq.log \
+&& ../bin/bam recab --in results/pipeDedupSeq.bam --out results/pipeDedupRecabSeq.sam --refFile testFiles/ref_partial.fa --buildSample 100000 --noph 2> results/pipeDedupRecabSeq.log
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+rm -f bampipe:*
+../bin/bam pipe convert --in testFiles/testDedup.sam --noph --then dedup --onePass --noph --then recab --refFile testFiles/ref_partial.fa --buildSample 100000 --noph --then convert --out results/pipeDedupRecab.sam --noph 2> results/pipeDedupRecab.log
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+diff results/pipeDedupRecab.sam results/pipeDedupRecabSeq.sam
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+if ls bampipe:* > /dev/null 2>&1
+then
+    ERROR=true
+fi
+
+# dedup --recab needs a second pass, so it cannot read a pipe.
+../bin/bam pipe convert --in testFiles/testDedup.sam --noph --then dedup --recab --refFile testFiles/ref_partial.fa --noph --then convert --out results/pipeInvalidRecab.sam --noph 2> results/pipeInvalidRecab.log
+if [ $? -eq 0 ] || ! grep -q "must use --onePass" results/pipeInvalidRecab.log
+then
+    ERROR=true
+fi
+
+# An invalid tool or an --out before the last tool is an error.
+../bin/bam pipe revert --in testFiles/testRevert.sam --noph --then notATool --out results/pipeInvalid.sam 2> results/pipeInvalid.log
+if [ $? -eq 0 ]
+then
+    ERROR=true
+fi
+
+../bin/bam pipe revert --in testFiles/testRevert.sam --out results/pipeInvalid.sam --noph --then convert --out results/pipeInvalid2.sam 2> results/pipeInvalid2.log
+if [ $? -eq 0 ]
+then
+    ERROR=true
+fi
+
+if($ERROR == true)
+then
+  exit 1
+fi
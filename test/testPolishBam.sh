@@ -1,5 +1,8 @@
 ERROR=false
 
+# Start without a cache of the reference MD5s, so the first run writes it.
+rm -f testFiles/testFasta.fa.refinfo
+
 ../bin/bam polishBam  --in testFiles/sortedSam.sam --out results/polishSam.sam --log results/polishSam.log --checkSQ --fasta testFiles/testFasta.fa --AS my37 --UR testFasta.fa --RG "@RG	ID:UM0037:1	SM:Sample2	LB:lb2	PU:mypu	CN:UMCORE	DT:2010-11-01	PL:ILLUMINA" --PG "@PG	ID:polish	VN:0.0.1" --SP new --HD "@HD	VN:1.0	SO:coordinate	GO:none" --noph
 if [ $? -ne 0 ]
 then
@@ -54,6 +57,44 @@ then
     ERROR=true
 fi
 
+tail -n +2 testFiles/testFasta.fa.refinfo | diff - expected/polishRefInfo.txt
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+../bin/bam polishBam  --in testFiles/sortedSam.sam --out results/polishSamNoCache.sam --log results/polishSamNoCache.log --checkSQ --fasta testFiles/testFasta.fa --AS my37 --UR testFasta.fa --RG "@RG	ID:UM0037:1	SM:Sample2	LB:lb2	PU:mypu	CN:UMCORE	DT:2010-11-01	PL:ILLUMINA" --PG "@PG	ID:polish	VN:0.0.1" --SP new --HD "@HD	VN:1.0	SO:coordinate	GO:none" --noph --noRefCache --threads 2
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+diff results/polishSamNoCache.sam expected/polishSam.sam
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+../bin/bam polishBam --in testFiles/sortedBam1.bam --out results/polishHeader.bam --log results/polishHeader.log --PG "@PG	ID:polish	VN:0.0.1" --HD "@HD	VN:1.0	SO:coordinate" --CO "@CO\tComment1" --noph
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+../bin/bam polishBam --in testFiles/sortedBam1.bam --out results/polishHeaderOnly.bam --log results/polishHeaderOnly.log --PG "@PG	ID:polish	VN:0.0.1" --HD "@HD	VN:1.0	SO:coordinate" --CO "@CO\tComment1" --noph --headerOnly
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+../bin/bam convert --in results/polishHeader.bam --out results/polishHeader.sam --noph && \
+../bin/bam convert --in results/polishHeaderOnly.bam --out results/polishHeaderOnly.sam --noph && \
+diff results/polishHeader.sam results/polishHeaderOnly.sam
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
 if($ERROR == true)
 then
   exit 1
@@ -52,6 +52,90 @@ let "status |= $?"
 diff -I "Start: .*" -I "End: .*" results/testRecabFast.sam.log expected/testRecabFast.sam.log
 let "status |= $?"
 
+# build the table using multiple threads
+../bin/bam recab --noph --threads 3 --fast --in testFiles/testRecab.sam --out results/testRecabThreads.sam --refFile testFilesLibBam/chr1_partial.fa --fitModel > results/testRecabThreads.txt 2> results/testRecabThreads.log
+let "status |= $?"
+diff results/testRecabThreads.sam expected/testRecab.sam
+let "status |= $?"
+diff results/testRecabThreads.txt expected/empty.txt
+let "status |= $?"
+diff results/testRecabThreads.log expected/empty.log
+let "status |= $?"
+diff <(sort results/testRecabThreads.sam.qemp) <(sort expected/testRecabFast.sam.qemp)
+let "status |= $?"
+diff -I "Start: .*" -I "End: .*" results/testRecabThreads.sam.log expected/testRecabFast.sam.log
+let "status |= $?"
+
+# pack the reference into shared memory, then attach to it
+../bin/bam recab --noph --sharedRef --fast --in testFiles/testRecab.sam --out results/testRecabShared.sam --refFile testFilesLibBam/chr1_partial.fa --fitModel > results/testRecabShared.txt 2> results/testRecabShared.log
+let "status |= $?"
+diff results/testRecabShared.sam expected/testRecab.sam
+let "status |= $?"
+../bin/bam recab --noph --sharedRef --threads 3 --fast --in testFiles/testRecab.sam --out results/testRecabShared2.sam --refFile testFilesLibBam/chr1_partial.fa --fitModel > results/testRecabShared2.txt 2> results/testRecabShared2.log
+let "status |= $?"
+diff results/testRecabShared2.sam expected/testRecab.sam
+let "status |= $?"
+diff <(sort results/testRecabShared2.sam.qemp) <(sort expected/testRecabFast.sam.qemp)
+let "status |= $?"
+sharedRef=`grep -o "Attached to the shared reference /bamUtil.packedRef.[0-9a-f]*" results/testRecabShared2.sam.log | cut -d / -f 2`
+if [ -z "$sharedRef" ]
+then
+    echo "Recab did not attach to the shared reference."
+    let "status = 1"
+else
+    rm -f /dev/shm/$sharedRef
+fi
+
+# save the table counts, then apply them without building the table
+../bin/bam recab --noph --in testFiles/testRecab.sam --out results/testRecabSave.sam --refFile testFilesLibBam/chr1_partial.fa --fitModel --saveTable results/testRecab.table > results/testRecabSave.txt 2> results/testRecabSave.log
+let "status |= $?"
+diff results/testRecabSave.sam expected/testRecab.sam
+let "status |= $?"
+diff results/testRecabSave.log expected/empty.log
+let "status |= $?"
+../bin/bam recab --noph --in testFiles/testRecab.sam --out results/testRecabLoad.sam --loadTable results/testRecab.table --fitModel > results/testRecabLoad.txt 2> results/testRecabLoad.log
+let "status |= $?"
+diff results/testRecabLoad.sam expected/testRecab.sam
+let "status |= $?"
+diff results/testRecabLoad.log expected/empty.log
+let "status |= $?"
+diff <(sort results/testRecabLoad.sam.qemp) <(sort expected/testRecab.sam.qemp)
+let "status |= $?"
+
+# a loaded table is applied reading stdin in a single pass
+cat testFiles/testRecab.sam | ../bin/bam recab --noph --in - --out results/testRecabLoadStdin.sam --loadTable results/testRecab.table --fitModel > results/testRecabLoadStdin.txt 2> results/testRecabLoadStdin.log
+let "status |= $?"
+diff results/testRecabLoadStdin.sam expected/testRecab.sam
+let "status |= $?"
+diff results/testRecabLoadStdin.log expected/empty.log
+let "status |= $?"
+
+# a leading sample holding every record matches building from the whole file
+cat testFiles/testRecab.sam | ../bin/bam recab --noph --in - --out results/testRecabSample.sam --refFile testFilesLibBam/chr1_partial.fa --fitModel --buildSample 1000 > results/testRecabSample.txt 2> results/testRecabSample.log
+let "status |= $?"
+diff results/testRecabSample.sam expected/testRecab.sam
+let "status |= $?"
+diff results/testRecabSample.log expected/empty.log
+let "status |= $?"
+diff <(sort results/testRecabSample.sam.qemp) <(sort expected/testRecab.sam.qemp)
+let "status |= $?"
+
+# the reads after a smaller sample are still counted in the report
+cat testFiles/testRecab.sam | ../bin/bam recab --noph --in - --out results/testRecabSample50.sam --refFile testFilesLibBam/chr1_partial.fa --fitModel --buildSample 50 > results/testRecabSample50.txt 2> results/testRecabSample50.log
+let "status |= $?"
+diff results/testRecabSample50.log expected/empty.log
+let "status |= $?"
+grep -q "^Counts of all 201 records, the table was built from the first 50:" results/testRecabSample50.sam.log
+let "status |= $?"
+diff <(sed -n '/^Counts of all/,/ref .N.:/p' results/testRecabSample50.sam.log | tail -n +2) <(sed -n '/^# mapped Reads observed/,/ref .N.:/p' expected/testRecab.sam.log)
+let "status |= $?"
+
+# loading a table twice sums its counts
+../bin/bam recab --noph --in testFiles/testRecab.sam --out results/testRecabLoad2.sam --loadTable results/testRecab.table,results/testRecab.table > results/testRecabLoad2.txt 2> results/testRecabLoad2.log
+let "status |= $?"
+diff <(sort results/testRecabLoad2.sam.qemp) <(sort expected/testRecabLoad2.sam.qemp)
+let "status |= $?"
+
 # Store the original quality
 ../bin/bam recab --noph --in testFiles/testRecab.sam --out results/testRecabStoreQ.sam --refFile testFilesLibBam/chr1_partial.fa --storeQualTag OQ --fitModel > results/testRecabStoreQ.txt 2> results/testRecabStoreQ.log
 let "status |= $?"
@@ -154,6 +238,23 @@ let "status |= $?"
 diff -I "Start: .*" -I "End: .*" results/testRecabDBSNPgz.sam.log expected/testRecabDBSNPgz.sam.log
 let "status |= $?"
 
+###############
+# Test with DBSNP converted to a bitmap
+../bin/bam indexSites --noph --in testFiles/dbsnp1.txt --out results/dbsnp1.ksb 2> results/dbsnp1.ksb.log
+let "status |= $?"
+../bin/bam recab --noph --in testFiles/testRecab.sam --out results/testRecabDBSNPksb.sam --refFile testFilesLibBam/chr1_partial.fa --dbsnp results/dbsnp1.ksb > results/testRecabDBSNPksb.txt 2> results/testRecabDBSNPksb.log
+let "status |= $?"
+diff results/testRecabDBSNPksb.sam expected/testRecabDBSNP.sam
+let "status |= $?"
+diff results/testRecabDBSNPksb.txt expected/empty.txt
+let "status |= $?"
+diff results/testRecabDBSNPksb.log expected/empty.txt
+let "status |= $?"
+diff <(sort results/testRecabDBSNPksb.sam.qemp) <(sort expected/testRecabDBSNP.sam.qemp)
+let "status |= $?"
+diff -I "Start: .*" -I "End: .*" -I "Writing .*" results/testRecabDBSNPksb.sam.log expected/testRecabDBSNP.sam.log
+let "status |= $?"
+
 ###############
 # Test with DBSNP, keeping even if previous is dbsnp
 ../bin/bam recab --noph --in testFiles/testRecab.sam --out results/testRecabDBSNPkeepPrev.sam --refFile testFilesLibBam/chr1_partial.fa --dbsnp testFiles/dbsnp1.txt --keepPrevDbsnp > results/testRecabDBSNPkeepPrev.txt 2> results/testRecabDBSNPkeepPrev.log
@@ -34,8 +34,23 @@ ERROR=false
 && \
 ../bin/bam convert --refFile testFilesLibBam/chr1_partial.fa --in testFiles/testFilter.bam --out results/seqBasesBam.bam --noph 2> results/seqBasesBam.bam.log --useBases && diff results/seqBasesBam.bam expected/seqBases.bam && diff results/seqBasesBam.bam.log expected/seq.log \
 && \
-../bin/bam convert --refFile testFilesLibBam/chr1_partial.fa --in testFiles/testFilter.bam --out results/seqEqualsBam.bam --noph 2> results/seqEqualsBam.bam.log --useEquals && diff results/seqEqualsBam.bam expected/seqEquals.bam && diff results/seqEqualsBam.bam.log expected/seq.log
+../bin/bam convert --refFile testFilesLibBam/chr1_partial.fa --in testFiles/testFilter.bam --out results/seqEqualsBam.bam --noph 2> results/seqEqualsBam.bam.log --useEquals && diff results/seqEqualsBam.bam expected/seqEquals.bam && diff results/seqEqualsBam.bam.log expected/seq.log \
+&& \
+# Encoding '=' on multiple threads gives the same records
+../bin/bam convert --refFile testFilesLibBam/chr1_partial.fa --in testFiles/testFilter.bam --out results/seqEqualsThreads.bam --noph --threads 3 2> results/seqEqualsThreads.bam.log --useEquals && diff results/seqEqualsThreads.bam expected/seqEquals.bam \
+&& \
+../bin/bam convert --refFile testFilesLibBam/chr1_partial.fa --in testFiles/testFilter.bam --out results/seqEqualsLshift.sam --noph --threads 3 --lshift 2> results/seqEqualsLshift.sam.log --useEquals \
+&& \
+../bin/bam convert --refFile testFilesLibBam/chr1_partial.fa --in testFiles/testFilter.bam --out results/seqEqualsLshift1.sam --noph --lshift 2> results/seqEqualsLshift1.sam.log --useEquals && diff results/seqEqualsLshift.sam results/seqEqualsLshift1.sam
+
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
 
+# Reads at or past the end of a reference shorter than the header
+# are left as they are.
+../bin/bam convert --refFile testFiles/ref_partial.fa --in testFiles/seqEqualsPastEnd.sam --out results/seqEqualsPastEnd.sam --noph 2> results/seqEqualsPastEnd.sam.log --useEquals && diff results/seqEqualsPastEnd.sam expected/seqEqualsPastEnd.sam && diff results/seqEqualsPastEnd.sam.log expected/seqEqualsPastEnd.log
 if [ $? -ne 0 ]
 then
     ERROR=true
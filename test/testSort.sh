@@ -0,0 +1,48 @@
+#!/bin/bash
+
+status=0
+
+# Sorting a read name sorted file gives the same records as the coordinate
+# sorted copy of that file.
+../bin/bam sort --in testFiles/sortedReadName.sam --out results/sortReadName.sam --noph 2> results/sortReadName.txt
+let "status |= $?"
+../bin/bam convert --in testFiles/sortedSam.sam --out results/sortSortedSam.sam --noph 2> results/sortSortedSam.txt
+let "status |= $?"
+diff <(grep -v '^@' results/sortReadName.sam) <(grep -v '^@' results/sortSortedSam.sam)
+let "status |= $?"
+grep -q "^@HD.*SO:coordinate" results/sortReadName.sam
+let "status |= $?"
+diff results/sortReadName.txt expected/empty.txt
+let "status |= $?"
+
+# Sorting in batches through temporary files, merging at most 2 at a
+# time, must match sorting in memory.
+../bin/bam sort --in testFiles/sortedReadName.sam --out results/sortReadNameRuns.sam --maxRecords 3 --maxOpen 2 --tmpPrefix results/sortReadNameRuns --noph 2> results/sortReadNameRuns.txt
+let "status |= $?"
+diff results/sortReadNameRuns.sam results/sortReadName.sam
+let "status |= $?"
+diff results/sortReadNameRuns.txt expected/empty.txt
+let "status |= $?"
+# The temporary files are removed.
+if ls results/sortReadNameRuns.*.ubam > /dev/null 2>&1
+then
+  status=1
+fi
+
+# Sorting a BAM on multiple threads matches sorting it on one
+../bin/bam sort --in testFiles/testBam2FastQReadName.bam --out results/sortBam2FastQ.sam --noph 2> results/sortBam2FastQ.txt
+let "status |= $?"
+../bin/bam sort --in testFiles/testBam2FastQReadName.bam --out results/sortBam2FastQThreads.sam --threads 3 --maxRecords 4 --tmpPrefix results/sortBam2FastQThreads --noph 2> results/sortBam2FastQThreads.txt
+let "status |= $?"
+diff results/sortBam2FastQThreads.sam results/sortBam2FastQ.sam
+let "status |= $?"
+../bin/bam validate --in results/sortBam2FastQ.sam --so_coord --noph 2> results/sortBam2FastQValidate.txt
+let "status |= $?"
+
+if [ $status != 0 ]
+then
+  echo failed testSort.sh
+  exit 1
+fi
+
+exit 0
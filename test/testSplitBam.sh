@@ -28,6 +28,21 @@ then
     ERROR=true
 fi
 
+# one output open at a time, compressing on multiple threads
+../bin/bam splitBam --in testFiles/splitBam.bam --out results/splitBamMax1 --maxOpen 1 --batchBlocks 1 --threads 2 --noph
+
+diff results/splitBamMax1.RG1.bam expected/split.RG1.bam
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+diff results/splitBamMax1.RG2.bam expected/split.RG2.bam
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
 if($ERROR == true)
 then
   exit 1
@@ -33,6 +33,22 @@ then
     ERROR=true
 fi
 
+# squeeze bam to bam using multiple threads for BGZF
+../bin/bam squeeze --threads 3 --in testFiles/squeeze.bam --out results/squeezeBamThreads.bam --noph 2> results/squeezeBamThreads2Bam.log && \
+diff results/squeezeBamThreads.bam expected/squeeze.bam && diff results/squeezeBamThreads2Bam.log expected/squeezeBam2Bam.log
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+# squeeze bam to sam using multiple threads for BGZF
+../bin/bam squeeze --in testFiles/squeeze.bam --out results/squeezeBamThreads.sam --noph --threads=2 2> results/squeezeBamThreads2Sam.log && \
+diff results/squeezeBamThreads.sam expected/squeezeBam.sam && diff results/squeezeBamThreads2Sam.log expected/squeezeBam2Sam.log
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
 
 # squeeze sam to sam, keep OQ, keep Dups
 ../bin/bam squeeze --in testFiles/squeeze.sam --out results/squeezeKeep.sam --keepDups --keepOQ --refFile testFilesLibBam/chr1_partial.fa --noph 2> results/squeezeKeep.log && \
@@ -90,6 +106,12 @@ then
     ERROR=true
 fi
 
+# the temporary read name map files should have been removed.
+if [ -e results/squeezeReadNameMap.txt.idx ] || [ -e results/squeezeReadNameMapBam.txt.idx ]
+then
+    ERROR=true
+fi
+
 # squeeze sorted by readname bam to sam, just reducing read names (keep OQ, keep dups).
 ../bin/bam squeeze --in testFiles/sortedReadName.sam --out results/squeezeReadNameSorted.sam --sreadName results/squeezeReadNameMapSamSorted.txt --keepDups --keepOQ --noph 2> results/squeezeReadNameSamSorted.log && \
 diff results/squeezeReadNameSorted.sam expected/squeezeReadNameSorted.sam && diff results/squeezeReadNameSamSorted.log expected/squeezeReadName.log && diff results/squeezeReadNameMapSamSorted.txt expected/squeezeReadNameMapSorted.txt
@@ -18,6 +18,11 @@
 ../bin/bam stats --basic --in testFilesLibBam/sortedBam.bam --noph 2> results/sortedStats.txt \
 && diff results/sortedStats.txt expected/sortedStats.txt \
 && \
+cp testFilesLibBam/sortedBam.bam results/cachedStats.bam \
+&& ../bin/bam cacheFields --in results/cachedStats.bam --noph 2> results/cachedStats.log \
+&& ../bin/bam stats --basic --in results/cachedStats.bam --noph 2> results/cachedStats.txt \
+&& diff results/cachedStats.txt expected/sortedStats.txt \
+&& \
 ../bin/bam stats --in testFilesLibBam/sortedBam.bam --qual --noph 2> results/sortedQualStats.txt \
 && diff results/sortedQualStats.txt expected/sortedQualStats.txt \
 && \
@@ -96,6 +101,11 @@
 ../bin/bam stats --in testFiles/testStatsBaseQCSorted.bam --pBaseQC results/statsBaseQCregDBPercent.txt --dbsnp testFiles/dbsnp.txt --regionList testFiles/region.txt --noph 2> results/statsBaseQCregDBPercent.log \
 && diff results/statsBaseQCregDBPercent.txt expected/statsBaseQCregDBPercent.txt && diff results/statsBaseQCregDBPercent.log expected/statsBaseQCreg.log \
 && \
+../bin/bam indexSites --in testFiles/dbsnp.txt --out results/dbsnp.ksb --noph 2> results/dbsnpKsb.log \
+&& \
+../bin/bam stats --in testFiles/testStatsBaseQCSorted.bam --cBaseQC results/statsBaseQCregDBksb.txt --dbsnp results/dbsnp.ksb --regionList testFiles/region.txt --noph 2> results/statsBaseQCregDBksb.log \
+&& diff results/statsBaseQCregDBksb.txt expected/statsBaseQCregDB.txt && diff results/statsBaseQCregDBksb.log expected/statsBaseQCreg.log \
+&& \
 ../bin/bam stats --in testFiles/testStatsBaseQC255.sam --cBaseQC results/statsBaseQCsam255.txt --noph 2> results/statsBaseQCsam255.log \
 && diff results/statsBaseQCsam255.txt expected/statsBaseQC255.txt && diff results/statsBaseQCsam255.log expected/statsBaseQC.log \
 && \
@@ -112,5 +122,41 @@
 && diff results/statsBaseQCregQual2SummaryNoDetail.log expected/statsBaseQCregQual2PercentSummary.log \
 && \
 ../bin/bam stats --in testFiles/testStatsBaseQCSorted.bam --regionList testFiles/region.txt --minMapQual 20 --baseSum --noph 2> results/statsBaseQCregQual20SummaryNoDetail.log \
-&& diff results/statsBaseQCregQual20SummaryNoDetail.log expected/statsBaseQCregQual20Summary.log 
-
+&& diff results/statsBaseQCregQual20SummaryNoDetail.log expected/statsBaseQCregQual20Summary.log \
+&& \
+../bin/bam stats --in testFiles/testStatsBaseQCSorted.bam --cBaseQC results/statsBaseQCSorted.txt --qual --baseSum --noph 2> results/statsBaseQCSorted.log \
+&& ../bin/bam stats --in testFiles/testStatsBaseQCSorted.bam --cBaseQC results/statsBaseQCSortedThreads.txt --qual --baseSum --threads 3 --noph 2> results/statsBaseQCSortedThreads.log \
+&& diff results/statsBaseQCSortedThreads.txt results/statsBaseQCSorted.txt && diff results/statsBaseQCSortedThreads.log results/statsBaseQCSorted.log \
+&& \
+../bin/bam stats --in testFiles/testStatsBaseQC.sam --bBaseQC results/statsBaseQC.bqc --noph 2> results/statsBaseQCbin.log \
+&& diff results/statsBaseQCbin.log expected/statsBaseQC.log \
+&& ../bin/bam baseQC --in results/statsBaseQC.bqc --out results/statsBaseQCbin.txt --noph \
+&& diff results/statsBaseQCbin.txt expected/statsBaseQC.txt \
+&& ../bin/bam baseQC --in results/statsBaseQC.bqc --percent --noph > results/statsBaseQCbinPercent.txt \
+&& diff results/statsBaseQCbinPercent.txt expected/statsBaseQCPercent.txt \
+&& ../bin/bam baseQC --in results/statsBaseQC.bqc --refName 1 --start 100 --end 110 --noph > results/statsBaseQCbinRegion.txt \
+&& awk '(NR == 1) || (($2 >= 100) && ($2 < 110))' expected/statsBaseQC.txt > results/statsBaseQCbinRegionExpected.txt \
+&& diff results/statsBaseQCbinRegion.txt results/statsBaseQCbinRegionExpected.txt \
+&& \
+../bin/bam stats --in testFiles/testStatsBaseQCSorted.bam --bBaseQC results/statsBaseQCSortedThreads.bqc --threads 3 --noph 2> results/statsBaseQCSortedThreadsBin.log \
+&& ../bin/bam baseQC --in results/statsBaseQCSortedThreads.bqc --noph > results/statsBaseQCSortedThreadsBin.txt \
+&& diff results/statsBaseQCSortedThreadsBin.txt results/statsBaseQCSorted.txt \
+&& \
+../bin/bam stats --in testFiles/testStatsBaseQCSorted.bam --idxStats --noph 2> results/idxStats.txt \
+&& diff results/idxStats.txt expected/idxStats.txt \
+&& \
+../bin/bam stats --in testFiles/testStatsBaseQCSorted.bam --idxStats --excludeFlags 1024 --noph 2> results/idxStatsExcludeDups.txt \
+&& diff results/idxStatsExcludeDups.txt expected/idxStatsExcludeDups.txt \
+&& \
+printf "testFilesLibBam/testSam.sam\ntestFilesLibBam/sortedBam.bam\n\ntestFiles/testStatsQual.bam\n" > results/statsList.txt \
+&& ../bin/bam stats --inList results/statsList.txt --basic --qual --noph 2> results/statsList.log \
+&& ../bin/bam stats --inList results/statsList.txt --basic --qual --threads 3 --noph 2> results/statsListThreads.log \
+&& diff results/statsListThreads.log results/statsList.log \
+&& grep -q "Number of failed files = 0" results/statsList.log \
+&& \
+../bin/bam stats --in testFilesLibBam/sortedBam.bam --basic --sample 4 --noph 2> results/sampleStats.txt \
+&& head -n 17 results/sampleStats.txt | diff - expected/sortedStats.txt \
+&& grep -q "^Estimate	" results/sampleStats.txt \
+&& ../bin/bam stats --in testFilesLibBam/sortedBam.bam --qual --sample 4 --threads 3 --noph 2> results/sampleQualStats.txt \
+&& head -n 97 results/sampleQualStats.txt | diff - expected/sortedQualStats.txt \
+&& grep -q "^MeanPhred	" results/sampleQualStats.txt
@@ -126,6 +126,21 @@ then
     ERROR=true
 fi
 
+# Clipping a sorted file with --keepSorted leaves it sorted, so it can be indexed.
+../bin/bam trimBam testFiles/sortedBam1.bam results/clipSorted.bam 5 -c --keepSorted --noph 2> results/testClipSorted.log &&
+../bin/bam index --in results/clipSorted.bam --noph 2> results/indexClipSorted.log
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
+../bin/bam trimBam testFiles/sortedBam1.bam results/clipSortedThreads.bam -L 3 -R 1 -c -s --threads 3 --noph 2> results/testClipSortedThreads.log &&
+../bin/bam index --in results/clipSortedThreads.bam --noph 2> results/indexClipSortedThreads.log
+if [ $? -ne 0 ]
+then
+    ERROR=true
+fi
+
 
 if($ERROR == true)
 then
@@ -36,6 +36,12 @@ ERROR=false
 ../bin/bam writeRegion --noph --in testFilesLibBam/sortedBam.bam --out results/regionRead11.sam --bed testFiles/bedFile2.bed 2> results/regionRead11.txt \
 && diff results/regionRead11.sam expected/regionRead9.sam && diff results/regionRead11.txt expected/regionRead11.txt \
 && \
+../bin/bam writeRegion --noph --in testFilesLibBam/sortedBam.bam --out results/regionRead12.sam --bed testFiles/bedFile3.bed --withinReg 2> results/regionRead12.txt \
+&& diff results/regionRead12.sam expected/regionRead8.sam && diff results/regionRead12.txt expected/regionRead12.txt \
+&& \
+../bin/bam writeRegion --noph --in testFilesLibBam/sortedBam.bam --out results/regionRead13.sam --bed testFiles/bedFile3.bed 2> results/regionRead13.txt \
+&& diff results/regionRead13.sam expected/regionRead9.sam && diff results/regionRead13.txt expected/regionRead13.txt \
+&& \
 ../bin/bam writeRegion --noph --in testFilesLibBam/testShift.sam --out results/regionShift.sam --lshift 2> results/regionShift.txt \
 && diff results/regionShift.sam expected/regionShift.sam && diff results/regionShift.txt expected/regionShift.txt\
 && \
@@ -50,6 +56,23 @@ ERROR=false
 && \
 ../bin/bam writeRegion --noph --in testFilesLibBam/sortedBam.bam --out results/regionReadRnFile3.sam --rnFile testFiles/rn3.txt 2> results/regionReadRnFile3.txt \
 && diff results/regionReadRnFile3.sam expected/regionReadRnFile2.sam && diff results/regionReadRnFile3.txt expected/regionReadRnFile3.txt \
+&& \
+../bin/bam indexNames --noph --in testFilesLibBam/sortedBam.bam --out results/sortedBam.rni 2> results/sortedBamRni.txt \
+&& \
+../bin/bam writeRegion --noph --in testFilesLibBam/sortedBam.bam --out results/regionReadRnIndex.sam --readName "1:1011:F:255+17M15D20M" --rnIndex results/sortedBam.rni 2> results/regionReadRnIndex.txt \
+&& diff results/regionReadRnIndex.sam expected/regionRead.sam && diff results/regionReadRnIndex.txt expected/regionReadRnIndex.txt \
+&& \
+../bin/bam writeRegion --noph --in testFilesLibBam/sortedBam.bam --out results/regionReadRnIndex2.sam --rnFile testFiles/rn2.txt --rnIndex results/sortedBam.rni 2> results/regionReadRnIndex2.txt \
+&& diff results/regionReadRnIndex2.sam expected/regionReadRnFile2.sam && diff results/regionReadRnIndex2.txt expected/regionReadRnIndex2.txt \
+&& \
+../bin/bam writeRegion --noph --in testFilesLibBam/sortedBam.bam --manifest testFiles/regionManifest.txt 2> results/regionManifest.txt \
+&& diff results/regionManifest1.sam expected/regionRead9.sam && diff results/regionManifest2.sam expected/regionRead9.sam \
+&& diff results/regionManifest3.sam expected/regionRead2.sam && diff results/regionManifest.txt expected/regionManifest.txt \
+&& \
+rm -rf results/remoteCache \
+&& \
+BAM_REMOTE_CACHE=results/remoteCache ../bin/bam writeRegion --noph --in file://$PWD/testFilesLibBam/sortedBam.bam --out results/regionReadRemote.sam --refName 1 --start 1010 --end 1011 2> results/regionReadRemote.txt \
+&& diff results/regionReadRemote.sam expected/regionRead2.sam \
 
 if [ $? -ne 0 ]
 then